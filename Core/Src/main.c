@@ -25,6 +25,7 @@
 /* Private includes ----------------------------------------------------------*/
 /* USER CODE BEGIN Includes */
 #include "asmart_comm_handler.h"
+#include "asmart_comm_pt.h"
 
 
 /* USER CODE END Includes */
@@ -36,6 +37,8 @@ uint8_t payload_recv[100];
 uint8_t command_flag = 0;
 uint8_t notif_flag = 0;
 aSmart_Comm_Handler_t comm_handler;
+aSmart_Pt_t transaction_pt;
+aSmart_Request_t transaction_request;
 
 const uint8_t command_payload[4] = {0xaa,0xdd,0xcc,0xbb};
   
@@ -62,6 +65,7 @@ const uint8_t command_payload[4] = {0xaa,0xdd,0xcc,0xbb};
 void SystemClock_Config(void);
 /* USER CODE BEGIN PFP */
 void response_handler(uint8_t message_type, uint8_t command_type, uint16_t sequence_number, uint8_t* payload, uint16_t length);
+static uint8_t transaction_flow(aSmart_Pt_t* pt);
 
 /* USER CODE END PFP */
 
@@ -111,18 +115,28 @@ int main(void)
   /* USER CODE BEGIN WHILE */
 	asmart_comm_init(&comm_handler, response_handler);
 	
+	/* DE timing and response gap of the RS485 link, from its baud rate */
+	aSmart_Rs485Timing_t rs485_timing;
+	asmart_rs485_timing(&rs485_timing, hlpuart2.Init.BaudRate, NULL);
+	asmart_comm_set_rs485(&comm_handler, &rs485_timing);
+	PT_INIT(&transaction_pt);
+	
 	
   while (1)
   {
-		if(command_flag){
-			asmart_comm_send_command(&comm_handler, COMMAND_TYPE_BEGIN_TRANSACTION,(uint8_t*)command_payload, 4);
-			command_flag = 0;
-		}
+		transaction_flow(&transaction_pt);
 		if(notif_flag){
 			asmart_comm_send_notification(&comm_handler, COMMAND_TYPE_BEGIN_TRANSACTION,(uint8_t*)command_payload, 4);
 		}
-		asmart_comm_handler(&comm_handler);
-		HAL_Delay(50);
+		uint32_t wait = asmart_comm_handler(&comm_handler);
+		if (notif_flag && wait > 50) {
+			wait = 50;  // Notifications keep their pace
+		}
+		/* Sleep until the handler's next deadline, a received frame or a new command; SysTick and the UART interrupt wake the core */
+		uint32_t since = asmart_comm_now();
+		while (asmart_comm_now() - since < wait && !asmart_comm_rx_pending(&comm_handler) && !command_flag) {
+			__WFI();
+		}
     /* USER CODE END WHILE */
 
     /* USER CODE BEGIN 3 */
@@ -178,6 +192,20 @@ void SystemClock_Config(void)
 }
 
 /* USER CODE BEGIN 4 */
+/* Sends a begin transaction command whenever command_flag is set and waits for its response */
+static uint8_t transaction_flow(aSmart_Pt_t* pt) {
+    PT_BEGIN(pt);
+    PT_WAIT_UNTIL(pt, command_flag);
+    command_flag = 0;
+
+    PT_REQUEST(pt, &comm_handler, &transaction_request, COMMAND_TYPE_BEGIN_TRANSACTION, (uint8_t*)command_payload, 4, payload_recv, sizeof(payload_recv));
+    if (transaction_request.status != REQUEST_DONE) {
+        // Handle timeout or error
+        HAL_GPIO_TogglePin(GPIOA,GPIO_PIN_15);
+    }
+    PT_END(pt);
+}
+
 void response_handler(uint8_t message_type, uint8_t command_type, uint16_t sequence_number, uint8_t* payload, uint16_t length) {
     if (payload != NULL && length > 0) {
         // Process the message based on the message type and command type
@@ -4,7 +4,13 @@
 #include "stdint.h"
 
 
+#define CRC16_INIT 0xFFFF
+
 uint16_t crc16(uint8_t *buffer, uint16_t buffer_length);
 
+/* Feeds one byte into a running CRC, start with CRC16_INIT.
+   The result after the last byte equals crc16() over the same data. */
+uint16_t crc16_update(uint16_t crc, uint8_t data);
+
 
 #endif 
\ No newline at end of file
@@ -76,4 +76,16 @@ uint16_t crc16(uint8_t *buffer, uint16_t buffer_length)
     }
 
     return (crc_hi << 8 | crc_lo);
-}
\ No newline at end of file
+}
+
+uint16_t crc16_update(uint16_t crc, uint8_t data)
+{
+    uint8_t crc_hi = crc >> 8;
+    uint8_t crc_lo = crc & 0xFF;
+    unsigned int i = crc_lo ^ data;
+
+    crc_lo = crc_hi ^ table_crc_hi[i];
+    crc_hi = table_crc_lo[i];
+
+    return (crc_hi << 8 | crc_lo);
+}
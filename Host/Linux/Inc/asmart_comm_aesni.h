@@ -0,0 +1,25 @@
+#ifndef _ASMART_COMM_AESNI_H_
+#define _ASMART_COMM_AESNI_H_
+
+/*
+ * AES-NI block cipher for secured links on x86 hosts (asmart_comm_secure.c). The round keys
+ * are the ones the software AES expands, so both produce the same frames.
+ */
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include "asmart_comm_secure.h"
+
+/**
+ * @brief Returns the AES-NI block cipher if the CPU has the instructions.
+ * @retval Block cipher, NULL on CPUs without AES-NI and on other architectures.
+ */
+SecureBlockCipher asmart_aesni_cipher(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // _ASMART_COMM_AESNI_H_
@@ -0,0 +1,111 @@
+#ifndef _ASMART_COMM_CANSIM_H_
+#define _ASMART_COMM_CANSIM_H_
+
+/*
+ * In-process CAN-FD bus for the host: stands in for the FDCAN controllers and the wire, so CAN
+ * links can be run and benchmarked without hardware. Time is simulated: a frame takes the bus
+ * for as long as its bits take at the nominal and data bit rates, stuff bits included.
+ */
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdint.h>
+#include "asmart_comm_can.h"
+
+// Simulator sizing
+#define CANSIM_NODES 128  // Controllers on one bus
+#define CANSIM_TX_FIFO 3  // Tx buffers of a controller, as on the G0's FDCAN
+#define CANSIM_ARBITRATION_BITS 36  // Extended CAN-FD frame: SOF, 29-bit identifier, SRR, IDE, r1, FDF, res, BRS
+#define CANSIM_TAIL_BITS 13  // CRC delimiter, ACK slot and delimiter, end of frame, intermission
+
+struct aSmart_CanSimBus_s;
+
+// Simulated Controller
+typedef struct {
+    struct aSmart_CanSimBus_s* bus;
+    aSmart_CanLink_t* link;  // Receives the frames its filters accept, serviced on Tx complete
+    aSmart_CanFrame_t tx_fifo[CANSIM_TX_FIFO];
+    uint8_t tx_head;
+    uint8_t tx_count;
+    uint32_t frames_sent;
+    uint32_t arbitration_lost;  // Times another controller won the bus while this one had a frame
+    uint64_t access_ns;  // Time frames waited in the Tx FIFO for the bus, summed
+    uint64_t queued_ns[CANSIM_TX_FIFO];  // Time each frame in the Tx FIFO was queued
+} aSmart_CanSimNode_t;
+
+// Simulated Bus
+typedef struct aSmart_CanSimBus_s {
+    uint32_t nominal_bitrate;  // Arbitration phase
+    uint32_t data_bitrate;  // Data phase, with bit rate switching
+    uint64_t now_ns;  // Simulated time
+    uint64_t busy_ns;  // Time the bus carried frames
+    uint32_t frames;
+    uint64_t data_bytes;  // Data field bytes carried, padding included
+    aSmart_CanSimNode_t* nodes[CANSIM_NODES];
+    uint16_t node_count;
+} aSmart_CanSimBus_t;
+
+/**
+ * @brief Initializes an idle bus at time 0.
+ * @param bus Pointer to the bus structure.
+ * @param nominal_bitrate Arbitration bit rate, e.g. 500000.
+ * @param data_bitrate Data bit rate, e.g. 2000000 to 5000000; the nominal rate for no switching.
+ * @retval None
+ */
+void asmart_cansim_init(aSmart_CanSimBus_t* bus, uint32_t nominal_bitrate, uint32_t data_bitrate);
+
+/**
+ * @brief Connects a controller to the bus; pass the node as driver to asmart_can_init().
+ * @param bus Pointer to the bus structure.
+ * @param node Pointer to the controller structure.
+ * @param link Link fed by the controller.
+ * @retval 0 on success, -1 if the bus is full.
+ */
+int asmart_cansim_attach(aSmart_CanSimBus_t* bus, aSmart_CanSimNode_t* node, aSmart_CanLink_t* link);
+
+/**
+ * @brief Controller write function of a simulated node, see CanWrite.
+ * @param driver Pointer to the controller structure.
+ * @param frame Frame to queue for sending.
+ * @retval 1 if queued, 0 if the Tx FIFO is full.
+ */
+uint8_t asmart_cansim_write(void* driver, const aSmart_CanFrame_t* frame);
+
+/**
+ * @brief Returns how long a frame takes the bus.
+ * @param bus Pointer to the bus structure.
+ * @param frame Frame.
+ * @retval Time in ns, dynamic and fixed stuff bits and the intermission included.
+ */
+uint64_t asmart_cansim_frame_ns(const aSmart_CanSimBus_t* bus, const aSmart_CanFrame_t* frame);
+
+/**
+ * @brief Sends one frame: the lowest identifier at the head of a Tx FIFO wins the arbitration.
+ * @note Time moves on by the frame's length. Every other node whose filters accept it receives
+ *       it, then the sender's link is serviced as by its Tx complete interrupt.
+ * @param bus Pointer to the bus structure.
+ * @retval 1 if a frame was sent, 0 if no controller has one.
+ */
+uint8_t asmart_cansim_step(aSmart_CanSimBus_t* bus);
+
+/**
+ * @brief Moves the time of an idle bus on.
+ * @param bus Pointer to the bus structure.
+ * @param ns Time to pass.
+ * @retval None
+ */
+void asmart_cansim_advance(aSmart_CanSimBus_t* bus, uint64_t ns);
+
+/**
+ * @brief Clock source of the simulated time, for asmart_comm_set_clock().
+ * @retval Milliseconds of the bus last initialized.
+ */
+uint32_t asmart_cansim_clock(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // _ASMART_COMM_CANSIM_H_
@@ -0,0 +1,176 @@
+#ifndef _ASMART_COMM_CAPTURE_H_
+#define _ASMART_COMM_CAPTURE_H_
+
+/*
+ * Frame captures on the Linux host: a writer fed by the handlers' capture hooks, a reader that
+ * maps a capture file and finds any record in constant time, and a replay driver that feeds the
+ * recorded frames back into a handler.
+ *
+ * File layout, native byte order, every part 8-byte aligned:
+ *   [Header][Record][Frame, padded] ... [Index: offset of every record, 8 bytes each]
+ * The index and the record count in the header are written when the capture is closed; a file
+ * left without them is still readable, the reader rebuilds the index by walking the records.
+ */
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdint.h>
+#include <stddef.h>
+#include <pthread.h>
+#include "asmart_comm_handler.h"
+
+#define CAPTURE_MAGIC 0x50414361U  // "aCAP" in a little-endian file
+#define CAPTURE_VERSION 1
+#define CAPTURE_BUFFER_SIZE 65536  // Bytes collected before a write()
+#define CAPTURE_ALL_PORTS 0xFFFF  // Replay filter: records of every port
+
+// File Header
+typedef struct {
+    uint32_t magic;
+    uint16_t version;
+    uint16_t header_size;  // sizeof(aSmart_CaptureHeader_t), records start here
+    uint64_t start_time_ns;  // CLOCK_REALTIME when the capture was created
+    uint64_t record_count;  // Zero until closed
+    uint64_t index_offset;  // Position of the index, zero until closed
+} aSmart_CaptureHeader_t;
+
+// Record Header, followed by the frame and padding to 8 bytes
+typedef struct {
+    uint64_t time_ns;  // Since the capture was created, from the monotonic clock
+    uint16_t length;  // Frame length
+    uint16_t port;  // Port number given to asmart_capture_tap()
+    uint8_t direction;  // CAPTURE_RX or CAPTURE_TX
+    uint8_t reserved[3];
+} aSmart_CaptureRecord_t;
+
+// Capture Writer, shared by any number of ports and threads
+typedef struct {
+    int fd;
+    pthread_mutex_t lock;
+    uint64_t start_ns;  // Monotonic time at creation
+    uint64_t start_time_ns;  // Realtime at creation, for the header
+    uint64_t offset;  // File position of the next record
+    uint8_t* buffer;  // Records not written yet
+    size_t buffered;
+    uint64_t* index;  // Offset of every record
+    uint64_t count;
+    uint64_t capacity;  // Entries allocated in index
+    uint64_t dropped;  // Records lost to a failed write or allocation
+} aSmart_CaptureWriter_t;
+
+// Capture Tap, the hook context of one handler
+typedef struct {
+    aSmart_CaptureWriter_t* writer;
+    uint16_t port;
+} aSmart_CaptureTap_t;
+
+// Replay Counts, added to by every asmart_capture_replay()
+typedef struct {
+    uint64_t frames;  // Selected records that parsed and were addressed to the handler
+    uint64_t delivered;  // Messages passed to the handler's response callback
+} aSmart_ReplayStats_t;
+
+// Capture Reader
+typedef struct {
+    const uint8_t* map;  // Whole file, read-only
+    size_t size;
+    const uint64_t* index;  // Into map, or allocated when the file was not closed
+    uint8_t index_owned;
+    uint64_t count;
+} aSmart_CaptureReader_t;
+
+/**
+ * @brief Creates a capture file, replacing an existing one.
+ * @param writer Pointer to the writer structure.
+ * @param path File path.
+ * @retval 0 on success, -1 otherwise (errno is set).
+ */
+int asmart_capture_create(aSmart_CaptureWriter_t* writer, const char* path);
+
+/**
+ * @brief Appends a frame; safe from any thread.
+ * @param writer Pointer to the writer structure.
+ * @param port Port number stored with the frame.
+ * @param direction CAPTURE_RX or CAPTURE_TX.
+ * @param frame Pointer to the frame.
+ * @param length Frame length.
+ * @retval None
+ */
+void asmart_capture_write(aSmart_CaptureWriter_t* writer, uint16_t port, uint8_t direction, const uint8_t* frame, uint16_t length);
+
+/**
+ * @brief Records a handler's traffic into a capture.
+ * @note Call asmart_comm_set_capture(handler, NULL, NULL) before closing the writer.
+ * @param tap Pointer to the tap, kept by the caller while the handler captures.
+ * @param writer Pointer to the writer structure.
+ * @param handler Pointer to the handler.
+ * @param port Port number stored with the handler's frames.
+ * @retval None
+ */
+void asmart_capture_tap(aSmart_CaptureTap_t* tap, aSmart_CaptureWriter_t* writer, aSmart_Comm_Handler_t* handler, uint16_t port);
+
+/**
+ * @brief Writes the buffered records, the index and the final header, and closes the file.
+ * @param writer Pointer to the writer structure.
+ * @retval 0 on success, -1 if a write failed (errno is set).
+ */
+int asmart_capture_close(aSmart_CaptureWriter_t* writer);
+
+/**
+ * @brief Maps a capture file for reading.
+ * @param reader Pointer to the reader structure.
+ * @param path File path.
+ * @retval 0 on success, -1 otherwise (errno is set, EINVAL for a file that is no capture).
+ */
+int asmart_capture_open(aSmart_CaptureReader_t* reader, const char* path);
+
+/**
+ * @brief Unmaps a capture file.
+ * @param reader Pointer to the reader structure.
+ * @retval None
+ */
+void asmart_capture_unmap(aSmart_CaptureReader_t* reader);
+
+/**
+ * @brief Returns a record in constant time.
+ * @param reader Pointer to the reader structure.
+ * @param number Record number, 0 .. count-1.
+ * @retval Pointer to the record header, the frame follows it; NULL if out of range.
+ */
+const aSmart_CaptureRecord_t* asmart_capture_record(const aSmart_CaptureReader_t* reader, uint64_t number);
+
+/**
+ * @brief Finds the first record at or after a point of time, by binary search over the index.
+ * @param reader Pointer to the reader structure.
+ * @param time_ns Time since the capture was created.
+ * @retval Record number, count if all records are older.
+ */
+uint64_t asmart_capture_seek(const aSmart_CaptureReader_t* reader, uint64_t time_ns);
+
+/**
+ * @brief Feeds recorded frames into a handler with asmart_comm_replay_frame().
+ * @note Runs on the calling thread. At speed 0 frames follow each other without pause, so the
+ *       run is a deterministic benchmark of the receive path; otherwise the recorded gaps are
+ *       kept, divided by speed. asmart_comm_handler() is not called in between.
+ * @note A frame that parses is not always delivered: a response reaches the callback only if
+ *       the handler has its command pending, so recorded responses replayed into a fresh handler
+ *       count in frames but not in delivered. Messages of channels with a callback of their own
+ *       and answers to awaited requests are not counted as delivered either.
+ * @param reader Pointer to the reader structure.
+ * @param handler Pointer to the handler fed.
+ * @param port Port whose records are fed, CAPTURE_ALL_PORTS for all.
+ * @param direction CAPTURE_RX, or CAPTURE_TX to play the other side's part.
+ * @param first First record number.
+ * @param speed 1.0 for the original timing, 0 for no pauses.
+ * @param stats Pointer to the counts, added to.
+ * @retval None
+ */
+void asmart_capture_replay(const aSmart_CaptureReader_t* reader, aSmart_Comm_Handler_t* handler, uint16_t port, uint8_t direction, uint64_t first, double speed, aSmart_ReplayStats_t* stats);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // _ASMART_COMM_CAPTURE_H_
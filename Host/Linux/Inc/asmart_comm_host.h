@@ -0,0 +1,252 @@
+#ifndef _ASMART_COMM_HOST_H_
+#define _ASMART_COMM_HOST_H_
+
+/*
+ * Linux port of the protocol stack. Built with ASMART_COMM_HOST=1, asmart_comm_handler.h includes
+ * this header instead of usart.h: a serial port stands in for the UART and the few HAL functions
+ * the library uses are implemented on termios and epoll or io_uring in asmart_comm_host.c.
+ */
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdint.h>
+#include <stddef.h>
+
+// Host port sizing
+#define HOST_TX_BUFFER_SIZE 4096  // Bytes queued per port while the serial driver is busy
+#define HOST_TX_TIMEOUT_MS 1000  // A send waits this long for room in a full queue, then drops the frame
+#define HOST_EVENTS 64  // Port events handled per epoll_wait()
+#define HOST_READ_SIZE 1024  // Bytes read per port and round
+#define HOST_SWEEP_MS 100  // Longest sleep of a loop; every port's handler runs at least this often
+#define HOST_URING_ENTRIES 256  // io_uring submission queue entries per loop
+#define HOST_URING_BUFFERS 256  // io_uring receive buffers of HOST_READ_SIZE bytes, shared by the ports of a loop
+#define HOST_URING_PORTS 1024  // Most ports of an io_uring loop, the size of its registered buffer table
+
+// HAL Status, as returned by the STM32 HAL
+typedef enum {
+    HAL_OK = 0x00,
+    HAL_ERROR = 0x01,
+    HAL_BUSY = 0x02,
+    HAL_TIMEOUT = 0x03
+} HAL_StatusTypeDef;
+
+#define HAL_MAX_DELAY 0xFFFFFFFFU
+
+#ifndef __weak
+#define __weak __attribute__((weak))
+#endif
+
+// Event Loop Engine, chosen per loop at run time
+typedef enum {
+    HOST_ENGINE_EPOLL = 0,  // Readiness: epoll_wait(), then read() and write() per port
+    HOST_ENGINE_URING  // Completion: multishot reads and batched writes through io_uring, Linux 6.7 or later
+} aSmart_HostEngine_t;
+
+struct aSmart_Comm_Handler_s;
+struct aSmart_HostLoop_s;
+struct aSmart_HostUring_s;
+
+// Serial Port Structure, the host's UART handle
+typedef struct aSmart_HostPort_s {
+    int fd;  // -1 while closed
+    int pty_fd;  // Slave side of a pty, held open so the master does not hang up before the peer opens it
+    struct aSmart_Comm_Handler_s* handler;  // Handler fed by this port, set by asmart_comm_init_port()
+    struct aSmart_HostLoop_s* loop;
+    struct aSmart_HostPort_s* next;  // Ports of the loop
+    struct aSmart_HostPort_s* next_ready;  // Ports with input in this round
+    uint8_t ready;  // Listed in the loop's ready list
+    uint8_t hung_up;  // The device went away, the port only sends into the void
+    uint8_t held;  // Not read and its handler not run, see asmart_host_hold()
+    uint32_t baudrate;  // Line speed set by asmart_host_open(), 0 if unknown (pty, socket)
+    uint8_t dirty;  // Sent on outside its handler, which runs before the loop sleeps so its new deadline counts
+    struct aSmart_HostPort_s* next_dirty;  // Ports in the loop's dirty list
+    uint8_t tx_buffer[HOST_TX_BUFFER_SIZE];  // Ring of bytes the driver has not taken yet
+    uint16_t tx_head;
+    uint16_t tx_count;
+    uint32_t events;  // epoll events watched
+    uint16_t slot;  // io_uring: index in the loop's port table and registered buffer table
+    uint8_t rx_armed;  // io_uring: a read is outstanding
+    uint8_t service_listed;  // io_uring: in the loop's service list
+    uint8_t tx_listed;  // io_uring: in the loop's write list
+    uint16_t tx_inflight;  // io_uring: bytes of the write under way, 0 if none
+    uint16_t pending_head;  // io_uring: first received buffer not parsed yet, 0xFFFF if none
+    uint16_t pending_tail;
+    struct aSmart_HostPort_s* next_service;  // io_uring: ports with buffers to parse or a read to re-arm
+    struct aSmart_HostPort_s* next_tx;  // io_uring: ports with bytes to write
+    uint32_t rx_bytes;
+    uint32_t tx_bytes;
+    uint32_t tx_drops;  // Frames dropped because the queue stayed full
+    void* context;  // Free for the application
+} aSmart_HostPort_t;
+
+typedef aSmart_HostPort_t UART_HandleTypeDef;
+
+// Event Loop Structure, one per thread
+typedef struct aSmart_HostLoop_s {
+    aSmart_HostEngine_t engine;
+    int epoll_fd;  // -1 with io_uring
+    struct aSmart_HostUring_s* uring;  // io_uring state, NULL with epoll
+    int wake_fd;  // eventfd, written by asmart_host_wake()
+    aSmart_HostPort_t* ports;  // All attached ports
+    uint16_t port_count;
+    uint32_t next_sweep;  // Earliest deadline returned by a handler, at most HOST_SWEEP_MS ahead (ms)
+    aSmart_HostPort_t* dirty;  // Ports sent on outside their handler
+} aSmart_HostLoop_t;
+
+/**
+ * @brief Returns the time since an arbitrary start, from the monotonic clock.
+ * @retval Time in ms.
+ */
+uint32_t HAL_GetTick(void);
+
+/**
+ * @brief Returns the time since an arbitrary start, from the monotonic clock, in µs.
+ * @retval Time in µs, wraps around.
+ */
+uint32_t asmart_host_time_us(void);
+
+/**
+ * @brief Queues bytes for sending and writes as much as the driver takes at once.
+ * @note The rest goes out from the event loop. If the queue is full, waits up to
+ *       HOST_TX_TIMEOUT_MS for room and drops the bytes after that.
+ * @param huart Pointer to the port.
+ * @param data Pointer to the bytes.
+ * @param size Number of bytes.
+ * @param timeout Ignored; the frame is queued or dropped.
+ * @retval HAL_OK if queued, HAL_TIMEOUT if dropped, HAL_ERROR if the port is closed.
+ */
+HAL_StatusTypeDef HAL_UART_Transmit(UART_HandleTypeDef* huart, const uint8_t* data, uint16_t size, uint32_t timeout);
+
+/* No interrupts on the host: a port is read from the loop thread that also runs its handler */
+static inline uint32_t __get_PRIMASK(void) { return 0; }
+static inline void __set_PRIMASK(uint32_t primask) { (void)primask; }
+static inline void __disable_irq(void) { }
+
+/**
+ * @brief Initializes an epoll event loop.
+ * @param loop Pointer to the loop structure.
+ * @retval 0 on success, -1 if epoll could not be created (errno is set).
+ */
+int asmart_host_loop_init(aSmart_HostLoop_t* loop);
+
+/**
+ * @brief Initializes an event loop on the given engine.
+ * @note io_uring needs Linux 6.7 for multishot reads; older kernels fall back to one read per
+ *       completion, kernels before 5.19 fail with errno ENOSYS or EINVAL. Ports of an io_uring
+ *       loop are switched to blocking mode, the kernel polls them.
+ * @param loop Pointer to the loop structure.
+ * @param engine HOST_ENGINE_EPOLL or HOST_ENGINE_URING.
+ * @retval 0 on success, -1 otherwise (errno is set).
+ */
+int asmart_host_loop_init_engine(aSmart_HostLoop_t* loop, aSmart_HostEngine_t engine);
+
+/**
+ * @brief Closes all ports of the loop and the loop itself.
+ * @param loop Pointer to the loop structure.
+ * @retval None
+ */
+void asmart_host_loop_close(aSmart_HostLoop_t* loop);
+
+/**
+ * @brief Opens a serial device in raw mode, 8N1, and adds it to the loop.
+ * @param loop Pointer to the loop structure.
+ * @param port Pointer to the port structure, kept by the caller while the port is open.
+ * @param path Device path, e.g. /dev/ttyUSB0.
+ * @param baudrate Line speed, one of the standard termios rates.
+ * @retval 0 on success, -1 otherwise (errno is set).
+ */
+int asmart_host_open(aSmart_HostLoop_t* loop, aSmart_HostPort_t* port, const char* path, uint32_t baudrate);
+
+/**
+ * @brief Creates a pseudo-terminal and adds its master side to the loop, e.g. to test against another process.
+ * @param loop Pointer to the loop structure.
+ * @param port Pointer to the port structure.
+ * @param slave_path Receives the path of the slave side.
+ * @param size Size of slave_path.
+ * @retval 0 on success, -1 otherwise (errno is set).
+ */
+int asmart_host_open_pty(aSmart_HostLoop_t* loop, aSmart_HostPort_t* port, char* slave_path, size_t size);
+
+/**
+ * @brief Adds an open file descriptor to the loop, e.g. a socket; it is made non-blocking with epoll.
+ * @param loop Pointer to the loop structure.
+ * @param port Pointer to the port structure.
+ * @param fd File descriptor, owned by the port from now on.
+ * @retval 0 on success, -1 otherwise (errno is set).
+ */
+int asmart_host_attach(aSmart_HostLoop_t* loop, aSmart_HostPort_t* port, int fd);
+
+/**
+ * @brief Lets the serial driver switch the transceiver's DE line (RTS) around every send (TIOCSRS485).
+ * @param port Pointer to the port.
+ * @param before_ms DE raised this long before the first byte.
+ * @param after_ms DE held this long after the last byte.
+ * @retval 0 on success, -1 if the driver has no RS485 mode, e.g. a pty (errno is set).
+ */
+int asmart_host_set_rs485(aSmart_HostPort_t* port, uint32_t before_ms, uint32_t after_ms);
+
+/**
+ * @brief Removes a port from its loop and closes it.
+ * @param port Pointer to the port structure.
+ * @retval None
+ */
+void asmart_host_close(aSmart_HostPort_t* port);
+
+/**
+ * @brief Waits for input or room on the loop's ports and services them.
+ * @note Received bytes are parsed, and asmart_comm_handler() runs for every port that received
+ *       something. The loop sleeps until the earliest deadline the handlers returned, at most
+ *       HOST_SWEEP_MS, and then runs the handlers of all ports so their timeouts expire.
+ * @param loop Pointer to the loop structure.
+ * @param timeout_ms Longest wait, -1 to wait until the next deadline.
+ * @retval Number of events handled, a wake-up included, -1 on error (errno is set).
+ */
+int asmart_host_poll(aSmart_HostLoop_t* loop, int timeout_ms);
+
+/**
+ * @brief Reads what has arrived on one port, waiting up to timeout_ms for it.
+ * @note Used by the library where the MCU would wait for its receive interrupt, e.g. for credit.
+ * @param port Pointer to the port.
+ * @param timeout_ms Longest wait.
+ * @retval None
+ */
+void asmart_host_poll_port(aSmart_HostPort_t* port, int timeout_ms);
+
+/**
+ * @brief Stops or resumes reading a port, e.g. while the application cannot take more messages.
+ * @note Received data waits in the driver meanwhile. On resume the handler runs at once for
+ *       the frames already in the receive slots. Call from the loop's thread.
+ * @param port Pointer to the port.
+ * @param hold 1 to stop, 0 to resume.
+ * @retval None
+ */
+void asmart_host_hold(aSmart_HostPort_t* port, uint8_t hold);
+
+/**
+ * @brief Makes a waiting asmart_host_poll() return; safe from any thread.
+ * @param loop Pointer to the loop structure.
+ * @retval None
+ */
+void asmart_host_wake(aSmart_HostLoop_t* loop);
+
+/**
+ * @brief Returns the port whose handler runs on this thread, e.g. from a response callback.
+ * @retval Pointer to the port, NULL outside the loop.
+ */
+aSmart_HostPort_t* asmart_host_active_port(void);
+
+/**
+ * @brief Binds a port to the handler it feeds; called by asmart_comm_init_port().
+ * @param port Pointer to the port.
+ * @param handler Pointer to the handler.
+ * @retval None
+ */
+void asmart_host_bind(aSmart_HostPort_t* port, struct aSmart_Comm_Handler_s* handler);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // _ASMART_COMM_HOST_H_
@@ -0,0 +1,125 @@
+#ifndef _ASMART_COMM_QUEUE_H_
+#define _ASMART_COMM_QUEUE_H_
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdatomic.h>
+
+// Bounded Multi-Producer Multi-Consumer Queue of fixed-size elements
+typedef struct {
+    uint8_t* cells;  // Sequence number followed by the element, cell_size bytes each
+    size_t cell_size;
+    size_t element_size;
+    size_t mask;  // Capacity - 1, the capacity is a power of two
+    _Alignas(64) atomic_size_t head;  // Next cell to write
+    _Alignas(64) atomic_size_t tail;  // Next cell to read
+} aSmart_Queue_t;
+
+// Single-Producer Single-Consumer Ring of variable-length records
+typedef struct {
+    uint8_t* buffer;
+    uint32_t size;  // Power of two
+    _Alignas(64) atomic_uint head;  // Bytes written, only advanced by the producer
+    _Alignas(64) atomic_uint tail;  // Bytes read, only advanced by the consumer
+} aSmart_Ring_t;
+
+/**
+ * @brief Allocates a queue.
+ * @param queue Pointer to the queue structure.
+ * @param capacity Number of elements, rounded up to a power of two.
+ * @param element_size Size of an element in bytes.
+ * @retval 0 on success, -1 if out of memory.
+ */
+int asmart_queue_init(aSmart_Queue_t* queue, size_t capacity, size_t element_size);
+
+/**
+ * @brief Frees a queue.
+ * @param queue Pointer to the queue structure.
+ * @retval None
+ */
+void asmart_queue_free(aSmart_Queue_t* queue);
+
+/**
+ * @brief Appends an element; safe from any number of threads.
+ * @param queue Pointer to the queue structure.
+ * @param element Pointer to the element, copied.
+ * @retval 1 if appended, 0 if the queue is full.
+ */
+uint8_t asmart_queue_push(aSmart_Queue_t* queue, const void* element);
+
+/**
+ * @brief Removes the oldest element; safe from any number of threads.
+ * @param queue Pointer to the queue structure.
+ * @param element Receives the element.
+ * @retval 1 if an element was removed, 0 if the queue is empty.
+ */
+uint8_t asmart_queue_pop(aSmart_Queue_t* queue, void* element);
+
+/**
+ * @brief Tells whether a queue looks empty; a push or pop may be under way.
+ * @param queue Pointer to the queue structure.
+ * @retval 1 if empty, 0 otherwise.
+ */
+uint8_t asmart_queue_empty(aSmart_Queue_t* queue);
+
+/**
+ * @brief Allocates a ring.
+ * @param ring Pointer to the ring structure.
+ * @param size Size in bytes, rounded up to a power of two.
+ * @retval 0 on success, -1 if out of memory.
+ */
+int asmart_ring_init(aSmart_Ring_t* ring, uint32_t size);
+
+/**
+ * @brief Frees a ring.
+ * @param ring Pointer to the ring structure.
+ * @retval None
+ */
+void asmart_ring_free(aSmart_Ring_t* ring);
+
+/**
+ * @brief Returns the bytes the producer can still write, record headers included.
+ * @param ring Pointer to the ring structure.
+ * @retval Free bytes.
+ */
+uint32_t asmart_ring_space(aSmart_Ring_t* ring);
+
+/**
+ * @brief Appends a record made of a header and a body; producer only.
+ * @param ring Pointer to the ring structure.
+ * @param header Pointer to the header.
+ * @param header_length Length of the header.
+ * @param body Pointer to the body, may be NULL if body_length is 0.
+ * @param body_length Length of the body.
+ * @retval 1 if appended, 0 if there is not enough room.
+ */
+uint8_t asmart_ring_write(aSmart_Ring_t* ring, const void* header, uint16_t header_length, const void* body, uint16_t body_length);
+
+/**
+ * @brief Removes the oldest record; consumer only.
+ * @param ring Pointer to the ring structure.
+ * @param header Receives the header, header_length bytes.
+ * @param header_length Length of the header, as written.
+ * @param body Receives the body.
+ * @param body_size Size of body; a longer body is truncated.
+ * @param body_length Receives the body length as written.
+ * @retval 1 if a record was removed, 0 if the ring is empty.
+ */
+uint8_t asmart_ring_read(aSmart_Ring_t* ring, void* header, uint16_t header_length, void* body, uint16_t body_size, uint16_t* body_length);
+
+/**
+ * @brief Tells whether the ring holds a record.
+ * @param ring Pointer to the ring structure.
+ * @retval 1 if empty, 0 otherwise.
+ */
+uint8_t asmart_ring_empty(aSmart_Ring_t* ring);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // _ASMART_COMM_QUEUE_H_
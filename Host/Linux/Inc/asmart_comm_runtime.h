@@ -0,0 +1,207 @@
+#ifndef _ASMART_COMM_RUNTIME_H_
+#define _ASMART_COMM_RUNTIME_H_
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdatomic.h>
+#include <pthread.h>
+#include "asmart_comm_handler.h"
+#include "asmart_comm_queue.h"
+
+// Runtime sizing
+#define RUNTIME_INBOX_SIZE 16384  // Bytes of received messages waiting for a worker, per link
+#define RUNTIME_INBOX_RESERVE (2 * HOST_READ_SIZE + RX_FRAME_SLOTS * RECEIVE_BUFFER_SIZE)  // Below this much room the port is no longer read
+#define RUNTIME_OUTBOX_DEPTH 32  // Messages waiting for the reactor to send them, per link; a full outbox refuses sends
+#define RUNTIME_BATCH 16  // Messages a worker handles for one link before taking the next link
+#define RUNTIME_SPIN 64  // Empty rounds before an idle worker sleeps
+#define RUNTIME_IDLE_MS 10  // Longest sleep of an idle worker
+
+#if 2 * RUNTIME_INBOX_RESERVE > RUNTIME_INBOX_SIZE
+#error "RUNTIME_INBOX_SIZE must hold twice RUNTIME_INBOX_RESERVE"
+#endif
+
+struct aSmart_Link_s;
+struct aSmart_Runtime_s;
+
+// Link Callback Function Type
+/**
+ * @brief Called on a worker thread for the messages of a link, in the order they were received.
+ * @note Never called for the same link on two threads at once.
+ * @param link Pointer to the link.
+ * Other parameters as for ResponseCallback.
+ */
+typedef void (*LinkCallback)(struct aSmart_Link_s* link, uint8_t message_type, uint8_t command_type, uint16_t sequence_number, uint8_t* payload, uint16_t length);
+
+// Received Message Record, followed by the payload in the link's inbox
+typedef struct {
+    uint8_t message_type;
+    uint8_t command_type;
+    uint16_t sequence_number;
+    uint8_t timeout;  // The callback gets a NULL payload
+    uint8_t source;  // Reply address of a command
+    uint8_t reply_enabled;  // Cleared for broadcast and group commands
+} RuntimeRecord_t;
+
+// Message to Send, queued by any thread for the link's reactor
+typedef struct {
+    uint8_t message_type;  // MSG_TYPE_COMMAND, _NOTIFICATION, _RESPONSE or _ERROR
+    uint8_t command_type;  // Or error code
+    uint16_t sequence_number;  // Of the command answered
+    uint8_t destination;  // Of a response or error
+    uint8_t reply_enabled;
+    uint16_t length;
+    uint8_t payload[ASMART_COMM_MAX_PAYLOAD];
+} RuntimeSend_t;
+
+// Reactor Structure, a thread owning the ports of its links
+typedef struct {
+    pthread_t thread;
+    aSmart_HostLoop_t loop;
+    aSmart_Queue_t signals;  // Links with messages to send or a hold to lift
+    struct aSmart_Runtime_s* runtime;
+} aSmart_Reactor_t;
+
+// Worker Structure, a thread running link callbacks
+typedef struct {
+    pthread_t thread;
+    aSmart_Queue_t queue;  // Links with messages; other workers steal from it
+    uint16_t index;
+    struct aSmart_Runtime_s* runtime;
+    atomic_ulong executed;  // Messages handled
+    atomic_ulong stolen;  // Links taken from other workers' queues
+} aSmart_Worker_t;
+
+// Link Structure, a port with its handler
+typedef struct aSmart_Link_s {
+    aSmart_HostPort_t port;
+    aSmart_Comm_Handler_t handler;  // Configure before asmart_runtime_start(), owned by the reactor after
+    struct aSmart_Runtime_s* runtime;
+    aSmart_Reactor_t* reactor;
+    uint16_t home;  // Worker whose queue takes the link
+    LinkCallback callback;
+    void* context;  // Free for the application
+    aSmart_Ring_t inbox;  // Received messages, reactor to worker
+    aSmart_Queue_t outbox;  // RuntimeSend_t, any thread to reactor
+    atomic_uchar scheduled;  // Queued at a worker or running
+    atomic_uchar signaled;  // Queued at the reactor
+    atomic_uchar held;  // Port not read until the inbox has room
+    atomic_ulong received;  // Messages passed to the inbox
+    atomic_ulong dropped;  // Messages lost because the inbox was full
+} aSmart_Link_t;
+
+// Runtime Structure
+typedef struct aSmart_Runtime_s {
+    aSmart_Reactor_t* reactors;
+    uint16_t reactor_count;
+    aSmart_Worker_t* workers;
+    uint16_t worker_count;
+    aSmart_Link_t** links;
+    uint16_t link_count;
+    uint16_t max_links;
+    atomic_uchar running;
+    pthread_mutex_t idle_lock;
+    pthread_cond_t idle_cond;
+    atomic_uint sleepers;  // Workers waiting on idle_cond
+} aSmart_Runtime_t;
+
+/**
+ * @brief Sets up reactors and workers; no thread runs until asmart_runtime_start().
+ * @param runtime Pointer to the runtime structure.
+ * @param reactors Number of reactor threads, the links are spread over them.
+ * @param workers Number of worker threads.
+ * @param max_links Most links that will be opened.
+ * @param engine Event loop engine of the reactors, see asmart_host_loop_init_engine().
+ * @retval 0 on success, -1 otherwise (errno is set).
+ */
+int asmart_runtime_init(aSmart_Runtime_t* runtime, uint16_t reactors, uint16_t workers, uint16_t max_links, aSmart_HostEngine_t engine);
+
+/**
+ * @brief Opens a serial device as a new link.
+ * @param runtime Pointer to the runtime structure.
+ * @param path Device path.
+ * @param baudrate Line speed.
+ * @param callback Receives the link's messages on a worker thread.
+ * @param context Stored in the link.
+ * @retval Pointer to the link, NULL on error (errno is set).
+ */
+aSmart_Link_t* asmart_runtime_open(aSmart_Runtime_t* runtime, const char* path, uint32_t baudrate, LinkCallback callback, void* context);
+
+/**
+ * @brief Opens a pseudo-terminal as a new link.
+ * @param runtime Pointer to the runtime structure.
+ * @param slave_path Receives the path of the slave side.
+ * @param size Size of slave_path.
+ * @param callback Receives the link's messages on a worker thread.
+ * @param context Stored in the link.
+ * @retval Pointer to the link, NULL on error (errno is set).
+ */
+aSmart_Link_t* asmart_runtime_open_pty(aSmart_Runtime_t* runtime, char* slave_path, size_t size, LinkCallback callback, void* context);
+
+/**
+ * @brief Adds an open file descriptor as a new link, e.g. one end of a socket pair.
+ * @param runtime Pointer to the runtime structure.
+ * @param fd File descriptor, owned by the link from now on.
+ * @param callback Receives the link's messages on a worker thread.
+ * @param context Stored in the link.
+ * @retval Pointer to the link, NULL on error (errno is set).
+ */
+aSmart_Link_t* asmart_runtime_attach(aSmart_Runtime_t* runtime, int fd, LinkCallback callback, void* context);
+
+/**
+ * @brief Starts the reactor and worker threads.
+ * @param runtime Pointer to the runtime structure.
+ * @retval 0 on success, -1 otherwise (errno is set).
+ */
+int asmart_runtime_start(aSmart_Runtime_t* runtime);
+
+/**
+ * @brief Stops and joins all threads, closes the links and frees the runtime.
+ * @param runtime Pointer to the runtime structure.
+ * @retval None
+ */
+void asmart_runtime_stop(aSmart_Runtime_t* runtime);
+
+/**
+ * @brief Queues a command to the link's peer; safe from any thread.
+ * @param link Pointer to the link.
+ * @param command_type Type of the command.
+ * @param payload Pointer to the payload, copied.
+ * @param payload_length Length of the payload.
+ * @retval 1 if queued, 0 if the outbox is full or the payload too large.
+ */
+uint8_t asmart_runtime_send_command(aSmart_Link_t* link, uint8_t command_type, const uint8_t* payload, uint16_t payload_length);
+
+/**
+ * @brief Queues a notification to the link's peer; safe from any thread.
+ * @param link Pointer to the link.
+ * @param notification_type Type of the notification.
+ * @param payload Pointer to the payload, copied.
+ * @param payload_length Length of the payload.
+ * @retval 1 if queued, 0 if the outbox is full or the payload too large.
+ */
+uint8_t asmart_runtime_send_notification(aSmart_Link_t* link, uint8_t notification_type, const uint8_t* payload, uint16_t payload_length);
+
+/**
+ * @brief Queues the response to a command; call from the link's callback.
+ * @note Goes to the source of the command being handled, not of the last one received.
+ * @param link Pointer to the link.
+ * @param sequence_number Sequence number of the command.
+ * @param command_type Type of the command.
+ * @param payload Pointer to the payload, copied.
+ * @param payload_length Length of the payload.
+ * @retval 1 if queued, 0 if the outbox is full or the payload too large.
+ */
+uint8_t asmart_runtime_send_response(aSmart_Link_t* link, uint16_t sequence_number, uint8_t command_type, const uint8_t* payload, uint16_t payload_length);
+
+/**
+ * @brief Queues an error answer to a command; call from the link's callback.
+ * @param link Pointer to the link.
+ * @param sequence_number Sequence number of the command.
+ * @param error_code Error code.
+ * @param payload Pointer to the payload, copied.
+ * @param payload_length Length of the payload.
+ * @retval 1 if queued, 0 if the outbox is full or the payload too large.
+ */
+uint8_t asmart_runtime_send_error(aSmart_Link_t* link, uint16_t sequence_number, uint8_t error_code, const uint8_t* payload, uint16_t payload_length);
+
+#endif // _ASMART_COMM_RUNTIME_H_
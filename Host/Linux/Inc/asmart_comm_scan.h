@@ -0,0 +1,116 @@
+#ifndef _ASMART_COMM_SCAN_H_
+#define _ASMART_COMM_SCAN_H_
+
+/*
+ * Bulk frame scanner for the Linux host, e.g. for captures or aggregated streams: finds frame
+ * starts with SSE2 or AVX2, checks the declared length against the ETX position, and checks the
+ * CRC of the candidates in batches. On a clean stream it finds the frames the parser finds
+ * byte by byte; after a damaged frame it resumes one byte behind the bad start, where the
+ * parser resumes at the byte that failed, so it can recover a frame the parser loses.
+ */
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdint.h>
+#include <stddef.h>
+#include "asmart_comm_handler.h"
+
+#define SCAN_BATCH 64  // Candidate frames checked per CRC round and handed over at once
+#define SCAN_MAX_FRAME RECEIVE_BUFFER_SIZE  // Longest frame accepted, as by the handler's parser
+#ifndef SCAN_NARROW_SPAN
+#define SCAN_NARROW_SPAN 32  // Bytes AVX2 searches in 16-byte blocks before its 64-byte loop
+#endif
+
+// Instruction Set used for the start byte search
+typedef enum {
+    SCAN_SCALAR = 0,
+    SCAN_SSE2,
+    SCAN_AVX2
+} scan_isa_t;
+
+// Frame Found in a Buffer
+typedef struct {
+    size_t offset;  // Position of the STX or SOH
+    uint16_t length;  // Total frame length
+    uint8_t compact;  // Compact layout
+} aSmart_FrameSpan_t;
+
+// Scan Counters
+typedef struct {
+    uint64_t frames;  // Valid frames handed over
+    uint64_t bytes;  // Bytes in valid frames
+    uint64_t rejected;  // Candidates that passed the length checks but had a bad CRC
+} aSmart_ScanStats_t;
+
+/**
+ * @brief Batch callback function type, receives validated frames in buffer order.
+ * @param context Context pointer given to asmart_scan_buffer().
+ * @param data Buffer scanned.
+ * @param spans Frames found, valid until the callback returns.
+ * @param count Number of frames.
+ */
+typedef void (*ScanCallback)(void* context, const uint8_t* data, const aSmart_FrameSpan_t* spans, size_t count);
+
+/**
+ * @brief Returns the instruction set the scanner uses on this CPU.
+ * @retval SCAN_SCALAR, SCAN_SSE2 or SCAN_AVX2.
+ */
+scan_isa_t asmart_scan_isa(void);
+
+/**
+ * @brief Overrides the instruction set, e.g. to compare them; sets above the CPU's are ignored.
+ * @param isa SCAN_SCALAR, SCAN_SSE2 or SCAN_AVX2.
+ * @retval None
+ */
+void asmart_scan_set_isa(scan_isa_t isa);
+
+/**
+ * @brief Finds candidate frames: a start byte followed by a length that fits and, for standard frames, an ETX where the length puts it.
+ * @note A candidate is taken as valid while scanning on, the next one is searched behind it.
+ *       The CRC is not checked, see asmart_scan_verify().
+ * @param data Buffer.
+ * @param length Buffer length.
+ * @param from Position to start at.
+ * @param spans Receives the candidates.
+ * @param max_spans Size of spans.
+ * @param next Receives the position to continue at: behind the last candidate, or at the start
+ *             of a frame that runs past the end of the buffer.
+ * @retval Number of candidates.
+ */
+size_t asmart_scan_candidates(const uint8_t* data, size_t length, size_t from, aSmart_FrameSpan_t* spans, size_t max_spans, size_t* next);
+
+/**
+ * @brief Checks the CRC of candidate frames.
+ * @param data Buffer.
+ * @param spans Candidates from asmart_scan_candidates().
+ * @param count Number of candidates.
+ * @retval Number of leading candidates with a good CRC; the scan resumes one byte behind the first bad one.
+ */
+size_t asmart_scan_verify(const uint8_t* data, const aSmart_FrameSpan_t* spans, size_t count);
+
+/**
+ * @brief Scans a buffer and hands the valid frames to the callback in batches of up to SCAN_BATCH.
+ * @param data Buffer.
+ * @param length Buffer length.
+ * @param callback Batch callback, NULL to only count.
+ * @param context Context pointer passed to the callback.
+ * @param stats Counters, added to; may be NULL.
+ * @retval Bytes consumed; a frame cut off by the end of the buffer starts at the returned position.
+ */
+size_t asmart_scan_buffer(const uint8_t* data, size_t length, ScanCallback callback, void* context, aSmart_ScanStats_t* stats);
+
+/**
+ * @brief CRC16 as computed by crc16(), eight bytes per step.
+ * @param data Pointer to the bytes.
+ * @param length Number of bytes.
+ * @retval CRC value.
+ */
+uint16_t asmart_scan_crc16(const uint8_t* data, size_t length);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // _ASMART_COMM_SCAN_H_
@@ -0,0 +1,80 @@
+#ifndef _ASMART_COMM_SPISIM_H_
+#define _ASMART_COMM_SPISIM_H_
+
+/*
+ * In-process SPI loopback for the host: stands in for two SPIs with DMA, the wires between
+ * them and the data-ready line, so an SPI link can be run and benchmarked without hardware.
+ * Time is simulated: a transfer takes the bus for as long as its bits take at the SPI clock,
+ * plus the pause the master leaves for the slave to re-arm.
+ */
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdint.h>
+#include "asmart_comm_spi.h"
+
+#define SPISIM_IDLE_FILL 0xFF  // What the master reads from a slave that is not armed
+
+// Simulated SPI Pair
+typedef struct {
+    uint32_t clock_hz;  // SPI clock
+    uint32_t gap_ns;  // Between transfers: chip select and the slave's re-arm time
+    uint64_t now_ns;  // Simulated time
+    uint64_t busy_ns;  // Time the clock ran
+    uint32_t transfers;
+    uint32_t unarmed;  // Transfers the slave was not armed for
+    aSmart_SpiLink_t* master;
+    aSmart_SpiLink_t* slave;
+    const uint8_t* master_tx;  // Transfer the master started, NULL if none
+    uint8_t* master_rx;
+    const uint8_t* slave_tx;  // Transfer the slave armed, NULL if none
+    uint8_t* slave_rx;
+    uint8_t ready;  // Data-ready line
+} aSmart_SpiSimBus_t;
+
+/* Driver functions of the two ends, the driver pointer is the bus */
+extern const aSmart_SpiDriver_t asmart_spisim_master_driver;
+extern const aSmart_SpiDriver_t asmart_spisim_slave_driver;
+
+/**
+ * @brief Initializes an idle pair at time 0; then initialize each link with its end's driver
+ *        functions and the bus as driver.
+ * @param bus Pointer to the bus structure.
+ * @param clock_hz SPI clock, e.g. 16000000.
+ * @param master Link of the master end.
+ * @param slave Link of the slave end.
+ * @retval None
+ */
+void asmart_spisim_init(aSmart_SpiSimBus_t* bus, uint32_t clock_hz, aSmart_SpiLink_t* master, aSmart_SpiLink_t* slave);
+
+/**
+ * @brief Runs the transfer the master started: both slots cross, then the slave's and the
+ *        master's links complete it, as their DMA complete interrupts do.
+ * @note Time moves on by the gap and the transfer's length. A slave that is not armed misses
+ *       the master's slot and sends SPISIM_IDLE_FILL.
+ * @param bus Pointer to the bus structure.
+ * @retval 1 if a transfer ran, 0 if the master has none.
+ */
+uint8_t asmart_spisim_step(aSmart_SpiSimBus_t* bus);
+
+/**
+ * @brief Moves the time of an idle pair on.
+ * @param bus Pointer to the bus structure.
+ * @param ns Time to pass.
+ * @retval None
+ */
+void asmart_spisim_advance(aSmart_SpiSimBus_t* bus, uint64_t ns);
+
+/**
+ * @brief Clock source of the simulated time, for asmart_comm_set_clock().
+ * @retval Milliseconds of the pair last initialized.
+ */
+uint32_t asmart_spisim_clock(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // _ASMART_COMM_SPISIM_H_
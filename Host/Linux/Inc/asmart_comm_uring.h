@@ -0,0 +1,133 @@
+#ifndef _ASMART_COMM_URING_H_
+#define _ASMART_COMM_URING_H_
+
+/*
+ * Thin io_uring wrapper for the host port's io_uring engine, on the raw system calls so no
+ * liburing is needed: ring setup, submission and completion, a ring of provided receive
+ * buffers, a sparse table of registered buffers and synchronous cancellation.
+ */
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdint.h>
+#include <stddef.h>
+#include <linux/io_uring.h>
+
+// Multishot read, Linux 6.7; older uapi headers do not list it
+#define URING_OP_READ_MULTISHOT 49
+
+// Ring Structure
+typedef struct {
+    int fd;
+    uint32_t features;  // IORING_FEAT_*
+    void* sq_map;
+    size_t sq_map_size;
+    void* cq_map;  // Same as sq_map with IORING_FEAT_SINGLE_MMAP
+    size_t cq_map_size;
+    struct io_uring_sqe* sqes;
+    uint32_t sq_entries;
+    volatile uint32_t* sq_head;  // Advanced by the kernel
+    volatile uint32_t* sq_tail;
+    uint32_t* sq_array;
+    uint32_t sq_mask;
+    uint32_t sq_pending;  // Prepared entries not yet handed to the kernel
+    volatile uint32_t* cq_head;
+    volatile uint32_t* cq_tail;  // Advanced by the kernel
+    struct io_uring_cqe* cqes;
+    uint32_t cq_mask;
+    struct io_uring_buf_ring* buffer_ring;  // Provided receive buffers, group 0
+    uint8_t* buffers;
+    uint16_t buffer_count;  // Power of two
+    uint16_t buffer_size;
+    uint16_t buffer_tail;  // Local copy of the ring's tail
+    uint8_t fixed;  // The registered buffer table exists
+} aSmart_Uring_t;
+
+/**
+ * @brief Creates a ring with a group of provided buffers and a sparse registered buffer table.
+ * @param ring Pointer to the ring structure.
+ * @param entries Submission queue entries; the completion queue has four times as many.
+ * @param buffer_count Provided buffers, a power of two.
+ * @param buffer_size Size of each provided buffer.
+ * @param fixed_slots Entries of the registered buffer table, 0 for none.
+ * @retval 0 on success, -1 otherwise (errno is set). A missing registered buffer table is not an error, see fixed.
+ */
+int asmart_uring_init(aSmart_Uring_t* ring, uint32_t entries, uint16_t buffer_count, uint16_t buffer_size, uint16_t fixed_slots);
+
+/**
+ * @brief Destroys the ring and frees its buffers.
+ * @param ring Pointer to the ring structure.
+ * @retval None
+ */
+void asmart_uring_exit(aSmart_Uring_t* ring);
+
+/**
+ * @brief Returns a cleared submission entry, submitting the prepared ones first if the queue is full.
+ * @param ring Pointer to the ring structure.
+ * @retval Pointer to the entry, NULL if the queue stayed full.
+ */
+struct io_uring_sqe* asmart_uring_get_sqe(aSmart_Uring_t* ring);
+
+/**
+ * @brief Submits the prepared entries and waits for a completion.
+ * @param ring Pointer to the ring structure.
+ * @param timeout_ms Longest wait, 0 not to wait, -1 without limit.
+ * @retval 0 on success or timeout, -1 on error (errno is set).
+ */
+int asmart_uring_submit(aSmart_Uring_t* ring, int timeout_ms);
+
+/**
+ * @brief Returns the oldest completion without removing it.
+ * @param ring Pointer to the ring structure.
+ * @retval Pointer to the completion, NULL if there is none.
+ */
+struct io_uring_cqe* asmart_uring_peek(aSmart_Uring_t* ring);
+
+/**
+ * @brief Removes the oldest completion.
+ * @param ring Pointer to the ring structure.
+ * @retval None
+ */
+void asmart_uring_advance(aSmart_Uring_t* ring);
+
+/**
+ * @brief Returns a provided buffer.
+ * @param ring Pointer to the ring structure.
+ * @param id Buffer ID from the completion flags.
+ * @retval Pointer to the buffer.
+ */
+uint8_t* asmart_uring_buffer(aSmart_Uring_t* ring, uint16_t id);
+
+/**
+ * @brief Gives a provided buffer back to the kernel.
+ * @param ring Pointer to the ring structure.
+ * @param id Buffer ID.
+ * @retval None
+ */
+void asmart_uring_recycle(aSmart_Uring_t* ring, uint16_t id);
+
+/**
+ * @brief Sets an entry of the registered buffer table.
+ * @param ring Pointer to the ring structure.
+ * @param slot Table index.
+ * @param data Pointer to the buffer, NULL to clear the entry.
+ * @param size Size of the buffer.
+ * @retval 0 on success, -1 otherwise (errno is set).
+ */
+int asmart_uring_register_buffer(aSmart_Uring_t* ring, uint16_t slot, void* data, size_t size);
+
+/**
+ * @brief Cancels every request on a file descriptor and waits until they are gone.
+ * @param ring Pointer to the ring structure.
+ * @param fd File descriptor.
+ * @retval None
+ */
+void asmart_uring_cancel_fd(aSmart_Uring_t* ring, int fd);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // _ASMART_COMM_URING_H_
@@ -0,0 +1,305 @@
+/**
+  ******************************************************************************
+  * @file           : asmart_bench.c
+  * @brief          : Throughput benchmark of the multi-core host runtime
+  ******************************************************************************
+  *
+  * Usage: asmart_bench [-p pairs] [-r reactors] [-w workers] [-t seconds]
+  *                     [-n window] [-b payload] [-k work] [-e epoll|uring]
+  *                     [-x pty|socket] [--secure] [--scale] [--compare]
+  *
+  * Every pair is a pseudo-terminal, or a socket pair with -x socket, with a link on each
+  * side; -e selects the reactors' event loop engine. The client side keeps
+  * <window> commands in flight and sends the next one when a response arrives; the
+  * server side runs <work> CRC passes over the payload per command, standing in for
+  * application work, and answers. Frames/s counts commands and responses delivered.
+  * --secure gives every pair a link key, so each frame is sealed and opened with AES-CCM.
+  * --scale repeats the run with 1, 2, 4, ... reactors and workers up to the core count.
+  * --compare runs both engines over both transports with the same settings.
+  *
+  ******************************************************************************
+  */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include "asmart_comm_runtime.h"
+#include "crc16.h"
+
+#define BENCH_COMMAND 0x10
+#define BENCH_WARMUP_MS 500
+#define BENCH_CLIENT_ADDRESS 0x01
+#define BENCH_SERVER_ADDRESS 0x02
+
+// Benchmark Settings
+typedef struct {
+    uint16_t pairs;
+    uint16_t reactors;
+    uint16_t workers;
+    uint16_t seconds;
+    uint16_t window;
+    uint16_t payload;
+    uint32_t work;
+    aSmart_HostEngine_t engine;
+    uint8_t sockets;  // Socket pairs instead of pseudo-terminals
+    uint8_t secure;  // Link keys on every pair
+} BenchConfig_t;
+
+// Client Side State
+typedef struct {
+    uint32_t sent;  // Counter carried by the next command
+    uint32_t expected;  // Lowest counter the next response may carry
+    atomic_ulong completed;
+    atomic_ulong timeouts;
+    atomic_ulong reordered;
+} BenchClient_t;
+
+static atomic_ulong unsent;  // Sends refused by a full outbox
+
+static BenchConfig_t config = { 64, 1, 1, 3, 4, 32, 10, HOST_ENGINE_EPOLL, 0, 0 };
+static atomic_ushort work_result;  // Keeps the work from being optimized away
+
+#if ASMART_COMM_SECURE
+/* Secures both ends of a pair; the nonce needs distinct addresses */
+static int secure_pair(aSmart_Link_t* client, aSmart_Link_t* server) {
+    static const uint8_t key[SECURE_KEY_SIZE] = { 0x61, 0x53, 0x6D, 0x61, 0x72, 0x74, 0x20, 0x62, 0x65, 0x6E, 0x63, 0x68, 0x20, 0x6B, 0x65, 0x79 };
+
+    asmart_comm_set_address(&client->handler, BENCH_CLIENT_ADDRESS, 0);
+    asmart_comm_set_peer(&client->handler, BENCH_SERVER_ADDRESS);
+    asmart_comm_set_address(&server->handler, BENCH_SERVER_ADDRESS, 0);
+    asmart_comm_set_peer(&server->handler, BENCH_CLIENT_ADDRESS);
+    if (!asmart_comm_set_link_key(&client->handler, BENCH_SERVER_ADDRESS, key, 1) || !asmart_comm_set_link_key(&server->handler, BENCH_CLIENT_ADDRESS, key, 1)) {
+        return -1;
+    }
+    return 0;
+}
+#endif
+
+/* Sends a command carrying the client's counter */
+static void send_next(aSmart_Link_t* link, BenchClient_t* client) {
+    uint8_t payload[ASMART_COMM_MAX_PAYLOAD];
+
+    memset(payload, 0xA5, config.payload);
+    memcpy(payload, &client->sent, (config.payload < sizeof(client->sent)) ? config.payload : sizeof(client->sent));
+    client->sent++;
+    if (!asmart_runtime_send_command(link, BENCH_COMMAND, payload, config.payload)) {
+        atomic_fetch_add_explicit(&unsent, 1, memory_order_relaxed);
+    }
+}
+
+/* Client side: keep the window full */
+static void client_callback(aSmart_Link_t* link, uint8_t message_type, uint8_t command_type, uint16_t sequence_number, uint8_t* payload, uint16_t length) {
+    BenchClient_t* client = (BenchClient_t*)link->context;
+    (void)command_type;
+    (void)sequence_number;
+
+    if (message_type == MSG_TYPE_RESPONSE) {
+        uint32_t counter = 0;
+
+        /* Responses of one link come back in the order sent; timed out ones leave gaps */
+        memcpy(&counter, payload, (length < sizeof(counter)) ? length : sizeof(counter));
+        if (length >= sizeof(counter) && counter < client->expected) {
+            atomic_fetch_add_explicit(&client->reordered, 1, memory_order_relaxed);
+        }
+        client->expected = counter + 1;
+        atomic_fetch_add_explicit(&client->completed, 1, memory_order_relaxed);
+    }
+    else if (message_type == MSG_TYPE_ERROR && payload == NULL) {
+        atomic_fetch_add_explicit(&client->timeouts, 1, memory_order_relaxed);
+    }
+    else {
+        return;
+    }
+    send_next(link, client);
+}
+
+/* Server side: some work per command, then the answer */
+static void server_callback(aSmart_Link_t* link, uint8_t message_type, uint8_t command_type, uint16_t sequence_number, uint8_t* payload, uint16_t length) {
+    uint16_t crc = 0;
+
+    if (message_type != MSG_TYPE_COMMAND) {
+        return;
+    }
+    for (uint32_t i = 0; i < config.work; i++) {
+        crc ^= crc16(payload, length);
+    }
+    atomic_store_explicit(&work_result, crc, memory_order_relaxed);
+    if (!asmart_runtime_send_response(link, sequence_number, command_type, payload, length)) {
+        atomic_fetch_add_explicit(&unsent, 1, memory_order_relaxed);
+    }
+}
+
+static uint64_t total_completed(BenchClient_t* clients, uint16_t count, uint64_t* timeouts, uint64_t* reordered) {
+    uint64_t completed = 0;
+
+    *timeouts = 0;
+    *reordered = 0;
+    for (uint16_t i = 0; i < count; i++) {
+        completed += atomic_load(&clients[i].completed);
+        *timeouts += atomic_load(&clients[i].timeouts);
+        *reordered += atomic_load(&clients[i].reordered);
+    }
+    return completed;
+}
+
+static int run_bench(void) {
+    aSmart_Runtime_t runtime;
+    BenchClient_t* clients = calloc(config.pairs, sizeof(BenchClient_t));
+    char slave_path[64];
+
+    if (clients == NULL || asmart_runtime_init(&runtime, config.reactors, config.workers, (uint16_t)(2 * config.pairs), config.engine) < 0) {
+        perror("runtime");
+        free(clients);
+        return -1;
+    }
+    for (uint16_t i = 0; i < config.pairs; i++) {
+        aSmart_Link_t* client = NULL;
+        aSmart_Link_t* server = NULL;
+        int fds[2];
+
+        if (config.sockets) {
+            if (socketpair(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0, fds) == 0) {
+                client = asmart_runtime_attach(&runtime, fds[0], client_callback, &clients[i]);
+                server = (client != NULL) ? asmart_runtime_attach(&runtime, fds[1], server_callback, NULL) : NULL;
+                if (client == NULL) {
+                    close(fds[1]);
+                }
+            }
+        }
+        else {
+            client = asmart_runtime_open_pty(&runtime, slave_path, sizeof(slave_path), client_callback, &clients[i]);
+            server = (client != NULL) ? asmart_runtime_open(&runtime, slave_path, 115200, server_callback, NULL) : NULL;
+        }
+        if (server == NULL) {
+            perror(config.sockets ? "socketpair" : "pty");
+            asmart_runtime_stop(&runtime);
+            free(clients);
+            return -1;
+        }
+#if ASMART_COMM_SECURE
+        if (config.secure && secure_pair(client, server) < 0) {
+            fprintf(stderr, "link key refused\n");
+            asmart_runtime_stop(&runtime);
+            free(clients);
+            return -1;
+        }
+#endif
+        for (uint16_t j = 0; j < config.window; j++) {
+            send_next(client, &clients[i]);
+        }
+    }
+    if (asmart_runtime_start(&runtime) < 0) {
+        perror("start");
+        asmart_runtime_stop(&runtime);
+        free(clients);
+        return -1;
+    }
+
+    uint64_t timeouts;
+    uint64_t reordered;
+    usleep(BENCH_WARMUP_MS * 1000);
+    uint64_t first = total_completed(clients, config.pairs, &timeouts, &reordered);
+    uint32_t start = HAL_GetTick();
+    sleep(config.seconds);
+    uint64_t last = total_completed(clients, config.pairs, &timeouts, &reordered);
+    uint32_t elapsed = HAL_GetTick() - start;
+
+    uint64_t dropped = 0;
+    uint64_t stolen = 0;
+    for (uint16_t i = 0; i < runtime.link_count; i++) {
+        dropped += atomic_load(&runtime.links[i]->dropped);
+    }
+    for (uint16_t i = 0; i < runtime.worker_count; i++) {
+        stolen += atomic_load(&runtime.workers[i].stolen);
+    }
+    asmart_runtime_stop(&runtime);
+    free(clients);
+
+    printf("%-5s %-6s %-3s %5u pairs %3u reactors %3u workers: %10.0f frames/s, %llu timeouts, %llu reordered, %llu dropped, %llu unsent, %llu stolen\n",
+           (config.engine == HOST_ENGINE_URING) ? "uring" : "epoll", config.sockets ? "socket" : "pty", config.secure ? "ccm" : "",
+           config.pairs, config.reactors, config.workers, 2.0 * (double)(last - first) * 1000.0 / (double)elapsed,
+           (unsigned long long)timeouts, (unsigned long long)reordered, (unsigned long long)dropped, (unsigned long long)atomic_exchange(&unsent, 0), (unsigned long long)stolen);
+    fflush(stdout);
+    return 0;
+}
+
+int main(int argc, char** argv) {
+    int scale = 0;
+    int compare = 0;
+
+    for (int i = 1; i < argc; i++) {
+        const char* option = argv[i];
+        const char* argument = (i + 1 < argc) ? argv[i + 1] : "";
+        uint32_t value = (uint32_t)strtoul(argument, NULL, 10);
+
+        if (strcmp(option, "--scale") == 0) {
+            scale = 1;
+            continue;
+        }
+        if (strcmp(option, "--compare") == 0) {
+            compare = 1;
+            continue;
+        }
+        if (strcmp(option, "--secure") == 0) {
+            config.secure = 1;
+            continue;
+        }
+        if (option[0] != '-' || option[1] == '\0' || option[2] != '\0' || i + 1 >= argc) {
+            fprintf(stderr, "usage: %s [-p pairs] [-r reactors] [-w workers] [-t seconds] [-n window] [-b payload] [-k work] [-e epoll|uring] [-x pty|socket] [--secure] [--scale] [--compare]\n", argv[0]);
+            return 1;
+        }
+        switch (option[1]) {
+            case 'e': config.engine = (strcmp(argument, "uring") == 0) ? HOST_ENGINE_URING : HOST_ENGINE_EPOLL; break;
+            case 'x': config.sockets = (strcmp(argument, "socket") == 0); break;
+            case 'p': config.pairs = (uint16_t)value; break;
+            case 'r': config.reactors = (uint16_t)value; break;
+            case 'w': config.workers = (uint16_t)value; break;
+            case 't': config.seconds = (uint16_t)value; break;
+            case 'n': config.window = (uint16_t)value; break;
+            case 'b': config.payload = (uint16_t)value; break;
+            case 'k': config.work = value; break;
+            default: fprintf(stderr, "unknown option %s\n", option); return 1;
+        }
+        i++;
+    }
+    if (config.pairs == 0 || 2 * config.pairs > UINT16_MAX || config.window == 0 || config.window > RUNTIME_OUTBOX_DEPTH / 2
+        || config.payload == 0 || config.payload > ASMART_COMM_MAX_PAYLOAD || config.reactors == 0 || config.workers == 0
+        || (config.secure && (!ASMART_COMM_SECURE || config.payload > ASMART_COMM_SECURE_MAX_PAYLOAD))) {
+        fprintf(stderr, "invalid settings\n");
+        return 1;
+    }
+    if (compare) {
+        for (uint8_t sockets = 0; sockets <= 1; sockets++) {
+            config.sockets = sockets;
+            config.engine = HOST_ENGINE_EPOLL;
+            if (run_bench() < 0) {
+                return 1;
+            }
+            config.engine = HOST_ENGINE_URING;
+            if (run_bench() < 0) {
+                return 1;
+            }
+        }
+        return 0;
+    }
+    if (!scale) {
+        return (run_bench() < 0) ? 1 : 0;
+    }
+
+    long cores = sysconf(_SC_NPROCESSORS_ONLN);
+    for (long threads = 1; ; threads *= 2) {
+        if (threads > cores) {
+            threads = cores;
+        }
+        config.reactors = (uint16_t)threads;
+        config.workers = (uint16_t)threads;
+        if (run_bench() < 0) {
+            return 1;
+        }
+        if (threads == cores) {
+            break;
+        }
+    }
+    return 0;
+}
@@ -0,0 +1,213 @@
+/**
+  ******************************************************************************
+  * @file           : asmart_bulk.c
+  * @brief          : Sends or receives a file with a bulk transfer
+  ******************************************************************************
+  *
+  * Usage: asmart_bulk send <device>[:<baudrate>] <file> [-a address]
+  *        asmart_bulk receive <device>[:<baudrate>] <file>
+  *        asmart_bulk loopback <file> <copy>
+  *
+  * send streams <file> to the bulk receiver of the node at -a (default 0x01), e.g. a
+  * firmware image into a device's flash writer. receive waits for one transfer and writes
+  * it to <file>, page by page. loopback sends <file> over a pseudo-terminal to a second
+  * handler that writes <copy>. Each reports the outcome, the bytes per second and how many
+  * of them were the file's.
+  *
+  ******************************************************************************
+  */
+#include <fcntl.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include "asmart_comm_handler.h"
+
+#if !ASMART_COMM_BULK
+#error "asmart_bulk needs ASMART_COMM_BULK, which the tiny profile leaves out"
+#endif
+
+#define DEFAULT_BAUDRATE 115200
+#define BULK_SENDER_ADDRESS 0x02  // Own address in loopback, the receiver keeps the default
+
+// Side of a Transfer
+typedef struct {
+    aSmart_HostPort_t port;
+    aSmart_Comm_Handler_t handler;
+    int fd;  // File read or written
+    uint8_t done;
+    uint8_t status;
+} BulkNode_t;
+
+static BulkNode_t sender;
+static BulkNode_t receiver;
+static aSmart_BulkTx_t bulk_tx;
+static aSmart_BulkRx_t bulk_rx;
+static volatile sig_atomic_t running = 1;
+
+static const char* status_names[] = {"ok", "refused", "crc mismatch", "sink failed", "source failed", "timeout", "cancelled"};
+
+static void stop(int signal_number) {
+    (void)signal_number;
+    running = 0;
+}
+
+/* Reads a block of the file */
+static uint8_t file_source(void* context, uint32_t offset, uint8_t* data, uint16_t length) {
+    BulkNode_t* node = (BulkNode_t*)context;
+
+    return pread(node->fd, data, length, offset) == (ssize_t)length;
+}
+
+/* Writes a page to the file */
+static uint8_t file_sink(void* context, uint32_t offset, const uint8_t* data, uint16_t length) {
+    BulkNode_t* node = (BulkNode_t*)context;
+
+    return pwrite(node->fd, data, length, offset) == (ssize_t)length;
+}
+
+static void transfer_done(void* context, uint8_t status) {
+    BulkNode_t* node = (BulkNode_t*)context;
+
+    node->done = 1;
+    node->status = status;
+}
+
+static const char* status_name(uint8_t status) {
+    return (status < sizeof(status_names) / sizeof(status_names[0])) ? status_names[status] : "unknown";
+}
+
+static int open_device(aSmart_HostLoop_t* loop, aSmart_HostPort_t* port, char* argument) {
+    uint32_t baudrate = DEFAULT_BAUDRATE;
+    char* separator = strrchr(argument, ':');
+
+    if (separator != NULL) {
+        *separator = '\0';
+        baudrate = (uint32_t)strtoul(separator + 1, NULL, 10);
+    }
+    if (asmart_host_open(loop, port, argument, baudrate) < 0) {
+        perror(argument);
+        return -1;
+    }
+    return 0;
+}
+
+/* CRC-32 of the whole file, announced in the open command */
+static int file_crc(int fd, uint32_t* size, uint32_t* crc) {
+    uint8_t chunk[4096];
+    ssize_t length;
+
+    *size = 0;
+    *crc = 0;
+    while ((length = pread(fd, chunk, sizeof(chunk), *size)) > 0) {
+        *crc = asmart_bulk_crc32(*crc, chunk, (uint32_t)length);
+        *size += (uint32_t)length;
+    }
+    return (length < 0) ? -1 : 0;
+}
+
+/* Runs the loop until every node given is done */
+static void run(aSmart_HostLoop_t* loop, BulkNode_t* first, BulkNode_t* second) {
+    while (running && !(first->done && (second == NULL || second->done))) {
+        if (asmart_host_poll(loop, -1) < 0) {
+            perror("epoll_wait");
+            return;
+        }
+    }
+}
+
+static int start_send(BulkNode_t* node, const char* path, uint8_t destination, uint32_t* size) {
+    uint32_t crc;
+
+    node->fd = open(path, O_RDONLY);
+    if (node->fd < 0 || file_crc(node->fd, size, &crc) < 0) {
+        perror(path);
+        return -1;
+    }
+    if (!asmart_comm_bulk_send(&node->handler, &bulk_tx, destination, *size, crc, file_source, transfer_done, node)) {
+        fprintf(stderr, "%s: empty or too large for a transfer\n", path);
+        return -1;
+    }
+    return 0;
+}
+
+static int start_receive(BulkNode_t* node, const char* path) {
+    node->fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (node->fd < 0) {
+        perror(path);
+        return -1;
+    }
+    asmart_comm_bulk_receive(&node->handler, &bulk_rx, file_sink, transfer_done, node);
+    return 0;
+}
+
+static void report(const char* role, BulkNode_t* node, uint32_t size, uint32_t elapsed_ms) {
+    double seconds = (elapsed_ms > 0) ? elapsed_ms / 1000.0 : 0.001;
+
+    printf("%s: %s, %u bytes in %.3f s, %.0f bytes/s\n", role, node->done ? status_name(node->status) : "interrupted", size, seconds, size / seconds);
+}
+
+int main(int argc, char** argv) {
+    aSmart_HostLoop_t loop;
+    const char* mode = (argc >= 2) ? argv[1] : "";
+    uint8_t destination = ASMART_COMM_DEFAULT_ADDRESS;
+    uint32_t size = 0;
+
+    if (argc == 6 && strcmp(mode, "send") == 0 && strcmp(argv[4], "-a") == 0) {
+        destination = (uint8_t)strtoul(argv[5], NULL, 0);
+    }
+    else if (argc != 4 || (strcmp(mode, "send") != 0 && strcmp(mode, "receive") != 0 && strcmp(mode, "loopback") != 0)) {
+        fprintf(stderr, "usage: %s send <device>[:<baudrate>] <file> [-a address] | receive <device>[:<baudrate>] <file> | loopback <file> <copy>\n", argv[0]);
+        return 1;
+    }
+    if (asmart_host_loop_init(&loop) < 0) {
+        perror("init");
+        return 1;
+    }
+    signal(SIGINT, stop);
+    signal(SIGTERM, stop);
+
+    uint32_t start = HAL_GetTick();
+    if (strcmp(mode, "loopback") == 0) {
+        char slave_path[64];
+
+        if (asmart_host_open_pty(&loop, &sender.port, slave_path, sizeof(slave_path)) < 0 || asmart_host_open(&loop, &receiver.port, slave_path, DEFAULT_BAUDRATE) < 0) {
+            perror("pty");
+            return 1;
+        }
+        asmart_comm_init_port(&sender.handler, &sender.port, NULL);
+        asmart_comm_init_port(&receiver.handler, &receiver.port, NULL);
+        asmart_comm_set_address(&sender.handler, BULK_SENDER_ADDRESS, 0);
+        if (start_receive(&receiver, argv[3]) < 0 || start_send(&sender, argv[2], ASMART_COMM_DEFAULT_ADDRESS, &size) < 0) {
+            return 1;
+        }
+        start = HAL_GetTick();
+        run(&loop, &sender, &receiver);
+        report("sender", &sender, size, HAL_GetTick() - start);
+        report("receiver", &receiver, size, HAL_GetTick() - start);
+        return (sender.done && receiver.done && sender.status == BULK_OK && receiver.status == BULK_OK) ? 0 : 1;
+    }
+
+    BulkNode_t* node = (strcmp(mode, "send") == 0) ? &sender : &receiver;
+    if (open_device(&loop, &node->port, argv[2]) < 0) {
+        return 1;
+    }
+    asmart_comm_init_port(&node->handler, &node->port, NULL);
+    if (node == &sender) {
+        asmart_comm_set_address(&node->handler, BULK_SENDER_ADDRESS, 0);
+        if (start_send(node, argv[3], destination, &size) < 0) {
+            return 1;
+        }
+    }
+    else if (start_receive(node, argv[3]) < 0) {
+        return 1;
+    }
+    run(&loop, node, NULL);
+    if (node == &receiver) {
+        size = bulk_rx.size;
+    }
+    report(mode, node, size, HAL_GetTick() - start);
+    return (node->done && node->status == BULK_OK) ? 0 : 1;
+}
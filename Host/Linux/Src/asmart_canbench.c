@@ -0,0 +1,218 @@
+/**
+  ******************************************************************************
+  * @file           : asmart_canbench.c
+  * @brief          : Throughput and latency of the CAN-FD transport on a simulated bus
+  ******************************************************************************
+  *
+  * Usage: asmart_canbench [-n nodes] [-b payload] [-w window] [-t seconds]
+  *                        [-a nominal bit/s] [-d data bit/s] [-s block size] [--sweep]
+  *
+  * A controller at address 0x01 and <nodes> nodes from 0x10 up share one simulated CAN-FD
+  * bus (asmart_comm_cansim.c). The controller keeps <window> commands of <payload> bytes in
+  * flight, spread over the nodes in turn; every node echoes the payload in its response.
+  * Time is the bus's: frames take the bus as long as their bits do at the nominal and data
+  * bit rates, nodes answer at once. Latency runs from the command being handed to the
+  * handler to its response being dispatched, queueing and arbitration included.
+  * --sweep repeats the run for payloads of 8 bytes up to the largest one that fits a frame.
+  *
+  ******************************************************************************
+  */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "asmart_comm_cansim.h"
+
+#define BENCH_COMMAND 0x10
+#define BENCH_CONTROLLER_ADDRESS 0x01
+#define BENCH_FIRST_NODE 0x10
+#define BENCH_IDLE_NS 10000  // Time that passes while no controller has a frame
+#define BENCH_SAMPLES_MAX 4000000  // Latencies kept for the percentiles
+
+// Benchmark Settings
+typedef struct {
+    uint16_t nodes;
+    uint16_t payload;
+    uint16_t window;
+    uint16_t seconds;
+    uint32_t nominal_bitrate;
+    uint32_t data_bitrate;
+    uint8_t block_size;  // Granted by the receivers, 0 for whole messages
+    uint8_t sweep;  // Repeat over payload sizes
+} BenchConfig_t;
+
+// One Node on the Bus
+typedef struct {
+    aSmart_Comm_Handler_t handler;
+    aSmart_CanLink_t link;
+    aSmart_CanSimNode_t controller;
+} BenchNode_t;
+
+// Results of a Run
+typedef struct {
+    uint64_t sent;
+    uint64_t completed;
+    uint64_t timeouts;
+    uint64_t* latencies;  // ns
+    uint32_t samples;
+} BenchResult_t;
+
+static BenchConfig_t config = { 8, 32, 8, 2, 500000, 2000000, CAN_BLOCK_SIZE, 0 };
+static aSmart_CanSimBus_t bus;
+static BenchNode_t* active_node;  // Node whose handler is being run, for its callback
+static BenchResult_t result;
+
+/* Nodes: echo every command */
+static void node_callback(uint8_t message_type, uint8_t command_type, uint16_t sequence_number, uint8_t* payload, uint16_t length) {
+    if (message_type == MSG_TYPE_COMMAND) {
+        asmart_comm_send_response(&active_node->handler, sequence_number, command_type, payload, length);
+    }
+}
+
+/* Controller: the payload carries the time its command was sent */
+static void controller_callback(uint8_t message_type, uint8_t command_type, uint16_t sequence_number, uint8_t* payload, uint16_t length) {
+    (void)command_type;
+    (void)sequence_number;
+
+    if (message_type == MSG_TYPE_RESPONSE && length >= sizeof(uint64_t)) {
+        uint64_t sent_ns;
+
+        memcpy(&sent_ns, payload, sizeof(sent_ns));
+        if (result.samples < BENCH_SAMPLES_MAX) {
+            result.latencies[result.samples++] = bus.now_ns - sent_ns;
+        }
+        result.completed++;
+    }
+    else if (message_type == MSG_TYPE_ERROR && payload == NULL) {
+        result.timeouts++;
+    }
+}
+
+static int compare_latency(const void* a, const void* b) {
+    uint64_t x = *(const uint64_t*)a;
+    uint64_t y = *(const uint64_t*)b;
+
+    return (x > y) - (x < y);
+}
+
+static void setup_node(BenchNode_t* node, uint8_t address, ResponseCallback callback) {
+    asmart_can_init(&node->link, &node->handler, asmart_cansim_write, &node->controller, callback);
+    asmart_cansim_attach(&bus, &node->controller, &node->link);
+    asmart_can_set_address(&node->link, address, 0);
+    node->link.block_size = config.block_size;
+}
+
+static int run_bench(void) {
+    BenchNode_t* nodes = calloc(config.nodes + 1, sizeof(BenchNode_t));
+    BenchNode_t* controller = &nodes[config.nodes];
+    uint8_t payload[ASMART_COMM_MAX_PAYLOAD];
+    uint64_t end_ns = (uint64_t)config.seconds * 1000000000ULL;
+    uint64_t arbitration_lost = 0;
+    uint64_t drops = 0;
+    uint16_t next_node = 0;
+
+    if (nodes == NULL) {
+        return -1;
+    }
+    memset(&result, 0, sizeof(result));
+    result.latencies = malloc(BENCH_SAMPLES_MAX * sizeof(uint64_t));
+    if (result.latencies == NULL) {
+        free(nodes);
+        return -1;
+    }
+
+    asmart_cansim_init(&bus, config.nominal_bitrate, config.data_bitrate);
+    asmart_comm_set_clock(asmart_cansim_clock);
+    for (uint16_t i = 0; i < config.nodes; i++) {
+        setup_node(&nodes[i], BENCH_FIRST_NODE + i, node_callback);
+        asmart_comm_set_peer(&nodes[i].handler, BENCH_CONTROLLER_ADDRESS);
+    }
+    setup_node(controller, BENCH_CONTROLLER_ADDRESS, controller_callback);
+    memset(payload, 0xA5, sizeof(payload));
+
+    while (bus.now_ns < end_ns) {
+        for (uint16_t i = 0; i < config.nodes; i++) {
+            active_node = &nodes[i];
+            asmart_comm_handler(&nodes[i].handler);
+            asmart_can_service(&nodes[i].link);
+        }
+        asmart_comm_handler(&controller->handler);
+
+        /* Keep the window full, one node after the other, as far as the link can queue */
+        while (result.sent - result.completed - result.timeouts < config.window && asmart_can_tx_room(&controller->link) >= FRAME_HEADER_SIZE + config.payload + FRAME_TRAILER_SIZE) {
+            memcpy(payload, &bus.now_ns, sizeof(bus.now_ns));
+            asmart_comm_send_command_to(&controller->handler, BENCH_FIRST_NODE + next_node, BENCH_COMMAND, payload, config.payload);
+            next_node = (next_node + 1) % config.nodes;
+            result.sent++;
+        }
+        asmart_can_service(&controller->link);
+
+        if (!asmart_cansim_step(&bus)) {
+            asmart_cansim_advance(&bus, BENCH_IDLE_NS);
+        }
+    }
+
+    for (uint16_t i = 0; i <= config.nodes; i++) {
+        arbitration_lost += nodes[i].controller.arbitration_lost;
+        drops += nodes[i].link.tx_drops + nodes[i].link.rx_drops;
+    }
+    qsort(result.latencies, result.samples, sizeof(uint64_t), compare_latency);
+
+    double seconds = (double)bus.now_ns / 1e9;
+    uint64_t p50 = (result.samples > 0) ? result.latencies[result.samples / 2] : 0;
+    uint64_t p99 = (result.samples > 0) ? result.latencies[(uint64_t)result.samples * 99 / 100] : 0;
+    uint64_t max = (result.samples > 0) ? result.latencies[result.samples - 1] : 0;
+
+    printf("%u nodes, %u B, window %u, %u/%u kbit/s: %.0f req/s, %.1f kB/s payload, bus load %.1f %%, %.0f frames/s, latency p50 %.0f us p99 %.0f us max %.0f us, %llu arbitration lost, %llu timeouts, %llu drops\n",
+           config.nodes, config.payload, config.window, config.nominal_bitrate / 1000, config.data_bitrate / 1000,
+           result.completed / seconds, 2.0 * result.completed * config.payload / seconds / 1000, 100.0 * bus.busy_ns / bus.now_ns, bus.frames / seconds,
+           p50 / 1e3, p99 / 1e3, max / 1e3, (unsigned long long)arbitration_lost, (unsigned long long)result.timeouts, (unsigned long long)drops);
+
+    free(result.latencies);
+    free(nodes);
+    return 0;
+}
+
+int main(int argc, char** argv) {
+    for (int i = 1; i < argc; i++) {
+        const char* option = argv[i];
+        const char* argument = (i + 1 < argc) ? argv[i + 1] : "";
+        uint32_t value = (uint32_t)strtoul(argument, NULL, 10);
+
+        if (strcmp(option, "--sweep") == 0) {
+            config.sweep = 1;
+            continue;
+        }
+        if (option[0] != '-' || option[1] == '\0' || option[2] != '\0' || i + 1 >= argc) {
+            fprintf(stderr, "usage: %s [-n nodes] [-b payload] [-w window] [-t seconds] [-a nominal bit/s] [-d data bit/s] [-s block size] [--sweep]\n", argv[0]);
+            return 1;
+        }
+        switch (option[1]) {
+            case 'n': config.nodes = (uint16_t)value; break;
+            case 'b': config.payload = (uint16_t)value; break;
+            case 'w': config.window = (uint16_t)value; break;
+            case 't': config.seconds = (uint16_t)value; break;
+            case 'a': config.nominal_bitrate = value; break;
+            case 'd': config.data_bitrate = value; break;
+            case 's': config.block_size = (uint8_t)value; break;
+            default: fprintf(stderr, "unknown option %s\n", option); return 1;
+        }
+        i++;
+    }
+    if (config.nodes == 0 || config.nodes >= CANSIM_NODES || BENCH_FIRST_NODE + config.nodes > ADDRESS_GROUP_FIRST || config.window == 0 ||
+        config.window > MAPPING_TABLE_ENTRIES || config.payload < sizeof(uint64_t) || config.payload > ASMART_COMM_MAX_PAYLOAD ||
+        config.seconds == 0 || config.nominal_bitrate == 0 || config.data_bitrate < config.nominal_bitrate) {
+        fprintf(stderr, "invalid settings\n");
+        return 1;
+    }
+
+    if (!config.sweep) {
+        return (run_bench() == 0) ? 0 : 1;
+    }
+    for (uint16_t payload = sizeof(uint64_t); payload <= ASMART_COMM_MAX_PAYLOAD; payload *= 2) {
+        config.payload = payload;
+        if (run_bench() != 0) {
+            return 1;
+        }
+    }
+    return 0;
+}
@@ -0,0 +1,56 @@
+#include "asmart_comm_aesni.h"
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define AESNI_X86 1
+#else
+#define AESNI_X86 0
+#endif
+
+/***********************************************************************************************
+ *                                AES-NI Block Cipher                                           *
+ ***********************************************************************************************
+ *
+ * - One AES-128 block in ten AESENC/AESENCLAST steps on the round keys expanded by
+ *   asmart_comm_secure.c. The function is compiled for AES-NI with a target attribute and only
+ *   handed out when the CPU reports the instructions, so the build needs no -maes.
+ *
+ ***********************************************************************************************/
+
+#if AESNI_X86
+/**
+ * @brief Encrypts one block with AES-NI, see SecureBlockCipher.
+ * @param round_keys Expanded key.
+ * @param in Plaintext block.
+ * @param out Ciphertext block, may be in.
+ * @retval None
+ */
+static void aesni_encrypt_block(const uint8_t* round_keys, const uint8_t* in, uint8_t* out);
+#endif
+
+/* Function implementations */
+
+SecureBlockCipher asmart_aesni_cipher(void){
+#if AESNI_X86
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("aes") && __builtin_cpu_supports("sse2")) {
+        return aesni_encrypt_block;
+    }
+#endif
+    return NULL;
+}
+
+/* Internal function implementations */
+
+#if AESNI_X86
+__attribute__((target("aes,sse2")))
+static void aesni_encrypt_block(const uint8_t* round_keys, const uint8_t* in, uint8_t* out) {
+    const __m128i* keys = (const __m128i*)round_keys;
+    __m128i block = _mm_xor_si128(_mm_loadu_si128((const __m128i*)in), _mm_loadu_si128(&keys[0]));
+
+    for (int round = 1; round < 10; round++) {
+        block = _mm_aesenc_si128(block, _mm_loadu_si128(&keys[round]));
+    }
+    block = _mm_aesenclast_si128(block, _mm_loadu_si128(&keys[10]));
+    _mm_storeu_si128((__m128i*)out, block);
+}
+#endif
@@ -0,0 +1,173 @@
+#include "asmart_comm_cansim.h"
+#include <string.h>
+
+/***********************************************************************************************
+ *                                Simulated CAN-FD Bus                                          *
+ ***********************************************************************************************
+ *
+ * - Every controller has a Tx FIFO of CANSIM_TX_FIFO frames, filled by its link. When the bus
+ *   is free, the frames at the heads of all FIFOs arbitrate: the lowest identifier wins, as
+ *   the dominant bits of the identifier override the recessive ones on the wire. The losers
+ *   keep their frames and try again after this one.
+ * - A frame's length comes from its bits: the arbitration phase and the tail at the nominal bit
+ *   rate, the data phase at the data bit rate. Dynamic stuff bits are counted from the actual
+ *   identifier and data, the fixed stuff bits of the CRC field from its length.
+ * - At the end of a frame every other controller whose filters accept it hands it to its link,
+ *   as the receive interrupt does; then the sender's link is serviced as by its Tx complete
+ *   interrupt. Nothing is ever lost or damaged: the controllers retransmit on their own.
+ *
+ ***********************************************************************************************/
+
+// Stuff Bit Counter, over the bits of a frame in the order they go out
+typedef struct {
+    uint8_t last;  // Level of the previous bit
+    uint8_t run;  // Bits of that level in a row
+    uint32_t stuffed;  // Stuff bits inserted so far
+} StuffCounter_t;
+
+/* Bus whose time asmart_cansim_clock() returns */
+static aSmart_CanSimBus_t* clock_bus;
+
+/**
+ * @brief Feeds bits to a stuff bit counter, most significant first.
+ * @note After five bits of the same level a bit of the other level is inserted, which starts
+ *       the next run.
+ * @param counter Pointer to the counter.
+ * @param value Bits.
+ * @param count Number of bits, up to 32.
+ * @retval None
+ */
+static void stuff_bits(StuffCounter_t* counter, uint32_t value, uint8_t count);
+
+void asmart_cansim_init(aSmart_CanSimBus_t* bus, uint32_t nominal_bitrate, uint32_t data_bitrate){
+    memset(bus, 0, sizeof(*bus));
+    bus->nominal_bitrate = nominal_bitrate;
+    bus->data_bitrate = data_bitrate;
+    clock_bus = bus;
+}
+
+int asmart_cansim_attach(aSmart_CanSimBus_t* bus, aSmart_CanSimNode_t* node, aSmart_CanLink_t* link){
+    if (bus->node_count >= CANSIM_NODES) {
+        return -1;
+    }
+    memset(node, 0, sizeof(*node));
+    node->bus = bus;
+    node->link = link;
+    bus->nodes[bus->node_count++] = node;
+    return 0;
+}
+
+uint8_t asmart_cansim_write(void* driver, const aSmart_CanFrame_t* frame){
+    aSmart_CanSimNode_t* node = (aSmart_CanSimNode_t*)driver;
+    uint8_t tail = (node->tx_head + node->tx_count) % CANSIM_TX_FIFO;
+
+    if (node->tx_count >= CANSIM_TX_FIFO) {
+        return 0;
+    }
+    node->tx_fifo[tail] = *frame;
+    node->queued_ns[tail] = node->bus->now_ns;
+    node->tx_count++;
+    return 1;
+}
+
+uint64_t asmart_cansim_frame_ns(const aSmart_CanSimBus_t* bus, const aSmart_CanFrame_t* frame){
+    StuffCounter_t counter = {1, 0, 0};  // The idle bus is recessive
+
+    /* Arbitration phase: SOF, base identifier, SRR, IDE, identifier extension, r1, FDF, res, BRS */
+    stuff_bits(&counter, 0, 1);
+    stuff_bits(&counter, frame->id >> 18, 11);
+    stuff_bits(&counter, 0x3, 2);
+    stuff_bits(&counter, frame->id & 0x3FFFF, 18);
+    stuff_bits(&counter, 0x5, 4);
+    uint32_t arbitration_stuff = counter.stuffed;
+
+    /* Data phase: ESI, DLC, data */
+    stuff_bits(&counter, 0, 1);
+    stuff_bits(&counter, asmart_can_dlc(frame->length), 4);
+    for (uint8_t i = 0; i < frame->length; i++) {
+        stuff_bits(&counter, frame->data[i], 8);
+    }
+
+    /* Stuff count and CRC, a fixed stuff bit ahead of them and after every fourth bit */
+    uint32_t crc_field = 4 + ((frame->length > 16) ? 21 : 17);
+    uint32_t data_bits = 5 + 8 * frame->length + (counter.stuffed - arbitration_stuff) + crc_field + (crc_field + 3) / 4;
+    uint32_t nominal_bits = CANSIM_ARBITRATION_BITS + arbitration_stuff + CANSIM_TAIL_BITS;
+
+    return (uint64_t)nominal_bits * 1000000000ULL / bus->nominal_bitrate + (uint64_t)data_bits * 1000000000ULL / bus->data_bitrate;
+}
+
+uint8_t asmart_cansim_step(aSmart_CanSimBus_t* bus){
+    aSmart_CanSimNode_t* sender = NULL;
+
+    /* The lowest identifier at the head of a Tx FIFO takes the bus */
+    for (uint16_t i = 0; i < bus->node_count; i++) {
+        aSmart_CanSimNode_t* node = bus->nodes[i];
+
+        if (node->tx_count == 0) {
+            continue;
+        }
+        if (sender == NULL || node->tx_fifo[node->tx_head].id < sender->tx_fifo[sender->tx_head].id) {
+            if (sender != NULL) {
+                sender->arbitration_lost++;
+            }
+            sender = node;
+        }
+        else {
+            node->arbitration_lost++;
+        }
+    }
+    if (sender == NULL) {
+        return 0;
+    }
+
+    aSmart_CanFrame_t frame = sender->tx_fifo[sender->tx_head];
+    uint64_t duration = asmart_cansim_frame_ns(bus, &frame);
+
+    sender->access_ns += bus->now_ns - sender->queued_ns[sender->tx_head];
+    sender->tx_head = (sender->tx_head + 1) % CANSIM_TX_FIFO;
+    sender->tx_count--;
+    sender->frames_sent++;
+    bus->now_ns += duration;
+    bus->busy_ns += duration;
+    bus->frames++;
+    bus->data_bytes += frame.length;
+
+    for (uint16_t i = 0; i < bus->node_count; i++) {
+        aSmart_CanSimNode_t* node = bus->nodes[i];
+
+        if (node != sender && asmart_can_accepts(node->link, frame.id)) {
+            asmart_can_receive(node->link, &frame);
+        }
+    }
+    asmart_can_service(sender->link);
+    return 1;
+}
+
+void asmart_cansim_advance(aSmart_CanSimBus_t* bus, uint64_t ns){
+    bus->now_ns += ns;
+}
+
+uint32_t asmart_cansim_clock(void){
+    return (clock_bus != NULL) ? (uint32_t)(clock_bus->now_ns / 1000000ULL) : 0;
+}
+
+/* Internal function implementations */
+
+static void stuff_bits(StuffCounter_t* counter, uint32_t value, uint8_t count) {
+    for (int8_t i = count - 1; i >= 0; i--) {
+        uint8_t bit = (value >> i) & 1;
+
+        if (bit == counter->last) {
+            counter->run++;
+        }
+        else {
+            counter->last = bit;
+            counter->run = 1;
+        }
+        if (counter->run == 5) {
+            counter->stuffed++;
+            counter->last = !bit;
+            counter->run = 1;
+        }
+    }
+}
@@ -0,0 +1,417 @@
+#include "asmart_comm_capture.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+/***********************************************************************************************
+ *                                Frame Capture and Replay                                      *
+ ***********************************************************************************************
+ *
+ * - The writer appends records to a buffer under its lock and writes the buffer out when it is
+ *   full, so a busy loop pays for a memcpy per frame and one write() per CAPTURE_BUFFER_SIZE.
+ *   The offset of every record goes to an index kept in memory.
+ * - Closing writes the index behind the last record and then the header with the record count
+ *   and the index position; until then both are zero, which tells the reader to walk the records.
+ * - The reader maps the file read-only. A record is index[number] bytes into the map, found in
+ *   constant time; the index is sorted by time as well, which asmart_capture_seek() uses.
+ * - The replay driver hands each selected frame to asmart_comm_replay_frame(), which takes the
+ *   frame through the same dispatch as one received from the port. The handler's callback is
+ *   wrapped for the run, so what reaches the application is counted apart from what parsed.
+ *
+ ***********************************************************************************************/
+
+/* Replay running on this thread: the callback it wraps and the counts it adds to */
+static __thread ResponseCallback replay_callback;
+static __thread aSmart_ReplayStats_t* replay_stats;
+
+/**
+ * @brief Counts a delivered message and passes it on to the callback of the replayed handler.
+ * @retval None
+ */
+static void count_delivered(uint8_t message_type, uint8_t command_type, uint16_t sequence_number, uint8_t* payload, uint16_t length);
+
+/**
+ * @brief Returns the monotonic time.
+ * @retval Time in ns.
+ */
+static uint64_t monotonic_ns(void);
+
+/**
+ * @brief Rounds a size up to the 8-byte alignment of the file's parts.
+ * @param size Size in bytes.
+ * @retval Aligned size.
+ */
+static uint64_t align8(uint64_t size);
+
+/**
+ * @brief Writes the whole buffer at a file position, retrying short writes.
+ * @param fd File descriptor.
+ * @param data Pointer to the bytes.
+ * @param size Number of bytes.
+ * @param offset File position.
+ * @retval 0 on success, -1 on error (errno is set).
+ */
+static int write_all(int fd, const void* data, size_t size, uint64_t offset);
+
+/**
+ * @brief Writes the buffered records out; called with the writer's lock held.
+ * @param writer Pointer to the writer structure.
+ * @retval 0 on success, -1 on error (errno is set); the buffered records are dropped either way.
+ */
+static int flush_buffer(aSmart_CaptureWriter_t* writer);
+
+/**
+ * @brief Capture hook of a tap, see CaptureHook.
+ * @param context Pointer to the tap.
+ * @param direction CAPTURE_RX or CAPTURE_TX.
+ * @param frame Pointer to the frame.
+ * @param length Frame length.
+ * @retval None
+ */
+static void tap_hook(void* context, uint8_t direction, const uint8_t* frame, uint16_t length);
+
+/**
+ * @brief Builds the index of a capture that was not closed by walking its records.
+ * @param reader Pointer to the reader structure, map and size set.
+ * @retval 0 on success, -1 if out of memory.
+ */
+static int rebuild_index(aSmart_CaptureReader_t* reader);
+
+/**
+ * @brief Sleeps until a point of the monotonic clock.
+ * @param deadline_ns Monotonic time in ns.
+ * @retval None
+ */
+static void sleep_until(uint64_t deadline_ns);
+
+/* Function implementations */
+
+int asmart_capture_create(aSmart_CaptureWriter_t* writer, const char* path){
+    aSmart_CaptureHeader_t header = { CAPTURE_MAGIC, CAPTURE_VERSION, sizeof(aSmart_CaptureHeader_t), 0, 0, 0 };
+    struct timespec now;
+
+    memset(writer, 0, sizeof(*writer));
+    writer->buffer = malloc(CAPTURE_BUFFER_SIZE);
+    if (writer->buffer == NULL) {
+        return -1;
+    }
+    writer->fd = open(path, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (writer->fd < 0) {
+        free(writer->buffer);
+        return -1;
+    }
+    clock_gettime(CLOCK_REALTIME, &now);
+    header.start_time_ns = (uint64_t)now.tv_sec * 1000000000ULL + (uint64_t)now.tv_nsec;
+    if (write_all(writer->fd, &header, sizeof(header), 0) < 0) {
+        close(writer->fd);
+        free(writer->buffer);
+        return -1;
+    }
+    pthread_mutex_init(&writer->lock, NULL);
+    writer->start_ns = monotonic_ns();
+    writer->start_time_ns = header.start_time_ns;
+    writer->offset = sizeof(header);
+    return 0;
+}
+
+void asmart_capture_write(aSmart_CaptureWriter_t* writer, uint16_t port, uint8_t direction, const uint8_t* frame, uint16_t length){
+    aSmart_CaptureRecord_t record = { 0, length, port, direction, { 0, 0, 0 } };
+    size_t size = (size_t)align8(sizeof(record) + length);
+
+    record.time_ns = monotonic_ns() - writer->start_ns;
+
+    pthread_mutex_lock(&writer->lock);
+    if (writer->count == writer->capacity) {
+        uint64_t capacity = (writer->capacity != 0) ? 2 * writer->capacity : 4096;
+        uint64_t* index = realloc(writer->index, capacity * sizeof(uint64_t));
+
+        if (index == NULL) {
+            writer->dropped++;
+            pthread_mutex_unlock(&writer->lock);
+            return;
+        }
+        writer->index = index;
+        writer->capacity = capacity;
+    }
+    if (writer->buffered + size > CAPTURE_BUFFER_SIZE && flush_buffer(writer) < 0) {
+        writer->dropped++;
+        pthread_mutex_unlock(&writer->lock);
+        return;
+    }
+
+    /* Padding is zeroed so captures of the same traffic compare equal */
+    uint8_t* out = writer->buffer + writer->buffered;
+    memcpy(out, &record, sizeof(record));
+    memcpy(out + sizeof(record), frame, length);
+    memset(out + sizeof(record) + length, 0, size - sizeof(record) - length);
+    writer->buffered += size;
+    writer->index[writer->count++] = writer->offset;
+    writer->offset += size;
+    pthread_mutex_unlock(&writer->lock);
+}
+
+void asmart_capture_tap(aSmart_CaptureTap_t* tap, aSmart_CaptureWriter_t* writer, aSmart_Comm_Handler_t* handler, uint16_t port){
+    tap->writer = writer;
+    tap->port = port;
+    asmart_comm_set_capture(handler, tap_hook, tap);
+}
+
+int asmart_capture_close(aSmart_CaptureWriter_t* writer){
+    aSmart_CaptureHeader_t header = { CAPTURE_MAGIC, CAPTURE_VERSION, sizeof(aSmart_CaptureHeader_t), 0, 0, 0 };
+    int result = 0;
+
+    pthread_mutex_lock(&writer->lock);
+    if (flush_buffer(writer) < 0) {
+        result = -1;
+    }
+    /* Index first, header last: a crash in between leaves a file the reader walks */
+    else if (write_all(writer->fd, writer->index, (size_t)writer->count * sizeof(uint64_t), writer->offset) < 0) {
+        result = -1;
+    }
+    else {
+        header.start_time_ns = writer->start_time_ns;
+        header.record_count = writer->count;
+        header.index_offset = writer->offset;
+        if (write_all(writer->fd, &header, sizeof(header), 0) < 0) {
+            result = -1;
+        }
+    }
+    pthread_mutex_unlock(&writer->lock);
+
+    if (close(writer->fd) < 0) {
+        result = -1;
+    }
+    pthread_mutex_destroy(&writer->lock);
+    free(writer->buffer);
+    free(writer->index);
+    writer->fd = -1;
+    writer->buffer = NULL;
+    writer->index = NULL;
+    return result;
+}
+
+int asmart_capture_open(aSmart_CaptureReader_t* reader, const char* path){
+    struct stat status;
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+
+    memset(reader, 0, sizeof(*reader));
+    if (fd < 0) {
+        return -1;
+    }
+    if (fstat(fd, &status) < 0) {
+        close(fd);
+        return -1;
+    }
+    if ((size_t)status.st_size < sizeof(aSmart_CaptureHeader_t)) {
+        close(fd);
+        errno = EINVAL;
+        return -1;
+    }
+    reader->size = (size_t)status.st_size;
+    reader->map = mmap(NULL, reader->size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (reader->map == MAP_FAILED) {
+        reader->map = NULL;
+        return -1;
+    }
+
+    const aSmart_CaptureHeader_t* header = (const aSmart_CaptureHeader_t*)reader->map;
+    if (header->magic != CAPTURE_MAGIC || header->version != CAPTURE_VERSION || header->header_size != sizeof(aSmart_CaptureHeader_t)) {
+        asmart_capture_unmap(reader);
+        errno = EINVAL;
+        return -1;
+    }
+
+    /* A closed capture carries its index, anything else is walked */
+    if (header->index_offset != 0 && header->index_offset % 8 == 0 && header->index_offset <= reader->size
+        && header->record_count <= (reader->size - header->index_offset) / sizeof(uint64_t)) {
+        reader->index = (const uint64_t*)(reader->map + header->index_offset);
+        reader->count = header->record_count;
+        return 0;
+    }
+    if (rebuild_index(reader) < 0) {
+        asmart_capture_unmap(reader);
+        errno = ENOMEM;
+        return -1;
+    }
+    return 0;
+}
+
+void asmart_capture_unmap(aSmart_CaptureReader_t* reader){
+    if (reader->index_owned) {
+        free((void*)reader->index);
+    }
+    if (reader->map != NULL) {
+        munmap((void*)reader->map, reader->size);
+    }
+    memset(reader, 0, sizeof(*reader));
+}
+
+const aSmart_CaptureRecord_t* asmart_capture_record(const aSmart_CaptureReader_t* reader, uint64_t number){
+    if (number >= reader->count) {
+        return NULL;
+    }
+    uint64_t offset = reader->index[number];
+
+    /* A damaged index must not lead outside the map */
+    if (offset % 8 != 0 || offset + sizeof(aSmart_CaptureRecord_t) > reader->size) {
+        return NULL;
+    }
+    const aSmart_CaptureRecord_t* record = (const aSmart_CaptureRecord_t*)(reader->map + offset);
+    if (offset + sizeof(*record) + record->length > reader->size) {
+        return NULL;
+    }
+    return record;
+}
+
+uint64_t asmart_capture_seek(const aSmart_CaptureReader_t* reader, uint64_t time_ns){
+    uint64_t low = 0;
+    uint64_t high = reader->count;
+
+    while (low < high) {
+        uint64_t middle = low + (high - low) / 2;
+        const aSmart_CaptureRecord_t* record = asmart_capture_record(reader, middle);
+
+        if (record != NULL && record->time_ns < time_ns) {
+            low = middle + 1;
+        }
+        else {
+            high = middle;
+        }
+    }
+    return low;
+}
+
+void asmart_capture_replay(const aSmart_CaptureReader_t* reader, aSmart_Comm_Handler_t* handler, uint16_t port, uint8_t direction, uint64_t first, double speed, aSmart_ReplayStats_t* stats){
+    const aSmart_CaptureRecord_t* start = asmart_capture_record(reader, first);
+    uint64_t started = monotonic_ns();
+
+    replay_callback = handler->response_callback;
+    replay_stats = stats;
+    handler->response_callback = count_delivered;
+    for (uint64_t i = first; i < reader->count; i++) {
+        const aSmart_CaptureRecord_t* record = asmart_capture_record(reader, i);
+
+        if (record == NULL) {
+            break;
+        }
+        if (record->direction != direction || (port != CAPTURE_ALL_PORTS && record->port != port)) {
+            continue;
+        }
+        if (speed > 0) {
+            sleep_until(started + (uint64_t)((double)(record->time_ns - start->time_ns) / speed));
+        }
+        stats->frames += asmart_comm_replay_frame(handler, (const uint8_t*)(record + 1), record->length);
+    }
+    handler->response_callback = replay_callback;
+    replay_callback = NULL;
+    replay_stats = NULL;
+}
+
+static void count_delivered(uint8_t message_type, uint8_t command_type, uint16_t sequence_number, uint8_t* payload, uint16_t length) {
+    replay_stats->delivered++;
+    if (replay_callback != NULL) {
+        replay_callback(message_type, command_type, sequence_number, payload, length);
+    }
+}
+
+static uint64_t monotonic_ns(void) {
+    struct timespec now;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint64_t)now.tv_sec * 1000000000ULL + (uint64_t)now.tv_nsec;
+}
+
+static uint64_t align8(uint64_t size) {
+    return (size + 7) & ~(uint64_t)7;
+}
+
+static int write_all(int fd, const void* data, size_t size, uint64_t offset) {
+    const uint8_t* bytes = (const uint8_t*)data;
+
+    while (size > 0) {
+        ssize_t written = pwrite(fd, bytes, size, (off_t)offset);
+
+        if (written < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return -1;
+        }
+        bytes += written;
+        size -= (size_t)written;
+        offset += (uint64_t)written;
+    }
+    return 0;
+}
+
+static int flush_buffer(aSmart_CaptureWriter_t* writer) {
+    uint64_t start = writer->offset - writer->buffered;
+    int result = write_all(writer->fd, writer->buffer, writer->buffered, start);
+
+    if (result < 0) {
+        /* The lost records leave the index and the file, the next ones take their place */
+        uint64_t lost = 0;
+
+        while (lost < writer->count && writer->index[writer->count - 1 - lost] >= start) {
+            lost++;
+        }
+        writer->count -= lost;
+        writer->dropped += lost;
+        writer->offset = start;
+    }
+    writer->buffered = 0;
+    return result;
+}
+
+static void tap_hook(void* context, uint8_t direction, const uint8_t* frame, uint16_t length) {
+    aSmart_CaptureTap_t* tap = (aSmart_CaptureTap_t*)context;
+
+    asmart_capture_write(tap->writer, tap->port, direction, frame, length);
+}
+
+static int rebuild_index(aSmart_CaptureReader_t* reader) {
+    uint64_t capacity = 4096;
+    uint64_t* index = malloc(capacity * sizeof(uint64_t));
+    uint64_t offset = sizeof(aSmart_CaptureHeader_t);
+
+    if (index == NULL) {
+        return -1;
+    }
+    /* Up to the last whole record; a record cut off by a crash ends the capture */
+    while (offset + sizeof(aSmart_CaptureRecord_t) <= reader->size) {
+        const aSmart_CaptureRecord_t* record = (const aSmart_CaptureRecord_t*)(reader->map + offset);
+        uint64_t size = align8(sizeof(*record) + record->length);
+
+        if (offset + size > reader->size || record->direction > CAPTURE_TX) {
+            break;
+        }
+        if (reader->count == capacity) {
+            uint64_t* grown = realloc(index, 2 * capacity * sizeof(uint64_t));
+
+            if (grown == NULL) {
+                free(index);
+                return -1;
+            }
+            index = grown;
+            capacity *= 2;
+        }
+        index[reader->count++] = offset;
+        offset += size;
+    }
+    reader->index = index;
+    reader->index_owned = 1;
+    return 0;
+}
+
+static void sleep_until(uint64_t deadline_ns) {
+    struct timespec until = { (time_t)(deadline_ns / 1000000000ULL), (long)(deadline_ns % 1000000000ULL) };
+
+    while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &until, NULL) == EINTR) {
+    }
+}
@@ -0,0 +1,1215 @@
+/* ptsname_r() and cfmakeraw() */
+#define _GNU_SOURCE
+
+#include "asmart_comm_host.h"
+#include "asmart_comm_handler.h"
+#include "asmart_comm_uring.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <stdlib.h>
+#include <string.h>
+#include <termios.h>
+#include <time.h>
+#include <unistd.h>
+#include <linux/serial.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/ioctl.h>
+
+/***********************************************************************************************
+ *                                Linux Host Port                                               *
+ ***********************************************************************************************
+ *
+ * - The library itself is unchanged: every serial port gets its own aSmart_Comm_Handler_t and
+ *   the same framing, CRC, command table and timeout code runs as on the MCU.
+ * - One epoll instance watches all ports of a loop. Input is read when the kernel has some, one
+ *   read per port and round so a busy port cannot starve the others, and fed to the parser as
+ *   the receive interrupt would.
+ * - Sends never block the loop: what the driver does not take at once is queued per port and
+ *   written on EPOLLOUT. Only a full queue makes a send wait.
+ * - asmart_comm_handler() runs for the ports that received something, and returns when it has
+ *   to run next. The loop sleeps until the earliest of these deadlines, at most HOST_SWEEP_MS,
+ *   then runs the handlers of all ports; idle ports cost nothing in between. A port sent on
+ *   outside its handler is listed as dirty and its handler runs before the loop sleeps.
+ * - A loop and its ports belong to one thread; use one loop per thread for more ports. Other
+ *   threads reach a loop only through asmart_host_wake(), an eventfd in the same epoll set.
+ * - HOST_ENGINE_URING runs the same loop on io_uring. Every port keeps one multishot read
+ *   armed, which takes a buffer from a ring shared by the loop only when data arrives. Sends
+ *   are queued, and each round submits one write per port for all frames queued since the
+ *   last round, in the same system call that waits for completions; the send queues are
+ *   registered buffers. Data for a held port, or arriving while the library waits inside a
+ *   handler, stays in its buffer until the port is serviced.
+ *
+ ***********************************************************************************************/
+
+// Bytes parsed between two dispatches: at most RX_FRAME_SLOTS frames can end within them
+#define HOST_FEED_SIZE (RX_FRAME_SLOTS * FRAME_MIN_LENGTH)
+
+// io_uring request kinds, in the low byte of user_data; the port's slot and generation are above it
+#define URING_READ 1
+#define URING_WRITE 2
+#define URING_WAKE 3
+#define URING_CANCEL 4
+#define URING_NONE 0xFFFF  // End of a pending buffer list
+
+// What a round of io_uring completions may do with received data
+typedef enum {
+    URING_DISPATCH,  // Parse it and dispatch the frames, from asmart_host_poll()
+    URING_FEED_PORT,  // Parse one buffer of the waiting port, keep the rest, from inside its handler
+    URING_STASH  // Keep all of it
+} UringMode_t;
+
+// io_uring Engine State of a loop
+typedef struct aSmart_HostUring_s {
+    aSmart_Uring_t ring;
+    aSmart_HostPort_t* slots[HOST_URING_PORTS];
+    uint32_t generations[HOST_URING_PORTS];  // Advanced on close, so completions for an earlier port are ignored
+    uint8_t registered[HOST_URING_PORTS];  // The port's send queue is in the registered buffer table
+    uint16_t pending_next[HOST_URING_BUFFERS];  // Links of the ports' pending buffer lists
+    uint16_t pending_length[HOST_URING_BUFFERS];
+    aSmart_HostPort_t* service;  // Ports with buffers to parse or a read to re-arm
+    aSmart_HostPort_t* tx_list;  // Ports with bytes to write
+    uint64_t wake_count;  // Read from the eventfd
+    uint8_t multishot;  // Cleared if the kernel rejects multishot reads
+} HostUring_t;
+
+/* Port whose handler runs on this thread, for the response callback */
+static __thread aSmart_HostPort_t* active_port;
+
+/**
+ * @brief Puts a terminal in raw 8N1 mode without flow control.
+ * @param fd File descriptor of the terminal.
+ * @param baudrate Line speed, 0 to keep the current one.
+ * @retval 0 on success, -1 otherwise (errno is set).
+ */
+static int configure_raw(int fd, uint32_t baudrate);
+
+/**
+ * @brief Maps a line speed to its termios constant.
+ * @param baudrate Line speed.
+ * @retval termios speed, B0 if not supported.
+ */
+static speed_t termios_speed(uint32_t baudrate);
+
+/**
+ * @brief Parses received bytes.
+ * @param port Pointer to the port.
+ * @param data Pointer to the bytes.
+ * @param length Number of bytes.
+ * @param dispatch 1 to dispatch frames in between so the slots never run full, 0 from inside the library.
+ * @retval None
+ */
+static void feed_port(aSmart_HostPort_t* port, const uint8_t* data, uint16_t length, uint8_t dispatch);
+
+/**
+ * @brief Reads once from a port and parses what came in.
+ * @param port Pointer to the port.
+ * @param dispatch As for feed_port().
+ * @retval Number of bytes read.
+ */
+static int read_port(aSmart_HostPort_t* port, uint8_t dispatch);
+
+/**
+ * @brief Writes queued bytes until the driver takes no more.
+ * @param port Pointer to the port.
+ * @retval None
+ */
+static void flush_port(aSmart_HostPort_t* port);
+
+/**
+ * @brief Selects the epoll events of a port: input, and room to write while bytes are queued.
+ * @param port Pointer to the port.
+ * @retval None
+ */
+static void update_events(aSmart_HostPort_t* port);
+
+/**
+ * @brief Stops watching a port whose device went away.
+ * @param port Pointer to the port.
+ * @retval None
+ */
+static void hang_up(aSmart_HostPort_t* port);
+
+/**
+ * @brief Runs the handler of a port unless the port is held.
+ * @param port Pointer to the port.
+ * @retval None
+ */
+static void run_handler(aSmart_HostPort_t* port);
+
+/**
+ * @brief Runs the handler of a port, held or not.
+ * @param port Pointer to the port.
+ * @retval None
+ */
+static void dispatch_port(aSmart_HostPort_t* port);
+
+/**
+ * @brief Lists a port whose handler has to run before the loop sleeps.
+ * @param port Pointer to the port.
+ * @retval None
+ */
+static void mark_dirty(aSmart_HostPort_t* port);
+
+/**
+ * @brief Adds a port to the ports whose handler runs at the end of the round.
+ * @param port Pointer to the port.
+ * @param ready Head of the ready list.
+ * @retval None
+ */
+static void mark_ready(aSmart_HostPort_t* port, aSmart_HostPort_t** ready);
+
+/**
+ * @brief Waits for epoll events and reads the ports that have input.
+ * @param loop Pointer to the loop structure.
+ * @param wait Longest wait (ms).
+ * @param ready Head of the ready list.
+ * @retval Number of events, -1 on error (errno is set).
+ */
+static int epoll_round(aSmart_HostLoop_t* loop, int wait, aSmart_HostPort_t** ready);
+
+/**
+ * @brief Services ports, submits writes, waits for io_uring completions and handles them.
+ * @param loop Pointer to the loop structure.
+ * @param wait Longest wait (ms).
+ * @param ready Head of the ready list.
+ * @retval Number of completions, -1 on error (errno is set).
+ */
+static int uring_round(aSmart_HostLoop_t* loop, int wait, aSmart_HostPort_t** ready);
+
+/**
+ * @brief Waits for io_uring completions from inside a handler, where nothing may be dispatched.
+ * @param loop Pointer to the loop structure.
+ * @param wait_port Port whose input is parsed, NULL to keep all input.
+ * @param timeout_ms Longest wait.
+ * @retval None
+ */
+static void uring_wait(aSmart_HostLoop_t* loop, aSmart_HostPort_t* wait_port, int timeout_ms);
+
+/**
+ * @brief Handles the completions that have arrived.
+ * @param loop Pointer to the loop structure.
+ * @param mode What may be done with received data.
+ * @param wait_port Port parsed with URING_FEED_PORT.
+ * @param ready Head of the ready list, for URING_DISPATCH.
+ * @retval Number of completions.
+ */
+static int uring_reap(aSmart_HostLoop_t* loop, UringMode_t mode, aSmart_HostPort_t* wait_port, aSmart_HostPort_t** ready);
+
+/**
+ * @brief Handles the completion of a read.
+ * @param port Pointer to the port.
+ * @param cqe Pointer to the completion.
+ * @param feed 1 to parse the data, 0 to keep it.
+ * @param dispatch As for feed_port().
+ * @retval 1 if the data was parsed, 0 otherwise.
+ */
+static uint8_t uring_read_done(aSmart_HostPort_t* port, const struct io_uring_cqe* cqe, uint8_t feed, uint8_t dispatch);
+
+/**
+ * @brief Handles the completion of a write.
+ * @param port Pointer to the port.
+ * @param result Bytes written or negative error.
+ * @retval None
+ */
+static void uring_write_done(aSmart_HostPort_t* port, int32_t result);
+
+/**
+ * @brief Parses the kept buffers of listed ports and re-arms their reads.
+ * @param loop Pointer to the loop structure.
+ * @param ready Head of the ready list.
+ * @retval None
+ */
+static void uring_service(aSmart_HostLoop_t* loop, aSmart_HostPort_t** ready);
+
+/**
+ * @brief Submits one write per listed port, of the queued bytes up to the end of the queue.
+ * @param loop Pointer to the loop structure.
+ * @retval None
+ */
+static void uring_submit_writes(aSmart_HostLoop_t* loop);
+
+/**
+ * @brief Arms a read, multishot if the kernel has it.
+ * @param port Pointer to the port.
+ * @retval None
+ */
+static void uring_arm_read(aSmart_HostPort_t* port);
+
+/**
+ * @brief Arms the read of the loop's eventfd.
+ * @param loop Pointer to the loop structure.
+ * @retval None
+ */
+static void uring_arm_wake(aSmart_HostLoop_t* loop);
+
+/**
+ * @brief Keeps a received buffer for later, after the port's other kept buffers.
+ * @param port Pointer to the port.
+ * @param id Buffer ID.
+ * @param length Bytes in the buffer.
+ * @retval None
+ */
+static void uring_stash(aSmart_HostPort_t* port, uint16_t id, uint16_t length);
+
+/**
+ * @brief Removes the oldest kept buffer of a port.
+ * @param port Pointer to the port, with a kept buffer.
+ * @retval Buffer ID.
+ */
+static uint16_t uring_unstash(aSmart_HostPort_t* port);
+
+/**
+ * @brief Adds a port to the service list.
+ * @param port Pointer to the port.
+ * @retval None
+ */
+static void uring_list_service(aSmart_HostPort_t* port);
+
+/**
+ * @brief Adds a port to the write list.
+ * @param port Pointer to the port.
+ * @retval None
+ */
+static void uring_list_tx(aSmart_HostPort_t* port);
+
+/**
+ * @brief Cancels the requests of a closing port and gives back its buffers.
+ * @param port Pointer to the port.
+ * @retval None
+ */
+static void uring_detach(aSmart_HostPort_t* port);
+
+/**
+ * @brief Builds the user_data of a request for a port.
+ * @param port Pointer to the port.
+ * @param kind URING_READ or URING_WRITE.
+ * @retval user_data value.
+ */
+static uint64_t uring_user_data(aSmart_HostPort_t* port, uint8_t kind);
+
+/* Function implementations */
+
+uint32_t HAL_GetTick(void){
+    struct timespec now;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint32_t)((uint64_t)now.tv_sec * 1000u + (uint64_t)now.tv_nsec / 1000000u);
+}
+
+uint32_t asmart_host_time_us(void){
+    struct timespec now;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint32_t)((uint64_t)now.tv_sec * 1000000u + (uint64_t)now.tv_nsec / 1000u);
+}
+
+HAL_StatusTypeDef HAL_UART_Transmit(UART_HandleTypeDef* huart, const uint8_t* data, uint16_t size, uint32_t timeout){
+    (void)timeout;
+
+    if (huart->fd < 0 || huart->hung_up) {
+        return HAL_ERROR;
+    }
+    mark_dirty(huart);
+
+    /* Nothing queued: hand the bytes to the driver directly; io_uring batches them instead */
+    if (huart->tx_count == 0 && huart->loop->uring == NULL) {
+        ssize_t written = write(huart->fd, data, size);
+
+        if (written < 0) {
+            if (errno != EAGAIN && errno != EINTR) {
+                hang_up(huart);
+                return HAL_ERROR;
+            }
+            written = 0;
+        }
+        huart->tx_bytes += (uint32_t)written;
+        data += written;
+        size -= (uint16_t)written;
+        if (size == 0) {
+            return HAL_OK;
+        }
+    }
+
+    /* Queue full: wait for the driver, the loop cannot run meanwhile */
+    uint32_t since = HAL_GetTick();
+    while (HOST_TX_BUFFER_SIZE - huart->tx_count < size) {
+        uint32_t elapsed = HAL_GetTick() - since;
+        struct pollfd pfd = { .fd = huart->fd, .events = POLLOUT };
+
+        if (elapsed >= HOST_TX_TIMEOUT_MS) {
+            huart->tx_drops++;
+            return HAL_TIMEOUT;
+        }
+        if (huart->loop->uring != NULL) {
+            uring_wait(huart->loop, NULL, (int)(HOST_TX_TIMEOUT_MS - elapsed));
+        }
+        else {
+            poll(&pfd, 1, (int)(HOST_TX_TIMEOUT_MS - elapsed));
+            flush_port(huart);
+        }
+        if (huart->hung_up) {
+            return HAL_ERROR;
+        }
+    }
+
+    for (uint16_t i = 0; i < size; i++) {
+        huart->tx_buffer[(huart->tx_head + huart->tx_count) % HOST_TX_BUFFER_SIZE] = data[i];
+        huart->tx_count++;
+    }
+    if (huart->loop->uring != NULL) {
+        uring_list_tx(huart);
+    }
+    else {
+        update_events(huart);
+    }
+    return HAL_OK;
+}
+
+int asmart_host_loop_init(aSmart_HostLoop_t* loop){
+    return asmart_host_loop_init_engine(loop, HOST_ENGINE_EPOLL);
+}
+
+int asmart_host_loop_init_engine(aSmart_HostLoop_t* loop, aSmart_HostEngine_t engine){
+    memset(loop, 0, sizeof(*loop));
+    loop->engine = engine;
+    loop->epoll_fd = -1;
+    loop->wake_fd = -1;
+
+    if (engine == HOST_ENGINE_URING) {
+        /* The kernel polls a blocking eventfd and reads it once written */
+        loop->uring = calloc(1, sizeof(HostUring_t));
+        loop->wake_fd = eventfd(0, EFD_CLOEXEC);
+        if (loop->uring == NULL || loop->wake_fd < 0
+            || asmart_uring_init(&loop->uring->ring, HOST_URING_ENTRIES, HOST_URING_BUFFERS, HOST_READ_SIZE, HOST_URING_PORTS) < 0) {
+            int error = errno;
+            if (loop->wake_fd >= 0) {
+                close(loop->wake_fd);
+            }
+            free(loop->uring);
+            loop->uring = NULL;
+            errno = error;
+            return -1;
+        }
+        loop->uring->multishot = 1;
+        uring_arm_wake(loop);
+        loop->next_sweep = HAL_GetTick() + HOST_SWEEP_MS;
+        loop->dirty = NULL;
+        return 0;
+    }
+
+    loop->epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+    if (loop->epoll_fd < 0) {
+        return -1;
+    }
+
+    /* Wake-ups are told apart from ports by their NULL pointer */
+    struct epoll_event event = { .events = EPOLLIN, .data.ptr = NULL };
+    loop->wake_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (loop->wake_fd < 0 || epoll_ctl(loop->epoll_fd, EPOLL_CTL_ADD, loop->wake_fd, &event) < 0) {
+        int error = errno;
+        if (loop->wake_fd >= 0) {
+            close(loop->wake_fd);
+        }
+        close(loop->epoll_fd);
+        errno = error;
+        return -1;
+    }
+    loop->next_sweep = HAL_GetTick() + HOST_SWEEP_MS;
+    loop->dirty = NULL;
+    return 0;
+}
+
+void asmart_host_loop_close(aSmart_HostLoop_t* loop){
+    while (loop->ports != NULL) {
+        asmart_host_close(loop->ports);
+    }
+    if (loop->uring != NULL) {
+        asmart_uring_exit(&loop->uring->ring);
+        free(loop->uring);
+        loop->uring = NULL;
+    }
+    if (loop->epoll_fd >= 0) {
+        close(loop->epoll_fd);
+    }
+    close(loop->wake_fd);
+    loop->wake_fd = -1;
+    loop->epoll_fd = -1;
+}
+
+int asmart_host_open(aSmart_HostLoop_t* loop, aSmart_HostPort_t* port, const char* path, uint32_t baudrate){
+    int fd = open(path, O_RDWR | O_NOCTTY | O_NONBLOCK | O_CLOEXEC);
+
+    if (fd < 0) {
+        return -1;
+    }
+    if (configure_raw(fd, baudrate) < 0) {
+        int error = errno;
+        close(fd);
+        errno = error;
+        return -1;
+    }
+    tcflush(fd, TCIOFLUSH);
+    if (asmart_host_attach(loop, port, fd) < 0) {
+        return -1;
+    }
+    port->baudrate = baudrate;
+    return 0;
+}
+
+int asmart_host_set_rs485(aSmart_HostPort_t* port, uint32_t before_ms, uint32_t after_ms){
+    struct serial_rs485 rs485;
+
+    memset(&rs485, 0, sizeof(rs485));
+    rs485.flags = SER_RS485_ENABLED | SER_RS485_RTS_ON_SEND;
+    rs485.delay_rts_before_send = before_ms;
+    rs485.delay_rts_after_send = after_ms;
+    return ioctl(port->fd, TIOCSRS485, &rs485);
+}
+
+int asmart_host_open_pty(aSmart_HostLoop_t* loop, aSmart_HostPort_t* port, char* slave_path, size_t size){
+    int fd = posix_openpt(O_RDWR | O_NOCTTY | O_CLOEXEC);
+
+    if (fd < 0) {
+        return -1;
+    }
+    if (grantpt(fd) < 0 || unlockpt(fd) < 0 || ptsname_r(fd, slave_path, size) != 0 || configure_raw(fd, 0) < 0) {
+        int error = errno;
+        close(fd);
+        errno = error;
+        return -1;
+    }
+
+    /* Without an open slave the master reports a hang-up */
+    int pty_fd = open(slave_path, O_RDWR | O_NOCTTY | O_CLOEXEC);
+    if (pty_fd < 0 || asmart_host_attach(loop, port, fd) < 0) {
+        int error = errno;
+        if (pty_fd >= 0) {
+            close(pty_fd);
+        }
+        else {
+            close(fd);
+        }
+        errno = error;
+        return -1;
+    }
+    port->pty_fd = pty_fd;
+    return 0;
+}
+
+int asmart_host_attach(aSmart_HostLoop_t* loop, aSmart_HostPort_t* port, int fd){
+    struct epoll_event event = { .events = EPOLLIN, .data.ptr = port };
+    int flags = fcntl(fd, F_GETFL);
+    uint16_t slot = 0;
+    int result = -1;
+
+    if (flags >= 0 && loop->uring != NULL) {
+        /* io_uring returns EAGAIN for a non-blocking file instead of polling it */
+        while (slot < HOST_URING_PORTS && loop->uring->slots[slot] != NULL) {
+            slot++;
+        }
+        if (slot == HOST_URING_PORTS) {
+            errno = EMFILE;
+        }
+        else {
+            result = fcntl(fd, F_SETFL, flags & ~O_NONBLOCK);
+        }
+    }
+    else if (flags >= 0) {
+        result = (fcntl(fd, F_SETFL, flags | O_NONBLOCK) < 0 || epoll_ctl(loop->epoll_fd, EPOLL_CTL_ADD, fd, &event) < 0) ? -1 : 0;
+    }
+    if (result < 0) {
+        int error = errno;
+        close(fd);
+        errno = error;
+        return -1;
+    }
+
+    /* The handler and context may have been set before the port was opened */
+    port->fd = fd;
+    port->pty_fd = -1;
+    port->loop = loop;
+    port->ready = 0;
+    port->hung_up = 0;
+    port->held = 0;
+    port->baudrate = 0;
+    port->dirty = 0;
+    port->next_dirty = NULL;
+    port->events = EPOLLIN;
+    port->tx_head = 0;
+    port->tx_count = 0;
+    port->rx_bytes = 0;
+    port->tx_bytes = 0;
+    port->tx_drops = 0;
+    port->slot = slot;
+    port->rx_armed = 0;
+    port->service_listed = 0;
+    port->tx_listed = 0;
+    port->tx_inflight = 0;
+    port->pending_head = URING_NONE;
+    port->pending_tail = URING_NONE;
+    port->next_service = NULL;
+    port->next_tx = NULL;
+    port->next = loop->ports;
+    loop->ports = port;
+    loop->port_count++;
+
+    if (loop->uring != NULL) {
+        HostUring_t* uring = loop->uring;
+
+        uring->slots[slot] = port;
+        uring->registered[slot] = (asmart_uring_register_buffer(&uring->ring, slot, port->tx_buffer, sizeof(port->tx_buffer)) == 0);
+        uring_arm_read(port);
+    }
+    return 0;
+}
+
+void asmart_host_close(aSmart_HostPort_t* port){
+    aSmart_HostLoop_t* loop = port->loop;
+
+    if (port->fd < 0) {
+        return;
+    }
+    if (loop->uring != NULL) {
+        uring_detach(port);
+    }
+    else if (!port->hung_up) {
+        epoll_ctl(loop->epoll_fd, EPOLL_CTL_DEL, port->fd, NULL);
+    }
+    close(port->fd);
+    port->fd = -1;
+    if (port->pty_fd >= 0) {
+        close(port->pty_fd);
+        port->pty_fd = -1;
+    }
+
+    for (aSmart_HostPort_t** link = &loop->ports; *link != NULL; link = &(*link)->next) {
+        if (*link == port) {
+            *link = port->next;
+            loop->port_count--;
+            break;
+        }
+    }
+    for (aSmart_HostPort_t** link = &loop->dirty; port->dirty && *link != NULL; link = &(*link)->next_dirty) {
+        if (*link == port) {
+            *link = port->next_dirty;
+            port->dirty = 0;
+            break;
+        }
+    }
+}
+
+int asmart_host_poll(aSmart_HostLoop_t* loop, int timeout_ms){
+    aSmart_HostPort_t* ready = NULL;
+
+    /* Commands sent since a port's handler last ran have deadlines the loop does not know yet */
+    while (loop->dirty != NULL) {
+        aSmart_HostPort_t* port = loop->dirty;
+
+        loop->dirty = port->next_dirty;
+        port->dirty = 0;
+        run_handler(port);
+    }
+
+    int32_t left = (int32_t)(loop->next_sweep - HAL_GetTick());
+    int wait = (left <= 0) ? 0 : (int)left;
+
+    if (timeout_ms >= 0 && timeout_ms < wait) {
+        wait = timeout_ms;
+    }
+
+    int count = (loop->uring != NULL) ? uring_round(loop, wait, &ready) : epoll_round(loop, wait, &ready);
+    if (count < 0) {
+        return -1;
+    }
+
+    /* Dispatch what arrived, the last frames of a read are still in their slots */
+    while (ready != NULL) {
+        aSmart_HostPort_t* port = ready;
+
+        ready = port->next_ready;
+        port->ready = 0;
+        run_handler(port);
+    }
+
+    if ((int32_t)(loop->next_sweep - HAL_GetTick()) <= 0) {
+        loop->next_sweep = HAL_GetTick() + HOST_SWEEP_MS;
+        for (aSmart_HostPort_t* port = loop->ports; port != NULL; port = port->next) {
+            /* Re-arm reads that found no free buffer */
+            if (loop->uring != NULL && !port->rx_armed) {
+                uring_list_service(port);
+            }
+            run_handler(port);
+        }
+    }
+    return count;
+}
+
+void asmart_host_poll_port(aSmart_HostPort_t* port, int timeout_ms){
+    struct pollfd pfd = { .fd = port->fd, .events = POLLIN };
+
+    if (port->fd < 0 || port->hung_up) {
+        return;
+    }
+    if (port->loop->uring != NULL) {
+        uring_wait(port->loop, port, timeout_ms);
+        return;
+    }
+    if (poll(&pfd, 1, timeout_ms) > 0) {
+        read_port(port, 0);
+    }
+}
+
+void asmart_host_hold(aSmart_HostPort_t* port, uint8_t hold){
+    if (port->held == hold || port->fd < 0) {
+        return;
+    }
+    port->held = hold;
+    if (port->loop->uring != NULL) {
+        /* Stop the armed read; what it already took is kept until the port is released */
+        struct io_uring_sqe* sqe = (hold && port->rx_armed) ? asmart_uring_get_sqe(&port->loop->uring->ring) : NULL;
+        if (sqe != NULL) {
+            sqe->opcode = IORING_OP_ASYNC_CANCEL;
+            sqe->addr = uring_user_data(port, URING_READ);
+            sqe->user_data = URING_CANCEL;
+        }
+        if (!hold) {
+            uring_list_service(port);
+        }
+    }
+    else {
+        update_events(port);
+    }
+    if (!hold) {
+        run_handler(port);
+    }
+}
+
+void asmart_host_wake(aSmart_HostLoop_t* loop){
+    uint64_t wake = 1;
+
+    if (write(loop->wake_fd, &wake, sizeof(wake)) < 0) {
+        /* The counter is saturated, the loop wakes anyway */
+    }
+}
+
+aSmart_HostPort_t* asmart_host_active_port(void){
+    return active_port;
+}
+
+void asmart_host_bind(aSmart_HostPort_t* port, struct aSmart_Comm_Handler_s* handler){
+    port->handler = handler;
+}
+
+static int configure_raw(int fd, uint32_t baudrate) {
+    struct termios tty;
+
+    if (tcgetattr(fd, &tty) < 0) {
+        return -1;
+    }
+    cfmakeraw(&tty);
+    tty.c_cflag |= CLOCAL | CREAD;
+    tty.c_cflag &= ~(CSTOPB | CRTSCTS);
+    tty.c_cc[VMIN] = 0;
+    tty.c_cc[VTIME] = 0;
+
+    if (baudrate != 0) {
+        speed_t speed = termios_speed(baudrate);
+
+        if (speed == B0) {
+            errno = EINVAL;
+            return -1;
+        }
+        cfsetispeed(&tty, speed);
+        cfsetospeed(&tty, speed);
+    }
+    return tcsetattr(fd, TCSANOW, &tty);
+}
+
+static speed_t termios_speed(uint32_t baudrate) {
+    switch (baudrate) {
+        case 9600: return B9600;
+        case 19200: return B19200;
+        case 38400: return B38400;
+        case 57600: return B57600;
+        case 115200: return B115200;
+        case 230400: return B230400;
+        case 460800: return B460800;
+        case 921600: return B921600;
+        case 1000000: return B1000000;
+        case 2000000: return B2000000;
+        case 3000000: return B3000000;
+        case 4000000: return B4000000;
+        default: return B0;
+    }
+}
+
+static void feed_port(aSmart_HostPort_t* port, const uint8_t* data, uint16_t length, uint8_t dispatch) {
+    aSmart_Comm_Handler_t* handler = port->handler;
+
+    if (handler == NULL) {
+        return;
+    }
+    if (!dispatch) {
+        asmart_comm_receive_bytes(handler, data, length);
+        return;
+    }
+
+    /* A read may hold more frames than there are slots: dispatch between pieces, as the main
+       loop would between interrupts. A hold takes effect with the next read. */
+    while (length > 0) {
+        uint16_t piece = (length < HOST_FEED_SIZE) ? length : HOST_FEED_SIZE;
+
+        if (handler->rx_handler.slot_in != handler->rx_handler.slot_out) {
+            dispatch_port(port);
+        }
+        asmart_comm_receive_bytes(handler, data, piece);
+        data += piece;
+        length -= piece;
+    }
+}
+
+static int read_port(aSmart_HostPort_t* port, uint8_t dispatch) {
+    uint8_t data[HOST_READ_SIZE];
+    ssize_t length = read(port->fd, data, sizeof(data));
+
+    if (length > 0) {
+        port->rx_bytes += (uint32_t)length;
+        feed_port(port, data, (uint16_t)length, dispatch);
+        return (int)length;
+    }
+    /* End of file or an error other than no data: the device is gone */
+    if (length == 0 || (errno != EAGAIN && errno != EINTR)) {
+        hang_up(port);
+    }
+    return 0;
+}
+
+static void flush_port(aSmart_HostPort_t* port) {
+    while (port->tx_count > 0) {
+        uint16_t chunk = HOST_TX_BUFFER_SIZE - port->tx_head;
+        if (chunk > port->tx_count) {
+            chunk = port->tx_count;
+        }
+
+        ssize_t written = write(port->fd, &port->tx_buffer[port->tx_head], chunk);
+        if (written <= 0) {
+            if (written < 0 && errno != EAGAIN && errno != EINTR) {
+                hang_up(port);
+            }
+            break;
+        }
+        port->tx_bytes += (uint32_t)written;
+        port->tx_head = (port->tx_head + (uint16_t)written) % HOST_TX_BUFFER_SIZE;
+        port->tx_count -= (uint16_t)written;
+    }
+    update_events(port);
+}
+
+static void update_events(aSmart_HostPort_t* port) {
+    uint32_t events = (port->held ? 0 : EPOLLIN) | (port->tx_count > 0 ? EPOLLOUT : 0);
+
+    if (port->hung_up || events == port->events || port->loop->uring != NULL) {
+        return;
+    }
+
+    struct epoll_event event = { .events = events, .data.ptr = port };
+    epoll_ctl(port->loop->epoll_fd, EPOLL_CTL_MOD, port->fd, &event);
+    port->events = events;
+}
+
+static void hang_up(aSmart_HostPort_t* port) {
+    if (port->hung_up) {
+        return;
+    }
+    /* Keep the descriptor until asmart_host_close(), but stop the events it keeps raising */
+    if (port->loop->uring == NULL) {
+        epoll_ctl(port->loop->epoll_fd, EPOLL_CTL_DEL, port->fd, NULL);
+    }
+    port->hung_up = 1;
+    port->tx_count = 0;
+}
+
+static void run_handler(aSmart_HostPort_t* port) {
+    if (!port->held) {
+        dispatch_port(port);
+    }
+}
+
+static void dispatch_port(aSmart_HostPort_t* port) {
+    aSmart_HostPort_t* previous = active_port;
+
+    if (port->handler == NULL) {
+        return;
+    }
+    active_port = port;
+    uint32_t next = asmart_comm_handler(port->handler);
+    active_port = previous;
+
+    /* The loop wakes for the earliest deadline of its ports */
+    if (next != ASMART_COMM_NO_DEADLINE && (int32_t)(port->loop->next_sweep - HAL_GetTick()) > (int32_t)next) {
+        port->loop->next_sweep = HAL_GetTick() + next;
+    }
+}
+
+static void mark_dirty(aSmart_HostPort_t* port) {
+    if (!port->dirty && port != active_port) {
+        port->dirty = 1;
+        port->next_dirty = port->loop->dirty;
+        port->loop->dirty = port;
+    }
+}
+
+static void mark_ready(aSmart_HostPort_t* port, aSmart_HostPort_t** ready) {
+    /* A callback may have closed the port while its data was parsed */
+    if (port->fd >= 0 && !port->ready) {
+        port->ready = 1;
+        port->next_ready = *ready;
+        *ready = port;
+    }
+}
+
+static int epoll_round(aSmart_HostLoop_t* loop, int wait, aSmart_HostPort_t** ready) {
+    struct epoll_event events[HOST_EVENTS];
+
+    int count = epoll_wait(loop->epoll_fd, events, HOST_EVENTS, wait);
+    if (count < 0) {
+        if (errno != EINTR) {
+            return -1;
+        }
+        count = 0;
+    }
+
+    for (int i = 0; i < count; i++) {
+        aSmart_HostPort_t* port = (aSmart_HostPort_t*)events[i].data.ptr;
+        uint64_t wakes;
+
+        if (port == NULL) {
+            if (read(loop->wake_fd, &wakes, sizeof(wakes)) < 0) {
+                /* Already cleared */
+            }
+            continue;
+        }
+        /* Closed by a callback earlier in this round */
+        if (port->fd < 0) {
+            continue;
+        }
+        if (events[i].events & EPOLLOUT) {
+            flush_port(port);
+        }
+        /* A held port is still read on a hang-up, which would be reported again and again */
+        uint8_t readable = ((events[i].events & EPOLLIN) && !port->held) || (events[i].events & (EPOLLHUP | EPOLLERR));
+        if (readable && read_port(port, 1) > 0) {
+            mark_ready(port, ready);
+        }
+    }
+    return count;
+}
+
+static int uring_round(aSmart_HostLoop_t* loop, int wait, aSmart_HostPort_t** ready) {
+    HostUring_t* uring = loop->uring;
+
+    uring_service(loop, ready);
+    uring_submit_writes(loop);
+
+    /* Kept data parsed by the service is dispatched first, without waiting */
+    if (asmart_uring_submit(&uring->ring, (*ready != NULL) ? 0 : wait) < 0) {
+        return -1;
+    }
+    return uring_reap(loop, URING_DISPATCH, NULL, ready);
+}
+
+static void uring_wait(aSmart_HostLoop_t* loop, aSmart_HostPort_t* wait_port, int timeout_ms) {
+    HostUring_t* uring = loop->uring;
+
+    /* Data kept for the waiting port comes before anything newer */
+    if (wait_port != NULL && wait_port->pending_head != URING_NONE && !wait_port->held) {
+        uint16_t id = uring_unstash(wait_port);
+
+        feed_port(wait_port, asmart_uring_buffer(&uring->ring, id), uring->pending_length[id], 0);
+        asmart_uring_recycle(&uring->ring, id);
+        return;
+    }
+
+    /* The bytes waited on may depend on the writes queued so far */
+    uring_submit_writes(loop);
+    if (asmart_uring_submit(&uring->ring, timeout_ms) < 0) {
+        return;
+    }
+    uring_reap(loop, (wait_port != NULL) ? URING_FEED_PORT : URING_STASH, wait_port, NULL);
+}
+
+static int uring_reap(aSmart_HostLoop_t* loop, UringMode_t mode, aSmart_HostPort_t* wait_port, aSmart_HostPort_t** ready) {
+    HostUring_t* uring = loop->uring;
+    struct io_uring_cqe* entry;
+    uint8_t fed = 0;
+    int count = 0;
+
+    /* Bounded, as parsing may cause new completions */
+    while (count < HOST_URING_ENTRIES * 4 && (entry = asmart_uring_peek(&uring->ring)) != NULL) {
+        /* Copied and removed first: a handler run from here may reap as well */
+        struct io_uring_cqe cqe = *entry;
+        uint8_t kind = (uint8_t)(cqe.user_data & 0xFF);
+        uint16_t slot = (uint16_t)(cqe.user_data >> 8);
+        aSmart_HostPort_t* port = NULL;
+
+        asmart_uring_advance(&uring->ring);
+        count++;
+
+        if (kind == URING_WAKE) {
+            uring_arm_wake(loop);
+            continue;
+        }
+        if ((kind == URING_READ || kind == URING_WRITE) && slot < HOST_URING_PORTS && uring->generations[slot] == (uint32_t)(cqe.user_data >> 32)) {
+            port = uring->slots[slot];
+        }
+        if (port == NULL) {
+            /* A closed port's read may still have taken a buffer */
+            if (cqe.flags & IORING_CQE_F_BUFFER) {
+                asmart_uring_recycle(&uring->ring, (uint16_t)(cqe.flags >> IORING_CQE_BUFFER_SHIFT));
+            }
+            continue;
+        }
+
+        if (kind == URING_WRITE) {
+            uring_write_done(port, cqe.res);
+        }
+        else if (mode == URING_DISPATCH) {
+            if (uring_read_done(port, &cqe, 1, 1)) {
+                mark_ready(port, ready);
+            }
+        }
+        else {
+            fed |= uring_read_done(port, &cqe, mode == URING_FEED_PORT && port == wait_port && !fed, 0);
+        }
+    }
+    return count;
+}
+
+static uint8_t uring_read_done(aSmart_HostPort_t* port, const struct io_uring_cqe* cqe, uint8_t feed, uint8_t dispatch) {
+    HostUring_t* uring = port->loop->uring;
+    int32_t result = cqe->res;
+    uint8_t parsed = 0;
+
+    if (!(cqe->flags & IORING_CQE_F_MORE)) {
+        port->rx_armed = 0;
+    }
+
+    if (result > 0 && (cqe->flags & IORING_CQE_F_BUFFER)) {
+        uint16_t id = (uint16_t)(cqe->flags >> IORING_CQE_BUFFER_SHIFT);
+
+        port->rx_bytes += (uint32_t)result;
+        if (feed && !port->held && port->pending_head == URING_NONE) {
+            feed_port(port, asmart_uring_buffer(&uring->ring, id), (uint16_t)result, dispatch);
+            asmart_uring_recycle(&uring->ring, id);
+            parsed = 1;
+        }
+        else {
+            uring_stash(port, id, (uint16_t)result);
+        }
+    }
+    else if (result == 0) {
+        /* End of file: the device is gone */
+        hang_up(port);
+    }
+    else if (result == -EINVAL && uring->multishot) {
+        /* Kernel before 6.7: one read per completion from now on */
+        uring->multishot = 0;
+    }
+    else if (result < 0 && result != -ENOBUFS && result != -ECANCELED && result != -EINTR && result != -EAGAIN) {
+        hang_up(port);
+    }
+
+    /* Out of buffers: the next sweep re-arms the read, by then buffers have been given back */
+    if (!port->rx_armed && result != -ENOBUFS) {
+        uring_list_service(port);
+    }
+    return parsed;
+}
+
+static void uring_write_done(aSmart_HostPort_t* port, int32_t result) {
+    port->tx_inflight = 0;
+    if (port->hung_up) {
+        return;
+    }
+    if (result > 0) {
+        port->tx_bytes += (uint32_t)result;
+        port->tx_head = (port->tx_head + (uint16_t)result) % HOST_TX_BUFFER_SIZE;
+        port->tx_count -= (uint16_t)result;
+    }
+    else if (result != -EAGAIN && result != -EINTR && result != -ECANCELED) {
+        hang_up(port);
+        return;
+    }
+    if (port->tx_count > 0) {
+        uring_list_tx(port);
+    }
+}
+
+static void uring_service(aSmart_HostLoop_t* loop, aSmart_HostPort_t** ready) {
+    HostUring_t* uring = loop->uring;
+    aSmart_HostPort_t* port;
+
+    while ((port = uring->service) != NULL) {
+        uring->service = port->next_service;
+        port->service_listed = 0;
+
+        /* Kept data is parsed oldest first; a callback may hold or close the port meanwhile */
+        while (port->pending_head != URING_NONE && !port->held && port->fd >= 0) {
+            uint16_t id = uring_unstash(port);
+
+            feed_port(port, asmart_uring_buffer(&uring->ring, id), uring->pending_length[id], 1);
+            asmart_uring_recycle(&uring->ring, id);
+            mark_ready(port, ready);
+        }
+        if (port->fd >= 0 && !port->held && !port->hung_up && !port->rx_armed) {
+            uring_arm_read(port);
+        }
+    }
+}
+
+static void uring_submit_writes(aSmart_HostLoop_t* loop) {
+    HostUring_t* uring = loop->uring;
+    aSmart_HostPort_t* port;
+
+    while ((port = uring->tx_list) != NULL) {
+        if (port->hung_up || port->tx_inflight > 0 || port->tx_count == 0) {
+            uring->tx_list = port->next_tx;
+            port->tx_listed = 0;
+            continue;
+        }
+
+        /* Everything queued since the last round, up to the end of the ring */
+        struct io_uring_sqe* sqe = asmart_uring_get_sqe(&uring->ring);
+        if (sqe == NULL) {
+            break;
+        }
+        uring->tx_list = port->next_tx;
+        port->tx_listed = 0;
+
+        uint16_t chunk = HOST_TX_BUFFER_SIZE - port->tx_head;
+        if (chunk > port->tx_count) {
+            chunk = port->tx_count;
+        }
+        sqe->opcode = uring->registered[port->slot] ? IORING_OP_WRITE_FIXED : IORING_OP_WRITE;
+        sqe->fd = port->fd;
+        sqe->addr = (uint64_t)(uintptr_t)&port->tx_buffer[port->tx_head];
+        sqe->len = chunk;
+        sqe->off = (uint64_t)-1;
+        sqe->buf_index = port->slot;
+        sqe->user_data = uring_user_data(port, URING_WRITE);
+        port->tx_inflight = chunk;
+    }
+}
+
+static void uring_arm_read(aSmart_HostPort_t* port) {
+    HostUring_t* uring = port->loop->uring;
+    struct io_uring_sqe* sqe = asmart_uring_get_sqe(&uring->ring);
+
+    if (sqe == NULL) {
+        return;
+    }
+    sqe->opcode = uring->multishot ? URING_OP_READ_MULTISHOT : IORING_OP_READ;
+    sqe->fd = port->fd;
+    sqe->len = uring->multishot ? 0 : HOST_READ_SIZE;
+    sqe->off = (uint64_t)-1;
+    sqe->flags = IOSQE_BUFFER_SELECT;
+    sqe->buf_group = 0;
+    sqe->user_data = uring_user_data(port, URING_READ);
+    port->rx_armed = 1;
+}
+
+static void uring_arm_wake(aSmart_HostLoop_t* loop) {
+    HostUring_t* uring = loop->uring;
+    struct io_uring_sqe* sqe = asmart_uring_get_sqe(&uring->ring);
+
+    if (sqe == NULL) {
+        return;
+    }
+    sqe->opcode = IORING_OP_READ;
+    sqe->fd = loop->wake_fd;
+    sqe->addr = (uint64_t)(uintptr_t)&uring->wake_count;
+    sqe->len = sizeof(uring->wake_count);
+    sqe->off = (uint64_t)-1;
+    sqe->user_data = URING_WAKE;
+}
+
+static void uring_stash(aSmart_HostPort_t* port, uint16_t id, uint16_t length) {
+    HostUring_t* uring = port->loop->uring;
+
+    uring->pending_next[id] = URING_NONE;
+    uring->pending_length[id] = length;
+    if (port->pending_tail == URING_NONE) {
+        port->pending_head = id;
+    }
+    else {
+        uring->pending_next[port->pending_tail] = id;
+    }
+    port->pending_tail = id;
+    uring_list_service(port);
+}
+
+static uint16_t uring_unstash(aSmart_HostPort_t* port) {
+    uint16_t id = port->pending_head;
+
+    port->pending_head = port->loop->uring->pending_next[id];
+    if (port->pending_head == URING_NONE) {
+        port->pending_tail = URING_NONE;
+    }
+    return id;
+}
+
+static void uring_list_service(aSmart_HostPort_t* port) {
+    HostUring_t* uring = port->loop->uring;
+
+    if (port->fd >= 0 && !port->service_listed) {
+        port->service_listed = 1;
+        port->next_service = uring->service;
+        uring->service = port;
+    }
+}
+
+static void uring_list_tx(aSmart_HostPort_t* port) {
+    HostUring_t* uring = port->loop->uring;
+
+    if (port->fd >= 0 && !port->tx_listed) {
+        port->tx_listed = 1;
+        port->next_tx = uring->tx_list;
+        uring->tx_list = port;
+    }
+}
+
+static void uring_detach(aSmart_HostPort_t* port) {
+    HostUring_t* uring = port->loop->uring;
+
+    asmart_uring_cancel_fd(&uring->ring, port->fd);
+    if (uring->registered[port->slot]) {
+        asmart_uring_register_buffer(&uring->ring, port->slot, NULL, 0);
+        uring->registered[port->slot] = 0;
+    }
+    uring->slots[port->slot] = NULL;
+    uring->generations[port->slot]++;
+
+    while (port->pending_head != URING_NONE) {
+        asmart_uring_recycle(&uring->ring, uring_unstash(port));
+    }
+    for (aSmart_HostPort_t** link = &uring->service; *link != NULL; link = &(*link)->next_service) {
+        if (*link == port) {
+            *link = port->next_service;
+            break;
+        }
+    }
+    for (aSmart_HostPort_t** link = &uring->tx_list; *link != NULL; link = &(*link)->next_tx) {
+        if (*link == port) {
+            *link = port->next_tx;
+            break;
+        }
+    }
+    port->service_listed = 0;
+    port->tx_listed = 0;
+}
+
+static uint64_t uring_user_data(aSmart_HostPort_t* port, uint8_t kind) {
+    return ((uint64_t)port->loop->uring->generations[port->slot] << 32) | ((uint64_t)port->slot << 8) | kind;
+}
@@ -0,0 +1,240 @@
+#include "asmart_comm_queue.h"
+#include <stdlib.h>
+#include <string.h>
+
+/***********************************************************************************************
+ *                                Lock-free Queues                                              *
+ ***********************************************************************************************
+ *
+ * - aSmart_Queue_t is a bounded array queue for any number of producers and consumers: every
+ *   cell carries a sequence number telling whether it is free for the writer of that round or
+ *   filled for its reader, so a thread claims a cell with one compare-and-swap on head or tail.
+ * - aSmart_Ring_t is a byte ring for one producer and one consumer. A record is its body length,
+ *   the fixed-size header and the body; head and tail are free-running byte counts, published
+ *   with release and read with acquire so the bytes are visible before the count.
+ * - Neither ever blocks; a full queue or ring is reported to the caller.
+ *
+ ***********************************************************************************************/
+
+/**
+ * @brief Rounds up to a power of two.
+ * @param value Value, at least 1.
+ * @retval Smallest power of two not below value.
+ */
+static size_t round_up_pow2(size_t value);
+
+/**
+ * @brief Returns the sequence number of a queue cell.
+ * @param queue Pointer to the queue structure.
+ * @param position Position of the cell.
+ * @retval Pointer to the sequence number; the element follows it.
+ */
+static atomic_size_t* queue_cell(aSmart_Queue_t* queue, size_t position);
+
+/**
+ * @brief Copies bytes into the ring, wrapping at its end.
+ * @param ring Pointer to the ring structure.
+ * @param position Free-running byte position.
+ * @param data Pointer to the bytes.
+ * @param length Number of bytes.
+ * @retval None
+ */
+static void ring_copy_in(aSmart_Ring_t* ring, uint32_t position, const void* data, uint32_t length);
+
+/**
+ * @brief Copies bytes out of the ring, wrapping at its end.
+ * @param ring Pointer to the ring structure.
+ * @param position Free-running byte position.
+ * @param data Receives the bytes.
+ * @param length Number of bytes.
+ * @retval None
+ */
+static void ring_copy_out(aSmart_Ring_t* ring, uint32_t position, void* data, uint32_t length);
+
+/* Function implementations */
+
+int asmart_queue_init(aSmart_Queue_t* queue, size_t capacity, size_t element_size){
+    size_t cells = round_up_pow2(capacity);
+
+    /* Cells stay aligned for the sequence number */
+    queue->element_size = element_size;
+    queue->cell_size = (sizeof(atomic_size_t) + element_size + sizeof(atomic_size_t) - 1) & ~(sizeof(atomic_size_t) - 1);
+    queue->mask = cells - 1;
+    queue->cells = aligned_alloc(64, (cells * queue->cell_size + 63) & ~(size_t)63);
+    if (queue->cells == NULL) {
+        return -1;
+    }
+    for (size_t i = 0; i < cells; i++) {
+        atomic_init(queue_cell(queue, i), i);
+    }
+    atomic_init(&queue->head, 0);
+    atomic_init(&queue->tail, 0);
+    return 0;
+}
+
+void asmart_queue_free(aSmart_Queue_t* queue){
+    free(queue->cells);
+    queue->cells = NULL;
+}
+
+uint8_t asmart_queue_push(aSmart_Queue_t* queue, const void* element){
+    size_t position = atomic_load_explicit(&queue->head, memory_order_relaxed);
+
+    for (;;) {
+        atomic_size_t* cell = queue_cell(queue, position);
+        size_t sequence = atomic_load_explicit(cell, memory_order_acquire);
+        intptr_t difference = (intptr_t)sequence - (intptr_t)position;
+
+        if (difference == 0) {
+            /* Free for this round: claim it */
+            if (atomic_compare_exchange_weak_explicit(&queue->head, &position, position + 1, memory_order_relaxed, memory_order_relaxed)) {
+                memcpy(cell + 1, element, queue->element_size);
+                atomic_store_explicit(cell, position + 1, memory_order_release);
+                return 1;
+            }
+        }
+        else if (difference < 0) {
+            /* Still holds the element of the previous round */
+            return 0;
+        }
+        else {
+            position = atomic_load_explicit(&queue->head, memory_order_relaxed);
+        }
+    }
+}
+
+uint8_t asmart_queue_pop(aSmart_Queue_t* queue, void* element){
+    size_t position = atomic_load_explicit(&queue->tail, memory_order_relaxed);
+
+    for (;;) {
+        atomic_size_t* cell = queue_cell(queue, position);
+        size_t sequence = atomic_load_explicit(cell, memory_order_acquire);
+        intptr_t difference = (intptr_t)sequence - (intptr_t)(position + 1);
+
+        if (difference == 0) {
+            /* Filled in this round: claim it */
+            if (atomic_compare_exchange_weak_explicit(&queue->tail, &position, position + 1, memory_order_relaxed, memory_order_relaxed)) {
+                memcpy(element, cell + 1, queue->element_size);
+                atomic_store_explicit(cell, position + queue->mask + 1, memory_order_release);
+                return 1;
+            }
+        }
+        else if (difference < 0) {
+            /* Not written yet */
+            return 0;
+        }
+        else {
+            position = atomic_load_explicit(&queue->tail, memory_order_relaxed);
+        }
+    }
+}
+
+uint8_t asmart_queue_empty(aSmart_Queue_t* queue){
+    return atomic_load(&queue->head) == atomic_load(&queue->tail);
+}
+
+int asmart_ring_init(aSmart_Ring_t* ring, uint32_t size){
+    ring->size = (uint32_t)round_up_pow2(size);
+    ring->buffer = malloc(ring->size);
+    if (ring->buffer == NULL) {
+        return -1;
+    }
+    atomic_init(&ring->head, 0);
+    atomic_init(&ring->tail, 0);
+    return 0;
+}
+
+void asmart_ring_free(aSmart_Ring_t* ring){
+    free(ring->buffer);
+    ring->buffer = NULL;
+}
+
+uint32_t asmart_ring_space(aSmart_Ring_t* ring){
+    uint32_t head = (uint32_t)atomic_load_explicit(&ring->head, memory_order_relaxed);
+    uint32_t tail = (uint32_t)atomic_load_explicit(&ring->tail, memory_order_acquire);
+
+    return ring->size - (head - tail);
+}
+
+uint8_t asmart_ring_write(aSmart_Ring_t* ring, const void* header, uint16_t header_length, const void* body, uint16_t body_length){
+    uint32_t head = (uint32_t)atomic_load_explicit(&ring->head, memory_order_relaxed);
+    uint32_t record = sizeof(body_length) + header_length + body_length;
+
+    if (asmart_ring_space(ring) < record) {
+        return 0;
+    }
+    ring_copy_in(ring, head, &body_length, sizeof(body_length));
+    ring_copy_in(ring, head + sizeof(body_length), header, header_length);
+    ring_copy_in(ring, head + sizeof(body_length) + header_length, body, body_length);
+
+    /* Publish the record after its bytes */
+    atomic_store_explicit(&ring->head, head + record, memory_order_release);
+    return 1;
+}
+
+uint8_t asmart_ring_read(aSmart_Ring_t* ring, void* header, uint16_t header_length, void* body, uint16_t body_size, uint16_t* body_length){
+    uint32_t tail = (uint32_t)atomic_load_explicit(&ring->tail, memory_order_relaxed);
+    uint32_t head = (uint32_t)atomic_load_explicit(&ring->head, memory_order_acquire);
+    uint16_t length;
+
+    if (head == tail) {
+        return 0;
+    }
+    ring_copy_out(ring, tail, &length, sizeof(length));
+    ring_copy_out(ring, tail + sizeof(length), header, header_length);
+
+    uint16_t copied = (length < body_size) ? length : body_size;
+    ring_copy_out(ring, tail + sizeof(length) + header_length, body, copied);
+    *body_length = length;
+
+    /* Hand the bytes back to the producer */
+    atomic_store_explicit(&ring->tail, tail + sizeof(length) + header_length + length, memory_order_release);
+    return 1;
+}
+
+uint8_t asmart_ring_empty(aSmart_Ring_t* ring){
+    return atomic_load_explicit(&ring->head, memory_order_acquire) == atomic_load_explicit(&ring->tail, memory_order_relaxed);
+}
+
+static size_t round_up_pow2(size_t value) {
+    size_t result = 1;
+
+    while (result < value) {
+        result <<= 1;
+    }
+    return result;
+}
+
+static atomic_size_t* queue_cell(aSmart_Queue_t* queue, size_t position) {
+    return (atomic_size_t*)(queue->cells + (position & queue->mask) * queue->cell_size);
+}
+
+static void ring_copy_in(aSmart_Ring_t* ring, uint32_t position, const void* data, uint32_t length) {
+    if (length == 0) {
+        return;
+    }
+
+    uint32_t offset = position & (ring->size - 1);
+    uint32_t first = ring->size - offset;
+
+    if (first > length) {
+        first = length;
+    }
+    memcpy(ring->buffer + offset, data, first);
+    memcpy(ring->buffer, (const uint8_t*)data + first, length - first);
+}
+
+static void ring_copy_out(aSmart_Ring_t* ring, uint32_t position, void* data, uint32_t length) {
+    if (length == 0) {
+        return;
+    }
+
+    uint32_t offset = position & (ring->size - 1);
+    uint32_t first = ring->size - offset;
+
+    if (first > length) {
+        first = length;
+    }
+    memcpy(data, ring->buffer + offset, first);
+    memcpy((uint8_t*)data + first, ring->buffer, length - first);
+}
@@ -0,0 +1,558 @@
+#include "asmart_comm_runtime.h"
+#include <errno.h>
+#include <sched.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+/***********************************************************************************************
+ *                                Multi-core Host Runtime                                       *
+ ***********************************************************************************************
+ *
+ * - Reactors: each reactor thread runs its own host loop (asmart_comm_host.c) over a disjoint
+ *   set of links, so parsing, CRC, command tables and timeouts of a link stay on one thread
+ *   and need no locks.
+ * - The reactor's response callback copies every message into the link's inbox, a single
+ *   producer single consumer ring, and schedules the link at its home worker.
+ * - Workers: a link is queued at one worker at most and runs on one worker at a time, so its
+ *   messages are handled in order. A worker takes links from its own queue first and steals
+ *   from the others when it runs dry; it handles RUNTIME_BATCH messages and requeues the link
+ *   if more are waiting, so one busy link cannot hold a worker.
+ * - Sends from a callback or any other thread go to the link's outbox; the reactor is woken
+ *   through its eventfd and sends them with the link's handler.
+ * - Back-pressure: when an inbox has less than RUNTIME_INBOX_RESERVE bytes free the reactor
+ *   stops reading the port; the worker that drains it asks the reactor to resume.
+ * - The worker and reactor queues hold link pointers only and are sized for all links, so
+ *   they never run full.
+ *
+ ***********************************************************************************************/
+
+/* Link being flushed by this reactor thread, for callbacks raised by a send */
+static __thread aSmart_Link_t* sending_link;
+
+/* Message being handled by this worker thread, for the reply address of a response */
+static __thread aSmart_Link_t* handling_link;
+static __thread const RuntimeRecord_t* handling_record;
+
+/**
+ * @brief Allocates and opens the common part of a link.
+ * @param runtime Pointer to the runtime structure.
+ * @param callback Link callback.
+ * @param context Stored in the link.
+ * @retval Pointer to the link, NULL on error.
+ */
+static aSmart_Link_t* create_link(aSmart_Runtime_t* runtime, LinkCallback callback, void* context);
+
+/**
+ * @brief Registers an opened link with its reactor and handler.
+ * @param link Pointer to the link.
+ * @retval Pointer to the link.
+ */
+static aSmart_Link_t* add_link(aSmart_Link_t* link);
+
+/**
+ * @brief Frees a link and its queues.
+ * @param link Pointer to the link.
+ * @retval None
+ */
+static void free_link(aSmart_Link_t* link);
+
+/**
+ * @brief Response callback of every link handler, runs on the reactor.
+ * @retval None
+ */
+static void link_callback(uint8_t message_type, uint8_t command_type, uint16_t sequence_number, uint8_t* payload, uint16_t length);
+
+/**
+ * @brief Queues a message in the link's outbox and wakes its reactor.
+ * @param link Pointer to the link.
+ * @param message Pointer to the message, payload already in place.
+ * @param payload Pointer to the payload.
+ * @retval 1 if queued, 0 otherwise.
+ */
+static uint8_t queue_send(aSmart_Link_t* link, RuntimeSend_t* message, const uint8_t* payload);
+
+/**
+ * @brief Sends the link's queued messages, on its reactor.
+ * @param link Pointer to the link.
+ * @retval None
+ */
+static void flush_outbox(aSmart_Link_t* link);
+
+/**
+ * @brief Hands a link to its reactor for sending or resuming, once until the reactor has seen it.
+ * @param link Pointer to the link.
+ * @retval None
+ */
+static void signal_reactor(aSmart_Link_t* link);
+
+/**
+ * @brief Queues a link at a worker and wakes a sleeping worker.
+ * @param runtime Pointer to the runtime structure.
+ * @param worker Index of the worker.
+ * @param link Pointer to the link.
+ * @retval None
+ */
+static void submit_link(aSmart_Runtime_t* runtime, uint16_t worker, aSmart_Link_t* link);
+
+/**
+ * @brief Takes a link from the worker's own queue, or steals one.
+ * @param worker Pointer to the worker.
+ * @retval Pointer to the link, NULL if all queues are empty.
+ */
+static aSmart_Link_t* take_link(aSmart_Worker_t* worker);
+
+/**
+ * @brief Handles up to RUNTIME_BATCH messages of a link and requeues or releases it.
+ * @param worker Pointer to the worker.
+ * @param link Pointer to the link.
+ * @retval None
+ */
+static void run_link(aSmart_Worker_t* worker, aSmart_Link_t* link);
+
+/**
+ * @brief Sleeps until a link is submitted or RUNTIME_IDLE_MS have passed.
+ * @param runtime Pointer to the runtime structure.
+ * @retval None
+ */
+static void idle_wait(aSmart_Runtime_t* runtime);
+
+static void* reactor_main(void* argument);
+static void* worker_main(void* argument);
+
+/* Function implementations */
+
+int asmart_runtime_init(aSmart_Runtime_t* runtime, uint16_t reactors, uint16_t workers, uint16_t max_links, aSmart_HostEngine_t engine){
+    memset(runtime, 0, sizeof(*runtime));
+    if (reactors == 0 || workers == 0 || max_links == 0) {
+        errno = EINVAL;
+        return -1;
+    }
+
+    runtime->reactors = calloc(reactors, sizeof(aSmart_Reactor_t));
+    runtime->workers = calloc(workers, sizeof(aSmart_Worker_t));
+    runtime->links = calloc(max_links, sizeof(aSmart_Link_t*));
+    if (runtime->reactors == NULL || runtime->workers == NULL || runtime->links == NULL) {
+        asmart_runtime_stop(runtime);
+        errno = ENOMEM;
+        return -1;
+    }
+    runtime->max_links = max_links;
+    pthread_mutex_init(&runtime->idle_lock, NULL);
+    pthread_cond_init(&runtime->idle_cond, NULL);
+    atomic_init(&runtime->running, 0);
+    atomic_init(&runtime->sleepers, 0);
+
+    for (uint16_t i = 0; i < reactors; i++) {
+        aSmart_Reactor_t* reactor = &runtime->reactors[i];
+
+        reactor->runtime = runtime;
+        if (asmart_host_loop_init_engine(&reactor->loop, engine) < 0 || asmart_queue_init(&reactor->signals, max_links, sizeof(aSmart_Link_t*)) < 0) {
+            asmart_runtime_stop(runtime);
+            return -1;
+        }
+        runtime->reactor_count++;
+    }
+    for (uint16_t i = 0; i < workers; i++) {
+        aSmart_Worker_t* worker = &runtime->workers[i];
+
+        worker->runtime = runtime;
+        worker->index = i;
+        if (asmart_queue_init(&worker->queue, max_links, sizeof(aSmart_Link_t*)) < 0) {
+            asmart_runtime_stop(runtime);
+            return -1;
+        }
+        runtime->worker_count++;
+    }
+    return 0;
+}
+
+aSmart_Link_t* asmart_runtime_open(aSmart_Runtime_t* runtime, const char* path, uint32_t baudrate, LinkCallback callback, void* context){
+    aSmart_Link_t* link = create_link(runtime, callback, context);
+
+    if (link == NULL) {
+        return NULL;
+    }
+    if (asmart_host_open(&link->reactor->loop, &link->port, path, baudrate) < 0) {
+        free_link(link);
+        return NULL;
+    }
+    return add_link(link);
+}
+
+aSmart_Link_t* asmart_runtime_open_pty(aSmart_Runtime_t* runtime, char* slave_path, size_t size, LinkCallback callback, void* context){
+    aSmart_Link_t* link = create_link(runtime, callback, context);
+
+    if (link == NULL) {
+        return NULL;
+    }
+    if (asmart_host_open_pty(&link->reactor->loop, &link->port, slave_path, size) < 0) {
+        free_link(link);
+        return NULL;
+    }
+    return add_link(link);
+}
+
+aSmart_Link_t* asmart_runtime_attach(aSmart_Runtime_t* runtime, int fd, LinkCallback callback, void* context){
+    aSmart_Link_t* link = create_link(runtime, callback, context);
+
+    if (link == NULL) {
+        close(fd);
+        return NULL;
+    }
+    if (asmart_host_attach(&link->reactor->loop, &link->port, fd) < 0) {
+        free_link(link);
+        return NULL;
+    }
+    return add_link(link);
+}
+
+int asmart_runtime_start(aSmart_Runtime_t* runtime){
+    atomic_store(&runtime->running, 1);
+
+    for (uint16_t i = 0; i < runtime->reactor_count; i++) {
+        if ((errno = pthread_create(&runtime->reactors[i].thread, NULL, reactor_main, &runtime->reactors[i])) != 0) {
+            return -1;
+        }
+    }
+    for (uint16_t i = 0; i < runtime->worker_count; i++) {
+        if ((errno = pthread_create(&runtime->workers[i].thread, NULL, worker_main, &runtime->workers[i])) != 0) {
+            return -1;
+        }
+    }
+    return 0;
+}
+
+void asmart_runtime_stop(aSmart_Runtime_t* runtime){
+    uint8_t running = atomic_exchange(&runtime->running, 0);
+
+    if (running) {
+        for (uint16_t i = 0; i < runtime->reactor_count; i++) {
+            asmart_host_wake(&runtime->reactors[i].loop);
+        }
+        pthread_mutex_lock(&runtime->idle_lock);
+        pthread_cond_broadcast(&runtime->idle_cond);
+        pthread_mutex_unlock(&runtime->idle_lock);
+
+        for (uint16_t i = 0; i < runtime->reactor_count; i++) {
+            pthread_join(runtime->reactors[i].thread, NULL);
+        }
+        for (uint16_t i = 0; i < runtime->worker_count; i++) {
+            pthread_join(runtime->workers[i].thread, NULL);
+        }
+    }
+
+    for (uint16_t i = 0; i < runtime->link_count; i++) {
+        asmart_host_close(&runtime->links[i]->port);
+        free_link(runtime->links[i]);
+    }
+    for (uint16_t i = 0; i < runtime->reactor_count; i++) {
+        asmart_host_loop_close(&runtime->reactors[i].loop);
+        asmart_queue_free(&runtime->reactors[i].signals);
+    }
+    for (uint16_t i = 0; i < runtime->worker_count; i++) {
+        asmart_queue_free(&runtime->workers[i].queue);
+    }
+    if (runtime->reactors != NULL && runtime->workers != NULL && runtime->links != NULL) {
+        pthread_mutex_destroy(&runtime->idle_lock);
+        pthread_cond_destroy(&runtime->idle_cond);
+    }
+    free(runtime->reactors);
+    free(runtime->workers);
+    free(runtime->links);
+    memset(runtime, 0, sizeof(*runtime));
+}
+
+uint8_t asmart_runtime_send_command(aSmart_Link_t* link, uint8_t command_type, const uint8_t* payload, uint16_t payload_length){
+    RuntimeSend_t message = { .message_type = MSG_TYPE_COMMAND, .command_type = command_type, .length = payload_length };
+
+    return queue_send(link, &message, payload);
+}
+
+uint8_t asmart_runtime_send_notification(aSmart_Link_t* link, uint8_t notification_type, const uint8_t* payload, uint16_t payload_length){
+    RuntimeSend_t message = { .message_type = MSG_TYPE_NOTIFICATION, .command_type = notification_type, .length = payload_length };
+
+    return queue_send(link, &message, payload);
+}
+
+uint8_t asmart_runtime_send_response(aSmart_Link_t* link, uint16_t sequence_number, uint8_t command_type, const uint8_t* payload, uint16_t payload_length){
+    RuntimeSend_t message = { .message_type = MSG_TYPE_RESPONSE, .command_type = command_type, .sequence_number = sequence_number, .length = payload_length };
+
+    return queue_send(link, &message, payload);
+}
+
+uint8_t asmart_runtime_send_error(aSmart_Link_t* link, uint16_t sequence_number, uint8_t error_code, const uint8_t* payload, uint16_t payload_length){
+    RuntimeSend_t message = { .message_type = MSG_TYPE_ERROR, .command_type = error_code, .sequence_number = sequence_number, .length = payload_length };
+
+    return queue_send(link, &message, payload);
+}
+
+static aSmart_Link_t* create_link(aSmart_Runtime_t* runtime, LinkCallback callback, void* context) {
+    if (runtime->link_count >= runtime->max_links) {
+        errno = ENOSPC;
+        return NULL;
+    }
+
+    aSmart_Link_t* link = calloc(1, sizeof(aSmart_Link_t));
+    if (link == NULL) {
+        return NULL;
+    }
+    if (asmart_ring_init(&link->inbox, RUNTIME_INBOX_SIZE) < 0 || asmart_queue_init(&link->outbox, RUNTIME_OUTBOX_DEPTH, sizeof(RuntimeSend_t)) < 0) {
+        free_link(link);
+        errno = ENOMEM;
+        return NULL;
+    }
+
+    /* Spread the links over the reactors and the workers */
+    link->runtime = runtime;
+    link->reactor = &runtime->reactors[runtime->link_count % runtime->reactor_count];
+    link->home = runtime->link_count % runtime->worker_count;
+    link->callback = callback;
+    link->context = context;
+    return link;
+}
+
+static aSmart_Link_t* add_link(aSmart_Link_t* link) {
+    aSmart_Runtime_t* runtime = link->runtime;
+
+    link->port.context = link;
+    asmart_comm_init_port(&link->handler, &link->port, link_callback);
+    runtime->links[runtime->link_count++] = link;
+    return link;
+}
+
+static void free_link(aSmart_Link_t* link) {
+    asmart_ring_free(&link->inbox);
+    asmart_queue_free(&link->outbox);
+    free(link);
+}
+
+static void link_callback(uint8_t message_type, uint8_t command_type, uint16_t sequence_number, uint8_t* payload, uint16_t length) {
+    aSmart_HostPort_t* port = asmart_host_active_port();
+    aSmart_Link_t* link = (port != NULL) ? (aSmart_Link_t*)port->context : sending_link;
+    RuntimeRecord_t record = {
+        .message_type = message_type,
+        .command_type = command_type,
+        .sequence_number = sequence_number,
+        .timeout = (payload == NULL),
+        .source = link->handler.reply_address,
+        .reply_enabled = link->handler.reply_enabled
+    };
+
+    if (!asmart_ring_write(&link->inbox, &record, sizeof(record), payload, (payload == NULL) ? 0 : length)) {
+        atomic_fetch_add_explicit(&link->dropped, 1, memory_order_relaxed);
+        return;
+    }
+    atomic_fetch_add_explicit(&link->received, 1, memory_order_relaxed);
+
+    /* Room for what one more read can bring, otherwise leave the rest in the driver */
+    if (asmart_ring_space(&link->inbox) < RUNTIME_INBOX_RESERVE && !atomic_load(&link->held)) {
+        atomic_store(&link->held, 1);
+        asmart_host_hold(&link->port, 1);
+    }
+
+    /* Pairs with the fence in run_link(): either the worker sees the record or we see it idle */
+    atomic_thread_fence(memory_order_seq_cst);
+    if (!atomic_exchange(&link->scheduled, 1)) {
+        submit_link(link->runtime, link->home, link);
+    }
+}
+
+static uint8_t queue_send(aSmart_Link_t* link, RuntimeSend_t* message, const uint8_t* payload) {
+    if (message->length > ASMART_COMM_MAX_PAYLOAD) {
+        return 0;
+    }
+    if (message->length > 0) {
+        memcpy(message->payload, payload, message->length);
+    }
+
+    /* Answers go back to the source of the command the worker is handling */
+    message->destination = link->handler.peer_address;
+    message->reply_enabled = 1;
+    if (handling_link == link && handling_record != NULL) {
+        message->destination = handling_record->source;
+        message->reply_enabled = handling_record->reply_enabled;
+    }
+
+    if (!asmart_queue_push(&link->outbox, message)) {
+        return 0;
+    }
+    signal_reactor(link);
+    return 1;
+}
+
+static void flush_outbox(aSmart_Link_t* link) {
+    aSmart_Comm_Handler_t* handler = &link->handler;
+    RuntimeSend_t message;
+
+    sending_link = link;
+    while (asmart_queue_pop(&link->outbox, &message)) {
+        switch (message.message_type) {
+            case MSG_TYPE_COMMAND:
+                asmart_comm_send_command(handler, message.command_type, message.payload, message.length);
+                break;
+            case MSG_TYPE_NOTIFICATION:
+                asmart_comm_send_notification(handler, message.command_type, message.payload, message.length);
+                break;
+            case MSG_TYPE_RESPONSE:
+            case MSG_TYPE_ERROR:
+                /* Other commands may have arrived since, restore the one answered */
+                handler->reply_address = message.destination;
+                handler->reply_enabled = message.reply_enabled;
+                if (message.message_type == MSG_TYPE_RESPONSE) {
+                    asmart_comm_send_response(handler, message.sequence_number, message.command_type, message.payload, message.length);
+                }
+                else {
+                    asmart_comm_send_error(handler, message.sequence_number, message.command_type, message.payload, message.length);
+                }
+                break;
+            default:
+                break;
+        }
+    }
+    sending_link = NULL;
+}
+
+static void signal_reactor(aSmart_Link_t* link) {
+    if (!atomic_exchange(&link->signaled, 1)) {
+        asmart_queue_push(&link->reactor->signals, &link);
+        asmart_host_wake(&link->reactor->loop);
+    }
+}
+
+static void submit_link(aSmart_Runtime_t* runtime, uint16_t worker, aSmart_Link_t* link) {
+    /* Cannot fail: a link is in one queue at most and the queues hold all links */
+    asmart_queue_push(&runtime->workers[worker].queue, &link);
+
+    atomic_thread_fence(memory_order_seq_cst);
+    if (atomic_load(&runtime->sleepers) > 0) {
+        pthread_mutex_lock(&runtime->idle_lock);
+        pthread_cond_signal(&runtime->idle_cond);
+        pthread_mutex_unlock(&runtime->idle_lock);
+    }
+}
+
+static aSmart_Link_t* take_link(aSmart_Worker_t* worker) {
+    aSmart_Runtime_t* runtime = worker->runtime;
+    aSmart_Link_t* link;
+
+    if (asmart_queue_pop(&worker->queue, &link)) {
+        return link;
+    }
+    for (uint16_t i = 1; i < runtime->worker_count; i++) {
+        aSmart_Worker_t* victim = &runtime->workers[(worker->index + i) % runtime->worker_count];
+
+        if (asmart_queue_pop(&victim->queue, &link)) {
+            atomic_fetch_add_explicit(&worker->stolen, 1, memory_order_relaxed);
+            return link;
+        }
+    }
+    return NULL;
+}
+
+static void run_link(aSmart_Worker_t* worker, aSmart_Link_t* link) {
+    uint8_t payload[ASMART_COMM_MAX_PAYLOAD];
+    RuntimeRecord_t record;
+    uint16_t length;
+    uint16_t handled = 0;
+
+    handling_link = link;
+    handling_record = &record;
+    while (handled < RUNTIME_BATCH && asmart_ring_read(&link->inbox, &record, sizeof(record), payload, sizeof(payload), &length)) {
+        link->callback(link, record.message_type, record.command_type, record.sequence_number, record.timeout ? NULL : payload, length);
+        handled++;
+    }
+    handling_link = NULL;
+    handling_record = NULL;
+    atomic_fetch_add_explicit(&worker->executed, handled, memory_order_relaxed);
+
+    /* Enough room again for the reactor to read the port */
+    if (atomic_load(&link->held) && asmart_ring_space(&link->inbox) >= 2 * RUNTIME_INBOX_RESERVE) {
+        signal_reactor(link);
+    }
+
+    /* More waiting: to the back of this worker's queue, behind the other links */
+    if (!asmart_ring_empty(&link->inbox)) {
+        submit_link(worker->runtime, worker->index, link);
+        return;
+    }
+    atomic_store(&link->scheduled, 0);
+    atomic_thread_fence(memory_order_seq_cst);
+    if (!asmart_ring_empty(&link->inbox) && !atomic_exchange(&link->scheduled, 1)) {
+        submit_link(worker->runtime, worker->index, link);
+    }
+}
+
+static void idle_wait(aSmart_Runtime_t* runtime) {
+    struct timespec until;
+
+    clock_gettime(CLOCK_REALTIME, &until);
+    until.tv_nsec += RUNTIME_IDLE_MS * 1000000L;
+    if (until.tv_nsec >= 1000000000L) {
+        until.tv_sec++;
+        until.tv_nsec -= 1000000000L;
+    }
+
+    pthread_mutex_lock(&runtime->idle_lock);
+    atomic_fetch_add(&runtime->sleepers, 1);
+
+    /* A link submitted before the count went up is seen here, one after it signals */
+    uint8_t empty = 1;
+    for (uint16_t i = 0; i < runtime->worker_count && empty; i++) {
+        empty = asmart_queue_empty(&runtime->workers[i].queue);
+    }
+    if (empty && atomic_load(&runtime->running)) {
+        pthread_cond_timedwait(&runtime->idle_cond, &runtime->idle_lock, &until);
+    }
+    atomic_fetch_sub(&runtime->sleepers, 1);
+    pthread_mutex_unlock(&runtime->idle_lock);
+}
+
+static void* reactor_main(void* argument) {
+    aSmart_Reactor_t* reactor = (aSmart_Reactor_t*)argument;
+    aSmart_Runtime_t* runtime = reactor->runtime;
+    aSmart_Link_t* link;
+
+    while (atomic_load_explicit(&runtime->running, memory_order_relaxed)) {
+        if (asmart_host_poll(&reactor->loop, -1) < 0) {
+            break;
+        }
+
+        while (asmart_queue_pop(&reactor->signals, &link)) {
+            /* Cleared first, so a send queued from now on signals again */
+            atomic_store(&link->signaled, 0);
+            flush_outbox(link);
+
+            if (atomic_load(&link->held) && asmart_ring_space(&link->inbox) >= 2 * RUNTIME_INBOX_RESERVE) {
+                atomic_store(&link->held, 0);
+                asmart_host_hold(&link->port, 0);
+            }
+        }
+    }
+    return NULL;
+}
+
+static void* worker_main(void* argument) {
+    aSmart_Worker_t* worker = (aSmart_Worker_t*)argument;
+    aSmart_Runtime_t* runtime = worker->runtime;
+    uint16_t idle = 0;
+
+    while (atomic_load_explicit(&runtime->running, memory_order_relaxed)) {
+        aSmart_Link_t* link = take_link(worker);
+
+        if (link == NULL) {
+            if (++idle < RUNTIME_SPIN) {
+                sched_yield();
+            }
+            else {
+                idle_wait(runtime);
+                idle = 0;
+            }
+            continue;
+        }
+        idle = 0;
+        run_link(worker, link);
+    }
+    return NULL;
+}
@@ -0,0 +1,367 @@
+#include "asmart_comm_scan.h"
+#include "crc16.h"
+#include <string.h>
+#include <pthread.h>
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define SCAN_X86 1
+#else
+#define SCAN_X86 0
+#endif
+
+/***********************************************************************************************
+ *                                Bulk Frame Scanner                                            *
+ ***********************************************************************************************
+ *
+ * - Start bytes are found 32 (AVX2) or 16 (SSE2) bytes at a time: both STX and SOH are compared
+ *   at once and the match mask gives the next candidate. The instruction set is picked at run
+ *   time from the CPU, the functions are compiled for it with target attributes, so the
+ *   library needs no -mavx2.
+ * - Vectors only win on long gaps. Back-to-back frames, the common case, are caught by a look
+ *   at the first byte; AVX2 searches the first SCAN_NARROW_SPAN bytes in 16-byte blocks, as
+ *   noise dense with markers ends a gap long before a 64-byte load pays off, and tails shorter
+ *   than a block go byte by byte.
+ * - A candidate's Length field is decoded and checked like the parser does it: minimum length,
+ *   the frame fits SCAN_MAX_FRAME, a flagged compact Sequence Number fits, and for standard
+ *   frames the ETX sits where the length puts it. Most stray STX/SOH bytes inside payloads fail
+ *   here without any CRC work.
+ * - A candidate that passes is taken as a frame and the search goes on behind it, so
+ *   back-to-back frames cost one length check each. Candidates are collected in batches of
+ *   SCAN_BATCH and then CRC-checked with a slicing-by-8 table, eight bytes per step.
+ * - A bad CRC cuts the batch: the frames before it are handed over, and the search restarts one
+ *   byte behind the bad start, as the parser resynchronises on the next STX or SOH.
+ *
+ ***********************************************************************************************/
+
+/**
+ * @brief Finds the next STX or SOH.
+ * @param data Buffer.
+ * @param from Position to start at.
+ * @param length Buffer length.
+ * @retval Position of the byte, length if there is none.
+ */
+typedef size_t (*FindStart)(const uint8_t* data, size_t from, size_t length);
+
+/**
+ * @brief Finds the next STX or SOH one byte at a time.
+ * @param data Buffer.
+ * @param from Position to start at.
+ * @param length Buffer length.
+ * @retval Position of the byte, length if there is none.
+ */
+static size_t find_start_scalar(const uint8_t* data, size_t from, size_t length);
+
+#if SCAN_X86
+/**
+ * @brief Finds the next STX or SOH 16 bytes at a time.
+ * @param data Buffer.
+ * @param from Position to start at.
+ * @param length Buffer length.
+ * @retval Position of the byte, length if there is none.
+ */
+static size_t find_start_sse2(const uint8_t* data, size_t from, size_t length);
+
+/**
+ * @brief Finds the next STX or SOH 32 bytes at a time.
+ * @param data Buffer.
+ * @param from Position to start at.
+ * @param length Buffer length.
+ * @retval Position of the byte, length if there is none.
+ */
+static size_t find_start_avx2(const uint8_t* data, size_t from, size_t length);
+#endif
+
+/**
+ * @brief Checks the declared length of a candidate frame.
+ * @param data Buffer.
+ * @param length Buffer length.
+ * @param start Position of the STX or SOH.
+ * @param span Receives the frame if it is a candidate.
+ * @retval 1 if it is a candidate, 0 if not, -1 if the buffer ends before the frame does.
+ */
+static int check_candidate(const uint8_t* data, size_t length, size_t start, aSmart_FrameSpan_t* span);
+
+/**
+ * @brief Fills the slicing-by-8 CRC tables and picks the CPU's best start byte search, once.
+ * @retval None
+ */
+static void scan_init(void);
+
+static uint16_t crc_tables[8][256];  // crc_tables[k][n]: register n shifted through k + 1 bytes
+static pthread_once_t scan_once = PTHREAD_ONCE_INIT;
+static FindStart find_start = find_start_scalar;  // Start byte search in use
+static scan_isa_t scan_isa = SCAN_SCALAR;
+
+/* Function implementations */
+
+scan_isa_t asmart_scan_isa(void){
+    pthread_once(&scan_once, scan_init);
+    return scan_isa;
+}
+
+void asmart_scan_set_isa(scan_isa_t isa){
+    pthread_once(&scan_once, scan_init);
+#if SCAN_X86
+    if (isa == SCAN_AVX2 && __builtin_cpu_supports("avx2")) {
+        find_start = find_start_avx2;
+    }
+    else if (isa >= SCAN_SSE2) {
+        /* Every x86-64 CPU has SSE2 */
+        isa = SCAN_SSE2;
+        find_start = find_start_sse2;
+    }
+    else {
+        find_start = find_start_scalar;
+    }
+#else
+    isa = SCAN_SCALAR;
+    find_start = find_start_scalar;
+#endif
+    scan_isa = isa;
+}
+
+size_t asmart_scan_candidates(const uint8_t* data, size_t length, size_t from, aSmart_FrameSpan_t* spans, size_t max_spans, size_t* next){
+    size_t count = 0;
+    size_t position = from;
+
+    pthread_once(&scan_once, scan_init);
+    while (count < max_spans) {
+        position = find_start(data, position, length);
+        if (position >= length) {
+            break;
+        }
+
+        int result = check_candidate(data, length, position, &spans[count]);
+        if (result < 0) {
+            /* Kept for the next buffer */
+            break;
+        }
+        if (result == 0) {
+            position++;
+            continue;
+        }
+        position += spans[count].length;
+        count++;
+    }
+    *next = position;
+    return count;
+}
+
+size_t asmart_scan_verify(const uint8_t* data, const aSmart_FrameSpan_t* spans, size_t count){
+    for (size_t i = 0; i < count; i++) {
+        const uint8_t* frame = data + spans[i].offset;
+        uint16_t crc_end = spans[i].length - (spans[i].compact ? COMPACT_TRAILER_SIZE : FRAME_TRAILER_SIZE);
+
+        /* CRC over Length up to the end of the Payload, high byte first */
+        if (asmart_scan_crc16(frame + 1, crc_end - 1) != ((frame[crc_end] << 8) | frame[crc_end + 1])) {
+            return i;
+        }
+    }
+    return count;
+}
+
+size_t asmart_scan_buffer(const uint8_t* data, size_t length, ScanCallback callback, void* context, aSmart_ScanStats_t* stats){
+    aSmart_FrameSpan_t spans[SCAN_BATCH];
+    size_t position = 0;
+
+    for (;;) {
+        size_t next;
+        size_t count = asmart_scan_candidates(data, length, position, spans, SCAN_BATCH, &next);
+        size_t valid = asmart_scan_verify(data, spans, count);
+
+        if (valid > 0) {
+            if (callback != NULL) {
+                callback(context, data, spans, valid);
+            }
+            if (stats != NULL) {
+                stats->frames += valid;
+                for (size_t i = 0; i < valid; i++) {
+                    stats->bytes += spans[i].length;
+                }
+            }
+        }
+        if (valid < count) {
+            /* Resynchronise behind the bad start; the candidates after it are searched again */
+            if (stats != NULL) {
+                stats->rejected++;
+            }
+            position = spans[valid].offset + 1;
+            continue;
+        }
+        position = next;
+        if (count < SCAN_BATCH) {
+            return position;
+        }
+    }
+}
+
+uint16_t asmart_scan_crc16(const uint8_t* data, size_t length){
+    uint32_t crc = CRC16_INIT;
+
+    pthread_once(&scan_once, scan_init);
+    while (length >= 8) {
+        uint64_t word;
+
+        /* Reflected CRC: the running value is xored into the first two bytes of the block */
+        memcpy(&word, data, sizeof(word));
+#if __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+        word = __builtin_bswap64(word);
+#endif
+        word ^= crc;
+        crc = crc_tables[7][word & 0xFF] ^ crc_tables[6][(word >> 8) & 0xFF] ^ crc_tables[5][(word >> 16) & 0xFF] ^ crc_tables[4][(word >> 24) & 0xFF]
+            ^ crc_tables[3][(word >> 32) & 0xFF] ^ crc_tables[2][(word >> 40) & 0xFF] ^ crc_tables[1][(word >> 48) & 0xFF] ^ crc_tables[0][word >> 56];
+        data += 8;
+        length -= 8;
+    }
+    while (length-- > 0) {
+        crc = (crc >> 8) ^ crc_tables[0][(crc ^ *data++) & 0xFF];
+    }
+    return (uint16_t)crc;
+}
+
+static size_t find_start_scalar(const uint8_t* data, size_t from, size_t length) {
+    while (from < length && (uint8_t)(data[from] - SOH) > (STX - SOH)) {
+        from++;
+    }
+    return from;
+}
+
+#if SCAN_X86
+__attribute__((target("sse2")))
+static size_t find_start_sse2(const uint8_t* data, size_t from, size_t length) {
+    const __m128i stx = _mm_set1_epi8(STX);
+    const __m128i soh = _mm_set1_epi8(SOH);
+
+    /* The next frame usually starts right where the last one ended */
+    if (from < length && (uint8_t)(data[from] - SOH) <= (STX - SOH)) {
+        return from;
+    }
+    while (from + 16 <= length) {
+        __m128i block = _mm_loadu_si128((const __m128i*)(data + from));
+        unsigned mask = (unsigned)_mm_movemask_epi8(_mm_or_si128(_mm_cmpeq_epi8(block, stx), _mm_cmpeq_epi8(block, soh)));
+
+        if (mask != 0) {
+            return from + (size_t)__builtin_ctz(mask);
+        }
+        from += 16;
+    }
+    return find_start_scalar(data, from, length);
+}
+
+__attribute__((target("avx2")))
+static size_t find_start_avx2(const uint8_t* data, size_t from, size_t length) {
+    const __m256i stx = _mm256_set1_epi8(STX);
+    const __m256i soh = _mm256_set1_epi8(SOH);
+
+    /* Back-to-back frames and short gaps are found by the SSE2 search before the wide loop
+       has loaded its first 64 bytes; the wide loop pays off on long gaps only */
+    size_t narrow_end = (length - from > SCAN_NARROW_SPAN) ? from + SCAN_NARROW_SPAN : length;
+    from = find_start_sse2(data, from, narrow_end);
+    if (from < narrow_end) {
+        return from;
+    }
+    while (from + 64 <= length) {
+        __m256i low = _mm256_loadu_si256((const __m256i*)(data + from));
+        __m256i high = _mm256_loadu_si256((const __m256i*)(data + from + 32));
+        uint64_t mask = (uint32_t)_mm256_movemask_epi8(_mm256_or_si256(_mm256_cmpeq_epi8(low, stx), _mm256_cmpeq_epi8(low, soh)))
+                      | ((uint64_t)(uint32_t)_mm256_movemask_epi8(_mm256_or_si256(_mm256_cmpeq_epi8(high, stx), _mm256_cmpeq_epi8(high, soh))) << 32);
+
+        if (mask != 0) {
+            return from + (size_t)__builtin_ctzll(mask);
+        }
+        from += 64;
+    }
+    while (from + 32 <= length) {
+        __m256i block = _mm256_loadu_si256((const __m256i*)(data + from));
+        unsigned mask = (uint32_t)_mm256_movemask_epi8(_mm256_or_si256(_mm256_cmpeq_epi8(block, stx), _mm256_cmpeq_epi8(block, soh)));
+
+        if (mask != 0) {
+            return from + (size_t)__builtin_ctz(mask);
+        }
+        from += 32;
+    }
+    return find_start_sse2(data, from, length);
+}
+#endif
+
+static int check_candidate(const uint8_t* data, size_t length, size_t start, aSmart_FrameSpan_t* span) {
+    size_t available = length - start;
+    const uint8_t* frame = data + start;
+    uint32_t total;
+
+    if (frame[0] == STX) {
+        if (available < 3) {
+            return -1;
+        }
+        uint16_t msg_length = (frame[1] << 8) | frame[2];
+
+        /* Length counts from the Length field up to the end of the Payload */
+        total = (uint32_t)msg_length + 1 + FRAME_TRAILER_SIZE;
+        if (msg_length < FRAME_MIN_LENGTH || total > SCAN_MAX_FRAME) {
+            return 0;
+        }
+        if (available < total) {
+            return -1;
+        }
+        if (frame[total - 1] != ETX) {
+            return 0;
+        }
+        span->compact = 0;
+    }
+    else {
+        uint16_t msg_length;
+        uint16_t length_end;
+
+        if (available < 2) {
+            return -1;
+        }
+        if (frame[1] & 0x80) {
+            if (available < 3) {
+                return -1;
+            }
+            if (frame[2] & 0x80) {
+                return 0;
+            }
+            msg_length = (frame[1] & 0x7F) | ((uint16_t)frame[2] << 7);
+            length_end = 3;
+        }
+        else {
+            msg_length = frame[1];
+            length_end = 2;
+        }
+        total = (uint32_t)length_end + msg_length + COMPACT_TRAILER_SIZE;
+        if (msg_length < COMPACT_HEADER_MIN_SIZE || total > SCAN_MAX_FRAME) {
+            return 0;
+        }
+        if (available < total) {
+            return -1;
+        }
+        /* A flagged Sequence Number must fit before the end of the Payload */
+        if ((frame[length_end + 2] & COMPACT_FLAG_SEQUENCE) && msg_length < COMPACT_HEADER_MIN_SIZE + 2) {
+            return 0;
+        }
+        span->compact = 1;
+    }
+    span->offset = start;
+    span->length = (uint16_t)total;
+    return 1;
+}
+
+static void scan_init(void) {
+    /* One step of the byte-wise crc16_update() from a register holding n */
+    for (uint32_t n = 0; n < 256; n++) {
+        crc_tables[0][n] = crc16_update(0, (uint8_t)n);
+    }
+    for (uint32_t n = 0; n < 256; n++) {
+        for (uint32_t k = 1; k < 8; k++) {
+            uint16_t previous = crc_tables[k - 1][n];
+
+            crc_tables[k][n] = (previous >> 8) ^ crc_tables[0][previous & 0xFF];
+        }
+    }
+#if SCAN_X86
+    __builtin_cpu_init();
+    find_start = __builtin_cpu_supports("avx2") ? find_start_avx2 : find_start_sse2;
+    scan_isa = __builtin_cpu_supports("avx2") ? SCAN_AVX2 : SCAN_SSE2;
+#endif
+}
@@ -0,0 +1,105 @@
+#include "asmart_comm_spisim.h"
+#include <string.h>
+
+/***********************************************************************************************
+ *                                Simulated SPI Pair                                            *
+ ***********************************************************************************************
+ *
+ * - The master's transfer function only records the slots; the transfer runs on the next
+ *   asmart_spisim_step(), as the DMA would run it in the background. The slave's transfer
+ *   function arms its end, which holds until the master clocks.
+ * - A transfer takes SPI_SLOT_SIZE bytes at the SPI clock, after a gap of SPI_REARM_US. Both
+ *   ends complete it: the slave first, so it is armed again, then the master.
+ * - Nothing is damaged on the wires; a slave that is not armed is the only way to lose a slot.
+ *
+ ***********************************************************************************************/
+
+/* Pair whose time asmart_spisim_clock() returns */
+static aSmart_SpiSimBus_t* clock_bus;
+
+/* Driver functions of the two ends, see aSmart_SpiDriver_t */
+static uint8_t master_transfer(void* driver, const uint8_t* tx, uint8_t* rx);
+static uint8_t slave_transfer(void* driver, const uint8_t* tx, uint8_t* rx);
+static void set_ready(void* driver, uint8_t level);
+static uint8_t get_ready(void* driver);
+
+const aSmart_SpiDriver_t asmart_spisim_master_driver = { master_transfer, set_ready, get_ready };
+const aSmart_SpiDriver_t asmart_spisim_slave_driver = { slave_transfer, set_ready, get_ready };
+
+void asmart_spisim_init(aSmart_SpiSimBus_t* bus, uint32_t clock_hz, aSmart_SpiLink_t* master, aSmart_SpiLink_t* slave){
+    memset(bus, 0, sizeof(*bus));
+    bus->clock_hz = clock_hz;
+    bus->gap_ns = SPI_REARM_US * 1000;
+    bus->master = master;
+    bus->slave = slave;
+    clock_bus = bus;
+}
+
+uint8_t asmart_spisim_step(aSmart_SpiSimBus_t* bus){
+    const uint8_t* master_tx = bus->master_tx;
+    uint8_t armed = (bus->slave_tx != NULL);
+    uint64_t duration = (uint64_t)SPI_SLOT_SIZE * 8 * 1000000000ULL / bus->clock_hz;
+
+    if (master_tx == NULL) {
+        return 0;
+    }
+    if (armed) {
+        memcpy(bus->slave_rx, master_tx, SPI_SLOT_SIZE);
+        memcpy(bus->master_rx, bus->slave_tx, SPI_SLOT_SIZE);
+    }
+    else {
+        memset(bus->master_rx, SPISIM_IDLE_FILL, SPI_SLOT_SIZE);
+        bus->unarmed++;
+    }
+    bus->now_ns += bus->gap_ns + duration;
+    bus->busy_ns += duration;
+    bus->transfers++;
+
+    bus->master_tx = NULL;
+    bus->slave_tx = NULL;
+    if (armed) {
+        asmart_spi_complete(bus->slave, 1);
+    }
+    asmart_spi_complete(bus->master, 1);
+    return 1;
+}
+
+void asmart_spisim_advance(aSmart_SpiSimBus_t* bus, uint64_t ns){
+    bus->now_ns += ns;
+}
+
+uint32_t asmart_spisim_clock(void){
+    return (clock_bus != NULL) ? (uint32_t)(clock_bus->now_ns / 1000000ULL) : 0;
+}
+
+/* Internal function implementations */
+
+static uint8_t master_transfer(void* driver, const uint8_t* tx, uint8_t* rx) {
+    aSmart_SpiSimBus_t* bus = (aSmart_SpiSimBus_t*)driver;
+
+    if (bus->master_tx != NULL) {
+        return 0;
+    }
+    bus->master_tx = tx;
+    bus->master_rx = rx;
+    return 1;
+}
+
+static uint8_t slave_transfer(void* driver, const uint8_t* tx, uint8_t* rx) {
+    aSmart_SpiSimBus_t* bus = (aSmart_SpiSimBus_t*)driver;
+
+    if (bus->slave_tx != NULL) {
+        return 0;
+    }
+    bus->slave_tx = tx;
+    bus->slave_rx = rx;
+    return 1;
+}
+
+static void set_ready(void* driver, uint8_t level) {
+    ((aSmart_SpiSimBus_t*)driver)->ready = level;
+}
+
+static uint8_t get_ready(void* driver) {
+    return ((aSmart_SpiSimBus_t*)driver)->ready;
+}
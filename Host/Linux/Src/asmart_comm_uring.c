@@ -0,0 +1,331 @@
+#include "asmart_comm_uring.h"
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <sys/uio.h>
+
+/***********************************************************************************************
+ *                                io_uring Wrapper                                              *
+ ***********************************************************************************************
+ *
+ * - Submission and completion queues are mapped once; entries are written in place and the
+ *   tail is published with release order, the kernel's tails are read with acquire order.
+ * - Receive buffers come from one provided buffer ring (group 0) shared by every port of the
+ *   loop: a read picks a free buffer when data arrives, so idle ports hold no memory.
+ * - Send queues are registered in a sparse table, one entry per port, for fixed-buffer writes
+ *   that skip pinning the pages on every write.
+ * - Only one thread uses a ring at a time; nothing here is locked.
+ *
+ ***********************************************************************************************/
+
+/**
+ * @brief io_uring_setup(2).
+ */
+static int uring_setup(uint32_t entries, struct io_uring_params* params);
+
+/**
+ * @brief io_uring_enter(2).
+ */
+static int uring_enter(int fd, uint32_t to_submit, uint32_t min_complete, uint32_t flags, void* arg, size_t size);
+
+/**
+ * @brief io_uring_register(2).
+ */
+static int uring_register(int fd, uint32_t opcode, void* arg, uint32_t count);
+
+/**
+ * @brief Maps the queues of a new ring.
+ * @param ring Pointer to the ring structure, fd and features set.
+ * @param params Parameters returned by io_uring_setup().
+ * @retval 0 on success, -1 otherwise (errno is set).
+ */
+static int map_queues(aSmart_Uring_t* ring, struct io_uring_params* params);
+
+/**
+ * @brief Allocates the provided buffers and registers their ring as group 0.
+ * @param ring Pointer to the ring structure.
+ * @retval 0 on success, -1 otherwise (errno is set).
+ */
+static int setup_buffers(aSmart_Uring_t* ring);
+
+/**
+ * @brief Adds a buffer to the provided buffer ring without publishing it.
+ * @param ring Pointer to the ring structure.
+ * @param id Buffer ID.
+ * @retval None
+ */
+static void add_buffer(aSmart_Uring_t* ring, uint16_t id);
+
+/* Function implementations */
+
+int asmart_uring_init(aSmart_Uring_t* ring, uint32_t entries, uint16_t buffer_count, uint16_t buffer_size, uint16_t fixed_slots){
+    struct io_uring_params params;
+
+    memset(ring, 0, sizeof(*ring));
+    ring->fd = -1;
+    ring->buffer_count = buffer_count;
+    ring->buffer_size = buffer_size;
+
+    /* Completions may pile up while the loop parses: give the completion queue room */
+    memset(&params, 0, sizeof(params));
+    params.flags = IORING_SETUP_CQSIZE | IORING_SETUP_COOP_TASKRUN;
+    params.cq_entries = entries * 4;
+    ring->fd = uring_setup(entries, &params);
+    if (ring->fd < 0 && errno == EINVAL) {
+        /* Kernels before 5.19 know no task-run flags */
+        memset(&params, 0, sizeof(params));
+        params.flags = IORING_SETUP_CQSIZE;
+        params.cq_entries = entries * 4;
+        ring->fd = uring_setup(entries, &params);
+    }
+    if (ring->fd < 0) {
+        return -1;
+    }
+    ring->features = params.features;
+
+    /* Waiting with a timeout needs IORING_ENTER_EXT_ARG, Linux 5.11 */
+    if (!(ring->features & IORING_FEAT_EXT_ARG)) {
+        asmart_uring_exit(ring);
+        errno = ENOSYS;
+        return -1;
+    }
+    if (map_queues(ring, &params) < 0 || setup_buffers(ring) < 0) {
+        int error = errno;
+        asmart_uring_exit(ring);
+        errno = error;
+        return -1;
+    }
+
+    if (fixed_slots > 0) {
+        struct io_uring_rsrc_register table;
+
+        memset(&table, 0, sizeof(table));
+        table.nr = fixed_slots;
+        table.flags = IORING_RSRC_REGISTER_SPARSE;
+        ring->fixed = (uring_register(ring->fd, IORING_REGISTER_BUFFERS2, &table, sizeof(table)) == 0);
+    }
+    return 0;
+}
+
+void asmart_uring_exit(aSmart_Uring_t* ring){
+    if (ring->buffer_ring != NULL) {
+        munmap(ring->buffer_ring, (size_t)ring->buffer_count * sizeof(struct io_uring_buf));
+        ring->buffer_ring = NULL;
+    }
+    free(ring->buffers);
+    ring->buffers = NULL;
+    if (ring->sqes != NULL) {
+        munmap(ring->sqes, ring->sq_entries * sizeof(struct io_uring_sqe));
+        ring->sqes = NULL;
+    }
+    if (ring->cq_map != NULL && ring->cq_map != ring->sq_map) {
+        munmap(ring->cq_map, ring->cq_map_size);
+    }
+    if (ring->sq_map != NULL) {
+        munmap(ring->sq_map, ring->sq_map_size);
+    }
+    ring->sq_map = NULL;
+    ring->cq_map = NULL;
+    if (ring->fd >= 0) {
+        close(ring->fd);
+        ring->fd = -1;
+    }
+}
+
+struct io_uring_sqe* asmart_uring_get_sqe(aSmart_Uring_t* ring){
+    uint32_t tail = *ring->sq_tail;
+
+    if (tail - __atomic_load_n(ring->sq_head, __ATOMIC_ACQUIRE) >= ring->sq_entries) {
+        asmart_uring_submit(ring, 0);
+        if (tail - __atomic_load_n(ring->sq_head, __ATOMIC_ACQUIRE) >= ring->sq_entries) {
+            return NULL;
+        }
+    }
+
+    uint32_t index = tail & ring->sq_mask;
+    struct io_uring_sqe* sqe = &ring->sqes[index];
+
+    memset(sqe, 0, sizeof(*sqe));
+    ring->sq_array[index] = index;
+    __atomic_store_n(ring->sq_tail, tail + 1, __ATOMIC_RELEASE);
+    ring->sq_pending++;
+    return sqe;
+}
+
+int asmart_uring_submit(aSmart_Uring_t* ring, int timeout_ms){
+    struct __kernel_timespec timeout = { .tv_sec = timeout_ms / 1000, .tv_nsec = (long long)(timeout_ms % 1000) * 1000000 };
+    struct io_uring_getevents_arg wait = { .ts = (timeout_ms > 0) ? (uint64_t)(uintptr_t)&timeout : 0 };
+    uint32_t flags = IORING_ENTER_GETEVENTS | IORING_ENTER_EXT_ARG;
+
+    /* Always entered with GETEVENTS: under IORING_SETUP_COOP_TASKRUN that is what posts finished requests */
+    int submitted = uring_enter(ring->fd, ring->sq_pending, (timeout_ms != 0) ? 1 : 0, flags, &wait, sizeof(wait));
+    if (submitted < 0) {
+        /* Timeouts and signals end the wait, a full completion queue is drained by the caller */
+        if (errno == ETIME || errno == EINTR || errno == EBUSY || errno == EAGAIN) {
+            return 0;
+        }
+        return -1;
+    }
+    ring->sq_pending -= (uint32_t)submitted;
+    return 0;
+}
+
+struct io_uring_cqe* asmart_uring_peek(aSmart_Uring_t* ring){
+    uint32_t head = *ring->cq_head;
+
+    if (head == __atomic_load_n(ring->cq_tail, __ATOMIC_ACQUIRE)) {
+        return NULL;
+    }
+    return &ring->cqes[head & ring->cq_mask];
+}
+
+void asmart_uring_advance(aSmart_Uring_t* ring){
+    __atomic_store_n(ring->cq_head, *ring->cq_head + 1, __ATOMIC_RELEASE);
+}
+
+uint8_t* asmart_uring_buffer(aSmart_Uring_t* ring, uint16_t id){
+    return ring->buffers + (size_t)id * ring->buffer_size;
+}
+
+void asmart_uring_recycle(aSmart_Uring_t* ring, uint16_t id){
+    add_buffer(ring, id);
+    __atomic_store_n(&ring->buffer_ring->tail, ring->buffer_tail, __ATOMIC_RELEASE);
+}
+
+int asmart_uring_register_buffer(aSmart_Uring_t* ring, uint16_t slot, void* data, size_t size){
+    struct iovec buffer = { .iov_base = data, .iov_len = (data != NULL) ? size : 0 };
+    struct io_uring_rsrc_update2 update;
+
+    if (!ring->fixed) {
+        errno = ENXIO;
+        return -1;
+    }
+    memset(&update, 0, sizeof(update));
+    update.offset = slot;
+    update.data = (uint64_t)(uintptr_t)&buffer;
+    update.nr = 1;
+    return (uring_register(ring->fd, IORING_REGISTER_BUFFERS_UPDATE, &update, sizeof(update)) < 0) ? -1 : 0;
+}
+
+void asmart_uring_cancel_fd(aSmart_Uring_t* ring, int fd){
+    struct io_uring_sync_cancel_reg cancel;
+
+    memset(&cancel, 0, sizeof(cancel));
+    cancel.fd = fd;
+    cancel.flags = IORING_ASYNC_CANCEL_FD | IORING_ASYNC_CANCEL_ALL;
+    cancel.timeout.tv_sec = -1;
+    cancel.timeout.tv_nsec = -1;
+    if (uring_register(ring->fd, IORING_REGISTER_SYNC_CANCEL, &cancel, 1) == 0 || errno != EINVAL) {
+        return;
+    }
+
+    /* Before Linux 6.0: cancel asynchronously, the completions are told apart by the caller */
+    struct io_uring_sqe* sqe = asmart_uring_get_sqe(ring);
+    if (sqe != NULL) {
+        sqe->opcode = IORING_OP_ASYNC_CANCEL;
+        sqe->fd = fd;
+        sqe->cancel_flags = IORING_ASYNC_CANCEL_FD | IORING_ASYNC_CANCEL_ALL;
+        sqe->user_data = 0;
+        asmart_uring_submit(ring, 0);
+    }
+}
+
+static int uring_setup(uint32_t entries, struct io_uring_params* params) {
+    return (int)syscall(__NR_io_uring_setup, entries, params);
+}
+
+static int uring_enter(int fd, uint32_t to_submit, uint32_t min_complete, uint32_t flags, void* arg, size_t size) {
+    return (int)syscall(__NR_io_uring_enter, fd, to_submit, min_complete, flags, arg, size);
+}
+
+static int uring_register(int fd, uint32_t opcode, void* arg, uint32_t count) {
+    return (int)syscall(__NR_io_uring_register, fd, opcode, arg, count);
+}
+
+static int map_queues(aSmart_Uring_t* ring, struct io_uring_params* params) {
+    ring->sq_map_size = params->sq_off.array + params->sq_entries * sizeof(uint32_t);
+    ring->cq_map_size = params->cq_off.cqes + params->cq_entries * sizeof(struct io_uring_cqe);
+    if (ring->features & IORING_FEAT_SINGLE_MMAP) {
+        if (ring->cq_map_size > ring->sq_map_size) {
+            ring->sq_map_size = ring->cq_map_size;
+        }
+    }
+
+    ring->sq_map = mmap(NULL, ring->sq_map_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring->fd, IORING_OFF_SQ_RING);
+    if (ring->sq_map == MAP_FAILED) {
+        ring->sq_map = NULL;
+        return -1;
+    }
+    if (ring->features & IORING_FEAT_SINGLE_MMAP) {
+        ring->cq_map = ring->sq_map;
+    }
+    else {
+        ring->cq_map = mmap(NULL, ring->cq_map_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring->fd, IORING_OFF_CQ_RING);
+        if (ring->cq_map == MAP_FAILED) {
+            ring->cq_map = NULL;
+            return -1;
+        }
+    }
+    ring->sq_entries = params->sq_entries;
+    ring->sqes = mmap(NULL, params->sq_entries * sizeof(struct io_uring_sqe), PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring->fd, IORING_OFF_SQES);
+    if (ring->sqes == MAP_FAILED) {
+        ring->sqes = NULL;
+        return -1;
+    }
+
+    uint8_t* sq = (uint8_t*)ring->sq_map;
+    uint8_t* cq = (uint8_t*)ring->cq_map;
+    ring->sq_head = (uint32_t*)(sq + params->sq_off.head);
+    ring->sq_tail = (uint32_t*)(sq + params->sq_off.tail);
+    ring->sq_mask = *(uint32_t*)(sq + params->sq_off.ring_mask);
+    ring->sq_array = (uint32_t*)(sq + params->sq_off.array);
+    ring->cq_head = (uint32_t*)(cq + params->cq_off.head);
+    ring->cq_tail = (uint32_t*)(cq + params->cq_off.tail);
+    ring->cq_mask = *(uint32_t*)(cq + params->cq_off.ring_mask);
+    ring->cqes = (struct io_uring_cqe*)(cq + params->cq_off.cqes);
+    return 0;
+}
+
+static int setup_buffers(aSmart_Uring_t* ring) {
+    size_t ring_size = (size_t)ring->buffer_count * sizeof(struct io_uring_buf);
+    struct io_uring_buf_reg registration;
+
+    ring->buffers = malloc((size_t)ring->buffer_count * ring->buffer_size);
+    if (ring->buffers == NULL) {
+        return -1;
+    }
+
+    /* The buffer ring must be page aligned */
+    ring->buffer_ring = mmap(NULL, ring_size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (ring->buffer_ring == MAP_FAILED) {
+        ring->buffer_ring = NULL;
+        return -1;
+    }
+
+    memset(&registration, 0, sizeof(registration));
+    registration.ring_addr = (uint64_t)(uintptr_t)ring->buffer_ring;
+    registration.ring_entries = ring->buffer_count;
+    registration.bgid = 0;
+    if (uring_register(ring->fd, IORING_REGISTER_PBUF_RING, &registration, 1) < 0) {
+        return -1;
+    }
+
+    ring->buffer_tail = 0;
+    for (uint16_t id = 0; id < ring->buffer_count; id++) {
+        add_buffer(ring, id);
+    }
+    __atomic_store_n(&ring->buffer_ring->tail, ring->buffer_tail, __ATOMIC_RELEASE);
+    return 0;
+}
+
+static void add_buffer(aSmart_Uring_t* ring, uint16_t id) {
+    struct io_uring_buf* buffer = &ring->buffer_ring->bufs[ring->buffer_tail & (ring->buffer_count - 1)];
+
+    buffer->addr = (uint64_t)(uintptr_t)asmart_uring_buffer(ring, id);
+    buffer->len = ring->buffer_size;
+    buffer->bid = id;
+    ring->buffer_tail++;
+}
@@ -0,0 +1,193 @@
+/**
+  ******************************************************************************
+  * @file           : asmart_replay.c
+  * @brief          : Replays a frame capture into a handler
+  ******************************************************************************
+  *
+  * Usage: asmart_replay <capture> [-p port] [-d rx|tx] [-a address] [-s speed]
+  *                      [-r rounds] [-f first]
+  *        asmart_replay <capture> --scan [-p port] [-d rx|tx] [-r megabytes]
+  *
+  * Feeds the recorded frames of one port, or of all, into a handler that is not connected
+  * to anything and reports how many were dispatched, how many reached the callback and how
+  * fast. Recorded responses are dispatched but not delivered: the handler has none of their
+  * commands pending. -d tx plays the frames the
+  * capturing side sent, e.g. a controller's commands into a device handler at -a. -s 1 keeps
+  * the recorded timing; the default -s 0 runs without pauses, a repeatable benchmark of the
+  * receive path. -f starts at a record number, -r repeats the run.
+  * --scan strings the selected frames together into a stream of at least <megabytes> MiB
+  * (default 64) and decodes it with the byte-wise parser and with the bulk scanner on every
+  * instruction set the CPU has.
+  *
+  ******************************************************************************
+  */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "asmart_comm_handler.h"
+#include "asmart_comm_capture.h"
+#include "asmart_comm_scan.h"
+
+#define SCAN_STREAM_MB 64
+
+static uint64_t messages[MSG_TYPE_ERROR + 1];  // Callback calls per message type
+
+/* Counts what reaches the application */
+static void replay_callback(uint8_t message_type, uint8_t command_type, uint16_t sequence_number, uint8_t* payload, uint16_t length) {
+    (void)command_type;
+    (void)sequence_number;
+    (void)payload;
+    (void)length;
+
+    if (message_type <= MSG_TYPE_ERROR) {
+        messages[message_type]++;
+    }
+}
+
+/* Decodes the selected frames as one long stream, byte by byte and with the scanner */
+static int scan_benchmark(const aSmart_CaptureReader_t* reader, uint16_t port, uint8_t direction, uint32_t megabytes) {
+    size_t pattern = 0;
+    uint64_t pattern_frames = 0;
+
+    for (uint64_t i = 0; i < reader->count; i++) {
+        const aSmart_CaptureRecord_t* record = asmart_capture_record(reader, i);
+
+        if (record != NULL && record->direction == direction && (port == CAPTURE_ALL_PORTS || record->port == port)) {
+            pattern += record->length;
+            pattern_frames++;
+        }
+    }
+    if (pattern == 0) {
+        fprintf(stderr, "no frames selected\n");
+        return -1;
+    }
+
+    size_t repeats = ((size_t)megabytes * 1024 * 1024 + pattern - 1) / pattern;
+    size_t length = repeats * pattern;
+    uint8_t* stream = malloc(length);
+    if (stream == NULL) {
+        perror("malloc");
+        return -1;
+    }
+    size_t position = 0;
+    for (size_t r = 0; r < repeats; r++) {
+        for (uint64_t i = 0; i < reader->count; i++) {
+            const aSmart_CaptureRecord_t* record = asmart_capture_record(reader, i);
+
+            if (record != NULL && record->direction == direction && (port == CAPTURE_ALL_PORTS || record->port == port)) {
+                memcpy(stream + position, record + 1, record->length);
+                position += record->length;
+            }
+        }
+    }
+
+    /* Byte-wise parser, as the receive interrupt runs it */
+    static uint8_t frame[RECEIVE_BUFFER_SIZE];
+    aSmart_Parser_t parser;
+    uint64_t frames = 0;
+    uint32_t start = HAL_GetTick();
+
+    asmart_parser_init(&parser, frame, sizeof(frame), NULL, NULL);
+    for (size_t i = 0; i < length; i++) {
+        frames += (asmart_parser_feed(&parser, stream[i]) == PARSE_FRAME);
+    }
+    uint32_t elapsed = HAL_GetTick() - start;
+    printf("parser  %8.3f GB/s, %llu frames\n", (elapsed != 0) ? (double)length / 1e6 / (double)elapsed : 0.0, (unsigned long long)frames);
+
+    static const char* names[] = { "scalar", "sse2", "avx2" };
+    for (int isa = SCAN_SCALAR; isa <= SCAN_AVX2; isa++) {
+        aSmart_ScanStats_t stats = { 0, 0, 0 };
+
+        asmart_scan_set_isa((scan_isa_t)isa);
+        if ((int)asmart_scan_isa() != isa) {
+            continue;
+        }
+        start = HAL_GetTick();
+        asmart_scan_buffer(stream, length, NULL, NULL, &stats);
+        elapsed = HAL_GetTick() - start;
+        printf("%-7s %8.3f GB/s, %llu frames, %llu rejected\n", names[isa], (elapsed != 0) ? (double)length / 1e6 / (double)elapsed : 0.0,
+               (unsigned long long)stats.frames, (unsigned long long)stats.rejected);
+    }
+    printf("expected %llu frames in %zu bytes\n", (unsigned long long)(pattern_frames * repeats), length);
+    free(stream);
+    return 0;
+}
+
+int main(int argc, char** argv) {
+    aSmart_CaptureReader_t reader;
+    aSmart_Comm_Handler_t handler;
+    aSmart_HostPort_t port;  // Never opened: sends from the handler go nowhere
+    uint16_t replay_port = CAPTURE_ALL_PORTS;
+    uint8_t direction = CAPTURE_RX;
+    uint8_t address = ASMART_COMM_DEFAULT_ADDRESS;
+    double speed = 0;
+    uint32_t rounds = 1;
+    uint64_t first = 0;
+    int scan = 0;
+
+    if (argc < 2) {
+        fprintf(stderr, "usage: %s <capture> [--scan] [-p port] [-d rx|tx] [-a address] [-s speed] [-r rounds] [-f first]\n", argv[0]);
+        return 1;
+    }
+    for (int i = 2; i < argc; i += 2) {
+        const char* argument = (i + 1 < argc) ? argv[i + 1] : "";
+
+        if (strcmp(argv[i], "--scan") == 0) {
+            scan = 1;
+            i--;
+        }
+        else if (strcmp(argv[i], "-p") == 0) {
+            replay_port = (uint16_t)strtoul(argument, NULL, 0);
+        }
+        else if (strcmp(argv[i], "-d") == 0) {
+            direction = (strcmp(argument, "tx") == 0) ? CAPTURE_TX : CAPTURE_RX;
+        }
+        else if (strcmp(argv[i], "-a") == 0) {
+            address = (uint8_t)strtoul(argument, NULL, 0);
+        }
+        else if (strcmp(argv[i], "-s") == 0) {
+            speed = strtod(argument, NULL);
+        }
+        else if (strcmp(argv[i], "-r") == 0) {
+            rounds = (uint32_t)strtoul(argument, NULL, 10);
+        }
+        else if (strcmp(argv[i], "-f") == 0) {
+            first = strtoull(argument, NULL, 10);
+        }
+        else {
+            fprintf(stderr, "unknown option %s\n", argv[i]);
+            return 1;
+        }
+    }
+    if (asmart_capture_open(&reader, argv[1]) < 0) {
+        perror(argv[1]);
+        return 1;
+    }
+    if (scan) {
+        int result = scan_benchmark(&reader, replay_port, direction, (rounds > 1) ? rounds : SCAN_STREAM_MB);
+
+        asmart_capture_unmap(&reader);
+        return (result < 0) ? 1 : 0;
+    }
+
+    memset(&port, 0, sizeof(port));
+    port.fd = -1;
+    port.pty_fd = -1;
+    asmart_comm_init_port(&handler, &port, replay_callback);
+    asmart_comm_set_address(&handler, address, 0);
+
+    aSmart_ReplayStats_t stats = { 0, 0 };
+    uint32_t start = HAL_GetTick();
+    for (uint32_t round = 0; round < rounds; round++) {
+        asmart_capture_replay(&reader, &handler, replay_port, direction, first, speed, &stats);
+    }
+    uint32_t elapsed = HAL_GetTick() - start;
+
+    printf("%llu records, %llu frames dispatched in %u ms (%.0f frames/s), %llu delivered: %llu commands, %llu responses, %llu notifications, %llu errors\n",
+           (unsigned long long)reader.count, (unsigned long long)stats.frames, elapsed, (elapsed != 0) ? (double)stats.frames * 1000.0 / (double)elapsed : 0.0,
+           (unsigned long long)stats.delivered,
+           (unsigned long long)messages[MSG_TYPE_COMMAND], (unsigned long long)messages[MSG_TYPE_RESPONSE],
+           (unsigned long long)messages[MSG_TYPE_NOTIFICATION], (unsigned long long)messages[MSG_TYPE_ERROR]);
+    asmart_capture_unmap(&reader);
+    return 0;
+}
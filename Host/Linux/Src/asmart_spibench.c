@@ -0,0 +1,184 @@
+/**
+  ******************************************************************************
+  * @file           : asmart_spibench.c
+  * @brief          : Throughput and latency of the SPI transport on a simulated pair
+  ******************************************************************************
+  *
+  * Usage: asmart_spibench [-c clock Hz] [-b payload] [-w window] [-t seconds] [--sweep]
+  *
+  * A controller at address 0x01 is the SPI master, a node at 0x10 the slave, joined by the
+  * in-process pair of asmart_comm_spisim.c. The controller keeps <window> commands of
+  * <payload> bytes in flight and the node echoes the payload in its response. Time is the
+  * pair's: every transfer takes SPI_SLOT_SIZE bytes at the SPI clock plus the re-arm gap, and
+  * the node answers at once. Latency runs from the command being handed to the handler to
+  * its response being dispatched. --sweep repeats the run for payloads of 8 bytes up to the
+  * largest one that fits a frame.
+  *
+  ******************************************************************************
+  */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "asmart_comm_spisim.h"
+
+#define BENCH_COMMAND 0x10
+#define BENCH_CONTROLLER_ADDRESS 0x01
+#define BENCH_NODE_ADDRESS 0x10
+#define BENCH_IDLE_NS 1000  // Time that passes while no transfer is due
+#define BENCH_SAMPLES_MAX 4000000  // Latencies kept for the percentiles
+
+// Benchmark Settings
+typedef struct {
+    uint32_t clock_hz;
+    uint16_t payload;
+    uint16_t window;
+    uint16_t seconds;
+    uint8_t sweep;  // Repeat over payload sizes
+} BenchConfig_t;
+
+// Results of a Run
+typedef struct {
+    uint64_t sent;
+    uint64_t completed;
+    uint64_t timeouts;
+    uint64_t* latencies;  // ns
+    uint32_t samples;
+} BenchResult_t;
+
+static BenchConfig_t config = { 16000000, 32, 4, 1, 0 };
+static aSmart_SpiSimBus_t bus;
+static aSmart_Comm_Handler_t controller;
+static aSmart_Comm_Handler_t node;
+static aSmart_SpiLink_t controller_link;
+static aSmart_SpiLink_t node_link;
+static BenchResult_t result;
+
+/* Node: echo every command */
+static void node_callback(uint8_t message_type, uint8_t command_type, uint16_t sequence_number, uint8_t* payload, uint16_t length) {
+    if (message_type == MSG_TYPE_COMMAND) {
+        asmart_comm_send_response(&node, sequence_number, command_type, payload, length);
+    }
+}
+
+/* Controller: the payload carries the time its command was sent */
+static void controller_callback(uint8_t message_type, uint8_t command_type, uint16_t sequence_number, uint8_t* payload, uint16_t length) {
+    (void)command_type;
+    (void)sequence_number;
+
+    if (message_type == MSG_TYPE_RESPONSE && length >= sizeof(uint64_t)) {
+        uint64_t sent_ns;
+
+        memcpy(&sent_ns, payload, sizeof(sent_ns));
+        if (result.samples < BENCH_SAMPLES_MAX) {
+            result.latencies[result.samples++] = bus.now_ns - sent_ns;
+        }
+        result.completed++;
+    }
+    else if (message_type == MSG_TYPE_ERROR && payload == NULL) {
+        result.timeouts++;
+    }
+}
+
+static int compare_latency(const void* a, const void* b) {
+    uint64_t x = *(const uint64_t*)a;
+    uint64_t y = *(const uint64_t*)b;
+
+    return (x > y) - (x < y);
+}
+
+static int run_bench(void) {
+    uint8_t payload[ASMART_COMM_MAX_PAYLOAD];
+    uint64_t end_ns = (uint64_t)config.seconds * 1000000000ULL;
+
+    memset(&result, 0, sizeof(result));
+    result.latencies = malloc(BENCH_SAMPLES_MAX * sizeof(uint64_t));
+    if (result.latencies == NULL) {
+        return -1;
+    }
+
+    asmart_spisim_init(&bus, config.clock_hz, &controller_link, &node_link);
+    asmart_comm_set_clock(asmart_spisim_clock);
+    asmart_spi_init(&controller_link, &controller, SPI_ROLE_MASTER, &asmart_spisim_master_driver, &bus, controller_callback);
+    asmart_comm_set_address(&controller, BENCH_CONTROLLER_ADDRESS, 0);
+    asmart_comm_set_peer(&controller, BENCH_NODE_ADDRESS);
+    asmart_spi_init(&node_link, &node, SPI_ROLE_SLAVE, &asmart_spisim_slave_driver, &bus, node_callback);
+    asmart_comm_set_address(&node, BENCH_NODE_ADDRESS, 0);
+    asmart_comm_set_peer(&node, BENCH_CONTROLLER_ADDRESS);
+    memset(payload, 0xA5, sizeof(payload));
+
+    while (bus.now_ns < end_ns) {
+        asmart_comm_handler(&node);
+        asmart_spi_service(&node_link);
+        asmart_comm_handler(&controller);
+
+        /* Keep the window full, as far as the link can queue */
+        while (result.sent - result.completed - result.timeouts < config.window && asmart_spi_tx_room(&controller_link) >= FRAME_HEADER_SIZE + config.payload + FRAME_TRAILER_SIZE) {
+            memcpy(payload, &bus.now_ns, sizeof(bus.now_ns));
+            asmart_comm_send_command(&controller, BENCH_COMMAND, payload, config.payload);
+            result.sent++;
+        }
+        asmart_spi_service(&controller_link);
+
+        if (!asmart_spisim_step(&bus)) {
+            asmart_spisim_advance(&bus, BENCH_IDLE_NS);
+        }
+    }
+    qsort(result.latencies, result.samples, sizeof(uint64_t), compare_latency);
+
+    double seconds = (double)bus.now_ns / 1e9;
+    double slot_bytes = (double)bus.transfers * SPI_SLOT_DATA * 2;
+    uint64_t p50 = (result.samples > 0) ? result.latencies[result.samples / 2] : 0;
+    uint64_t p99 = (result.samples > 0) ? result.latencies[(uint64_t)result.samples * 99 / 100] : 0;
+    uint64_t max = (result.samples > 0) ? result.latencies[result.samples - 1] : 0;
+
+    printf("%u B, window %u, %u kHz, %u B slots: %.0f req/s, %.1f kB/s payload, clock busy %.1f %%, %.0f transfers/s, slots %.1f %% full, latency p50 %.1f us p99 %.1f us max %.1f us, %llu timeouts, %u drops, %u slot errors\n",
+           config.payload, config.window, config.clock_hz / 1000, SPI_SLOT_SIZE,
+           result.completed / seconds, 2.0 * result.completed * config.payload / seconds / 1000, 100.0 * bus.busy_ns / bus.now_ns, bus.transfers / seconds,
+           (slot_bytes > 0) ? 100.0 * (controller_link.tx_bytes + node_link.tx_bytes) / slot_bytes : 0.0,
+           p50 / 1e3, p99 / 1e3, max / 1e3, (unsigned long long)result.timeouts,
+           controller_link.tx_drops + node_link.tx_drops, controller_link.rx_errors + node_link.rx_errors);
+
+    free(result.latencies);
+    return 0;
+}
+
+int main(int argc, char** argv) {
+    for (int i = 1; i < argc; i++) {
+        const char* option = argv[i];
+        const char* argument = (i + 1 < argc) ? argv[i + 1] : "";
+        uint32_t value = (uint32_t)strtoul(argument, NULL, 10);
+
+        if (strcmp(option, "--sweep") == 0) {
+            config.sweep = 1;
+            continue;
+        }
+        if (option[0] != '-' || option[1] == '\0' || option[2] != '\0' || i + 1 >= argc) {
+            fprintf(stderr, "usage: %s [-c clock Hz] [-b payload] [-w window] [-t seconds] [--sweep]\n", argv[0]);
+            return 1;
+        }
+        switch (option[1]) {
+            case 'c': config.clock_hz = value; break;
+            case 'b': config.payload = (uint16_t)value; break;
+            case 'w': config.window = (uint16_t)value; break;
+            case 't': config.seconds = (uint16_t)value; break;
+            default: fprintf(stderr, "unknown option %s\n", option); return 1;
+        }
+        i++;
+    }
+    if (config.clock_hz == 0 || config.window == 0 || config.window > MAPPING_TABLE_ENTRIES || config.payload < sizeof(uint64_t)
+        || config.payload > ASMART_COMM_MAX_PAYLOAD || config.seconds == 0) {
+        fprintf(stderr, "invalid settings\n");
+        return 1;
+    }
+
+    if (!config.sweep) {
+        return (run_bench() == 0) ? 0 : 1;
+    }
+    for (uint16_t payload = sizeof(uint64_t); payload <= ASMART_COMM_MAX_PAYLOAD; payload *= 2) {
+        config.payload = payload;
+        if (run_bench() != 0) {
+            return 1;
+        }
+    }
+    return 0;
+}
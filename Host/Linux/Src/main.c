@@ -0,0 +1,179 @@
+/**
+  ******************************************************************************
+  * @file           : main.c
+  * @brief          : Linux host example, one controller talking to many MCUs
+  ******************************************************************************
+  *
+  * Usage: asmart_host [--capture <file>] <device>[:<baudrate>] ...
+  *        asmart_host [--capture <file>] --loopback <count>
+  *
+  * Every port gets its own handler and a begin transaction command once a second; answers
+  * and timeouts are counted per port. --loopback opens <count> pseudo-terminals and answers
+  * the commands from a second handler on each slave side, so it runs without hardware.
+  * --capture records the frames of every controller port, numbered from 0, for asmart_replay.
+  *
+  ******************************************************************************
+  */
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "asmart_comm_handler.h"
+#include "asmart_comm_capture.h"
+
+#define HOST_MAX_PORTS 512
+#define DEFAULT_BAUDRATE 115200
+#define COMMAND_PERIOD_MS 1000
+
+// Port State
+typedef struct {
+    aSmart_HostPort_t port;
+    aSmart_Comm_Handler_t handler;
+    aSmart_CaptureTap_t tap;
+    uint32_t responses;
+    uint32_t timeouts;
+} HostNode_t;
+
+static HostNode_t* controllers;
+static HostNode_t* devices;  // Loopback only: the other end of each pty
+static volatile sig_atomic_t running = 1;
+
+static const uint8_t command_payload[4] = {0xaa, 0xdd, 0xcc, 0xbb};
+
+static void stop(int signal_number) {
+    (void)signal_number;
+    running = 0;
+}
+
+/* Controller side: responses and timeouts of the port's commands */
+static void controller_callback(uint8_t message_type, uint8_t command_type, uint16_t sequence_number, uint8_t* payload, uint16_t length) {
+    HostNode_t* node = (HostNode_t*)asmart_host_active_port()->context;
+
+    (void)command_type;
+    (void)sequence_number;
+    (void)length;
+
+    if (message_type == MSG_TYPE_RESPONSE) {
+        node->responses++;
+    }
+    else if (message_type == MSG_TYPE_ERROR && payload == NULL) {
+        node->timeouts++;
+    }
+}
+
+/* Device side of a loopback: answers every command with its payload */
+static void device_callback(uint8_t message_type, uint8_t command_type, uint16_t sequence_number, uint8_t* payload, uint16_t length) {
+    HostNode_t* node = (HostNode_t*)asmart_host_active_port()->context;
+
+    if (message_type == MSG_TYPE_COMMAND) {
+        asmart_comm_send_response(&node->handler, sequence_number, command_type, payload, length);
+    }
+}
+
+static int open_loopback(aSmart_HostLoop_t* loop, int index) {
+    char slave_path[64];
+
+    if (asmart_host_open_pty(loop, &controllers[index].port, slave_path, sizeof(slave_path)) < 0
+        || asmart_host_open(loop, &devices[index].port, slave_path, DEFAULT_BAUDRATE) < 0) {
+        perror("pty");
+        return -1;
+    }
+    devices[index].port.context = &devices[index];
+    asmart_comm_init_port(&devices[index].handler, &devices[index].port, device_callback);
+    return 0;
+}
+
+static int open_device(aSmart_HostLoop_t* loop, int index, char* argument) {
+    uint32_t baudrate = DEFAULT_BAUDRATE;
+    char* separator = strrchr(argument, ':');
+
+    if (separator != NULL) {
+        *separator = '\0';
+        baudrate = (uint32_t)strtoul(separator + 1, NULL, 10);
+    }
+    if (asmart_host_open(loop, &controllers[index].port, argument, baudrate) < 0) {
+        perror(argument);
+        return -1;
+    }
+    return 0;
+}
+
+int main(int argc, char** argv) {
+    aSmart_HostLoop_t loop;
+    aSmart_CaptureWriter_t capture;
+    const char* capture_path = (argc >= 3 && strcmp(argv[1], "--capture") == 0) ? argv[2] : NULL;
+    char** arguments = (capture_path != NULL) ? argv + 2 : argv;
+    int argument_count = (capture_path != NULL) ? argc - 2 : argc;
+    int loopback = (argument_count == 3 && strcmp(arguments[1], "--loopback") == 0);
+    int count = loopback ? atoi(arguments[2]) : argument_count - 1;
+
+    if (count < 1 || count > HOST_MAX_PORTS) {
+        fprintf(stderr, "usage: %s [--capture <file>] <device>[:<baudrate>] ... | [--capture <file>] --loopback <count>\n", argv[0]);
+        return 1;
+    }
+    if (capture_path != NULL && asmart_capture_create(&capture, capture_path) < 0) {
+        perror(capture_path);
+        return 1;
+    }
+
+    controllers = calloc((size_t)count, sizeof(HostNode_t));
+    devices = loopback ? calloc((size_t)count, sizeof(HostNode_t)) : NULL;
+    if (controllers == NULL || (loopback && devices == NULL) || asmart_host_loop_init(&loop) < 0) {
+        perror("init");
+        return 1;
+    }
+
+    for (int i = 0; i < count; i++) {
+        if ((loopback ? open_loopback(&loop, i) : open_device(&loop, i, arguments[i + 1])) < 0) {
+            return 1;
+        }
+        controllers[i].port.context = &controllers[i];
+        asmart_comm_init_port(&controllers[i].handler, &controllers[i].port, controller_callback);
+        if (capture_path != NULL) {
+            asmart_capture_tap(&controllers[i].tap, &capture, &controllers[i].handler, (uint16_t)i);
+        }
+    }
+
+    signal(SIGINT, stop);
+    signal(SIGTERM, stop);
+
+    uint32_t last_command = HAL_GetTick() - COMMAND_PERIOD_MS;
+    uint32_t last_report = HAL_GetTick();
+    while (running) {
+        if (HAL_GetTick() - last_command >= COMMAND_PERIOD_MS) {
+            last_command = HAL_GetTick();
+            for (int i = 0; i < count; i++) {
+                asmart_comm_send_command(&controllers[i].handler, COMMAND_TYPE_BEGIN_TRANSACTION, (uint8_t*)command_payload, sizeof(command_payload));
+            }
+        }
+        if (asmart_host_poll(&loop, -1) < 0) {
+            perror("epoll_wait");
+            break;
+        }
+        if (HAL_GetTick() - last_report >= 5 * COMMAND_PERIOD_MS) {
+            uint32_t responses = 0;
+            uint32_t timeouts = 0;
+
+            last_report = HAL_GetTick();
+            for (int i = 0; i < count; i++) {
+                responses += controllers[i].responses;
+                timeouts += controllers[i].timeouts;
+            }
+            printf("%d ports: %u responses, %u timeouts\n", count, responses, timeouts);
+            fflush(stdout);
+        }
+    }
+
+    asmart_host_loop_close(&loop);
+    if (capture_path != NULL) {
+        for (int i = 0; i < count; i++) {
+            asmart_comm_set_capture(&controllers[i].handler, NULL, NULL);
+        }
+        if (asmart_capture_close(&capture) < 0) {
+            perror(capture_path);
+        }
+    }
+    free(controllers);
+    free(devices);
+    return 0;
+}
@@ -0,0 +1,47 @@
+#ifndef _ASMART_TEST_H_
+#define _ASMART_TEST_H_
+
+/*
+ * Checks of the host tests: every test program runs its cases from main() with ASMART_TEST_RUN
+ * and returns asmart_test_result(), so ctest sees a failure as a non-zero exit. A failed check
+ * prints where it failed and ends its case.
+ */
+
+#include <stdint.h>
+#include <stdio.h>
+
+static int asmart_test_failures;
+
+// Ends the current case if the condition does not hold
+#define CHECK(condition) \
+    do { \
+        if (!(condition)) { \
+            fprintf(stderr, "%s:%d: check failed: %s\n", __FILE__, __LINE__, #condition); \
+            asmart_test_failures++; \
+            return; \
+        } \
+    } while (0)
+
+// Runs a case, a function without arguments and result
+#define ASMART_TEST_RUN(test) \
+    do { \
+        int failures_before = asmart_test_failures; \
+        test(); \
+        printf("%s %s\n", (asmart_test_failures == failures_before) ? "ok  " : "FAIL", #test); \
+    } while (0)
+
+// Time of the tests: pass asmart_test_clock to asmart_comm_set_clock() and move it by hand
+static uint32_t asmart_test_now_ms;
+
+static inline uint32_t asmart_test_clock(void) {
+    return asmart_test_now_ms;
+}
+
+// Exit code of a program whose cases cannot run on this machine, reported as skipped by ctest
+#define ASMART_TEST_SKIPPED 77
+
+static inline int asmart_test_result(void) {
+    return (asmart_test_failures == 0) ? 0 : 1;
+}
+
+#endif // _ASMART_TEST_H_
@@ -0,0 +1,162 @@
+/*
+ * Multi-drop addressing: frames to this node, to another node, to a group it joined, to one it
+ * did not join and to broadcast, and the responses a node holds back for group and broadcast
+ * commands.
+ */
+#include <string.h>
+#include "asmart_comm_handler.h"
+#include "asmart_test.h"
+
+#define CONTROLLER_ADDRESS 0x01
+#define NODE_ADDRESS 0x10
+#define OTHER_ADDRESS 0x11
+#define JOINED_GROUP 2
+#define OTHER_GROUP 3
+#define ECHO_COMMAND 0x10
+#define TEST_NOTIFICATION 0x30
+
+// Frames a Handler Sent
+typedef struct {
+    uint8_t frame[TRANSMIT_BUFFER_SIZE];
+    uint16_t length;
+    uint32_t count;
+} SentFrames_t;
+
+static aSmart_Comm_Handler_t controller;
+static aSmart_Comm_Handler_t node;
+static SentFrames_t controller_sent;
+static SentFrames_t node_sent;
+static uint32_t commands;
+static uint32_t notifications;
+
+static void keep_frame(void* context, uint8_t destination, const uint8_t* frame, uint16_t length) {
+    SentFrames_t* sent = (SentFrames_t*)context;
+
+    (void)destination;
+    memcpy(sent->frame, frame, length);
+    sent->length = length;
+    sent->count++;
+}
+
+/* Node: answers every command it is given, counts notifications */
+static void node_callback(uint8_t message_type, uint8_t command_type, uint16_t sequence_number, uint8_t* payload, uint16_t length) {
+    if (message_type == MSG_TYPE_COMMAND) {
+        commands++;
+        asmart_comm_send_response(&node, sequence_number, command_type, payload, length);
+    }
+    else if (message_type == MSG_TYPE_NOTIFICATION && command_type == TEST_NOTIFICATION) {
+        notifications++;
+    }
+}
+
+static void ignore(uint8_t message_type, uint8_t command_type, uint16_t sequence_number, uint8_t* payload, uint16_t length) {
+    (void)message_type;
+    (void)command_type;
+    (void)sequence_number;
+    (void)payload;
+    (void)length;
+}
+
+/* The node has its own address and joined one group */
+static void init_pair(void) {
+    asmart_test_now_ms = 0;
+    asmart_comm_set_clock(asmart_test_clock);
+    memset(&controller_sent, 0, sizeof(controller_sent));
+    memset(&node_sent, 0, sizeof(node_sent));
+    asmart_comm_init_transport(&controller, keep_frame, &controller_sent, ignore);
+    asmart_comm_set_address(&controller, CONTROLLER_ADDRESS, 0);
+    asmart_comm_set_peer(&controller, NODE_ADDRESS);
+    asmart_comm_init_transport(&node, keep_frame, &node_sent, node_callback);
+    asmart_comm_set_address(&node, NODE_ADDRESS, 1 << JOINED_GROUP);
+    asmart_comm_set_peer(&node, CONTROLLER_ADDRESS);
+    commands = 0;
+    notifications = 0;
+}
+
+/* Hands the controller's last frame to the node and runs it */
+static void deliver(void) {
+    asmart_comm_receive_bytes(&node, controller_sent.frame, controller_sent.length);
+    asmart_comm_handler(&node);
+}
+
+static void notify(uint8_t destination) {
+    uint8_t value = 0x5A;
+
+    asmart_comm_send_notification_to(&controller, destination, TEST_NOTIFICATION, &value, 1);
+    deliver();
+}
+
+static void command(uint8_t destination) {
+    uint8_t value = 0x5A;
+
+    asmart_comm_send_command_to(&controller, destination, ECHO_COMMAND, &value, 1);
+    deliver();
+}
+
+static void test_notification_dispatch(void) {
+    init_pair();
+
+    notify(NODE_ADDRESS);
+    CHECK(notifications == 1);
+    notify(OTHER_ADDRESS);
+    CHECK(notifications == 1);
+    notify(ADDRESS_GROUP(JOINED_GROUP));
+    CHECK(notifications == 2);
+    notify(ADDRESS_GROUP(OTHER_GROUP));
+    CHECK(notifications == 2);
+    notify(ADDRESS_BROADCAST);
+    CHECK(notifications == 3);
+    CHECK(controller_sent.count == 5 && node_sent.count == 0);
+}
+
+static void test_multicast_commands_not_answered(void) {
+    init_pair();
+
+    /* A unicast command is answered */
+    command(NODE_ADDRESS);
+    CHECK(commands == 1 && node_sent.count == 1);
+
+    /* Group and broadcast commands reach the application, the response stays off the bus */
+    command(ADDRESS_GROUP(JOINED_GROUP));
+    CHECK(commands == 2 && node_sent.count == 1);
+    command(ADDRESS_BROADCAST);
+    CHECK(commands == 3 && node_sent.count == 1);
+
+    /* Neither is waited for by the controller, the unicast one is until its response arrives */
+    CHECK(controller.mapping_table_count == 1);
+
+    /* The next unicast command is answered again */
+    command(NODE_ADDRESS);
+    CHECK(commands == 4 && node_sent.count == 2);
+
+    /* Commands for others never reach the application */
+    command(OTHER_ADDRESS);
+    command(ADDRESS_GROUP(OTHER_GROUP));
+    CHECK(commands == 4 && node_sent.count == 2);
+}
+
+static void test_group_membership_changes(void) {
+    init_pair();
+
+    /* Leaving the group drops its frames, joining another takes them */
+    asmart_comm_set_address(&node, NODE_ADDRESS, 1 << OTHER_GROUP);
+    notify(ADDRESS_GROUP(JOINED_GROUP));
+    CHECK(notifications == 0);
+    notify(ADDRESS_GROUP(OTHER_GROUP));
+    CHECK(notifications == 1);
+
+    /* A node without an address still takes broadcast only */
+    asmart_comm_set_address(&node, ADDRESS_UNASSIGNED, 0);
+    notify(ADDRESS_UNASSIGNED);
+    notify(NODE_ADDRESS);
+    CHECK(notifications == 1);
+    notify(ADDRESS_BROADCAST);
+    CHECK(notifications == 2);
+}
+
+int main(void) {
+    ASMART_TEST_RUN(test_notification_dispatch);
+    ASMART_TEST_RUN(test_multicast_commands_not_answered);
+    ASMART_TEST_RUN(test_group_membership_changes);
+    return asmart_test_result();
+}
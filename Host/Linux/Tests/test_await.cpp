@@ -0,0 +1,140 @@
+/*
+ * C++20 coroutine front end: a request awaited to its response, one awaited to its timeout and
+ * two awaited one after the other in the same flow.
+ */
+#include <cstring>
+#include "asmart_comm_await.hpp"
+#include "asmart_test.h"
+
+#define CONTROLLER_ADDRESS 0x01
+#define NODE_ADDRESS 0x10
+#define ECHO_COMMAND 0x10
+
+// Frames a Handler Sent
+struct SentFrames_t {
+    uint8_t frame[TRANSMIT_BUFFER_SIZE];
+    uint16_t length;
+    uint32_t count;
+};
+
+// What a flow saw, checked once it has returned
+struct FlowResult_t {
+    asmart::RequestResult results[2];
+    uint8_t response[8];
+    uint8_t awaited;
+    bool finished;
+};
+
+static aSmart_Comm_Handler_t controller;
+static aSmart_Comm_Handler_t node;
+static SentFrames_t controller_sent;
+static SentFrames_t node_sent;
+static FlowResult_t flow;
+
+static void keep_frame(void* context, uint8_t destination, const uint8_t* frame, uint16_t length) {
+    SentFrames_t* sent = static_cast<SentFrames_t*>(context);
+
+    (void)destination;
+    std::memcpy(sent->frame, frame, length);
+    sent->length = length;
+    sent->count++;
+}
+
+static void node_callback(uint8_t message_type, uint8_t command_type, uint16_t sequence_number, uint8_t* payload, uint16_t length) {
+    if (message_type == MSG_TYPE_COMMAND) {
+        asmart_comm_send_response(&node, sequence_number, command_type, payload, length);
+    }
+}
+
+static void ignore(uint8_t message_type, uint8_t command_type, uint16_t sequence_number, uint8_t* payload, uint16_t length) {
+    (void)message_type;
+    (void)command_type;
+    (void)sequence_number;
+    (void)payload;
+    (void)length;
+}
+
+static void init_pair() {
+    asmart_test_now_ms = 0;
+    asmart_comm_set_clock(asmart_test_clock);
+    std::memset(&controller_sent, 0, sizeof(controller_sent));
+    std::memset(&node_sent, 0, sizeof(node_sent));
+    std::memset(&flow, 0, sizeof(flow));
+    asmart_comm_init_transport(&controller, keep_frame, &controller_sent, ignore);
+    asmart_comm_set_address(&controller, CONTROLLER_ADDRESS, 0);
+    asmart_comm_set_peer(&controller, NODE_ADDRESS);
+    asmart_comm_init_transport(&node, keep_frame, &node_sent, node_callback);
+    asmart_comm_set_address(&node, NODE_ADDRESS, 0);
+}
+
+/* The controller's last command reaches the node and its response comes straight back */
+static void answer() {
+    asmart_comm_receive_bytes(&node, controller_sent.frame, controller_sent.length);
+    asmart_comm_handler(&node);
+    asmart_comm_receive_bytes(&controller, node_sent.frame, node_sent.length);
+    asmart_comm_handler(&controller);
+}
+
+/* Awaits the given number of echo requests, each with its own payload */
+static asmart::Task echo_flow(uint8_t count) {
+    for (uint8_t i = 0; i < count; i++) {
+        const uint8_t payload[4] = { i, 2, 3, 4 };
+
+        flow.results[i] = co_await asmart::request(&controller, ECHO_COMMAND, payload, sizeof(payload), flow.response, sizeof(flow.response));
+        flow.awaited++;
+        if (flow.results[i].status != REQUEST_DONE) {
+            break;
+        }
+    }
+    flow.finished = true;
+}
+
+static void test_awaited_to_response() {
+    init_pair();
+
+    /* The flow suspends once the command is out */
+    echo_flow(1);
+    CHECK(!flow.finished && controller_sent.count == 1);
+    CHECK(controller.pending_requests != NULL);
+
+    /* The response resumes it from asmart_comm_handler() */
+    answer();
+    CHECK(flow.finished && flow.awaited == 1);
+    CHECK(flow.results[0].status == REQUEST_DONE && flow.results[0].response_length == 4);
+    CHECK(flow.response[0] == 0 && flow.response[3] == 4);
+    CHECK(controller.pending_requests == NULL);
+}
+
+static void test_awaited_to_timeout() {
+    init_pair();
+    echo_flow(1);
+
+    /* No answer: the flow resumes after the last retransmission */
+    for (uint32_t wait = asmart_comm_handler(&controller); !flow.finished; wait = asmart_comm_handler(&controller)) {
+        CHECK(wait != ASMART_COMM_NO_DEADLINE);
+        asmart_test_now_ms += (wait > 0) ? wait : 1;
+    }
+    CHECK(flow.awaited == 1 && flow.results[0].status == REQUEST_TIMEOUT);
+    CHECK(controller_sent.count == 1 + COMMAND_MAX_RETRIES);
+    CHECK(controller.pending_requests == NULL && controller.mapping_table_count == 0);
+}
+
+static void test_awaited_in_sequence() {
+    init_pair();
+
+    /* The second request only goes out once the first has been answered */
+    echo_flow(2);
+    CHECK(controller_sent.count == 1);
+    answer();
+    CHECK(!flow.finished && flow.awaited == 1 && controller_sent.count == 2);
+    answer();
+    CHECK(flow.finished && flow.awaited == 2);
+    CHECK(flow.results[1].status == REQUEST_DONE && flow.response[0] == 1);
+}
+
+int main() {
+    ASMART_TEST_RUN(test_awaited_to_response);
+    ASMART_TEST_RUN(test_awaited_to_timeout);
+    ASMART_TEST_RUN(test_awaited_in_sequence);
+    return asmart_test_result();
+}
@@ -0,0 +1,174 @@
+/*
+ * Bridge: cut-through frames go out ahead of local frames, which are held rather than waited for,
+ * a stalled frame is cut off on a deadline and a slower target port stores instead.
+ */
+#include <string.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#include "asmart_comm_handler.h"
+#include "asmart_test.h"
+
+#define BRIDGE_ADDRESS 0x01
+#define REMOTE_ADDRESS 0x05
+#define NODE_ADDRESS 0x20
+#define TEST_NOTIFICATION 0x30
+
+#if ASMART_COMM_BRIDGE
+// Frames a Handler Sent
+typedef struct {
+    uint8_t frame[TRANSMIT_BUFFER_SIZE];
+    uint16_t length;
+} SentFrame_t;
+
+static aSmart_HostLoop_t loop;
+static aSmart_HostPort_t source_port;
+static aSmart_HostPort_t target_port;
+static aSmart_Comm_Handler_t source;
+static aSmart_Comm_Handler_t target;
+static aSmart_Comm_Handler_t remote;
+static SentFrame_t remote_sent;
+static int source_peer;
+static int target_peer;
+
+static void keep_frame(void* context, uint8_t destination, const uint8_t* frame, uint16_t length) {
+    SentFrame_t* sent = (SentFrame_t*)context;
+
+    (void)destination;
+    memcpy(sent->frame, frame, length);
+    sent->length = length;
+}
+
+static void ignore(uint8_t message_type, uint8_t command_type, uint16_t sequence_number, uint8_t* payload, uint16_t length) {
+    (void)message_type;
+    (void)command_type;
+    (void)sequence_number;
+    (void)payload;
+    (void)length;
+}
+
+/* Two ports on sockets, frames to NODE_ADDRESS received on the source are cut through to the target */
+static void init_bridge(void) {
+    int source_fds[2];
+    int target_fds[2];
+    uint8_t payload[16];
+
+    asmart_test_now_ms = 0;
+    asmart_comm_set_clock(asmart_test_clock);
+    CHECK(asmart_host_loop_init(&loop) == 0);
+    CHECK(socketpair(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK, 0, source_fds) == 0);
+    CHECK(socketpair(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK, 0, target_fds) == 0);
+    CHECK(asmart_host_attach(&loop, &source_port, source_fds[0]) == 0);
+    CHECK(asmart_host_attach(&loop, &target_port, target_fds[0]) == 0);
+    source_peer = source_fds[1];
+    target_peer = target_fds[1];
+
+    asmart_comm_init_port(&source, &source_port, ignore);
+    asmart_comm_set_address(&source, BRIDGE_ADDRESS, 0);
+    asmart_comm_init_port(&target, &target_port, ignore);
+    asmart_comm_set_address(&target, BRIDGE_ADDRESS, 0);
+    asmart_comm_set_peer(&target, NODE_ADDRESS);
+
+    /* The frame that arrives on the source port */
+    memset(&remote_sent, 0, sizeof(remote_sent));
+    asmart_comm_init_transport(&remote, keep_frame, &remote_sent, ignore);
+    asmart_comm_set_address(&remote, REMOTE_ADDRESS, 0);
+    asmart_comm_set_peer(&remote, NODE_ADDRESS);
+    memset(payload, 0xA5, sizeof(payload));
+    asmart_comm_send_notification(&remote, TEST_NOTIFICATION, payload, sizeof(payload));
+    CHECK(remote_sent.length / 2 > FRAME_HEADER_SIZE);
+}
+
+static void close_bridge(void) {
+    asmart_host_loop_close(&loop);
+    close(source_peer);
+    close(target_peer);
+}
+
+static void send_local(void) {
+    uint8_t value = 0x5A;
+    asmart_comm_send_notification(&target, TEST_NOTIFICATION, &value, 1);
+}
+
+static uint16_t read_target_line(uint8_t* data, uint16_t size) {
+    ssize_t length = read(target_peer, data, size);
+    return (length > 0) ? (uint16_t)length : 0;
+}
+
+static void test_local_frame_after_relayed(void) {
+    uint8_t line[2 * TRANSMIT_BUFFER_SIZE];
+    uint16_t half;
+
+    init_bridge();
+    CHECK(asmart_comm_route_to_port(&source, ROUTE_BY_DESTINATION, NODE_ADDRESS, NODE_ADDRESS, &target, FORWARD_CUT_THROUGH));
+    half = remote_sent.length / 2;
+
+    /* Half the frame is relayed, a local send on the port is held and returns at once */
+    asmart_comm_receive_bytes(&source, remote_sent.frame, half);
+    CHECK(target.port_owner == PORT_FORWARDING);
+    send_local();
+    CHECK(target.held_count == 1);
+    CHECK(asmart_comm_handler(&target) == BRIDGE_CUT_THROUGH_TIMEOUT_MS);
+
+    /* The rest arrives: the relayed frame is whole on the line, the local one follows it */
+    asmart_comm_receive_bytes(&source, &remote_sent.frame[half], remote_sent.length - half);
+    CHECK(target.port_owner == PORT_FREE);
+    asmart_comm_handler(&target);
+    CHECK(target.held_count == 0);
+
+    uint16_t length = read_target_line(line, sizeof(line));
+    CHECK(length > remote_sent.length);
+    CHECK(memcmp(line, remote_sent.frame, remote_sent.length) == 0);
+    CHECK(line[remote_sent.length] == remote_sent.frame[0]);
+    CHECK(source.bridge.routes[0].forwarded == 1 && source.bridge.routes[0].truncated == 0);
+    close_bridge();
+}
+
+static void test_stalled_frame_cut_off(void) {
+    uint8_t line[2 * TRANSMIT_BUFFER_SIZE];
+    uint16_t half;
+
+    init_bridge();
+    CHECK(asmart_comm_route_to_port(&source, ROUTE_BY_DESTINATION, NODE_ADDRESS, NODE_ADDRESS, &target, FORWARD_CUT_THROUGH));
+    half = remote_sent.length / 2;
+    asmart_comm_receive_bytes(&source, remote_sent.frame, half);
+    send_local();
+    CHECK(read_target_line(line, sizeof(line)) == half);
+
+    /* The source stops sending: the local frame goes out once the deadline has passed */
+    asmart_test_now_ms += asmart_comm_handler(&target);
+    asmart_comm_handler(&target);
+    CHECK(target.held_count == 0 && target.port_owner == PORT_FREE);
+    CHECK(read_target_line(line, sizeof(line)) > 0 && line[0] == remote_sent.frame[0]);
+
+    /* The late rest of the frame is not relayed into the middle of another */
+    asmart_comm_receive_bytes(&source, &remote_sent.frame[half], remote_sent.length - half);
+    CHECK(read_target_line(line, sizeof(line)) == 0);
+    close_bridge();
+}
+
+static void test_slower_target_stores(void) {
+    init_bridge();
+    source_port.baudrate = 115200;
+    target_port.baudrate = 9600;
+
+    /* A slower line would fall behind the relayed bytes */
+    CHECK(asmart_comm_route_to_port(&source, ROUTE_BY_DESTINATION, NODE_ADDRESS, NODE_ADDRESS, &target, FORWARD_CUT_THROUGH));
+    CHECK(source.bridge.routes[0].mode == FORWARD_STORE);
+
+    /* The other way round it cuts through; an invalid target takes no route */
+    CHECK(asmart_comm_route_to_port(&target, ROUTE_BY_DESTINATION, REMOTE_ADDRESS, REMOTE_ADDRESS, &source, FORWARD_CUT_THROUGH));
+    CHECK(target.bridge.routes[0].mode == FORWARD_CUT_THROUGH);
+    CHECK(!asmart_comm_route_to_port(&source, ROUTE_BY_DESTINATION, REMOTE_ADDRESS, REMOTE_ADDRESS, &source, FORWARD_CUT_THROUGH));
+    CHECK(source.bridge.route_count == 1);
+    close_bridge();
+}
+#endif
+
+int main(void) {
+#if ASMART_COMM_BRIDGE
+    ASMART_TEST_RUN(test_local_frame_after_relayed);
+    ASMART_TEST_RUN(test_stalled_frame_cut_off);
+    ASMART_TEST_RUN(test_slower_target_stores);
+#endif
+    return asmart_test_result();
+}
@@ -0,0 +1,196 @@
+/*
+ * Bulk transfer: blocks or acknowledgements lost on the way are sent again until the image is
+ * complete, and a sender whose receiver went silent gives up after its probes.
+ */
+#include <string.h>
+#include "asmart_comm_handler.h"
+#include "asmart_test.h"
+
+#define SENDER_ADDRESS 0x02
+#define RECEIVER_ADDRESS 0x10
+#define QUEUED_FRAMES 64
+#define IMAGE_SIZE (3 * BULK_PAGE_SIZE + 100)  // Ends in a short page
+#define MAX_STEPS 100000
+
+#if ASMART_COMM_BULK
+// Frames a Handler Sent, not delivered yet
+typedef struct {
+    uint8_t frame[QUEUED_FRAMES][TRANSMIT_BUFFER_SIZE];
+    uint16_t length[QUEUED_FRAMES];
+    uint8_t count;
+    uint32_t total;
+} SentFrames_t;
+
+// Frames Lost on the Way
+typedef struct {
+    uint32_t every;  // Each such frame is lost, 0 for none
+    uint32_t after;  // Frames delivered before losses start
+    uint8_t all;  // The line is cut
+    uint32_t seen;
+    uint32_t lost;
+} Loss_t;
+
+// Side of a Transfer
+typedef struct {
+    aSmart_Comm_Handler_t handler;
+    SentFrames_t sent;
+    uint8_t done;
+    uint8_t status;
+} BulkNode_t;
+
+static BulkNode_t sender;
+static BulkNode_t receiver;
+static aSmart_BulkTx_t bulk_tx;
+static aSmart_BulkRx_t bulk_rx;
+static uint8_t image[IMAGE_SIZE];
+static uint8_t copy[IMAGE_SIZE];
+
+static void keep_frame(void* context, uint8_t destination, const uint8_t* frame, uint16_t length) {
+    SentFrames_t* sent = (SentFrames_t*)context;
+
+    (void)destination;
+    if (sent->count < QUEUED_FRAMES) {
+        memcpy(sent->frame[sent->count], frame, length);
+        sent->length[sent->count++] = length;
+    }
+    sent->total++;
+}
+
+static void ignore(uint8_t message_type, uint8_t command_type, uint16_t sequence_number, uint8_t* payload, uint16_t length) {
+    (void)message_type;
+    (void)command_type;
+    (void)sequence_number;
+    (void)payload;
+    (void)length;
+}
+
+static uint8_t image_source(void* context, uint32_t offset, uint8_t* data, uint16_t length) {
+    (void)context;
+    memcpy(data, &image[offset], length);
+    return 1;
+}
+
+static uint8_t copy_sink(void* context, uint32_t offset, const uint8_t* data, uint16_t length) {
+    (void)context;
+    memcpy(&copy[offset], data, length);
+    return 1;
+}
+
+static void transfer_done(void* context, uint8_t status) {
+    BulkNode_t* node = (BulkNode_t*)context;
+
+    node->done = 1;
+    node->status = status;
+}
+
+static void init_transfer(void) {
+    asmart_test_now_ms = 0;
+    asmart_comm_set_clock(asmart_test_clock);
+    memset(&sender, 0, sizeof(sender));
+    memset(&receiver, 0, sizeof(receiver));
+    memset(copy, 0, sizeof(copy));
+    for (uint32_t i = 0; i < IMAGE_SIZE; i++) {
+        image[i] = (uint8_t)(i * 31 + (i >> 8));
+    }
+    asmart_comm_init_transport(&sender.handler, keep_frame, &sender.sent, ignore);
+    asmart_comm_set_address(&sender.handler, SENDER_ADDRESS, 0);
+    asmart_comm_set_peer(&sender.handler, RECEIVER_ADDRESS);
+    asmart_comm_init_transport(&receiver.handler, keep_frame, &receiver.sent, ignore);
+    asmart_comm_set_address(&receiver.handler, RECEIVER_ADDRESS, 0);
+    asmart_comm_bulk_receive(&receiver.handler, &bulk_rx, copy_sink, transfer_done, &receiver);
+    CHECK(asmart_comm_bulk_send(&sender.handler, &bulk_tx, RECEIVER_ADDRESS, IMAGE_SIZE, asmart_bulk_crc32(0, image, IMAGE_SIZE), image_source, transfer_done, &sender));
+}
+
+/* Frames sent so far arrive one by one, unless lost, each dispatched before the next fills a slot */
+static uint8_t deliver(SentFrames_t* sent, Loss_t* loss, aSmart_Comm_Handler_t* receiving) {
+    uint8_t delivered = sent->count;
+
+    for (uint8_t i = 0; i < sent->count; i++) {
+        loss->seen++;
+        if (loss->all || (loss->every != 0 && loss->seen > loss->after && loss->seen % loss->every == 0)) {
+            loss->lost++;
+            continue;
+        }
+        asmart_comm_receive_bytes(receiving, sent->frame[i], sent->length[i]);
+        asmart_comm_handler(receiving);
+    }
+    sent->count = 0;
+    return delivered;
+}
+
+/* Both handlers run, and the time moves to the next deadline whenever nothing is on the line */
+static void run_transfer(Loss_t* to_receiver, Loss_t* to_sender) {
+    for (uint32_t step = 0; step < MAX_STEPS && !sender.done; step++) {
+        uint32_t wait = asmart_comm_handler(&sender.handler);
+        uint8_t moved = deliver(&sender.sent, to_receiver, &receiver.handler);
+
+        moved += deliver(&receiver.sent, to_sender, &sender.handler);
+        if (!moved) {
+            uint32_t receiver_wait = asmart_comm_handler(&receiver.handler);
+
+            if (receiver_wait < wait) {
+                wait = receiver_wait;
+            }
+            CHECK(wait != ASMART_COMM_NO_DEADLINE);
+            asmart_test_now_ms += (wait > 0) ? wait : 1;
+        }
+    }
+}
+
+static void test_lost_blocks_sent_again(void) {
+    Loss_t to_receiver = { .every = 7, .after = 2 };
+    Loss_t to_sender = { 0 };
+
+    init_transfer();
+    run_transfer(&to_receiver, &to_sender);
+    CHECK(sender.done && sender.status == BULK_OK);
+    CHECK(receiver.done && receiver.status == BULK_OK);
+    CHECK(memcmp(copy, image, IMAGE_SIZE) == 0);
+
+    /* Only what was lost went again, not the whole window */
+    CHECK(to_receiver.lost > 0);
+    CHECK(sender.sent.total > bulk_tx.block_count);
+    CHECK(sender.sent.total <= bulk_tx.block_count + 2 * to_receiver.lost + 4);
+}
+
+static void test_lost_acknowledgements(void) {
+    Loss_t to_receiver = { 0 };
+    Loss_t to_sender = { .every = 3, .after = 1 };
+
+    init_transfer();
+    run_transfer(&to_receiver, &to_sender);
+    CHECK(to_sender.lost > 0);
+    CHECK(sender.done && sender.status == BULK_OK);
+    CHECK(receiver.done && receiver.status == BULK_OK);
+    CHECK(memcmp(copy, image, IMAGE_SIZE) == 0);
+}
+
+static void test_silent_receiver_times_out(void) {
+    Loss_t to_receiver = { 0 };
+    Loss_t to_sender = { 0 };
+
+    init_transfer();
+
+    /* Open answered, then the line is cut before the blocks go out */
+    for (uint8_t i = 0; i < 4 && bulk_tx.state != BULK_STREAMING; i++) {
+        asmart_comm_handler(&sender.handler);
+        deliver(&sender.sent, &to_receiver, &receiver.handler);
+        deliver(&receiver.sent, &to_sender, &sender.handler);
+    }
+    CHECK(bulk_tx.state == BULK_STREAMING);
+    to_receiver.all = 1;
+    to_sender.all = 1;
+    run_transfer(&to_receiver, &to_sender);
+    CHECK(sender.done && sender.status == BULK_TIMEOUT);
+    CHECK(bulk_tx.probes >= BULK_MAX_PROBES);
+}
+#endif
+
+int main(void) {
+#if ASMART_COMM_BULK
+    ASMART_TEST_RUN(test_lost_blocks_sent_again);
+    ASMART_TEST_RUN(test_lost_acknowledgements);
+    ASMART_TEST_RUN(test_silent_receiver_times_out);
+#endif
+    return asmart_test_result();
+}
@@ -0,0 +1,309 @@
+/*
+ * CAN-FD transport on the simulated bus: ISO-TP single and segmented messages, flow control with
+ * block size and separation time, broadcasts without flow control, and the messages a lost
+ * frame, a silent receiver or a full receiver end.
+ */
+#include <string.h>
+#include "asmart_comm_cansim.h"
+#include "asmart_test.h"
+
+#define CONTROLLER_ADDRESS 0x01
+#define NODE_ADDRESS 0x10
+#define ABSENT_ADDRESS 0x20  // No controller on the bus answers it
+#define TEST_NOTIFICATION 0x30
+#define IDLE_NS 100000  // Time that passes while no controller has a frame
+#define LOGGED_FRAMES 64
+#define FIRST_DATA (CAN_MAX_DATA - 2)  // Message bytes in a first frame with a 12-bit length
+#define CONSECUTIVE_DATA (CAN_MAX_DATA - 1)  // Message bytes in a consecutive frame
+#define NODE_STMIN_MS 5
+
+// Frame a Link Handed to Its Controller
+typedef struct {
+    uint8_t from_node;
+    uint8_t pci;  // First data byte
+    uint8_t length;
+    uint32_t ms;  // Bus time it was queued
+} LoggedFrame_t;
+
+// Node on the Bus
+typedef struct {
+    aSmart_Comm_Handler_t handler;
+    aSmart_CanLink_t link;
+    aSmart_CanSimNode_t can;
+} TestNode_t;
+
+static aSmart_CanSimBus_t bus;
+static TestNode_t controller;
+static TestNode_t node;
+static LoggedFrame_t logged[LOGGED_FRAMES];
+static uint8_t logged_count;
+static uint8_t received[TRANSMIT_BUFFER_SIZE];
+static uint16_t received_length;
+static uint32_t notifications;
+
+/* Queues the frame on the simulated controller and notes it */
+static uint8_t logged_write(void* driver, const aSmart_CanFrame_t* frame) {
+    if (!asmart_cansim_write(driver, frame)) {
+        return 0;
+    }
+    if (logged_count < LOGGED_FRAMES) {
+        LoggedFrame_t* entry = &logged[logged_count++];
+        entry->from_node = (driver == &node.can);
+        entry->pci = frame->data[0];
+        entry->length = frame->length;
+        entry->ms = asmart_cansim_clock();
+    }
+    return 1;
+}
+
+static void node_callback(uint8_t message_type, uint8_t command_type, uint16_t sequence_number, uint8_t* payload, uint16_t length) {
+    (void)sequence_number;
+
+    if (message_type == MSG_TYPE_NOTIFICATION && command_type == TEST_NOTIFICATION) {
+        memcpy(received, payload, length);
+        received_length = length;
+        notifications++;
+    }
+}
+
+static void ignore(uint8_t message_type, uint8_t command_type, uint16_t sequence_number, uint8_t* payload, uint16_t length) {
+    (void)message_type;
+    (void)command_type;
+    (void)sequence_number;
+    (void)payload;
+    (void)length;
+}
+
+static void setup_node(TestNode_t* test_node, uint8_t address, ResponseCallback callback) {
+    memset(test_node, 0, sizeof(*test_node));
+    asmart_can_init(&test_node->link, &test_node->handler, logged_write, &test_node->can, callback);
+    asmart_cansim_attach(&bus, &test_node->can, &test_node->link);
+    asmart_can_set_address(&test_node->link, address, 0);
+}
+
+/* A controller and a node on a 500 kbit/s bus, 2 Mbit/s in the data phase */
+static void init_bus(void) {
+    asmart_cansim_init(&bus, 500000, 2000000);
+    asmart_comm_set_clock(asmart_cansim_clock);
+    setup_node(&controller, CONTROLLER_ADDRESS, ignore);
+    setup_node(&node, NODE_ADDRESS, node_callback);
+    asmart_comm_set_peer(&controller.handler, NODE_ADDRESS);
+    logged_count = 0;
+    received_length = 0;
+    notifications = 0;
+}
+
+/* Both nodes run their main loop while the bus carries what they send */
+static void run_for(uint32_t ms) {
+    uint64_t end_ns = bus.now_ns + (uint64_t)ms * 1000000ULL;
+
+    while (bus.now_ns < end_ns) {
+        asmart_comm_handler(&controller.handler);
+        asmart_can_service(&controller.link);
+        asmart_comm_handler(&node.handler);
+        asmart_can_service(&node.link);
+        if (!asmart_cansim_step(&bus)) {
+            asmart_cansim_advance(&bus, IDLE_NS);
+        }
+    }
+}
+
+/* Sends a notification of the given length, its bytes counting up */
+static uint16_t send_payload(uint8_t destination, uint16_t length) {
+    uint8_t payload[ASMART_COMM_MAX_PAYLOAD];
+
+    for (uint16_t i = 0; i < length; i++) {
+        payload[i] = (uint8_t)i;
+    }
+    asmart_comm_send_notification_to(&controller.handler, destination, TEST_NOTIFICATION, payload, length);
+    return FRAME_HEADER_SIZE + length + FRAME_TRAILER_SIZE;
+}
+
+static uint8_t payload_received(uint16_t length) {
+    if (received_length != length) {
+        return 0;
+    }
+    for (uint16_t i = 0; i < length; i++) {
+        if (received[i] != (uint8_t)i) {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+static uint8_t count_logged(uint8_t from_node, uint8_t pci) {
+    uint8_t count = 0;
+
+    for (uint8_t i = 0; i < logged_count; i++) {
+        if (logged[i].from_node == from_node && (logged[i].pci & 0xF0) == pci) {
+            count++;
+        }
+    }
+    return count;
+}
+
+static uint8_t consecutive_frames(uint16_t message_length) {
+    return (uint8_t)((message_length - FIRST_DATA + CONSECUTIVE_DATA - 1) / CONSECUTIVE_DATA);
+}
+
+/* A first frame of a message of the given length from the given source, to the node */
+static void first_frame(aSmart_CanFrame_t* frame, uint8_t source, uint16_t length) {
+    frame->id = CAN_ID(CAN_ID_PHYSICAL, NODE_ADDRESS, source);
+    frame->length = CAN_MAX_DATA;
+    frame->data[0] = CAN_PCI_FIRST | (uint8_t)(length >> 8);
+    frame->data[1] = (uint8_t)length;
+    memset(&frame->data[2], 0x11, CAN_MAX_DATA - 2);
+}
+
+static void test_single_frame(void) {
+    init_bus();
+
+    /* Longer than a classic frame: the length goes in the second byte */
+    uint16_t message_length = send_payload(NODE_ADDRESS, 20);
+    run_for(10);
+    CHECK(message_length > CAN_CLASSIC_DATA - 1 && message_length <= CAN_SINGLE_MAX);
+    CHECK(logged_count == 1 && logged[0].pci == CAN_PCI_SINGLE && logged[0].length >= message_length + 2);
+    CHECK(notifications == 1 && payload_received(20));
+    CHECK(controller.link.tx_messages == 1 && node.link.rx_messages == 1);
+}
+
+static void test_segmented_message(void) {
+    init_bus();
+
+    /* The largest frame: a first frame, one flow control, then consecutive frames counting from 1 */
+    uint16_t message_length = send_payload(NODE_ADDRESS, ASMART_COMM_MAX_PAYLOAD);
+    run_for(20);
+    CHECK(logged[0].from_node == 0 && logged[0].pci == (CAN_PCI_FIRST | (message_length >> 8)));
+    CHECK(logged[1].from_node == 1 && logged[1].pci == (CAN_PCI_FLOW | CAN_FLOW_CTS));
+    CHECK(logged_count == 2 + consecutive_frames(message_length));
+    for (uint8_t i = 2; i < logged_count; i++) {
+        CHECK(logged[i].from_node == 0 && logged[i].pci == (CAN_PCI_CONSECUTIVE | ((i - 1) & 0x0F)));
+    }
+    CHECK(notifications == 1 && payload_received(ASMART_COMM_MAX_PAYLOAD));
+    CHECK(controller.link.tx_drops == 0 && node.link.rx_drops == 0);
+}
+
+static void test_block_size(void) {
+    init_bus();
+    node.link.block_size = 1;
+
+    /* A flow control after the first frame and after every consecutive frame but the last */
+    uint16_t message_length = send_payload(NODE_ADDRESS, ASMART_COMM_MAX_PAYLOAD);
+    uint8_t frames = consecutive_frames(message_length);
+    run_for(20);
+    CHECK(frames >= 2);
+    CHECK(count_logged(1, CAN_PCI_FLOW) == frames);
+    CHECK(count_logged(0, CAN_PCI_CONSECUTIVE) == frames);
+    CHECK(notifications == 1 && payload_received(ASMART_COMM_MAX_PAYLOAD));
+}
+
+static void test_separation_time(void) {
+    init_bus();
+    node.link.stmin = NODE_STMIN_MS;
+
+    /* Consecutive frames are at least the separation time apart */
+    uint16_t message_length = send_payload(NODE_ADDRESS, ASMART_COMM_MAX_PAYLOAD);
+    uint8_t frames = consecutive_frames(message_length);
+    run_for(20 + frames * NODE_STMIN_MS);
+    CHECK(count_logged(1, CAN_PCI_FLOW) == 1);
+    CHECK(count_logged(0, CAN_PCI_CONSECUTIVE) == frames);
+    uint32_t last_ms = 0;
+    uint8_t seen = 0;
+    for (uint8_t i = 0; i < logged_count; i++) {
+        if (!logged[i].from_node && (logged[i].pci & 0xF0) == CAN_PCI_CONSECUTIVE) {
+            CHECK(seen == 0 || logged[i].ms - last_ms >= NODE_STMIN_MS);
+            last_ms = logged[i].ms;
+            seen++;
+        }
+    }
+    CHECK(notifications == 1 && payload_received(ASMART_COMM_MAX_PAYLOAD));
+}
+
+static void test_broadcast_without_flow_control(void) {
+    init_bus();
+
+    /* Functional addressing: the consecutive frames follow the first without flow control */
+    uint16_t message_length = send_payload(ADDRESS_BROADCAST, ASMART_COMM_MAX_PAYLOAD);
+    run_for(20);
+    CHECK(count_logged(1, CAN_PCI_FLOW) == 0);
+    CHECK(logged_count == 1 + consecutive_frames(message_length));
+    CHECK(notifications == 1 && payload_received(ASMART_COMM_MAX_PAYLOAD));
+}
+
+static void test_lost_consecutive_frame(void) {
+    aSmart_CanFrame_t frame;
+
+    init_bus();
+    first_frame(&frame, CONTROLLER_ADDRESS, FIRST_DATA + CONSECUTIVE_DATA + 1);
+    asmart_can_receive(&node.link, &frame);
+    CHECK(node.link.rx[0].source == CONTROLLER_ADDRESS);
+
+    /* Consecutive frame 2 arrives without 1: the message is dropped and its channel freed */
+    frame.data[0] = CAN_PCI_CONSECUTIVE | 2;
+    asmart_can_receive(&node.link, &frame);
+    CHECK(node.link.rx_drops == 1 && node.link.rx[0].source == ADDRESS_UNASSIGNED);
+    run_for(10);
+    CHECK(notifications == 0 && node.link.rx_messages == 0);
+}
+
+static void test_stalled_message_expires(void) {
+    aSmart_CanFrame_t frame;
+
+    init_bus();
+
+    /* The receiver waits for the next consecutive frame (N_Cr) on its deadline */
+    first_frame(&frame, CONTROLLER_ADDRESS, FIRST_DATA + CONSECUTIVE_DATA);
+    asmart_can_receive(&node.link, &frame);
+    uint32_t wait = asmart_can_service(&node.link);
+    CHECK(wait > 0 && wait <= CAN_TIMEOUT_MS);
+
+    /* The sender waits for a flow control (N_Bs) from a node that is not there */
+    send_payload(ABSENT_ADDRESS, ASMART_COMM_MAX_PAYLOAD);
+    run_for(10);
+    CHECK(controller.link.tx_state == CAN_TX_WAIT_FLOW);
+    CHECK(asmart_can_service(&controller.link) <= CAN_TIMEOUT_MS);
+
+    /* Both give up once the timeout has passed */
+    run_for(CAN_TIMEOUT_MS);
+    CHECK(node.link.rx_drops == 1 && node.link.rx[0].source == ADDRESS_UNASSIGNED);
+    CHECK(controller.link.tx_drops == 1 && controller.link.tx_state == CAN_TX_IDLE && controller.link.queue_count == 0);
+}
+
+static void test_overflow(void) {
+    aSmart_CanFrame_t frame;
+
+    init_bus();
+
+    /* Longer than the receive buffer: the node refuses it */
+    first_frame(&frame, CONTROLLER_ADDRESS, RECEIVE_BUFFER_SIZE + 1);
+    asmart_can_receive(&node.link, &frame);
+    CHECK(node.link.rx_drops == 1 && node.link.rx[0].source == ADDRESS_UNASSIGNED);
+    CHECK(logged_count == 1 && logged[0].from_node && logged[0].pci == (CAN_PCI_FLOW | CAN_FLOW_OVERFLOW));
+
+    /* A sender told so drops the message and goes on with the next one */
+    send_payload(ABSENT_ADDRESS, ASMART_COMM_MAX_PAYLOAD);
+    send_payload(NODE_ADDRESS, 4);
+    run_for(10);
+    CHECK(controller.link.tx_state == CAN_TX_WAIT_FLOW);
+    frame.id = CAN_ID(CAN_ID_PHYSICAL, CONTROLLER_ADDRESS, ABSENT_ADDRESS);
+    frame.length = CAN_CLASSIC_DATA;
+    frame.data[0] = CAN_PCI_FLOW | CAN_FLOW_OVERFLOW;
+    frame.data[1] = 0;
+    frame.data[2] = 0;
+    asmart_can_receive(&controller.link, &frame);
+    CHECK(controller.link.tx_drops == 1);
+    run_for(10);
+    CHECK(notifications == 1 && payload_received(4));
+}
+
+int main(void) {
+    ASMART_TEST_RUN(test_single_frame);
+    ASMART_TEST_RUN(test_segmented_message);
+    ASMART_TEST_RUN(test_block_size);
+    ASMART_TEST_RUN(test_separation_time);
+    ASMART_TEST_RUN(test_broadcast_without_flow_control);
+    ASMART_TEST_RUN(test_lost_consecutive_frame);
+    ASMART_TEST_RUN(test_stalled_message_expires);
+    ASMART_TEST_RUN(test_overflow);
+    return asmart_test_result();
+}
@@ -0,0 +1,221 @@
+/*
+ * Frame capture and replay: the traffic of a controller and a node is recorded to a file, read
+ * back record by record, and replayed into fresh handlers, which count what was dispatched
+ * apart from what reached the callback.
+ */
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "asmart_comm_handler.h"
+#include "asmart_comm_capture.h"
+#include "asmart_test.h"
+
+#define CONTROLLER_ADDRESS 0x01
+#define NODE_ADDRESS 0x10
+#define ECHO_COMMAND 0x10
+#define TEST_NOTIFICATION 0x30
+#define TEST_COMMANDS 4  // All pending at once in the smallest command table
+#define TEST_NOTIFICATIONS 3
+#define CONTROLLER_PORT 0
+#define NODE_PORT 1
+
+#if TEST_COMMANDS > MAPPING_TABLE_ENTRIES
+#error "TEST_COMMANDS must fit the command table"
+#endif
+
+// Last Frame a Handler Sent
+typedef struct {
+    uint8_t frame[TRANSMIT_BUFFER_SIZE];
+    uint16_t length;
+    uint32_t count;
+} SentFrames_t;
+
+// Messages that Reached a Callback, per type
+typedef struct {
+    uint32_t commands;
+    uint32_t responses;
+    uint32_t notifications;
+} Received_t;
+
+static aSmart_Comm_Handler_t controller;
+static aSmart_Comm_Handler_t node;
+static SentFrames_t controller_sent;
+static SentFrames_t node_sent;
+static Received_t controller_received;
+static Received_t node_received;
+static char capture_path[] = "/tmp/asmart_capture_XXXXXX";
+
+static void keep_frame(void* context, uint8_t destination, const uint8_t* frame, uint16_t length) {
+    SentFrames_t* sent = (SentFrames_t*)context;
+
+    (void)destination;
+    memcpy(sent->frame, frame, length);
+    sent->length = length;
+    sent->count++;
+}
+
+static void count(Received_t* received, uint8_t message_type) {
+    if (message_type == MSG_TYPE_COMMAND) {
+        received->commands++;
+    }
+    else if (message_type == MSG_TYPE_RESPONSE) {
+        received->responses++;
+    }
+    else if (message_type == MSG_TYPE_NOTIFICATION) {
+        received->notifications++;
+    }
+}
+
+static void node_callback(uint8_t message_type, uint8_t command_type, uint16_t sequence_number, uint8_t* payload, uint16_t length) {
+    count(&node_received, message_type);
+    if (message_type == MSG_TYPE_COMMAND) {
+        asmart_comm_send_response(&node, sequence_number, command_type, payload, length);
+    }
+}
+
+static void controller_callback(uint8_t message_type, uint8_t command_type, uint16_t sequence_number, uint8_t* payload, uint16_t length) {
+    (void)command_type;
+    (void)sequence_number;
+    (void)payload;
+    (void)length;
+
+    count(&controller_received, message_type);
+}
+
+/* Fresh handlers with a frozen clock, nothing received yet */
+static void init_pair(void) {
+    asmart_test_now_ms = 0;
+    asmart_comm_set_clock(asmart_test_clock);
+    memset(&controller_sent, 0, sizeof(controller_sent));
+    memset(&node_sent, 0, sizeof(node_sent));
+    memset(&controller_received, 0, sizeof(controller_received));
+    memset(&node_received, 0, sizeof(node_received));
+    asmart_comm_init_transport(&controller, keep_frame, &controller_sent, controller_callback);
+    asmart_comm_set_address(&controller, CONTROLLER_ADDRESS, 0);
+    asmart_comm_set_peer(&controller, NODE_ADDRESS);
+    asmart_comm_init_transport(&node, keep_frame, &node_sent, node_callback);
+    asmart_comm_set_address(&node, NODE_ADDRESS, 0);
+    asmart_comm_set_peer(&node, CONTROLLER_ADDRESS);
+}
+
+/* The last frame sent arrives at the other handler, which runs */
+static void pass(SentFrames_t* sent, aSmart_Comm_Handler_t* receiver) {
+    asmart_comm_receive_bytes(receiver, sent->frame, sent->length);
+    asmart_comm_handler(receiver);
+}
+
+static void send_commands(void) {
+    for (uint8_t i = 0; i < TEST_COMMANDS; i++) {
+        asmart_comm_send_command(&controller, ECHO_COMMAND, &i, 1);
+        pass(&controller_sent, &node);
+        pass(&node_sent, &controller);
+    }
+}
+
+/* Commands answered by the node and notifications from it, both sides recorded */
+static void record_traffic(void) {
+    aSmart_CaptureWriter_t writer;
+    aSmart_CaptureTap_t controller_tap;
+    aSmart_CaptureTap_t node_tap;
+
+    init_pair();
+    CHECK(asmart_capture_create(&writer, capture_path) == 0);
+    asmart_capture_tap(&controller_tap, &writer, &controller, CONTROLLER_PORT);
+    asmart_capture_tap(&node_tap, &writer, &node, NODE_PORT);
+
+    send_commands();
+    for (uint8_t i = 0; i < TEST_NOTIFICATIONS; i++) {
+        asmart_comm_send_notification(&node, TEST_NOTIFICATION, &i, 1);
+        pass(&node_sent, &controller);
+    }
+
+    asmart_comm_set_capture(&controller, NULL, NULL);
+    asmart_comm_set_capture(&node, NULL, NULL);
+    CHECK(asmart_capture_close(&writer) == 0);
+}
+
+static void test_records_read_back(void) {
+    aSmart_CaptureReader_t reader;
+
+    record_traffic();
+    CHECK(controller_received.responses == TEST_COMMANDS && controller_received.notifications == TEST_NOTIFICATIONS);
+    CHECK(asmart_capture_open(&reader, capture_path) == 0);
+
+    /* Every frame twice, as sent and as received; a frame is recorded the same on both sides */
+    CHECK(reader.count == 2u * (2 * TEST_COMMANDS + TEST_NOTIFICATIONS));
+    uint64_t last_time = 0;
+    for (uint64_t i = 0; i + 1 < reader.count; i += 2) {
+        const aSmart_CaptureRecord_t* sent = asmart_capture_record(&reader, i);
+        const aSmart_CaptureRecord_t* received = asmart_capture_record(&reader, i + 1);
+
+        CHECK(sent != NULL && received != NULL);
+        CHECK(sent->direction == CAPTURE_TX && received->direction == CAPTURE_RX && sent->port != received->port);
+        CHECK(sent->length == received->length && memcmp(sent + 1, received + 1, sent->length) == 0);
+        CHECK(sent->time_ns >= last_time && received->time_ns >= sent->time_ns);
+        last_time = received->time_ns;
+    }
+    CHECK(asmart_capture_record(&reader, reader.count) == NULL);
+    asmart_capture_unmap(&reader);
+    unlink(capture_path);
+}
+
+static void test_replay_commands(void) {
+    aSmart_CaptureReader_t reader;
+    aSmart_ReplayStats_t stats = { 0, 0 };
+
+    record_traffic();
+    CHECK(asmart_capture_open(&reader, capture_path) == 0);
+
+    /* The commands the node received reach a fresh node's callback again, which answers them */
+    init_pair();
+    asmart_capture_replay(&reader, &node, NODE_PORT, CAPTURE_RX, 0, 0, &stats);
+    asmart_capture_unmap(&reader);
+    unlink(capture_path);
+
+    CHECK(stats.frames == TEST_COMMANDS && stats.delivered == TEST_COMMANDS);
+    CHECK(node_received.commands == TEST_COMMANDS && node_sent.count == TEST_COMMANDS);
+    CHECK(node.response_callback == node_callback);
+}
+
+static void test_replay_responses(void) {
+    aSmart_CaptureReader_t reader;
+    aSmart_ReplayStats_t stats = { 0, 0 };
+
+    record_traffic();
+    CHECK(asmart_capture_open(&reader, capture_path) == 0);
+
+    /* A fresh controller has none of the commands pending: the responses parse but go nowhere */
+    init_pair();
+    asmart_capture_replay(&reader, &controller, CONTROLLER_PORT, CAPTURE_RX, 0, 0, &stats);
+    CHECK(stats.frames == TEST_COMMANDS + TEST_NOTIFICATIONS && stats.delivered == TEST_NOTIFICATIONS);
+    CHECK(controller_received.responses == 0 && controller_received.notifications == TEST_NOTIFICATIONS);
+
+    /* Sent the same commands again, with the same sequence numbers, it takes the recorded answers */
+    init_pair();
+    for (uint8_t i = 0; i < TEST_COMMANDS; i++) {
+        asmart_comm_send_command(&controller, ECHO_COMMAND, &i, 1);
+    }
+    memset(&stats, 0, sizeof(stats));
+    asmart_capture_replay(&reader, &controller, CONTROLLER_PORT, CAPTURE_RX, 0, 0, &stats);
+    asmart_capture_unmap(&reader);
+    unlink(capture_path);
+
+    CHECK(stats.frames == TEST_COMMANDS + TEST_NOTIFICATIONS && stats.delivered == TEST_COMMANDS + TEST_NOTIFICATIONS);
+    CHECK(controller_received.responses == TEST_COMMANDS && controller.mapping_table_count == 0);
+}
+
+int main(void) {
+    int fd = mkstemp(capture_path);
+
+    if (fd < 0) {
+        perror(capture_path);
+        return 1;
+    }
+    close(fd);
+
+    ASMART_TEST_RUN(test_records_read_back);
+    ASMART_TEST_RUN(test_replay_commands);
+    ASMART_TEST_RUN(test_replay_responses);
+    unlink(capture_path);
+    return asmart_test_result();
+}
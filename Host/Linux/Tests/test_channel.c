@@ -0,0 +1,221 @@
+/*
+ * Logical channels: the channel number in bits 4..5 of the Message Type byte, frames reaching the
+ * callback of their channel, responses on the channel of the command, and a closed channel.
+ */
+#include <string.h>
+#include "asmart_comm_handler.h"
+#include "asmart_test.h"
+
+#if ASMART_COMM_CHANNELS > 1
+#define CONTROLLER_ADDRESS 0x01
+#define NODE_ADDRESS 0x10
+#define ECHO_COMMAND 0x10
+#define TEST_NOTIFICATION 0x30
+#define RX_WINDOW 2
+#define LINK_FRAMES 16  // Frames a direction of the link holds until pumped
+#define TYPE_BYTE 7  // Offset of the Message Type byte in a standard frame
+
+// Frames in Flight in One Direction
+typedef struct {
+    uint8_t frames[LINK_FRAMES][TRANSMIT_BUFFER_SIZE];
+    uint16_t lengths[LINK_FRAMES];
+    uint8_t count;
+    uint8_t type_bytes[LINK_FRAMES];  // Message Type byte of every frame sent
+    uint8_t sent;
+} LinkFrames_t;
+
+// What a Channel Callback Saw
+typedef struct {
+    uint32_t notifications;
+    uint32_t commands;
+    uint32_t responses;
+    uint16_t last_sequence_number;
+} ChannelLog_t;
+
+static aSmart_Comm_Handler_t controller;
+static aSmart_Comm_Handler_t node;
+static LinkFrames_t to_node;
+static LinkFrames_t to_controller;
+static ChannelLog_t node_log[ASMART_COMM_CHANNELS];
+static ChannelLog_t controller_log[ASMART_COMM_CHANNELS];
+
+static void queue_frame(void* context, uint8_t destination, const uint8_t* frame, uint16_t length) {
+    LinkFrames_t* link = (LinkFrames_t*)context;
+
+    (void)destination;
+    if (link->sent < LINK_FRAMES) {
+        link->type_bytes[link->sent++] = frame[TYPE_BYTE];
+    }
+    if (link->count < LINK_FRAMES) {
+        memcpy(link->frames[link->count], frame, length);
+        link->lengths[link->count++] = length;
+    }
+}
+
+static void log_message(ChannelLog_t* log, uint8_t message_type, uint16_t sequence_number) {
+    if (message_type == MSG_TYPE_NOTIFICATION) {
+        log->notifications++;
+    }
+    else if (message_type == MSG_TYPE_COMMAND) {
+        log->commands++;
+    }
+    else if (message_type == MSG_TYPE_RESPONSE) {
+        log->responses++;
+    }
+    log->last_sequence_number = sequence_number;
+}
+
+/* Node: one callback for channels 1..n, the response callback for channel 0; commands are echoed */
+static void node_channel_callback(uint8_t channel, uint8_t message_type, uint8_t command_type, uint16_t sequence_number, uint8_t* payload, uint16_t length) {
+    log_message(&node_log[channel], message_type, sequence_number);
+    if (message_type == MSG_TYPE_COMMAND) {
+        asmart_comm_send_response(&node, sequence_number, command_type, payload, length);
+    }
+}
+
+static void node_callback(uint8_t message_type, uint8_t command_type, uint16_t sequence_number, uint8_t* payload, uint16_t length) {
+    node_channel_callback(0, message_type, command_type, sequence_number, payload, length);
+}
+
+static void controller_channel_callback(uint8_t channel, uint8_t message_type, uint8_t command_type, uint16_t sequence_number, uint8_t* payload, uint16_t length) {
+    (void)command_type;
+    (void)payload;
+    (void)length;
+    log_message(&controller_log[channel], message_type, sequence_number);
+}
+
+static void controller_callback(uint8_t message_type, uint8_t command_type, uint16_t sequence_number, uint8_t* payload, uint16_t length) {
+    controller_channel_callback(0, message_type, command_type, sequence_number, payload, length);
+}
+
+/* Hands every frame in flight to the other end and runs both handlers until the link is quiet */
+static void pump(void) {
+    for (uint8_t round = 0; round < LINK_FRAMES; round++) {
+        asmart_comm_handler(&controller);
+        asmart_comm_handler(&node);
+        if (to_node.count == 0 && to_controller.count == 0) {
+            return;
+        }
+        for (uint8_t i = 0; i < to_node.count; i++) {
+            asmart_comm_receive_bytes(&node, to_node.frames[i], to_node.lengths[i]);
+        }
+        to_node.count = 0;
+        for (uint8_t i = 0; i < to_controller.count; i++) {
+            asmart_comm_receive_bytes(&controller, to_controller.frames[i], to_controller.lengths[i]);
+        }
+        to_controller.count = 0;
+    }
+}
+
+/* Both ends open channels 1..n and grant each other their window */
+static void init_pair(void) {
+    asmart_test_now_ms = 0;
+    asmart_comm_set_clock(asmart_test_clock);
+    memset(&to_node, 0, sizeof(to_node));
+    memset(&to_controller, 0, sizeof(to_controller));
+    memset(node_log, 0, sizeof(node_log));
+    memset(controller_log, 0, sizeof(controller_log));
+    asmart_comm_init_transport(&controller, queue_frame, &to_node, controller_callback);
+    asmart_comm_set_address(&controller, CONTROLLER_ADDRESS, 0);
+    asmart_comm_set_peer(&controller, NODE_ADDRESS);
+    asmart_comm_init_transport(&node, queue_frame, &to_controller, node_callback);
+    asmart_comm_set_address(&node, NODE_ADDRESS, 0);
+    asmart_comm_set_peer(&node, CONTROLLER_ADDRESS);
+    for (uint8_t channel = 1; channel < ASMART_COMM_CHANNELS; channel++) {
+        asmart_comm_channel_open(&controller, channel, NODE_ADDRESS, RX_WINDOW, controller_channel_callback);
+        asmart_comm_channel_open(&node, channel, CONTROLLER_ADDRESS, RX_WINDOW, node_channel_callback);
+    }
+    pump();
+    to_node.sent = 0;
+    to_controller.sent = 0;
+}
+
+static void test_channel_in_type_byte(void) {
+    uint8_t value = 0x5A;
+    uint8_t last = ASMART_COMM_CHANNELS - 1;
+
+    init_pair();
+
+    /* Channel 0 goes out at once with the channel bits clear */
+    asmart_comm_send_notification(&controller, TEST_NOTIFICATION, &value, 1);
+    CHECK(to_node.sent == 1 && to_node.type_bytes[0] == FRAME_TYPE_BYTE(MSG_TYPE_NOTIFICATION, 0));
+
+    /* Channel frames go out from the handler with their number in bits 4..5 */
+    CHECK(asmart_comm_channel_send_notification(&controller, last, TEST_NOTIFICATION, &value, 1));
+    CHECK(to_node.sent == 1);
+    asmart_comm_handler(&controller);
+    CHECK(to_node.sent == 2);
+    CHECK((to_node.type_bytes[1] & FRAME_TYPE_MASK) == MSG_TYPE_NOTIFICATION);
+    CHECK((to_node.type_bytes[1] & FRAME_CHANNEL_MASK) >> FRAME_CHANNEL_SHIFT == last);
+}
+
+static void test_routed_to_channel_callback(void) {
+    uint8_t value = 0x5A;
+
+    init_pair();
+
+    /* A notification on each channel reaches that channel only */
+    asmart_comm_send_notification(&controller, TEST_NOTIFICATION, &value, 1);
+    for (uint8_t channel = 1; channel < ASMART_COMM_CHANNELS; channel++) {
+        CHECK(asmart_comm_channel_send_notification(&controller, channel, TEST_NOTIFICATION, &value, 1));
+    }
+    pump();
+    for (uint8_t channel = 0; channel < ASMART_COMM_CHANNELS; channel++) {
+        CHECK(node_log[channel].notifications == 1 && node_log[channel].commands == 0);
+    }
+
+    /* Each channel numbers its own messages */
+    CHECK(asmart_comm_channel_send_notification(&controller, 1, TEST_NOTIFICATION, &value, 1));
+    pump();
+    CHECK(node_log[1].notifications == 2 && node_log[1].last_sequence_number == 2);
+}
+
+static void test_response_on_command_channel(void) {
+    uint8_t value = 0x5A;
+    uint8_t last = ASMART_COMM_CHANNELS - 1;
+
+    init_pair();
+
+    /* The node answers from the channel callback, the response comes back on the same channel */
+    CHECK(asmart_comm_channel_send_command(&controller, last, ECHO_COMMAND, &value, 1));
+    pump();
+    CHECK(node_log[last].commands == 1 && node_log[0].commands == 0);
+    CHECK((to_controller.type_bytes[0] & FRAME_CHANNEL_MASK) >> FRAME_CHANNEL_SHIFT == last);
+    CHECK(controller_log[last].responses == 1 && controller_log[last].last_sequence_number == 1);
+    CHECK(controller_log[0].responses == 0 && controller.mapping_table_count == 0);
+
+    /* A channel 0 command is answered to the response callback */
+    asmart_comm_send_command(&controller, ECHO_COMMAND, &value, 1);
+    pump();
+    CHECK(node_log[0].commands == 1 && controller_log[0].responses == 1);
+}
+
+static void test_closed_channel(void) {
+    uint8_t value = 0x5A;
+
+    init_pair();
+
+    /* Nothing can be queued on a closed channel, and the peer ignores what arrives on it */
+    asmart_comm_channel_close(&controller, 1);
+    CHECK(!asmart_comm_channel_send_notification(&controller, 1, TEST_NOTIFICATION, &value, 1));
+    asmart_comm_channel_close(&node, 1);
+    asmart_comm_channel_open(&controller, 1, NODE_ADDRESS, RX_WINDOW, controller_channel_callback);
+    CHECK(asmart_comm_channel_send_notification(&controller, 1, TEST_NOTIFICATION, &value, 1));
+    pump();
+    CHECK(node_log[1].notifications == 0 && node_log[0].notifications == 0);
+
+    /* Channel 0 and numbers past the last channel take no queued frames */
+    CHECK(!asmart_comm_channel_send_notification(&controller, 0, TEST_NOTIFICATION, &value, 1));
+    CHECK(!asmart_comm_channel_send_notification(&controller, ASMART_COMM_CHANNELS, TEST_NOTIFICATION, &value, 1));
+}
+#endif
+
+int main(void) {
+#if ASMART_COMM_CHANNELS > 1
+    ASMART_TEST_RUN(test_channel_in_type_byte);
+    ASMART_TEST_RUN(test_routed_to_channel_callback);
+    ASMART_TEST_RUN(test_response_on_command_channel);
+    ASMART_TEST_RUN(test_closed_channel);
+#endif
+    return asmart_test_result();
+}
@@ -0,0 +1,233 @@
+/*
+ * Receiver credits: a sender without credit holds frames back instead of waiting, stays stalled
+ * while no credit comes, sends them once the credit arrives, and resynchronises and gives up on its
+ * own deadlines.
+ */
+#include <string.h>
+#include "asmart_comm_handler.h"
+#include "asmart_test.h"
+
+#define CONTROLLER_ADDRESS 0x01
+#define NODE_ADDRESS 0x10
+#define TEST_NOTIFICATION 0x30
+#define QUEUED_FRAMES 8
+#define STALL_STEP_MS 10  // Handler runs while stalled, well inside CREDIT_RESYNC_MS
+
+#if ASMART_COMM_RX_CREDITS
+// Frames a Handler Sent, not delivered yet
+typedef struct {
+    uint8_t frame[QUEUED_FRAMES][TRANSMIT_BUFFER_SIZE];
+    uint16_t length[QUEUED_FRAMES];
+    uint8_t count;
+    uint32_t total;
+} SentFrames_t;
+
+static aSmart_Comm_Handler_t controller;
+static aSmart_Comm_Handler_t node;
+static SentFrames_t controller_sent;
+static SentFrames_t node_sent;
+static uint32_t notifications;
+static uint8_t last_value;
+static uint8_t values[2 * QUEUED_FRAMES];  // Values the node received, in arrival order
+
+static void keep_frame(void* context, uint8_t destination, const uint8_t* frame, uint16_t length) {
+    SentFrames_t* sent = (SentFrames_t*)context;
+
+    (void)destination;
+    if (sent->count < QUEUED_FRAMES) {
+        memcpy(sent->frame[sent->count], frame, length);
+        sent->length[sent->count++] = length;
+    }
+    sent->total++;
+}
+
+static void node_callback(uint8_t message_type, uint8_t command_type, uint16_t sequence_number, uint8_t* payload, uint16_t length) {
+    (void)sequence_number;
+
+    if (message_type == MSG_TYPE_NOTIFICATION && command_type == TEST_NOTIFICATION && length == 1) {
+        last_value = payload[0];
+        if (notifications < sizeof(values)) {
+            values[notifications] = payload[0];
+        }
+        notifications++;
+    }
+}
+
+static void controller_callback(uint8_t message_type, uint8_t command_type, uint16_t sequence_number, uint8_t* payload, uint16_t length) {
+    (void)message_type;
+    (void)command_type;
+    (void)sequence_number;
+    (void)payload;
+    (void)length;
+}
+
+/* Every frame sent so far arrives, then the receiver's handler runs */
+static void deliver(SentFrames_t* sent, aSmart_Comm_Handler_t* receiver) {
+    for (uint8_t i = 0; i < sent->count; i++) {
+        asmart_comm_receive_bytes(receiver, sent->frame[i], sent->length[i]);
+    }
+    sent->count = 0;
+    asmart_comm_handler(receiver);
+}
+
+/* Both nodes count from now on */
+static void init_credit_pair(void) {
+    asmart_test_now_ms = 0;
+    asmart_comm_set_clock(asmart_test_clock);
+    memset(&controller_sent, 0, sizeof(controller_sent));
+    memset(&node_sent, 0, sizeof(node_sent));
+    asmart_comm_init_transport(&controller, keep_frame, &controller_sent, controller_callback);
+    asmart_comm_set_address(&controller, CONTROLLER_ADDRESS, 0);
+    asmart_comm_set_peer(&controller, NODE_ADDRESS);
+    asmart_comm_init_transport(&node, keep_frame, &node_sent, node_callback);
+    asmart_comm_set_address(&node, NODE_ADDRESS, 0);
+    notifications = 0;
+
+    asmart_comm_negotiate(&controller, NODE_ADDRESS);
+    deliver(&controller_sent, &node);
+    deliver(&node_sent, &controller);
+}
+
+static void send_value(uint8_t value) {
+    asmart_comm_send_notification(&controller, TEST_NOTIFICATION, &value, 1);
+}
+
+static void test_held_until_credit(void) {
+    init_credit_pair();
+    CHECK(controller.credit_peers[0].active && node.credit_peers[0].active);
+
+    /* The window fills, the next frame is held and the send call returns at once */
+    for (uint8_t i = 0; i < RX_CREDIT_WINDOW; i++) {
+        send_value(i);
+    }
+    uint32_t written = controller_sent.total;
+    send_value(RX_CREDIT_WINDOW);
+    CHECK(controller_sent.total == written);
+    CHECK(controller.held_count == 1);
+    CHECK(asmart_comm_handler(&controller) == CREDIT_RESYNC_MS);
+
+    /* The node frees its slots and sends credit, the held frame follows in order */
+    deliver(&controller_sent, &node);
+    CHECK(notifications == RX_CREDIT_WINDOW);
+    deliver(&node_sent, &controller);
+    CHECK(controller.held_count == 0 && controller_sent.count == 1);
+    deliver(&controller_sent, &node);
+    CHECK(notifications == RX_CREDIT_WINDOW + 1 && last_value == RX_CREDIT_WINDOW);
+}
+
+static void test_exhausted_sender_stalls(void) {
+    init_credit_pair();
+    for (uint8_t i = 0; i < RX_CREDIT_WINDOW + TX_HOLD_FRAMES; i++) {
+        send_value(i);
+    }
+    uint32_t written = controller_sent.total;
+    CHECK(controller.held_count == TX_HOLD_FRAMES);
+
+    /* No credit comes back: the handler keeps returning the resync deadline and sends nothing */
+    for (uint32_t ms = 0; ms + STALL_STEP_MS < CREDIT_RESYNC_MS; ms += STALL_STEP_MS) {
+        CHECK(asmart_comm_handler(&controller) <= CREDIT_RESYNC_MS);
+        CHECK(controller_sent.total == written && controller.held_count == TX_HOLD_FRAMES);
+        asmart_test_now_ms += STALL_STEP_MS;
+    }
+
+    /* The node got the window only */
+    deliver(&controller_sent, &node);
+    CHECK(notifications == RX_CREDIT_WINDOW && last_value == RX_CREDIT_WINDOW - 1);
+}
+
+static void test_credit_update_resumes(void) {
+    uint8_t total = RX_CREDIT_WINDOW + TX_HOLD_FRAMES;
+
+    init_credit_pair();
+    for (uint8_t i = 0; i < total; i++) {
+        send_value(i);
+    }
+    deliver(&controller_sent, &node);
+    CHECK(notifications == RX_CREDIT_WINDOW);
+
+    /* Each credit update releases held frames, never more than a window, until the hold is empty */
+    for (uint8_t update = 0; controller.held_count > 0; update++) {
+        uint8_t held = controller.held_count;
+
+        CHECK(update < TX_HOLD_FRAMES && node_sent.count > 0);
+        deliver(&node_sent, &controller);
+        CHECK(controller.held_count < held && held - controller.held_count <= RX_CREDIT_WINDOW);
+        CHECK(controller_sent.count == held - controller.held_count);
+        deliver(&controller_sent, &node);
+    }
+
+    /* Every frame arrived, in the order it was sent */
+    CHECK(notifications == total);
+    for (uint8_t i = 0; i < total; i++) {
+        CHECK(values[i] == i);
+    }
+
+    /* Credit is back: the next frame goes straight out */
+    deliver(&node_sent, &controller);
+    uint32_t written = controller_sent.total;
+    send_value(total);
+    CHECK(controller_sent.total == written + 1 && controller.held_count == 0);
+}
+
+static void test_order_behind_held_frame(void) {
+    init_credit_pair();
+    for (uint8_t i = 0; i < RX_CREDIT_WINDOW; i++) {
+        send_value(i);
+    }
+    send_value(10);
+    deliver(&controller_sent, &node);
+
+    /* The credit is in, but a frame sent before the handler ran queues behind the held one */
+    asmart_comm_receive_bytes(&controller, node_sent.frame[0], node_sent.length[0]);
+    node_sent.count = 0;
+    send_value(11);
+    CHECK(controller_sent.count == 0 && controller.held_count == 2);
+    asmart_comm_handler(&controller);
+    CHECK(controller.held_count == 0);
+    deliver(&controller_sent, &node);
+    CHECK(last_value == 11 && notifications == RX_CREDIT_WINDOW + 2);
+}
+
+static void test_resync_then_give_up(void) {
+    init_credit_pair();
+    for (uint8_t i = 0; i < RX_CREDIT_WINDOW; i++) {
+        send_value(i);
+    }
+
+    /* The node never answers: the counters are resent, then the held frame goes anyway */
+    controller_sent.count = 0;
+    send_value(20);
+    CHECK(controller.held_count == 1);
+    asmart_test_now_ms += asmart_comm_handler(&controller);
+    CHECK(asmart_comm_handler(&controller) == CREDIT_RESYNC_MS);
+    CHECK(controller_sent.count == 1 && controller.held_count == 1);
+    asmart_test_now_ms += CREDIT_RESYNC_MS;
+    asmart_comm_handler(&controller);
+    CHECK(controller_sent.count == 2 && controller.held_count == 0);
+}
+
+static void test_hold_full_drops(void) {
+    init_credit_pair();
+    for (uint8_t i = 0; i < RX_CREDIT_WINDOW + TX_HOLD_FRAMES; i++) {
+        send_value(i);
+    }
+    CHECK(controller.held_count == TX_HOLD_FRAMES);
+
+    /* No room left: dropped, the send call still returns */
+    send_value(30);
+    CHECK(controller.held_count == TX_HOLD_FRAMES);
+    CHECK(controller_sent.total == 1 + RX_CREDIT_WINDOW);
+}
+#endif
+
+int main(void) {
+#if ASMART_COMM_RX_CREDITS
+    ASMART_TEST_RUN(test_held_until_credit);
+    ASMART_TEST_RUN(test_exhausted_sender_stalls);
+    ASMART_TEST_RUN(test_credit_update_resumes);
+    ASMART_TEST_RUN(test_order_behind_held_frame);
+    ASMART_TEST_RUN(test_resync_then_give_up);
+    ASMART_TEST_RUN(test_hold_full_drops);
+#endif
+    return asmart_test_result();
+}
@@ -0,0 +1,168 @@
+/*
+ * Next deadline returned by the handler: nothing pending, the earliest of a command's retransmission
+ * timer and a request's fixed timeout as both move on, and a credit resync ahead of a command timer.
+ */
+#include <string.h>
+#include "asmart_comm_handler.h"
+#include "asmart_test.h"
+
+#define CONTROLLER_ADDRESS 0x01
+#define NODE_ADDRESS 0x10
+#define RETRANSMIT_COMMAND 0x10  // Adaptive timeout, COMMAND_TIMEOUT_MS before the first round trip
+#define REQUEST_COMMAND 0x11  // Fixed timeout
+#define TEST_NOTIFICATION 0x30
+#define REQUEST_START_MS 1000
+#define REQUEST_TIMEOUT_MS 3000  // Expires before the first attempt of RETRANSMIT_COMMAND
+#define QUEUED_FRAMES 8
+
+// Frames a Handler Sent, not delivered yet
+typedef struct {
+    uint8_t frame[QUEUED_FRAMES][TRANSMIT_BUFFER_SIZE];
+    uint16_t length[QUEUED_FRAMES];
+    uint8_t count;
+    uint32_t total;
+} SentFrames_t;
+
+static aSmart_Comm_Handler_t controller;
+static aSmart_Comm_Handler_t node;
+static SentFrames_t controller_sent;
+static SentFrames_t node_sent;
+
+static void keep_frame(void* context, uint8_t destination, const uint8_t* frame, uint16_t length) {
+    SentFrames_t* sent = (SentFrames_t*)context;
+
+    (void)destination;
+    if (sent->count < QUEUED_FRAMES) {
+        memcpy(sent->frame[sent->count], frame, length);
+        sent->length[sent->count++] = length;
+    }
+    sent->total++;
+}
+
+/* Neither end answers, so every command stays pending until it times out */
+static void ignore(uint8_t message_type, uint8_t command_type, uint16_t sequence_number, uint8_t* payload, uint16_t length) {
+    (void)message_type;
+    (void)command_type;
+    (void)sequence_number;
+    (void)payload;
+    (void)length;
+}
+
+static void init_handlers(void) {
+    asmart_test_now_ms = 0;
+    asmart_comm_set_clock(asmart_test_clock);
+    memset(&controller_sent, 0, sizeof(controller_sent));
+    memset(&node_sent, 0, sizeof(node_sent));
+    asmart_comm_init_transport(&controller, keep_frame, &controller_sent, ignore);
+    asmart_comm_set_address(&controller, CONTROLLER_ADDRESS, 0);
+    asmart_comm_set_peer(&controller, NODE_ADDRESS);
+    asmart_comm_init_transport(&node, keep_frame, &node_sent, ignore);
+    asmart_comm_set_address(&node, NODE_ADDRESS, 0);
+}
+
+static void test_nothing_pending(void) {
+    uint8_t value = 0;
+
+    init_handlers();
+    CHECK(asmart_comm_handler(&controller) == ASMART_COMM_NO_DEADLINE);
+
+    /* A notification waits for nothing */
+    asmart_comm_send_notification(&controller, TEST_NOTIFICATION, &value, 1);
+    CHECK(controller_sent.total == 1);
+    CHECK(asmart_comm_handler(&controller) == ASMART_COMM_NO_DEADLINE);
+}
+
+static void test_earliest_timer(void) {
+    static aSmart_Request_t request;
+    uint8_t payload[2] = { 1, 2 };
+    uint8_t response[2];
+
+    init_handlers();
+    asmart_comm_set_command_timeout(&controller, REQUEST_COMMAND, REQUEST_TIMEOUT_MS);
+
+    /* A command is sent: its retransmission timer is the only deadline */
+    asmart_comm_send_command(&controller, RETRANSMIT_COMMAND, payload, sizeof(payload));
+    CHECK(asmart_comm_handler(&controller) == COMMAND_TIMEOUT_MS + 1);
+
+    /* A request sent later with a shorter timeout expires first */
+    asmart_test_now_ms = REQUEST_START_MS;
+    asmart_comm_request(&controller, &request, REQUEST_COMMAND, payload, sizeof(payload), response, sizeof(response));
+    CHECK(request.status == REQUEST_PENDING);
+    CHECK(asmart_comm_handler(&controller) == REQUEST_TIMEOUT_MS + 1);
+
+    /* Its deadline passes: the request is retransmitted with a doubled timeout, the command's timer is earliest again */
+    uint32_t written = controller_sent.total;
+    asmart_test_now_ms += REQUEST_TIMEOUT_MS + 1;
+    uint32_t left = asmart_comm_handler(&controller);
+    CHECK(controller_sent.total == written + 1);
+    CHECK(left == COMMAND_TIMEOUT_MS + 1 - asmart_test_now_ms);
+
+    /* The command's first attempt runs out: the request is earliest */
+    uint32_t request_sent = asmart_test_now_ms;
+    asmart_test_now_ms += left;
+    CHECK(asmart_comm_handler(&controller) == request_sent + 2 * REQUEST_TIMEOUT_MS + 1 - asmart_test_now_ms);
+    CHECK(controller_sent.total == written + 2);
+
+    /* Waiting out each deadline ends in the request's timeout, and then nothing is pending */
+    for (uint8_t rounds = 0; controller.mapping_table_count > 0; rounds++) {
+        uint32_t wait = asmart_comm_handler(&controller);
+
+        CHECK(rounds < 4 * (COMMAND_MAX_RETRIES + 1) && wait != ASMART_COMM_NO_DEADLINE && wait > 0);
+        asmart_test_now_ms += wait;
+        asmart_comm_handler(&controller);
+    }
+    CHECK(request.status == REQUEST_TIMEOUT);
+    CHECK(asmart_comm_handler(&controller) == ASMART_COMM_NO_DEADLINE);
+}
+
+#if ASMART_COMM_RX_CREDITS
+/* Every frame sent so far arrives, then the receiver's handler runs */
+static void deliver(SentFrames_t* sent, aSmart_Comm_Handler_t* receiver) {
+    for (uint8_t i = 0; i < sent->count; i++) {
+        asmart_comm_receive_bytes(receiver, sent->frame[i], sent->length[i]);
+    }
+    sent->count = 0;
+    asmart_comm_handler(receiver);
+}
+
+static void test_credit_resync_earliest(void) {
+    uint8_t value = 0;
+
+    init_handlers();
+    asmart_comm_negotiate(&controller, NODE_ADDRESS);
+    deliver(&controller_sent, &node);
+    deliver(&node_sent, &controller);
+    CHECK(controller.credit_peers[0].active);
+    CHECK(asmart_comm_handler(&controller) == ASMART_COMM_NO_DEADLINE);
+
+    /* The negotiation measured the link, a fixed timeout keeps the command's timer behind the resync */
+    asmart_comm_set_command_timeout(&controller, REQUEST_COMMAND, REQUEST_TIMEOUT_MS);
+
+    /* A command takes one credit and arms its timer, notifications fill the window until one is held */
+    asmart_comm_send_command(&controller, REQUEST_COMMAND, &value, 1);
+    for (uint8_t i = 0; i < RX_CREDIT_WINDOW && controller.held_count == 0; i++) {
+        asmart_comm_send_notification(&controller, TEST_NOTIFICATION, &value, 1);
+    }
+    CHECK(controller.held_count == 1);
+
+    /* The resync is due long before the command's timer */
+    CHECK(asmart_comm_handler(&controller) == CREDIT_RESYNC_MS);
+    asmart_test_now_ms += CREDIT_RESYNC_MS / 2;
+    CHECK(asmart_comm_handler(&controller) == CREDIT_RESYNC_MS - CREDIT_RESYNC_MS / 2);
+
+    /* Credit arrives and the held frame goes out: the command's timer is left */
+    deliver(&controller_sent, &node);
+    deliver(&node_sent, &controller);
+    CHECK(controller.held_count == 0);
+    CHECK(asmart_comm_handler(&controller) == REQUEST_TIMEOUT_MS + 1 - asmart_test_now_ms);
+}
+#endif
+
+int main(void) {
+    ASMART_TEST_RUN(test_nothing_pending);
+    ASMART_TEST_RUN(test_earliest_timer);
+#if ASMART_COMM_RX_CREDITS
+    ASMART_TEST_RUN(test_credit_resync_earliest);
+#endif
+    return asmart_test_result();
+}
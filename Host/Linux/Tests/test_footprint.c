@@ -0,0 +1,88 @@
+/*
+ * Footprint of the profile in the build: the handler size is printed for the record, the largest
+ * payload fills the transmit buffer exactly, and one byte more is refused by every send call
+ * instead of running past the buffer.
+ */
+#include <stdio.h>
+#include <string.h>
+#include "asmart_comm_handler.h"
+#include "asmart_test.h"
+
+#define CONTROLLER_ADDRESS 0x01
+#define NODE_ADDRESS 0x10
+#define TEST_COMMAND 0x10
+#define TEST_NOTIFICATION 0x30
+#define TEST_ERROR 0x01
+
+// Frames a Handler Sent
+typedef struct {
+    uint16_t length;  // Length of the last frame
+    uint32_t count;
+} SentFrames_t;
+
+static aSmart_Comm_Handler_t handler;
+static SentFrames_t sent;
+static uint8_t payload[ASMART_COMM_MAX_PAYLOAD + 1];
+
+static void keep_frame(void* context, uint8_t destination, const uint8_t* frame, uint16_t length) {
+    SentFrames_t* frames = (SentFrames_t*)context;
+
+    (void)destination;
+    (void)frame;
+    frames->length = length;
+    frames->count++;
+}
+
+static void ignore(uint8_t message_type, uint8_t command_type, uint16_t sequence_number, uint8_t* data, uint16_t length) {
+    (void)message_type;
+    (void)command_type;
+    (void)sequence_number;
+    (void)data;
+    (void)length;
+}
+
+static void init_handler(void) {
+    memset(&sent, 0, sizeof(sent));
+    memset(payload, 0xA5, sizeof(payload));
+    asmart_comm_init_transport(&handler, keep_frame, &sent, ignore);
+    asmart_comm_set_address(&handler, CONTROLLER_ADDRESS, 0);
+    asmart_comm_set_peer(&handler, NODE_ADDRESS);
+}
+
+static void test_largest_payload_fills_buffer(void) {
+    init_handler();
+    asmart_comm_send_notification(&handler, TEST_NOTIFICATION, payload, ASMART_COMM_MAX_PAYLOAD);
+    CHECK(sent.count == 1 && sent.length == TRANSMIT_BUFFER_SIZE);
+    asmart_comm_send_command(&handler, TEST_COMMAND, payload, ASMART_COMM_MAX_PAYLOAD);
+    CHECK(sent.count == 2 && sent.length == TRANSMIT_BUFFER_SIZE);
+    CHECK(handler.mapping_table_count == 1);
+}
+
+static void test_oversized_payload_not_sent(void) {
+    uint16_t length = ASMART_COMM_MAX_PAYLOAD + 1;
+
+    init_handler();
+
+    /* Nothing goes out and no command waits for a response */
+    asmart_comm_send_command(&handler, TEST_COMMAND, payload, length);
+    asmart_comm_send_command_to(&handler, NODE_ADDRESS, TEST_COMMAND, payload, length);
+    asmart_comm_send_notification(&handler, TEST_NOTIFICATION, payload, length);
+    asmart_comm_send_notification_to(&handler, NODE_ADDRESS, TEST_NOTIFICATION, payload, length);
+    asmart_comm_send_response(&handler, 1, TEST_COMMAND, payload, length);
+    asmart_comm_send_error(&handler, 1, TEST_ERROR, payload, length);
+    CHECK(sent.count == 0 && handler.mapping_table_count == 0);
+    CHECK(asmart_comm_handler(&handler) == ASMART_COMM_NO_DEADLINE);
+
+    /* The handler is left as it was: the next send goes out whole */
+    asmart_comm_send_command(&handler, TEST_COMMAND, payload, 1);
+    CHECK(sent.count == 1 && sent.length == FRAME_HEADER_SIZE + 1 + FRAME_TRAILER_SIZE);
+    CHECK(handler.mapping_table_count == 1);
+}
+
+int main(void) {
+    printf("profile %d: aSmart_Comm_Handler_t %zu bytes, frame buffers %d bytes, %d commands in flight\n",
+           ASMART_COMM_PROFILE, sizeof(aSmart_Comm_Handler_t), TRANSMIT_BUFFER_SIZE, MAPPING_TABLE_ENTRIES);
+    ASMART_TEST_RUN(test_largest_payload_fills_buffer);
+    ASMART_TEST_RUN(test_oversized_payload_not_sent);
+    return asmart_test_result();
+}
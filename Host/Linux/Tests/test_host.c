@@ -0,0 +1,74 @@
+/*
+ * Host port: a controller and a device on the two ends of a pseudo-terminal.
+ */
+#include <string.h>
+#include "asmart_comm_handler.h"
+#include "asmart_test.h"
+
+#define TEST_COMMAND 0x10
+#define TEST_WAIT_MS 2000
+
+// One End of the Pseudo-terminal
+typedef struct {
+    aSmart_HostPort_t port;
+    aSmart_Comm_Handler_t handler;
+    uint32_t responses;
+    uint32_t timeouts;
+    uint8_t payload[ASMART_COMM_MAX_PAYLOAD];
+    uint16_t length;
+} TestNode_t;
+
+static TestNode_t controller;
+static TestNode_t device;
+
+static void controller_callback(uint8_t message_type, uint8_t command_type, uint16_t sequence_number, uint8_t* payload, uint16_t length) {
+    (void)command_type;
+    (void)sequence_number;
+
+    if (message_type == MSG_TYPE_RESPONSE) {
+        memcpy(controller.payload, payload, length);
+        controller.length = length;
+        controller.responses++;
+    }
+    else if (message_type == MSG_TYPE_ERROR && payload == NULL) {
+        controller.timeouts++;
+    }
+}
+
+static void device_callback(uint8_t message_type, uint8_t command_type, uint16_t sequence_number, uint8_t* payload, uint16_t length) {
+    if (message_type == MSG_TYPE_COMMAND) {
+        asmart_comm_send_response(&device.handler, sequence_number, command_type, payload, length);
+    }
+}
+
+static void test_pty_round_trip(void) {
+    aSmart_HostLoop_t loop;
+    char slave_path[64];
+    uint8_t payload[ASMART_COMM_MAX_PAYLOAD / 2];
+
+    CHECK(asmart_host_loop_init(&loop) == 0);
+    CHECK(asmart_host_open_pty(&loop, &controller.port, slave_path, sizeof(slave_path)) == 0);
+    CHECK(asmart_host_open(&loop, &device.port, slave_path, 115200) == 0);
+    asmart_comm_init_port(&controller.handler, &controller.port, controller_callback);
+    asmart_comm_init_port(&device.handler, &device.port, device_callback);
+
+    for (uint16_t i = 0; i < sizeof(payload); i++) {
+        payload[i] = (uint8_t)(i * 7);
+    }
+    asmart_comm_send_command(&controller.handler, TEST_COMMAND, payload, sizeof(payload));
+
+    uint32_t start = HAL_GetTick();
+    while (controller.responses == 0 && controller.timeouts == 0 && HAL_GetTick() - start < TEST_WAIT_MS) {
+        CHECK(asmart_host_poll(&loop, 10) >= 0);
+    }
+    asmart_host_loop_close(&loop);
+
+    CHECK(controller.responses == 1);
+    CHECK(controller.length == sizeof(payload));
+    CHECK(memcmp(controller.payload, payload, sizeof(payload)) == 0);
+}
+
+int main(void) {
+    ASMART_TEST_RUN(test_pty_round_trip);
+    return asmart_test_result();
+}
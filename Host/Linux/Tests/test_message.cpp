@@ -0,0 +1,141 @@
+/*
+ * C++17 typed messages: wire sizes at compile time, the big-endian layout, a decode of every
+ * field type, a length mismatch, and a message sent through one handler and decoded by another.
+ */
+#include <array>
+#include <cstring>
+#include "asmart_comm_message.hpp"
+#include "asmart_test.h"
+
+#define CONTROLLER_ADDRESS 0x01
+#define NODE_ADDRESS 0x10
+#define SETPOINT_COMMAND 0x21
+
+enum class Mode : uint8_t { Idle = 1, Run = 2 };
+
+struct Position {
+    int16_t x;
+    int16_t y;
+    using fields = asmart::Fields<&Position::x, &Position::y>;
+};
+
+struct Setpoint {
+    static constexpr uint8_t command_type = SETPOINT_COMMAND;
+    static constexpr uint16_t wire_size = 24;
+    uint32_t id;
+    bool enable;
+    Mode mode;
+    float gain;
+    double limit;
+    std::array<uint8_t, 2> flags;
+    Position target;
+    using fields = asmart::Fields<&Setpoint::id, &Setpoint::enable, &Setpoint::mode, &Setpoint::gain, &Setpoint::limit,
+                                  &Setpoint::flags, &Setpoint::target>;
+};
+
+static_assert(asmart::wire_size_v<Position> == 4);
+static_assert(asmart::wire_size_v<Setpoint> == Setpoint::wire_size);
+
+// Frames a Handler Sent
+struct SentFrames_t {
+    uint8_t frame[TRANSMIT_BUFFER_SIZE];
+    uint16_t length;
+    uint32_t count;
+};
+
+static aSmart_Comm_Handler_t controller;
+static aSmart_Comm_Handler_t node;
+static SentFrames_t controller_sent;
+static SentFrames_t node_sent;
+static Setpoint received;
+static uint32_t decoded;
+
+static const Setpoint sample = { 0x01020304, true, Mode::Run, 1.5f, -2.25, { 0xAA, 0x55 }, { -2, 300 } };
+
+static bool same(const Setpoint& a, const Setpoint& b) {
+    return a.id == b.id && a.enable == b.enable && a.mode == b.mode && a.gain == b.gain && a.limit == b.limit &&
+           a.flags == b.flags && a.target.x == b.target.x && a.target.y == b.target.y;
+}
+
+static void keep_frame(void* context, uint8_t destination, const uint8_t* frame, uint16_t length) {
+    SentFrames_t* sent = static_cast<SentFrames_t*>(context);
+
+    (void)destination;
+    std::memcpy(sent->frame, frame, length);
+    sent->length = length;
+    sent->count++;
+}
+
+/* Node: decodes the setpoint and answers with it */
+static void node_callback(uint8_t message_type, uint8_t command_type, uint16_t sequence_number, uint8_t* payload, uint16_t length) {
+    if (message_type == MSG_TYPE_COMMAND && command_type == Setpoint::command_type && asmart::decode(payload, length, received)) {
+        decoded++;
+        asmart::send_response(&node, sequence_number, received);
+    }
+}
+
+static void controller_callback(uint8_t message_type, uint8_t command_type, uint16_t sequence_number, uint8_t* payload, uint16_t length) {
+    Setpoint answer;
+
+    (void)sequence_number;
+    if (message_type == MSG_TYPE_RESPONSE && command_type == Setpoint::command_type && asmart::decode(payload, length, answer) && same(answer, sample)) {
+        decoded++;
+    }
+}
+
+static void test_big_endian_layout() {
+    uint8_t out[Setpoint::wire_size];
+    const uint8_t expected_head[] = { 0x01, 0x02, 0x03, 0x04, 0x01, 0x02, 0x3F, 0xC0, 0x00, 0x00, 0xC0, 0x02 };
+    const uint8_t expected_tail[] = { 0xAA, 0x55, 0xFF, 0xFE, 0x01, 0x2C };
+
+    /* Fields in list order at fixed offsets, floats as their bit pattern */
+    CHECK(asmart::encode(sample, out) == Setpoint::wire_size);
+    CHECK(std::memcmp(out, expected_head, sizeof(expected_head)) == 0);
+    CHECK(std::memcmp(&out[Setpoint::wire_size - sizeof(expected_tail)], expected_tail, sizeof(expected_tail)) == 0);
+}
+
+static void test_decode_round_trip() {
+    uint8_t out[Setpoint::wire_size];
+    Setpoint copy{};
+
+    asmart::encode(sample, out);
+    CHECK(asmart::decode(out, sizeof(out), copy));
+    CHECK(same(copy, sample));
+
+    /* Any other length leaves the message untouched */
+    Setpoint untouched{};
+    CHECK(!asmart::decode(out, sizeof(out) - 1, untouched));
+    CHECK(!asmart::decode(out, sizeof(out) + 1, untouched));
+    CHECK(untouched.id == 0 && untouched.target.y == 0);
+}
+
+static void test_sent_through_handlers() {
+    asmart_test_now_ms = 0;
+    asmart_comm_set_clock(asmart_test_clock);
+    std::memset(&controller_sent, 0, sizeof(controller_sent));
+    std::memset(&node_sent, 0, sizeof(node_sent));
+    decoded = 0;
+    asmart_comm_init_transport(&controller, keep_frame, &controller_sent, controller_callback);
+    asmart_comm_set_address(&controller, CONTROLLER_ADDRESS, 0);
+    asmart_comm_set_peer(&controller, NODE_ADDRESS);
+    asmart_comm_init_transport(&node, keep_frame, &node_sent, node_callback);
+    asmart_comm_set_address(&node, NODE_ADDRESS, 0);
+
+    /* Encoded in place in the transmit buffer, decoded from the received payload, answered the same way */
+    asmart::send_command(&controller, sample);
+    CHECK(controller_sent.count == 1 && controller_sent.length == FRAME_HEADER_SIZE + Setpoint::wire_size + FRAME_TRAILER_SIZE);
+    asmart_comm_receive_bytes(&node, controller_sent.frame, controller_sent.length);
+    asmart_comm_handler(&node);
+    CHECK(decoded == 1 && same(received, sample));
+    CHECK(node_sent.count == 1);
+    asmart_comm_receive_bytes(&controller, node_sent.frame, node_sent.length);
+    asmart_comm_handler(&controller);
+    CHECK(decoded == 2 && controller.mapping_table_count == 0);
+}
+
+int main() {
+    ASMART_TEST_RUN(test_big_endian_layout);
+    ASMART_TEST_RUN(test_decode_round_trip);
+    ASMART_TEST_RUN(test_sent_through_handlers);
+    return asmart_test_result();
+}
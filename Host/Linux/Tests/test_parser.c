@@ -0,0 +1,275 @@
+/*
+ * Streaming parser: frames fed byte by byte and in pieces, and resynchronisation after damage.
+ */
+#include <string.h>
+#include "asmart_comm_handler.h"
+#include "crc16.h"
+#include "asmart_test.h"
+
+#define NODE_ADDRESS 0x10
+#define OTHER_ADDRESS 0x20
+#define SOURCE_ADDRESS 0x05
+#define TEST_COMMAND 0x10
+#define TEST_PAYLOAD 24
+#define SPLIT_FRAMES ((RX_FRAME_SLOTS > 1) ? 2 : 1)  // Frames received before the handler runs
+
+static uint8_t parser_buffer[RECEIVE_BUFFER_SIZE];
+static aSmart_Comm_Handler_t node;
+static uint32_t commands;
+static uint16_t last_sequence;
+static uint8_t last_payload[TEST_PAYLOAD];
+static uint8_t relayed_ends;
+static uint32_t relayed_bytes;
+
+/* Standard frame, returns its length */
+static uint16_t build_frame(uint8_t* frame, uint8_t destination, uint8_t message_type, uint16_t sequence_number, const uint8_t* payload, uint16_t payload_length) {
+    uint16_t length = FRAME_MIN_LENGTH + payload_length;
+    uint16_t index = 0;
+
+    frame[index++] = STX;
+    frame[index++] = (uint8_t)(length >> 8);
+    frame[index++] = (uint8_t)length;
+    frame[index++] = destination;
+    frame[index++] = SOURCE_ADDRESS;
+    frame[index++] = (uint8_t)(sequence_number >> 8);
+    frame[index++] = (uint8_t)sequence_number;
+    frame[index++] = message_type;
+    frame[index++] = TEST_COMMAND;
+    memcpy(&frame[index], payload, payload_length);
+    index += payload_length;
+
+    uint16_t crc = crc16(&frame[1], (uint16_t)(index - 1));
+    frame[index++] = (uint8_t)(crc >> 8);
+    frame[index++] = (uint8_t)crc;
+    frame[index++] = ETX;
+    return index;
+}
+
+/* Payload without STX, SOH or ETX, so a resynchronising parser cannot start inside it */
+static void fill_payload(uint8_t* payload, uint8_t seed) {
+    for (uint16_t i = 0; i < TEST_PAYLOAD; i++) {
+        payload[i] = (uint8_t)(0x40 + ((seed + i) & 0x3F));
+    }
+}
+
+static header_action_t skip_other_nodes(void* context, const aSmart_FrameHeader_t* header) {
+    (void)context;
+    return (header->destination == NODE_ADDRESS) ? HEADER_ACCEPT : HEADER_SKIP;
+}
+
+static void node_callback(uint8_t message_type, uint8_t command_type, uint16_t sequence_number, uint8_t* payload, uint16_t length) {
+    (void)command_type;
+
+    if (message_type == MSG_TYPE_COMMAND && length == TEST_PAYLOAD) {
+        memcpy(last_payload, payload, length);
+        last_sequence = sequence_number;
+        commands++;
+    }
+}
+
+static void discard_frame(void* context, uint8_t destination, const uint8_t* frame, uint16_t length) {
+    (void)context;
+    (void)destination;
+    (void)frame;
+    (void)length;
+}
+
+#if ASMART_COMM_BRIDGE
+static void relay_sink(void* context, const uint8_t* data, uint16_t length, uint8_t end) {
+    (void)context;
+    (void)data;
+
+    relayed_bytes += length;
+    relayed_ends += end;
+}
+#endif
+
+static void init_node(void) {
+    asmart_test_now_ms = 0;
+    asmart_comm_set_clock(asmart_test_clock);
+    asmart_comm_init_transport(&node, discard_frame, NULL, node_callback);
+    asmart_comm_set_address(&node, NODE_ADDRESS, 0);
+    commands = 0;
+    relayed_ends = 0;
+    relayed_bytes = 0;
+}
+
+/* Feeds bytes, returns the number of frames and errors reported */
+static void feed(aSmart_Parser_t* parser, const uint8_t* data, uint16_t length, uint32_t* frames, uint32_t* errors) {
+    for (uint16_t i = 0; i < length; i++) {
+        parse_result_t result = asmart_parser_feed(parser, data[i]);
+
+        if (result == PARSE_FRAME) {
+            (*frames)++;
+        }
+        else if (result == PARSE_ERROR) {
+            (*errors)++;
+        }
+    }
+}
+
+static void test_byte_by_byte(void) {
+    aSmart_Parser_t parser;
+    uint8_t payload[TEST_PAYLOAD];
+    uint8_t frame[64];
+
+    fill_payload(payload, 1);
+    uint16_t length = build_frame(frame, NODE_ADDRESS, MSG_TYPE_COMMAND, 0x1234, payload, sizeof(payload));
+
+    asmart_parser_init(&parser, parser_buffer, sizeof(parser_buffer), NULL, NULL);
+    for (uint16_t i = 0; i + 1 < length; i++) {
+        CHECK(asmart_parser_feed(&parser, frame[i]) == PARSE_PENDING);
+    }
+    CHECK(asmart_parser_feed(&parser, frame[length - 1]) == PARSE_FRAME);
+    CHECK(parser.frame_length == length);
+    CHECK(parser.header.destination == NODE_ADDRESS);
+    CHECK(parser.header.source == SOURCE_ADDRESS);
+    CHECK(parser.header.sequence_number == 0x1234);
+    CHECK(parser.header.message_type == MSG_TYPE_COMMAND);
+    CHECK(parser.header.payload_length == TEST_PAYLOAD);
+    CHECK(memcmp(&parser_buffer[parser.header.payload_offset], payload, TEST_PAYLOAD) == 0);
+}
+
+static void test_split_feed(void) {
+    uint8_t payload[TEST_PAYLOAD];
+    uint8_t stream[128];
+    uint16_t sequence_number = 1;
+
+    init_node();
+
+    /* Frames in two pieces, cut at every position */
+    for (uint16_t cut = 0; cut <= SPLIT_FRAMES * (FRAME_HEADER_SIZE + TEST_PAYLOAD + FRAME_TRAILER_SIZE); cut++) {
+        uint32_t before = commands;
+        uint16_t length = 0;
+
+        fill_payload(payload, (uint8_t)cut);
+        for (uint8_t i = 0; i < SPLIT_FRAMES; i++) {
+            length += build_frame(&stream[length], NODE_ADDRESS, MSG_TYPE_COMMAND, sequence_number++, payload, sizeof(payload));
+        }
+
+        asmart_comm_receive_bytes(&node, stream, cut);
+        asmart_comm_receive_bytes(&node, &stream[cut], (uint16_t)(length - cut));
+        asmart_comm_handler(&node);
+
+        CHECK(commands == before + SPLIT_FRAMES);
+        CHECK(last_sequence == sequence_number - 1);
+        CHECK(memcmp(last_payload, payload, TEST_PAYLOAD) == 0);
+    }
+}
+
+static void test_resync_after_garbage(void) {
+    aSmart_Parser_t parser;
+    uint8_t payload[TEST_PAYLOAD];
+    uint8_t frame[64];
+    uint32_t frames = 0;
+    uint32_t errors = 0;
+
+    /* Line noise, a start with a Length shorter than any frame and one too long for the buffer */
+    static const uint8_t noise[] = { 0x00, 0xFF, 0x55, STX, 0x00, 0x03, 0x42, STX, 0xFF, 0xFF, 0x42 };
+
+    fill_payload(payload, 2);
+    uint16_t length = build_frame(frame, NODE_ADDRESS, MSG_TYPE_COMMAND, 7, payload, sizeof(payload));
+
+    asmart_parser_init(&parser, parser_buffer, sizeof(parser_buffer), NULL, NULL);
+    feed(&parser, noise, sizeof(noise), &frames, &errors);
+    CHECK(errors == 2);
+    CHECK(parser.state == PARSER_STATE_WAIT_STX);
+
+    /* A frame with a damaged CRC is dropped, the next one is taken */
+    frame[length - 2] ^= 0x01;
+    feed(&parser, frame, length, &frames, &errors);
+    CHECK(frames == 0 && errors == 3);
+    frame[length - 2] ^= 0x01;
+    feed(&parser, frame, length, &frames, &errors);
+    CHECK(frames == 1);
+}
+
+static void test_skip_with_damaged_length(void) {
+    aSmart_Parser_t parser;
+    uint8_t payload[TEST_PAYLOAD];
+    uint8_t other[64];
+    uint8_t frame[64];
+    uint32_t frames = 0;
+    uint32_t errors = 0;
+
+    /* Error frames: no byte of their headers starts a frame */
+    fill_payload(payload, 3);
+    uint16_t other_length = build_frame(other, OTHER_ADDRESS, MSG_TYPE_ERROR, 8, payload, sizeof(payload));
+    uint16_t length = build_frame(frame, NODE_ADDRESS, MSG_TYPE_ERROR, 9, payload, sizeof(payload));
+
+    asmart_parser_init(&parser, parser_buffer, sizeof(parser_buffer), skip_other_nodes, NULL);
+
+    /* A skipped frame is counted through to its ETX */
+    feed(&parser, other, other_length, &frames, &errors);
+    CHECK(frames == 0 && errors == 0 && parser.state == PARSER_STATE_WAIT_STX);
+
+    /* Length too short: the skip ends inside the payload, which is an error, and the parser
+       hunts for the next STX */
+    other[2] -= 10;
+    feed(&parser, other, other_length, &frames, &errors);
+    CHECK(errors > 0);
+    feed(&parser, frame, length, &frames, &errors);
+    CHECK(frames == 1);
+
+    /* Length too long: the skip takes the start of the next frame and no more, that frame is
+       lost but the one after it is taken */
+    uint32_t errors_before = errors;
+    other[2] += 14;
+    feed(&parser, other, other_length, &frames, &errors);
+    feed(&parser, frame, length, &frames, &errors);
+    CHECK(errors > errors_before && frames == 1);
+    feed(&parser, frame, length, &frames, &errors);
+    CHECK(frames == 2);
+}
+
+static void test_idle_resync(void) {
+    uint8_t payload[TEST_PAYLOAD];
+    uint8_t frame[64];
+
+    init_node();
+    fill_payload(payload, 4);
+    uint16_t length = build_frame(frame, NODE_ADDRESS, MSG_TYPE_COMMAND, 11, payload, sizeof(payload));
+
+    /* Half a frame, then the line stays quiet: the next frame's STX starts a frame again */
+    asmart_comm_receive_bytes(&node, frame, length / 2);
+    asmart_test_now_ms += RX_IDLE_RESYNC_MS;
+    asmart_comm_receive_bytes(&node, frame, length);
+    asmart_comm_handler(&node);
+    CHECK(commands == 1);
+    CHECK(last_sequence == 11);
+}
+
+#if ASMART_COMM_BRIDGE
+static void test_idle_ends_cut_through(void) {
+    uint8_t payload[TEST_PAYLOAD];
+    uint8_t other[64];
+    uint8_t frame[64];
+
+    init_node();
+    CHECK(asmart_comm_route_to_sink(&node, ROUTE_BY_DESTINATION, OTHER_ADDRESS, OTHER_ADDRESS, relay_sink, NULL, FORWARD_CUT_THROUGH));
+    fill_payload(payload, 5);
+    uint16_t other_length = build_frame(other, OTHER_ADDRESS, MSG_TYPE_COMMAND, 12, payload, sizeof(payload));
+    uint16_t length = build_frame(frame, NODE_ADDRESS, MSG_TYPE_COMMAND, 13, payload, sizeof(payload));
+
+    /* A forwarded frame stalls half way: it is ended towards the sink, then frames parse again */
+    asmart_comm_receive_bytes(&node, other, other_length / 2);
+    CHECK(relayed_bytes == other_length / 2 && relayed_ends == 0);
+    asmart_test_now_ms += RX_IDLE_RESYNC_MS;
+    asmart_comm_receive_bytes(&node, frame, length);
+    asmart_comm_handler(&node);
+    CHECK(relayed_ends == 1 && relayed_bytes == other_length / 2);
+    CHECK(commands == 1 && last_sequence == 13);
+}
+#endif
+
+int main(void) {
+    ASMART_TEST_RUN(test_byte_by_byte);
+    ASMART_TEST_RUN(test_split_feed);
+    ASMART_TEST_RUN(test_resync_after_garbage);
+    ASMART_TEST_RUN(test_skip_with_damaged_length);
+    ASMART_TEST_RUN(test_idle_resync);
+#if ASMART_COMM_BRIDGE
+    ASMART_TEST_RUN(test_idle_ends_cut_through);
+#endif
+    return asmart_test_result();
+}
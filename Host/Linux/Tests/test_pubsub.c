@@ -0,0 +1,173 @@
+/*
+ * Publish/subscribe: a topic reaches a node only between its subscribe and unsubscribe, rate
+ * limit and decimation of a subscription, and a publisher whose subscription table is full.
+ */
+#include <string.h>
+#include "asmart_comm_handler.h"
+#include "asmart_test.h"
+
+#if ASMART_COMM_PUBSUB
+#define SUBSCRIBER_ADDRESS 0x01
+#define PUBLISHER_ADDRESS 0x10
+#define OTHER_SUBSCRIBERS 0x20  // First address of the subscribers that fill the table
+#define TOPIC 0x30
+#define PLAIN_NOTIFICATION 0x31  // Not a topic, always sent
+#define MIN_INTERVAL_MS 100
+
+// Frames a Handler Sent
+typedef struct {
+    uint8_t frame[TRANSMIT_BUFFER_SIZE];
+    uint16_t length;
+    uint32_t count;
+} SentFrames_t;
+
+static aSmart_Comm_Handler_t subscriber;
+static aSmart_Comm_Handler_t publisher;
+static SentFrames_t subscriber_sent;
+static SentFrames_t publisher_sent;
+static uint32_t topic_notifications;
+
+static void keep_frame(void* context, uint8_t destination, const uint8_t* frame, uint16_t length) {
+    SentFrames_t* sent = (SentFrames_t*)context;
+
+    (void)destination;
+    memcpy(sent->frame, frame, length);
+    sent->length = length;
+    sent->count++;
+}
+
+static void subscriber_callback(uint8_t message_type, uint8_t command_type, uint16_t sequence_number, uint8_t* payload, uint16_t length) {
+    (void)sequence_number;
+    (void)payload;
+    (void)length;
+
+    if (message_type == MSG_TYPE_NOTIFICATION && command_type == TOPIC) {
+        topic_notifications++;
+    }
+}
+
+static void ignore(uint8_t message_type, uint8_t command_type, uint16_t sequence_number, uint8_t* payload, uint16_t length) {
+    (void)message_type;
+    (void)command_type;
+    (void)sequence_number;
+    (void)payload;
+    (void)length;
+}
+
+/* The publisher marks TOPIC as a topic */
+static void init_pair(void) {
+    asmart_test_now_ms = 0;
+    asmart_comm_set_clock(asmart_test_clock);
+    memset(&subscriber_sent, 0, sizeof(subscriber_sent));
+    memset(&publisher_sent, 0, sizeof(publisher_sent));
+    asmart_comm_init_transport(&subscriber, keep_frame, &subscriber_sent, subscriber_callback);
+    asmart_comm_set_address(&subscriber, SUBSCRIBER_ADDRESS, 0);
+    asmart_comm_init_transport(&publisher, keep_frame, &publisher_sent, ignore);
+    asmart_comm_set_address(&publisher, PUBLISHER_ADDRESS, 0);
+    asmart_comm_publish_topic(&publisher, TOPIC);
+    topic_notifications = 0;
+}
+
+/* The subscriber's last command reaches the publisher and the response comes back */
+static void exchange(void) {
+    asmart_comm_receive_bytes(&publisher, subscriber_sent.frame, subscriber_sent.length);
+    asmart_comm_handler(&publisher);
+    asmart_comm_receive_bytes(&subscriber, publisher_sent.frame, publisher_sent.length);
+    asmart_comm_handler(&subscriber);
+}
+
+/* First payload byte of the publisher's last frame: the subscribe verdict */
+static uint8_t accepted(void) {
+    return publisher_sent.frame[FRAME_HEADER_SIZE];
+}
+
+/* Publishes to the given destination; returns 1 if a frame went out, and hands it over */
+static uint8_t publish(uint8_t destination, uint8_t type) {
+    uint32_t before = publisher_sent.count;
+    uint8_t value = 0x5A;
+
+    asmart_comm_send_notification_to(&publisher, destination, type, &value, 1);
+    if (publisher_sent.count == before) {
+        return 0;
+    }
+    asmart_comm_receive_bytes(&subscriber, publisher_sent.frame, publisher_sent.length);
+    asmart_comm_handler(&subscriber);
+    return 1;
+}
+
+static void test_subscribe_publish_unsubscribe(void) {
+    init_pair();
+
+    /* Nobody subscribed: the topic stays off the wire, other notifications do not */
+    CHECK(!publish(SUBSCRIBER_ADDRESS, TOPIC));
+    CHECK(!publish(ADDRESS_BROADCAST, TOPIC));
+    CHECK(publish(SUBSCRIBER_ADDRESS, PLAIN_NOTIFICATION));
+
+    asmart_comm_subscribe(&subscriber, PUBLISHER_ADDRESS, TOPIC, 0, 0);
+    exchange();
+    CHECK(accepted() == 1 && subscriber.mapping_table_count == 0);
+
+    /* To the subscriber and to broadcast, not to another node */
+    CHECK(publish(SUBSCRIBER_ADDRESS, TOPIC) && topic_notifications == 1);
+    CHECK(publish(ADDRESS_BROADCAST, TOPIC) && topic_notifications == 2);
+    CHECK(!publish(OTHER_SUBSCRIBERS, TOPIC));
+
+    asmart_comm_unsubscribe(&subscriber, PUBLISHER_ADDRESS, TOPIC);
+    exchange();
+    CHECK(!publish(SUBSCRIBER_ADDRESS, TOPIC) && topic_notifications == 2);
+}
+
+static void test_rate_limit_and_decimation(void) {
+    init_pair();
+
+    /* Every second publication, at most one per interval */
+    asmart_comm_subscribe(&subscriber, PUBLISHER_ADDRESS, TOPIC, MIN_INTERVAL_MS, 2);
+    exchange();
+    CHECK(!publish(SUBSCRIBER_ADDRESS, TOPIC));
+    CHECK(publish(SUBSCRIBER_ADDRESS, TOPIC));
+    CHECK(!publish(SUBSCRIBER_ADDRESS, TOPIC));
+    CHECK(!publish(SUBSCRIBER_ADDRESS, TOPIC));
+    asmart_test_now_ms += MIN_INTERVAL_MS;
+    CHECK(publish(SUBSCRIBER_ADDRESS, TOPIC) && topic_notifications == 2);
+
+    /* Subscribing again changes the limits */
+    asmart_comm_subscribe(&subscriber, PUBLISHER_ADDRESS, TOPIC, 0, 0);
+    exchange();
+    CHECK(publish(SUBSCRIBER_ADDRESS, TOPIC) && publish(SUBSCRIBER_ADDRESS, TOPIC));
+}
+
+static void test_table_full(void) {
+    init_pair();
+
+    /* Other nodes hold every entry */
+    for (uint8_t i = 0; i < SUBSCRIPTION_ENTRIES; i++) {
+        CHECK(asmart_pubsub_subscribe(&publisher.pubsub, OTHER_SUBSCRIBERS + i, TOPIC, 0, 0));
+    }
+
+    /* Refused, and the topic is not sent to the node */
+    asmart_comm_subscribe(&subscriber, PUBLISHER_ADDRESS, TOPIC, 0, 0);
+    exchange();
+    CHECK(accepted() == 0);
+    CHECK(!publish(SUBSCRIBER_ADDRESS, TOPIC));
+    CHECK(publish(OTHER_SUBSCRIBERS, TOPIC));
+
+    /* A subscriber already in the table can still change its limits */
+    CHECK(asmart_pubsub_subscribe(&publisher.pubsub, OTHER_SUBSCRIBERS, TOPIC, MIN_INTERVAL_MS, 0));
+
+    /* Once an entry is free the node gets it */
+    asmart_pubsub_unsubscribe(&publisher.pubsub, OTHER_SUBSCRIBERS, TOPIC);
+    asmart_comm_subscribe(&subscriber, PUBLISHER_ADDRESS, TOPIC, 0, 0);
+    exchange();
+    CHECK(accepted() == 1);
+    CHECK(publish(SUBSCRIBER_ADDRESS, TOPIC) && topic_notifications == 1);
+}
+#endif
+
+int main(void) {
+#if ASMART_COMM_PUBSUB
+    ASMART_TEST_RUN(test_subscribe_publish_unsubscribe);
+    ASMART_TEST_RUN(test_rate_limit_and_decimation);
+    ASMART_TEST_RUN(test_table_full);
+#endif
+    return asmart_test_result();
+}
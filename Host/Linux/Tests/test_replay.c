@@ -0,0 +1,160 @@
+/*
+ * Response replay cache: a repeated command is answered again or dropped, never run twice.
+ */
+#include <string.h>
+#include "asmart_comm_handler.h"
+#include "asmart_test.h"
+
+#define CONTROLLER_ADDRESS 0x01
+#define NODE_ADDRESS 0x10
+#define ECHO_COMMAND 0x10  // Answered at once with its payload
+#define LARGE_COMMAND 0x11  // Answered at once with a response too large to keep
+#define LATER_COMMAND 0x12  // Not answered from the callback
+
+// Frames a Handler Sent
+typedef struct {
+    uint8_t frame[TRANSMIT_BUFFER_SIZE];
+    uint16_t length;
+    uint32_t count;
+} SentFrames_t;
+
+static aSmart_Comm_Handler_t controller;
+static aSmart_Comm_Handler_t node;
+static SentFrames_t controller_sent;
+static SentFrames_t node_sent;
+static uint32_t commands_run;
+static uint32_t responses;
+static uint32_t timeouts;
+
+static void keep_frame(void* context, uint8_t destination, const uint8_t* frame, uint16_t length) {
+    SentFrames_t* sent = (SentFrames_t*)context;
+
+    (void)destination;
+    memcpy(sent->frame, frame, length);
+    sent->length = length;
+    sent->count++;
+}
+
+static void node_callback(uint8_t message_type, uint8_t command_type, uint16_t sequence_number, uint8_t* payload, uint16_t length) {
+    static uint8_t large[REPLAY_CACHE_FRAME_SIZE];
+
+    if (message_type != MSG_TYPE_COMMAND) {
+        return;
+    }
+    commands_run++;
+    if (command_type == ECHO_COMMAND) {
+        asmart_comm_send_response(&node, sequence_number, command_type, payload, length);
+    }
+    else if (command_type == LARGE_COMMAND) {
+        memset(large, 0x5A, sizeof(large));
+        asmart_comm_send_response(&node, sequence_number, command_type, large, sizeof(large));
+    }
+}
+
+static void controller_callback(uint8_t message_type, uint8_t command_type, uint16_t sequence_number, uint8_t* payload, uint16_t length) {
+    (void)command_type;
+    (void)sequence_number;
+    (void)length;
+
+    if (message_type == MSG_TYPE_RESPONSE) {
+        responses++;
+    }
+    else if (message_type == MSG_TYPE_ERROR && payload == NULL) {
+        timeouts++;
+    }
+}
+
+static void init_pair(void) {
+    asmart_test_now_ms = 0;
+    asmart_comm_set_clock(asmart_test_clock);
+    memset(&controller_sent, 0, sizeof(controller_sent));
+    memset(&node_sent, 0, sizeof(node_sent));
+    asmart_comm_init_transport(&controller, keep_frame, &controller_sent, controller_callback);
+    asmart_comm_set_address(&controller, CONTROLLER_ADDRESS, 0);
+    asmart_comm_set_peer(&controller, NODE_ADDRESS);
+    asmart_comm_init_transport(&node, keep_frame, &node_sent, node_callback);
+    asmart_comm_set_address(&node, NODE_ADDRESS, 0);
+    commands_run = 0;
+    responses = 0;
+    timeouts = 0;
+}
+
+/* The command the controller sent last arrives at the node */
+static void deliver_command(void) {
+    asmart_comm_receive_bytes(&node, controller_sent.frame, controller_sent.length);
+    asmart_comm_handler(&node);
+}
+
+static void test_repeat_answered_from_cache(void) {
+    uint8_t payload[4] = { 1, 2, 3, 4 };
+    uint8_t response[TRANSMIT_BUFFER_SIZE];
+
+    init_pair();
+    asmart_comm_send_command(&controller, ECHO_COMMAND, payload, sizeof(payload));
+    deliver_command();
+    CHECK(commands_run == 1 && node_sent.count == 1);
+    memcpy(response, node_sent.frame, node_sent.length);
+
+    /* The response got lost, the command comes again: the same response, the callback is not run */
+    asmart_test_now_ms += 1000;
+    deliver_command();
+    CHECK(commands_run == 1);
+    CHECK(node_sent.count == 2);
+    CHECK(memcmp(node_sent.frame, response, node_sent.length) == 0);
+}
+
+static void test_repeat_without_kept_response(void) {
+    uint8_t payload[4] = { 5, 6, 7, 8 };
+
+    init_pair();
+
+    /* Response too large to keep */
+    asmart_comm_send_command(&controller, LARGE_COMMAND, payload, sizeof(payload));
+    deliver_command();
+    CHECK(commands_run == 1 && node_sent.count == 1);
+    CHECK(node_sent.length > REPLAY_CACHE_FRAME_SIZE);
+    deliver_command();
+    CHECK(commands_run == 1 && node_sent.count == 1);
+
+    /* Response still pending */
+    asmart_comm_send_command(&controller, LATER_COMMAND, payload, sizeof(payload));
+    deliver_command();
+    deliver_command();
+    CHECK(commands_run == 2 && node_sent.count == 1);
+}
+
+static void test_retransmission_window(void) {
+    uint8_t payload[4] = { 9, 10, 11, 12 };
+
+    init_pair();
+    CHECK(REPLAY_CACHE_MAX_AGE_MS >= (uint32_t)COMMAND_MAX_RETRIES * RTO_MAX_MS);
+
+    /* Every response is lost: each retransmission reaches the node until the command times out */
+    asmart_comm_send_command(&controller, ECHO_COMMAND, payload, sizeof(payload));
+    deliver_command();
+    for (uint8_t attempt = 0; attempt < COMMAND_MAX_RETRIES; attempt++) {
+        uint32_t sent = controller_sent.count;
+
+        while (controller_sent.count == sent && timeouts == 0) {
+            uint32_t wait = asmart_comm_handler(&controller);
+            CHECK(wait != ASMART_COMM_NO_DEADLINE);
+            asmart_test_now_ms += (wait > 0) ? wait : 1;
+        }
+        CHECK(timeouts == 0);
+        deliver_command();
+    }
+    CHECK(commands_run == 1);
+    CHECK(node_sent.count == 1 + COMMAND_MAX_RETRIES);
+
+    /* Long after the window, the same key is a new command */
+    asmart_test_now_ms += REPLAY_CACHE_MAX_AGE_MS + 1;
+    deliver_command();
+    CHECK(commands_run == 2);
+}
+
+int main(void) {
+    ASMART_TEST_RUN(test_repeat_answered_from_cache);
+    ASMART_TEST_RUN(test_repeat_without_kept_response);
+    ASMART_TEST_RUN(test_retransmission_window);
+    return asmart_test_result();
+}
@@ -0,0 +1,174 @@
+/*
+ * Awaitable requests: completion, timeout, a request issued again while pending and a command that cannot be sent.
+ */
+#include <string.h>
+#include "asmart_comm_handler.h"
+#include "asmart_test.h"
+
+#define CONTROLLER_ADDRESS 0x01
+#define NODE_ADDRESS 0x10
+#define ECHO_COMMAND 0x10
+
+// Frames a Handler Sent
+typedef struct {
+    uint8_t frame[TRANSMIT_BUFFER_SIZE];
+    uint16_t length;
+    uint32_t count;
+} SentFrames_t;
+
+static aSmart_Comm_Handler_t controller;
+static aSmart_Comm_Handler_t node;
+static SentFrames_t controller_sent;
+static SentFrames_t node_sent;
+static uint32_t callback_responses;
+static uint32_t completions;
+
+static void keep_frame(void* context, uint8_t destination, const uint8_t* frame, uint16_t length) {
+    SentFrames_t* sent = (SentFrames_t*)context;
+
+    (void)destination;
+    memcpy(sent->frame, frame, length);
+    sent->length = length;
+    sent->count++;
+}
+
+static void node_callback(uint8_t message_type, uint8_t command_type, uint16_t sequence_number, uint8_t* payload, uint16_t length) {
+    if (message_type == MSG_TYPE_COMMAND) {
+        asmart_comm_send_response(&node, sequence_number, command_type, payload, length);
+    }
+}
+
+static void controller_callback(uint8_t message_type, uint8_t command_type, uint16_t sequence_number, uint8_t* payload, uint16_t length) {
+    (void)command_type;
+    (void)sequence_number;
+    (void)payload;
+    (void)length;
+
+    if (message_type == MSG_TYPE_RESPONSE) {
+        callback_responses++;
+    }
+}
+
+static void count_completion(aSmart_Request_t* request) {
+    (void)request;
+    completions++;
+}
+
+static void init_pair(void) {
+    asmart_test_now_ms = 0;
+    asmart_comm_set_clock(asmart_test_clock);
+    memset(&controller_sent, 0, sizeof(controller_sent));
+    memset(&node_sent, 0, sizeof(node_sent));
+    asmart_comm_init_transport(&controller, keep_frame, &controller_sent, controller_callback);
+    asmart_comm_set_address(&controller, CONTROLLER_ADDRESS, 0);
+    asmart_comm_set_peer(&controller, NODE_ADDRESS);
+    asmart_comm_init_transport(&node, keep_frame, &node_sent, node_callback);
+    asmart_comm_set_address(&node, NODE_ADDRESS, 0);
+    callback_responses = 0;
+    completions = 0;
+}
+
+/* The given command frame reaches the node and its response comes straight back */
+static void answer(const uint8_t* frame, uint16_t length) {
+    asmart_comm_receive_bytes(&node, frame, length);
+    asmart_comm_handler(&node);
+    asmart_comm_receive_bytes(&controller, node_sent.frame, node_sent.length);
+    asmart_comm_handler(&controller);
+}
+
+static void test_done(void) {
+    static aSmart_Request_t request;
+    uint8_t payload[4] = { 1, 2, 3, 4 };
+    uint8_t response[8];
+
+    init_pair();
+    request.on_complete = count_completion;
+
+    /* Other commands before it move the Sequence Number on */
+    asmart_comm_send_command(&controller, ECHO_COMMAND, payload, sizeof(payload));
+    answer(controller_sent.frame, controller_sent.length);
+    asmart_comm_request(&controller, &request, ECHO_COMMAND, payload, sizeof(payload), response, sizeof(response));
+    CHECK(request.status == REQUEST_PENDING);
+    CHECK(request.sequence_number == controller.sequence_number);
+
+    answer(controller_sent.frame, controller_sent.length);
+    CHECK(request.status == REQUEST_DONE && completions == 1);
+    CHECK(request.response_length == sizeof(payload) && memcmp(response, payload, sizeof(payload)) == 0);
+    CHECK(callback_responses == 1);
+    CHECK(controller.pending_requests == NULL);
+}
+
+static void test_timeout(void) {
+    static aSmart_Request_t request;
+    uint8_t payload[4] = { 5, 6, 7, 8 };
+    uint8_t response[8];
+
+    init_pair();
+    asmart_comm_request(&controller, &request, ECHO_COMMAND, payload, sizeof(payload), response, sizeof(response));
+
+    /* No answer: the request completes after the last retransmission */
+    for (uint32_t wait = asmart_comm_handler(&controller); request.status == REQUEST_PENDING; wait = asmart_comm_handler(&controller)) {
+        CHECK(wait != ASMART_COMM_NO_DEADLINE);
+        asmart_test_now_ms += (wait > 0) ? wait : 1;
+    }
+    CHECK(request.status == REQUEST_TIMEOUT);
+    CHECK(controller.pending_requests == NULL && controller.mapping_table_count == 0);
+}
+
+static void test_issued_again_while_pending(void) {
+    static aSmart_Request_t request;
+    uint8_t payload[4] = { 9, 10, 11, 12 };
+    uint8_t first[TRANSMIT_BUFFER_SIZE];
+    uint16_t first_length;
+    uint8_t response[8];
+
+    init_pair();
+    request.on_complete = count_completion;
+    asmart_comm_request(&controller, &request, ECHO_COMMAND, payload, sizeof(payload), response, sizeof(response));
+    memcpy(first, controller_sent.frame, controller_sent.length);
+    first_length = controller_sent.length;
+    uint16_t first_sequence = request.sequence_number;
+
+    /* The list holds the request once, for the second command */
+    asmart_comm_request(&controller, &request, ECHO_COMMAND, payload, sizeof(payload), response, sizeof(response));
+    CHECK(request.status == REQUEST_PENDING && request.sequence_number != first_sequence);
+    CHECK(controller.pending_requests == &request && request.next == NULL);
+
+    /* The first command's response goes to the response callback, the second completes the request */
+    answer(first, first_length);
+    CHECK(request.status == REQUEST_PENDING && callback_responses == 1);
+    answer(controller_sent.frame, controller_sent.length);
+    CHECK(request.status == REQUEST_DONE && completions == 1);
+    CHECK(controller.pending_requests == NULL);
+}
+
+#if ASMART_COMM_SECURE
+static void test_send_failure(void) {
+    static aSmart_Request_t request;
+    static const uint8_t key[SECURE_KEY_SIZE] = { 0x2B, 0x7E, 0x15, 0x16, 0x28, 0xAE, 0xD2, 0xA6, 0xAB, 0xF7, 0x15, 0x88, 0x09, 0xCF, 0x4F, 0x3C };
+    uint8_t payload[ASMART_COMM_SECURE_MAX_PAYLOAD + 1];
+    uint8_t response[8];
+
+    init_pair();
+    memset(payload, 0x42, sizeof(payload));
+    request.on_complete = count_completion;
+    CHECK(asmart_comm_set_link_key(&controller, NODE_ADDRESS, key, 1));
+
+    /* Too long to be sealed: nothing is sent and nothing waits for a response */
+    asmart_comm_request(&controller, &request, ECHO_COMMAND, payload, sizeof(payload), response, sizeof(response));
+    CHECK(request.status == REQUEST_FAILED && completions == 1);
+    CHECK(controller_sent.count == 0);
+    CHECK(controller.pending_requests == NULL && controller.mapping_table_count == 0);
+    CHECK(asmart_comm_handler(&controller) == ASMART_COMM_NO_DEADLINE);
+}
+#endif
+
+int main(void) {
+    ASMART_TEST_RUN(test_done);
+    ASMART_TEST_RUN(test_timeout);
+    ASMART_TEST_RUN(test_issued_again_while_pending);
+#if ASMART_COMM_SECURE
+    ASMART_TEST_RUN(test_send_failure);
+#endif
+    return asmart_test_result();
+}
@@ -0,0 +1,125 @@
+/*
+ * RS485 response gap: a frame sent before the gap has passed is held instead of waited for, the
+ * handler's deadline covers the rest of the gap and the frame goes out once it has passed.
+ */
+#include <string.h>
+#include <unistd.h>
+#include "asmart_comm_handler.h"
+#include "asmart_test.h"
+
+#define CONTROLLER_ADDRESS 0x01
+#define NODE_ADDRESS 0x10
+#define ECHO_COMMAND 0x10
+#define TEST_NOTIFICATION 0x30
+#define TEST_GAP_US 20000  // Long enough for the test to send within it; the gap runs on the µs bus clock
+
+// Frames a Handler Sent
+typedef struct {
+    uint8_t frame[TRANSMIT_BUFFER_SIZE];
+    uint16_t length;
+    uint32_t count;
+} SentFrames_t;
+
+static aSmart_Comm_Handler_t controller;
+static aSmart_Comm_Handler_t node;
+static SentFrames_t controller_sent;
+static SentFrames_t node_sent;
+
+static void keep_frame(void* context, uint8_t destination, const uint8_t* frame, uint16_t length) {
+    SentFrames_t* sent = (SentFrames_t*)context;
+
+    (void)destination;
+    memcpy(sent->frame, frame, length);
+    sent->length = length;
+    sent->count++;
+}
+
+static void node_callback(uint8_t message_type, uint8_t command_type, uint16_t sequence_number, uint8_t* payload, uint16_t length) {
+    if (message_type == MSG_TYPE_COMMAND) {
+        asmart_comm_send_response(&node, sequence_number, command_type, payload, length);
+    }
+}
+
+static void ignore(uint8_t message_type, uint8_t command_type, uint16_t sequence_number, uint8_t* payload, uint16_t length) {
+    (void)message_type;
+    (void)command_type;
+    (void)sequence_number;
+    (void)payload;
+    (void)length;
+}
+
+/* The node's link has a response gap, which starts now */
+static void init_pair(void) {
+    aSmart_Rs485Timing_t timing = { 115200, 0, 0, TEST_GAP_US };
+
+    asmart_test_now_ms = 0;
+    asmart_comm_set_clock(asmart_test_clock);
+    memset(&controller_sent, 0, sizeof(controller_sent));
+    memset(&node_sent, 0, sizeof(node_sent));
+    asmart_comm_init_transport(&controller, keep_frame, &controller_sent, ignore);
+    asmart_comm_set_address(&controller, CONTROLLER_ADDRESS, 0);
+    asmart_comm_set_peer(&controller, NODE_ADDRESS);
+    asmart_comm_init_transport(&node, keep_frame, &node_sent, node_callback);
+    asmart_comm_set_address(&node, NODE_ADDRESS, 0);
+    asmart_comm_set_peer(&node, CONTROLLER_ADDRESS);
+
+    /* A transport has no driver enable control, the gap is taken all the same */
+    CHECK(asmart_comm_set_rs485(&node, &timing) == 0);
+    CHECK(node.rs485.response_gap_us == TEST_GAP_US);
+}
+
+/* Waits out the deadline the handler returned, on the bus clock */
+static uint32_t wait_deadline(void) {
+    uint32_t wait = asmart_comm_handler(&node);
+
+    if (wait != ASMART_COMM_NO_DEADLINE) {
+        usleep(wait * 1000);
+    }
+    return wait;
+}
+
+static void test_send_held_for_gap(void) {
+    uint8_t value = 0x5A;
+
+    init_pair();
+
+    /* Sent at once: held, the send call returns and the deadline is the rest of the gap */
+    asmart_comm_send_notification(&node, TEST_NOTIFICATION, &value, 1);
+    CHECK(node_sent.count == 0 && node.held_count == 1);
+    uint32_t wait = wait_deadline();
+    CHECK(wait >= 1 && wait <= (TEST_GAP_US + 999) / 1000);
+
+    /* The gap has passed: the frame goes out and nothing is left to wait for */
+    CHECK(asmart_comm_handler(&node) == ASMART_COMM_NO_DEADLINE);
+    CHECK(node_sent.count == 1 && node.held_count == 0);
+
+    /* With the bus quiet for longer than the gap, a frame goes straight out */
+    asmart_comm_send_notification(&node, TEST_NOTIFICATION, &value, 1);
+    CHECK(node_sent.count == 2 && node.held_count == 0);
+}
+
+static void test_response_after_gap(void) {
+    uint8_t payload[4] = { 1, 2, 3, 4 };
+
+    init_pair();
+    usleep(TEST_GAP_US);
+
+    /* The command's last byte restarts the gap, the response waits for it in the hold */
+    asmart_comm_send_command(&controller, ECHO_COMMAND, payload, sizeof(payload));
+    asmart_comm_receive_bytes(&node, controller_sent.frame, controller_sent.length);
+    wait_deadline();
+    CHECK(node_sent.count == 0 && node.held_count == 1);
+    asmart_comm_handler(&node);
+    CHECK(node_sent.count == 1 && node.held_count == 0);
+
+    /* It is the response to the command */
+    asmart_comm_receive_bytes(&controller, node_sent.frame, node_sent.length);
+    asmart_comm_handler(&controller);
+    CHECK(controller.mapping_table_count == 0);
+}
+
+int main(void) {
+    ASMART_TEST_RUN(test_send_held_for_gap);
+    ASMART_TEST_RUN(test_response_after_gap);
+    return asmart_test_result();
+}
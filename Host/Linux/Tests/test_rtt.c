@@ -0,0 +1,174 @@
+/*
+ * Adaptive command timeouts: the RTT estimator, Karn's algorithm, backoff and fixed timeouts.
+ */
+#include <string.h>
+#include "asmart_comm_handler.h"
+#include "asmart_test.h"
+
+#define CONTROLLER_ADDRESS 0x01
+#define NODE_ADDRESS 0x10
+#define ECHO_COMMAND 0x10
+#define SLOW_COMMAND 0x11  // Has a fixed timeout
+#define SLOW_TIMEOUT_MS 15000  // Above RTO_MAX_MS
+
+// Frames a Handler Sent
+typedef struct {
+    uint8_t frame[TRANSMIT_BUFFER_SIZE];
+    uint16_t length;
+    uint32_t count;
+} SentFrames_t;
+
+static aSmart_Comm_Handler_t controller;
+static aSmart_Comm_Handler_t node;
+static SentFrames_t controller_sent;
+static SentFrames_t node_sent;
+static uint32_t responses;
+
+static void keep_frame(void* context, uint8_t destination, const uint8_t* frame, uint16_t length) {
+    SentFrames_t* sent = (SentFrames_t*)context;
+
+    (void)destination;
+    memcpy(sent->frame, frame, length);
+    sent->length = length;
+    sent->count++;
+}
+
+static void node_callback(uint8_t message_type, uint8_t command_type, uint16_t sequence_number, uint8_t* payload, uint16_t length) {
+    if (message_type == MSG_TYPE_COMMAND) {
+        asmart_comm_send_response(&node, sequence_number, command_type, payload, length);
+    }
+}
+
+static void controller_callback(uint8_t message_type, uint8_t command_type, uint16_t sequence_number, uint8_t* payload, uint16_t length) {
+    (void)command_type;
+    (void)sequence_number;
+    (void)payload;
+    (void)length;
+
+    if (message_type == MSG_TYPE_RESPONSE) {
+        responses++;
+    }
+}
+
+static void init_pair(void) {
+    asmart_test_now_ms = 0;
+    asmart_comm_set_clock(asmart_test_clock);
+    memset(&controller_sent, 0, sizeof(controller_sent));
+    memset(&node_sent, 0, sizeof(node_sent));
+    asmart_comm_init_transport(&controller, keep_frame, &controller_sent, controller_callback);
+    asmart_comm_set_address(&controller, CONTROLLER_ADDRESS, 0);
+    asmart_comm_set_peer(&controller, NODE_ADDRESS);
+    asmart_comm_init_transport(&node, keep_frame, &node_sent, node_callback);
+    asmart_comm_set_address(&node, NODE_ADDRESS, 0);
+    responses = 0;
+}
+
+/* The last command reaches the node after the given time and its response comes straight back */
+static void answer_after(uint32_t delay_ms) {
+    asmart_test_now_ms += delay_ms;
+    asmart_comm_receive_bytes(&node, controller_sent.frame, controller_sent.length);
+    asmart_comm_handler(&node);
+    asmart_comm_receive_bytes(&controller, node_sent.frame, node_sent.length);
+    asmart_comm_handler(&controller);
+}
+
+static void test_estimator(void) {
+    aSmart_RttEstimator_t rtt;
+
+    asmart_rtt_init(&rtt, COMMAND_TIMEOUT_MS);
+    CHECK(asmart_rtt_timeout(&rtt) == COMMAND_TIMEOUT_MS);
+
+    /* First sample R: SRTT = R, RTTVAR = R / 2, RTO = SRTT + 4 RTTVAR */
+    asmart_rtt_sample(&rtt, 100);
+    CHECK(asmart_rtt_timeout(&rtt) == 300);
+
+    /* Same sample again: RTTVAR = 3/4 RTTVAR */
+    asmart_rtt_sample(&rtt, 100);
+    CHECK(asmart_rtt_timeout(&rtt) == 250);
+
+    /* Backoff doubles up to RTO_MAX_MS, a sample clears it */
+    asmart_rtt_backoff(&rtt);
+    CHECK(asmart_rtt_timeout(&rtt) == 500);
+    for (uint8_t i = 0; i < 16; i++) {
+        asmart_rtt_backoff(&rtt);
+    }
+    CHECK(asmart_rtt_timeout(&rtt) == RTO_MAX_MS);
+    asmart_rtt_sample(&rtt, 100);
+    CHECK(rtt.backoff == 0 && asmart_rtt_timeout(&rtt) < 300);
+
+    /* Lower bound */
+    asmart_rtt_init(&rtt, 0);
+    CHECK(asmart_rtt_timeout(&rtt) == RTO_MIN_MS);
+}
+
+static void test_karn(void) {
+    uint8_t payload[4] = { 1, 2, 3, 4 };
+
+    init_pair();
+
+    /* A command answered on the first attempt is measured */
+    asmart_comm_send_command(&controller, ECHO_COMMAND, payload, sizeof(payload));
+    answer_after(100);
+    CHECK(responses == 1);
+    CHECK(asmart_rtt_timeout(&controller.rtt) == 300);
+
+    /* A retransmitted one is not: its response may answer either attempt */
+    asmart_comm_send_command(&controller, ECHO_COMMAND, payload, sizeof(payload));
+    asmart_test_now_ms += 301;
+    asmart_comm_handler(&controller);
+    CHECK(controller_sent.count == 3);
+    answer_after(10);
+    CHECK(responses == 2);
+    CHECK(controller.rtt.rto == 300 && controller.rtt.backoff == 1);
+
+    /* The backed-off timeout holds until the next clean sample */
+    asmart_comm_send_command(&controller, ECHO_COMMAND, payload, sizeof(payload));
+    answer_after(100);
+    CHECK(responses == 3);
+    CHECK(controller.rtt.backoff == 0);
+}
+
+static void test_backoff_once_per_expiry(void) {
+    uint8_t payload[4] = { 5, 6, 7, 8 };
+    uint8_t commands = (MAPPING_TABLE_ENTRIES < RETRANSMIT_SLOTS) ? MAPPING_TABLE_ENTRIES : RETRANSMIT_SLOTS;
+
+    init_pair();
+    CHECK(commands >= 2);
+    asmart_comm_send_command(&controller, ECHO_COMMAND, payload, sizeof(payload));
+    answer_after(100);
+    CHECK(asmart_rtt_timeout(&controller.rtt) == 300);
+
+    for (uint8_t i = 0; i < commands; i++) {
+        asmart_comm_send_command(&controller, ECHO_COMMAND, payload, sizeof(payload));
+    }
+
+    /* All of them expire together and are retransmitted in one pass */
+    asmart_test_now_ms += 301;
+    asmart_comm_handler(&controller);
+    CHECK(controller_sent.count == 1u + 2u * commands);
+    CHECK(controller.rtt.backoff == 1);
+    CHECK(asmart_rtt_timeout(&controller.rtt) == 600);
+}
+
+static void test_fixed_timeout_not_clamped(void) {
+    uint8_t payload[4] = { 9, 10, 11, 12 };
+
+    init_pair();
+    asmart_comm_set_command_timeout(&controller, SLOW_COMMAND, SLOW_TIMEOUT_MS);
+    asmart_comm_send_command(&controller, SLOW_COMMAND, payload, sizeof(payload));
+    CHECK(asmart_comm_handler(&controller) == SLOW_TIMEOUT_MS + 1);
+
+    /* The retransmission waits twice as long, beyond RTO_MAX_MS, and the link does not back off */
+    asmart_test_now_ms += SLOW_TIMEOUT_MS + 1;
+    CHECK(asmart_comm_handler(&controller) == 2 * SLOW_TIMEOUT_MS + 1);
+    CHECK(controller_sent.count == 2);
+    CHECK(controller.rtt.backoff == 0);
+}
+
+int main(void) {
+    ASMART_TEST_RUN(test_estimator);
+    ASMART_TEST_RUN(test_karn);
+    ASMART_TEST_RUN(test_backoff_once_per_expiry);
+    ASMART_TEST_RUN(test_fixed_timeout_not_clamped);
+    return asmart_test_result();
+}
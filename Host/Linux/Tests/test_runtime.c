@@ -0,0 +1,206 @@
+/*
+ * Multi-core host runtime: several socket pairs over two reactors and four workers. The messages
+ * of every link reach its callback in the order they were sent, and a worker stuck in a callback
+ * does not stop the other links queued at it, which the idle workers steal.
+ */
+#include <string.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include "asmart_comm_runtime.h"
+#include "asmart_test.h"
+
+#define TEST_COMMAND 0x10
+#define BLOCK_NOTIFICATION 0x30
+#define TEST_PAIRS 4  // Links 2i (client) and 2i + 1 (server); link n has worker n % TEST_WORKERS as home
+#define TEST_REACTORS 2
+#define TEST_WORKERS 4
+#define TEST_WINDOW 4  // Commands in flight per pair
+#define TEST_COMMANDS 500  // Commands per pair
+#define TEST_WAIT_MS 5000
+
+// Both Ends of a Socket Pair
+typedef struct {
+    uint32_t sent;  // Counter carried by the next command
+    uint32_t next_command;  // Counter the server expects next
+    uint32_t next_response;  // Counter the client expects next
+    atomic_ulong responses;
+    atomic_ulong reordered;  // Commands or responses out of order
+    atomic_ulong failed;  // Timeouts, errors and refused sends
+} TestPair_t;
+
+static aSmart_Runtime_t runtime;
+static aSmart_Link_t* clients[TEST_PAIRS];
+static TestPair_t pairs[TEST_PAIRS];
+static atomic_uchar blocking;  // The server of pair 0 is stuck in its callback
+static atomic_uchar released;
+
+static void send_next(aSmart_Link_t* link, TestPair_t* pair) {
+    uint8_t payload[sizeof(uint32_t)];
+
+    memcpy(payload, &pair->sent, sizeof(payload));
+    pair->sent++;
+    if (!asmart_runtime_send_command(link, TEST_COMMAND, payload, sizeof(payload))) {
+        atomic_fetch_add(&pair->failed, 1);
+    }
+}
+
+/* Checks the counter of a message against the one expected on its link */
+static void check_order(TestPair_t* pair, uint32_t* next, const uint8_t* payload, uint16_t length) {
+    uint32_t counter;
+
+    if (length != sizeof(counter)) {
+        atomic_fetch_add(&pair->failed, 1);
+        return;
+    }
+    memcpy(&counter, payload, sizeof(counter));
+    if (counter != *next) {
+        atomic_fetch_add(&pair->reordered, 1);
+    }
+    *next = counter + 1;
+}
+
+static void client_callback(aSmart_Link_t* link, uint8_t message_type, uint8_t command_type, uint16_t sequence_number, uint8_t* payload, uint16_t length) {
+    TestPair_t* pair = (TestPair_t*)link->context;
+    (void)command_type;
+    (void)sequence_number;
+
+    if (message_type != MSG_TYPE_RESPONSE) {
+        atomic_fetch_add(&pair->failed, 1);
+        return;
+    }
+    check_order(pair, &pair->next_response, payload, length);
+    atomic_fetch_add(&pair->responses, 1);
+    if (pair->sent < TEST_COMMANDS) {
+        send_next(link, pair);
+    }
+}
+
+static void server_callback(aSmart_Link_t* link, uint8_t message_type, uint8_t command_type, uint16_t sequence_number, uint8_t* payload, uint16_t length) {
+    TestPair_t* pair = (TestPair_t*)link->context;
+
+    if (message_type == MSG_TYPE_NOTIFICATION && command_type == BLOCK_NOTIFICATION) {
+        /* Holds this worker until released, or gives up so the test can end */
+        uint32_t start = HAL_GetTick();
+
+        atomic_store(&blocking, 1);
+        while (!atomic_load(&released) && HAL_GetTick() - start < TEST_WAIT_MS) {
+            usleep(1000);
+        }
+        atomic_store(&blocking, 0);
+        return;
+    }
+    if (message_type != MSG_TYPE_COMMAND) {
+        return;
+    }
+    check_order(pair, &pair->next_command, payload, length);
+    if (!asmart_runtime_send_response(link, sequence_number, command_type, payload, length)) {
+        atomic_fetch_add(&pair->failed, 1);
+    }
+}
+
+/* Socket pairs, link 2i the client and 2i + 1 the server of pair i */
+static void open_pairs(void) {
+    memset(pairs, 0, sizeof(pairs));
+    atomic_store(&blocking, 0);
+    atomic_store(&released, 0);
+    CHECK(asmart_runtime_init(&runtime, TEST_REACTORS, TEST_WORKERS, 2 * TEST_PAIRS, HOST_ENGINE_EPOLL) == 0);
+    for (uint8_t i = 0; i < TEST_PAIRS; i++) {
+        int fds[2];
+
+        CHECK(socketpair(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0, fds) == 0);
+        clients[i] = asmart_runtime_attach(&runtime, fds[0], client_callback, &pairs[i]);
+        CHECK(clients[i] != NULL);
+        CHECK(asmart_runtime_attach(&runtime, fds[1], server_callback, &pairs[i]) != NULL);
+    }
+}
+
+/* Fills the window of pairs first..TEST_PAIRS - 1 */
+static void start_commands(uint8_t first) {
+    for (uint8_t i = first; i < TEST_PAIRS; i++) {
+        for (uint8_t j = 0; j < TEST_WINDOW; j++) {
+            send_next(clients[i], &pairs[i]);
+        }
+    }
+}
+
+/* Waits until pairs first..TEST_PAIRS - 1 have all their responses, 1 if they have */
+static uint8_t wait_commands(uint8_t first) {
+    uint32_t start = HAL_GetTick();
+
+    while (HAL_GetTick() - start < TEST_WAIT_MS) {
+        uint8_t done = 1;
+
+        for (uint8_t i = first; i < TEST_PAIRS; i++) {
+            done = done && atomic_load(&pairs[i].responses) == TEST_COMMANDS;
+        }
+        if (done) {
+            return 1;
+        }
+        usleep(1000);
+    }
+    return 0;
+}
+
+static void test_order_per_link(void) {
+    open_pairs();
+    start_commands(0);
+    CHECK(asmart_runtime_start(&runtime) == 0);
+    uint8_t done = wait_commands(0);
+
+    uint64_t executed = 0;
+    for (uint16_t i = 0; i < runtime.worker_count; i++) {
+        executed += atomic_load(&runtime.workers[i].executed);
+    }
+    uint64_t dropped = 0;
+    for (uint16_t i = 0; i < runtime.link_count; i++) {
+        dropped += atomic_load(&runtime.links[i]->dropped);
+    }
+    asmart_runtime_stop(&runtime);
+
+    /* Every link made progress and saw its messages in order */
+    CHECK(done);
+    for (uint8_t i = 0; i < TEST_PAIRS; i++) {
+        CHECK(pairs[i].next_command == TEST_COMMANDS && pairs[i].next_response == TEST_COMMANDS);
+        CHECK(atomic_load(&pairs[i].reordered) == 0 && atomic_load(&pairs[i].failed) == 0);
+    }
+    CHECK(executed == 2u * TEST_PAIRS * TEST_COMMANDS && dropped == 0);
+}
+
+static void test_stuck_worker_stolen_from(void) {
+    uint8_t value = 0;
+
+    open_pairs();
+
+    /* The server of pair 0 takes its home worker and keeps it */
+    CHECK(asmart_runtime_send_notification(clients[0], BLOCK_NOTIFICATION, &value, 1));
+    CHECK(asmart_runtime_start(&runtime) == 0);
+    uint32_t start = HAL_GetTick();
+    while (!atomic_load(&blocking) && HAL_GetTick() - start < TEST_WAIT_MS) {
+        usleep(1000);
+    }
+    uint8_t blocked = atomic_load(&blocking);
+
+    /* The other links, pair 2's server among them with the same home, still get through */
+    start_commands(1);
+    uint8_t done = wait_commands(1);
+    uint8_t still_blocked = atomic_load(&blocking);
+    atomic_store(&released, 1);
+
+    uint64_t stolen = 0;
+    for (uint16_t i = 0; i < runtime.worker_count; i++) {
+        stolen += atomic_load(&runtime.workers[i].stolen);
+    }
+    asmart_runtime_stop(&runtime);
+
+    CHECK(blocked && done && still_blocked);
+    CHECK(stolen > 0);
+    for (uint8_t i = 1; i < TEST_PAIRS; i++) {
+        CHECK(atomic_load(&pairs[i].reordered) == 0 && atomic_load(&pairs[i].failed) == 0);
+    }
+}
+
+int main(void) {
+    ASMART_TEST_RUN(test_order_per_link);
+    ASMART_TEST_RUN(test_stuck_worker_stolen_from);
+    return asmart_test_result();
+}
@@ -0,0 +1,332 @@
+/*
+ * Bulk frame scanner: every instruction set finds what the byte-wise parser finds, on clean
+ * streams with random payloads, on payloads made of STX, SOH and ETX bytes or of whole frames,
+ * and on frames mixed with noise, where it may find more but never less.
+ */
+#include <stdlib.h>
+#include <string.h>
+#include "asmart_comm_handler.h"
+#include "asmart_comm_scan.h"
+#include "asmart_test.h"
+
+#define CONTROLLER_ADDRESS 0x01
+#define NODE_ADDRESS 0x10
+#define TEST_NOTIFICATION 0x30
+#define STREAM_SIZE 65536
+#define MAX_SPANS 8192
+
+// Frames Found in a Stream, in stream order
+typedef struct {
+    aSmart_FrameSpan_t span[MAX_SPANS];
+    size_t count;
+} SpanList_t;
+
+// Last Frame a Handler Sent
+typedef struct {
+    uint8_t frame[TRANSMIT_BUFFER_SIZE];
+    uint16_t length;
+} SentFrame_t;
+
+static aSmart_Comm_Handler_t standard;  // Sends standard frames
+static aSmart_Comm_Handler_t compact;  // Sends compact frames once negotiated
+static aSmart_Comm_Handler_t node;
+static SentFrame_t standard_sent;
+static SentFrame_t compact_sent;
+static SentFrame_t node_sent;
+static uint8_t stream[STREAM_SIZE];
+static size_t stream_length;
+static SpanList_t expected;  // Frames put into the stream
+static SpanList_t parsed;
+static SpanList_t scanned;
+static SpanList_t scanned_scalar;
+static uint32_t random_state;
+
+static void keep_frame(void* context, uint8_t destination, const uint8_t* frame, uint16_t length) {
+    SentFrame_t* sent = (SentFrame_t*)context;
+
+    (void)destination;
+    memcpy(sent->frame, frame, length);
+    sent->length = length;
+}
+
+static void ignore(uint8_t message_type, uint8_t command_type, uint16_t sequence_number, uint8_t* payload, uint16_t length) {
+    (void)message_type;
+    (void)command_type;
+    (void)sequence_number;
+    (void)payload;
+    (void)length;
+}
+
+static uint8_t next_random(void) {
+    random_state ^= random_state << 13;
+    random_state ^= random_state >> 17;
+    random_state ^= random_state << 5;
+    return (uint8_t)(random_state >> 11);
+}
+
+/* One handler sending standard frames, one that agreed on the compact header with the node */
+static void init_senders(void) {
+    asmart_test_now_ms = 0;
+    asmart_comm_set_clock(asmart_test_clock);
+    asmart_comm_init_transport(&standard, keep_frame, &standard_sent, ignore);
+    asmart_comm_set_address(&standard, CONTROLLER_ADDRESS, 0);
+    asmart_comm_set_peer(&standard, NODE_ADDRESS);
+    asmart_comm_init_transport(&compact, keep_frame, &compact_sent, ignore);
+    asmart_comm_set_address(&compact, CONTROLLER_ADDRESS, 0);
+    asmart_comm_set_peer(&compact, NODE_ADDRESS);
+    asmart_comm_init_transport(&node, keep_frame, &node_sent, ignore);
+    asmart_comm_set_address(&node, NODE_ADDRESS, 0);
+
+    asmart_comm_negotiate(&compact, NODE_ADDRESS);
+    asmart_comm_receive_bytes(&node, compact_sent.frame, compact_sent.length);
+    asmart_comm_handler(&node);
+    asmart_comm_receive_bytes(&compact, node_sent.frame, node_sent.length);
+    asmart_comm_handler(&compact);
+
+    stream_length = 0;
+    expected.count = 0;
+    random_state = 0x2545F491;
+}
+
+static void add_span(SpanList_t* list, size_t offset, uint16_t length) {
+    if (list->count < MAX_SPANS) {
+        list->span[list->count].offset = offset;
+        list->span[list->count].length = length;
+        list->count++;
+    }
+}
+
+static void append(const uint8_t* data, uint16_t length) {
+    if (stream_length + length <= STREAM_SIZE) {
+        memcpy(&stream[stream_length], data, length);
+        stream_length += length;
+    }
+}
+
+/* Sends the payload as a notification and appends the frame to the stream, 0 once it is full */
+static uint8_t append_frame(uint8_t* payload, uint16_t length, uint8_t use_compact) {
+    SentFrame_t* sent = use_compact ? &compact_sent : &standard_sent;
+
+    asmart_comm_send_notification(use_compact ? &compact : &standard, TEST_NOTIFICATION, payload, length);
+    if (stream_length + sent->length > STREAM_SIZE) {
+        return 0;
+    }
+    add_span(&expected, stream_length, sent->length);
+    append(sent->frame, sent->length);
+    return 1;
+}
+
+static void random_payload(uint8_t* payload, uint16_t length) {
+    for (uint16_t i = 0; i < length; i++) {
+        payload[i] = next_random();
+    }
+}
+
+/* The byte-wise parser's frames, as the receive path finds them */
+static void parse_stream(void) {
+    static uint8_t buffer[RECEIVE_BUFFER_SIZE];
+    aSmart_Parser_t parser;
+
+    parsed.count = 0;
+    asmart_parser_init(&parser, buffer, sizeof(buffer), NULL, NULL);
+    for (size_t i = 0; i < stream_length; i++) {
+        if (asmart_parser_feed(&parser, stream[i]) == PARSE_FRAME) {
+            add_span(&parsed, i + 1 - parser.frame_length, parser.frame_length);
+        }
+    }
+}
+
+static void keep_spans(void* context, const uint8_t* data, const aSmart_FrameSpan_t* spans, size_t count) {
+    (void)data;
+
+    for (size_t i = 0; i < count; i++) {
+        add_span((SpanList_t*)context, spans[i].offset, spans[i].length);
+    }
+}
+
+/* Scans the whole stream on one instruction set, 0 if the CPU does not have it */
+static uint8_t scan_stream(scan_isa_t isa, SpanList_t* list) {
+    asmart_scan_set_isa(isa);
+    if (asmart_scan_isa() != isa) {
+        return 0;
+    }
+    list->count = 0;
+    asmart_scan_buffer(stream, stream_length, keep_spans, list, NULL);
+    return 1;
+}
+
+static uint8_t same_spans(const SpanList_t* a, const SpanList_t* b) {
+    if (a->count != b->count) {
+        return 0;
+    }
+    for (size_t i = 0; i < a->count; i++) {
+        if (a->span[i].offset != b->span[i].offset || a->span[i].length != b->span[i].length) {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+/* Every span of a is in b; both are in stream order */
+static uint8_t contains_spans(const SpanList_t* b, const SpanList_t* a) {
+    size_t j = 0;
+
+    for (size_t i = 0; i < a->count; i++) {
+        while (j < b->count && b->span[j].offset < a->span[i].offset) {
+            j++;
+        }
+        if (j == b->count || b->span[j].offset != a->span[i].offset || b->span[j].length != a->span[i].length) {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+/* On a clean stream every instruction set and the parser find exactly the frames put in */
+static void check_clean_stream(void) {
+    parse_stream();
+    CHECK(expected.count > 0 && same_spans(&parsed, &expected));
+    for (int isa = SCAN_SCALAR; isa <= SCAN_AVX2; isa++) {
+        if (scan_stream((scan_isa_t)isa, &scanned)) {
+            CHECK(same_spans(&scanned, &expected));
+        }
+    }
+}
+
+static void test_random_payloads(void) {
+    uint8_t payload[ASMART_COMM_MAX_PAYLOAD];
+
+    /* Both layouts, any length, payload bytes anything including STX, SOH and ETX */
+    init_senders();
+    for (;;) {
+        uint16_t length = next_random() % (ASMART_COMM_MAX_PAYLOAD + 1);
+
+        random_payload(payload, length);
+        if (!append_frame(payload, length, next_random() & 1)) {
+            break;
+        }
+    }
+    check_clean_stream();
+
+    /* Both layouts went in */
+    uint8_t layouts = 0;
+    for (size_t i = 0; i < expected.count; i++) {
+        layouts |= (stream[expected.span[i].offset] == SOH) ? 2 : 1;
+    }
+    CHECK(layouts == (ASMART_COMM_COMPACT_HEADER ? 3 : 1));
+}
+
+static void test_marker_payloads(void) {
+    static const uint8_t markers[] = { STX, SOH, ETX };
+    uint8_t payload[ASMART_COMM_MAX_PAYLOAD];
+
+    /* Payloads of nothing but frame markers: a start candidate at every byte */
+    init_senders();
+    for (;;) {
+        uint16_t length = next_random() % (ASMART_COMM_MAX_PAYLOAD + 1);
+
+        for (uint16_t i = 0; i < length; i++) {
+            payload[i] = markers[next_random() % sizeof(markers)];
+        }
+        if (!append_frame(payload, length, next_random() & 1)) {
+            break;
+        }
+    }
+    check_clean_stream();
+}
+
+static void test_nested_frames(void) {
+    uint8_t payload[ASMART_COMM_MAX_PAYLOAD];
+    uint8_t inner[ASMART_COMM_MAX_PAYLOAD];
+
+    /* Payloads that hold a whole valid frame, which must not be taken out of its carrier */
+    init_senders();
+    for (;;) {
+        uint16_t inner_length = next_random() % (ASMART_COMM_MAX_PAYLOAD / 2);
+        uint8_t inner_compact = next_random() & 1;
+        SentFrame_t* sent = inner_compact ? &compact_sent : &standard_sent;
+
+        random_payload(inner, inner_length);
+        asmart_comm_send_notification(inner_compact ? &compact : &standard, TEST_NOTIFICATION, inner, inner_length);
+        if (sent->length > ASMART_COMM_MAX_PAYLOAD) {
+            continue;
+        }
+        uint16_t offset = next_random() % (ASMART_COMM_MAX_PAYLOAD - sent->length + 1);
+        random_payload(payload, ASMART_COMM_MAX_PAYLOAD);
+        memcpy(&payload[offset], sent->frame, sent->length);
+        if (!append_frame(payload, offset + sent->length, next_random() & 1)) {
+            break;
+        }
+    }
+    check_clean_stream();
+}
+
+static void test_frames_in_noise(void) {
+    uint8_t payload[ASMART_COMM_MAX_PAYLOAD];
+    uint8_t noise[16];
+
+    /* Random bytes between the frames, a third of them markers: frames may be lost to a
+       candidate that spans them, but the scanner never finds less than the parser */
+    init_senders();
+    for (;;) {
+        uint16_t length = next_random() % (ASMART_COMM_MAX_PAYLOAD + 1);
+        uint8_t noise_length = next_random() % sizeof(noise);
+
+        for (uint8_t i = 0; i < noise_length; i++) {
+            uint8_t byte = next_random();
+            noise[i] = (byte % 3 == 0) ? ((byte & 1) ? STX : SOH) : byte;
+        }
+        if (stream_length + noise_length > STREAM_SIZE) {
+            break;
+        }
+        append(noise, noise_length);
+        random_payload(payload, length);
+        if (!append_frame(payload, length, next_random() & 1)) {
+            break;
+        }
+    }
+
+    parse_stream();
+    CHECK(parsed.count > 0);
+    CHECK(scan_stream(SCAN_SCALAR, &scanned_scalar));
+    CHECK(contains_spans(&scanned_scalar, &parsed));
+    for (int isa = SCAN_SSE2; isa <= SCAN_AVX2; isa++) {
+        if (scan_stream((scan_isa_t)isa, &scanned)) {
+            CHECK(same_spans(&scanned, &scanned_scalar));
+        }
+    }
+}
+
+static void test_cut_frame_left(void) {
+    uint8_t payload[ASMART_COMM_MAX_PAYLOAD];
+
+    /* A stream cut inside its last frame: everything before it is consumed, the frame is kept */
+    init_senders();
+    random_payload(payload, sizeof(payload));
+    for (uint8_t i = 0; i < 4; i++) {
+        CHECK(append_frame(payload, sizeof(payload), i & 1));
+    }
+    size_t last = expected.span[expected.count - 1].offset;
+    stream_length -= 2;
+    for (int isa = SCAN_SCALAR; isa <= SCAN_AVX2; isa++) {
+        asmart_scan_set_isa((scan_isa_t)isa);
+        if (asmart_scan_isa() == (scan_isa_t)isa) {
+            aSmart_ScanStats_t stats = { 0, 0, 0 };
+
+            CHECK(asmart_scan_buffer(stream, stream_length, NULL, NULL, &stats) == last);
+            CHECK(stats.frames == expected.count - 1 && stats.rejected == 0);
+        }
+    }
+}
+
+int main(void) {
+    scan_isa_t best = asmart_scan_isa();
+
+    ASMART_TEST_RUN(test_random_payloads);
+    ASMART_TEST_RUN(test_marker_payloads);
+    ASMART_TEST_RUN(test_nested_frames);
+    ASMART_TEST_RUN(test_frames_in_noise);
+    ASMART_TEST_RUN(test_cut_frame_left);
+    asmart_scan_set_isa(best);
+    return asmart_test_result();
+}
@@ -0,0 +1,157 @@
+/*
+ * Generated schema code: Tests/Schema/asmart_comm.idl is generated into the build directory and
+ * this test links a copy of the library built with it. A command is answered through the
+ * dispatcher and the asmart_on_ handlers, a notification with a variable-length array is decoded,
+ * and a malformed payload and an unknown type are left to the response callback.
+ */
+#include <string.h>
+#include "asmart_comm_handler.h"
+#include "asmart_test.h"
+
+#define CONTROLLER_ADDRESS 0x01
+#define NODE_ADDRESS 0x10
+#define UNKNOWN_COMMAND 0x42
+
+// Frames a Handler Sent
+typedef struct {
+    uint8_t frame[TRANSMIT_BUFFER_SIZE];
+    uint16_t length;
+    uint32_t count;
+} SentFrames_t;
+
+static aSmart_Comm_Handler_t controller;
+static aSmart_Comm_Handler_t node;
+static SentFrames_t controller_sent;
+static SentFrames_t node_sent;
+static SetValveCommand_t valve_command;
+static SetValveResponse_t valve_response;
+static LevelsNotification_t levels;
+static uint32_t valve_commands;
+static uint32_t valve_responses;
+static uint32_t level_notifications;
+static uint32_t not_dispatched;
+
+static void keep_frame(void* context, uint8_t destination, const uint8_t* frame, uint16_t length) {
+    SentFrames_t* sent = (SentFrames_t*)context;
+
+    (void)destination;
+    memcpy(sent->frame, frame, length);
+    sent->length = length;
+    sent->count++;
+}
+
+/* Both ends dispatch first, as the README shows, and count what is left over */
+static void response_callback(uint8_t message_type, uint8_t command_type, uint16_t sequence_number, uint8_t* payload, uint16_t length) {
+    if (!asmart_comm_schema_dispatch(message_type, command_type, sequence_number, payload, length)) {
+        not_dispatched++;
+    }
+}
+
+/* Handlers of the generated code, overriding the weak defaults */
+void asmart_on_set_valve_command(uint16_t sequence_number, const SetValveCommand_t* message) {
+    SetValveResponse_t response = { message->state };
+
+    valve_command = *message;
+    valve_commands++;
+    asmart_send_set_valve_response(&node, sequence_number, &response);
+}
+
+void asmart_on_set_valve_response(uint16_t sequence_number, const SetValveResponse_t* message) {
+    (void)sequence_number;
+    valve_response = *message;
+    valve_responses++;
+}
+
+void asmart_on_levels_notification(const LevelsNotification_t* message) {
+    levels = *message;
+    level_notifications++;
+}
+
+static void init_pair(void) {
+    asmart_test_now_ms = 0;
+    asmart_comm_set_clock(asmart_test_clock);
+    memset(&controller_sent, 0, sizeof(controller_sent));
+    memset(&node_sent, 0, sizeof(node_sent));
+    asmart_comm_init_transport(&controller, keep_frame, &controller_sent, response_callback);
+    asmart_comm_set_address(&controller, CONTROLLER_ADDRESS, 0);
+    asmart_comm_set_peer(&controller, NODE_ADDRESS);
+    asmart_comm_init_transport(&node, keep_frame, &node_sent, response_callback);
+    asmart_comm_set_address(&node, NODE_ADDRESS, 0);
+    asmart_comm_set_peer(&node, CONTROLLER_ADDRESS);
+    valve_commands = 0;
+    valve_responses = 0;
+    level_notifications = 0;
+    not_dispatched = 0;
+}
+
+/* The controller's last frame reaches the node, and the node's answer, if any, comes back */
+static void exchange(void) {
+    uint32_t answers = node_sent.count;
+
+    asmart_comm_receive_bytes(&node, controller_sent.frame, controller_sent.length);
+    asmart_comm_handler(&node);
+    if (node_sent.count != answers) {
+        asmart_comm_receive_bytes(&controller, node_sent.frame, node_sent.length);
+        asmart_comm_handler(&controller);
+    }
+}
+
+static void test_encoding(void) {
+    SetValveCommand_t command = { 3, VALVE_STATE_OPEN, 1.5f };
+    uint8_t expected[] = { 3, VALVE_STATE_OPEN, 0x3F, 0xC0, 0x00, 0x00 };
+    uint8_t buffer[SET_VALVE_COMMAND_MAX_SIZE];
+    SetValveCommand_t decoded;
+
+    /* Fields in schema order, big-endian, decoded back the same */
+    CHECK(asmart_encode_set_valve_command(&command, buffer) == sizeof(expected));
+    CHECK(memcmp(buffer, expected, sizeof(expected)) == 0);
+    CHECK(asmart_decode_set_valve_command(buffer, sizeof(buffer), &decoded));
+    CHECK(decoded.valve == 3 && decoded.state == VALVE_STATE_OPEN && decoded.flow == 1.5f);
+    CHECK(!asmart_decode_set_valve_command(buffer, sizeof(buffer) - 1, &decoded));
+}
+
+static void test_command_dispatched(void) {
+    SetValveCommand_t command = { 3, VALVE_STATE_OPEN, 1.5f };
+
+    init_pair();
+    asmart_send_set_valve_command(&controller, &command);
+    exchange();
+    CHECK(valve_commands == 1 && valve_command.valve == 3 && valve_command.flow == 1.5f);
+    CHECK(valve_responses == 1 && valve_response.state == VALVE_STATE_OPEN);
+    CHECK(not_dispatched == 0 && controller.mapping_table_count == 0);
+}
+
+static void test_variable_length_notification(void) {
+    LevelsNotification_t notification = { -300, 3, { 7, 8, 9 } };
+
+    init_pair();
+    asmart_send_levels_notification(&controller, &notification);
+    CHECK(controller_sent.length == FRAME_HEADER_SIZE + LEVELS_NOTIFICATION_MIN_SIZE + 3 + FRAME_TRAILER_SIZE);
+    exchange();
+    CHECK(level_notifications == 1 && levels.level == -300);
+    CHECK(levels.samples_count == 3 && levels.samples[0] == 7 && levels.samples[2] == 9);
+}
+
+static void test_left_to_callback(void) {
+    uint8_t short_payload[SET_VALVE_COMMAND_MAX_SIZE - 1] = { 0 };
+
+    init_pair();
+
+    /* A known type with a payload of the wrong size never reaches its handler */
+    asmart_comm_send_command(&controller, COMMAND_TYPE_SET_VALVE, short_payload, sizeof(short_payload));
+    exchange();
+    CHECK(valve_commands == 0 && not_dispatched == 1);
+
+    /* Neither does a type outside the schema */
+    asmart_comm_send_command(&controller, UNKNOWN_COMMAND, NULL, 0);
+    exchange();
+    CHECK(not_dispatched == 2);
+}
+
+int main(void) {
+    ASMART_TEST_RUN(test_encoding);
+    ASMART_TEST_RUN(test_command_dispatched);
+    ASMART_TEST_RUN(test_variable_length_notification);
+    ASMART_TEST_RUN(test_left_to_callback);
+    return asmart_test_result();
+}
@@ -0,0 +1,163 @@
+/*
+ * Secured links: AES-CCM against the RFC 3610 packet vectors, the replay window and its restore after a restart.
+ */
+#include <string.h>
+#include "asmart_comm_handler.h"
+#include "asmart_test.h"
+
+#define CONTROLLER_ADDRESS 0x01
+#define NODE_ADDRESS 0x10
+#define FRAMES 40
+#define TEST_PAYLOAD 16
+
+#if ASMART_COMM_SECURE
+// RFC 3610 Packet Vector, 8-byte header and 8-byte tag
+typedef struct {
+    uint8_t nonce[SECURE_NONCE_SIZE];
+    uint8_t length;  // Header and payload
+    uint8_t output[48];  // Encrypted payload and tag, behind the header
+} CcmVector_t;
+
+static const uint8_t rfc3610_key[SECURE_KEY_SIZE] = {
+    0xC0, 0xC1, 0xC2, 0xC3, 0xC4, 0xC5, 0xC6, 0xC7, 0xC8, 0xC9, 0xCA, 0xCB, 0xCC, 0xCD, 0xCE, 0xCF
+};
+
+static const CcmVector_t rfc3610_vectors[] = {
+    /* Packet Vector #1 */
+    { { 0x00, 0x00, 0x00, 0x03, 0x02, 0x01, 0x00, 0xA0, 0xA1, 0xA2, 0xA3, 0xA4, 0xA5 }, 31,
+      { 0x58, 0x8C, 0x97, 0x9A, 0x61, 0xC6, 0x63, 0xD2, 0xF0, 0x66, 0xD0, 0xC2, 0xC0, 0xF9, 0x89, 0x80,
+        0x6D, 0x5F, 0x6B, 0x61, 0xDA, 0xC3, 0x84, 0x17, 0xE8, 0xD1, 0x2C, 0xFD, 0xF9, 0x26, 0xE0 } },
+    /* Packet Vector #2 */
+    { { 0x00, 0x00, 0x00, 0x04, 0x03, 0x02, 0x01, 0xA0, 0xA1, 0xA2, 0xA3, 0xA4, 0xA5 }, 32,
+      { 0x72, 0xC9, 0x1A, 0x36, 0xE1, 0x35, 0xF8, 0xCF, 0x29, 0x1C, 0xA8, 0x94, 0x08, 0x5C, 0x87, 0xE3,
+        0xCC, 0x15, 0xC4, 0x39, 0xC9, 0xE4, 0x3A, 0x3B, 0xA0, 0x91, 0xD5, 0x6E, 0x10, 0x40, 0x09, 0x16 } },
+    /* Packet Vector #3 */
+    { { 0x00, 0x00, 0x00, 0x05, 0x04, 0x03, 0x02, 0xA0, 0xA1, 0xA2, 0xA3, 0xA4, 0xA5 }, 33,
+      { 0x51, 0xB1, 0xE5, 0xF4, 0x4A, 0x19, 0x7D, 0x1D, 0xA4, 0x6B, 0x0F, 0x8E, 0x2D, 0x28, 0x2A, 0xE8,
+        0x71, 0xE8, 0x38, 0xBB, 0x64, 0xDA, 0x85, 0x96, 0x57, 0x4A, 0xDA, 0xA7, 0x6F, 0xBD, 0x9F, 0xB0, 0xC5 } }
+};
+
+static const uint8_t link_key[SECURE_KEY_SIZE] = {
+    0x2B, 0x7E, 0x15, 0x16, 0x28, 0xAE, 0xD2, 0xA6, 0xAB, 0xF7, 0x15, 0x88, 0x09, 0xCF, 0x4F, 0x3C
+};
+static const uint8_t header[SECURE_MAX_AAD] = { 0x00, 0x20, NODE_ADDRESS, CONTROLLER_ADDRESS, 0x00, 0x01, 0x03, 0x30 };
+
+// A Sealed Payload
+typedef struct {
+    uint8_t data[TEST_PAYLOAD + SECURE_OVERHEAD];
+} SealedFrame_t;
+
+static aSmart_Secure_t sender;
+static aSmart_Secure_t receiver;
+static SealedFrame_t sealed[FRAMES + 1];
+
+/* Counters 1 to FRAMES, sealed by the controller for the node */
+static void seal_frames(void) {
+    asmart_secure_init(&sender);
+    asmart_secure_init(&receiver);
+    CHECK(asmart_secure_set_key(&sender, NODE_ADDRESS, link_key, 1));
+    CHECK(asmart_secure_set_key(&receiver, CONTROLLER_ADDRESS, link_key, 1));
+    for (uint32_t counter = 1; counter <= FRAMES; counter++) {
+        memset(sealed[counter].data, (uint8_t)counter, TEST_PAYLOAD);
+        CHECK(asmart_secure_seal(asmart_secure_find(&sender, NODE_ADDRESS), CONTROLLER_ADDRESS, NODE_ADDRESS, header, sizeof(header), sealed[counter].data, TEST_PAYLOAD));
+    }
+}
+
+/* Opens a copy, the sealed frame stays for the next try; a wrong plaintext counts as failed */
+static secure_open_t open_frame(aSmart_Secure_t* secure, uint32_t counter) {
+    SealedFrame_t frame = sealed[counter];
+    secure_open_t result = asmart_secure_open(asmart_secure_find(secure, CONTROLLER_ADDRESS), CONTROLLER_ADDRESS, NODE_ADDRESS, header, sizeof(header), frame.data, sizeof(frame.data));
+
+    if (result == SECURE_OPEN_OK && (frame.data[0] != (uint8_t)counter || frame.data[TEST_PAYLOAD - 1] != (uint8_t)counter)) {
+        return SECURE_OPEN_FAILED;
+    }
+    return result;
+}
+
+static void test_rfc3610_vectors(void) {
+    aSmart_Secure_t secure;
+
+    asmart_secure_init(&secure);
+    CHECK(asmart_secure_set_key(&secure, NODE_ADDRESS, rfc3610_key, 1));
+    SecureLink_t* link = asmart_secure_find(&secure, NODE_ADDRESS);
+
+    for (uint8_t v = 0; v < sizeof(rfc3610_vectors) / sizeof(rfc3610_vectors[0]); v++) {
+        const CcmVector_t* vector = &rfc3610_vectors[v];
+        uint8_t packet[48];
+        uint8_t tag[SECURE_TAG_SIZE];
+        uint16_t length = vector->length - SECURE_MAX_AAD;
+
+        /* Header 00..07, payload counting on from 08 */
+        for (uint8_t i = 0; i < vector->length; i++) {
+            packet[i] = i;
+        }
+        CHECK(asmart_secure_ccm(link, vector->nonce, packet, SECURE_MAX_AAD, &packet[SECURE_MAX_AAD], length, tag, 1));
+        CHECK(memcmp(&packet[SECURE_MAX_AAD], vector->output, length) == 0);
+        CHECK(memcmp(tag, &vector->output[length], SECURE_TAG_SIZE) == 0);
+
+        /* Decrypted, the same tag comes out over the plaintext */
+        memset(tag, 0, sizeof(tag));
+        CHECK(asmart_secure_ccm(link, vector->nonce, packet, SECURE_MAX_AAD, &packet[SECURE_MAX_AAD], length, tag, 0));
+        CHECK(memcmp(tag, &vector->output[length], SECURE_TAG_SIZE) == 0);
+        for (uint8_t i = 0; i < vector->length; i++) {
+            CHECK(packet[i] == i);
+        }
+    }
+}
+
+static void test_replay_window(void) {
+    seal_frames();
+
+    /* Out of order within the window, each counter once */
+    CHECK(open_frame(&receiver, 5) == SECURE_OPEN_OK);
+    CHECK(open_frame(&receiver, 5) == SECURE_OPEN_REPLAYED);
+    CHECK(open_frame(&receiver, 3) == SECURE_OPEN_OK);
+    CHECK(open_frame(&receiver, 3) == SECURE_OPEN_REPLAYED);
+    CHECK(open_frame(&receiver, 4) == SECURE_OPEN_OK);
+
+    /* The window slides with the highest counter: SECURE_REPLAY_WINDOW below it still counts */
+    CHECK(open_frame(&receiver, FRAMES) == SECURE_OPEN_OK);
+    CHECK(open_frame(&receiver, FRAMES - SECURE_REPLAY_WINDOW) == SECURE_OPEN_OK);
+    CHECK(open_frame(&receiver, FRAMES - SECURE_REPLAY_WINDOW - 1) == SECURE_OPEN_REPLAYED);
+    CHECK(open_frame(&receiver, 5) == SECURE_OPEN_REPLAYED);
+
+    /* A changed byte fails and leaves its counter unused */
+    sealed[FRAMES - 1].data[0] ^= 0x01;
+    CHECK(open_frame(&receiver, FRAMES - 1) == SECURE_OPEN_FAILED);
+    sealed[FRAMES - 1].data[0] ^= 0x01;
+    CHECK(open_frame(&receiver, FRAMES - 1) == SECURE_OPEN_OK);
+}
+
+static void test_restore_after_restart(void) {
+    static aSmart_Comm_Handler_t node;
+
+    seal_frames();
+    for (uint32_t counter = 1; counter <= 10; counter++) {
+        CHECK(open_frame(&receiver, counter) == SECURE_OPEN_OK);
+    }
+
+    /* Restarted with the same key: the old frames are recorded traffic now */
+    asmart_comm_init_transport(&node, NULL, NULL, NULL);
+    asmart_comm_set_address(&node, NODE_ADDRESS, 0);
+    CHECK(!asmart_comm_set_link_rx_counter(&node, CONTROLLER_ADDRESS, 10));
+    CHECK(asmart_comm_set_link_key(&node, CONTROLLER_ADDRESS, link_key, 1));
+    CHECK(asmart_comm_link_rx_counter(&node, CONTROLLER_ADDRESS) == 0);
+    CHECK(asmart_comm_set_link_rx_counter(&node, CONTROLLER_ADDRESS, asmart_secure_find(&receiver, CONTROLLER_ADDRESS)->rx_highest));
+    CHECK(asmart_comm_link_rx_counter(&node, CONTROLLER_ADDRESS) == 10);
+
+    CHECK(open_frame(&node.secure, 10) == SECURE_OPEN_REPLAYED);
+    CHECK(open_frame(&node.secure, 2) == SECURE_OPEN_REPLAYED);
+    CHECK(open_frame(&node.secure, 12) == SECURE_OPEN_OK);
+    CHECK(open_frame(&node.secure, 11) == SECURE_OPEN_OK);
+    CHECK(asmart_comm_link_rx_counter(&node, CONTROLLER_ADDRESS) == 12);
+}
+#endif
+
+int main(void) {
+#if ASMART_COMM_SECURE
+    ASMART_TEST_RUN(test_rfc3610_vectors);
+    ASMART_TEST_RUN(test_replay_window);
+    ASMART_TEST_RUN(test_restore_after_restart);
+#endif
+    return asmart_test_result();
+}
@@ -0,0 +1,202 @@
+/*
+ * SPI transport on the simulated pair: frames streamed through fixed-size slots in both
+ * directions, several frames in one slot and one frame over several, the data-ready line, an
+ * idle master, and a slot the slave missed.
+ */
+#include <string.h>
+#include "asmart_comm_spisim.h"
+#include "asmart_test.h"
+
+#define CONTROLLER_ADDRESS 0x01
+#define NODE_ADDRESS 0x10
+#define ECHO_COMMAND 0x10
+#define TEST_NOTIFICATION 0x30
+#define SPI_CLOCK_HZ 16000000
+#define IDLE_NS 1000  // Time that passes while no transfer is due
+#define SHORT_PAYLOAD 2
+#define SHARED_FRAMES 2  // Frames that queue behind the first and go in one slot
+
+static aSmart_SpiSimBus_t bus;
+static aSmart_Comm_Handler_t controller;
+static aSmart_Comm_Handler_t node;
+static aSmart_SpiLink_t controller_link;
+static aSmart_SpiLink_t node_link;
+static uint8_t received[TRANSMIT_BUFFER_SIZE];
+static uint16_t received_length;
+static uint32_t node_notifications;
+static uint32_t controller_notifications;
+static uint32_t responses;
+
+/* Node: echoes commands, keeps notifications */
+static void node_callback(uint8_t message_type, uint8_t command_type, uint16_t sequence_number, uint8_t* payload, uint16_t length) {
+    if (message_type == MSG_TYPE_COMMAND) {
+        asmart_comm_send_response(&node, sequence_number, command_type, payload, length);
+    }
+    else if (message_type == MSG_TYPE_NOTIFICATION && command_type == TEST_NOTIFICATION) {
+        memcpy(received, payload, length);
+        received_length = length;
+        node_notifications++;
+    }
+}
+
+static void controller_callback(uint8_t message_type, uint8_t command_type, uint16_t sequence_number, uint8_t* payload, uint16_t length) {
+    (void)sequence_number;
+
+    if (message_type == MSG_TYPE_RESPONSE && command_type == ECHO_COMMAND) {
+        memcpy(received, payload, length);
+        received_length = length;
+        responses++;
+    }
+    else if (message_type == MSG_TYPE_NOTIFICATION && command_type == TEST_NOTIFICATION) {
+        controller_notifications++;
+    }
+}
+
+/* The controller is the master at 16 MHz, the node the slave */
+static void init_pair(void) {
+    asmart_spisim_init(&bus, SPI_CLOCK_HZ, &controller_link, &node_link);
+    asmart_comm_set_clock(asmart_spisim_clock);
+    memset(&controller_link, 0, sizeof(controller_link));
+    memset(&node_link, 0, sizeof(node_link));
+    asmart_spi_init(&controller_link, &controller, SPI_ROLE_MASTER, &asmart_spisim_master_driver, &bus, controller_callback);
+    asmart_comm_set_address(&controller, CONTROLLER_ADDRESS, 0);
+    asmart_comm_set_peer(&controller, NODE_ADDRESS);
+    asmart_spi_init(&node_link, &node, SPI_ROLE_SLAVE, &asmart_spisim_slave_driver, &bus, node_callback);
+    asmart_comm_set_address(&node, NODE_ADDRESS, 0);
+    asmart_comm_set_peer(&node, CONTROLLER_ADDRESS);
+    asmart_spi_service(&node_link);
+    received_length = 0;
+    node_notifications = 0;
+    controller_notifications = 0;
+    responses = 0;
+}
+
+/* Both ends run their main loop while the pair runs what the master starts, and once more at the end */
+static void run_for(uint32_t us) {
+    uint64_t end_ns = bus.now_ns + (uint64_t)us * 1000ULL;
+
+    while (1) {
+        asmart_comm_handler(&node);
+        asmart_spi_service(&node_link);
+        asmart_comm_handler(&controller);
+        asmart_spi_service(&controller_link);
+        if (bus.now_ns >= end_ns) {
+            return;
+        }
+        if (!asmart_spisim_step(&bus)) {
+            asmart_spisim_advance(&bus, IDLE_NS);
+        }
+    }
+}
+
+/* A payload of the given length without frame markers, so lost bytes cannot pass for a frame start */
+static void fill_payload(uint8_t* payload, uint16_t length) {
+    memset(payload, 0xA5, length);
+}
+
+static void test_echo_round_trip(void) {
+    uint8_t payload[8] = { 1, 2, 3, 4, 5, 6, 7, 8 };
+
+    init_pair();
+
+    /* The command goes in the master's first slot, the response comes back when the node raises data-ready */
+    asmart_comm_send_command(&controller, ECHO_COMMAND, payload, sizeof(payload));
+    run_for(1000);
+    CHECK(responses == 1 && received_length == sizeof(payload) && memcmp(received, payload, sizeof(payload)) == 0);
+    CHECK(controller_link.rx_errors == 0 && node_link.rx_errors == 0);
+    CHECK(bus.ready == 0 && bus.unarmed == 0);
+    CHECK(controller.mapping_table_count == 0);
+}
+
+static void test_idle_master_does_not_clock(void) {
+    init_pair();
+
+    /* Nothing to send and data-ready low: no transfer */
+    CHECK(asmart_spi_service(&controller_link) == ASMART_COMM_NO_DEADLINE);
+    run_for(100);
+    CHECK(bus.transfers == 0);
+}
+
+static void test_frame_over_several_slots(void) {
+    uint8_t payload[ASMART_COMM_MAX_PAYLOAD];
+    uint16_t frame_length = FRAME_HEADER_SIZE + ASMART_COMM_MAX_PAYLOAD + FRAME_TRAILER_SIZE;
+
+    init_pair();
+    fill_payload(payload, sizeof(payload));
+    asmart_comm_send_notification(&controller, TEST_NOTIFICATION, payload, sizeof(payload));
+    run_for(1000);
+    CHECK(frame_length > SPI_SLOT_DATA);
+    CHECK(bus.transfers == (frame_length + SPI_SLOT_DATA - 1u) / SPI_SLOT_DATA);
+    CHECK(node_notifications == 1 && received_length == sizeof(payload) && memcmp(received, payload, sizeof(payload)) == 0);
+    CHECK(node_link.rx_bytes == frame_length);
+}
+
+static void test_frames_share_slot(void) {
+    uint8_t payload[SHORT_PAYLOAD];
+    uint16_t frame_length = FRAME_HEADER_SIZE + SHORT_PAYLOAD + FRAME_TRAILER_SIZE;
+
+    init_pair();
+    CHECK(SHARED_FRAMES * frame_length <= SPI_SLOT_DATA);
+    fill_payload(payload, sizeof(payload));
+
+    /* The first frame starts a transfer, the others queue behind it for the next slot */
+    for (uint8_t i = 0; i < 1 + SHARED_FRAMES; i++) {
+        asmart_comm_send_notification(&controller, TEST_NOTIFICATION, payload, sizeof(payload));
+    }
+    run_for(1000);
+    CHECK(bus.transfers == 2 && node_link.rx_bytes == (1 + SHARED_FRAMES) * frame_length);
+
+    /* A node with a single receive slot (half duplex) keeps the first frame of a slot only */
+    CHECK(node_notifications == 1u + ((RX_FRAME_SLOTS < SHARED_FRAMES) ? RX_FRAME_SLOTS : SHARED_FRAMES));
+}
+
+static void test_slave_raises_data_ready(void) {
+    uint8_t payload[SHORT_PAYLOAD];
+
+    init_pair();
+    fill_payload(payload, sizeof(payload));
+
+    /* The node has bytes to send: the line goes up and the master clocks transfers until the
+       slot armed before, still empty, and the one with the bytes have crossed */
+    asmart_comm_send_notification(&node, TEST_NOTIFICATION, payload, sizeof(payload));
+    CHECK(bus.ready == 1);
+    run_for(1000);
+    CHECK(controller_notifications == 1);
+    CHECK(bus.transfers == 2 && bus.ready == 0);
+}
+
+static void test_missed_slot(void) {
+    uint8_t payload[ASMART_COMM_MAX_PAYLOAD];
+
+    init_pair();
+    fill_payload(payload, sizeof(payload));
+    asmart_comm_send_notification(&controller, TEST_NOTIFICATION, payload, sizeof(payload));
+
+    /* First slot crosses, the second finds the slave not armed: its DMA reports an error instead */
+    CHECK(asmart_spisim_step(&bus));
+    asmart_spi_service(&controller_link);
+    bus.slave_tx = NULL;
+    CHECK(asmart_spisim_step(&bus));
+    CHECK(bus.unarmed == 1 && controller_link.rx_errors == 1);
+    asmart_spi_complete(&node_link, 0);
+    CHECK(node_link.rx_errors == 1);
+
+    /* The slave sees the gap in the sequence and drops the frame it was parsing */
+    run_for(RX_IDLE_RESYNC_MS * 1000 + 1000);
+    CHECK(node_link.rx_errors == 2 && node_notifications == 0);
+
+    /* The next frame comes through whole */
+    asmart_comm_send_notification(&controller, TEST_NOTIFICATION, payload, SHORT_PAYLOAD);
+    run_for(1000);
+    CHECK(node_notifications == 1 && received_length == SHORT_PAYLOAD);
+}
+
+int main(void) {
+    ASMART_TEST_RUN(test_echo_round_trip);
+    ASMART_TEST_RUN(test_idle_master_does_not_clock);
+    ASMART_TEST_RUN(test_frame_over_several_slots);
+    ASMART_TEST_RUN(test_frames_share_slot);
+    ASMART_TEST_RUN(test_slave_raises_data_ready);
+    ASMART_TEST_RUN(test_missed_slot);
+    return asmart_test_result();
+}
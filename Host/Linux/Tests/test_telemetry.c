@@ -0,0 +1,219 @@
+/*
+ * Delta-encoded telemetry: the keyframe and delta layouts, keyframes inserted by interval, on
+ * request and for a baseline too old, and a stream between two handlers rebuilding the full
+ * snapshot after a lost frame and after the receiver lost its baseline.
+ */
+#include <string.h>
+#include "asmart_comm_handler.h"
+#include "asmart_test.h"
+
+#if ASMART_COMM_TELEMETRY
+#define CONTROLLER_ADDRESS 0x01
+#define NODE_ADDRESS 0x10
+#define STREAM_NOTIFICATION 0x31
+#define FIELD_COUNT 3
+#define SNAPSHOT_SIZE 7
+#define KEYFRAME_LENGTH (2 + SNAPSHOT_SIZE)
+
+// Frames a Handler Sent
+typedef struct {
+    uint8_t frame[TRANSMIT_BUFFER_SIZE];
+    uint16_t length;
+    uint32_t count;
+} SentFrames_t;
+
+static const uint8_t field_sizes[FIELD_COUNT] = { 2, 1, 4 };
+
+static aSmart_Comm_Handler_t controller;
+static aSmart_Comm_Handler_t node;
+static SentFrames_t controller_sent;
+static SentFrames_t node_sent;
+static aSmart_TelemetryTx_t stream_tx;
+static aSmart_TelemetryRx_t stream_rx;
+static uint8_t received[SNAPSHOT_SIZE];
+static uint32_t samples;
+
+static void keep_frame(void* context, uint8_t destination, const uint8_t* frame, uint16_t length) {
+    SentFrames_t* sent = (SentFrames_t*)context;
+
+    (void)destination;
+    memcpy(sent->frame, frame, length);
+    sent->length = length;
+    sent->count++;
+}
+
+/* Node: keeps the rebuilt snapshots */
+static void node_callback(uint8_t message_type, uint8_t command_type, uint16_t sequence_number, uint8_t* payload, uint16_t length) {
+    (void)sequence_number;
+
+    if (message_type == MSG_TYPE_NOTIFICATION && command_type == STREAM_NOTIFICATION && length == SNAPSHOT_SIZE) {
+        memcpy(received, payload, length);
+        samples++;
+    }
+}
+
+static void ignore(uint8_t message_type, uint8_t command_type, uint16_t sequence_number, uint8_t* payload, uint16_t length) {
+    (void)message_type;
+    (void)command_type;
+    (void)sequence_number;
+    (void)payload;
+    (void)length;
+}
+
+/* The controller streams to the node, keyframes on demand only */
+static void init_pair(void) {
+    asmart_test_now_ms = 0;
+    asmart_comm_set_clock(asmart_test_clock);
+    memset(&controller_sent, 0, sizeof(controller_sent));
+    memset(&node_sent, 0, sizeof(node_sent));
+    asmart_comm_init_transport(&controller, keep_frame, &controller_sent, ignore);
+    asmart_comm_set_address(&controller, CONTROLLER_ADDRESS, 0);
+    asmart_comm_init_transport(&node, keep_frame, &node_sent, node_callback);
+    asmart_comm_set_address(&node, NODE_ADDRESS, 0);
+    asmart_telemetry_tx_init(&stream_tx, STREAM_NOTIFICATION, NODE_ADDRESS, field_sizes, FIELD_COUNT, 0);
+    asmart_comm_add_telemetry_tx(&controller, &stream_tx);
+    asmart_telemetry_rx_init(&stream_rx, STREAM_NOTIFICATION, field_sizes, FIELD_COUNT);
+    asmart_comm_add_telemetry_rx(&node, &stream_rx);
+    samples = 0;
+}
+
+/* Sends a sample; unless lost, the node gets it and its acknowledgement or request comes back */
+static void stream(const uint8_t* snapshot, uint8_t lost) {
+    uint32_t answers = node_sent.count;
+
+    asmart_comm_send_telemetry(&controller, &stream_tx, snapshot);
+    if (lost) {
+        return;
+    }
+    asmart_comm_receive_bytes(&node, controller_sent.frame, controller_sent.length);
+    asmart_comm_handler(&node);
+    if (node_sent.count != answers) {
+        asmart_comm_receive_bytes(&controller, node_sent.frame, node_sent.length);
+        asmart_comm_handler(&controller);
+    }
+}
+
+/* Kind of the last payload the controller sent */
+static uint8_t last_kind(void) {
+    return controller_sent.frame[FRAME_HEADER_SIZE];
+}
+
+static void test_delta_encoding(void) {
+    aSmart_TelemetryTx_t tx;
+    aSmart_TelemetryRx_t rx;
+    uint8_t snapshot[SNAPSHOT_SIZE] = { 0x01, 0x02, 0x03, 0x10, 0x20, 0x30, 0x40 };
+    uint8_t payload[TELEMETRY_MAX_PAYLOAD];
+
+    asmart_telemetry_tx_init(&tx, STREAM_NOTIFICATION, NODE_ADDRESS, field_sizes, FIELD_COUNT, 0);
+    asmart_telemetry_rx_init(&rx, STREAM_NOTIFICATION, field_sizes, FIELD_COUNT);
+
+    /* No baseline yet: the whole snapshot */
+    uint16_t length = asmart_telemetry_encode(&tx, snapshot, payload);
+    CHECK(length == KEYFRAME_LENGTH && payload[0] == TELEMETRY_KEYFRAME && payload[1] == 0);
+    CHECK(memcmp(&payload[2], snapshot, SNAPSHOT_SIZE) == 0);
+    CHECK(asmart_telemetry_decode(&rx, payload, length) == TELEMETRY_REBUILT);
+    CHECK(asmart_telemetry_ack_due(&rx) && rx.last_sample == 0);
+    asmart_telemetry_ack(&tx, 0);
+
+    /* Only the middle field changed: bitmap bit 1 and its one byte */
+    snapshot[2] = 0x04;
+    length = asmart_telemetry_encode(&tx, snapshot, payload);
+    CHECK(length == 3 + 1 + 1);
+    CHECK(payload[0] == TELEMETRY_DELTA && payload[1] == 1 && payload[2] == 0 && payload[3] == 0x02 && payload[4] == 0x04);
+    CHECK(asmart_telemetry_decode(&rx, payload, length) == TELEMETRY_REBUILT);
+    CHECK(memcmp(rx.snapshot, snapshot, SNAPSHOT_SIZE) == 0);
+
+    /* Nothing changed since the acknowledged sample: an empty bitmap */
+    asmart_telemetry_ack(&tx, 1);
+    length = asmart_telemetry_encode(&tx, snapshot, payload);
+    CHECK(length == 3 + 1 && payload[3] == 0x00);
+    CHECK(asmart_telemetry_decode(&rx, payload, length) == TELEMETRY_REBUILT);
+    CHECK(memcmp(rx.snapshot, snapshot, SNAPSHOT_SIZE) == 0);
+
+    /* A delta whose length does not match its bitmap is dropped */
+    payload[3] = 0x01;
+    CHECK(asmart_telemetry_decode(&rx, payload, length) == TELEMETRY_INVALID);
+}
+
+static void test_keyframe_insertion(void) {
+    aSmart_TelemetryTx_t tx;
+    uint8_t snapshot[SNAPSHOT_SIZE] = { 0 };
+    uint8_t payload[TELEMETRY_MAX_PAYLOAD];
+
+    /* Every third sample is a keyframe, whatever the acknowledgements */
+    asmart_telemetry_tx_init(&tx, STREAM_NOTIFICATION, NODE_ADDRESS, field_sizes, FIELD_COUNT, 3);
+    for (uint8_t sample = 0; sample < 7; sample++) {
+        asmart_telemetry_encode(&tx, snapshot, payload);
+        CHECK(payload[0] == ((sample % 3 == 0) ? TELEMETRY_KEYFRAME : TELEMETRY_DELTA));
+        asmart_telemetry_ack(&tx, sample);
+    }
+
+    /* On request, once */
+    asmart_telemetry_tx_init(&tx, STREAM_NOTIFICATION, NODE_ADDRESS, field_sizes, FIELD_COUNT, 0);
+    asmart_telemetry_encode(&tx, snapshot, payload);
+    asmart_telemetry_ack(&tx, 0);
+    asmart_telemetry_request_keyframe(&tx);
+    asmart_telemetry_encode(&tx, snapshot, payload);
+    CHECK(payload[0] == TELEMETRY_KEYFRAME);
+    asmart_telemetry_encode(&tx, snapshot, payload);
+    CHECK(payload[0] == TELEMETRY_DELTA);
+
+    /* Without acknowledgements the baseline ages out of the receiver's history */
+    for (uint8_t i = 0; i < TELEMETRY_HISTORY; i++) {
+        asmart_telemetry_encode(&tx, snapshot, payload);
+    }
+    CHECK(payload[0] == TELEMETRY_KEYFRAME);
+}
+
+static void test_rebuilt_after_lost_frame(void) {
+    uint8_t snapshot[SNAPSHOT_SIZE] = { 0x01, 0x02, 0x03, 0x10, 0x20, 0x30, 0x40 };
+
+    init_pair();
+
+    /* Keyframe, acknowledged at once */
+    stream(snapshot, 0);
+    CHECK(samples == 1 && memcmp(received, snapshot, SNAPSHOT_SIZE) == 0);
+    CHECK(stream_tx.baseline.valid && stream_tx.baseline.sample == 0);
+
+    /* A delta is lost; the next one names the same baseline and rebuilds the full snapshot */
+    snapshot[0] = 0x11;
+    stream(snapshot, 1);
+    CHECK(last_kind() == TELEMETRY_DELTA);
+    snapshot[6] = 0x44;
+    stream(snapshot, 0);
+    CHECK(last_kind() == TELEMETRY_DELTA && controller_sent.frame[FRAME_HEADER_SIZE + 2] == 0);
+    CHECK(samples == 2 && memcmp(received, snapshot, SNAPSHOT_SIZE) == 0);
+}
+
+static void test_rebuilt_after_lost_baseline(void) {
+    uint8_t snapshot[SNAPSHOT_SIZE] = { 0x01, 0x02, 0x03, 0x10, 0x20, 0x30, 0x40 };
+
+    init_pair();
+    stream(snapshot, 0);
+
+    /* The receiver restarts: the delta cannot be rebuilt and a keyframe is asked for */
+    asmart_telemetry_rx_init(&stream_rx, STREAM_NOTIFICATION, field_sizes, FIELD_COUNT);
+    snapshot[1] = 0x22;
+    stream(snapshot, 0);
+    CHECK(last_kind() == TELEMETRY_DELTA && samples == 1);
+    CHECK(stream_tx.force_keyframe == 1);
+
+    /* The next sample is that keyframe and the stream goes on with deltas */
+    snapshot[3] = 0x33;
+    stream(snapshot, 0);
+    CHECK(last_kind() == TELEMETRY_KEYFRAME && samples == 2 && memcmp(received, snapshot, SNAPSHOT_SIZE) == 0);
+    snapshot[4] = 0x55;
+    stream(snapshot, 0);
+    CHECK(last_kind() == TELEMETRY_DELTA && samples == 3 && memcmp(received, snapshot, SNAPSHOT_SIZE) == 0);
+}
+#endif
+
+int main(void) {
+#if ASMART_COMM_TELEMETRY
+    ASMART_TEST_RUN(test_delta_encoding);
+    ASMART_TEST_RUN(test_keyframe_insertion);
+    ASMART_TEST_RUN(test_rebuilt_after_lost_frame);
+    ASMART_TEST_RUN(test_rebuilt_after_lost_baseline);
+#endif
+    return asmart_test_result();
+}
@@ -0,0 +1,117 @@
+/*
+ * io_uring engine: a controller and a device on the two ends of a pseudo-terminal, served by a
+ * loop on HOST_ENGINE_URING. Skipped where the kernel or a seccomp filter refuses io_uring.
+ */
+#include <string.h>
+#include "asmart_comm_handler.h"
+#include "asmart_test.h"
+
+#define TEST_COMMAND 0x10
+#define TEST_WAIT_MS 2000
+
+// One End of the Pseudo-terminal
+typedef struct {
+    aSmart_HostPort_t port;
+    aSmart_Comm_Handler_t handler;
+    uint32_t responses;
+    uint32_t timeouts;
+    uint32_t reordered;  // Responses whose first payload byte is not the next one sent
+    uint8_t payload[ASMART_COMM_MAX_PAYLOAD];
+    uint16_t length;
+} TestNode_t;
+
+static aSmart_HostLoop_t loop;
+static TestNode_t controller;
+static TestNode_t device;
+
+static void controller_callback(uint8_t message_type, uint8_t command_type, uint16_t sequence_number, uint8_t* payload, uint16_t length) {
+    (void)command_type;
+    (void)sequence_number;
+
+    if (message_type == MSG_TYPE_RESPONSE) {
+        if (length == 0 || payload[0] != (uint8_t)controller.responses) {
+            controller.reordered++;
+        }
+        memcpy(controller.payload, payload, length);
+        controller.length = length;
+        controller.responses++;
+    }
+    else if (message_type == MSG_TYPE_ERROR && payload == NULL) {
+        controller.timeouts++;
+    }
+}
+
+static void device_callback(uint8_t message_type, uint8_t command_type, uint16_t sequence_number, uint8_t* payload, uint16_t length) {
+    if (message_type == MSG_TYPE_COMMAND) {
+        asmart_comm_send_response(&device.handler, sequence_number, command_type, payload, length);
+    }
+}
+
+/* The two ends on a fresh io_uring loop */
+static void open_pair(void) {
+    char slave_path[64];
+
+    memset(&controller, 0, sizeof(controller));
+    memset(&device, 0, sizeof(device));
+    CHECK(asmart_host_loop_init_engine(&loop, HOST_ENGINE_URING) == 0);
+    CHECK(loop.engine == HOST_ENGINE_URING);
+    CHECK(asmart_host_open_pty(&loop, &controller.port, slave_path, sizeof(slave_path)) == 0);
+    CHECK(asmart_host_open(&loop, &device.port, slave_path, 115200) == 0);
+    asmart_comm_init_port(&controller.handler, &controller.port, controller_callback);
+    asmart_comm_init_port(&device.handler, &device.port, device_callback);
+}
+
+/* Polls until the controller has the given number of answers or the wait is over */
+static void poll_responses(uint32_t responses) {
+    uint32_t start = HAL_GetTick();
+
+    while (controller.responses + controller.timeouts < responses && HAL_GetTick() - start < TEST_WAIT_MS) {
+        CHECK(asmart_host_poll(&loop, 10) >= 0);
+    }
+}
+
+static void test_pty_round_trip(void) {
+    uint8_t payload[ASMART_COMM_MAX_PAYLOAD / 2];
+
+    open_pair();
+    for (uint16_t i = 0; i < sizeof(payload); i++) {
+        payload[i] = (uint8_t)(i * 7);
+    }
+    asmart_comm_send_command(&controller.handler, TEST_COMMAND, payload, sizeof(payload));
+    poll_responses(1);
+    asmart_host_loop_close(&loop);
+
+    CHECK(controller.responses == 1 && controller.timeouts == 0);
+    CHECK(controller.length == sizeof(payload));
+    CHECK(memcmp(controller.payload, payload, sizeof(payload)) == 0);
+}
+
+static void test_commands_in_flight(void) {
+    uint8_t payload[ASMART_COMM_MAX_PAYLOAD];
+
+    /* A full command table at once: the reads complete with several frames or parts of one */
+    open_pair();
+    memset(payload, 0xA5, sizeof(payload));
+    for (uint8_t i = 0; i < MAPPING_TABLE_ENTRIES; i++) {
+        payload[0] = i;
+        asmart_comm_send_command(&controller.handler, TEST_COMMAND, payload, sizeof(payload));
+    }
+    poll_responses(MAPPING_TABLE_ENTRIES);
+    asmart_host_loop_close(&loop);
+
+    CHECK(controller.responses == MAPPING_TABLE_ENTRIES && controller.timeouts == 0);
+    CHECK(controller.reordered == 0 && controller.length == sizeof(payload));
+}
+
+int main(void) {
+    /* No io_uring here: nothing to test */
+    if (asmart_host_loop_init_engine(&loop, HOST_ENGINE_URING) < 0) {
+        printf("skip io_uring unavailable\n");
+        return ASMART_TEST_SKIPPED;
+    }
+    asmart_host_loop_close(&loop);
+
+    ASMART_TEST_RUN(test_pty_round_trip);
+    ASMART_TEST_RUN(test_commands_in_flight);
+    return asmart_test_result();
+}
@@ -0,0 +1,125 @@
+#!/usr/bin/env python3
+"""Models a half-duplex RS485 bus polled by one controller: the request rate it reaches.
+
+    python3 Tools/asmart_bus_timing.py --nodes 8 --mix 4:4:70,32:64:25,128:4:5
+    python3 Tools/asmart_bus_timing.py --baud 115200 --processing-us 40 --compact --secure
+
+Each transaction is a command and its response. Before a node drives the bus it waits for the
+response gap, or for its own processing time if that is longer, and its UART holds the start bit
+back for the DE assertion time. DE times and the gap are derived as asmart_rs485_timing() does
+(asmart_comm_rs485.c), from the baud rate and the transceiver's switching times. The mix lists
+request payload, response payload and weight; the controller polls the nodes in turn.
+"""
+
+import argparse
+import math
+import sys
+
+SAMPLES_PER_BIT = 16  # RS485_SAMPLES_PER_BIT
+DE_TIME_MAX = 31  # RS485_DE_TIME_MAX
+FRAME_OVERHEAD = 12  # STX, Length (2), Destination, Source, Sequence (2), Message Type, Command Type, CRC (2), ETX
+COMPACT_OVERHEAD = 9  # SOH, Destination, Source, Type/Flags, Sequence (2), Command Type, CRC (2), plus the length varint
+SECURE_OVERHEAD = 12  # Counter and tag
+BAUD_RATES = [9600, 19200, 57600, 115200, 230400, 460800, 921600]
+
+
+def to_samples(ns, baud):
+    return math.ceil(ns * baud * SAMPLES_PER_BIT / 1e9)
+
+
+def rs485_timing(baud, enable_ns, disable_ns, propagation_ns):
+    """Returns DEAT and DEDT in sample times and the response gap in µs, clamped as on the UART."""
+    de_assert = min(to_samples(enable_ns, baud), DE_TIME_MAX)
+    de_deassert = min(to_samples(propagation_ns, baud), DE_TIME_MAX)
+    gap_ns = 0.5e9 / baud + de_deassert * 1e9 / (baud * SAMPLES_PER_BIT) + disable_ns + propagation_ns
+    return de_assert, de_deassert, math.ceil(gap_ns / 1000)
+
+
+def frame_bytes(payload, args):
+    if args.secure:
+        payload += SECURE_OVERHEAD
+    if args.compact:
+        length = 6 + payload  # Destination up to the end of the payload
+        return COMPACT_OVERHEAD + (1 if length < 128 else 2) + payload
+    return FRAME_OVERHEAD + payload
+
+
+def frame_us(payload, baud, args):
+    characters = frame_bytes(payload, args) + (1 if args.mute else 0)  # Address mark word
+    bits_per_character = 11 if args.mute else 10  # 8N1, or 9 data bits in mute mode
+    return characters * bits_per_character * 1e6 / baud
+
+
+def parse_mix(text):
+    mix = []
+    for entry in text.split(","):
+        fields = entry.split(":")
+        if len(fields) != 3:
+            raise ValueError(f"mix entry {entry!r} is not request:response:weight")
+        request, response, weight = int(fields[0]), int(fields[1]), float(fields[2])
+        if request < 0 or response < 0 or weight <= 0:
+            raise ValueError(f"mix entry {entry!r} has a negative size or no weight")
+        mix.append((request, response, weight))
+    return mix
+
+
+def transaction_us(baud, request, response, args):
+    """Returns the bus time of one transaction and the part of it spent turning the bus around."""
+    de_assert, _, gap_us = rs485_timing(baud, args.enable_ns, args.disable_ns, args.propagation_ns)
+    lead_us = de_assert * 1e6 / (baud * SAMPLES_PER_BIT)
+    half_bit_us = 0.5e6 / baud  # The gap runs from the middle of the last stop bit
+
+    # The responder answers once it has processed the command, the controller polls again likewise
+    node_wait = max(args.processing_us, gap_us - half_bit_us)
+    controller_wait = max(args.controller_us, gap_us - half_bit_us)
+    data = frame_us(request, baud, args) + frame_us(response, baud, args)
+    turnaround = node_wait + controller_wait + 2 * lead_us
+    return data + turnaround, turnaround
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter)
+    parser.add_argument("--baud", type=int, action="append", help="line speed, repeat for several (default: common rates)")
+    parser.add_argument("--nodes", type=int, default=1, help="nodes polled in turn")
+    parser.add_argument("--mix", default="4:4:1", help="request:response:weight payload sizes, comma separated")
+    parser.add_argument("--processing-us", type=float, default=20, help="node time from a command to its response")
+    parser.add_argument("--controller-us", type=float, default=20, help="controller time from a response to the next command")
+    parser.add_argument("--enable-ns", type=int, default=1000, help="driver enable time (RS485_DRIVER_ENABLE_NS)")
+    parser.add_argument("--disable-ns", type=int, default=1000, help="driver disable time (RS485_DRIVER_DISABLE_NS)")
+    parser.add_argument("--propagation-ns", type=int, default=500, help="end-to-end delay (RS485_PROPAGATION_NS)")
+    parser.add_argument("--compact", action="store_true", help="compact headers")
+    parser.add_argument("--secure", action="store_true", help="secured links")
+    parser.add_argument("--mute", action="store_true", help="9-bit mute mode with address marks")
+    args = parser.parse_args()
+
+    try:
+        mix = parse_mix(args.mix)
+    except ValueError as error:
+        print(error, file=sys.stderr)
+        return 1
+    if args.nodes < 1:
+        print("--nodes must be at least 1", file=sys.stderr)
+        return 1
+
+    total_weight = sum(weight for _, _, weight in mix)
+    clamped_any = False
+    print(f"{'baud':>8} {'DEAT':>4} {'DEDT':>4} {'gap us':>6} {'cycle us':>9} {'turn %':>6} {'req/s':>8} {'per node':>9}")
+    for baud in args.baud or BAUD_RATES:
+        de_assert, de_deassert, gap_us = rs485_timing(baud, args.enable_ns, args.disable_ns, args.propagation_ns)
+        cycle = 0.0
+        turnaround = 0.0
+        for request, response, weight in mix:
+            time, turn = transaction_us(baud, request, response, args)
+            cycle += time * weight / total_weight
+            turnaround += turn * weight / total_weight
+        rate = 1e6 / cycle
+        clamped = "*" if max(to_samples(args.enable_ns, baud), to_samples(args.propagation_ns, baud)) > DE_TIME_MAX else " "
+        clamped_any = clamped_any or clamped == "*"
+        print(f"{baud:>8} {de_assert:>4} {de_deassert:>4}{clamped}{gap_us:>6} {cycle:>9.1f} {100 * turnaround / cycle:>6.1f} {rate:>8.0f} {rate / args.nodes:>9.1f}")
+    if clamped_any:
+        print(f"* DE time clamped to {DE_TIME_MAX} sample times, the transceiver is too slow for the rate")
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
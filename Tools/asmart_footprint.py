@@ -0,0 +1,78 @@
+#!/usr/bin/env python3
+"""Prints the RAM a communication handler takes in a build.
+
+    python3 Tools/asmart_footprint.py MDK-ARM/aSmart_Comm_Protocol_Stack/aSmart_Comm_Protocol_Stack.map
+    python3 Tools/asmart_footprint.py build/firmware.elf --instances 3
+
+Reads the absolute symbols asmart_comm_ram_* that asmart_comm_handler.c defines, from a linker
+map file (armlink lists them under Global Symbols) or from an object, ELF or AXF file through nm
+(override the tool with $NM).
+"""
+
+import argparse
+import os
+import re
+import shutil
+import subprocess
+import sys
+
+PREFIX = "asmart_comm_ram_"
+PROFILES = {1: "tiny", 2: "default", 3: "gateway"}  # ASMART_COMM_PROFILE_*, see asmart_comm_config.h
+PARTS = [
+    # symbol suffix, label
+    ("rx", "receive (slots, parser)"),
+    ("tx", "transmit"),
+    ("commands", "mapping table, retransmission"),
+]
+
+
+def read_map(path):
+    symbols = {}
+    pattern = re.compile(r"\b" + PREFIX + r"(\w+)\s+(0x[0-9a-fA-F]+)")
+    with open(path, errors="replace") as f:
+        for line in f:
+            match = pattern.search(line)
+            if match:
+                symbols[match.group(1)] = int(match.group(2), 16)
+    return symbols
+
+
+def read_nm(path):
+    nm = os.environ.get("NM") or shutil.which("arm-none-eabi-nm") or "nm"
+    output = subprocess.run([nm, path], check=True, capture_output=True, text=True).stdout
+    symbols = {}
+    for line in output.splitlines():
+        fields = line.split()
+        if len(fields) == 3 and fields[2].startswith(PREFIX):
+            symbols[fields[2][len(PREFIX):]] = int(fields[0], 16)
+    return symbols
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter)
+    parser.add_argument("file", help="map file, or object/ELF/AXF file")
+    parser.add_argument("--instances", type=int, default=1, help="handlers in the application")
+    args = parser.parse_args()
+
+    try:
+        symbols = read_map(args.file) if args.file.endswith(".map") else read_nm(args.file)
+    except (OSError, subprocess.CalledProcessError) as error:
+        print(f"{args.file}: {error}", file=sys.stderr)
+        return 1
+    if "handler" not in symbols:
+        print(f"{args.file}: no {PREFIX}* symbols, is asmart_comm_handler.c linked and built with GCC, clang or ARM Compiler?", file=sys.stderr)
+        return 1
+
+    handler = symbols["handler"]
+    print(f"profile   {PROFILES.get(symbols.get('profile'), 'unknown')}")
+    print(f"handler   {handler:6d} bytes")
+    for suffix, label in PARTS:
+        if suffix in symbols:
+            print(f"  {symbols[suffix]:6d}  {label}")
+    if args.instances > 1:
+        print(f"x {args.instances:<6d}  {handler * args.instances:6d} bytes")
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
@@ -0,0 +1,612 @@
+#!/usr/bin/env python3
+"""Generates C message types, encoders/decoders and dispatch code from an aSmart schema.
+
+    python3 Tools/asmart_idl.py aSmart_Comm/Schema/asmart_comm.idl
+
+writes <stem>_schema.h to aSmart_Comm/Inc and <stem>_schema.c to aSmart_Comm/Src
+(override with --inc-dir/--src-dir). See the schema file for the format.
+"""
+
+import argparse
+import os
+import re
+import sys
+
+SCALARS = {
+    # name: (C type, wire size)
+    "uint8": ("uint8_t", 1),
+    "uint16": ("uint16_t", 2),
+    "uint32": ("uint32_t", 4),
+    "int8": ("int8_t", 1),
+    "int16": ("int16_t", 2),
+    "int32": ("int32_t", 4),
+    "bool": ("uint8_t", 1),
+    "float": ("float", 4),
+}
+
+UNSIGNED = {1: "uint8_t", 2: "uint16_t", 4: "uint32_t"}
+
+CONTROL_COMMAND_FIRST = 0xF0  # Reserved command and notification types, see asmart_comm_handler.h
+
+TOKEN = re.compile(r"\s*(?:(#[^\n]*)|(<=)|([{}=:\[\];])|(0[xX][0-9a-fA-F]+|\d+)|([A-Za-z_]\w*))")
+
+
+class SchemaError(Exception):
+    pass
+
+
+class Field:
+    def __init__(self, type_name, name, count=None, variable=False):
+        self.type_name = type_name
+        self.name = name
+        self.count = count  # None for a single value
+        self.variable = variable  # Trailing array, element count taken from the payload length
+        self.enum = None
+
+    @property
+    def c_type(self):
+        return SCALARS[self.base_type][0]
+
+    @property
+    def base_type(self):
+        return self.enum.base if self.enum else self.type_name
+
+    @property
+    def element_size(self):
+        return SCALARS[self.base_type][1]
+
+
+class Enum:
+    def __init__(self, name, base, values):
+        self.name = name
+        self.base = base
+        self.values = values
+
+
+class Message:
+    def __init__(self, name, kind, type_id, fields):
+        self.name = name  # e.g. BEGIN_TRANSACTION
+        self.kind = kind  # command, response or notification
+        self.type_id = type_id
+        self.fields = fields
+
+    @property
+    def struct_name(self):
+        return "".join(part.capitalize() for part in self.name.split("_")) + self.kind.capitalize() + "_t"
+
+    @property
+    def func_suffix(self):
+        return "%s_%s" % (self.name.lower(), self.kind)
+
+    @property
+    def size_prefix(self):
+        return "%s_%s" % (self.name, self.kind.upper())
+
+    @property
+    def type_constant(self):
+        return ("NOTIFICATION_TYPE_" if self.kind == "notification" else "COMMAND_TYPE_") + self.name
+
+    @property
+    def message_type(self):
+        return {"command": "MSG_TYPE_COMMAND", "response": "MSG_TYPE_RESPONSE", "notification": "MSG_TYPE_NOTIFICATION"}[self.kind]
+
+    @property
+    def min_size(self):
+        return sum(f.element_size * (f.count or 1) for f in self.fields if not f.variable)
+
+    @property
+    def max_size(self):
+        return sum(f.element_size * (f.count or 1) for f in self.fields)
+
+    @property
+    def tail(self):
+        return self.fields[-1] if self.fields and self.fields[-1].variable else None
+
+
+class Parser:
+    def __init__(self, text, path):
+        self.path = path
+        self.tokens = []  # (token, line)
+        pos = 0
+        while pos < len(text):
+            match = TOKEN.match(text, pos)
+            if not match:
+                if text[pos:].strip():
+                    raise SchemaError("%s:%d: unexpected character %r" % (path, text.count("\n", 0, pos) + 1, text[pos:].strip()[0]))
+                break
+            if not match.group(1):
+                start = match.start(match.lastindex)
+                self.tokens.append((match.group(match.lastindex), text.count("\n", 0, start) + 1))
+            pos = match.end()
+        self.index = 0
+        self.enums = {}
+        self.messages = []
+
+    def error(self, message):
+        line = self.tokens[min(self.index, len(self.tokens) - 1)][1] if self.tokens else 1
+        raise SchemaError("%s:%d: %s" % (self.path, line, message))
+
+    def peek(self):
+        return self.tokens[self.index][0] if self.index < len(self.tokens) else None
+
+    def next(self):
+        if self.index >= len(self.tokens):
+            self.error("unexpected end of file")
+        self.index += 1
+        return self.tokens[self.index - 1][0]
+
+    def expect(self, token):
+        if self.next() != token:
+            self.index -= 1
+            self.error("expected '%s'" % token)
+
+    def identifier(self):
+        token = self.next()
+        if not re.match(r"[A-Za-z_]\w*$", token):
+            self.index -= 1
+            self.error("expected a name")
+        return token
+
+    def number(self):
+        token = self.next()
+        if not re.match(r"(0[xX][0-9a-fA-F]+|\d+)$", token):
+            self.index -= 1
+            self.error("expected a number")
+        return int(token, 0)
+
+    def parse(self):
+        while self.peek() is not None:
+            keyword = self.next()
+            if keyword == "enum":
+                self.parse_enum()
+            elif keyword == "command":
+                self.parse_command()
+            elif keyword == "notification":
+                name, type_id = self.parse_header()
+                self.messages.append(Message(name, "notification", type_id, self.parse_fields()))
+            else:
+                self.index -= 1
+                self.error("expected 'enum', 'command' or 'notification'")
+        self.check()
+        return self.enums, self.messages
+
+    def parse_enum(self):
+        name = self.identifier()
+        self.expect(":")
+        base = self.identifier()
+        if base not in SCALARS or base in ("bool", "float"):
+            self.error("enum base type must be an integer type")
+        self.expect("{")
+        values = []
+        while self.peek() != "}":
+            value_name = self.identifier()
+            self.expect("=")
+            values.append((value_name, self.number()))
+            if self.peek() == ";":
+                self.next()
+        self.next()
+        if name in self.enums:
+            self.error("enum '%s' declared twice" % name)
+        self.enums[name] = Enum(name, base, values)
+
+    def parse_header(self):
+        name = self.identifier()
+        self.expect("=")
+        type_id = self.number()
+        if type_id > 0xFF:
+            self.error("type id of '%s' does not fit one byte" % name)
+        if type_id >= CONTROL_COMMAND_FIRST:
+            self.error("types 0x%02X..0xFF are reserved for library control messages" % CONTROL_COMMAND_FIRST)
+        return name, type_id
+
+    def parse_command(self):
+        name, type_id = self.parse_header()
+        self.expect("{")
+        sections = {"request": [], "response": []}
+        while self.peek() != "}":
+            section = self.identifier()
+            if section not in sections:
+                self.index -= 1
+                self.error("expected 'request' or 'response'")
+            sections[section] = self.parse_fields()
+        self.next()
+        self.messages.append(Message(name, "command", type_id, sections["request"]))
+        self.messages.append(Message(name, "response", type_id, sections["response"]))
+
+    def parse_fields(self):
+        self.expect("{")
+        fields = []
+        while self.peek() != "}":
+            if fields and fields[-1].variable:
+                self.error("only the last field can have a variable length")
+            type_name = self.identifier()
+            if type_name not in SCALARS and type_name not in self.enums:
+                self.index -= 1
+                self.error("unknown type '%s'" % type_name)
+            field = Field(type_name, self.identifier())
+            field.enum = self.enums.get(type_name)
+            if self.peek() == "[":
+                self.next()
+                if self.peek() == "<=":
+                    self.next()
+                    field.variable = True
+                field.count = self.number()
+                if field.count == 0:
+                    self.error("array '%s' has no elements" % field.name)
+                self.expect("]")
+            if any(f.name == field.name for f in fields):
+                self.error("field '%s' declared twice" % field.name)
+            fields.append(field)
+            if self.peek() == ";":
+                self.next()
+        self.next()
+        return fields
+
+    def check(self):
+        seen = {}
+        for message in self.messages:
+            key = (message.kind, message.type_id)
+            if key in seen:
+                raise SchemaError("%s: %s and %s both use %s type 0x%02X" % (self.path, seen[key], message.name, message.kind, message.type_id))
+            seen[key] = message.name
+            if message.max_size > 0xFFFF:
+                raise SchemaError("%s: %s %s is larger than 65535 bytes" % (self.path, message.name, message.kind))
+
+
+def store_value(expr, field, indent):
+    """Lines writing one value big-endian at buffer[index]."""
+    size = field.element_size
+    lines = []
+    if field.base_type == "float":
+        lines.append("%s{" % indent)
+        lines.append("%s    uint32_t raw;" % indent)
+        lines.append("%s    memcpy(&raw, &%s, sizeof(raw));" % (indent, expr))
+        for shift in range(24, -8, -8):
+            lines.append("%s    buffer[index++] = (raw >> %d) & 0xFF;" % (indent, shift) if shift else "%s    buffer[index++] = raw & 0xFF;" % indent)
+        lines.append("%s}" % indent)
+        return lines
+    if field.base_type == "bool":
+        return ["%sbuffer[index++] = %s ? 1 : 0;" % (indent, expr)]
+    value = "(%s)%s" % (UNSIGNED[size], expr) if field.base_type.startswith("int") else expr
+    for shift in range(8 * (size - 1), -8, -8):
+        lines.append("%sbuffer[index++] = (%s >> %d) & 0xFF;" % (indent, value, shift) if shift else "%sbuffer[index++] = %s & 0xFF;" % (indent, value))
+    return lines
+
+
+def load_value(expr, field, indent):
+    """Lines reading one big-endian value from payload[index]."""
+    size = field.element_size
+    if size == 1:
+        raw = "payload[index]"
+    else:
+        parts = ["((%s)payload[index + %d] << %d)" % (UNSIGNED[size], i, 8 * (size - 1 - i)) for i in range(size - 1)]
+        raw = " | ".join(parts + ["payload[index + %d]" % (size - 1)])
+    if field.base_type == "float":
+        return ["%s{" % indent,
+                "%s    uint32_t raw = %s;" % (indent, raw),
+                "%s    memcpy(&%s, &raw, sizeof(raw));" % (indent, expr),
+                "%s}" % indent,
+                "%sindex += 4;" % indent]
+    if field.base_type == "bool":
+        return ["%s%s = (%s != 0);" % (indent, expr, raw), "%sindex += 1;" % indent]
+    return ["%s%s = (%s)(%s);" % (indent, expr, field.c_type, raw), "%sindex += %d;" % (indent, size)]
+
+
+def generate_header(stem, schema_name, enums, messages):
+    guard = "_%s_SCHEMA_H_" % stem.upper()
+    prefix = stem.lower()
+    out = []
+    out.append("#ifndef %s" % guard)
+    out.append("#define %s" % guard)
+    out.append("")
+    out.append("/* Generated by Tools/asmart_idl.py from %s, do not edit */" % schema_name)
+    out.append("")
+    out.append("#ifdef __cplusplus")
+    out.append('extern "C" {')
+    out.append("#endif")
+    out.append("")
+    out.append("#include <stdint.h>")
+    out.append("")
+    out.append("struct aSmart_Comm_Handler_s;")
+    out.append("struct aSmart_Request_s;")
+    out.append("")
+
+    commands = [m for m in messages if m.kind == "command"]
+    notifications = [m for m in messages if m.kind == "notification"]
+    out.append("// Command Types")
+    out.append("typedef enum {")
+    for message in commands:
+        out.append("    %s = 0x%02X," % (message.type_constant, message.type_id))
+    out.append("} command_type_t;")
+    out.append("")
+    if notifications:
+        out.append("// Notification Types")
+        out.append("typedef enum {")
+        for message in notifications:
+            out.append("    %s = 0x%02X," % (message.type_constant, message.type_id))
+        out.append("} notification_type_t;")
+        out.append("")
+
+    for enum in enums.values():
+        out.append("// %s values, sent as %s" % (enum.name, enum.base))
+        out.append("typedef enum {")
+        for name, value in enum.values:
+            out.append("    %s_%s = %d," % (enum.name.upper(), name, value))
+        out.append("} %s_t;" % enum.name)
+        out.append("")
+
+    out.append("// Payload sizes in bytes")
+    for message in messages:
+        out.append("#define %s_MIN_SIZE %d" % (message.size_prefix, message.min_size))
+        out.append("#define %s_MAX_SIZE %d" % (message.size_prefix, message.max_size))
+    out.append("#define %s_SCHEMA_MAX_PAYLOAD %d  // Largest payload of any message" % (prefix.upper(), max([m.max_size for m in messages] + [0])))
+    out.append("")
+
+    for message in messages:
+        if not message.fields:
+            continue
+        out.append("// %s %s payload" % (message.name.replace("_", " ").capitalize(), message.kind))
+        out.append("typedef struct {")
+        for field in message.fields:
+            comment = "  // %s_t" % field.enum.name if field.enum else ""
+            if field.variable:
+                out.append("    uint16_t %s_count;  // Elements used, at most %d" % (field.name, field.count))
+                out.append("    %s %s[%d];%s" % (field.c_type, field.name, field.count, comment))
+            elif field.count:
+                out.append("    %s %s[%d];%s" % (field.c_type, field.name, field.count, comment))
+            else:
+                out.append("    %s %s;%s" % (field.c_type, field.name, comment))
+        out.append("} %s;" % message.struct_name)
+        out.append("")
+
+    out.append("// Schema Table Entry")
+    out.append("typedef struct {")
+    out.append("    uint8_t message_type;")
+    out.append("    uint8_t command_type;  // Command or notification type")
+    out.append("    uint16_t min_size;")
+    out.append("    uint16_t max_size;")
+    out.append("    uint8_t (*handle)(uint16_t sequence_number, const uint8_t* payload, uint16_t length);  // Decodes and calls the asmart_on_ handler, 0 if the payload is malformed")
+    out.append("} aSmart_SchemaEntry_t;")
+    out.append("")
+    out.append("#define %s_SCHEMA_ENTRIES %d" % (prefix.upper(), len(messages)))
+    out.append("extern const aSmart_SchemaEntry_t %s_schema_table[%s_SCHEMA_ENTRIES];" % (prefix, prefix.upper()))
+    out.append("")
+
+    out.append("/**")
+    out.append(" * @brief Decodes a received message and calls its asmart_on_ handler.")
+    out.append(" * @note The handler does not call it: call it from the response callback passed to")
+    out.append(" *       asmart_comm_init() and handle the messages it returns 0 for in the callback.")
+    out.append(" * @param message_type Type of the message received.")
+    out.append(" * @param command_type Type of the command or notification.")
+    out.append(" * @param sequence_number Sequence number of the message.")
+    out.append(" * @param payload Pointer to the payload data.")
+    out.append(" * @param length Length of the payload data.")
+    out.append(" * @retval 1 if handled, 0 if the type is not in the schema or the payload size is wrong.")
+    out.append(" */")
+    out.append("uint8_t %s_schema_dispatch(uint8_t message_type, uint8_t command_type, uint16_t sequence_number, const uint8_t* payload, uint16_t length);" % prefix)
+    out.append("")
+
+    for message in messages:
+        title = "%s %s" % (message.name.replace("_", " ").capitalize(), message.kind)
+        out.append("// %s" % title)
+        if message.fields:
+            out.append("uint16_t asmart_encode_%s(const %s* message, uint8_t* buffer);" % (message.func_suffix, message.struct_name))
+            out.append("uint8_t asmart_decode_%s(const uint8_t* payload, uint16_t length, %s* message);" % (message.func_suffix, message.struct_name))
+        msg_param = ", const %s* message" % message.struct_name if message.fields else ""
+        if message.kind == "command":
+            out.append("void asmart_send_%s(struct aSmart_Comm_Handler_s* comm_handler%s);" % (message.func_suffix, msg_param))
+            out.append("void asmart_request_%s(struct aSmart_Comm_Handler_s* comm_handler, struct aSmart_Request_s* request%s, uint8_t* response);  // response: %s_RESPONSE_MAX_SIZE bytes"
+                       % (message.name.lower(), msg_param, message.name))
+            out.append("void asmart_on_%s(uint16_t sequence_number%s);" % (message.func_suffix, msg_param))
+        elif message.kind == "response":
+            out.append("void asmart_send_%s(struct aSmart_Comm_Handler_s* comm_handler, uint16_t sequence_number%s);" % (message.func_suffix, msg_param))
+            out.append("void asmart_on_%s(uint16_t sequence_number%s);" % (message.func_suffix, msg_param))
+        else:
+            out.append("void asmart_send_%s(struct aSmart_Comm_Handler_s* comm_handler%s);" % (message.func_suffix, msg_param))
+            out.append("void asmart_on_%s(%s);" % (message.func_suffix, msg_param[2:] if msg_param else "void"))
+        out.append("")
+
+    out.append("#ifdef __cplusplus")
+    out.append("}")
+    out.append("#endif")
+    out.append("")
+    out.append("#endif // %s" % guard)
+    return "\n".join(out) + "\n"
+
+
+def generate_source(stem, schema_name, enums, messages):
+    prefix = stem.lower()
+    out = []
+    out.append('#include "%s_schema.h"' % prefix)
+    out.append('#include "asmart_comm_handler.h"')
+    out.append("")
+    out.append("/* Generated by Tools/asmart_idl.py from %s, do not edit */" % schema_name)
+    out.append("")
+    out.append("#if %s_SCHEMA_MAX_PAYLOAD > ASMART_COMM_MAX_PAYLOAD" % prefix.upper())
+    out.append('#error "A schema message does not fit one frame, increase TRANSMIT_BUFFER_SIZE"')
+    out.append("#endif")
+    out.append("#if %s_SCHEMA_MAX_PAYLOAD + FRAME_HEADER_SIZE + FRAME_TRAILER_SIZE > RECEIVE_BUFFER_SIZE" % prefix.upper())
+    out.append('#error "A schema message does not fit the receive buffer, increase RECEIVE_BUFFER_SIZE"')
+    out.append("#endif")
+    out.append("")
+
+    for message in messages:
+        if message.fields:
+            out.extend(generate_codec(message))
+        out.extend(generate_send(message))
+        out.extend(generate_handle(message))
+
+    out.append("const aSmart_SchemaEntry_t %s_schema_table[%s_SCHEMA_ENTRIES] = {" % (prefix, prefix.upper()))
+    for message in messages:
+        out.append("    {%s, %s, %s_MIN_SIZE, %s_MAX_SIZE, handle_%s}," % (message.message_type, message.type_constant, message.size_prefix, message.size_prefix, message.func_suffix))
+    out.append("};")
+    out.append("")
+    out.append("uint8_t %s_schema_dispatch(uint8_t message_type, uint8_t command_type, uint16_t sequence_number, const uint8_t* payload, uint16_t length) {" % prefix)
+    out.append("    for (uint8_t i = 0; i < %s_SCHEMA_ENTRIES; i++) {" % prefix.upper())
+    out.append("        const aSmart_SchemaEntry_t* entry = &%s_schema_table[i];" % prefix)
+    out.append("        if (entry->message_type == message_type && entry->command_type == command_type) {")
+    out.append("            return entry->handle(sequence_number, payload, length);")
+    out.append("        }")
+    out.append("    }")
+    out.append("    return 0;")
+    out.append("}")
+    return "\n".join(out) + "\n"
+
+
+def generate_codec(message):
+    out = []
+    out.append("uint16_t asmart_encode_%s(const %s* message, uint8_t* buffer) {" % (message.func_suffix, message.struct_name))
+    out.append("    uint16_t index = 0;")
+    for field in message.fields:
+        expr = "message->%s" % field.name
+        if field.count:
+            bound = "count" if field.variable else str(field.count)
+            out.append("    {")
+            if field.variable:
+                out.append("        uint16_t count = (%s_count < %d) ? %s_count : %d;" % (expr, field.count, expr, field.count))
+            out.append("        for (uint16_t i = 0; i < %s; i++) {" % bound)
+            out.extend(store_value("%s[i]" % expr, field, "            "))
+            out.append("        }")
+            out.append("    }")
+        else:
+            out.extend(store_value(expr, field, "    "))
+    out.append("    return index;")
+    out.append("}")
+    out.append("")
+
+    out.append("uint8_t asmart_decode_%s(const uint8_t* payload, uint16_t length, %s* message) {" % (message.func_suffix, message.struct_name))
+    out.append("    uint16_t index = 0;")
+    tail = message.tail
+    if tail:
+        out.append("    if (length < %s_MIN_SIZE || length > %s_MAX_SIZE || (length - %s_MIN_SIZE) %% %d != 0) {"
+                   % (message.size_prefix, message.size_prefix, message.size_prefix, tail.element_size))
+    else:
+        out.append("    if (length != %s_MAX_SIZE) {" % message.size_prefix)
+    out.append("        return 0;")
+    out.append("    }")
+    for field in message.fields:
+        expr = "message->%s" % field.name
+        if field.count:
+            if field.variable:
+                out.append("    %s_count = (length - %s_MIN_SIZE) / %d;" % (expr, message.size_prefix, field.element_size))
+                bound = "%s_count" % expr
+            else:
+                bound = str(field.count)
+            out.append("    for (uint16_t i = 0; i < %s; i++) {" % bound)
+            out.extend(load_value("%s[i]" % expr, field, "        "))
+            out.append("    }")
+        else:
+            out.extend(load_value(expr, field, "    "))
+    out.append("    return 1;")
+    out.append("}")
+    out.append("")
+    return out
+
+
+def generate_send(message):
+    out = []
+    msg_param = ", const %s* message" % message.struct_name if message.fields else ""
+    if message.fields:
+        encode = ["    uint8_t* payload = asmart_comm_tx_payload(comm_handler);",
+                  "    uint16_t length = asmart_encode_%s(message, payload);" % message.func_suffix]
+        args = "payload, length"
+    else:
+        encode = []
+        args = "NULL, 0"
+
+    if message.kind == "command":
+        out.append("void asmart_send_%s(aSmart_Comm_Handler_t* comm_handler%s) {" % (message.func_suffix, msg_param))
+        out.extend(encode)
+        out.append("    asmart_comm_send_command(comm_handler, %s, %s);" % (message.type_constant, args))
+        out.append("}")
+        out.append("")
+        out.append("void asmart_request_%s(aSmart_Comm_Handler_t* comm_handler, aSmart_Request_t* request%s, uint8_t* response) {"
+                   % (message.name.lower(), msg_param))
+        out.extend(encode)
+        out.append("    asmart_comm_request(comm_handler, request, %s, %s, response, %s_RESPONSE_MAX_SIZE);" % (message.type_constant, args, message.name))
+        out.append("}")
+    elif message.kind == "response":
+        out.append("void asmart_send_%s(aSmart_Comm_Handler_t* comm_handler, uint16_t sequence_number%s) {" % (message.func_suffix, msg_param))
+        out.extend(encode)
+        out.append("    asmart_comm_send_response(comm_handler, sequence_number, %s, %s);" % (message.type_constant, args))
+        out.append("}")
+    else:
+        out.append("void asmart_send_%s(aSmart_Comm_Handler_t* comm_handler%s) {" % (message.func_suffix, msg_param))
+        out.extend(encode)
+        out.append("    asmart_comm_send_notification(comm_handler, %s, %s);" % (message.type_constant, args))
+        out.append("}")
+    out.append("")
+    return out
+
+
+def generate_handle(message):
+    out = []
+    msg_param = ", const %s* message" % message.struct_name if message.fields else ""
+    if message.kind == "notification":
+        stub_params = msg_param[2:] if msg_param else "void"
+    else:
+        stub_params = "uint16_t sequence_number" + msg_param
+
+    out.append("/* Override in the application */")
+    out.append("__weak void asmart_on_%s(%s) {" % (message.func_suffix, stub_params))
+    if message.kind != "notification":
+        out.append("    (void)sequence_number;")
+    if message.fields:
+        out.append("    (void)message;")
+    out.append("}")
+    out.append("")
+
+    out.append("static uint8_t handle_%s(uint16_t sequence_number, const uint8_t* payload, uint16_t length) {" % message.func_suffix)
+    call_args = [] if message.kind == "notification" else ["sequence_number"]
+    if message.fields:
+        out.append("    %s message;" % message.struct_name)
+        if message.kind == "notification":
+            out.append("    (void)sequence_number;")
+        out.append("    if (!asmart_decode_%s(payload, length, &message)) {" % message.func_suffix)
+        out.append("        return 0;")
+        out.append("    }")
+        out.append("    asmart_on_%s(%s);" % (message.func_suffix, ", ".join(call_args + ["&message"])))
+    else:
+        out.append("    (void)payload;")
+        if message.kind == "notification":
+            out.append("    (void)sequence_number;")
+        out.append("    if (length != 0) {")
+        out.append("        return 0;")
+        out.append("    }")
+        out.append("    asmart_on_%s(%s);" % (message.func_suffix, ", ".join(call_args)))
+    out.append("    return 1;")
+    out.append("}")
+    out.append("")
+    return out
+
+
+def main():
+    root = os.path.dirname(os.path.dirname(os.path.abspath(__file__)))
+    parser = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    parser.add_argument("schema", help="schema file (.idl)")
+    parser.add_argument("--inc-dir", default=os.path.join(root, "aSmart_Comm", "Inc"), help="output directory of the header")
+    parser.add_argument("--src-dir", default=os.path.join(root, "aSmart_Comm", "Src"), help="output directory of the source")
+    args = parser.parse_args()
+
+    with open(args.schema) as schema_file:
+        text = schema_file.read()
+    try:
+        enums, messages = Parser(text, args.schema).parse()
+    except SchemaError as error:
+        sys.stderr.write("%s\n" % error)
+        return 1
+
+    stem = os.path.splitext(os.path.basename(args.schema))[0]
+    schema_name = os.path.relpath(os.path.abspath(args.schema), root).replace(os.sep, "/")
+    outputs = [
+        (os.path.join(args.inc_dir, "%s_schema.h" % stem), generate_header(stem, schema_name, enums, messages)),
+        (os.path.join(args.src_dir, "%s_schema.c" % stem), generate_source(stem, schema_name, enums, messages)),
+    ]
+    for path, content in outputs:
+        with open(path, "w", newline="\n") as output:
+            output.write(content)
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
@@ -0,0 +1,108 @@
+#ifndef _ASMART_COMM_AWAIT_HPP_
+#define _ASMART_COMM_AWAIT_HPP_
+
+/*
+ * C++20 coroutine front end for asmart_comm_request() (host builds).
+ *
+ * The coroutine suspends on co_await and is resumed from asmart_comm_handler() when the
+ * response, error or timeout arrives, so many request flows can run on one thread:
+ *
+ *   asmart::Task transaction(aSmart_Comm_Handler_t* handler) {
+ *       uint8_t response[32];
+ *       auto begin = co_await asmart::request(handler, COMMAND_TYPE_BEGIN_TRANSACTION, payload, 4, response, sizeof(response));
+ *       if (begin.status != REQUEST_DONE) {
+ *           co_return;
+ *       }
+ *       co_await asmart::request(handler, COMMAND_TYPE_END_TRANSACTION, nullptr, 0, response, sizeof(response));
+ *   }
+ */
+
+#include <coroutine>
+#include <cstdint>
+#include <exception>
+
+#include "asmart_comm_handler.h"
+
+namespace asmart {
+
+// Outcome of an awaited request
+struct RequestResult {
+    uint8_t status;  // request_status_t
+    uint8_t error_code;
+    uint16_t response_length;
+};
+
+// Awaitable wrapping one aSmart_Request_t, lives in the coroutine frame while suspended
+class RequestAwaiter {
+public:
+    RequestAwaiter(aSmart_Comm_Handler_t* handler, uint8_t command_type, const uint8_t* payload, uint16_t payload_length,
+                   uint8_t* response, uint16_t response_size) noexcept
+        : handler_(handler), command_type_(command_type), payload_(payload), payload_length_(payload_length),
+          response_(response), response_size_(response_size), request_{} {}
+
+    RequestAwaiter(const RequestAwaiter&) = delete;
+    RequestAwaiter& operator=(const RequestAwaiter&) = delete;
+
+    ~RequestAwaiter() {
+        // Coroutine destroyed while waiting: do not leave a dangling request behind
+        if (request_.status == REQUEST_PENDING) {
+            asmart_comm_cancel_request(handler_, &request_);
+        }
+    }
+
+    bool await_ready() const noexcept { return false; }
+
+    bool await_suspend(std::coroutine_handle<> waiter) noexcept {
+        waiter_ = waiter;
+        request_.context = this;
+        request_.on_complete = &RequestAwaiter::on_complete;
+        asmart_comm_request(handler_, &request_, command_type_, const_cast<uint8_t*>(payload_), payload_length_, response_, response_size_);
+
+        // Stay suspended only if the command actually went out
+        resume_on_complete_ = (request_.status == REQUEST_PENDING);
+        return resume_on_complete_;
+    }
+
+    RequestResult await_resume() const noexcept {
+        return RequestResult{request_.status, request_.error_code, request_.response_length};
+    }
+
+private:
+    static void on_complete(aSmart_Request_t* request) {
+        RequestAwaiter* self = static_cast<RequestAwaiter*>(request->context);
+        if (self->resume_on_complete_) {
+            self->resume_on_complete_ = false;
+            self->waiter_.resume();
+        }
+    }
+
+    aSmart_Comm_Handler_t* handler_;
+    uint8_t command_type_;
+    const uint8_t* payload_;
+    uint16_t payload_length_;
+    uint8_t* response_;
+    uint16_t response_size_;
+    aSmart_Request_t request_;
+    std::coroutine_handle<> waiter_{};
+    bool resume_on_complete_ = false;
+};
+
+inline RequestAwaiter request(aSmart_Comm_Handler_t* handler, uint8_t command_type, const uint8_t* payload, uint16_t payload_length,
+                              uint8_t* response, uint16_t response_size) noexcept {
+    return RequestAwaiter(handler, command_type, payload, payload_length, response, response_size);
+}
+
+// Fire-and-forget coroutine type for request flows; the frame frees itself when the flow returns
+struct Task {
+    struct promise_type {
+        Task get_return_object() noexcept { return {}; }
+        std::suspend_never initial_suspend() noexcept { return {}; }
+        std::suspend_never final_suspend() noexcept { return {}; }
+        void return_void() noexcept {}
+        void unhandled_exception() noexcept { std::terminate(); }
+    };
+};
+
+}  // namespace asmart
+
+#endif // _ASMART_COMM_AWAIT_HPP_
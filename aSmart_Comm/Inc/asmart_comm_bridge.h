@@ -0,0 +1,82 @@
+#ifndef _ASMART_COMM_BRIDGE_H_
+#define _ASMART_COMM_BRIDGE_H_
+
+#include <stdint.h>
+#include "asmart_comm_parser.h"
+#include "asmart_comm_config.h"
+
+// Bridge sizing, routes in asmart_comm_config.h (BRIDGE_ROUTES)
+#define BRIDGE_CUT_THROUGH_TIMEOUT_MS 20  // Frames held for a port cutting a frame through wait this long, then the relayed frame is cut off
+
+// Route Key
+typedef enum {
+    ROUTE_BY_DESTINATION = 0,  // Destination address range, any message type
+    ROUTE_BY_COMMAND  // Command or notification type range
+} route_key_t;
+
+// Forwarding Mode
+typedef enum {
+    FORWARD_CUT_THROUGH = 0,  // Relay each byte as it arrives, once the header is in
+    FORWARD_STORE  // Relay the whole frame after its CRC has been checked
+} forward_mode_t;
+
+// Host Transport Function Type
+/**
+ * @brief Receives the bytes of a forwarded frame; cut-through frames arrive in pieces from the receive interrupt.
+ * @param context Context pointer given with the route.
+ * @param data Pointer to the bytes.
+ * @param length Number of bytes.
+ * @param end 1 with the last piece of the frame; a frame whose bytes stopped ends with an empty
+ *            piece, short of its CRC.
+ */
+typedef void (*BridgeSink)(void* context, const uint8_t* data, uint16_t length, uint8_t end);
+
+struct aSmart_Comm_Handler_s;
+
+// Route Structure
+typedef struct {
+    uint8_t key;  // route_key_t
+    uint8_t first;  // First address or type of the range
+    uint8_t last;  // Last address or type of the range
+    uint8_t mode;  // forward_mode_t
+    struct aSmart_Comm_Handler_s* port;  // Handler whose UART sends the frame, NULL for a sink
+    BridgeSink sink;  // Host transport
+    void* context;
+    uint32_t forwarded;  // Frames forwarded by this route
+    uint32_t truncated;  // Cut-through frames cut short because the target's relay ring was full
+} BridgeRoute_t;
+
+// Routing Table Structure
+typedef struct {
+    BridgeRoute_t routes[BRIDGE_ROUTES];
+    uint8_t route_count;
+} aSmart_Bridge_t;
+
+/**
+ * @brief Initializes an empty routing table.
+ * @param bridge Pointer to the routing table.
+ * @retval None
+ */
+void asmart_bridge_init(aSmart_Bridge_t* bridge);
+
+/**
+ * @brief Appends a route; the caller fills in its target.
+ * @param bridge Pointer to the routing table.
+ * @param key ROUTE_BY_DESTINATION or ROUTE_BY_COMMAND.
+ * @param first First address or type of the range.
+ * @param last Last address or type of the range.
+ * @param mode FORWARD_CUT_THROUGH or FORWARD_STORE.
+ * @retval Pointer to the route, NULL if the table is full.
+ */
+BridgeRoute_t* asmart_bridge_add_route(aSmart_Bridge_t* bridge, uint8_t key, uint8_t first, uint8_t last, uint8_t mode);
+
+/**
+ * @brief Finds the route of a frame. Safe to call from the receive interrupt.
+ * @note Command routes only match commands and notifications; responses and errors are routed by destination.
+ * @param bridge Pointer to the routing table.
+ * @param header Decoded header of the frame.
+ * @retval Pointer to the first matching route, NULL if none.
+ */
+BridgeRoute_t* asmart_bridge_lookup(aSmart_Bridge_t* bridge, const aSmart_FrameHeader_t* header);
+
+#endif // _ASMART_COMM_BRIDGE_H_
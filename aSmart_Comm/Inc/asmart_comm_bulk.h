@@ -0,0 +1,240 @@
+#ifndef _ASMART_COMM_BULK_H_
+#define _ASMART_COMM_BULK_H_
+
+#include <stdint.h>
+#include "asmart_comm_config.h"
+
+// Bulk transfer: an image is cut into numbered blocks of a power-of-two size that divides
+// BULK_PAGE_SIZE; the receiver collects them in two page buffers and hands every completed page
+// to its sink, in order. Sized in asmart_comm_config.h (BULK_PAGE_SIZE).
+#define BULK_PAGE_BLOCKS_MAX 32  // Blocks per page, one bitmap word per page buffer
+#define BULK_MIN_BLOCK_SIZE (BULK_PAGE_SIZE / BULK_PAGE_BLOCKS_MAX)
+#define BULK_MAX_BLOCKS 0xFFFF  // Block numbers are 16 bits
+#define BULK_PROBE_BLOCK 0xFFFF  // Block number of a probe, never a block of the image
+#define BULK_BLOCK_HEADER 3  // [Session][Block Number (2 bytes)] in front of the data
+#define BULK_ACK_SIZE 10  // Acknowledgement payload, see asmart_bulk_rx_ack()
+#define BULK_BURST 8  // Blocks sent per asmart_comm_handler() call
+#define BULK_MAX_PROBES 6  // Unanswered probes before the sender gives up
+#define BULK_PROBE_MAX_MS 2000  // Longest interval between probes, they start at the retransmission timeout and double
+#define BULK_NEXT_NONE (-1)  // asmart_bulk_tx_next(): nothing to send now
+#define BULK_NEXT_PROBE (-2)  // asmart_bulk_tx_next(): send a probe, BULK_PROBE_BLOCK without data
+
+#if (BULK_PAGE_SIZE & (BULK_PAGE_SIZE - 1)) != 0 || BULK_PAGE_SIZE < BULK_PAGE_BLOCKS_MAX
+#error "BULK_PAGE_SIZE must be a power of two, at least BULK_PAGE_BLOCKS_MAX"
+#endif
+
+// Outcome of a transfer, passed to the done callback of both sides
+typedef enum {
+    BULK_OK = 0,  // Every block written, the CRC-32 of the image matches
+    BULK_REFUSED,  // No receiver, busy, or the image does not fit its block numbers
+    BULK_CRC_MISMATCH,  // All blocks written, but the image is not the one announced
+    BULK_SINK_FAILED,  // The receiver's sink refused a page
+    BULK_SOURCE_FAILED,  // The sender's source could not read a block
+    BULK_TIMEOUT,  // The other node stopped answering
+    BULK_CANCELLED  // Ended by asmart_comm_bulk_cancel() or by the other node
+} bulk_status_t;
+
+// Session state
+typedef enum {
+    BULK_IDLE = 0,
+    BULK_OPENING,  // Sender: open command sent, waiting for the block size and window
+    BULK_STREAMING,  // Blocks flow
+    BULK_FINISHING,  // Sender: all blocks acknowledged, finish command sent
+    BULK_FAILED  // Receiver: a page could not be written, blocks are answered with the failure
+} bulk_state_t;
+
+/**
+ * @brief Sink function type, takes the image page by page, in order.
+ * @param context Context pointer given to asmart_comm_bulk_receive().
+ * @param offset Position of the page in the image, a multiple of BULK_PAGE_SIZE.
+ * @param data Page data, valid during the call.
+ * @param length BULK_PAGE_SIZE, less for the last page.
+ * @retval 1 if written, 0 to abort the transfer.
+ */
+typedef uint8_t (*BulkSink)(void* context, uint32_t offset, const uint8_t* data, uint16_t length);
+
+/**
+ * @brief Source function type, reads one block of the image.
+ * @param context Context pointer given to asmart_comm_bulk_send().
+ * @param offset Position of the block in the image.
+ * @param data Receives the block.
+ * @param length Bytes to read.
+ * @retval 1 if read, 0 to abort the transfer.
+ */
+typedef uint8_t (*BulkSource)(void* context, uint32_t offset, uint8_t* data, uint16_t length);
+
+/**
+ * @brief Done function type, called once per transfer from asmart_comm_handler().
+ * @param context Context pointer of the transfer.
+ * @param status bulk_status_t.
+ */
+typedef void (*BulkDone)(void* context, uint8_t status);
+
+// Bulk Receiver Structure, owned by the application while it is registered
+typedef struct {
+    uint8_t state;  // bulk_state_t
+    uint8_t status;  // bulk_status_t of the last transfer, repeated to a retransmitted finish
+    uint8_t peer;  // Sending node
+    uint8_t session;  // Session number chosen by the sender
+    uint32_t size;  // Image size
+    uint32_t crc;  // CRC-32 announced by the sender
+    uint32_t written_crc;  // CRC-32 of the pages handed to the sink so far
+    uint16_t block_size;
+    uint16_t block_count;
+    uint16_t page_blocks;  // Blocks per page
+    uint16_t page;  // First page not handed to the sink yet
+    uint32_t received[2];  // Bit n: block n of the page in buffers[page & 1] is in
+    uint16_t since_ack;  // Blocks taken since the last acknowledgement
+    uint16_t gap_reported;  // First missing block of the last acknowledgement sent for a gap
+    uint8_t buffers[2][BULK_PAGE_SIZE];  // Page being completed and the page after it
+    BulkSink sink;
+    BulkDone done;
+    void* context;
+} aSmart_BulkRx_t;
+
+// Bulk Sender Structure, owned by the application while the transfer runs
+typedef struct {
+    uint8_t state;  // bulk_state_t
+    uint8_t peer;  // Receiving node
+    uint8_t session;
+    uint32_t size;  // Image size
+    uint32_t crc;  // CRC-32 of the image
+    uint16_t block_size;  // Offered in the open command, then the size granted
+    uint16_t block_count;
+    uint16_t acked;  // Blocks below are confirmed, the receiver's first missing block
+    uint16_t limit;  // Blocks below are accepted by the receiver's page buffers
+    uint16_t next;  // First block never sent
+    uint32_t resend;  // Bit n: block acked + n is to be sent again
+    uint32_t resend_armed;  // Time resend was last filled from a gap (ms)
+    uint32_t last_progress;  // Time acked last advanced, or of the last probe (ms)
+    uint8_t probes;  // Probes since the last acknowledgement
+    BulkSource source;
+    BulkDone done;
+    void* context;
+} aSmart_BulkTx_t;
+
+/**
+ * @brief Updates a CRC-32 (IEEE 802.3, as zlib's crc32()) with more data.
+ * @param crc CRC-32 of the data before, 0 to start.
+ * @param data Pointer to the bytes.
+ * @param length Number of bytes.
+ * @retval CRC-32 including the bytes.
+ */
+uint32_t asmart_bulk_crc32(uint32_t crc, const uint8_t* data, uint32_t length);
+
+/**
+ * @brief Largest block size both a node's frames and the page buffers allow.
+ * @param max_data Data bytes that fit one block frame.
+ * @retval Power of two up to BULK_PAGE_SIZE, 0 if even BULK_MIN_BLOCK_SIZE does not fit.
+ */
+uint16_t asmart_bulk_block_size(uint16_t max_data);
+
+/**
+ * @brief Starts a receiver on an open command.
+ * @param rx Pointer to the receiver structure.
+ * @param peer Sending node.
+ * @param session Session number.
+ * @param size Image size.
+ * @param crc CRC-32 of the image.
+ * @param block_size Block size granted, see asmart_bulk_block_size().
+ * @retval Number of blocks, 0 if the image does not fit BULK_MAX_BLOCKS.
+ */
+uint16_t asmart_bulk_rx_open(aSmart_BulkRx_t* rx, uint8_t peer, uint8_t session, uint32_t size, uint32_t crc, uint16_t block_size);
+
+/**
+ * @brief Stores a received block and hands every page it completes to the sink.
+ * @note Blocks outside the two page buffers, of the wrong length or already in are dropped.
+ *       A sink failure moves the receiver to BULK_FAILED.
+ * @param rx Pointer to the receiver structure.
+ * @param block Block number.
+ * @param data Block data.
+ * @param length Block length.
+ * @retval 1 if an acknowledgement is due, 0 otherwise.
+ */
+uint8_t asmart_bulk_rx_block(aSmart_BulkRx_t* rx, uint16_t block, const uint8_t* data, uint16_t length);
+
+/**
+ * @brief Encodes the acknowledgement: [Session][Status][First Missing Block (2)][Limit (2)][Bitmap (4)].
+ * @note Bitmap bit n: block first missing + 1 + n is in. Limit: blocks below it fit the page buffers.
+ *       A status other than BULK_OK ends the transfer on the sender's side.
+ * @param rx Pointer to the receiver structure.
+ * @param payload Receives BULK_ACK_SIZE bytes.
+ * @retval Payload length.
+ */
+uint16_t asmart_bulk_rx_ack(aSmart_BulkRx_t* rx, uint8_t* payload);
+
+/**
+ * @brief Ends a receiver on the finish command.
+ * @param rx Pointer to the receiver structure.
+ * @retval bulk_status_t of the transfer.
+ */
+uint8_t asmart_bulk_rx_finish(aSmart_BulkRx_t* rx);
+
+/**
+ * @brief Prepares a sender; the open command offers block_size.
+ * @param tx Pointer to the sender structure.
+ * @param peer Receiving node.
+ * @param session Session number.
+ * @param size Image size.
+ * @param crc CRC-32 of the image.
+ * @param block_size Largest block the sender's frames carry, see asmart_bulk_block_size().
+ * @retval None
+ */
+void asmart_bulk_tx_start(aSmart_BulkTx_t* tx, uint8_t peer, uint8_t session, uint32_t size, uint32_t crc, uint16_t block_size);
+
+/**
+ * @brief Starts streaming with the block size and limit the receiver granted.
+ * @param tx Pointer to the sender structure.
+ * @param block_size Block size granted.
+ * @param limit Blocks below are accepted.
+ * @param now Current time (ms).
+ * @retval 1 if the grant is usable, 0 otherwise.
+ */
+uint8_t asmart_bulk_tx_opened(aSmart_BulkTx_t* tx, uint16_t block_size, uint16_t limit, uint32_t now);
+
+/**
+ * @brief Takes an acknowledgement: confirms blocks, moves the limit, and queues gaps for sending again.
+ * @note Gaps are queued at once when the acknowledgement confirms new blocks or answers a probe,
+ *       otherwise at most once per retransmission timeout, so blocks already on their way are not
+ *       doubled. After a probe every block sent and not reported is queued.
+ * @param tx Pointer to the sender structure.
+ * @param acked First missing block.
+ * @param limit Blocks below are accepted.
+ * @param bitmap Bit n: block acked + 1 + n is in.
+ * @param now Current time (ms).
+ * @param rto Retransmission timeout (ms).
+ * @retval None
+ */
+void asmart_bulk_tx_ack(aSmart_BulkTx_t* tx, uint16_t acked, uint16_t limit, uint32_t bitmap, uint32_t now, uint32_t rto);
+
+/**
+ * @brief Picks the block to send next: a gap first, then a new block within the limit, or a
+ *        probe once the probe interval has passed without progress.
+ * @note Probes follow a pause of at least the retransmission timeout, long enough for both
+ *       parsers to drop what is left of a damaged frame (RX_IDLE_RESYNC_MS).
+ * @param tx Pointer to the sender structure.
+ * @param now Current time (ms).
+ * @param rto Retransmission timeout (ms), the first probe interval.
+ * @retval Block number, BULK_NEXT_PROBE or BULK_NEXT_NONE.
+ */
+int32_t asmart_bulk_tx_next(aSmart_BulkTx_t* tx, uint32_t now, uint32_t rto);
+
+/**
+ * @brief Tells when the sender has to run again.
+ * @param tx Pointer to the sender structure.
+ * @param now Current time (ms).
+ * @param rto Retransmission timeout (ms).
+ * @retval 0 if a block or probe can be sent, otherwise the milliseconds until the next probe.
+ */
+uint32_t asmart_bulk_tx_deadline(aSmart_BulkTx_t* tx, uint32_t now, uint32_t rto);
+
+/**
+ * @brief Returns the length of a block.
+ * @param size Image size.
+ * @param block_size Block size.
+ * @param block Block number.
+ * @retval Bytes of the block, less than block_size for the last one.
+ */
+uint16_t asmart_bulk_block_length(uint32_t size, uint16_t block_size, uint16_t block);
+
+#endif // _ASMART_COMM_BULK_H_
@@ -0,0 +1,197 @@
+#ifndef _ASMART_COMM_CAN_H_
+#define _ASMART_COMM_CAN_H_
+
+#include <stdint.h>
+#include "asmart_comm_handler.h"
+
+// CAN-FD transport: every frame of the protocol is one ISO 15765-2 (ISO-TP) message, segmented
+// into CAN-FD frames of up to 64 bytes. 29-bit identifiers carry the target and source address
+// as in normal fixed addressing, so the controller's filters drop frames for other nodes.
+#define CAN_ID_PHYSICAL 0x18DA0000UL  // Unicast: 0x18DA<Target><Source>, flow controlled
+#define CAN_ID_FUNCTIONAL 0x18DB0000UL  // Group and broadcast: 0x18DB<Target><Source>, no flow control
+#define CAN_ID_BASE_MASK 0x1FFF0000UL
+#define CAN_ID(base, target, source) ((base) | ((uint32_t)(target) << 8) | (uint32_t)(source))
+#define CAN_ID_TARGET(id) ((uint8_t)((id) >> 8))
+#define CAN_ID_SOURCE(id) ((uint8_t)(id))
+#define CAN_MAX_DATA 64  // Largest CAN-FD frame
+#define CAN_CLASSIC_DATA 8  // Largest classic frame; a single frame up to 7 bytes fits it
+#define CAN_PADDING 0xCC  // Fills a frame up to the next CAN-FD length
+
+// Protocol Control Information, high nibble of the first byte
+#define CAN_PCI_SINGLE 0x00  // [0L][Data] up to 7 bytes, [00][Length][Data] up to 62 bytes
+#define CAN_PCI_FIRST 0x10  // [1L][L][Data] up to 4095 bytes, [10][00][Length (4 bytes)][Data] above
+#define CAN_PCI_CONSECUTIVE 0x20  // [2N][Data], N counts 1..15, 0..15
+#define CAN_PCI_FLOW 0x30  // [3S][Block Size][STmin]
+#define CAN_FLOW_CTS 0x00  // Continue to send
+#define CAN_FLOW_WAIT 0x01  // Wait for another flow control
+#define CAN_FLOW_OVERFLOW 0x02  // The message does not fit, drop it
+#define CAN_SINGLE_MAX (CAN_MAX_DATA - 2)
+#define CAN_FIRST_MAX_SHORT 4095  // Longest length of the 12-bit First Frame field
+
+// Segmentation settings
+#define CAN_BLOCK_SIZE 0  // Consecutive frames granted per flow control, 0: the whole message at once
+#define CAN_STMIN 0  // Separation asked between consecutive frames (ms 0..127, 0xF1..0xF9: 100..900 µs)
+#define CAN_TIMEOUT_MS 1000  // Wait for a flow control (N_Bs) or the next consecutive frame (N_Cr)
+#define CAN_MAX_WAITS 8  // Flow control WAITs accepted per message, then it is dropped
+#define CAN_TX_QUEUE_SIZE (2 * TRANSMIT_BUFFER_SIZE)  // Frames waiting behind the message being segmented
+#define CAN_TX_ENTRY_HEADER 3  // [Target][Length (2 bytes)] in front of a queued frame
+#define CAN_PORTS 2  // FDCAN1 and FDCAN2, for the HAL callbacks
+
+// CAN-FD Frame
+typedef struct {
+    uint32_t id;  // 29-bit identifier
+    uint8_t length;  // Data bytes, a CAN-FD length: 0..8, 12, 16, 20, 24, 32, 48 or 64
+    uint8_t data[CAN_MAX_DATA];
+} aSmart_CanFrame_t;
+
+/**
+ * @brief Controller write function type, called from the main loop and from interrupts.
+ * @param driver Driver pointer given to asmart_can_init(), e.g. the FDCAN handle.
+ * @param frame Frame to queue for sending.
+ * @retval 1 if the controller took the frame, 0 if its Tx FIFO is full.
+ */
+typedef uint8_t (*CanWrite)(void* driver, const aSmart_CanFrame_t* frame);
+
+// Segmentation State of the Message Being Sent
+typedef enum {
+    CAN_TX_IDLE = 0,  // Next message starts with its single or first frame
+    CAN_TX_WAIT_FLOW,  // First frame or a block sent, waiting for the receiver's flow control
+    CAN_TX_SENDING  // Consecutive frames go out
+} can_tx_state_t;
+
+// Reassembly Channel
+typedef struct {
+    uint8_t source;  // Sending node, ADDRESS_UNASSIGNED while free
+    uint8_t functional;  // Group or broadcast message, not flow controlled
+    uint8_t sequence;  // Sequence number of the next consecutive frame
+    uint8_t block_count;  // Consecutive frames since the last flow control
+    uint8_t flow_pending;  // Flow status the Tx FIFO had no room for, 0xFF if none
+    uint16_t length;  // Message length
+    uint16_t received;
+    uint32_t last_frame;  // Time the last frame arrived (ms)
+    uint8_t buffer[RECEIVE_BUFFER_SIZE];
+} aSmart_CanRxChannel_t;
+
+// CAN-FD Link Structure, binds a handler to a controller
+typedef struct {
+    aSmart_Comm_Handler_t* handler;
+    CanWrite write;
+    void* driver;
+    uint8_t own_address;
+    uint16_t group_mask;
+    uint8_t block_size;  // Granted to senders, CAN_BLOCK_SIZE after asmart_can_init()
+    uint8_t stmin;  // Asked of senders, CAN_STMIN after asmart_can_init()
+    uint8_t queue[CAN_TX_QUEUE_SIZE];  // Ring of [Target][Length][Frame] entries, the first one is being sent
+    uint16_t queue_head;
+    uint16_t queue_count;
+    uint8_t tx_state;  // can_tx_state_t
+    uint8_t tx_target;
+    uint8_t tx_sequence;
+    uint8_t tx_block_size;  // Granted by the receiver, 0 for no limit
+    uint8_t tx_block_sent;
+    uint8_t tx_stmin_ms;  // Separation asked by the receiver, rounded up to ms
+    uint8_t tx_waits;
+    uint16_t tx_length;
+    uint16_t tx_offset;  // Message bytes sent
+    uint32_t tx_last;  // Time of the last frame sent or flow control received (ms)
+    aSmart_CanRxChannel_t rx[CAN_RX_CHANNELS];
+    uint32_t tx_messages;
+    uint32_t rx_messages;
+    uint32_t tx_drops;  // Frames dropped: queue full, refused by the receiver or no flow control
+    uint32_t rx_drops;  // Messages lost: no channel free, too long, out of sequence or stalled
+} aSmart_CanLink_t;
+
+/**
+ * @brief Initializes a link and its handler; the handler sends every frame through the link.
+ * @param link Pointer to the link structure.
+ * @param handler Pointer to the communication handler structure.
+ * @param write Controller write function.
+ * @param driver Driver pointer passed to write.
+ * @param response_callback Function pointer to the response callback.
+ * @retval None
+ */
+void asmart_can_init(aSmart_CanLink_t* link, aSmart_Comm_Handler_t* handler, CanWrite write, void* driver, ResponseCallback response_callback);
+
+/**
+ * @brief Sets the node address and group membership of the link and its handler.
+ * @note The controller's filters follow on the next asmart_can_fdcan_start().
+ * @param link Pointer to the link structure.
+ * @param own_address Unicast address of this node (0x01..0x6F).
+ * @param group_mask Group membership, bit n selects ADDRESS_GROUP(n).
+ * @retval None
+ */
+void asmart_can_set_address(aSmart_CanLink_t* link, uint8_t own_address, uint16_t group_mask);
+
+/**
+ * @brief Checks whether a frame is for this node, as the controller's filters do.
+ * @param link Pointer to the link structure.
+ * @param id 29-bit identifier.
+ * @retval 1 if accepted, 0 otherwise.
+ */
+uint8_t asmart_can_accepts(const aSmart_CanLink_t* link, uint32_t id);
+
+/**
+ * @brief Takes a received CAN-FD frame, from the receive interrupt.
+ * @note A completed message goes to asmart_comm_receive_bytes() of the handler. Flow control
+ *       frames are answered, and resume the message being sent.
+ * @param link Pointer to the link structure.
+ * @param frame Received frame.
+ * @retval None
+ */
+void asmart_can_receive(aSmart_CanLink_t* link, const aSmart_CanFrame_t* frame);
+
+/**
+ * @brief Sends what the controller has room for and expires stalled messages.
+ * @note Call it from the main loop and when the controller has sent a frame (Tx complete
+ *       interrupt); the returned time adds to the one asmart_comm_handler() returns.
+ * @param link Pointer to the link structure.
+ * @retval Milliseconds until a separation time or timeout is due; 0 if there is more to do at
+ *         once, ASMART_COMM_NO_DEADLINE if only the controller or the other node can go on.
+ */
+uint32_t asmart_can_service(aSmart_CanLink_t* link);
+
+/**
+ * @brief Returns the room left in the link's queue.
+ * @note A frame the queue has no room for is dropped and counted in tx_drops; check before
+ *       sending a burst of frames, e.g. long responses, larger than RETRANSMIT_FRAME_SIZE.
+ * @param link Pointer to the link structure.
+ * @retval Length of the longest frame that fits, 0 if none.
+ */
+uint16_t asmart_can_tx_room(const aSmart_CanLink_t* link);
+
+/**
+ * @brief Returns the DLC code of a CAN-FD length, rounded up.
+ * @param length Data bytes, up to CAN_MAX_DATA.
+ * @retval DLC code 0..15.
+ */
+uint8_t asmart_can_dlc(uint8_t length);
+
+/**
+ * @brief Returns the data length of a DLC code.
+ * @param dlc DLC code 0..15.
+ * @retval Data bytes.
+ */
+uint8_t asmart_can_dlc_length(uint8_t dlc);
+
+#if !ASMART_COMM_HOST && defined(HAL_FDCAN_MODULE_ENABLED)
+/**
+ * @brief Sets up the FDCAN's filters for the link's addresses and starts it.
+ * @note Needs two extended filters (ExtFiltersNbr): the node's unicast identifiers, and the
+ *       range of group and broadcast identifiers. Other frames are rejected by the hardware.
+ *       With bit rate switching, the transceiver delay compensation is turned on. Stops a
+ *       running FDCAN first, so it can be called again after asmart_can_set_address().
+ * @param link Pointer to the link structure, initialized with the FDCAN handle as driver.
+ * @retval HAL_OK on success, the failing HAL status otherwise.
+ */
+HAL_StatusTypeDef asmart_can_fdcan_start(aSmart_CanLink_t* link);
+
+/**
+ * @brief Controller write function of the FDCAN, see CanWrite.
+ * @param driver FDCAN handle.
+ * @param frame Frame to queue for sending.
+ * @retval 1 if queued, 0 if the Tx FIFO is full.
+ */
+uint8_t asmart_can_fdcan_write(void* driver, const aSmart_CanFrame_t* frame);
+#endif
+
+#endif // _ASMART_COMM_CAN_H_
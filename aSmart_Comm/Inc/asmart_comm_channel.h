@@ -0,0 +1,126 @@
+#ifndef _ASMART_COMM_CHANNEL_H_
+#define _ASMART_COMM_CHANNEL_H_
+
+#include <stdint.h>
+#include "asmart_comm_config.h"
+
+// Channel sizing, queue depth, frame size and commands in flight in asmart_comm_config.h
+#define CHANNEL_PROBE_MS 200  // A sender without credit this long asks the receiver for a new grant
+
+// Channel Frame Callback Function Type
+/**
+ * @brief Called for commands, notifications, responses, errors and timeouts of a channel.
+ * @param channel Logical channel number.
+ * @param message_type Type of the message received.
+ * @param command_type Type of the command or notification.
+ * @param sequence_number Sequence number in the channel's own sequence space.
+ * @param payload Pointer to the payload data (NULL for a timeout).
+ * @param length Length of the payload data.
+ */
+typedef void (*ChannelCallback)(uint8_t channel, uint8_t message_type, uint8_t command_type, uint16_t sequence_number, uint8_t* payload, uint16_t length);
+
+// Queued Frame Structure
+typedef struct {
+    uint16_t sequence_number;  // Channel sequence number, checked against the peer's credit
+    uint16_t frame_length;
+    uint8_t frame[CHANNEL_FRAME_SIZE];  // Encoded frame, ready to transmit
+} ChannelFrame_t;
+
+// Logical Channel Structure
+typedef struct {
+    uint8_t open;
+    uint8_t peer;  // Unicast address of the node at the other end
+    ChannelCallback callback;
+    uint16_t sequence_number;  // Last sequence number used for a command or notification
+
+    /* Sending: the peer accepts sequence numbers up to send_limit */
+    uint16_t send_limit;
+    uint8_t blocked;  // Head of the queue is waiting for credit
+    uint32_t blocked_since;  // Time the wait started or the last probe was sent (ms)
+
+    /* Receiving: frames up to rx_highest + rx_window are accepted */
+    uint8_t rx_window;
+    uint16_t rx_highest;  // Newest sequence number received
+    uint16_t rx_advertised;  // Limit last granted to the peer
+
+    ChannelFrame_t queue[CHANNEL_QUEUE_DEPTH];
+    uint8_t queue_head;
+    uint8_t queue_count;
+} aSmart_Channel_t;
+
+/**
+ * @brief Opens a channel; the sender has no credit until the peer grants some.
+ * @param channel Pointer to the channel structure.
+ * @param peer Unicast address of the node at the other end.
+ * @param rx_window Frames the peer may send ahead of the newest one received.
+ * @param callback Receives the channel's messages, NULL for the handler's response callback.
+ * @retval None
+ */
+void asmart_channel_open(aSmart_Channel_t* channel, uint8_t peer, uint8_t rx_window, ChannelCallback callback);
+
+/**
+ * @brief Closes a channel and drops its queued frames.
+ * @param channel Pointer to the channel structure.
+ * @retval None
+ */
+void asmart_channel_close(aSmart_Channel_t* channel);
+
+/**
+ * @brief Appends an encoded frame to the channel's transmit queue.
+ * @param channel Pointer to the channel structure.
+ * @param sequence_number Channel sequence number of the frame.
+ * @param frame Pointer to the encoded frame.
+ * @param frame_length Length of the encoded frame.
+ * @retval 1 if queued, 0 if the queue is full or the frame too large.
+ */
+uint8_t asmart_channel_enqueue(aSmart_Channel_t* channel, uint16_t sequence_number, const uint8_t* frame, uint16_t frame_length);
+
+/**
+ * @brief Returns the frame at the head of the transmit queue.
+ * @param channel Pointer to the channel structure.
+ * @retval Pointer to the frame, NULL if the queue is empty.
+ */
+ChannelFrame_t* asmart_channel_head(aSmart_Channel_t* channel);
+
+/**
+ * @brief Removes the frame at the head of the transmit queue.
+ * @param channel Pointer to the channel structure.
+ * @retval None
+ */
+void asmart_channel_dequeue(aSmart_Channel_t* channel);
+
+/**
+ * @brief Tells whether the peer's credit covers a sequence number.
+ * @param channel Pointer to the channel structure.
+ * @param sequence_number Channel sequence number.
+ * @retval 1 if it may be sent, 0 otherwise.
+ */
+uint8_t asmart_channel_has_credit(aSmart_Channel_t* channel, uint16_t sequence_number);
+
+/**
+ * @brief Applies a credit grant from the peer; older grants are ignored.
+ * @param channel Pointer to the channel structure.
+ * @param limit Highest sequence number the peer accepts.
+ * @retval None
+ */
+void asmart_channel_grant(aSmart_Channel_t* channel, uint16_t limit);
+
+/**
+ * @brief Records a received command or notification.
+ * @param channel Pointer to the channel structure.
+ * @param sequence_number Channel sequence number of the frame.
+ * @retval None
+ */
+void asmart_channel_received(aSmart_Channel_t* channel, uint16_t sequence_number);
+
+/**
+ * @brief Tells whether a new grant should be sent, and marks it as sent if so.
+ * @note A grant goes out once half of the window has been used, so the sender rarely stalls.
+ * @param channel Pointer to the channel structure.
+ * @param force 1 to grant regardless, e.g. in answer to a probe.
+ * @param limit Receives the limit to grant.
+ * @retval 1 if a grant is due, 0 otherwise.
+ */
+uint8_t asmart_channel_grant_due(aSmart_Channel_t* channel, uint8_t force, uint16_t* limit);
+
+#endif // _ASMART_COMM_CHANNEL_H_
@@ -0,0 +1,194 @@
+#ifndef _ASMART_COMM_CONFIG_H_
+#define _ASMART_COMM_CONFIG_H_
+
+/*
+ * Footprint profiles: every buffer, table and queue embedded in aSmart_Comm_Handler_t is sized
+ * here. Select a profile with ASMART_COMM_PROFILE (compiler define or before the first include);
+ * any single value can still be overridden the same way, it is only set when not defined yet.
+ * Feature switches of asmart_comm_handler.h that a profile turns off are set here as well.
+ *
+ * The size of a handler in the build is exported as the absolute symbols asmart_comm_ram_*,
+ * listed in the map file; Tools/asmart_footprint.py prints them. Define ASMART_COMM_RAM_BUDGET
+ * (bytes) to fail the build of asmart_comm_handler.c when a handler grows beyond it.
+ *
+ * A handler takes about 0.8 KB (tiny), 7.4 KB (default) and 18.4 KB (gateway) on a 32-bit MCU,
+ * against 1.2 KB before the profiles; the receive slots, channel queues and held frames
+ * make up most of the default size. Trim single values to fit a smaller part.
+ */
+
+#define ASMART_COMM_PROFILE_TINY 1  // One small node per UART, several instances beside the application
+#define ASMART_COMM_PROFILE_DEFAULT 2  // Every feature on, frame buffers and command table as before the profiles
+#define ASMART_COMM_PROFILE_GATEWAY 3  // Bridges and multiplexes many nodes
+
+#ifndef ASMART_COMM_PROFILE
+#define ASMART_COMM_PROFILE ASMART_COMM_PROFILE_DEFAULT
+#endif
+
+#if ASMART_COMM_PROFILE == ASMART_COMM_PROFILE_TINY
+// Half-duplex: receive and transmit share one buffer, no bridging, credits, channels, link keys
+// or bulk transfer
+#ifndef ASMART_COMM_HALF_DUPLEX
+#define ASMART_COMM_HALF_DUPLEX 1
+#endif
+#ifndef ASMART_COMM_RX_CREDITS
+#define ASMART_COMM_RX_CREDITS 0
+#endif
+#ifndef ASMART_COMM_BRIDGE
+#define ASMART_COMM_BRIDGE 0
+#endif
+#ifndef ASMART_COMM_CHANNELS
+#define ASMART_COMM_CHANNELS 1
+#endif
+#ifndef ASMART_COMM_SECURE
+#define ASMART_COMM_SECURE 0
+#endif
+#ifndef ASMART_COMM_BULK
+#define ASMART_COMM_BULK 0
+#endif
+#define PROFILE_BUFFER_SIZE 128
+#define PROFILE_RX_SLOTS 2
+#define PROFILE_MAPPING_ENTRIES 4
+#define PROFILE_RETRANSMIT_SLOTS 2
+#define PROFILE_COPY_SIZE 32
+#define PROFILE_RTO_OVERRIDES 2
+#define PROFILE_CREDIT_PEERS 1
+#define PROFILE_TX_HOLD 1
+#define PROFILE_REPLAY_ENTRIES 2
+#define PROFILE_SUBSCRIPTIONS 4
+#define PROFILE_CHANNEL_QUEUE 2
+#define PROFILE_CHANNEL_FRAME_SIZE 64
+#define PROFILE_CHANNEL_IN_FLIGHT 2
+#define PROFILE_ROUTES 2
+#define PROFILE_RELAY_SIZE 64
+#define PROFILE_SECURE_LINKS 1
+#define PROFILE_BULK_PAGE_SIZE 256
+#define PROFILE_CAN_RX_CHANNELS 1
+#define PROFILE_SPI_SLOT_SIZE 64
+#elif ASMART_COMM_PROFILE == ASMART_COMM_PROFILE_DEFAULT
+#define PROFILE_BUFFER_SIZE 512
+#define PROFILE_RX_SLOTS 4
+#define PROFILE_MAPPING_ENTRIES 20
+#define PROFILE_RETRANSMIT_SLOTS 4
+#define PROFILE_COPY_SIZE 64
+#define PROFILE_RTO_OVERRIDES 4
+#define PROFILE_CREDIT_PEERS 4
+#define PROFILE_TX_HOLD 2
+#define PROFILE_REPLAY_ENTRIES 4
+#define PROFILE_SUBSCRIPTIONS 16
+#define PROFILE_CHANNEL_QUEUE 4
+#define PROFILE_CHANNEL_FRAME_SIZE 128
+#define PROFILE_CHANNEL_IN_FLIGHT 4
+#define PROFILE_ROUTES 8
+#define PROFILE_RELAY_SIZE 64
+#define PROFILE_SECURE_LINKS 2
+#define PROFILE_BULK_PAGE_SIZE 2048
+#define PROFILE_CAN_RX_CHANNELS 2
+#define PROFILE_SPI_SLOT_SIZE 128
+#elif ASMART_COMM_PROFILE == ASMART_COMM_PROFILE_GATEWAY
+#define PROFILE_BUFFER_SIZE 512
+#define PROFILE_RX_SLOTS 8
+#define PROFILE_MAPPING_ENTRIES 32
+#define PROFILE_RETRANSMIT_SLOTS 8
+#define PROFILE_COPY_SIZE 128
+#define PROFILE_RTO_OVERRIDES 8
+#define PROFILE_CREDIT_PEERS 8
+#define PROFILE_TX_HOLD 4
+#define PROFILE_REPLAY_ENTRIES 8
+#define PROFILE_SUBSCRIPTIONS 32
+#define PROFILE_CHANNEL_QUEUE 8
+#define PROFILE_CHANNEL_FRAME_SIZE 256
+#define PROFILE_CHANNEL_IN_FLIGHT 8
+#define PROFILE_ROUTES 16
+#define PROFILE_RELAY_SIZE 128
+#define PROFILE_SECURE_LINKS 8
+#define PROFILE_BULK_PAGE_SIZE 2048
+#define PROFILE_CAN_RX_CHANNELS 8
+#define PROFILE_SPI_SLOT_SIZE 256
+#else
+#error "ASMART_COMM_PROFILE must be ASMART_COMM_PROFILE_TINY, _DEFAULT or _GATEWAY"
+#endif
+
+// Frame buffers (asmart_comm_handler.h)
+#ifndef RECEIVE_BUFFER_SIZE
+#define RECEIVE_BUFFER_SIZE PROFILE_BUFFER_SIZE  // Longest frame received, per receive slot
+#endif
+#ifndef TRANSMIT_BUFFER_SIZE
+#define TRANSMIT_BUFFER_SIZE PROFILE_BUFFER_SIZE  // Longest frame sent; with ASMART_COMM_HALF_DUPLEX at most RECEIVE_BUFFER_SIZE
+#endif
+#ifndef RX_STREAM_SLOTS
+#define RX_STREAM_SLOTS PROFILE_RX_SLOTS  // Receive slots of streaming reception (power of two)
+#endif
+
+// Commands in flight (asmart_comm_handler.h)
+#ifndef MAPPING_TABLE_ENTRIES
+#define MAPPING_TABLE_ENTRIES PROFILE_MAPPING_ENTRIES  // Commands waiting for their response, over all channels
+#endif
+#ifndef RETRANSMIT_SLOTS
+#define RETRANSMIT_SLOTS PROFILE_RETRANSMIT_SLOTS  // Commands that can be retransmitted concurrently
+#endif
+#ifndef RETRANSMIT_FRAME_SIZE
+#define RETRANSMIT_FRAME_SIZE PROFILE_COPY_SIZE  // Larger commands are not retransmitted
+#endif
+#ifndef RTO_OVERRIDE_ENTRIES
+#define RTO_OVERRIDE_ENTRIES PROFILE_RTO_OVERRIDES  // Command types with a fixed timeout
+#endif
+#ifndef CREDIT_PEERS
+#define CREDIT_PEERS PROFILE_CREDIT_PEERS  // Nodes with credit flow control
+#endif
+#ifndef TX_HOLD_FRAMES
+#define TX_HOLD_FRAMES PROFILE_TX_HOLD  // Frames held back while their node has no credit, their port forwards a frame or the RS485 response gap runs
+#endif
+
+// Replay cache (asmart_comm_replay.h)
+#ifndef REPLAY_CACHE_ENTRIES
+#define REPLAY_CACHE_ENTRIES PROFILE_REPLAY_ENTRIES  // Responses kept, the oldest is evicted first
+#endif
+#ifndef REPLAY_CACHE_FRAME_SIZE
+#define REPLAY_CACHE_FRAME_SIZE PROFILE_COPY_SIZE  // Larger responses are sent but not cached
+#endif
+
+// Topic subscriptions (asmart_comm_pubsub.h)
+#ifndef SUBSCRIPTION_ENTRIES
+#define SUBSCRIPTION_ENTRIES PROFILE_SUBSCRIPTIONS  // Subscriptions held by a publisher, over all subscribers and topics
+#endif
+
+// Logical channels (asmart_comm_channel.h)
+#ifndef CHANNEL_QUEUE_DEPTH
+#define CHANNEL_QUEUE_DEPTH PROFILE_CHANNEL_QUEUE  // Frames queued per channel, waiting for their turn or for credit
+#endif
+#ifndef CHANNEL_FRAME_SIZE
+#define CHANNEL_FRAME_SIZE PROFILE_CHANNEL_FRAME_SIZE  // Larger frames are refused on a multiplexed channel
+#endif
+#ifndef CHANNEL_MAX_IN_FLIGHT
+#define CHANNEL_MAX_IN_FLIGHT PROFILE_CHANNEL_IN_FLIGHT  // Unanswered commands per channel
+#endif
+
+// Bridge (asmart_comm_bridge.h)
+#ifndef BRIDGE_ROUTES
+#define BRIDGE_ROUTES PROFILE_ROUTES  // Routes per receiving port, the first match wins
+#endif
+#ifndef BRIDGE_RELAY_SIZE
+#define BRIDGE_RELAY_SIZE PROFILE_RELAY_SIZE  // Cut-through bytes queued per sending port for its UART (power of two)
+#endif
+
+// Secured links (asmart_comm_secure.h)
+#ifndef SECURE_LINKS
+#define SECURE_LINKS PROFILE_SECURE_LINKS  // Nodes with a link key, each holds its expanded key and counters
+#endif
+
+// Bulk transfer (asmart_comm_bulk.h)
+#ifndef BULK_PAGE_SIZE
+#define BULK_PAGE_SIZE PROFILE_BULK_PAGE_SIZE  // Sink page, e.g. a flash page; a receiver holds two (power of two)
+#endif
+
+// CAN-FD transport (asmart_comm_can.h)
+#ifndef CAN_RX_CHANNELS
+#define CAN_RX_CHANNELS PROFILE_CAN_RX_CHANNELS  // Segmented messages reassembled at the same time, each from another source
+#endif
+
+// SPI transport (asmart_comm_spi.h)
+#ifndef SPI_SLOT_SIZE
+#define SPI_SLOT_SIZE PROFILE_SPI_SLOT_SIZE  // Bytes of every transfer, both ways; frames stream through the slots
+#endif
+
+#endif // _ASMART_COMM_CONFIG_H_
@@ -1,24 +1,249 @@
 #ifndef _ASMART_COMM_HANDLER_H_
 #define _ASMART_COMM_HANDLER_H_
 
+#ifdef __cplusplus
+extern "C" {
+#endif
+
 #include <stdint.h>
 #include <string.h>
+#include "asmart_comm_config.h"
+
+// Linux host build: serial ports of Host/Linux stand in for the UARTs (set to 1 by the host build)
+#ifndef ASMART_COMM_HOST
+#define ASMART_COMM_HOST 0
+#endif
+
+#if ASMART_COMM_HOST
+#include "asmart_comm_host.h"
+#else
 #include "usart.h"
+#endif
+#include "asmart_comm_parser.h"
+#include "asmart_comm_replay.h"
+#include "asmart_comm_rtt.h"
+#include "asmart_comm_schema.h"
+#include "asmart_comm_telemetry.h"
+#include "asmart_comm_pubsub.h"
+#include "asmart_comm_channel.h"
+#include "asmart_comm_bridge.h"
+#include "asmart_comm_secure.h"
+#include "asmart_comm_bulk.h"
+#include "asmart_comm_rs485.h"
 
-// UART handle definition (modify according to your UART instance)
+// UART handle used by asmart_comm_init() (modify according to your UART instance)
 #define COMM_UART hlpuart2
 
+// Handlers receiving at the same time, one per UART (asmart_comm_init_port())
+#define ASMART_COMM_PORTS 2
+
 // Constants for special characters
 #define STX 0x02  // Start of Text
 #define ETX 0x03  // End of Text
+#define SOH 0x01  // Start of Heading, starts a compact-header frame
 
-// Buffer sizes
-#define RECEIVE_BUFFER_SIZE 512
-#define TRANSMIT_BUFFER_SIZE 512
+// Buffer sizes, set by the footprint profile (asmart_comm_config.h)
+#define ASMART_COMM_MAX_PAYLOAD (TRANSMIT_BUFFER_SIZE - FRAME_HEADER_SIZE - FRAME_TRAILER_SIZE)  // Largest payload that fits one frame
 
-// Command timeout in milliseconds
+// Initial command timeout in milliseconds, used until the first round-trip time has been measured
 #define COMMAND_TIMEOUT_MS 5000  // Adjust as needed
 
+// Returned by asmart_comm_handler() when nothing is due: sleep until a frame arrives or something is sent
+#define ASMART_COMM_NO_DEADLINE 0xFFFFFFFFU
+
+// Retransmission
+#define COMMAND_MAX_RETRIES 2  // Retransmissions before a command times out
+#define NO_RETRANSMIT_SLOT 0xFF
+
+// Node addressing (7-bit address space, matches the UART address-match hardware)
+#define ADDRESS_UNASSIGNED 0x00  // Never matches; used before asmart_comm_set_address()
+#define ADDRESS_GROUP_FIRST 0x70  // Group addresses 0x70..0x7E map to group_mask bits 0..14
+#define ADDRESS_GROUP_LAST 0x7E
+#define ADDRESS_BROADCAST 0x7F  // Accepted by every node, never answered
+#define ADDRESS_GROUP(n) (ADDRESS_GROUP_FIRST + (n))
+#define ASMART_COMM_DEFAULT_ADDRESS 0x01  // Own and peer address after asmart_comm_init()
+
+// Hardware address filtering: runs the UART in 9-bit multiprocessor mode and prefixes every frame
+// with an address mark so non-addressed nodes stay muted. Every node on the bus must use the same
+// setting. A muted node only wakes for its unicast address, so a node with a group mask stays awake
+// and filters in software, and broadcast frames are not sent at all. Not with ASMART_COMM_BRIDGE:
+// build it with the tiny profile or with ASMART_COMM_BRIDGE set to 0.
+#ifndef ASMART_COMM_ADDRESS_MUTE_MODE
+#define ASMART_COMM_ADDRESS_MUTE_MODE 0
+#endif
+
+// Byte-wise reception: every byte is parsed and CRC'd from the receive interrupt and a frame is
+// ready as soon as its ETX arrives. Set to 0 to receive whole blocks up to the idle line instead.
+#ifndef ASMART_COMM_STREAMING_RX
+#define ASMART_COMM_STREAMING_RX 1
+#endif
+#if ASMART_COMM_HOST && (!ASMART_COMM_STREAMING_RX || ASMART_COMM_ADDRESS_MUTE_MODE)
+#error "ASMART_COMM_HOST needs ASMART_COMM_STREAMING_RX without ASMART_COMM_ADDRESS_MUTE_MODE"
+#endif
+
+// A frame whose bytes stop this long is dropped, so a damaged frame does not take the frames
+// after it as its remains. Keep above the longest pause a sender makes within a frame.
+#define RX_IDLE_RESYNC_MS 20
+
+// Completed frames wait in a ring of receive slots until asmart_comm_handler() dispatches them,
+// so the next frames can arrive meanwhile (RX_STREAM_SLOTS). Block reception uses a single slot.
+#if ASMART_COMM_STREAMING_RX && !ASMART_COMM_HALF_DUPLEX
+#define RX_FRAME_SLOTS RX_STREAM_SLOTS
+#else
+#define RX_FRAME_SLOTS 1
+#endif
+
+// Receiver credits: negotiated nodes only send while this node has a receive slot free for them,
+// so a fast sender does not overrun a slow receiver. Needs ASMART_COMM_STREAMING_RX.
+#ifndef ASMART_COMM_RX_CREDITS
+#define ASMART_COMM_RX_CREDITS 1
+#endif
+#if ASMART_COMM_RX_CREDITS && !ASMART_COMM_STREAMING_RX
+#error "ASMART_COMM_RX_CREDITS needs ASMART_COMM_STREAMING_RX"
+#endif
+
+// Credit sizing. Each sending peer may fill RX_CREDIT_WINDOW slots, keep RX_FRAME_SLOTS above
+// the window times the number of peers sending at the same time.
+#define RX_CREDIT_WINDOW 3  // Unacknowledged frames per peer, at most 3 (2-bit counter)
+#define CREDIT_RESYNC_MS 100  // A sender without credit this long resynchronises the counters, then gives up
+#define CREDIT_COUNTER_MASK (FRAME_CREDIT_MASK >> FRAME_CREDIT_SHIFT)
+
+// Gateway mode: frames matching a route of the receiving port are forwarded unchanged to another
+// port or a host transport, cut through as soon as their header is in (routes in asmart_comm_bridge.h).
+// Needs ASMART_COMM_STREAMING_RX; a bridge must hear every frame, so mute mode is not supported.
+#ifndef ASMART_COMM_BRIDGE
+#define ASMART_COMM_BRIDGE 1
+#endif
+#if ASMART_COMM_BRIDGE && (!ASMART_COMM_STREAMING_RX || ASMART_COMM_ADDRESS_MUTE_MODE)
+#error "ASMART_COMM_BRIDGE needs ASMART_COMM_STREAMING_RX without ASMART_COMM_ADDRESS_MUTE_MODE"
+#endif
+
+// Answer retransmitted commands from a cache of recent responses (sized in asmart_comm_config.h)
+#ifndef ASMART_COMM_REPLAY_CACHE
+#define ASMART_COMM_REPLAY_CACHE 1
+#endif
+
+// Offer the compact header in asmart_comm_negotiate(). Compact frames are always accepted;
+// they are only sent to nodes that agreed to them.
+#ifndef ASMART_COMM_COMPACT_HEADER
+#define ASMART_COMM_COMPACT_HEADER 1
+#endif
+
+// Delta-encoded telemetry streams (sized in asmart_comm_telemetry.h)
+#ifndef ASMART_COMM_TELEMETRY
+#define ASMART_COMM_TELEMETRY 1
+#endif
+
+// Topic subscriptions: notification types marked as topics are only sent to subscribed nodes
+#ifndef ASMART_COMM_PUBSUB
+#define ASMART_COMM_PUBSUB 1
+#endif
+
+// Frame capture: a hook sees every frame dispatched and every frame sent, e.g. to record traffic
+// for replay (Host/Linux/Src/asmart_comm_capture.c)
+#ifndef ASMART_COMM_CAPTURE
+#define ASMART_COMM_CAPTURE 1
+#endif
+
+// Logical channels per link, including the default channel 0 (at most 4, 1 disables multiplexing).
+// Channels 1..n have their own sequence numbers, transmit queue and credit-based flow control.
+#ifndef ASMART_COMM_CHANNELS
+#define ASMART_COMM_CHANNELS 4
+#endif
+#if ASMART_COMM_CHANNELS < 1 || ASMART_COMM_CHANNELS > ((FRAME_CHANNEL_MASK >> FRAME_CHANNEL_SHIFT) + 1)
+#error "ASMART_COMM_CHANNELS must be 1..4"
+#endif
+
+// Half-duplex: frames are assembled in the receive buffer, so a handler holds one frame buffer
+// instead of two. Received bytes are dropped while a frame is assembled or sent, and a received
+// frame not dispatched yet is lost to a send, as in a collision on the bus; a payload received
+// is overwritten by the first frame sent while it is dispatched. Uses a single receive slot.
+#ifndef ASMART_COMM_HALF_DUPLEX
+#define ASMART_COMM_HALF_DUPLEX 0
+#endif
+#if ASMART_COMM_HALF_DUPLEX && (!ASMART_COMM_STREAMING_RX || ASMART_COMM_RX_CREDITS || ASMART_COMM_BRIDGE)
+#error "ASMART_COMM_HALF_DUPLEX needs ASMART_COMM_STREAMING_RX without ASMART_COMM_RX_CREDITS and ASMART_COMM_BRIDGE"
+#endif
+
+// Secured links: frames to and from a node with a link key are encrypted and authenticated with
+// AES-CCM and carry a frame counter against replays (keys and counters in asmart_comm_secure.h).
+// Group and broadcast frames are never secured.
+#ifndef ASMART_COMM_SECURE
+#define ASMART_COMM_SECURE 1
+#endif
+#define ASMART_COMM_SECURE_MAX_PAYLOAD (ASMART_COMM_MAX_PAYLOAD - SECURE_OVERHEAD)  // Largest payload of a secured frame
+
+// Bulk transfer: an image streams to a node's sink in numbered blocks under a window of two
+// pages, without a round trip per block (page buffers and blocks in asmart_comm_bulk.h).
+#ifndef ASMART_COMM_BULK
+#define ASMART_COMM_BULK 1
+#endif
+
+// Sizing checks: frame limits against the buffers and the counters they are kept in
+#if TRANSMIT_BUFFER_SIZE < FRAME_HEADER_SIZE + FRAME_TRAILER_SIZE || RECEIVE_BUFFER_SIZE < FRAME_HEADER_SIZE + FRAME_TRAILER_SIZE
+#error "RECEIVE_BUFFER_SIZE and TRANSMIT_BUFFER_SIZE must hold an empty frame"
+#endif
+#if RECEIVE_BUFFER_SIZE > 0xFFFF || TRANSMIT_BUFFER_SIZE > 0xFFFF
+#error "RECEIVE_BUFFER_SIZE and TRANSMIT_BUFFER_SIZE exceed the 16-bit frame length"
+#endif
+#if ASMART_COMM_HALF_DUPLEX && TRANSMIT_BUFFER_SIZE > RECEIVE_BUFFER_SIZE
+#error "ASMART_COMM_HALF_DUPLEX assembles frames in the receive buffer, TRANSMIT_BUFFER_SIZE must not exceed RECEIVE_BUFFER_SIZE"
+#endif
+#if ASMART_COMM_SCHEMA_MAX_PAYLOAD > ASMART_COMM_MAX_PAYLOAD || ASMART_COMM_SCHEMA_MAX_PAYLOAD > RECEIVE_BUFFER_SIZE - FRAME_HEADER_SIZE - FRAME_TRAILER_SIZE
+#error "A message of the schema does not fit the frame buffers"
+#endif
+#if ASMART_COMM_SECURE && ASMART_COMM_SCHEMA_MAX_PAYLOAD > ASMART_COMM_SECURE_MAX_PAYLOAD
+#error "A message of the schema does not fit a secured frame"
+#endif
+#if ASMART_COMM_BULK && ASMART_COMM_HALF_DUPLEX
+#error "ASMART_COMM_BULK streams blocks back to back, a half-duplex node drops them while it answers"
+#endif
+#if RX_FRAME_SLOTS < 1 || RX_FRAME_SLOTS > 128 || (RX_FRAME_SLOTS & (RX_FRAME_SLOTS - 1)) != 0
+#error "RX_STREAM_SLOTS must be a power of two, 1..128"
+#endif
+#if ASMART_COMM_RX_CREDITS && RX_FRAME_SLOTS < RX_CREDIT_WINDOW
+#error "RX_STREAM_SLOTS must cover at least one RX_CREDIT_WINDOW"
+#endif
+#if TX_HOLD_FRAMES < 1 || TX_HOLD_FRAMES > 255
+#error "TX_HOLD_FRAMES must be 1..255"
+#endif
+#if ASMART_COMM_BRIDGE && (BRIDGE_RELAY_SIZE < 2 || BRIDGE_RELAY_SIZE > 32768 || (BRIDGE_RELAY_SIZE & (BRIDGE_RELAY_SIZE - 1)) != 0)
+#error "BRIDGE_RELAY_SIZE must be a power of two, 2..32768"
+#endif
+#if MAPPING_TABLE_ENTRIES < 1 || MAPPING_TABLE_ENTRIES > 255 || RETRANSMIT_SLOTS >= NO_RETRANSMIT_SLOT || RTO_OVERRIDE_ENTRIES > 255
+#error "MAPPING_TABLE_ENTRIES, RETRANSMIT_SLOTS and RTO_OVERRIDE_ENTRIES are counted in 8 bits"
+#endif
+#if RETRANSMIT_FRAME_SIZE > TRANSMIT_BUFFER_SIZE || (ASMART_COMM_REPLAY_CACHE && REPLAY_CACHE_FRAME_SIZE > TRANSMIT_BUFFER_SIZE)
+#error "RETRANSMIT_FRAME_SIZE and REPLAY_CACHE_FRAME_SIZE must not exceed TRANSMIT_BUFFER_SIZE"
+#endif
+#if ASMART_COMM_CHANNELS > 1 && (CHANNEL_FRAME_SIZE > TRANSMIT_BUFFER_SIZE || CHANNEL_FRAME_SIZE < FRAME_HEADER_SIZE + FRAME_TRAILER_SIZE || CHANNEL_QUEUE_DEPTH > 255 || CHANNEL_MAX_IN_FLIGHT > MAPPING_TABLE_ENTRIES)
+#error "Channel sizing does not fit TRANSMIT_BUFFER_SIZE or MAPPING_TABLE_ENTRIES"
+#endif
+#if (ASMART_COMM_BRIDGE && BRIDGE_ROUTES > 255) || (ASMART_COMM_PUBSUB && SUBSCRIPTION_ENTRIES > 255)
+#error "BRIDGE_ROUTES and SUBSCRIPTION_ENTRIES are counted in 8 bits"
+#endif
+
+// Library control messages, handled inside the library and never passed to the application
+#define CONTROL_COMMAND_FIRST 0xF0  // Command and notification types 0xF0..0xFF are reserved
+#define CONTROL_COMMAND_NEGOTIATE 0xF0  // Payload: capabilities of the sender; response: the common ones
+#define CONTROL_NOTIFICATION_TELEMETRY_ACK 0xF1  // Payload: [Notification Type][Sample], the sample was rebuilt
+#define CONTROL_NOTIFICATION_KEYFRAME_REQUEST 0xF2  // Payload: [Notification Type], the baseline is missing
+#define CONTROL_COMMAND_SUBSCRIBE 0xF3  // Payload: [Topic][Min Interval (ms, 2 bytes)][Decimation]; response: [Accepted]
+#define CONTROL_COMMAND_UNSUBSCRIBE 0xF4  // Payload: [Topic]; response: the same
+#define CONTROL_NOTIFICATION_CHANNEL_CREDIT 0xF5  // Payload: [Channel][Limit (2 bytes)], highest sequence number accepted
+#define CONTROL_NOTIFICATION_CHANNEL_PROBE 0xF6  // Payload: [Channel][Sequence Number (2 bytes)], sender is blocked at it
+#define CONTROL_NOTIFICATION_CREDIT 0xF7  // Empty: credit update; [Frames Sent]: blocked sender resynchronises the counters
+#define CONTROL_COMMAND_BULK_OPEN 0xF8  // Payload: [Session][Size (4 bytes)][CRC-32 (4 bytes)][Block Size (2 bytes)]; response: [Session][Status][Block Size (2 bytes)][Limit (2 bytes)]
+#define CONTROL_NOTIFICATION_BULK_BLOCK 0xF9  // Payload: [Session][Block Number (2 bytes)][Data]; block 0xFFFF is a probe
+#define CONTROL_NOTIFICATION_BULK_ACK 0xFA  // Payload: [Session][Status][First Missing Block (2 bytes)][Limit (2 bytes)][Bitmap (4 bytes)]
+#define CONTROL_COMMAND_BULK_FINISH 0xFB  // Payload: [Session]; response: [Session][Status]
+#define CONTROL_NOTIFICATION_BULK_ABORT 0xFC  // Payload: [Session][Status], the sender ends the transfer
+
+// Capability bits exchanged by CONTROL_COMMAND_NEGOTIATE
+#define CAPABILITY_COMPACT_HEADER 0x01
+#define CAPABILITY_RX_CREDITS 0x02
+#define ASMART_COMM_CAPABILITIES ((ASMART_COMM_COMPACT_HEADER ? CAPABILITY_COMPACT_HEADER : 0) | (ASMART_COMM_RX_CREDITS ? CAPABILITY_RX_CREDITS : 0))
+
 // Message Types
 typedef enum {
     MSG_TYPE_COMMAND = 0x01,
@@ -27,78 +252,710 @@ typedef enum {
     MSG_TYPE_ERROR = 0x04
 } message_type_t;
 
-// Command Types
-typedef enum {
-    COMMAND_TYPE_BEGIN_TRANSACTION = 0x10,
-    COMMAND_TYPE_END_TRANSACTION = 0x11,
-    // Add other command types as needed
-} command_type_t;
+// Command types, payload layouts and sizes are generated from Schema/asmart_comm.idl (asmart_comm_schema.h)
 
 // Command Entry Structure for Mapping Table
 typedef struct {
     uint16_t sequence_number;
+    uint8_t channel;  // Logical channel, the sequence number is unique within it
     uint8_t command_type;
-    uint32_t timestamp;  // Time when the command was sent (ms)
+    uint8_t queued;  // Waiting in the channel's transmit queue, the timeout has not started
+    uint32_t timestamp;  // Time when the command was last sent (ms)
+    uint32_t timeout;  // Time to wait for the response to this attempt (ms)
+    uint8_t retries;  // Retransmissions so far
+    uint8_t retransmit_slot;  // Index into retransmit_slots, NO_RETRANSMIT_SLOT if none
+    uint8_t fixed_timeout;  // Timeout comes from an override, not from the RTT estimate
 } CommandEntry_t;
 
+// Retransmission Copy of a Sent Command
+typedef struct {
+    uint16_t frame_length;  // Zero marks a free slot
+    uint8_t frame[RETRANSMIT_FRAME_SIZE];
+} RetransmitSlot_t;
+
+// Fixed Timeout for a Command Type
+typedef struct {
+    uint8_t command_type;
+    uint32_t timeout_ms;
+} RtoOverride_t;
+
+// Receiver Credit State of a Node, counters are modulo 4
+typedef struct {
+    uint8_t address;  // ADDRESS_UNASSIGNED marks a free entry
+    uint8_t active;  // Both nodes count, set once the negotiation has completed
+    uint8_t sent;  // Frames sent to the node that take one of its receive slots
+    volatile uint8_t acknowledged;  // Frames the node has consumed, from the last frame it sent
+    uint8_t consumed;  // Frames from the node dispatched and their slots freed
+    uint8_t advertised;  // Value of consumed last sent to the node
+    uint8_t blocked;  // A frame is held back for lack of credit
+    uint8_t resynced;  // The counters were resent during this hold
+    uint32_t blocked_since;  // Time the hold started or the resync was sent (ms)
+} CreditPeer_t;
+
+// Frame Held Back until its Node has Credit or its Port is Free
+typedef struct {
+    uint8_t destination;
+    uint8_t counted;  // Waits for the node's credit, its credit bits are stamped when it is sent
+    uint16_t frame_length;
+    uint8_t frame[TRANSMIT_BUFFER_SIZE];  // Encoded frame
+} HeldFrame_t;
+
+// Received Frame Slot
+typedef struct {
+    uint8_t buffer[RECEIVE_BUFFER_SIZE];
+    uint16_t length;  // Frame length, or bytes received with block reception
+    aSmart_FrameHeader_t header;  // Decoded by the streaming parser
+#if ASMART_COMM_BRIDGE
+    BridgeRoute_t* route;  // Forward the frame from the slot, NULL if not routed
+    uint8_t deliver;  // Dispatch the frame locally as well
+#endif
+} RxFrameSlot_t;
+
 // Receive Handler Structure
 typedef struct {
-    uint8_t rxd_buffer[RECEIVE_BUFFER_SIZE];
-    uint16_t rxd_buffer_size;
-    uint16_t rxd_index;
-    uint8_t message_ready;
+    RxFrameSlot_t slots[RX_FRAME_SLOTS];
+    volatile uint8_t slot_in;  // Slots filled, only written by the receive interrupt
+    volatile uint8_t slot_out;  // Slots dispatched, only written by asmart_comm_handler()
+    uint8_t dropping;  // All slots were full, bytes are dropped until one is free
+#if ASMART_COMM_HALF_DUPLEX
+    volatile uint8_t tx_owned;  // The buffer holds a frame being assembled or sent, bytes are dropped
+    uint8_t dispatching;  // The frame in the slot is being dispatched, a send may use its payload
+#endif
+    uint16_t overruns;  // Frames lost because all slots were full
+    uint32_t last_byte;  // Time bytes last arrived (ms)
+    uint32_t last_byte_us;  // The same in µs, kept while an RS485 response gap is set
+    uint16_t rxd_word;  // Single-word landing area for streaming reception
+    aSmart_Parser_t parser;
+#if ASMART_COMM_BRIDGE
+    BridgeRoute_t* route;  // Route of the frame being received
+    uint8_t deliver;  // Frame being received is for this node as well
+#endif
 } aSmart_RxHandler_t;
 
+// Port Owner, arbitrates a UART between sends and frames cut through from another port
+typedef enum {
+    PORT_FREE = 0,
+    PORT_SENDING,  // A frame is sent from the main loop
+    PORT_FORWARDING  // A frame is cut through from the receive interrupt of another port
+} port_owner_t;
+
 // Transmit Handler Structure
 typedef struct {
+#if ASMART_COMM_HALF_DUPLEX
+    uint8_t* txd_buffer;  // Buffer of the receive slot, see ASMART_COMM_HALF_DUPLEX
+#else
     uint8_t txd_buffer[TRANSMIT_BUFFER_SIZE];
+#endif
+    uint16_t txd_start;  // Frame offset in txd_buffer, a compact header ends where the standard one does
     uint16_t txd_length;
 } aSmart_TxHandler_t;
 
+// Request Status
+typedef enum {
+    REQUEST_IDLE = 0,
+    REQUEST_PENDING,  // Command sent, waiting for the response
+    REQUEST_DONE,  // Response received
+    REQUEST_FAILED,  // Error received (see error_code) or command could not be sent
+    REQUEST_TIMEOUT  // No response after all retransmissions
+} request_status_t;
+
+// Awaitable Request Structure, owned by the caller until it is no longer pending
+typedef struct aSmart_Request_s {
+    uint16_t sequence_number;
+    uint8_t command_type;
+    volatile uint8_t status;  // request_status_t
+    uint8_t error_code;  // Error code of a MSG_TYPE_ERROR answer
+    uint8_t* response;  // Buffer for the response payload
+    uint16_t response_size;
+    uint16_t response_length;  // Bytes stored, truncated to response_size
+    void (*on_complete)(struct aSmart_Request_s* request);  // Optional, called from asmart_comm_handler()
+    void* context;  // Free for the owner, e.g. a coroutine handle
+    struct aSmart_Request_s* next;  // Pending list link
+} aSmart_Request_t;
+
+// Capture directions
+#define CAPTURE_RX 0  // Received frame, before it is dispatched
+#define CAPTURE_TX 1  // Sent frame, as written to the port
+
+/**
+ * @brief Capture hook function type, called from the main loop, never from an interrupt.
+ * @param context Context pointer given to asmart_comm_set_capture().
+ * @param direction CAPTURE_RX or CAPTURE_TX.
+ * @param frame Pointer to the frame, STX or SOH at index 0; only valid during the call.
+ * @param length Frame length.
+ */
+typedef void (*CaptureHook)(void* context, uint8_t direction, const uint8_t* frame, uint16_t length);
+
+/**
+ * @brief Frame writer function type, sends frames of a handler that has no UART, e.g. over CAN.
+ * @param context Context pointer given to asmart_comm_init_transport().
+ * @param destination Destination address of the frame.
+ * @param frame Pointer to the frame, STX or SOH at index 0; only valid during the call.
+ * @param length Frame length.
+ */
+typedef void (*FrameWriter)(void* context, uint8_t destination, const uint8_t* frame, uint16_t length);
+
+/**
+ * @brief Clock source function type.
+ * @retval Milliseconds from a free-running counter that wraps at 2^32, like HAL_GetTick().
+ */
+typedef uint32_t (*ClockSource)(void);
+
 // Response Callback Function Type
 /**
  * @brief Response callback function type.
  * @param message_type Type of the message received.
  * @param command_type Type of the command or notification.
  * @param sequence_number Sequence number of the message (zero if not applicable).
- * @param payload Pointer to the payload data.
+ * @param payload Pointer to the payload data, in the receive slot and not NUL-terminated; copy
+ *                it to keep it past the callback.
  * @param length Length of the payload data.
  */
 typedef void (*ResponseCallback)(uint8_t message_type, uint8_t command_type, uint16_t sequence_number, uint8_t* payload, uint16_t length);
 
 // Communication Handler Structure
-typedef struct {
+typedef struct aSmart_Comm_Handler_s {
+    UART_HandleTypeDef* uart;  // Port of this handler, NULL on a transport
+    FrameWriter writer;  // Transport of this handler, NULL on a UART
+    void* writer_context;
+    uint8_t own_address;  // Unicast address of this node
+    uint16_t group_mask;  // Bit n set: member of ADDRESS_GROUP(n)
+    uint8_t peer_address;  // Destination of asmart_comm_send_command()/asmart_comm_send_notification()
+    uint8_t reply_address;  // Source of the last received command, destination of responses and errors
+    uint8_t reply_enabled;  // Cleared when the last command was broadcast or group addressed
+    uint16_t reply_sequence_number;  // Sequence number of the last received command
+    uint8_t reply_command_type;  // Type of the last received command
+    uint8_t reply_channel;  // Channel of the last received command
+    uint8_t compact_peers[16];  // Bit per unicast address: node accepts compact headers
     uint16_t sequence_number;
-    CommandEntry_t mapping_table[20];  // Adjust size as needed
+    CommandEntry_t mapping_table[MAPPING_TABLE_ENTRIES];
     uint8_t mapping_table_count;
+    RetransmitSlot_t retransmit_slots[RETRANSMIT_SLOTS];
+    aSmart_RttEstimator_t rtt;  // Round-trip estimate of this link
+    aSmart_Rs485Timing_t rs485;  // Turnaround of this link, all zero until asmart_comm_set_rs485()
+    RtoOverride_t rto_overrides[RTO_OVERRIDE_ENTRIES];
+    uint8_t rto_override_count;
     aSmart_RxHandler_t rx_handler;
     aSmart_TxHandler_t tx_handler;
     ResponseCallback response_callback;  // Single callback for all messages
+    aSmart_Request_t* pending_requests;  // Requests waiting for their response
+#if ASMART_COMM_REPLAY_CACHE
+    aSmart_ReplayCache_t replay_cache;  // Responses to recent commands
+#endif
+#if ASMART_COMM_TELEMETRY
+    aSmart_TelemetryTx_t* telemetry_tx;  // Streams sent by this node
+    aSmart_TelemetryRx_t* telemetry_rx;  // Streams rebuilt for the response callback
+#endif
+#if ASMART_COMM_PUBSUB
+    aSmart_PubSub_t pubsub;  // Topics published by this node and their subscribers
+#endif
+#if ASMART_COMM_CHANNELS > 1
+    aSmart_Channel_t channels[ASMART_COMM_CHANNELS - 1];  // Channels 1..n
+    uint8_t channel_cursor;  // Channel served first by the next scheduling round
+#endif
+#if ASMART_COMM_RX_CREDITS
+    CreditPeer_t credit_peers[CREDIT_PEERS];  // Nodes that agreed to receiver credits
+#endif
+    HeldFrame_t held_frames[TX_HOLD_FRAMES];  // Frames that could not go out yet, in the order they were sent
+    uint8_t held_count;
+#if ASMART_COMM_BRIDGE
+    aSmart_Bridge_t bridge;  // Routes of frames received on this port
+    volatile uint8_t port_owner;  // port_owner_t
+    struct aSmart_Comm_Handler_s* volatile relay_source;  // Port whose frame is cut through this one
+    uint8_t relay_ring[BRIDGE_RELAY_SIZE];  // Cut-through bytes on their way to this port's UART
+    volatile uint16_t relay_head;  // Bytes queued, written by the receive interrupt of the source port
+    volatile uint16_t relay_tail;  // Bytes the UART has taken
+    volatile uint16_t relay_sending;  // Bytes handed to the UART and not sent yet, 0 while it is idle
+    volatile uint8_t relay_end;  // The last byte of the frame is queued
+    volatile uint8_t relay_overflow;  // Bytes of the frame were lost, the ring was full
+    uint8_t port_waiting;  // A held frame waits for the port
+    uint32_t port_waiting_since;  // Time the wait started (ms)
+#endif
+#if ASMART_COMM_CAPTURE
+    CaptureHook capture;  // NULL while not capturing
+    void* capture_context;
+#endif
+#if ASMART_COMM_SECURE
+    aSmart_Secure_t secure;  // Link keys, frame counters and replay windows
+#endif
+#if ASMART_COMM_BULK
+    aSmart_BulkTx_t* bulk_tx;  // Transfer being sent, NULL if none
+    aSmart_BulkRx_t* bulk_rx;  // Receiver of incoming transfers, NULL refuses them
+    uint8_t bulk_session;  // Session number of the last transfer sent
+#endif
 } aSmart_Comm_Handler_t;
 
 // Function Prototypes
 
+#if !ASMART_COMM_HOST
 /**
- * @brief Initializes the communication handler.
+ * @brief Initializes the communication handler on COMM_UART.
  * @param comm_handler Pointer to the communication handler structure.
  * @param response_callback Function pointer to the response callback.
  * @retval None
  */
 void asmart_comm_init(aSmart_Comm_Handler_t* comm_handler, ResponseCallback response_callback);
+#endif
 
 /**
- * @brief Handles incoming messages and timeouts. Should be called periodically.
+ * @brief Initializes a communication handler on its own UART, e.g. one per port of a gateway.
+ * @note Up to ASMART_COMM_PORTS handlers receive at the same time; initializing another handler
+ *       on the same UART replaces the previous one. On a host, any number of opened ports.
  * @param comm_handler Pointer to the communication handler structure.
+ * @param huart UART of the port.
+ * @param response_callback Function pointer to the response callback.
  * @retval None
  */
-void asmart_comm_handler(aSmart_Comm_Handler_t* comm_handler);
+void asmart_comm_init_port(aSmart_Comm_Handler_t* comm_handler, UART_HandleTypeDef* huart, ResponseCallback response_callback);
 
 /**
- * @brief Sends a command message.
+ * @brief Initializes a communication handler on a transport other than a UART, e.g. a CAN-FD link.
+ * @note Every frame sent goes to the writer whole; the transport passes the bytes it receives
+ *       to asmart_comm_receive_bytes(). Address mute mode and RS485 turnaround do not apply.
+ * @param comm_handler Pointer to the communication handler structure.
+ * @param writer Frame writer of the transport.
+ * @param context Context pointer passed to the writer.
+ * @param response_callback Function pointer to the response callback.
+ * @retval None
+ */
+void asmart_comm_init_transport(aSmart_Comm_Handler_t* comm_handler, FrameWriter writer, void* context, ResponseCallback response_callback);
+
+/**
+ * @brief Handles incoming messages and timeouts, and tells when it has to run next.
+ * @note Every pending receive slot is dispatched, oldest first. Call it again when a frame has
+ *       arrived (asmart_comm_rx_pending()), after sending, or when the returned time is up;
+ *       the caller may sleep in between instead of polling.
+ * @param comm_handler Pointer to the communication handler structure.
+ * @retval Milliseconds until the next command timeout, retransmission or channel probe is due;
+ *         0 if there is more to do at once, ASMART_COMM_NO_DEADLINE if nothing is pending.
+ */
+uint32_t asmart_comm_handler(aSmart_Comm_Handler_t* comm_handler);
+
+/**
+ * @brief Checks whether received frames wait for asmart_comm_handler(), e.g. before going to sleep.
+ * @param comm_handler Pointer to the communication handler structure.
+ * @retval 1 if a frame is pending, 0 otherwise.
+ */
+uint8_t asmart_comm_rx_pending(aSmart_Comm_Handler_t* comm_handler);
+
+/**
+ * @brief Sets the millisecond clock of the library, shared by all handlers.
+ * @note Set it before the first handler is initialized, e.g. to an RTOS tick count or a
+ *       low-power timer that keeps running in sleep.
+ * @param clock Clock source, NULL for HAL_GetTick().
+ * @retval None
+ */
+void asmart_comm_set_clock(ClockSource clock);
+
+/**
+ * @brief Returns the time of the library clock, the base of all its timeouts.
+ * @retval Milliseconds, see ClockSource.
+ */
+uint32_t asmart_comm_now(void);
+
+/**
+ * @brief Returns a free-running time in µs, for waits shorter than a tick.
+ * @note The HAL tick plus the SysTick count within it on the MCU, the monotonic clock on the
+ *       host; it does not follow asmart_comm_set_clock().
+ * @retval Time (µs), wraps around.
+ */
+uint32_t asmart_comm_now_us(void);
+
+/**
+ * @brief Sets the node address and group membership.
+ * @note With ASMART_COMM_ADDRESS_MUTE_MODE the UART address-match register is updated as well,
+ *       and the UART only enters mute mode while group_mask is 0.
+ * @param comm_handler Pointer to the communication handler structure.
+ * @param own_address Unicast address of this node (0x01..0x6F).
+ * @param group_mask Group membership, bit n selects ADDRESS_GROUP(n).
+ * @retval None
+ */
+void asmart_comm_set_address(aSmart_Comm_Handler_t* comm_handler, uint8_t own_address, uint16_t group_mask);
+
+/**
+ * @brief Sets the RS485 turnaround of the link, derived with asmart_rs485_timing().
+ * @note On the MCU the DE times go to the UART, which is disabled for a moment to take them;
+ *       reception is aborted and started again around it, so a frame being received is lost
+ *       and retransmitted like one damaged on the line. On the host they go to the serial
+ *       driver (TIOCSRS485), in whole milliseconds. A frame sent before response_gap_us have
+ *       passed since the last byte received is held and sent by asmart_comm_handler(), whose
+ *       deadline covers the rest of the gap, so the other node's driver is off before this
+ *       node's comes on.
+ * @param comm_handler Pointer to the communication handler structure.
+ * @param timing Turnaround of the link.
+ * @retval 1 if set, 0 if the port has no driver enable control or cuts a frame through (gap set regardless).
+ */
+uint8_t asmart_comm_set_rs485(aSmart_Comm_Handler_t* comm_handler, const aSmart_Rs485Timing_t* timing);
+
+/**
+ * @brief Sets the default destination used by asmart_comm_send_command() and asmart_comm_send_notification().
+ * @param comm_handler Pointer to the communication handler structure.
+ * @param peer_address Unicast, group or broadcast address.
+ * @retval None
+ */
+void asmart_comm_set_peer(aSmart_Comm_Handler_t* comm_handler, uint8_t peer_address);
+
+/**
+ * @brief Offers this node's capabilities to a node; once it agrees, frames to it use the compact header and receiver credits.
+ * @note Negotiation runs in the background and is silent towards the application. A node that
+ *       negotiates with this one is switched as well. Credits are only offered while
+ *       CREDIT_PEERS has room.
+ * @param comm_handler Pointer to the communication handler structure.
+ * @param destination Unicast address of the node.
+ * @retval None
+ */
+void asmart_comm_negotiate(aSmart_Comm_Handler_t* comm_handler, uint8_t destination);
+
+/**
+ * @brief Sends a command to the peer and completes the request when its response, error or timeout arrives.
+ * @note The response callback is not called for request commands. The request and response
+ *       buffer must stay valid while the request is pending. on_complete and context are left as
+ *       they are: zero-initialize the request (static, or = {0}) or set both before the first call.
+ *       A request that cannot be sent completes at once with REQUEST_FAILED; one that is still
+ *       pending is cancelled and issued again.
+ * @param comm_handler Pointer to the communication handler structure.
+ * @param request Pointer to the request; sequence_number holds the command's Sequence Number afterwards.
+ * @param command_type Type of the command to send.
+ * @param payload Pointer to the payload data.
+ * @param payload_length Length of the payload data.
+ * @param response Buffer for the response payload.
+ * @param response_size Size of the response buffer.
+ * @retval None
+ */
+void asmart_comm_request(aSmart_Comm_Handler_t* comm_handler, aSmart_Request_t* request, uint8_t command_type, uint8_t* payload, uint16_t payload_length, uint8_t* response, uint16_t response_size);
+
+/**
+ * @brief Stops waiting for a request; a late response goes to the response callback.
+ * @param comm_handler Pointer to the communication handler structure.
+ * @param request Pointer to the request.
+ * @retval None
+ */
+void asmart_comm_cancel_request(aSmart_Comm_Handler_t* comm_handler, aSmart_Request_t* request);
+
+/**
+ * @brief Gives a command type a fixed timeout instead of the adaptive one, e.g. for slow commands.
+ * @note Commands with an override do not feed the link's round-trip estimate.
+ * @param comm_handler Pointer to the communication handler structure.
+ * @param command_type Command type.
+ * @param timeout_ms Timeout of the first attempt (ms), doubled on each retransmission. Zero removes the override.
+ * @retval None
+ */
+void asmart_comm_set_command_timeout(aSmart_Comm_Handler_t* comm_handler, uint8_t command_type, uint32_t timeout_ms);
+
+/**
+ * @brief Returns the payload area of the transmit buffer so a payload can be encoded in place.
+ * @note Passing this pointer as the payload of the next send call skips the payload copy.
+ *       The area is overwritten by every message sent, including responses sent from the
+ *       response callback. With ASMART_COMM_HALF_DUPLEX reception pauses until the message is sent.
+ * @param comm_handler Pointer to the communication handler structure.
+ * @retval Pointer to ASMART_COMM_MAX_PAYLOAD bytes.
+ */
+uint8_t* asmart_comm_tx_payload(aSmart_Comm_Handler_t* comm_handler);
+
+#if ASMART_COMM_TELEMETRY
+/**
+ * @brief Registers a telemetry stream sent by this node; acknowledgements and keyframe requests for it are handled internally.
+ * @param comm_handler Pointer to the communication handler structure.
+ * @param tx Pointer to a sender initialized with asmart_telemetry_tx_init(), must stay valid.
+ * @retval None
+ */
+void asmart_comm_add_telemetry_tx(aSmart_Comm_Handler_t* comm_handler, aSmart_TelemetryTx_t* tx);
+
+/**
+ * @brief Registers a telemetry stream received by this node.
+ * @note Notifications of this type reach the response callback with the rebuilt full snapshot
+ *       as the payload; undecodable samples are dropped.
+ * @param comm_handler Pointer to the communication handler structure.
+ * @param rx Pointer to a receiver initialized with asmart_telemetry_rx_init(), must stay valid.
+ * @retval None
+ */
+void asmart_comm_add_telemetry_rx(aSmart_Comm_Handler_t* comm_handler, aSmart_TelemetryRx_t* rx);
+
+/**
+ * @brief Sends the next sample of a telemetry stream as a keyframe or delta notification.
+ * @note Group and broadcast streams cannot be acknowledged and send keyframes only.
+ * @param comm_handler Pointer to the communication handler structure.
+ * @param tx Pointer to a registered telemetry sender.
+ * @param snapshot Encoded snapshot, must not point into asmart_comm_tx_payload().
+ * @retval None
+ */
+void asmart_comm_send_telemetry(aSmart_Comm_Handler_t* comm_handler, aSmart_TelemetryTx_t* tx, const uint8_t* snapshot);
+#endif
+
+#if ASMART_COMM_PUBSUB
+/**
+ * @brief Makes a notification type a topic: it is only sent to nodes subscribed to it.
+ * @note Notifications to a unicast address need that node's subscription, group and broadcast
+ *       notifications are sent when any subscriber is due.
+ * @param comm_handler Pointer to the communication handler structure.
+ * @param topic Notification type (below CONTROL_COMMAND_FIRST).
+ * @retval None
+ */
+void asmart_comm_publish_topic(aSmart_Comm_Handler_t* comm_handler, uint8_t topic);
+
+/**
+ * @brief Subscribes to a topic of another node.
+ * @note The subscription is lost when the publisher restarts; subscribing again renews it and
+ *       updates the limits.
+ * @param comm_handler Pointer to the communication handler structure.
+ * @param publisher Unicast address of the publishing node.
+ * @param topic Notification type.
+ * @param min_interval_ms Minimum time between two notifications, zero for none.
+ * @param decimation Receive only every n-th publication, zero or one for all.
+ * @retval None
+ */
+void asmart_comm_subscribe(aSmart_Comm_Handler_t* comm_handler, uint8_t publisher, uint8_t topic, uint16_t min_interval_ms, uint8_t decimation);
+
+/**
+ * @brief Cancels a subscription.
  * @param comm_handler Pointer to the communication handler structure.
+ * @param publisher Unicast address of the publishing node.
+ * @param topic Notification type.
+ * @retval None
+ */
+void asmart_comm_unsubscribe(aSmart_Comm_Handler_t* comm_handler, uint8_t publisher, uint8_t topic);
+#endif
+
+#if ASMART_COMM_CHANNELS > 1
+/**
+ * @brief Opens a logical channel to a node and grants it the receive window.
+ * @note Both nodes open the channel; a node sends on it once the other has granted credit.
+ * @param comm_handler Pointer to the communication handler structure.
+ * @param channel Channel number, 1..ASMART_COMM_CHANNELS-1.
+ * @param peer Unicast address of the node.
+ * @param rx_window Frames the node may send ahead of the newest one received.
+ * @param callback Receives the channel's messages, NULL for the response callback.
+ * @retval None
+ */
+void asmart_comm_channel_open(aSmart_Comm_Handler_t* comm_handler, uint8_t channel, uint8_t peer, uint8_t rx_window, ChannelCallback callback);
+
+/**
+ * @brief Closes a logical channel; queued frames are dropped and incoming ones ignored.
+ * @param comm_handler Pointer to the communication handler structure.
+ * @param channel Channel number.
+ * @retval None
+ */
+void asmart_comm_channel_close(aSmart_Comm_Handler_t* comm_handler, uint8_t channel);
+
+/**
+ * @brief Queues a command on a logical channel; asmart_comm_handler() sends it when the channel has credit and its turn.
+ * @note The response, error or timeout goes to the channel callback with the channel's sequence number.
+ * @param comm_handler Pointer to the communication handler structure.
+ * @param channel Channel number.
  * @param command_type Type of the command to send.
  * @param payload Pointer to the payload data.
  * @param payload_length Length of the payload data.
+ * @retval 1 if queued, 0 if the channel is closed, its queue full or CHANNEL_MAX_IN_FLIGHT commands are unanswered.
+ */
+uint8_t asmart_comm_channel_send_command(aSmart_Comm_Handler_t* comm_handler, uint8_t channel, uint8_t command_type, uint8_t* payload, uint16_t payload_length);
+
+/**
+ * @brief Queues a notification on a logical channel.
+ * @param comm_handler Pointer to the communication handler structure.
+ * @param channel Channel number.
+ * @param notification_type Type of the notification.
+ * @param payload Pointer to the payload data.
+ * @param payload_length Length of the payload data.
+ * @retval 1 if queued, 0 if the channel is closed or its queue full.
+ */
+uint8_t asmart_comm_channel_send_notification(aSmart_Comm_Handler_t* comm_handler, uint8_t channel, uint8_t notification_type, uint8_t* payload, uint16_t payload_length);
+#endif
+
+#if ASMART_COMM_BRIDGE
+/**
+ * @brief Forwards frames received on this port to another port, without decoding or re-encoding them.
+ * @note Frames for this node are dispatched as usual unless a route takes them; group and
+ *       broadcast frames are dispatched and forwarded. A cut-through frame is relayed byte by
+ *       byte from the receive interrupt through the target's relay ring; its CRC is checked by the
+ *       final receiver only. If the target port is busy sending, the frame is stored, checked and
+ *       forwarded by asmart_comm_handler() instead.
+ * @param comm_handler Pointer to the receiving handler.
+ * @param key ROUTE_BY_DESTINATION or ROUTE_BY_COMMAND.
+ * @param first First address or type of the range.
+ * @param last Last address or type of the range.
+ * @param target Handler of the port that sends the frames.
+ * @param mode FORWARD_CUT_THROUGH or FORWARD_STORE; a target on a transport, or slower than the
+ *             receiving port, always stores.
+ * @retval 1 if added, 0 if the target is invalid or the routing table is full.
+ */
+uint8_t asmart_comm_route_to_port(aSmart_Comm_Handler_t* comm_handler, uint8_t key, uint8_t first, uint8_t last, aSmart_Comm_Handler_t* target, uint8_t mode);
+
+/**
+ * @brief Forwards frames received on this port to a host transport, e.g. USB or a socket.
+ * @note With FORWARD_CUT_THROUGH the sink is called from the receive interrupt with each piece
+ *       of the frame; with FORWARD_STORE it is called once from asmart_comm_handler().
+ * @param comm_handler Pointer to the receiving handler.
+ * @param key ROUTE_BY_DESTINATION or ROUTE_BY_COMMAND.
+ * @param first First address or type of the range.
+ * @param last Last address or type of the range.
+ * @param sink Host transport function.
+ * @param context Context pointer passed to the sink.
+ * @param mode FORWARD_CUT_THROUGH or FORWARD_STORE.
+ * @retval 1 if added, 0 if the routing table is full.
+ */
+uint8_t asmart_comm_route_to_sink(aSmart_Comm_Handler_t* comm_handler, uint8_t key, uint8_t first, uint8_t last, BridgeSink sink, void* context, uint8_t mode);
+
+/**
+ * @brief Sends an encoded frame unchanged on a port, e.g. one received from a host transport.
+ * @param comm_handler Pointer to the handler of the port.
+ * @param frame Pointer to the frame, STX or SOH at index 0.
+ * @param frame_length Total frame length.
+ * @retval None
+ */
+void asmart_comm_forward_frame(aSmart_Comm_Handler_t* comm_handler, uint8_t* frame, uint16_t frame_length);
+#endif
+
+/**
+ * @brief Feeds received bytes into the frame parser, e.g. from a receive interrupt or FIFO drain.
+ * @note Completed frames are processed by the next asmart_comm_handler() call; bytes arriving
+ *       while all RX_FRAME_SLOTS are pending are dropped and counted in rx_handler.overruns.
+ * @param comm_handler Pointer to the communication handler structure.
+ * @param data Pointer to the received bytes.
+ * @param length Number of bytes.
+ * @retval None
+ */
+void asmart_comm_receive_bytes(aSmart_Comm_Handler_t* comm_handler, const uint8_t* data, uint16_t length);
+
+#if ASMART_COMM_CAPTURE
+/**
+ * @brief Sets the hook that sees every received frame before dispatch and every frame sent.
+ * @note Received blocks without ASMART_COMM_STREAMING_RX are passed whole. Frames cut through
+ *       by a bridge route are not seen.
+ * @param comm_handler Pointer to the communication handler structure.
+ * @param hook Capture hook, NULL to stop capturing.
+ * @param context Context pointer passed to the hook.
+ * @retval None
+ */
+void asmart_comm_set_capture(aSmart_Comm_Handler_t* comm_handler, CaptureHook hook, void* context);
+
+/**
+ * @brief Dispatches a recorded frame as if it had just been received, e.g. to replay a capture.
+ * @note The frame runs through a parser of its own and goes to the same dispatch as a received
+ *       one; frames addressed to other nodes or with a bad CRC are ignored, bridge routes are
+ *       not applied. Call from the thread that runs asmart_comm_handler().
+ * @param comm_handler Pointer to the communication handler structure.
+ * @param frame Pointer to the frame, STX or SOH at index 0.
+ * @param frame_length Total frame length, at most RECEIVE_BUFFER_SIZE.
+ * @retval 1 if the frame was dispatched, 0 otherwise.
+ */
+uint8_t asmart_comm_replay_frame(aSmart_Comm_Handler_t* comm_handler, const uint8_t* frame, uint16_t frame_length);
+#endif
+
+#if ASMART_COMM_SECURE
+/**
+ * @brief Secures the link to a node, or ends it: unicast frames between both are sealed with AES-CCM.
+ * @note Both nodes set the same key, and need distinct addresses, which keep the nonces of the two
+ *       directions apart. Frames of the node that do not authenticate, or repeat a counter, are
+ *       dropped; a repeated command is only answered from the replay cache. Secured payloads are
+ *       at most ASMART_COMM_SECURE_MAX_PAYLOAD bytes.
+ * @param comm_handler Pointer to the communication handler structure.
+ * @param address Unicast address of the node.
+ * @param key SECURE_KEY_SIZE byte AES-128 key, NULL to send and accept plain frames again.
+ * @param tx_counter Counter of the first frame sent: 1 with a new key, or one past the last counter
+ *                   used with this key (asmart_comm_link_counter()), e.g. kept across a restart.
+ * @retval 1 if set, 0 if the address is not a peer's or every link is taken (SECURE_LINKS).
+ */
+uint8_t asmart_comm_set_link_key(aSmart_Comm_Handler_t* comm_handler, uint8_t address, const uint8_t* key, uint32_t tx_counter);
+
+/**
+ * @brief Returns the counter the next frame to a node will carry.
+ * @param comm_handler Pointer to the communication handler structure.
+ * @param address Unicast address of the node.
+ * @retval Counter, 0 if the link has no key or its counters are used up.
+ */
+uint32_t asmart_comm_link_counter(aSmart_Comm_Handler_t* comm_handler, uint8_t address);
+
+/**
+ * @brief Returns the highest counter received from a node, to keep across a restart.
+ * @param comm_handler Pointer to the communication handler structure.
+ * @param address Unicast address of the node.
+ * @retval Counter, 0 if the link has no key or nothing was received on it yet.
+ */
+uint32_t asmart_comm_link_rx_counter(aSmart_Comm_Handler_t* comm_handler, uint8_t address);
+
+/**
+ * @brief Restores the highest counter received from a node, after asmart_comm_set_link_key() with the same key.
+ * @note Frames with this counter or a lower one are dropped as replays, so frames recorded before
+ *       a restart cannot be played back after it. A value kept lower than the last one received
+ *       leaves the counters in between open to a replay.
+ * @param comm_handler Pointer to the communication handler structure.
+ * @param address Unicast address of the node.
+ * @param rx_counter Counter returned by asmart_comm_link_rx_counter() before the restart.
+ * @retval 1 if restored, 0 if the link has no key.
+ */
+uint8_t asmart_comm_set_link_rx_counter(aSmart_Comm_Handler_t* comm_handler, uint8_t address, uint32_t rx_counter);
+#endif
+
+#if ASMART_COMM_BULK
+/**
+ * @brief Registers the receiver of incoming bulk transfers, or removes it.
+ * @note The receiver and its page buffers belong to the application until removed. One transfer is
+ *       received at a time; an open from another node meanwhile is refused. Removing a receiver
+ *       while a transfer runs cancels it.
+ * @param comm_handler Pointer to the communication handler structure.
+ * @param rx Pointer to the receiver structure, NULL to refuse transfers.
+ * @param sink Takes the image page by page, in order.
+ * @param done Called with the bulk_status_t when a transfer ends, may be NULL.
+ * @param context Passed to sink and done.
+ * @retval None
+ */
+void asmart_comm_bulk_receive(aSmart_Comm_Handler_t* comm_handler, aSmart_BulkRx_t* rx, BulkSink sink, BulkDone done, void* context);
+
+/**
+ * @brief Starts sending an image to a node's bulk receiver.
+ * @note Blocks are read from source and sent by asmart_comm_handler(), BULK_BURST per call, as far
+ *       as the receiver's page buffers reach; missing blocks are sent again as the acknowledgements
+ *       report them. done is called once with the outcome, after the receiver checked the CRC-32.
+ * @param comm_handler Pointer to the communication handler structure.
+ * @param tx Pointer to the sender structure, owned by the application until done is called.
+ * @param destination Unicast address of the receiving node.
+ * @param size Image size in bytes.
+ * @param crc CRC-32 of the image (asmart_bulk_crc32()).
+ * @param source Reads the blocks of the image.
+ * @param done Called with the bulk_status_t when the transfer ends, may be NULL.
+ * @param context Passed to source and done.
+ * @retval 1 if started, 0 if a transfer is being sent or the image is empty or too large.
+ */
+uint8_t asmart_comm_bulk_send(aSmart_Comm_Handler_t* comm_handler, aSmart_BulkTx_t* tx, uint8_t destination, uint32_t size, uint32_t crc, BulkSource source, BulkDone done, void* context);
+
+/**
+ * @brief Cancels the transfer being sent; the receiver is told and done reports BULK_CANCELLED.
+ * @param comm_handler Pointer to the communication handler structure.
+ * @retval None
+ */
+void asmart_comm_bulk_cancel(aSmart_Comm_Handler_t* comm_handler);
+#endif
+
+/**
+ * @brief Sends a command message to a specific node, group or to all nodes.
+ * @note Group and broadcast commands are not tracked for a response.
+ * @param comm_handler Pointer to the communication handler structure.
+ * @param destination Destination address.
+ * @param command_type Type of the command to send.
+ * @param payload Pointer to the payload data.
+ * @param payload_length Length of the payload data, at most ASMART_COMM_MAX_PAYLOAD; nothing is sent for a longer one.
+ * @retval None
+ */
+void asmart_comm_send_command_to(aSmart_Comm_Handler_t* comm_handler, uint8_t destination, uint8_t command_type, uint8_t* payload, uint16_t payload_length);
+
+/**
+ * @brief Sends a notification message to a specific node, group or to all nodes.
+ * @note A topic (asmart_comm_publish_topic()) is dropped before assembly unless a subscriber is due.
+ * @param comm_handler Pointer to the communication handler structure.
+ * @param destination Destination address.
+ * @param notification_type Type of the notification.
+ * @param payload Pointer to the payload data.
+ * @param payload_length Length of the payload data, at most ASMART_COMM_MAX_PAYLOAD; nothing is sent for a longer one.
+ * @retval None
+ */
+void asmart_comm_send_notification_to(aSmart_Comm_Handler_t* comm_handler, uint8_t destination, uint8_t notification_type, uint8_t* payload, uint16_t payload_length);
+
+/**
+ * @brief Sends a command message.
+ * @param comm_handler Pointer to the communication handler structure.
+ * @param command_type Type of the command to send.
+ * @param payload Pointer to the payload data.
+ * @param payload_length Length of the payload data, at most ASMART_COMM_MAX_PAYLOAD; nothing is sent for a longer one.
  * @retval None
  */
 void asmart_comm_send_command(aSmart_Comm_Handler_t* comm_handler, uint8_t command_type, uint8_t* payload, uint16_t payload_length);
@@ -108,31 +965,38 @@ void asmart_comm_send_command(aSmart_Comm_Handler_t* comm_handler, uint8_t comma
  * @param comm_handler Pointer to the communication handler structure.
  * @param notification_type Type of the notification.
  * @param payload Pointer to the payload data.
- * @param payload_length Length of the payload data.
+ * @param payload_length Length of the payload data, at most ASMART_COMM_MAX_PAYLOAD; nothing is sent for a longer one.
  * @retval None
  */
 void asmart_comm_send_notification(aSmart_Comm_Handler_t* comm_handler, uint8_t notification_type, uint8_t* payload, uint16_t payload_length);
 
 /**
- * @brief Sends a response message.
+ * @brief Sends a response message to the node that sent the last command.
+ * @note Suppressed when that command was broadcast or group addressed. Sent on the command's
+ *       channel, ahead of any queued frames.
  * @param comm_handler Pointer to the communication handler structure.
  * @param sequence_number Sequence number of the original command.
  * @param command_type Type of the command being responded to.
  * @param payload Pointer to the payload data.
- * @param payload_length Length of the payload data.
+ * @param payload_length Length of the payload data, at most ASMART_COMM_MAX_PAYLOAD; nothing is sent for a longer one.
  * @retval None
  */
 void asmart_comm_send_response(aSmart_Comm_Handler_t* comm_handler, uint16_t sequence_number, uint8_t command_type, uint8_t* payload, uint16_t payload_length);
 
 /**
  * @brief Sends an error message.
+ * @note Addressed like asmart_comm_send_response().
  * @param comm_handler Pointer to the communication handler structure.
  * @param sequence_number Sequence number of the related message (zero if not applicable).
  * @param error_code Error code to send.
  * @param payload Pointer to the payload data.
- * @param payload_length Length of the payload data.
+ * @param payload_length Length of the payload data, at most ASMART_COMM_MAX_PAYLOAD; nothing is sent for a longer one.
  * @retval None
  */
 void asmart_comm_send_error(aSmart_Comm_Handler_t* comm_handler, uint16_t sequence_number, uint8_t error_code, uint8_t* payload, uint16_t payload_length);
 
+#ifdef __cplusplus
+}
+#endif
+
 #endif // _ASMART_COMM_HANDLER_H_
@@ -0,0 +1,329 @@
+#ifndef _ASMART_COMM_MESSAGE_HPP_
+#define _ASMART_COMM_MESSAGE_HPP_
+
+/*
+ * Typed messages for C++17 applications.
+ *
+ * A message is a plain struct that lists its fields once. The wire size is a compile-time
+ * constant and fields are packed big-endian in declaration order of the list, straight into
+ * the transmit buffer and straight out of the received payload:
+ *
+ *   struct BeginTransaction {
+ *       static constexpr uint8_t command_type = COMMAND_TYPE_BEGIN_TRANSACTION;
+ *       static constexpr uint16_t wire_size = 6;  // Optional, checked against the fields
+ *       uint32_t transaction_id;
+ *       uint16_t flags;
+ *       using fields = asmart::Fields<&BeginTransaction::transaction_id, &BeginTransaction::flags>;
+ *   };
+ *
+ *   asmart::send_command(&comm_handler, BeginTransaction{42, 0});
+ *
+ *   // In the response callback
+ *   BeginTransaction begin;
+ *   if (command_type == BeginTransaction::command_type && asmart::decode(payload, length, begin)) { ... }
+ *
+ * Field types: integers, bool, enums, float, double, std::array of those, and nested messages.
+ * Any other type, a message larger than ASMART_COMM_MAX_PAYLOAD, a wire_size that does not
+ * match the fields or a fixed buffer that is too small fails to compile.
+ */
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <type_traits>
+#include <utility>
+
+#include "asmart_comm_handler.h"
+
+namespace asmart {
+
+// Field list of a message, pointers to its data members in wire order
+template <auto... Members>
+struct Fields {};
+
+namespace detail {
+
+template <typename T>
+struct MemberType;
+
+template <typename C, typename M>
+struct MemberType<M C::*> {
+    using type = M;
+};
+
+template <auto Member>
+using member_t = typename MemberType<decltype(Member)>::type;
+
+template <std::size_t N>
+struct UintOfSize;
+template <>
+struct UintOfSize<1> { using type = uint8_t; };
+template <>
+struct UintOfSize<2> { using type = uint16_t; };
+template <>
+struct UintOfSize<4> { using type = uint32_t; };
+template <>
+struct UintOfSize<8> { using type = uint64_t; };
+
+// Unrolled big-endian store and load, one byte access per byte of U
+template <typename U, std::size_t... I>
+inline void store_be(U value, uint8_t* out, std::index_sequence<I...>) noexcept {
+    ((out[I] = static_cast<uint8_t>(value >> (8 * (sizeof(U) - 1 - I)))), ...);
+}
+
+template <typename U, std::size_t... I>
+inline U load_be(const uint8_t* in, std::index_sequence<I...>) noexcept {
+    return static_cast<U>((static_cast<U>(static_cast<U>(in[I]) << (8 * (sizeof(U) - 1 - I))) | ...));
+}
+
+template <typename T, typename = void>
+struct HasFields : std::false_type {};
+template <typename T>
+struct HasFields<T, std::void_t<typename T::fields>> : std::true_type {};
+
+template <typename T, typename = void>
+struct HasWireSize : std::false_type {};
+template <typename T>
+struct HasWireSize<T, std::void_t<decltype(T::wire_size)>> : std::true_type {};
+
+template <typename T>
+struct Dependent : std::false_type {};
+
+}  // namespace detail
+
+// Wire codec of one field type; unsupported types hit the static_assert
+template <typename T, typename = void>
+struct Codec {
+    static_assert(detail::Dependent<T>::value, "asmart: field type has no wire encoding");
+};
+
+// Integers and bool
+template <typename T>
+struct Codec<T, std::enable_if_t<std::is_integral_v<T>>> {
+    using U = typename detail::UintOfSize<sizeof(T)>::type;
+    static constexpr uint16_t size = sizeof(T);
+
+    static void encode(const T& value, uint8_t* out) noexcept {
+        detail::store_be(static_cast<U>(value), out, std::make_index_sequence<sizeof(T)>{});
+    }
+    static void decode(const uint8_t* in, T& value) noexcept {
+        U raw = detail::load_be<U>(in, std::make_index_sequence<sizeof(T)>{});
+        if constexpr (std::is_same_v<T, bool>) {
+            value = (raw != 0);
+        } else {
+            value = static_cast<T>(raw);
+        }
+    }
+};
+
+// Enums, sent as their underlying type
+template <typename T>
+struct Codec<T, std::enable_if_t<std::is_enum_v<T>>> {
+    using Underlying = std::underlying_type_t<T>;
+    static constexpr uint16_t size = Codec<Underlying>::size;
+
+    static void encode(const T& value, uint8_t* out) noexcept {
+        Codec<Underlying>::encode(static_cast<Underlying>(value), out);
+    }
+    static void decode(const uint8_t* in, T& value) noexcept {
+        Underlying raw;
+        Codec<Underlying>::decode(in, raw);
+        value = static_cast<T>(raw);
+    }
+};
+
+// IEEE 754 float and double, bit pattern sent big-endian
+template <typename T>
+struct Codec<T, std::enable_if_t<std::is_floating_point_v<T>>> {
+    using U = typename detail::UintOfSize<sizeof(T)>::type;
+    static constexpr uint16_t size = sizeof(T);
+
+    static void encode(const T& value, uint8_t* out) noexcept {
+        U raw;
+        std::memcpy(&raw, &value, sizeof(raw));
+        Codec<U>::encode(raw, out);
+    }
+    static void decode(const uint8_t* in, T& value) noexcept {
+        U raw;
+        Codec<U>::decode(in, raw);
+        std::memcpy(&value, &raw, sizeof(value));
+    }
+};
+
+// Fixed-length arrays
+template <typename T, std::size_t N>
+struct Codec<std::array<T, N>> {
+    static constexpr uint16_t size = static_cast<uint16_t>(Codec<T>::size * N);
+
+    static void encode(const std::array<T, N>& value, uint8_t* out) noexcept {
+        encode_each(value, out, std::make_index_sequence<N>{});
+    }
+    static void decode(const uint8_t* in, std::array<T, N>& value) noexcept {
+        decode_each(in, value, std::make_index_sequence<N>{});
+    }
+
+private:
+    template <std::size_t... I>
+    static void encode_each(const std::array<T, N>& value, uint8_t* out, std::index_sequence<I...>) noexcept {
+        (Codec<T>::encode(value[I], out + I * Codec<T>::size), ...);
+    }
+    template <std::size_t... I>
+    static void decode_each(const uint8_t* in, std::array<T, N>& value, std::index_sequence<I...>) noexcept {
+        (Codec<T>::decode(in + I * Codec<T>::size, value[I]), ...);
+    }
+};
+
+// Messages, also usable as fields of other messages
+template <typename T>
+struct Codec<T, std::enable_if_t<detail::HasFields<T>::value>> {
+private:
+    template <typename F>
+    struct Layout;
+
+    template <auto... Members>
+    struct Layout<Fields<Members...>> {
+        static constexpr uint16_t size = (0 + ... + Codec<detail::member_t<Members>>::size);
+
+        static void encode(const T& message, uint8_t* out) noexcept {
+            encode_at(message, out, std::make_index_sequence<sizeof...(Members)>{});
+        }
+        static void decode(const uint8_t* in, T& message) noexcept {
+            decode_at(in, message, std::make_index_sequence<sizeof...(Members)>{});
+        }
+
+    private:
+        static constexpr std::array<uint16_t, sizeof...(Members) + 1> offsets() {
+            constexpr uint16_t sizes[] = {Codec<detail::member_t<Members>>::size..., 0};
+            std::array<uint16_t, sizeof...(Members) + 1> result{};
+            for (std::size_t i = 0; i < sizeof...(Members); i++) {
+                result[i + 1] = static_cast<uint16_t>(result[i] + sizes[i]);
+            }
+            return result;
+        }
+
+        // Every field lands at a constant offset, no running index
+        template <std::size_t... I>
+        static void encode_at(const T& message, uint8_t* out, std::index_sequence<I...>) noexcept {
+            constexpr auto offset = offsets();
+            (Codec<detail::member_t<Members>>::encode(message.*Members, out + offset[I]), ...);
+        }
+        template <std::size_t... I>
+        static void decode_at(const uint8_t* in, T& message, std::index_sequence<I...>) noexcept {
+            constexpr auto offset = offsets();
+            (Codec<detail::member_t<Members>>::decode(in + offset[I], message.*Members), ...);
+        }
+    };
+
+    using FieldLayout = Layout<typename T::fields>;
+
+public:
+    static constexpr uint16_t size = FieldLayout::size;
+
+    static void encode(const T& message, uint8_t* out) noexcept { FieldLayout::encode(message, out); }
+    static void decode(const uint8_t* in, T& message) noexcept { FieldLayout::decode(in, message); }
+};
+
+// Encoded size of a message or field type
+template <typename T>
+constexpr uint16_t wire_size_v = Codec<T>::size;
+
+namespace detail {
+
+template <typename T>
+constexpr bool check_message() {
+    static_assert(HasFields<T>::value, "asmart: message type needs a fields list");
+    if constexpr (HasWireSize<T>::value) {
+        static_assert(T::wire_size == wire_size_v<T>, "asmart: declared wire_size does not match the fields");
+    }
+    return true;
+}
+
+template <typename T>
+constexpr bool check_sendable() {
+    static_assert(check_message<T>(), "");
+    static_assert(wire_size_v<T> <= ASMART_COMM_MAX_PAYLOAD, "asmart: message does not fit one frame");
+    return true;
+}
+
+}  // namespace detail
+
+/**
+ * @brief Encodes a message into a buffer of at least wire_size_v<T> bytes.
+ * @note A fixed-size uint8_t array that is too small does not compile.
+ * @retval Number of bytes written.
+ */
+template <typename T, typename Buffer>
+inline uint16_t encode(const T& message, Buffer&& out) noexcept {
+    static_assert(detail::check_message<T>(), "");
+    if constexpr (std::is_array_v<std::remove_reference_t<Buffer>>) {
+        static_assert(sizeof(out) >= wire_size_v<T>, "asmart: buffer too small for message");
+    }
+    Codec<T>::encode(message, &out[0]);
+    return wire_size_v<T>;
+}
+
+/**
+ * @brief Decodes a received payload.
+ * @retval true if the payload length matches the message, false leaves the message untouched.
+ */
+template <typename T>
+inline bool decode(const uint8_t* payload, uint16_t length, T& message) noexcept {
+    static_assert(detail::check_message<T>(), "");
+    if (length != wire_size_v<T>) {
+        return false;
+    }
+    Codec<T>::decode(payload, message);
+    return true;
+}
+
+// Sending, encoded in place in the transmit buffer (see asmart_comm_tx_payload())
+
+template <typename T>
+inline void send_command_to(aSmart_Comm_Handler_t* comm_handler, uint8_t destination, const T& message) {
+    static_assert(detail::check_sendable<T>(), "");
+    uint8_t* payload = asmart_comm_tx_payload(comm_handler);
+    Codec<T>::encode(message, payload);
+    asmart_comm_send_command_to(comm_handler, destination, T::command_type, payload, wire_size_v<T>);
+}
+
+template <typename T>
+inline void send_command(aSmart_Comm_Handler_t* comm_handler, const T& message) {
+    send_command_to(comm_handler, comm_handler->peer_address, message);
+}
+
+template <typename T>
+inline void send_notification_to(aSmart_Comm_Handler_t* comm_handler, uint8_t destination, const T& message) {
+    static_assert(detail::check_sendable<T>(), "");
+    uint8_t* payload = asmart_comm_tx_payload(comm_handler);
+    Codec<T>::encode(message, payload);
+    asmart_comm_send_notification_to(comm_handler, destination, T::command_type, payload, wire_size_v<T>);
+}
+
+template <typename T>
+inline void send_notification(aSmart_Comm_Handler_t* comm_handler, const T& message) {
+    send_notification_to(comm_handler, comm_handler->peer_address, message);
+}
+
+// Answers a command; the response type carries the command_type of the command it answers
+template <typename T>
+inline void send_response(aSmart_Comm_Handler_t* comm_handler, uint16_t sequence_number, const T& message) {
+    static_assert(detail::check_sendable<T>(), "");
+    uint8_t* payload = asmart_comm_tx_payload(comm_handler);
+    Codec<T>::encode(message, payload);
+    asmart_comm_send_response(comm_handler, sequence_number, T::command_type, payload, wire_size_v<T>);
+}
+
+// Sends a command as an awaitable request (see asmart_comm_request()), response sized for Response
+template <typename Response, typename T, std::size_t N>
+inline void request(aSmart_Comm_Handler_t* comm_handler, aSmart_Request_t* pending, const T& message, uint8_t (&response)[N]) {
+    static_assert(detail::check_sendable<T>(), "");
+    static_assert(N >= wire_size_v<Response>, "asmart: response buffer too small for the response message");
+    uint8_t* payload = asmart_comm_tx_payload(comm_handler);
+    Codec<T>::encode(message, payload);
+    asmart_comm_request(comm_handler, pending, T::command_type, payload, wire_size_v<T>, response, static_cast<uint16_t>(N));
+}
+
+}  // namespace asmart
+
+#endif // _ASMART_COMM_MESSAGE_HPP_
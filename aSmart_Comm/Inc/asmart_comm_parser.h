@@ -0,0 +1,125 @@
+#ifndef _ASMART_COMM_PARSER_H_
+#define _ASMART_COMM_PARSER_H_
+
+#include <stdint.h>
+
+// Frame layout: [STX][Length][Destination][Source][Sequence Number][Message Type][Command Type][Payload][CRC][ETX]
+#define FRAME_HEADER_SIZE 9  // STX up to and including Command Type
+#define FRAME_TRAILER_SIZE 3  // CRC (2 bytes) and ETX
+#define FRAME_MIN_LENGTH 8  // Smallest Length field value (empty payload)
+
+// Message Type byte, both layouts: [Credit (2 bits)][Channel (2 bits)][Flags (1 bit)][Message Type (3 bits)]
+#define FRAME_TYPE_MASK 0x07  // Message Type bits
+#define FRAME_CHANNEL_MASK 0x30  // Logical channel, zero for the default channel
+#define FRAME_CHANNEL_SHIFT 4
+#define FRAME_CREDIT_MASK 0xC0  // Receiver credit counter of the sender, zero unless negotiated
+#define FRAME_CREDIT_SHIFT 6
+#define FRAME_TYPE_BYTE(type, channel) ((type) | ((channel) << FRAME_CHANNEL_SHIFT))
+
+// Compact layout: [SOH][Length (varint)][Destination][Source][Type/Flags][Sequence Number, if flagged][Command Type][Payload][CRC]
+// Length counts Destination up to the end of the Payload, 7 bits per byte with bit 7 set on all but the last byte.
+#define COMPACT_LENGTH_MAX_BYTES 2  // Length values up to 16383
+#define COMPACT_HEADER_MIN_SIZE 4  // Destination, Source, Type/Flags, Command Type
+#define COMPACT_TRAILER_SIZE 2  // CRC only, no ETX
+#define COMPACT_FLAG_SEQUENCE 0x08  // Sequence Number present (omitted for notifications on the default channel)
+
+// Parser result for each byte fed
+typedef enum {
+    PARSE_PENDING = 0,  // Frame not complete yet
+    PARSE_FRAME,  // A valid frame is in the buffer, see frame_length
+    PARSE_SKIPPED,  // A frame rejected by the header callback has passed
+    PARSE_ERROR,  // Framing, length or CRC error, parser resynchronises on the next STX
+    PARSE_FORWARD_START,  // Header of a forwarded frame is in, buffer holds its first index bytes
+    PARSE_FORWARD,  // The byte belongs to a forwarded frame
+    PARSE_FORWARDED  // The byte ends a forwarded frame
+} parse_result_t;
+
+// Header callback verdict
+typedef enum {
+    HEADER_ACCEPT = 0,  // Store the rest of the frame and check its CRC
+    HEADER_SKIP,  // Count the remaining bytes without storing or checking them
+    HEADER_FORWARD  // Report the remaining bytes one by one without storing or checking them
+} header_action_t;
+
+// Decoded Frame Header, the same for both layouts
+typedef struct {
+    uint8_t destination;
+    uint8_t source;
+    uint16_t sequence_number;  // Zero when a compact header omits it
+    uint8_t message_type;
+    uint8_t command_type;
+    uint8_t channel;  // Logical channel
+    uint8_t credit;  // Frames the sender has taken from its receive slots, modulo 4
+    uint8_t flags;  // Message Type byte without the message type, channel and credit bits
+    uint8_t compact;  // Received with the compact layout
+    uint16_t payload_offset;  // Position of the payload in the frame buffer
+    uint16_t payload_length;
+} aSmart_FrameHeader_t;
+
+/**
+ * @brief Header callback function type, called once the header has been received.
+ * @param context Context pointer given to asmart_parser_init().
+ * @param header Decoded header (CRC not verified yet).
+ * @retval HEADER_ACCEPT, HEADER_SKIP or HEADER_FORWARD.
+ */
+typedef header_action_t (*HeaderCallback)(void* context, const aSmart_FrameHeader_t* header);
+
+// Parser states
+typedef enum {
+    PARSER_STATE_WAIT_STX = 0,
+    PARSER_STATE_LENGTH,
+    PARSER_STATE_HEADER,
+    PARSER_STATE_PAYLOAD,
+    PARSER_STATE_CRC_HI,
+    PARSER_STATE_CRC_LO,
+    PARSER_STATE_ETX,
+    PARSER_STATE_SKIP,
+    PARSER_STATE_FORWARD
+} parser_state_t;
+
+// Streaming Parser Structure
+typedef struct {
+    uint8_t* buffer;  // Frame storage, STX at index 0
+    uint16_t buffer_size;
+    uint16_t index;  // Bytes of the current frame stored so far
+    uint16_t length_end;  // Index one past the Length field
+    uint16_t header_end;  // Index one past the Command Type
+    uint16_t crc_end;  // Index one past the last CRC-covered byte
+    uint16_t skip_remaining;  // Bytes left of a skipped or forwarded frame
+    uint16_t crc;  // Running CRC over Length..Payload
+    uint16_t frame_length;  // Total length of the last valid frame
+    aSmart_FrameHeader_t header;  // Header of the current or last valid frame
+    uint8_t state;
+    uint8_t compact;  // Current frame started with SOH
+    HeaderCallback header_callback;
+    void* context;
+} aSmart_Parser_t;
+
+/**
+ * @brief Initializes a streaming frame parser.
+ * @param parser Pointer to the parser structure.
+ * @param buffer Frame storage.
+ * @param buffer_size Size of the frame storage, frames that do not fit are rejected.
+ * @param header_callback Optional header filter, NULL accepts every frame.
+ * @param context Context pointer passed to the header callback.
+ * @retval None
+ */
+void asmart_parser_init(aSmart_Parser_t* parser, uint8_t* buffer, uint16_t buffer_size, HeaderCallback header_callback, void* context);
+
+/**
+ * @brief Drops a partially received frame and waits for the next STX.
+ * @param parser Pointer to the parser structure.
+ * @retval None
+ */
+void asmart_parser_reset(aSmart_Parser_t* parser);
+
+/**
+ * @brief Feeds one received byte. Safe to call from the UART receive interrupt.
+ * @note The buffer may also be the source of the bytes as long as they are fed in order.
+ * @param parser Pointer to the parser structure.
+ * @param byte Received byte.
+ * @retval Parse result, PARSE_FRAME once the last byte of a valid frame has arrived.
+ */
+parse_result_t asmart_parser_feed(aSmart_Parser_t* parser, uint8_t byte);
+
+#endif // _ASMART_COMM_PARSER_H_
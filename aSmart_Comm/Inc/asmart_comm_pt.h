@@ -0,0 +1,60 @@
+#ifndef _ASMART_COMM_PT_H_
+#define _ASMART_COMM_PT_H_
+
+#include "asmart_comm_handler.h"
+
+/*
+ * Stackless protothreads over asmart_comm_request().
+ *
+ * A flow is a function taking an aSmart_Pt_t and returning PT_WAITING until it has finished.
+ * It is called again from the main loop after asmart_comm_handler(); each call resumes after
+ * the statement it was waiting on. Local variables are not preserved across waits, keep them
+ * in a struct next to the aSmart_Pt_t. Do not use switch statements inside a flow.
+ *
+ *   static aSmart_Pt_t flow_pt;
+ *   static aSmart_Request_t flow_request;
+ *
+ *   static uint8_t transaction_flow(aSmart_Pt_t* pt) {
+ *       PT_BEGIN(pt);
+ *       PT_REQUEST(pt, &comm_handler, &flow_request, COMMAND_TYPE_BEGIN_TRANSACTION, payload, 4, response, sizeof(response));
+ *       if (flow_request.status != REQUEST_DONE) {
+ *           PT_EXIT(pt);
+ *       }
+ *       PT_REQUEST(pt, &comm_handler, &flow_request, COMMAND_TYPE_END_TRANSACTION, NULL, 0, response, sizeof(response));
+ *       PT_END(pt);
+ *   }
+ */
+
+// Flow return values
+#define PT_WAITING 0
+#define PT_ENDED 1
+
+// Protothread State Structure
+typedef struct {
+    uint16_t line;  // Resume point, zero before the first call
+} aSmart_Pt_t;
+
+#define PT_INIT(pt) ((pt)->line = 0)
+
+#define PT_BEGIN(pt) switch ((pt)->line) { case 0:
+
+#define PT_END(pt) } (pt)->line = 0; return PT_ENDED
+
+// Returns PT_WAITING until the condition holds
+#define PT_WAIT_UNTIL(pt, condition) \
+    do { \
+        (pt)->line = __LINE__; case __LINE__: \
+        if (!(condition)) { return PT_WAITING; } \
+    } while (0)
+
+// Ends the flow early, the next call starts it again from PT_BEGIN
+#define PT_EXIT(pt) do { (pt)->line = 0; return PT_ENDED; } while (0)
+
+// Sends a command and waits until its request is no longer pending
+#define PT_REQUEST(pt, comm_handler, request, command_type, payload, payload_length, response, response_size) \
+    do { \
+        asmart_comm_request((comm_handler), (request), (command_type), (payload), (payload_length), (response), (response_size)); \
+        PT_WAIT_UNTIL(pt, (request)->status != REQUEST_PENDING); \
+    } while (0)
+
+#endif // _ASMART_COMM_PT_H_
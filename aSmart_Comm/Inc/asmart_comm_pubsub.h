@@ -0,0 +1,76 @@
+#ifndef _ASMART_COMM_PUBSUB_H_
+#define _ASMART_COMM_PUBSUB_H_
+
+#include <stdint.h>
+#include "asmart_comm_config.h"
+
+// Subscription table, sized in asmart_comm_config.h (SUBSCRIPTION_ENTRIES)
+#define PUBSUB_ANY_SUBSCRIBER 0x00  // Matches every subscriber, used for group and broadcast notifications
+
+// Subscription Structure
+typedef struct {
+    uint8_t subscriber;  // Address of the subscribing node, PUBSUB_ANY_SUBSCRIBER marks a free entry
+    uint8_t topic;  // Notification type
+    uint16_t min_interval_ms;  // Rate limit, zero for none
+    uint8_t decimation;  // Only every n-th publication is sent, zero or one for all
+    uint8_t skipped;  // Publications dropped by decimation since the last one sent
+    uint8_t sent;  // last_sent is valid
+    uint32_t last_sent;  // Time the topic was last sent to the subscriber (ms)
+} aSmart_Subscription_t;
+
+// Publisher Topic Table Structure
+typedef struct {
+    uint8_t filtered[32];  // Bit per notification type: only sent to subscribers
+    uint8_t subscribed[32];  // Bit per notification type: at least one subscription
+    aSmart_Subscription_t entries[SUBSCRIPTION_ENTRIES];
+} aSmart_PubSub_t;
+
+/**
+ * @brief Initializes the topic table; no notification type is filtered.
+ * @param pubsub Pointer to the topic table structure.
+ * @retval None
+ */
+void asmart_pubsub_init(aSmart_PubSub_t* pubsub);
+
+/**
+ * @brief Makes a notification type a topic that is only sent to its subscribers, or lifts the filter.
+ * @param pubsub Pointer to the topic table structure.
+ * @param topic Notification type.
+ * @param filtered 1 to filter, 0 to send unconditionally.
+ * @retval None
+ */
+void asmart_pubsub_set_filtered(aSmart_PubSub_t* pubsub, uint8_t topic, uint8_t filtered);
+
+/**
+ * @brief Adds or updates a subscription.
+ * @param pubsub Pointer to the topic table structure.
+ * @param subscriber Address of the subscribing node.
+ * @param topic Notification type.
+ * @param min_interval_ms Minimum time between two notifications to the subscriber, zero for none.
+ * @param decimation Send only every n-th publication, zero or one for all.
+ * @retval 1 if the subscription is held, 0 if the table is full.
+ */
+uint8_t asmart_pubsub_subscribe(aSmart_PubSub_t* pubsub, uint8_t subscriber, uint8_t topic, uint16_t min_interval_ms, uint8_t decimation);
+
+/**
+ * @brief Removes a subscription.
+ * @param pubsub Pointer to the topic table structure.
+ * @param subscriber Address of the subscribing node.
+ * @param topic Notification type.
+ * @retval None
+ */
+void asmart_pubsub_unsubscribe(aSmart_PubSub_t* pubsub, uint8_t subscriber, uint8_t topic);
+
+/**
+ * @brief Decides whether a notification goes on the wire, and accounts for it if so.
+ * @note Unfiltered types are always sent. For a filtered type without subscribers only the
+ *       bitset is consulted.
+ * @param pubsub Pointer to the topic table structure.
+ * @param destination Address of the subscriber, PUBSUB_ANY_SUBSCRIBER if any subscriber will do.
+ * @param topic Notification type.
+ * @param now Current time (ms).
+ * @retval 1 to send, 0 to drop.
+ */
+uint8_t asmart_pubsub_should_send(aSmart_PubSub_t* pubsub, uint8_t destination, uint8_t topic, uint32_t now);
+
+#endif // _ASMART_COMM_PUBSUB_H_
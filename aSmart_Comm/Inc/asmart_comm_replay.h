@@ -0,0 +1,78 @@
+#ifndef _ASMART_COMM_REPLAY_H_
+#define _ASMART_COMM_REPLAY_H_
+
+#include <stdint.h>
+#include "asmart_comm_config.h"
+
+// Replay cache sizing, entries and frame size in asmart_comm_config.h. A command is remembered as
+// long as its sender may retransmit it: every attempt waits at most RTO_MAX_MS (asmart_comm_rtt.h),
+// unless the sender set a longer timeout for its type with asmart_comm_set_command_timeout().
+#ifndef REPLAY_CACHE_MAX_AGE_MS
+#define REPLAY_CACHE_MAX_AGE_MS ((COMMAND_MAX_RETRIES + 1) * RTO_MAX_MS)
+#endif
+
+// Remembered Command Structure
+typedef struct {
+    uint8_t peer;  // Source address of the command
+    uint8_t channel;  // Logical channel of the command
+    uint8_t command_type;
+    uint8_t used;  // Zero marks a free entry
+    uint16_t sequence_number;
+    uint16_t frame_length;  // Zero while the response is pending, or if it was too large to keep
+    uint32_t timestamp;  // Time the command first arrived (ms)
+    uint8_t frame[REPLAY_CACHE_FRAME_SIZE];  // Encoded response, STX to ETX
+} ReplayEntry_t;
+
+// Replay Cache Structure
+typedef struct {
+    ReplayEntry_t entries[REPLAY_CACHE_ENTRIES];
+} aSmart_ReplayCache_t;
+
+/**
+ * @brief Initializes the replay cache.
+ * @param cache Pointer to the replay cache structure.
+ * @retval None
+ */
+void asmart_replay_init(aSmart_ReplayCache_t* cache);
+
+/**
+ * @brief Remembers a command about to be run, replacing an expired or the oldest entry.
+ * @param cache Pointer to the replay cache structure.
+ * @param peer Source address of the command.
+ * @param channel Logical channel of the command.
+ * @param sequence_number Sequence number of the command.
+ * @param command_type Type of the command.
+ * @param now Current time (ms).
+ * @retval Pointer to the entry, without a response yet.
+ */
+ReplayEntry_t* asmart_replay_record(aSmart_ReplayCache_t* cache, uint8_t peer, uint8_t channel, uint16_t sequence_number, uint8_t command_type, uint32_t now);
+
+/**
+ * @brief Keeps the encoded response to a command, remembering the command if it was not yet.
+ * @note A response larger than REPLAY_CACHE_FRAME_SIZE is not kept; the command stays remembered.
+ * @param cache Pointer to the replay cache structure.
+ * @param peer Source address of the command being answered.
+ * @param channel Logical channel of the command.
+ * @param sequence_number Sequence number of the command.
+ * @param command_type Type of the command.
+ * @param frame Pointer to the encoded frame.
+ * @param frame_length Length of the encoded frame.
+ * @param now Current time (ms).
+ * @retval None
+ */
+void asmart_replay_store(aSmart_ReplayCache_t* cache, uint8_t peer, uint8_t channel, uint16_t sequence_number, uint8_t command_type, const uint8_t* frame, uint16_t frame_length, uint32_t now);
+
+/**
+ * @brief Looks up a command, dropping entries older than REPLAY_CACHE_MAX_AGE_MS.
+ * @param cache Pointer to the replay cache structure.
+ * @param peer Source address of the command.
+ * @param channel Logical channel of the command.
+ * @param sequence_number Sequence number of the command.
+ * @param command_type Type of the command.
+ * @param now Current time (ms).
+ * @retval Pointer to the entry if the command was seen, NULL otherwise; its frame_length is zero
+ *         if there is no response to send again.
+ */
+ReplayEntry_t* asmart_replay_lookup(aSmart_ReplayCache_t* cache, uint8_t peer, uint8_t channel, uint16_t sequence_number, uint8_t command_type, uint32_t now);
+
+#endif // _ASMART_COMM_REPLAY_H_
@@ -0,0 +1,43 @@
+#ifndef _ASMART_COMM_RS485_H_
+#define _ASMART_COMM_RS485_H_
+
+#include <stdint.h>
+
+// Transceiver switching times from its datasheet, worst case (modify according to your transceiver)
+#define RS485_DRIVER_ENABLE_NS 1000  // DE high to a valid output (t_ZH, t_ZL)
+#define RS485_DRIVER_DISABLE_NS 1000  // DE low to a high-impedance output (t_HZ, t_LZ)
+#define RS485_PROPAGATION_NS 500  // Driver, cable and receiver delay from one end of the bus to the other
+
+// UART driver enable timing
+#define RS485_SAMPLES_PER_BIT 16  // DE times count in sample times: 1/16 bit (LPUART, USART oversampling by 16)
+#define RS485_DE_TIME_MAX 31  // DEAT and DEDT are 5-bit fields
+
+// Transceiver of a Link
+typedef struct {
+    uint32_t driver_enable_ns;
+    uint32_t driver_disable_ns;
+    uint32_t propagation_ns;
+} aSmart_Rs485Transceiver_t;
+
+// Turnaround Timing of a Link
+typedef struct {
+    uint32_t baudrate;  // Line speed the timing is for
+    uint8_t de_assert;  // DE raised this long before the start bit, in sample times (DEAT)
+    uint8_t de_deassert;  // DE held this long after the last stop bit, in sample times (DEDT)
+    uint16_t response_gap_us;  // Silence after the last byte received before the node drives the bus
+} aSmart_Rs485Timing_t;
+
+/**
+ * @brief Derives the turnaround of a link from its baud rate and transceiver.
+ * @note DE rises early enough for the driver to be on at the start bit, and falls late enough for
+ *       the last stop bit to cross the bus. The gap covers what the other node still drives after
+ *       the byte was received: the second half of its stop bit, its DE hold and its driver
+ *       disable time, plus the propagation delay. Every node of a bus uses the same values.
+ * @param timing Receives the timing.
+ * @param baudrate Line speed.
+ * @param transceiver Switching times, NULL for the RS485_* defaults.
+ * @retval 1 if DE timing fits the UART, 0 if it was clamped to RS485_DE_TIME_MAX.
+ */
+uint8_t asmart_rs485_timing(aSmart_Rs485Timing_t* timing, uint32_t baudrate, const aSmart_Rs485Transceiver_t* transceiver);
+
+#endif // _ASMART_COMM_RS485_H_
@@ -0,0 +1,51 @@
+#ifndef _ASMART_COMM_RTT_H_
+#define _ASMART_COMM_RTT_H_
+
+#include <stdint.h>
+
+// Retransmission timeout limits in milliseconds
+#define RTO_MIN_MS 20  // Lower bound, keeps jitter from causing spurious retransmissions
+#define RTO_MAX_MS 10000  // Upper bound, also caps exponential backoff
+#define RTO_GRANULARITY_MS 1  // Tick resolution of the clock
+
+// RTT Estimator Structure (Jacobson/Karels, fixed point as in BSD)
+typedef struct {
+    uint32_t srtt_x8;  // Smoothed RTT, scaled by 8
+    uint32_t rttvar_x4;  // RTT variance, scaled by 4
+    uint32_t rto;  // Current retransmission timeout (ms), before backoff
+    uint8_t has_sample;  // Zero until the first measurement
+    uint8_t backoff;  // Doublings applied since the last valid sample
+} aSmart_RttEstimator_t;
+
+/**
+ * @brief Initializes the estimator.
+ * @param rtt Pointer to the estimator structure.
+ * @param initial_rto Timeout used until the first measurement (ms).
+ * @retval None
+ */
+void asmart_rtt_init(aSmart_RttEstimator_t* rtt, uint32_t initial_rto);
+
+/**
+ * @brief Adds a round-trip measurement and clears the backoff.
+ * @note Only feed commands that were not retransmitted (Karn's algorithm).
+ * @param rtt Pointer to the estimator structure.
+ * @param sample_ms Measured round-trip time (ms).
+ * @retval None
+ */
+void asmart_rtt_sample(aSmart_RttEstimator_t* rtt, uint32_t sample_ms);
+
+/**
+ * @brief Doubles the timeout after a retransmission, up to RTO_MAX_MS.
+ * @param rtt Pointer to the estimator structure.
+ * @retval None
+ */
+void asmart_rtt_backoff(aSmart_RttEstimator_t* rtt);
+
+/**
+ * @brief Returns the timeout for a new command, including backoff.
+ * @param rtt Pointer to the estimator structure.
+ * @retval Retransmission timeout (ms).
+ */
+uint32_t asmart_rtt_timeout(aSmart_RttEstimator_t* rtt);
+
+#endif // _ASMART_COMM_RTT_H_
@@ -0,0 +1,114 @@
+#ifndef _ASMART_COMM_SCHEMA_H_
+#define _ASMART_COMM_SCHEMA_H_
+
+/* Generated by Tools/asmart_idl.py from aSmart_Comm/Schema/asmart_comm.idl, do not edit */
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdint.h>
+
+struct aSmart_Comm_Handler_s;
+struct aSmart_Request_s;
+
+// Command Types
+typedef enum {
+    COMMAND_TYPE_BEGIN_TRANSACTION = 0x10,
+    COMMAND_TYPE_END_TRANSACTION = 0x11,
+} command_type_t;
+
+// transaction_status values, sent as uint8
+typedef enum {
+    TRANSACTION_STATUS_OK = 0,
+    TRANSACTION_STATUS_BUSY = 1,
+    TRANSACTION_STATUS_REJECTED = 2,
+} transaction_status_t;
+
+// Payload sizes in bytes
+#define BEGIN_TRANSACTION_COMMAND_MIN_SIZE 4
+#define BEGIN_TRANSACTION_COMMAND_MAX_SIZE 4
+#define BEGIN_TRANSACTION_RESPONSE_MIN_SIZE 4
+#define BEGIN_TRANSACTION_RESPONSE_MAX_SIZE 4
+#define END_TRANSACTION_COMMAND_MIN_SIZE 4
+#define END_TRANSACTION_COMMAND_MAX_SIZE 4
+#define END_TRANSACTION_RESPONSE_MIN_SIZE 1
+#define END_TRANSACTION_RESPONSE_MAX_SIZE 1
+#define ASMART_COMM_SCHEMA_MAX_PAYLOAD 4  // Largest payload of any message
+
+// Begin transaction command payload
+typedef struct {
+    uint32_t transaction_id;
+} BeginTransactionCommand_t;
+
+// Begin transaction response payload
+typedef struct {
+    uint32_t transaction_id;
+} BeginTransactionResponse_t;
+
+// End transaction command payload
+typedef struct {
+    uint32_t transaction_id;
+} EndTransactionCommand_t;
+
+// End transaction response payload
+typedef struct {
+    uint8_t status;  // transaction_status_t
+} EndTransactionResponse_t;
+
+// Schema Table Entry
+typedef struct {
+    uint8_t message_type;
+    uint8_t command_type;  // Command or notification type
+    uint16_t min_size;
+    uint16_t max_size;
+    uint8_t (*handle)(uint16_t sequence_number, const uint8_t* payload, uint16_t length);  // Decodes and calls the asmart_on_ handler, 0 if the payload is malformed
+} aSmart_SchemaEntry_t;
+
+#define ASMART_COMM_SCHEMA_ENTRIES 4
+extern const aSmart_SchemaEntry_t asmart_comm_schema_table[ASMART_COMM_SCHEMA_ENTRIES];
+
+/**
+ * @brief Decodes a received message and calls its asmart_on_ handler.
+ * @note The handler does not call it: call it from the response callback passed to
+ *       asmart_comm_init() and handle the messages it returns 0 for in the callback.
+ * @param message_type Type of the message received.
+ * @param command_type Type of the command or notification.
+ * @param sequence_number Sequence number of the message.
+ * @param payload Pointer to the payload data.
+ * @param length Length of the payload data.
+ * @retval 1 if handled, 0 if the type is not in the schema or the payload size is wrong.
+ */
+uint8_t asmart_comm_schema_dispatch(uint8_t message_type, uint8_t command_type, uint16_t sequence_number, const uint8_t* payload, uint16_t length);
+
+// Begin transaction command
+uint16_t asmart_encode_begin_transaction_command(const BeginTransactionCommand_t* message, uint8_t* buffer);
+uint8_t asmart_decode_begin_transaction_command(const uint8_t* payload, uint16_t length, BeginTransactionCommand_t* message);
+void asmart_send_begin_transaction_command(struct aSmart_Comm_Handler_s* comm_handler, const BeginTransactionCommand_t* message);
+void asmart_request_begin_transaction(struct aSmart_Comm_Handler_s* comm_handler, struct aSmart_Request_s* request, const BeginTransactionCommand_t* message, uint8_t* response);  // response: BEGIN_TRANSACTION_RESPONSE_MAX_SIZE bytes
+void asmart_on_begin_transaction_command(uint16_t sequence_number, const BeginTransactionCommand_t* message);
+
+// Begin transaction response
+uint16_t asmart_encode_begin_transaction_response(const BeginTransactionResponse_t* message, uint8_t* buffer);
+uint8_t asmart_decode_begin_transaction_response(const uint8_t* payload, uint16_t length, BeginTransactionResponse_t* message);
+void asmart_send_begin_transaction_response(struct aSmart_Comm_Handler_s* comm_handler, uint16_t sequence_number, const BeginTransactionResponse_t* message);
+void asmart_on_begin_transaction_response(uint16_t sequence_number, const BeginTransactionResponse_t* message);
+
+// End transaction command
+uint16_t asmart_encode_end_transaction_command(const EndTransactionCommand_t* message, uint8_t* buffer);
+uint8_t asmart_decode_end_transaction_command(const uint8_t* payload, uint16_t length, EndTransactionCommand_t* message);
+void asmart_send_end_transaction_command(struct aSmart_Comm_Handler_s* comm_handler, const EndTransactionCommand_t* message);
+void asmart_request_end_transaction(struct aSmart_Comm_Handler_s* comm_handler, struct aSmart_Request_s* request, const EndTransactionCommand_t* message, uint8_t* response);  // response: END_TRANSACTION_RESPONSE_MAX_SIZE bytes
+void asmart_on_end_transaction_command(uint16_t sequence_number, const EndTransactionCommand_t* message);
+
+// End transaction response
+uint16_t asmart_encode_end_transaction_response(const EndTransactionResponse_t* message, uint8_t* buffer);
+uint8_t asmart_decode_end_transaction_response(const uint8_t* payload, uint16_t length, EndTransactionResponse_t* message);
+void asmart_send_end_transaction_response(struct aSmart_Comm_Handler_s* comm_handler, uint16_t sequence_number, const EndTransactionResponse_t* message);
+void asmart_on_end_transaction_response(uint16_t sequence_number, const EndTransactionResponse_t* message);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // _ASMART_COMM_SCHEMA_H_
@@ -0,0 +1,147 @@
+#ifndef _ASMART_COMM_SECURE_H_
+#define _ASMART_COMM_SECURE_H_
+
+#include <stdint.h>
+#include "asmart_comm_config.h"
+#if !ASMART_COMM_HOST
+#include "main.h"  // Device and HAL configuration, SECURE_HARDWARE depends on them
+#endif
+
+// Secured frame payload: [Ciphertext][Counter (4 bytes)][Tag (8 bytes)], AES-128 in CCM mode
+// (RFC 3610 with a 13-byte nonce and an 8-byte tag). The header is authenticated, not encrypted.
+#define SECURE_KEY_SIZE 16  // AES-128
+#define SECURE_COUNTER_SIZE 4  // Frame counter of the sender, big endian
+#define SECURE_TAG_SIZE 8  // Authentication tag
+#define SECURE_OVERHEAD (SECURE_COUNTER_SIZE + SECURE_TAG_SIZE)  // Bytes a secured frame adds to the payload
+#define SECURE_NONCE_SIZE 13  // [Source][Destination][Counter][Zero padding]
+#define SECURE_MAX_AAD 8  // Longest header authenticated, Length up to Command Type
+#define SECURE_REPLAY_WINDOW 32  // Counters below the highest accepted once each, out of order
+#define SECURE_ROUND_KEYS 176  // Expanded AES-128 key, 11 round keys
+
+// AES peripheral: the CRYP HAL in CCM mode with DMA, on parts that have it (e.g. STM32G081,
+// STM32G0C1) once CubeMX enabled the module; the software cipher otherwise
+#if !ASMART_COMM_HOST && defined(AES) && defined(HAL_CRYP_MODULE_ENABLED)
+#define SECURE_HARDWARE 1
+#define SECURE_CRYP hcryp  // CRYP handle with its DMA channels (modify according to your AES instance)
+#define SECURE_HARDWARE_TIMEOUT_MS 10
+#else
+#define SECURE_HARDWARE 0
+#endif
+
+// Result of opening a received frame
+typedef enum {
+    SECURE_OPEN_OK = 0,  // Authentic, payload decrypted in place
+    SECURE_OPEN_REPLAYED,  // Authentic, but its counter was accepted before
+    SECURE_OPEN_FAILED  // Too short or the tag does not match, payload undefined
+} secure_open_t;
+
+/**
+ * @brief Block cipher function type: encrypts one 16-byte block with an expanded key.
+ * @param round_keys Expanded key, SECURE_ROUND_KEYS bytes.
+ * @param in Plaintext block.
+ * @param out Ciphertext block, may be in.
+ */
+typedef void (*SecureBlockCipher)(const uint8_t* round_keys, const uint8_t* in, uint8_t* out);
+
+// Link Key and Counters of a Node
+typedef struct {
+    uint8_t address;  // Node at the other end, 0 (ADDRESS_UNASSIGNED) marks a free entry
+    uint32_t tx_counter;  // Counter of the next frame sent, 0 once used up
+    uint32_t rx_highest;  // Highest counter accepted, 0 before the first frame
+    uint32_t rx_window;  // Bit n set: counter rx_highest - 1 - n was accepted
+#if SECURE_HARDWARE
+    uint32_t key[SECURE_KEY_SIZE / 4];  // Big-endian words, as the peripheral takes them
+#else
+    uint8_t round_keys[SECURE_ROUND_KEYS];
+#endif
+#if ASMART_COMM_HOST
+    SecureBlockCipher cipher;  // AES-NI when the CPU has it
+#endif
+} SecureLink_t;
+
+// Secured Links Structure
+typedef struct {
+    SecureLink_t links[SECURE_LINKS];
+    uint16_t auth_failures;  // Frames dropped because they did not authenticate
+    uint16_t replays;  // Authentic frames dropped because their counter was seen before
+} aSmart_Secure_t;
+
+/**
+ * @brief Initializes the secured links, none has a key.
+ * @param secure Pointer to the secured links structure.
+ * @retval None
+ */
+void asmart_secure_init(aSmart_Secure_t* secure);
+
+/**
+ * @brief Sets the key of a node and restarts its counters, or removes it.
+ * @param secure Pointer to the secured links structure.
+ * @param address Node at the other end of the link.
+ * @param key SECURE_KEY_SIZE bytes, NULL to remove the node's key.
+ * @param tx_counter Counter of the first frame sent, at least 1.
+ * @retval 1 if set or removed, 0 if every entry is taken.
+ */
+uint8_t asmart_secure_set_key(aSmart_Secure_t* secure, uint8_t address, const uint8_t* key, uint32_t tx_counter);
+
+/**
+ * @brief Restores the highest counter received on a link, e.g. after a restart with the same key.
+ * @note Every counter up to and including it is taken as received, so frames recorded before the
+ *       restart cannot be replayed.
+ * @param link Pointer to the link.
+ * @param rx_highest Highest counter accepted before, 0 to accept any counter again.
+ * @retval None
+ */
+void asmart_secure_restore_rx(SecureLink_t* link, uint32_t rx_highest);
+
+/**
+ * @brief Encrypts or decrypts data in place with AES-CCM and computes its tag, under an explicit nonce.
+ * @note The primitive under asmart_secure_seal() and asmart_secure_open(), which build the nonce
+ *       from the addresses and the counter; also runs the RFC 3610 test vectors.
+ * @param link Pointer to the link, whose key is used.
+ * @param nonce SECURE_NONCE_SIZE bytes.
+ * @param aad Data to authenticate, at most SECURE_MAX_AAD bytes.
+ * @param aad_length Its length.
+ * @param data Data, encrypted or decrypted in place.
+ * @param length Data length.
+ * @param tag Receives the SECURE_TAG_SIZE byte tag computed over the plaintext.
+ * @param encrypt 1 to encrypt, 0 to decrypt.
+ * @retval 1 on success, 0 if the AAD is too long or the peripheral failed.
+ */
+uint8_t asmart_secure_ccm(SecureLink_t* link, const uint8_t* nonce, const uint8_t* aad, uint16_t aad_length, uint8_t* data, uint16_t length, uint8_t* tag, uint8_t encrypt);
+
+/**
+ * @brief Looks up the link of a node.
+ * @param secure Pointer to the secured links structure.
+ * @param address Node address.
+ * @retval Pointer to the link, NULL if the node has no key.
+ */
+SecureLink_t* asmart_secure_find(aSmart_Secure_t* secure, uint8_t address);
+
+/**
+ * @brief Encrypts a payload in place and appends the counter and tag.
+ * @param link Pointer to the link.
+ * @param source Address of the sender.
+ * @param destination Address of the receiver.
+ * @param aad Header to authenticate, at most SECURE_MAX_AAD bytes.
+ * @param aad_length Header length.
+ * @param payload Payload, followed by SECURE_OVERHEAD free bytes.
+ * @param length Payload length.
+ * @retval 1 if sealed, 0 if the counters are used up or the peripheral failed.
+ */
+uint8_t asmart_secure_seal(SecureLink_t* link, uint8_t source, uint8_t destination, const uint8_t* aad, uint16_t aad_length, uint8_t* payload, uint16_t length);
+
+/**
+ * @brief Authenticates a received payload, decrypts it in place and checks its counter.
+ * @note The counter is only recorded for an authentic frame.
+ * @param link Pointer to the link.
+ * @param source Address of the sender.
+ * @param destination Address of the receiver.
+ * @param aad Received header, at most SECURE_MAX_AAD bytes.
+ * @param aad_length Header length.
+ * @param payload Ciphertext, counter and tag.
+ * @param length Their length; the plaintext is SECURE_OVERHEAD bytes shorter.
+ * @retval SECURE_OPEN_OK, SECURE_OPEN_REPLAYED or SECURE_OPEN_FAILED.
+ */
+secure_open_t asmart_secure_open(SecureLink_t* link, uint8_t source, uint8_t destination, const uint8_t* aad, uint16_t aad_length, uint8_t* payload, uint16_t length);
+
+#endif // _ASMART_COMM_SECURE_H_
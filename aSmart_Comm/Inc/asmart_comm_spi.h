@@ -0,0 +1,122 @@
+#ifndef _ASMART_COMM_SPI_H_
+#define _ASMART_COMM_SPI_H_
+
+#include <stdint.h>
+#include "asmart_comm_handler.h"
+
+// SPI transport: full-duplex transfers of SPI_SLOT_SIZE bytes, clocked by the master. Every slot
+// carries a header and the next bytes of the sender's frames, so one slot holds several short
+// frames or a piece of a long one. The slave raises the data-ready line while it has bytes to send.
+#define SPI_ROLE_MASTER 0  // Clocks the transfers, reads the data-ready line
+#define SPI_ROLE_SLAVE 1  // Keeps a transfer armed, drives the data-ready line
+
+// Slot Layout: [Magic][Sequence][Length (2 bytes)][Frame bytes][Padding]
+#define SPI_SLOT_MAGIC 0x5A  // Tells a slot from an idle or unarmed line (0x00, 0xFF)
+#define SPI_SLOT_HEADER 4
+#define SPI_SLOT_DATA (SPI_SLOT_SIZE - SPI_SLOT_HEADER)  // Frame bytes per slot
+#define SPI_PADDING 0x00
+
+// Transfer settings
+#define SPI_TX_QUEUE_SIZE (2 * TRANSMIT_BUFFER_SIZE)  // Frame bytes waiting for a slot
+#define SPI_REARM_US 5  // Master: pause after a transfer while the slave re-arms its DMA
+#define SPI_PORTS 2  // SPI1 and SPI2, for the HAL callbacks
+
+#if SPI_SLOT_SIZE <= SPI_SLOT_HEADER || SPI_SLOT_SIZE > 0xFFFF
+#error "SPI_SLOT_SIZE must leave room for frame bytes after the slot header"
+#endif
+
+// SPI Driver Functions, called from the main loop and from interrupts
+typedef struct {
+    uint8_t (*transfer)(void* driver, const uint8_t* tx, uint8_t* rx);  // Starts a full-duplex transfer of SPI_SLOT_SIZE bytes, clocked (master) or armed (slave); 0 if not possible now
+    void (*set_ready)(void* driver, uint8_t level);  // Slave: drives the data-ready line, 1 while it has bytes to send
+    uint8_t (*get_ready)(void* driver);  // Master: reads the data-ready line
+} aSmart_SpiDriver_t;
+
+// SPI Link Structure, binds a handler to an SPI
+typedef struct {
+    aSmart_Comm_Handler_t* handler;
+    const aSmart_SpiDriver_t* driver_functions;
+    void* driver;
+    uint8_t role;  // SPI_ROLE_MASTER or SPI_ROLE_SLAVE
+    volatile uint8_t busy;  // A transfer is running (master) or armed (slave)
+    uint8_t tx_sequence;  // Sequence of the next slot sent
+    uint8_t rx_sequence;  // Sequence expected of the next slot received
+    uint8_t rx_synced;  // A slot has been received, rx_sequence is valid
+    uint8_t tx_slot[SPI_SLOT_SIZE];  // Slot of the running transfer
+    uint8_t rx_slot[SPI_SLOT_SIZE];
+    uint8_t queue[SPI_TX_QUEUE_SIZE];  // Ring of frame bytes, sent in order
+    uint16_t queue_head;
+    uint16_t queue_count;
+    uint32_t transfers;
+    uint32_t tx_bytes;  // Frame bytes sent and received
+    uint32_t rx_bytes;
+    uint32_t tx_drops;  // Frames dropped: the queue had no room
+    uint32_t rx_errors;  // Slots lost: transfer error, no magic, bad length or out of sequence
+} aSmart_SpiLink_t;
+
+/**
+ * @brief Initializes a link and its handler; the handler sends every frame through the link.
+ * @note A slave arms its first transfer on the first asmart_spi_service().
+ * @param link Pointer to the link structure.
+ * @param handler Pointer to the communication handler structure.
+ * @param role SPI_ROLE_MASTER or SPI_ROLE_SLAVE.
+ * @param driver_functions Driver functions, e.g. &asmart_spi_hal_driver.
+ * @param driver Driver pointer passed to them.
+ * @param response_callback Function pointer to the response callback.
+ * @retval None
+ */
+void asmart_spi_init(aSmart_SpiLink_t* link, aSmart_Comm_Handler_t* handler, uint8_t role, const aSmart_SpiDriver_t* driver_functions, void* driver, ResponseCallback response_callback);
+
+/**
+ * @brief Takes the end of a transfer, from the DMA complete or SPI error interrupt.
+ * @note The received frame bytes go to asmart_comm_receive_bytes() of the handler. A slave
+ *       arms the next transfer at once; a master starts it from asmart_spi_service().
+ * @param link Pointer to the link structure.
+ * @param ok 1 if the transfer completed, 0 on an error; the slot received is dropped then.
+ * @retval None
+ */
+void asmart_spi_complete(aSmart_SpiLink_t* link, uint8_t ok);
+
+/**
+ * @brief Starts a transfer when one is due: on the master when it has bytes to send or the
+ *        slave raised the data-ready line, on a slave when arming failed before.
+ * @note Call it from the main loop, and on the master from the data-ready line's interrupt; the
+ *       returned time adds to the one asmart_comm_handler() returns.
+ * @param link Pointer to the link structure.
+ * @retval 0 if a transfer is due but could not start yet, ASMART_COMM_NO_DEADLINE otherwise.
+ */
+uint32_t asmart_spi_service(aSmart_SpiLink_t* link);
+
+/**
+ * @brief Returns the room left in the link's queue.
+ * @note A frame the queue has no room for is dropped and counted in tx_drops.
+ * @param link Pointer to the link structure.
+ * @retval Length of the longest frame that fits.
+ */
+uint16_t asmart_spi_tx_room(const aSmart_SpiLink_t* link);
+
+#if !ASMART_COMM_HOST && defined(HAL_SPI_MODULE_ENABLED)
+// SPI Port, the driver of asmart_spi_hal_driver
+typedef struct {
+    SPI_HandleTypeDef* hspi;  // Full-duplex, 8-bit, with Tx and Rx DMA channels
+    GPIO_TypeDef* ready_port;  // Data-ready line: push-pull output on the slave, input on the master
+    uint16_t ready_pin;
+    GPIO_TypeDef* nss_port;  // Master: chip select driven here, NULL with hardware NSS output
+    uint16_t nss_pin;
+    volatile uint32_t last_end_us;  // End of the last transfer, for SPI_REARM_US
+} aSmart_SpiPort_t;
+
+/* Driver functions of an SPI with DMA, the driver pointer is an aSmart_SpiPort_t */
+extern const aSmart_SpiDriver_t asmart_spi_hal_driver;
+
+/**
+ * @brief Hands the SPI's DMA complete and error interrupts to the link and sets the lines idle.
+ * @note Call it after asmart_spi_init() with asmart_spi_hal_driver; a slave arms its first
+ *       transfer here.
+ * @param link Pointer to the link structure, initialized with an aSmart_SpiPort_t as driver.
+ * @retval None
+ */
+void asmart_spi_hal_start(aSmart_SpiLink_t* link);
+#endif
+
+#endif // _ASMART_COMM_SPI_H_
@@ -0,0 +1,128 @@
+#ifndef _ASMART_COMM_TELEMETRY_H_
+#define _ASMART_COMM_TELEMETRY_H_
+
+#include <stdint.h>
+
+// Telemetry sizing
+#define TELEMETRY_MAX_SNAPSHOT 64  // Bytes of one encoded snapshot
+#define TELEMETRY_MAX_FIELDS 32  // Fields per snapshot, one bitmap bit each
+#define TELEMETRY_HISTORY 4  // Samples kept on each side; a baseline more than this many samples back is not used
+#define TELEMETRY_ACK_INTERVAL 2  // The receiver acknowledges every n-th rebuilt sample
+
+// Payload layout: [Kind][Sample][Baseline, delta only][Changed-field bitmap, delta only][Values]
+#define TELEMETRY_KEYFRAME 0x00  // Values: the whole snapshot
+#define TELEMETRY_DELTA 0x01  // Values: the changed fields, in field order
+#define TELEMETRY_MAX_PAYLOAD (3 + (TELEMETRY_MAX_FIELDS + 7) / 8 + TELEMETRY_MAX_SNAPSHOT)
+
+// Receiver verdict on a telemetry payload
+typedef enum {
+    TELEMETRY_INVALID = 0,  // Malformed or for another layout, dropped
+    TELEMETRY_REBUILT,  // snapshot holds the full sample
+    TELEMETRY_NEED_KEYFRAME  // Baseline unknown, dropped; a keyframe should be requested now
+} telemetry_result_t;
+
+// Snapshot Field Layout
+typedef struct {
+    const uint8_t* field_sizes;  // Bytes of each field of the encoded snapshot
+    uint8_t field_count;
+    uint16_t snapshot_size;  // Sum of field_sizes
+} TelemetryLayout_t;
+
+// Snapshot Kept for Delta Encoding
+typedef struct {
+    uint8_t sample;  // Sample number
+    uint8_t valid;
+    uint8_t data[TELEMETRY_MAX_SNAPSHOT];
+} TelemetrySnapshot_t;
+
+// Telemetry Sender Structure
+typedef struct aSmart_TelemetryTx_s {
+    uint8_t notification_type;  // Identifies the stream
+    uint8_t destination;
+    TelemetryLayout_t layout;
+    uint8_t keyframe_interval;  // Keyframe every n samples, zero for keyframes on demand only
+    uint8_t sample;  // Number of the next sample
+    uint8_t since_keyframe;  // Samples sent since the last keyframe
+    uint8_t force_keyframe;  // Next sample is a keyframe
+    TelemetrySnapshot_t baseline;  // Last sample acknowledged by the receiver
+    TelemetrySnapshot_t history[TELEMETRY_HISTORY];  // Recently sent samples, awaiting acknowledgement
+    struct aSmart_TelemetryTx_s* next;
+} aSmart_TelemetryTx_t;
+
+// Telemetry Receiver Structure
+typedef struct aSmart_TelemetryRx_s {
+    uint8_t notification_type;
+    TelemetryLayout_t layout;
+    uint8_t since_ack;  // Samples rebuilt since the last acknowledgement
+    uint8_t keyframe_holdoff;  // Undecodable samples to drop before the next keyframe request
+    uint8_t last_sample;  // Newest rebuilt sample
+    uint8_t* snapshot;  // Full snapshot of the newest sample, points into history
+    TelemetrySnapshot_t history[TELEMETRY_HISTORY];  // Recently rebuilt samples, possible baselines
+    struct aSmart_TelemetryRx_s* next;
+} aSmart_TelemetryRx_t;
+
+/**
+ * @brief Initializes a telemetry sender.
+ * @param tx Pointer to the telemetry sender structure.
+ * @param notification_type Notification type of the stream.
+ * @param destination Address of the receiving node.
+ * @param field_sizes Size of each field of the encoded snapshot, must stay valid.
+ * @param field_count Number of fields (up to TELEMETRY_MAX_FIELDS).
+ * @param keyframe_interval Keyframe every n samples, zero for keyframes on demand only.
+ * @retval None
+ */
+void asmart_telemetry_tx_init(aSmart_TelemetryTx_t* tx, uint8_t notification_type, uint8_t destination, const uint8_t* field_sizes, uint8_t field_count, uint8_t keyframe_interval);
+
+/**
+ * @brief Initializes a telemetry receiver.
+ * @param rx Pointer to the telemetry receiver structure.
+ * @param notification_type Notification type of the stream.
+ * @param field_sizes Size of each field of the encoded snapshot, must match the sender.
+ * @param field_count Number of fields.
+ * @retval None
+ */
+void asmart_telemetry_rx_init(aSmart_TelemetryRx_t* rx, uint8_t notification_type, const uint8_t* field_sizes, uint8_t field_count);
+
+/**
+ * @brief Encodes the next sample as a keyframe or as a delta to the acknowledged baseline.
+ * @param tx Pointer to the telemetry sender structure.
+ * @param snapshot Encoded snapshot, layout.snapshot_size bytes.
+ * @param payload Output buffer of at least TELEMETRY_MAX_PAYLOAD bytes.
+ * @retval Payload length, zero if the layout is invalid.
+ */
+uint16_t asmart_telemetry_encode(aSmart_TelemetryTx_t* tx, const uint8_t* snapshot, uint8_t* payload);
+
+/**
+ * @brief Records the receiver's acknowledgement of a sample, which becomes the new baseline.
+ * @param tx Pointer to the telemetry sender structure.
+ * @param sample Acknowledged sample number.
+ * @retval None
+ */
+void asmart_telemetry_ack(aSmart_TelemetryTx_t* tx, uint8_t sample);
+
+/**
+ * @brief Makes the next sample a keyframe, e.g. when the receiver has lost its baseline.
+ * @param tx Pointer to the telemetry sender structure.
+ * @retval None
+ */
+void asmart_telemetry_request_keyframe(aSmart_TelemetryTx_t* tx);
+
+/**
+ * @brief Rebuilds the full snapshot from a received keyframe or delta.
+ * @param rx Pointer to the telemetry receiver structure.
+ * @param payload Pointer to the payload data.
+ * @param length Length of the payload data.
+ * @note Keyframe requests are rate limited: after one has been asked for, the next
+ *       TELEMETRY_HISTORY undecodable samples return TELEMETRY_INVALID.
+ * @retval TELEMETRY_REBUILT with rx->snapshot set, TELEMETRY_NEED_KEYFRAME or TELEMETRY_INVALID.
+ */
+telemetry_result_t asmart_telemetry_decode(aSmart_TelemetryRx_t* rx, const uint8_t* payload, uint16_t length);
+
+/**
+ * @brief Tells whether the newest rebuilt sample should be acknowledged now.
+ * @param rx Pointer to the telemetry receiver structure.
+ * @retval 1 to acknowledge rx->last_sample, 0 otherwise.
+ */
+uint8_t asmart_telemetry_ack_due(aSmart_TelemetryRx_t* rx);
+
+#endif // _ASMART_COMM_TELEMETRY_H_
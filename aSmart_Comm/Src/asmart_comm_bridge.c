@@ -0,0 +1,58 @@
+#include "asmart_comm_bridge.h"
+#include "asmart_comm_handler.h"
+#include <string.h>
+
+/***********************************************************************************************
+ *                                Bridge Routing                                                *
+ ***********************************************************************************************
+ *
+ * - Each receiving port has its own routing table; a route selects frames by a range of
+ *   destination addresses or of command and notification types.
+ * - The lookup runs from the parser's header callback, i.e. in the receive interrupt, as soon
+ *   as the header is in; it only reads the decoded header.
+ * - Routes are tried in the order they were added, so a narrow command route placed first can
+ *   take frames out of a wider destination route.
+ *
+ ***********************************************************************************************/
+
+void asmart_bridge_init(aSmart_Bridge_t* bridge){
+    memset(bridge, 0, sizeof(*bridge));
+}
+
+BridgeRoute_t* asmart_bridge_add_route(aSmart_Bridge_t* bridge, uint8_t key, uint8_t first, uint8_t last, uint8_t mode){
+    if (bridge->route_count >= BRIDGE_ROUTES || first > last) {
+        return NULL;
+    }
+
+    BridgeRoute_t* route = &bridge->routes[bridge->route_count];
+    memset(route, 0, sizeof(*route));
+    route->key = key;
+    route->first = first;
+    route->last = last;
+    route->mode = mode;
+    bridge->route_count++;
+    return route;
+}
+
+BridgeRoute_t* asmart_bridge_lookup(aSmart_Bridge_t* bridge, const aSmart_FrameHeader_t* header){
+    uint8_t is_request = (header->message_type == MSG_TYPE_COMMAND || header->message_type == MSG_TYPE_NOTIFICATION);
+
+    for (uint8_t i = 0; i < bridge->route_count; i++) {
+        BridgeRoute_t* route = &bridge->routes[i];
+        uint8_t value;
+
+        if (route->key == ROUTE_BY_COMMAND) {
+            if (!is_request) {
+                continue;
+            }
+            value = header->command_type;
+        }
+        else {
+            value = header->destination;
+        }
+        if (value >= route->first && value <= route->last) {
+            return route;
+        }
+    }
+    return NULL;
+}
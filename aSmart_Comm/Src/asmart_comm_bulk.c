@@ -0,0 +1,375 @@
+#include "asmart_comm_bulk.h"
+#include <string.h>
+
+/***********************************************************************************************
+ *                                Bulk Transfer                                                 *
+ ***********************************************************************************************
+ *
+ * - The sender streams numbered blocks without waiting for an answer to each one. The
+ *   receiver places them in two page buffers, the page it is completing and the page after
+ *   it, and hands every completed page to its sink in order, so the sink writes whole pages
+ *   while the blocks of the next one arrive.
+ * - Acknowledgements carry the first missing block, the limit the page buffers accept, and a
+ *   bitmap of the blocks received behind the gap. They are sent every half page, when a page
+ *   is written, and at once when a gap shows up; the sender sends only the missing blocks
+ *   again (selective repeat) and probes, at doubling intervals, if they stop coming.
+ * - The CRC-32 of the image is announced in the open command and checked over the pages
+ *   handed to the sink when the sender finishes.
+ *
+ ***********************************************************************************************/
+
+#define BULK_CRC32_POLYNOMIAL 0xEDB88320UL  // IEEE 802.3, reflected
+
+/**
+ * @brief Returns the number of blocks of a page.
+ * @param rx Pointer to the receiver structure.
+ * @param page Page number.
+ * @retval page_blocks, less for the last page, 0 beyond the image.
+ */
+static uint16_t page_block_count(const aSmart_BulkRx_t* rx, uint32_t page);
+
+/**
+ * @brief Tells whether a block is in, written or waiting in a page buffer.
+ * @param rx Pointer to the receiver structure.
+ * @param block Block number.
+ * @retval 1 if received, 0 otherwise.
+ */
+static uint8_t is_block_received(const aSmart_BulkRx_t* rx, uint32_t block);
+
+/**
+ * @brief Returns the first block that has not been received.
+ * @param rx Pointer to the receiver structure.
+ * @retval Block number, block_count once all are in.
+ */
+static uint16_t first_missing_block(const aSmart_BulkRx_t* rx);
+
+/**
+ * @brief Hands the completed pages at the front to the sink.
+ * @param rx Pointer to the receiver structure.
+ * @retval Number of pages written.
+ */
+static uint16_t write_pages(aSmart_BulkRx_t* rx);
+
+/**
+ * @brief Returns the time without progress before the sender probes again.
+ * @param tx Pointer to the sender structure.
+ * @param rto Retransmission timeout (ms).
+ * @retval rto doubled per probe sent, at most BULK_PROBE_MAX_MS.
+ */
+static uint32_t probe_interval(const aSmart_BulkTx_t* tx, uint32_t rto);
+
+/* Nibble table: 64 bytes of flash instead of 1 KB, fast enough for a UART */
+static const uint32_t crc32_nibbles[16] = {
+    0x00000000UL, 0x1DB71064UL, 0x3B6E20C8UL, 0x26D930ACUL, 0x76DC4190UL, 0x6B6B51F4UL, 0x4DB26158UL, 0x5005713CUL,
+    0xEDB88320UL, 0xF00F9344UL, 0xD6D6A3E8UL, 0xCB61B38CUL, 0x9B64C2B0UL, 0x86D3D2D4UL, 0xA00AE278UL, 0xBDBDF21CUL
+};
+
+uint32_t asmart_bulk_crc32(uint32_t crc, const uint8_t* data, uint32_t length){
+    crc = ~crc;
+    for (uint32_t i = 0; i < length; i++) {
+        crc ^= data[i];
+        crc = (crc >> 4) ^ crc32_nibbles[crc & 0x0F];
+        crc = (crc >> 4) ^ crc32_nibbles[crc & 0x0F];
+    }
+    return ~crc;
+}
+
+uint16_t asmart_bulk_block_size(uint16_t max_data){
+    uint16_t block_size = BULK_PAGE_SIZE;
+
+    while (block_size > max_data) {
+        block_size >>= 1;
+    }
+    return (block_size >= BULK_MIN_BLOCK_SIZE) ? block_size : 0;
+}
+
+uint16_t asmart_bulk_block_length(uint32_t size, uint16_t block_size, uint16_t block){
+    uint32_t offset = (uint32_t)block * block_size;
+
+    return (size - offset < block_size) ? (uint16_t)(size - offset) : block_size;
+}
+
+uint16_t asmart_bulk_rx_open(aSmart_BulkRx_t* rx, uint8_t peer, uint8_t session, uint32_t size, uint32_t crc, uint16_t block_size){
+    uint32_t block_count = (size + block_size - 1) / block_size;
+
+    if (size == 0 || block_size == 0 || block_count > BULK_MAX_BLOCKS) {
+        return 0;
+    }
+    rx->state = BULK_STREAMING;
+    rx->status = BULK_OK;
+    rx->peer = peer;
+    rx->session = session;
+    rx->size = size;
+    rx->crc = crc;
+    rx->written_crc = 0;
+    rx->block_size = block_size;
+    rx->block_count = (uint16_t)block_count;
+    rx->page_blocks = BULK_PAGE_SIZE / block_size;
+    rx->page = 0;
+    rx->received[0] = 0;
+    rx->received[1] = 0;
+    rx->since_ack = 0;
+    rx->gap_reported = BULK_MAX_BLOCKS;
+    return rx->block_count;
+}
+
+uint8_t asmart_bulk_rx_block(aSmart_BulkRx_t* rx, uint16_t block, const uint8_t* data, uint16_t length){
+    if (rx->state != BULK_STREAMING || block >= rx->block_count) {
+        return 0;
+    }
+
+    /* Already written or in: the sender missed an acknowledgement */
+    if (is_block_received(rx, block)) {
+        return 1;
+    }
+
+    uint32_t page = block / rx->page_blocks;
+    uint16_t index = block % rx->page_blocks;
+    if (page > (uint32_t)rx->page + 1 || length != asmart_bulk_block_length(rx->size, rx->block_size, block)) {
+        return 0;
+    }
+    memcpy(&rx->buffers[page & 1][index * rx->block_size], data, length);
+    rx->received[page & 1] |= (1UL << index);
+    rx->since_ack++;
+
+    uint8_t due = (write_pages(rx) > 0);
+    if (rx->state != BULK_STREAMING) {
+        return 1;
+    }
+
+    /* A gap is reported once, when the first block behind it arrives */
+    uint16_t missing = first_missing_block(rx);
+    if (block > missing && rx->gap_reported != missing) {
+        rx->gap_reported = missing;
+        due = 1;
+    }
+    return due || missing >= rx->block_count || rx->since_ack >= (rx->page_blocks + 1) / 2;
+}
+
+uint16_t asmart_bulk_rx_ack(aSmart_BulkRx_t* rx, uint8_t* payload){
+    uint16_t missing = first_missing_block(rx);
+    uint32_t limit = ((uint32_t)rx->page + 2) * rx->page_blocks;
+    uint32_t bitmap = 0;
+
+    if (limit > rx->block_count) {
+        limit = rx->block_count;
+    }
+    for (uint8_t n = 0; n < 32; n++) {
+        if (is_block_received(rx, (uint32_t)missing + 1 + n)) {
+            bitmap |= (1UL << n);
+        }
+    }
+    payload[0] = rx->session;
+    payload[1] = rx->status;
+    payload[2] = (missing >> 8) & 0xFF;
+    payload[3] = missing & 0xFF;
+    payload[4] = (limit >> 8) & 0xFF;
+    payload[5] = limit & 0xFF;
+    payload[6] = (bitmap >> 24) & 0xFF;
+    payload[7] = (bitmap >> 16) & 0xFF;
+    payload[8] = (bitmap >> 8) & 0xFF;
+    payload[9] = bitmap & 0xFF;
+    rx->since_ack = 0;
+    return BULK_ACK_SIZE;
+}
+
+uint8_t asmart_bulk_rx_finish(aSmart_BulkRx_t* rx){
+    if (rx->state == BULK_STREAMING) {
+        /* Every page must have reached the sink, and the image must be the one announced */
+        uint8_t complete = (first_missing_block(rx) >= rx->block_count);
+        rx->status = (complete && rx->written_crc == rx->crc) ? BULK_OK : BULK_CRC_MISMATCH;
+    }
+    rx->state = BULK_IDLE;
+    return rx->status;
+}
+
+void asmart_bulk_tx_start(aSmart_BulkTx_t* tx, uint8_t peer, uint8_t session, uint32_t size, uint32_t crc, uint16_t block_size){
+    tx->state = BULK_OPENING;
+    tx->peer = peer;
+    tx->session = session;
+    tx->size = size;
+    tx->crc = crc;
+    tx->block_size = block_size;
+    tx->block_count = 0;
+    tx->acked = 0;
+    tx->limit = 0;
+    tx->next = 0;
+    tx->resend = 0;
+    tx->resend_armed = 0;
+    tx->last_progress = 0;
+    tx->probes = 0;
+}
+
+uint8_t asmart_bulk_tx_opened(aSmart_BulkTx_t* tx, uint16_t block_size, uint16_t limit, uint32_t now){
+    /* The receiver may only lower the block size, to a power of two */
+    if (block_size == 0 || block_size > tx->block_size || (block_size & (block_size - 1)) != 0) {
+        return 0;
+    }
+
+    uint32_t block_count = (tx->size + block_size - 1) / block_size;
+    if (block_count > BULK_MAX_BLOCKS || limit == 0) {
+        return 0;
+    }
+    tx->state = BULK_STREAMING;
+    tx->block_size = block_size;
+    tx->block_count = (uint16_t)block_count;
+    tx->limit = (limit < tx->block_count) ? limit : tx->block_count;
+    tx->last_progress = now;
+    return 1;
+}
+
+void asmart_bulk_tx_ack(aSmart_BulkTx_t* tx, uint16_t acked, uint16_t limit, uint32_t bitmap, uint32_t now, uint32_t rto){
+    /* Older acknowledgements, overtaken by a later one, and nonsense are ignored */
+    if (acked < tx->acked || acked > tx->next) {
+        return;
+    }
+
+    /* The receiver answers: probing starts over, from the retransmission timeout */
+    uint8_t probed = (tx->probes > 0);
+    uint8_t progress = (acked > tx->acked);
+    tx->probes = 0;
+    if (progress) {
+        uint16_t advance = acked - tx->acked;
+        tx->resend = (advance < 32) ? (tx->resend >> advance) : 0;
+        tx->acked = acked;
+        tx->last_progress = now;
+    }
+    if (limit > tx->limit) {
+        tx->limit = (limit < tx->block_count) ? limit : tx->block_count;
+    }
+
+    /* Bit n: block acked + n was sent and is not in */
+    uint32_t outstanding = tx->next - tx->acked;
+    uint32_t missing = ~(bitmap << 1) & ((outstanding >= 32) ? 0xFFFFFFFFUL : ((1UL << outstanding) - 1));
+
+    /* Blocks arrive in order: those missing below the highest one received are lost. An answer
+       to a probe comes after every block sent, so all missing ones are */
+    if (!probed) {
+        uint32_t below = 0;
+        for (uint8_t n = 0; n < 32; n++) {
+            if (bitmap & (1UL << n)) {
+                below = (uint32_t)((2UL << n) - 1);
+            }
+        }
+        missing &= below;
+    }
+
+    /* Armed on progress or a probe, else once per timeout so blocks already sent again are not doubled */
+    if (missing != 0 && (progress || probed || now - tx->resend_armed >= rto)) {
+        tx->resend |= missing;
+        tx->resend_armed = now;
+    }
+}
+
+int32_t asmart_bulk_tx_next(aSmart_BulkTx_t* tx, uint32_t now, uint32_t rto){
+    if (tx->state != BULK_STREAMING) {
+        return BULK_NEXT_NONE;
+    }
+
+    /* Gaps first, lowest block first */
+    while (tx->resend != 0) {
+        uint8_t bit = 0;
+        while (!(tx->resend & (1UL << bit))) {
+            bit++;
+        }
+        tx->resend &= ~(1UL << bit);
+        if ((uint32_t)tx->acked + bit < tx->next) {
+            return tx->acked + bit;
+        }
+    }
+
+    /* New blocks, as far as the receiver's page buffers reach */
+    if (tx->next < tx->limit) {
+        return tx->next++;
+    }
+
+    /* Nothing confirmed for a while: ask the receiver for an acknowledgement */
+    if (tx->acked < tx->next && now - tx->last_progress >= probe_interval(tx, rto)) {
+        tx->last_progress = now;
+        tx->probes++;
+        return BULK_NEXT_PROBE;
+    }
+    return BULK_NEXT_NONE;
+}
+
+uint32_t asmart_bulk_tx_deadline(aSmart_BulkTx_t* tx, uint32_t now, uint32_t rto){
+    if (tx->resend != 0 || tx->next < tx->limit || tx->acked >= tx->block_count) {
+        return 0;
+    }
+
+    uint32_t interval = probe_interval(tx, rto);
+    uint32_t elapsed = now - tx->last_progress;
+    return (elapsed >= interval) ? 0 : interval - elapsed;
+}
+
+/* Internal function implementations */
+
+static uint16_t page_block_count(const aSmart_BulkRx_t* rx, uint32_t page){
+    uint32_t first = page * rx->page_blocks;
+
+    if (first >= rx->block_count) {
+        return 0;
+    }
+    return (rx->block_count - first < rx->page_blocks) ? (uint16_t)(rx->block_count - first) : rx->page_blocks;
+}
+
+static uint8_t is_block_received(const aSmart_BulkRx_t* rx, uint32_t block){
+    uint32_t page = block / rx->page_blocks;
+
+    if (block >= rx->block_count || page > (uint32_t)rx->page + 1) {
+        return 0;
+    }
+    if (page < rx->page) {
+        return 1;
+    }
+    return (rx->received[page & 1] >> (block % rx->page_blocks)) & 0x01;
+}
+
+static uint16_t first_missing_block(const aSmart_BulkRx_t* rx){
+    uint32_t received = rx->received[rx->page & 1];
+    uint32_t block = (uint32_t)rx->page * rx->page_blocks;
+
+    while (received & 0x01) {
+        received >>= 1;
+        block++;
+    }
+    return (block < rx->block_count) ? (uint16_t)block : rx->block_count;
+}
+
+static uint16_t write_pages(aSmart_BulkRx_t* rx){
+    uint16_t written = 0;
+
+    for (;;) {
+        uint16_t blocks = page_block_count(rx, rx->page);
+        uint32_t complete = (blocks >= 32) ? 0xFFFFFFFFUL : ((1UL << blocks) - 1);
+
+        if (blocks == 0 || rx->received[rx->page & 1] != complete) {
+            return written;
+        }
+
+        uint32_t offset = (uint32_t)rx->page * BULK_PAGE_SIZE;
+        uint16_t length = (rx->size - offset < BULK_PAGE_SIZE) ? (uint16_t)(rx->size - offset) : BULK_PAGE_SIZE;
+        uint8_t* data = rx->buffers[rx->page & 1];
+
+        rx->written_crc = asmart_bulk_crc32(rx->written_crc, data, length);
+        if (!rx->sink(rx->context, offset, data, length)) {
+            rx->state = BULK_FAILED;
+            rx->status = BULK_SINK_FAILED;
+            return written;
+        }
+
+        /* The buffer now takes the page after the next one */
+        rx->received[rx->page & 1] = 0;
+        rx->page++;
+        written++;
+    }
+}
+
+static uint32_t probe_interval(const aSmart_BulkTx_t* tx, uint32_t rto){
+    uint32_t interval = rto;
+
+    for (uint8_t i = 0; i < tx->probes && interval < BULK_PROBE_MAX_MS; i++) {
+        interval <<= 1;
+    }
+    return (interval < BULK_PROBE_MAX_MS) ? interval : BULK_PROBE_MAX_MS;
+}
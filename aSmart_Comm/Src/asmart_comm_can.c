@@ -0,0 +1,694 @@
+#include "asmart_comm_can.h"
+
+/***********************************************************************************************
+ *                                CAN-FD Transport                                              *
+ ***********************************************************************************************
+ *
+ * - Sending: the handler's frames queue in the link. A frame up to 62 bytes goes out as a single
+ *   frame; a longer one as a first frame with its length, then consecutive frames of 63 bytes
+ *   numbered modulo 16. Unicast messages wait after the first frame, and after every block the
+ *   receiver granted, for its flow control: continue (with block size and separation time),
+ *   wait, or overflow, which drops the message. Group and broadcast messages are not flow
+ *   controlled, their consecutive frames follow at once.
+ * - Receiving: single frames go straight to the handler's parser. A first frame opens a
+ *   reassembly channel for its source and is answered with a flow control; the message goes to
+ *   the parser once its last consecutive frame is in. A frame out of sequence, or a pause of
+ *   CAN_TIMEOUT_MS, drops it; the protocol's retransmission takes over from there.
+ * - The controller's Tx FIFO is filled from the main loop, from the Tx complete interrupt and
+ *   on a flow control; a flow control it has no room for is sent from asmart_can_service().
+ *
+ ***********************************************************************************************/
+
+#define CAN_NO_FLOW 0xFF  // aSmart_CanRxChannel_t.flow_pending: nothing to send
+
+/* Data lengths of the DLC codes */
+static const uint8_t dlc_lengths[16] = {0, 1, 2, 3, 4, 5, 6, 7, 8, 12, 16, 20, 24, 32, 48, 64};
+
+/**
+ * @brief Sends the handler's frames through the link, see FrameWriter.
+ * @param context Pointer to the link.
+ * @param destination Destination address of the frame.
+ * @param frame Pointer to the frame.
+ * @param length Frame length.
+ * @retval None
+ */
+static void write_frame(void* context, uint8_t destination, const uint8_t* frame, uint16_t length);
+
+/**
+ * @brief Sends the queued messages as far as the controller and the receivers let it.
+ * @note Runs with interrupts disabled.
+ * @param link Pointer to the link structure.
+ * @param now Current time (ms).
+ * @retval Milliseconds until a separation time or flow control timeout is due,
+ *         ASMART_COMM_NO_DEADLINE if waiting for the controller or nothing is queued.
+ */
+static uint32_t advance_tx(aSmart_CanLink_t* link, uint32_t now);
+
+/**
+ * @brief Removes the message being sent from the queue.
+ * @param link Pointer to the link structure.
+ * @param sent 1 if it went out whole, 0 if it was dropped.
+ * @retval None
+ */
+static void end_message(aSmart_CanLink_t* link, uint8_t sent);
+
+/**
+ * @brief Copies bytes of the message being sent out of the queue ring.
+ * @param link Pointer to the link structure.
+ * @param offset Position in the message.
+ * @param data Receives the bytes.
+ * @param length Number of bytes.
+ * @retval None
+ */
+static void copy_message(aSmart_CanLink_t* link, uint16_t offset, uint8_t* data, uint16_t length);
+
+/**
+ * @brief Pads a frame up to the next CAN-FD length.
+ * @param frame Pointer to the frame.
+ * @param length Bytes filled.
+ * @retval None
+ */
+static void pad_frame(aSmart_CanFrame_t* frame, uint8_t length);
+
+/**
+ * @brief Sends a flow control frame.
+ * @param link Pointer to the link structure.
+ * @param target Node sending the message.
+ * @param status CAN_FLOW_CTS, CAN_FLOW_WAIT or CAN_FLOW_OVERFLOW.
+ * @retval 1 if the controller took it, 0 otherwise.
+ */
+static uint8_t send_flow(aSmart_CanLink_t* link, uint8_t target, uint8_t status);
+
+/**
+ * @brief Takes a flow control frame for the message being sent.
+ * @param link Pointer to the link structure.
+ * @param source Node that sent it.
+ * @param frame Received frame.
+ * @param now Current time (ms).
+ * @retval None
+ */
+static void receive_flow(aSmart_CanLink_t* link, uint8_t source, const aSmart_CanFrame_t* frame, uint32_t now);
+
+/**
+ * @brief Opens a reassembly channel on a first frame and answers it.
+ * @param link Pointer to the link structure.
+ * @param source Node that sent it.
+ * @param functional 1 for a group or broadcast message.
+ * @param frame Received frame.
+ * @param now Current time (ms).
+ * @retval None
+ */
+static void receive_first(aSmart_CanLink_t* link, uint8_t source, uint8_t functional, const aSmart_CanFrame_t* frame, uint32_t now);
+
+/**
+ * @brief Adds a consecutive frame to its channel, delivers the message once it is complete.
+ * @param link Pointer to the link structure.
+ * @param source Node that sent it.
+ * @param frame Received frame.
+ * @param now Current time (ms).
+ * @retval None
+ */
+static void receive_consecutive(aSmart_CanLink_t* link, uint8_t source, const aSmart_CanFrame_t* frame, uint32_t now);
+
+/**
+ * @brief Returns the reassembly channel of a source.
+ * @param link Pointer to the link structure.
+ * @param source Sending node, ADDRESS_UNASSIGNED finds a free channel.
+ * @retval Pointer to the channel, NULL if none.
+ */
+static aSmart_CanRxChannel_t* find_channel(aSmart_CanLink_t* link, uint8_t source);
+
+/**
+ * @brief Hands a complete message to the handler's parser.
+ * @param link Pointer to the link structure.
+ * @param data Message bytes, one frame of the protocol.
+ * @param length Message length.
+ * @retval None
+ */
+static void deliver_message(aSmart_CanLink_t* link, const uint8_t* data, uint16_t length);
+
+/**
+ * @brief Converts a separation time as sent in a flow control to milliseconds.
+ * @param stmin STmin byte.
+ * @retval Milliseconds, µs values round up to 1, reserved values count as 127.
+ */
+static uint8_t stmin_to_ms(uint8_t stmin);
+
+void asmart_can_init(aSmart_CanLink_t* link, aSmart_Comm_Handler_t* handler, CanWrite write, void* driver, ResponseCallback response_callback){
+    memset(link, 0, sizeof(*link));
+    link->handler = handler;
+    link->write = write;
+    link->driver = driver;
+    link->own_address = ASMART_COMM_DEFAULT_ADDRESS;
+    link->block_size = CAN_BLOCK_SIZE;
+    link->stmin = CAN_STMIN;
+    for (uint8_t i = 0; i < CAN_RX_CHANNELS; i++) {
+        link->rx[i].flow_pending = CAN_NO_FLOW;
+    }
+    asmart_comm_init_transport(handler, write_frame, link, response_callback);
+}
+
+void asmart_can_set_address(aSmart_CanLink_t* link, uint8_t own_address, uint16_t group_mask){
+    link->own_address = own_address & 0x7F;
+    link->group_mask = group_mask;
+    asmart_comm_set_address(link->handler, own_address, group_mask);
+}
+
+uint8_t asmart_can_accepts(const aSmart_CanLink_t* link, uint32_t id){
+    uint8_t target = CAN_ID_TARGET(id);
+
+    if ((id & CAN_ID_BASE_MASK) == CAN_ID_PHYSICAL) {
+        return target == link->own_address;
+    }
+    if ((id & CAN_ID_BASE_MASK) == CAN_ID_FUNCTIONAL) {
+        if (target == ADDRESS_BROADCAST) {
+            return 1;
+        }
+        return target >= ADDRESS_GROUP_FIRST && target <= ADDRESS_GROUP_LAST && (link->group_mask & (1U << (target - ADDRESS_GROUP_FIRST)));
+    }
+    return 0;
+}
+
+void asmart_can_receive(aSmart_CanLink_t* link, const aSmart_CanFrame_t* frame){
+    uint8_t source = CAN_ID_SOURCE(frame->id);
+    uint8_t functional = (frame->id & CAN_ID_BASE_MASK) == CAN_ID_FUNCTIONAL;
+    uint8_t pci = frame->data[0] & 0xF0;
+    uint32_t now = asmart_comm_now();
+
+    if (frame->length == 0 || !asmart_can_accepts(link, frame->id)) {
+        return;
+    }
+
+    if (pci == CAN_PCI_SINGLE) {
+        uint8_t length = frame->data[0] & 0x0F;
+        uint8_t start = 1;
+
+        /* Longer than a classic frame: the length follows in the second byte */
+        if (length == 0 && frame->length > CAN_CLASSIC_DATA) {
+            length = frame->data[1];
+            start = 2;
+        }
+        if (length == 0 || start + length > frame->length) {
+            return;
+        }
+
+        /* A new message from the source ends the one it had under way */
+        aSmart_CanRxChannel_t* channel = find_channel(link, source);
+        if (channel != NULL) {
+            channel->source = ADDRESS_UNASSIGNED;
+            link->rx_drops++;
+        }
+        deliver_message(link, &frame->data[start], length);
+    }
+    else if (pci == CAN_PCI_FIRST) {
+        receive_first(link, source, functional, frame, now);
+    }
+    else if (pci == CAN_PCI_CONSECUTIVE) {
+        receive_consecutive(link, source, frame, now);
+    }
+    else if (pci == CAN_PCI_FLOW && !functional) {
+        receive_flow(link, source, frame, now);
+    }
+}
+
+uint32_t asmart_can_service(aSmart_CanLink_t* link){
+    uint32_t now = asmart_comm_now();
+    uint32_t deadline = ASMART_COMM_NO_DEADLINE;
+    uint32_t wait;
+
+    /* The receive and Tx complete interrupts work on the same state */
+    uint32_t primask = __get_PRIMASK();
+    __disable_irq();
+    for (uint8_t i = 0; i < CAN_RX_CHANNELS; i++) {
+        aSmart_CanRxChannel_t* channel = &link->rx[i];
+
+        if (channel->source == ADDRESS_UNASSIGNED) {
+            continue;
+        }
+        if (now - channel->last_frame >= CAN_TIMEOUT_MS) {
+            channel->source = ADDRESS_UNASSIGNED;
+            link->rx_drops++;
+            continue;
+        }
+        if (channel->flow_pending != CAN_NO_FLOW && send_flow(link, channel->source, channel->flow_pending)) {
+            channel->flow_pending = CAN_NO_FLOW;
+        }
+        wait = CAN_TIMEOUT_MS - (now - channel->last_frame);
+        deadline = (wait < deadline) ? wait : deadline;
+    }
+    wait = advance_tx(link, now);
+    deadline = (wait < deadline) ? wait : deadline;
+    __set_PRIMASK(primask);
+    return deadline;
+}
+
+uint16_t asmart_can_tx_room(const aSmart_CanLink_t* link){
+    uint16_t free = CAN_TX_QUEUE_SIZE - link->queue_count;
+
+    return (free > CAN_TX_ENTRY_HEADER) ? free - CAN_TX_ENTRY_HEADER : 0;
+}
+
+uint8_t asmart_can_dlc(uint8_t length){
+    uint8_t dlc = 0;
+
+    while (dlc < 15 && dlc_lengths[dlc] < length) {
+        dlc++;
+    }
+    return dlc;
+}
+
+uint8_t asmart_can_dlc_length(uint8_t dlc){
+    return dlc_lengths[dlc & 0x0F];
+}
+
+/* Internal function implementations */
+
+static void write_frame(void* context, uint8_t destination, const uint8_t* frame, uint16_t length){
+    aSmart_CanLink_t* link = (aSmart_CanLink_t*)context;
+
+    uint32_t primask = __get_PRIMASK();
+    __disable_irq();
+    if (length == 0 || link->queue_count + CAN_TX_ENTRY_HEADER + length > CAN_TX_QUEUE_SIZE) {
+        link->tx_drops++;
+    }
+    else {
+        uint16_t tail = (link->queue_head + link->queue_count) % CAN_TX_QUEUE_SIZE;
+        uint8_t entry[CAN_TX_ENTRY_HEADER] = {destination, (uint8_t)(length >> 8), (uint8_t)length};
+
+        for (uint16_t i = 0; i < CAN_TX_ENTRY_HEADER; i++) {
+            link->queue[(tail + i) % CAN_TX_QUEUE_SIZE] = entry[i];
+        }
+        tail = (tail + CAN_TX_ENTRY_HEADER) % CAN_TX_QUEUE_SIZE;
+        for (uint16_t i = 0; i < length; i++) {
+            link->queue[(tail + i) % CAN_TX_QUEUE_SIZE] = frame[i];
+        }
+        link->queue_count += CAN_TX_ENTRY_HEADER + length;
+        advance_tx(link, asmart_comm_now());
+    }
+    __set_PRIMASK(primask);
+}
+
+static uint32_t advance_tx(aSmart_CanLink_t* link, uint32_t now){
+    aSmart_CanFrame_t frame;
+
+    while (1) {
+        if (link->tx_state == CAN_TX_WAIT_FLOW) {
+            if (now - link->tx_last >= CAN_TIMEOUT_MS) {
+                end_message(link, 0);
+                continue;
+            }
+            return CAN_TIMEOUT_MS - (now - link->tx_last);
+        }
+
+        if (link->tx_state == CAN_TX_SENDING) {
+            if (link->tx_stmin_ms != 0 && now - link->tx_last < link->tx_stmin_ms) {
+                return link->tx_stmin_ms - (now - link->tx_last);
+            }
+            uint16_t chunk = link->tx_length - link->tx_offset;
+            chunk = (chunk > CAN_MAX_DATA - 1) ? CAN_MAX_DATA - 1 : chunk;
+
+            frame.id = CAN_ID((link->tx_target >= ADDRESS_GROUP_FIRST) ? CAN_ID_FUNCTIONAL : CAN_ID_PHYSICAL, link->tx_target, link->own_address);
+            frame.data[0] = CAN_PCI_CONSECUTIVE | (link->tx_sequence & 0x0F);
+            copy_message(link, link->tx_offset, &frame.data[1], chunk);
+            pad_frame(&frame, 1 + chunk);
+            if (!link->write(link->driver, &frame)) {
+                return ASMART_COMM_NO_DEADLINE;
+            }
+            link->tx_offset += chunk;
+            link->tx_sequence++;
+            link->tx_last = now;
+            if (link->tx_offset == link->tx_length) {
+                end_message(link, 1);
+            }
+            else if (link->tx_block_size != 0 && ++link->tx_block_sent == link->tx_block_size) {
+                link->tx_state = CAN_TX_WAIT_FLOW;
+            }
+            continue;
+        }
+
+        /* CAN_TX_IDLE: start the next message with its single or first frame */
+        if (link->queue_count == 0) {
+            return ASMART_COMM_NO_DEADLINE;
+        }
+        link->tx_target = link->queue[link->queue_head];
+        link->tx_length = ((uint16_t)link->queue[(link->queue_head + 1) % CAN_TX_QUEUE_SIZE] << 8) | link->queue[(link->queue_head + 2) % CAN_TX_QUEUE_SIZE];
+        uint8_t functional = link->tx_target >= ADDRESS_GROUP_FIRST;
+        uint8_t start;
+        uint16_t chunk;
+
+        frame.id = CAN_ID(functional ? CAN_ID_FUNCTIONAL : CAN_ID_PHYSICAL, link->tx_target, link->own_address);
+        if (link->tx_length <= CAN_CLASSIC_DATA - 1) {
+            frame.data[0] = CAN_PCI_SINGLE | link->tx_length;
+            start = 1;
+            chunk = link->tx_length;
+        }
+        else if (link->tx_length <= CAN_SINGLE_MAX) {
+            frame.data[0] = CAN_PCI_SINGLE;
+            frame.data[1] = link->tx_length;
+            start = 2;
+            chunk = link->tx_length;
+        }
+        else {
+            if (link->tx_length <= CAN_FIRST_MAX_SHORT) {
+                frame.data[0] = CAN_PCI_FIRST | (link->tx_length >> 8);
+                frame.data[1] = link->tx_length & 0xFF;
+                start = 2;
+            }
+            else {
+                frame.data[0] = CAN_PCI_FIRST;
+                frame.data[1] = 0;
+                frame.data[2] = 0;
+                frame.data[3] = 0;
+                frame.data[4] = (link->tx_length >> 8) & 0xFF;
+                frame.data[5] = link->tx_length & 0xFF;
+                start = 6;
+            }
+            chunk = CAN_MAX_DATA - start;
+        }
+        copy_message(link, 0, &frame.data[start], chunk);
+        pad_frame(&frame, start + chunk);
+        if (!link->write(link->driver, &frame)) {
+            return ASMART_COMM_NO_DEADLINE;
+        }
+        if (chunk == link->tx_length) {
+            end_message(link, 1);
+            continue;
+        }
+        link->tx_offset = chunk;
+        link->tx_sequence = 1;
+        link->tx_block_size = 0;
+        link->tx_block_sent = 0;
+        link->tx_stmin_ms = 0;
+        link->tx_waits = 0;
+        link->tx_last = now;
+        link->tx_state = functional ? CAN_TX_SENDING : CAN_TX_WAIT_FLOW;
+    }
+}
+
+static void end_message(aSmart_CanLink_t* link, uint8_t sent){
+    uint16_t entry = CAN_TX_ENTRY_HEADER + link->tx_length;
+
+    link->queue_head = (link->queue_head + entry) % CAN_TX_QUEUE_SIZE;
+    link->queue_count -= entry;
+    link->tx_state = CAN_TX_IDLE;
+    if (sent) {
+        link->tx_messages++;
+    }
+    else {
+        link->tx_drops++;
+    }
+}
+
+static void copy_message(aSmart_CanLink_t* link, uint16_t offset, uint8_t* data, uint16_t length){
+    uint16_t position = (link->queue_head + CAN_TX_ENTRY_HEADER + offset) % CAN_TX_QUEUE_SIZE;
+    uint16_t first = CAN_TX_QUEUE_SIZE - position;
+
+    /* The message may wrap around the end of the ring */
+    if (first >= length) {
+        memcpy(data, &link->queue[position], length);
+    }
+    else {
+        memcpy(data, &link->queue[position], first);
+        memcpy(&data[first], link->queue, length - first);
+    }
+}
+
+static void pad_frame(aSmart_CanFrame_t* frame, uint8_t length){
+    uint8_t padded = asmart_can_dlc_length(asmart_can_dlc(length));
+
+    memset(&frame->data[length], CAN_PADDING, padded - length);
+    frame->length = padded;
+}
+
+static uint8_t send_flow(aSmart_CanLink_t* link, uint8_t target, uint8_t status){
+    aSmart_CanFrame_t frame;
+
+    frame.id = CAN_ID(CAN_ID_PHYSICAL, target, link->own_address);
+    frame.data[0] = CAN_PCI_FLOW | status;
+    frame.data[1] = link->block_size;
+    frame.data[2] = link->stmin;
+
+    /* Padded to a classic frame, for receivers that expect it */
+    memset(&frame.data[3], CAN_PADDING, CAN_CLASSIC_DATA - 3);
+    frame.length = CAN_CLASSIC_DATA;
+    return link->write(link->driver, &frame);
+}
+
+static void receive_flow(aSmart_CanLink_t* link, uint8_t source, const aSmart_CanFrame_t* frame, uint32_t now){
+    uint8_t status = frame->data[0] & 0x0F;
+
+    if (link->tx_state != CAN_TX_WAIT_FLOW || source != link->tx_target || frame->length < 3) {
+        return;
+    }
+    if (status == CAN_FLOW_CTS) {
+        link->tx_block_size = frame->data[1];
+        link->tx_block_sent = 0;
+        link->tx_stmin_ms = stmin_to_ms(frame->data[2]);
+        link->tx_last = now - link->tx_stmin_ms;  // The first consecutive frame goes at once
+        link->tx_state = CAN_TX_SENDING;
+    }
+    else if (status == CAN_FLOW_WAIT) {
+        link->tx_last = now;
+        if (++link->tx_waits > CAN_MAX_WAITS) {
+            end_message(link, 0);
+        }
+    }
+    else {
+        /* Overflow: the receiver cannot take the message */
+        end_message(link, 0);
+    }
+    advance_tx(link, now);
+}
+
+static void receive_first(aSmart_CanLink_t* link, uint8_t source, uint8_t functional, const aSmart_CanFrame_t* frame, uint32_t now){
+    uint32_t length = ((uint32_t)(frame->data[0] & 0x0F) << 8) | frame->data[1];
+    uint8_t start = 2;
+
+    if (length == 0 && frame->length >= 6) {
+        length = ((uint32_t)frame->data[2] << 24) | ((uint32_t)frame->data[3] << 16) | ((uint32_t)frame->data[4] << 8) | frame->data[5];
+        start = 6;
+    }
+    /* A message that fits a single frame is never segmented */
+    if (frame->length < CAN_CLASSIC_DATA || length <= (uint32_t)(frame->length - start)) {
+        return;
+    }
+
+    /* A new message from the source ends the one it had under way */
+    aSmart_CanRxChannel_t* channel = find_channel(link, source);
+    if (channel != NULL) {
+        channel->source = ADDRESS_UNASSIGNED;
+        link->rx_drops++;
+    }
+    channel = find_channel(link, ADDRESS_UNASSIGNED);
+    if (channel == NULL || length > RECEIVE_BUFFER_SIZE) {
+        link->rx_drops++;
+        if (!functional) {
+            send_flow(link, source, CAN_FLOW_OVERFLOW);
+        }
+        return;
+    }
+
+    channel->source = source;
+    channel->functional = functional;
+    channel->sequence = 1;
+    channel->block_count = 0;
+    channel->flow_pending = CAN_NO_FLOW;
+    channel->length = (uint16_t)length;
+    channel->received = frame->length - start;
+    channel->last_frame = now;
+    memcpy(channel->buffer, &frame->data[start], channel->received);
+    if (!functional && !send_flow(link, source, CAN_FLOW_CTS)) {
+        channel->flow_pending = CAN_FLOW_CTS;
+    }
+}
+
+static void receive_consecutive(aSmart_CanLink_t* link, uint8_t source, const aSmart_CanFrame_t* frame, uint32_t now){
+    aSmart_CanRxChannel_t* channel = find_channel(link, source);
+
+    if (channel == NULL) {
+        return;
+    }
+    if ((frame->data[0] & 0x0F) != (channel->sequence & 0x0F)) {
+        /* A frame went missing */
+        channel->source = ADDRESS_UNASSIGNED;
+        link->rx_drops++;
+        return;
+    }
+
+    uint16_t chunk = channel->length - channel->received;
+    chunk = (chunk > frame->length - 1) ? frame->length - 1 : chunk;
+    memcpy(&channel->buffer[channel->received], &frame->data[1], chunk);
+    channel->received += chunk;
+    channel->sequence++;
+    channel->last_frame = now;
+
+    if (channel->received == channel->length) {
+        channel->source = ADDRESS_UNASSIGNED;
+        deliver_message(link, channel->buffer, channel->length);
+    }
+    else if (!channel->functional && link->block_size != 0 && ++channel->block_count == link->block_size) {
+        channel->block_count = 0;
+        if (!send_flow(link, source, CAN_FLOW_CTS)) {
+            channel->flow_pending = CAN_FLOW_CTS;
+        }
+    }
+}
+
+static aSmart_CanRxChannel_t* find_channel(aSmart_CanLink_t* link, uint8_t source){
+    for (uint8_t i = 0; i < CAN_RX_CHANNELS; i++) {
+        if (link->rx[i].source == source) {
+            return &link->rx[i];
+        }
+    }
+    return NULL;
+}
+
+static void deliver_message(aSmart_CanLink_t* link, const uint8_t* data, uint16_t length){
+    aSmart_Parser_t* parser = &link->handler->rx_handler.parser;
+
+    /* A message is one whole frame, whatever a damaged one left in the parser goes */
+    if (parser->state != PARSER_STATE_WAIT_STX && parser->state != PARSER_STATE_FORWARD) {
+        asmart_parser_reset(parser);
+    }
+    asmart_comm_receive_bytes(link->handler, data, length);
+    link->rx_messages++;
+}
+
+static uint8_t stmin_to_ms(uint8_t stmin){
+    if (stmin <= 0x7F) {
+        return stmin;
+    }
+    return (stmin >= 0xF1 && stmin <= 0xF9) ? 1 : 0x7F;
+}
+
+#if !ASMART_COMM_HOST && defined(HAL_FDCAN_MODULE_ENABLED)
+/* Links by FDCAN, for the HAL callbacks */
+static aSmart_CanLink_t* can_links[CAN_PORTS];
+
+/**
+ * @brief Returns the link of an FDCAN.
+ * @param hfdcan FDCAN handle passed to a HAL callback.
+ * @retval Pointer to the link, NULL if the FDCAN has none.
+ */
+static aSmart_CanLink_t* find_link(FDCAN_HandleTypeDef* hfdcan);
+
+HAL_StatusTypeDef asmart_can_fdcan_start(aSmart_CanLink_t* link){
+    FDCAN_HandleTypeDef* hfdcan = (FDCAN_HandleTypeDef*)link->driver;
+    FDCAN_FilterTypeDef filter = {0};
+    HAL_StatusTypeDef status;
+
+    /* Take the FDCAN's entry, or the first free one */
+    for (uint8_t i = 0; i < CAN_PORTS; i++) {
+        if (can_links[i] == NULL || can_links[i]->driver == link->driver) {
+            can_links[i] = link;
+            break;
+        }
+    }
+    /* Filters are only written while the FDCAN is stopped */
+    if (hfdcan->State == HAL_FDCAN_STATE_BUSY) {
+        HAL_FDCAN_Stop(hfdcan);
+    }
+
+    /* Unicast identifiers of this node, from any source */
+    filter.IdType = FDCAN_EXTENDED_ID;
+    filter.FilterIndex = 0;
+    filter.FilterType = FDCAN_FILTER_MASK;
+    filter.FilterConfig = FDCAN_FILTER_TO_RXFIFO0;
+    filter.FilterID1 = CAN_ID(CAN_ID_PHYSICAL, link->own_address, 0x00);
+    filter.FilterID2 = 0x1FFFFF00UL;
+    status = HAL_FDCAN_ConfigFilter(hfdcan, &filter);
+
+    /* Group and broadcast identifiers; asmart_can_accepts() drops the groups this node is not in */
+    if (status == HAL_OK) {
+        filter.FilterIndex = 1;
+        filter.FilterType = FDCAN_FILTER_RANGE;
+        filter.FilterID1 = CAN_ID(CAN_ID_FUNCTIONAL, ADDRESS_GROUP_FIRST, 0x00);
+        filter.FilterID2 = CAN_ID(CAN_ID_FUNCTIONAL, ADDRESS_BROADCAST, 0xFF);
+        status = HAL_FDCAN_ConfigFilter(hfdcan, &filter);
+    }
+    if (status == HAL_OK) {
+        status = HAL_FDCAN_ConfigGlobalFilter(hfdcan, FDCAN_REJECT, FDCAN_REJECT, FDCAN_REJECT_REMOTE, FDCAN_REJECT_REMOTE);
+    }
+
+    /* At data rates above 1 Mbit/s the transceiver's loop delay exceeds a bit: check the echo later */
+    if (status == HAL_OK && hfdcan->Init.FrameFormat == FDCAN_FRAME_FD_BRS) {
+        status = HAL_FDCAN_ConfigTxDelayCompensation(hfdcan, hfdcan->Init.DataPrescaler * hfdcan->Init.DataTimeSeg1, 0);
+        if (status == HAL_OK) {
+            status = HAL_FDCAN_EnableTxDelayCompensation(hfdcan);
+        }
+    }
+    if (status == HAL_OK) {
+        status = HAL_FDCAN_ActivateNotification(hfdcan, FDCAN_IT_RX_FIFO0_NEW_MESSAGE | FDCAN_IT_TX_COMPLETE, FDCAN_TX_BUFFER0 | FDCAN_TX_BUFFER1 | FDCAN_TX_BUFFER2);
+    }
+    if (status == HAL_OK) {
+        status = HAL_FDCAN_Start(hfdcan);
+    }
+    return status;
+}
+
+uint8_t asmart_can_fdcan_write(void* driver, const aSmart_CanFrame_t* frame){
+    FDCAN_HandleTypeDef* hfdcan = (FDCAN_HandleTypeDef*)driver;
+    FDCAN_TxHeaderTypeDef header;
+
+    if (HAL_FDCAN_GetTxFifoFreeLevel(hfdcan) == 0) {
+        return 0;
+    }
+    header.Identifier = frame->id;
+    header.IdType = FDCAN_EXTENDED_ID;
+    header.TxFrameType = FDCAN_DATA_FRAME;
+    header.DataLength = asmart_can_dlc(frame->length);  // DLC codes, not shifted on the G0
+    header.ErrorStateIndicator = FDCAN_ESI_ACTIVE;
+    header.BitRateSwitch = (hfdcan->Init.FrameFormat == FDCAN_FRAME_FD_BRS) ? FDCAN_BRS_ON : FDCAN_BRS_OFF;
+    header.FDFormat = FDCAN_FD_CAN;
+    header.TxEventFifoControl = FDCAN_NO_TX_EVENTS;
+    header.MessageMarker = 0;
+    return HAL_FDCAN_AddMessageToTxFifoQ(hfdcan, &header, frame->data) == HAL_OK;
+}
+
+/**
+ * @brief Rx FIFO 0 callback, passes every frame waiting in the FIFO to the link.
+ * @param hfdcan FDCAN handle.
+ * @param RxFifo0ITs Interrupts that occurred.
+ * @retval None
+ */
+void HAL_FDCAN_RxFifo0Callback(FDCAN_HandleTypeDef* hfdcan, uint32_t RxFifo0ITs){
+    aSmart_CanLink_t* link = find_link(hfdcan);
+    FDCAN_RxHeaderTypeDef header;
+    aSmart_CanFrame_t frame;
+
+    if (link == NULL || !(RxFifo0ITs & FDCAN_IT_RX_FIFO0_NEW_MESSAGE)) {
+        return;
+    }
+    while (HAL_FDCAN_GetRxFifoFillLevel(hfdcan, FDCAN_RX_FIFO0) > 0 && HAL_FDCAN_GetRxMessage(hfdcan, FDCAN_RX_FIFO0, &header, frame.data) == HAL_OK) {
+        if (header.IdType == FDCAN_EXTENDED_ID) {
+            frame.id = header.Identifier;
+            frame.length = asmart_can_dlc_length((uint8_t)header.DataLength);
+            asmart_can_receive(link, &frame);
+        }
+    }
+}
+
+/**
+ * @brief Tx complete callback, refills the Tx FIFO.
+ * @param hfdcan FDCAN handle.
+ * @param BufferIndexes Tx buffers that completed.
+ * @retval None
+ */
+void HAL_FDCAN_TxBufferCompleteCallback(FDCAN_HandleTypeDef* hfdcan, uint32_t BufferIndexes){
+    aSmart_CanLink_t* link = find_link(hfdcan);
+
+    (void)BufferIndexes;
+    if (link != NULL) {
+        asmart_can_service(link);
+    }
+}
+
+static aSmart_CanLink_t* find_link(FDCAN_HandleTypeDef* hfdcan){
+    for (uint8_t i = 0; i < CAN_PORTS; i++) {
+        if (can_links[i] != NULL && can_links[i]->driver == hfdcan) {
+            return can_links[i];
+        }
+    }
+    return NULL;
+}
+#endif
@@ -0,0 +1,88 @@
+#include "asmart_comm_channel.h"
+#include <string.h>
+
+/***********************************************************************************************
+ *                                Logical Channels                                              *
+ ***********************************************************************************************
+ *
+ * - Each channel has its own sequence space, shared by its commands and notifications, and
+ *   its own transmit queue.
+ * - Flow control is credit based: the receiver grants a limit (newest sequence number received
+ *   plus its window) and the sender only transmits frames up to that limit.
+ * - Credit is derived from sequence numbers, so a lost frame does not leak credit; a sender
+ *   that stays blocked probes the receiver, which then treats everything before the probe's
+ *   sequence number as received and grants again.
+ *
+ ***********************************************************************************************/
+
+void asmart_channel_open(aSmart_Channel_t* channel, uint8_t peer, uint8_t rx_window, ChannelCallback callback){
+    memset(channel, 0, sizeof(*channel));
+    channel->open = 1;
+    channel->peer = peer;
+    channel->callback = callback;
+    channel->rx_window = (rx_window == 0) ? 1 : rx_window;
+}
+
+void asmart_channel_close(aSmart_Channel_t* channel){
+    channel->open = 0;
+    channel->queue_count = 0;
+    channel->blocked = 0;
+}
+
+uint8_t asmart_channel_enqueue(aSmart_Channel_t* channel, uint16_t sequence_number, const uint8_t* frame, uint16_t frame_length){
+    if (channel->queue_count >= CHANNEL_QUEUE_DEPTH || frame_length > CHANNEL_FRAME_SIZE) {
+        return 0;
+    }
+
+    ChannelFrame_t* slot = &channel->queue[(channel->queue_head + channel->queue_count) % CHANNEL_QUEUE_DEPTH];
+    slot->sequence_number = sequence_number;
+    slot->frame_length = frame_length;
+    memcpy(slot->frame, frame, frame_length);
+    channel->queue_count++;
+    return 1;
+}
+
+ChannelFrame_t* asmart_channel_head(aSmart_Channel_t* channel){
+    if (channel->queue_count == 0) {
+        return NULL;
+    }
+    return &channel->queue[channel->queue_head];
+}
+
+void asmart_channel_dequeue(aSmart_Channel_t* channel){
+    if (channel->queue_count == 0) {
+        return;
+    }
+    channel->queue_head = (channel->queue_head + 1) % CHANNEL_QUEUE_DEPTH;
+    channel->queue_count--;
+    channel->blocked = 0;
+}
+
+uint8_t asmart_channel_has_credit(aSmart_Channel_t* channel, uint16_t sequence_number){
+    return (int16_t)(sequence_number - channel->send_limit) <= 0;
+}
+
+void asmart_channel_grant(aSmart_Channel_t* channel, uint16_t limit){
+    /* Grants may arrive out of order after a probe, never move the limit back */
+    if ((int16_t)(limit - channel->send_limit) > 0) {
+        channel->send_limit = limit;
+    }
+}
+
+void asmart_channel_received(aSmart_Channel_t* channel, uint16_t sequence_number){
+    if ((int16_t)(sequence_number - channel->rx_highest) > 0) {
+        channel->rx_highest = sequence_number;
+    }
+}
+
+uint8_t asmart_channel_grant_due(aSmart_Channel_t* channel, uint8_t force, uint16_t* limit){
+    uint16_t next_limit = channel->rx_highest + channel->rx_window;
+    uint16_t unadvertised = next_limit - channel->rx_advertised;
+
+    if (!force && unadvertised < (channel->rx_window + 1) / 2) {
+        return 0;
+    }
+    channel->rx_advertised = next_limit;
+    *limit = next_limit;
+    return 1;
+}
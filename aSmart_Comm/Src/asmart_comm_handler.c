@@ -11,6 +11,10 @@
  *      - Initializes the communication handler structure (`aSmart_Comm_Handler_t`).
  *      - Sets up UART reception using `HAL_UARTEx_ReceiveToIdle_IT()`.
  *      - Assigns the response callback function provided by the application.
+ *      - Sets own and peer address to `ASMART_COMM_DEFAULT_ADDRESS`; `asmart_comm_set_address()`
+ *        and `asmart_comm_set_peer()` configure multi-drop nodes.
+ *    - `asmart_comm_init_port()` does the same on another UART; each handler is one port and
+ *      the HAL callbacks find it by its UART.
  *
  * 2. Sending a Command
  *    --------------------
@@ -22,14 +26,17 @@
  *        - Timestamp for timeout management.
  *      - Assembles the message by calling `assemble_message()`:
  *        - Constructs the message according to the protocol:
- *          [STX][Length][Sequence Number][Message Type][Command Type][Payload][CRC][ETX]
+ *          [STX][Length][Destination][Source][Sequence Number][Message Type][Command Type][Payload][CRC][ETX]
  *      - Transmits the message using `HAL_UART_Transmit()`.
+ *      - Commands to a group or broadcast address are not added to the mapping table.
  *
  * 3. Sending a Response
  *    ----------------------
  *    - Function: `asmart_send_response()`
  *      - Assembles a response message to a received command.
  *      - Uses the sequence number from the received command to match the response.
+ *      - Addressed to the source of the last received command; suppressed if that command
+ *        was sent to a group or broadcast address.
  *      - Calls `assemble_message()` to construct the message.
  *      - Transmits the message.
  *
@@ -56,34 +63,62 @@
  *      - Builds the message buffer:
  *        - Starts with STX (Start of Text).
  *        - Includes the Length field (excluding STX and ETX).
+ *        - Adds the Destination and Source addresses.
  *        - Adds the Sequence Number (2 bytes, big-endian).
  *        - Adds the Message Type (e.g., COMMAND, RESPONSE, NOTIFICATION, ERROR).
  *        - Adds the Command Type or Error Code.
- *        - Appends the Payload (message data).
+ *        - Appends the Payload (message data). A payload encoded straight into
+ *          `asmart_comm_tx_payload()` is already in place and is not copied. A payload
+ *          longer than `ASMART_COMM_MAX_PAYLOAD` leaves nothing assembled and is not sent.
  *        - Calculates and appends the CRC16-CCITT checksum.
  *        - Ends with ETX (End of Text).
  *
  * 7. UART Reception
  *    -----------------
- *    - Callback: `HAL_UARTEx_RxEventCallback()`
+ *    - With `ASMART_COMM_STREAMING_RX` (default):
+ *      - Callback: `HAL_UART_RxCpltCallback()`, one received byte per interrupt.
+ *      - Each byte is passed through `asmart_comm_receive_bytes()` to the streaming parser
+ *        (`asmart_comm_parser.c`), which checks STX and Length and updates the CRC on the fly.
+ *      - The frame is validated when ETX arrives and its receive slot is handed over
+ *        (`slot_in`); the parser continues in the next of the `RX_FRAME_SLOTS` slots.
+ *      - Frames for other nodes are counted through, not stored; their Length was checked
+ *        against the slot size like any other, and a standard frame must still end with ETX.
+ *      - A frame whose bytes stop for `RX_IDLE_RESYNC_MS` is dropped (a cut-through frame is
+ *        ended towards its target) and the parser waits for the next STX or SOH.
+ *      - Bytes arriving while all slots are pending are dropped and counted in `overruns`.
+ *    - On a Linux host (`ASMART_COMM_HOST`) there are no UART callbacks: the epoll loop in
+ *      `Host/Linux/Src/asmart_comm_host.c` reads each port and calls `asmart_comm_receive_bytes()`.
+ *    - Without streaming:
+ *      - Callback: `HAL_UARTEx_RxEventCallback()`
  *      - Triggered when data is received until an idle event occurs.
- *      - Sets the `message_ready` flag in the receive handler.
+ *      - Hands over the single receive slot.
  *      - Re-initiates UART reception for the next message.
  *
  * 8. Communication Handler Loop
  *    ------------------------------
  *    - Function: `asmart_comm_handler()`
- *      - Should be called periodically in the main loop.
- *      - Checks if a message is ready to be processed:
- *        - If yes, calls `process_received_message()`.
+ *      - Called from the main loop when a frame has arrived, after sending, and when its last
+ *        return value has run out.
+ *      - Calls `process_received_message()` for every pending receive slot, oldest first, and
+ *        frees the slot (`slot_out`).
  *      - Calls `check_command_timeouts()` to handle any command timeouts.
+ *      - Returns the time until the next deadline from `next_deadline()`: the earliest command
+ *        timeout (which is also when it is retransmitted), a channel probe or a credit resync;
+ *        0 while frames or sendable channel frames wait. All times come from `asmart_comm_now()`,
+ *        the clock set with `asmart_comm_set_clock()`.
  *
  * 9. Processing Received Messages
  *    -------------------------------
  *    - Function: `process_received_message()`
- *      - Verifies message framing (STX and ETX) and length.
- *      - Extracts the Sequence Number, Message Type, Command Type, and Payload.
- *      - Verifies the CRC16 checksum.
+ *      - With streaming, the slot holds a frame the parser has already checked (framing, Length
+ *        and CRC) and its decoded header; nothing is parsed again.
+ *      - Without streaming, runs the received block through the same parser, which rebuilds
+ *        each frame in place and checks it the same way.
+ *      - Frames whose Destination is neither this node, one of its groups nor broadcast are
+ *        skipped by the parser's header callback, before any CRC work.
+ *      - `dispatch_message()` then handles the validated frame: the Sequence Number, Message
+ *        Type and Command Type come from the decoded header, and the payload is passed in place,
+ *        not NUL-terminated.
  *      - Depending on the Message Type:
  *        - **MSG_TYPE_COMMAND**:
  *          - Calls the application's response callback with the message details.
@@ -101,7 +136,7 @@
  *          - Calls the application's response callback with the message details.
  *          - If the Sequence Number is non-zero, relates to a specific command.
  *          - Removes the command from the mapping table if applicable.
- *      - Resets the receive handler for the next message.
+ *      - `asmart_comm_handler()` frees the slot afterwards (`slot_out`).
  *
  * 10. Handling Responses and Messages in Application
  *     ------------------------------------------------
@@ -131,7 +166,13 @@
  *     - Function: `check_command_timeouts()`
  *       - Iterates over the mapping table.
  *       - Compares the current time with the timestamp of each command.
- *       - If the time difference exceeds `COMMAND_TIMEOUT_MS`:
+ *       - The timeout of each command is the link's adaptive RTO (`asmart_comm_rtt.c`), fed from
+ *         the round-trip time of answered commands, or a per-command-type override.
+ *       - If the time difference exceeds the timeout and retries are left:
+ *         - Retransmits the stored frame with the same sequence number and doubles the timeout,
+ *           up to `RTO_MAX_MS` unless it was set for the command type.
+ *         - The link's RTO backs off once per call, however many commands expired in it.
+ *       - If the time difference exceeds the timeout of the last attempt:
  *         - Calls the response callback with `MSG_TYPE_ERROR`, passing the command type and sequence number.
  *         - Passes a NULL payload and zero length to indicate a timeout.
  *         - Removes the command from the mapping table.
@@ -154,6 +195,193 @@
  *     - The sequence number is included in messages to match responses to commands.
  *     - Applications can send errors in response to commands or as standalone error notifications.
  *
+ * 15. RS485 Multi-drop Addressing
+ *     ------------------------------
+ *     - Addresses are 7-bit: unicast 0x01..0x6F, groups 0x70..0x7E, broadcast 0x7F.
+ *     - With `ASMART_COMM_ADDRESS_MUTE_MODE` the UART runs 9-bit multiprocessor mode:
+ *       - Each frame is preceded by an address mark word (bit 8 set, destination in bits 0..6).
+ *       - Nodes whose address does not match stay muted and never see the frame.
+ *       - A node in a group stays awake and filters group frames in software.
+ *       - Broadcast is refused on send: no muted node would wake for it.
+ *       - 9-bit words are packed back into bytes in the receive callback.
+ *
+ * 16. Response Replay Cache (`ASMART_COMM_REPLAY_CACHE`)
+ *     -----------------------------------------------------
+ *     - `dispatch_message()` remembers every unicast command before running it, keyed by the
+ *       source, channel, sequence number and type, for `REPLAY_CACHE_MAX_AGE_MS`, the longest
+ *       time the source may retransmit it.
+ *     - `asmart_send_response()` and `asmart_send_error()` keep the encoded frame with the key
+ *       of the command being answered, if it fits `REPLAY_CACHE_FRAME_SIZE`.
+ *     - A command that arrives again with the same key is answered from the cache
+ *       (`asmart_comm_replay.c`), or dropped if no response was kept, without calling the
+ *       application.
+ *
+ * 17. Awaitable Requests
+ *     ----------------------
+ *     - `asmart_comm_request()` sends a command and registers an `aSmart_Request_t` for its
+ *       sequence number.
+ *     - The response, error or timeout completes the request instead of calling the response
+ *       callback: the payload is copied to the request's buffer, `status` is set and the
+ *       optional `on_complete` hook runs.
+ *     - `asmart_comm_pt.h` waits on it from protothreads, `asmart_comm_await.hpp` from
+ *       C++20 coroutines.
+ *
+ * 18. Message Schema
+ *     -----------------
+ *     - Command and notification types, payload layouts and size limits are declared in
+ *       `Schema/asmart_comm.idl`; `Tools/asmart_idl.py` generates `asmart_comm_schema.h/.c`.
+ *     - The generated code encodes into `asmart_comm_tx_payload()`, decodes received payloads
+ *       and dispatches them from a table to `asmart_on_<name>_<kind>()` handlers.
+ *
+ * 19. Compact Header
+ *     -----------------
+ *     - Layout: [SOH][Length (varint)][Destination][Source][Type/Flags][Sequence Number][Command Type][Payload][CRC]
+ *       - Length covers Destination up to the end of the Payload, one byte below 128.
+ *       - The Sequence Number is only present when flagged (not for notifications), there is no ETX.
+ *     - `asmart_comm_negotiate()` sends the control command `CONTROL_COMMAND_NEGOTIATE` with this
+ *       node's capabilities; both nodes record the common ones per address (`compact_peers`).
+ *     - The parser always accepts both layouts and decodes either into `aSmart_FrameHeader_t`.
+ *     - Group and broadcast frames keep the standard header.
+ *     - Control commands (0xF0..0xFF) and their answers or timeouts never reach the application.
+ *
+ * 20. Telemetry (`ASMART_COMM_TELEMETRY`)
+ *     ---------------------------------------
+ *     - `asmart_comm_send_telemetry()` sends a numbered sample of a registered stream as a keyframe
+ *       or as a bitmap of changed fields relative to the last acknowledged sample (`asmart_comm_telemetry.c`).
+ *     - A registered receiver rebuilds the full snapshot and passes it to the response callback
+ *       as a normal notification of the stream's type.
+ *     - The receiver answers with control notifications: `CONTROL_NOTIFICATION_TELEMETRY_ACK` for
+ *       rebuilt samples, `CONTROL_NOTIFICATION_KEYFRAME_REQUEST` when the baseline is missing.
+ *     - Control notifications (0xF0..0xFF) never reach the application.
+ *
+ * 21. Publish / Subscribe (`ASMART_COMM_PUBSUB`)
+ *     ------------------------------------------------
+ *     - `asmart_comm_subscribe()`/`asmart_comm_unsubscribe()` send the control commands
+ *       `CONTROL_COMMAND_SUBSCRIBE`/`CONTROL_COMMAND_UNSUBSCRIBE` with a topic (notification type),
+ *       a minimum interval and a decimation factor.
+ *     - The publisher keeps the subscriptions (`asmart_comm_pubsub.c`). For types marked with
+ *       `asmart_comm_publish_topic()`, `asmart_comm_send_notification_to()` checks the topic bitset and the
+ *       subscription's limits before the frame is assembled; an unwanted notification is never sent.
+ *
+ * 22. Logical Channels (`ASMART_COMM_CHANNELS`)
+ *     ----------------------------------------------
+ *     - The channel number travels in bits 4..5 of the Message Type byte; channel 0 is the default
+ *       channel used by every other API and is sent immediately, as before.
+ *     - `asmart_comm_channel_send_command()`/`asmart_comm_channel_send_notification()` assemble the
+ *       frame with the channel's own sequence number and queue it (`asmart_comm_channel.c`).
+ *     - `asmart_comm_handler()` sends at most one queued frame per call, taking the channels in
+ *       turn and skipping those without credit, so channel 0 waits for one frame at most.
+ *     - The receiver grants credit with `CONTROL_NOTIFICATION_CHANNEL_CREDIT`; a sender blocked for
+ *       `CHANNEL_PROBE_MS` asks again with `CONTROL_NOTIFICATION_CHANNEL_PROBE`.
+ *     - Commands in a channel queue do not time out before they are sent; responses and errors
+ *       go out at once on the command's channel.
+ *
+ * 23. Receiver Credits (`ASMART_COMM_RX_CREDITS`)
+ *     ------------------------------------------------
+ *     - Negotiated with `CAPABILITY_RX_CREDITS`; each node counts, modulo 4, the frames it has
+ *       sent to the other and the frames from it that it has dispatched (slot freed).
+ *     - The dispatched count rides in bits 6..7 of the Message Type byte of every frame to the
+ *       node; `transmit_frame()` stamps it and recomputes the CRC. When nothing goes back,
+ *       `CONTROL_NOTIFICATION_CREDIT` carries it alone.
+ *     - While `RX_CREDIT_WINDOW` frames are unacknowledged, `transmit_frame()` does not wait: it
+ *       holds the frame back (`TX_HOLD_FRAMES` over all nodes) and `asmart_comm_handler()`
+ *       sends it once the credit has arrived through the receive interrupt, each node's frames in
+ *       order. A frame that finds the hold full is dropped and recovered like one lost on the line.
+ *       Queued channel frames stay in their queue instead.
+ *     - After `CREDIT_RESYNC_MS` without credit the sender sends its count, the receiver takes
+ *       everything before as consumed and answers; without an answer the sender goes ahead
+ *       another `CREDIT_RESYNC_MS` later. Both are deadlines of `asmart_comm_handler()`.
+ *     - Group and broadcast frames, negotiation and credit notifications are not counted.
+ *
+ * 24. Bridging (`ASMART_COMM_BRIDGE`)
+ *     ---------------------------------
+ *     - Routes (`asmart_comm_route_to_port()`, `asmart_comm_route_to_sink()`) are looked up by
+ *       `filter_frame_header()` as soon as the header is in (`asmart_comm_bridge.c`).
+ *     - Cut-through: the parser reports the header and then each byte (`HEADER_FORWARD`), and
+ *       `relay_bytes()` passes them to the host sink, or queues them in the target port's ring
+ *       (`BRIDGE_RELAY_SIZE`) from the receive interrupt; `drain_relay()` hands the ring to the
+ *       UART, which sends it in the background (`HAL_UART_TxCpltCallback()`). No slot, no CRC,
+ *       no re-encoding; the final receiver checks the CRC. A frame that overflows the ring is cut
+ *       short (`truncated`) and dropped by its receiver.
+ *     - The target port is claimed for the frame (`port_owner`). If it is busy, the frame is
+ *       stored instead. A route to a slower port than its source, or to a transport, always
+ *       stores.
+ *     - Local frames for a port that is cutting a frame through are held back (`TX_HOLD_FRAMES`)
+ *       and sent by `asmart_comm_handler()` after it; a frame that has not finished
+ *       `BRIDGE_CUT_THROUGH_TIMEOUT_MS` after the first one was held is cut off. Both are deadlines
+ *       of `asmart_comm_handler()`, nothing waits in the send path.
+ *     - Store-and-forward: the frame is stored and checked like any other and
+ *       `asmart_comm_handler()` sends it unchanged from its slot, before dispatching it locally
+ *       if it was a group or broadcast frame.
+ *
+ * 25. Frame Capture (`ASMART_COMM_CAPTURE`)
+ *     ---------------------------------------
+ *     - The hook set by `asmart_comm_set_capture()` sees each received frame in
+ *       `process_received_message()`, before dispatch, and each sent frame in `write_frame()`,
+ *       as it goes to the UART with its credit stamped.
+ *     - `asmart_comm_replay_frame()` runs a recorded frame through a parser of its own and hands
+ *       it to `process_received_message()`, so replayed traffic takes the path of received traffic.
+ *
+ * 26. Footprint (`asmart_comm_config.h`, `ASMART_COMM_HALF_DUPLEX`)
+ *     ----------------------------------------------------------------
+ *     - `ASMART_COMM_PROFILE` sizes the buffers, tables and queues of a handler; the sizing checks
+ *       in `asmart_comm_handler.h` stop a build whose limits do not fit its buffers.
+ *     - Half-duplex: `txd_buffer` points at the single receive slot. `claim_transmit_buffer()`
+ *       stops reception into it before a frame is assembled, `release_transmit_buffer()` resumes
+ *       it once the frame is sent or queued; the payload of the frame being dispatched may be
+ *       sent back from where it is, the assembly moves it before writing the header.
+ *     - `export_footprint()` emits the sizes as absolute symbols (`asmart_comm_ram_*`) for the
+ *       map file, with GNU inline assembly (GCC, clang, ARM Compiler 6) or, on ARM Compiler 5,
+ *       embedded assembly; other compilers get no symbols. `ASMART_COMM_RAM_BUDGET` turns the
+ *       handler size into a build error on any compiler.
+ *
+ * 27. Secured Links (`ASMART_COMM_SECURE`)
+ *     --------------------------------------
+ *     - `asmart_comm_set_link_key()` gives a node a key; unicast frames to and from it are
+ *       sealed with AES-CCM (`asmart_comm_secure.c`): the payload is encrypted in place in the
+ *       transmit buffer, the counter and tag follow it and count in the Length.
+ *     - `assemble_message()` seals once the header is written and before the CRC, so stored
+ *       copies (retransmission, replay cache, channel queue) hold the sealed frame and are sent
+ *       again unchanged. The header is authenticated without its credit bits, which
+ *       `transmit_frame()` stamps on every transmission.
+ *     - `dispatch_message()` opens a frame from a node with a key before anything else: frames
+ *       that do not authenticate are dropped (`auth_failures`), counters seen before as well
+ *       (`replays`); a replayed command is still answered from the replay cache.
+ *
+ * 28. Bulk Transfer (`ASMART_COMM_BULK`)
+ *     ------------------------------------
+ *     - `asmart_comm_bulk_send()` sends `CONTROL_COMMAND_BULK_OPEN` with the size, CRC-32 and the
+ *       largest block its frames carry; the receiver registered with `asmart_comm_bulk_receive()`
+ *       answers with the block size it takes and the first limit of its page buffers.
+ *     - `service_bulk()` runs from `asmart_comm_handler()` and sends up to `BULK_BURST` blocks
+ *       per call as notifications, read by the source straight into the transmit buffer, as
+ *       far as the limit reaches; `next_deadline()` returns 0 while blocks are ready.
+ *     - The receiver answers blocks with `CONTROL_NOTIFICATION_BULK_ACK` when
+ *       `asmart_bulk_rx_block()` says so; the sender queues the gaps it reports and probes
+ *       with `BULK_PROBE_BLOCK`, a block number without data, when nothing is confirmed for a
+ *       while, at doubling intervals.
+ *     - Once every block is confirmed the sender sends `CONTROL_COMMAND_BULK_FINISH`, the
+ *       response carries the receiver's verdict on the CRC-32. A timeout of the open or finish
+ *       command, too many probes, a source or sink failure end the transfer with its status.
+ *
+ * 29. RS485 Turnaround (`asmart_comm_set_rs485()`)
+ *     ---------------------------------------------
+ *     - `asmart_rs485_timing()` derives the DE assertion and deassertion times and the response
+ *       gap from the baud rate and the transceiver; the UART switches DE on its own.
+ *     - While a gap is set, `asmart_comm_receive_bytes()` stamps the last byte in µs. A frame
+ *       sent before the gap has passed is held, as in section 23, and `next_deadline()` returns
+ *       the rest of the gap rounded up to whole milliseconds; the send call does not wait.
+ *     - The DE times are written with the UART disabled: reception is aborted, a frame half
+ *       received is dropped and reception starts again, so a handler can be retuned while running.
+ *
+ * 30. Frame Transports (`asmart_comm_init_transport()`)
+ *     --------------------------------------------------
+ *     - A handler without a UART hands every frame it sends to its `FrameWriter`, whole and
+ *       with its destination, e.g. the CAN-FD link of `asmart_comm_can.c`, which segments it,
+ *       or the SPI link of `asmart_comm_spi.c`, which streams it through fixed-size slots.
+ *     - The transport feeds what it receives to `asmart_comm_receive_bytes()`, as a receive
+ *       interrupt would. Routes to a transport store and check frames before forwarding them.
+ *
  ***********************************************************************************************/
 
 
@@ -162,7 +390,8 @@
 /**
  * @brief Assembles and prepares a message for transmission.
  * @param comm_handler Pointer to the communication handler structure.
- * @param msg_type Type of the message (Command, Response, Notification, Error).
+ * @param destination Destination address.
+ * @param msg_type Message Type byte: type of the message (Command, Response, Notification, Error) and channel, see FRAME_TYPE_BYTE().
  * @param seq_num Sequence number of the message.
  * @param cmd_type Command or notification type.
  * @param payload Pointer to the payload data.
@@ -175,232 +404,2911 @@ typedef struct{
 	uint8_t* buffer;
 	uint16_t length;
 	uint16_t index;
-	uint16_t msg_length;
+	uint8_t destination;
+	uint8_t source;
 	uint16_t seq_num;
 	 uint8_t msg_type;
 	uint8_t cmd_type;
-	uint16_t received_crc;
-	uint16_t calculated_crc;
+	uint8_t channel;
 }aMessage_Struct_t;
 
 
  
- aSmart_Comm_Handler_t* ptr_handler;
+/* Millisecond clock of all handlers */
+static ClockSource clock_source = HAL_GetTick;
+
+/**
+ * @brief Sets a handler to its initial state, without touching its port or transport.
+ * @param comm_handler Pointer to the communication handler structure.
+ * @param response_callback Function pointer to the response callback.
+ * @retval None
+ */
+static void reset_handler(aSmart_Comm_Handler_t* comm_handler, ResponseCallback response_callback);
+
+#if !ASMART_COMM_HOST
+/* Handlers by UART, for the HAL callbacks */
+static aSmart_Comm_Handler_t* port_handlers[ASMART_COMM_PORTS];
  
-static void assemble_message(aSmart_Comm_Handler_t* comm_handler, uint8_t msg_type, uint16_t seq_num, uint8_t cmd_type, uint8_t* payload, uint16_t payload_length);
+/**
+ * @brief Returns the handler receiving on a UART.
+ * @param huart UART handle passed to a HAL callback.
+ * @retval Pointer to the handler, NULL if the UART is not a port.
+ */
+static aSmart_Comm_Handler_t* find_port_handler(UART_HandleTypeDef* huart);
+#endif
+
+static void assemble_message(aSmart_Comm_Handler_t* comm_handler, uint8_t destination, uint8_t msg_type, uint16_t seq_num, uint8_t cmd_type, uint8_t* payload, uint16_t payload_length);
+
+/**
+ * @brief Sends a command with the given Sequence Number, registering it for its response and retransmission.
+ * @param comm_handler Pointer to the communication handler structure.
+ * @param destination Destination address.
+ * @param seq_num Sequence Number of the command.
+ * @param cmd_type Type of the command.
+ * @param payload Pointer to the payload data.
+ * @param payload_length Length of the payload data.
+ * @retval 1 if the frame was sent, 0 if it could not be assembled (nothing waits for its response then).
+ */
+static uint8_t send_command(aSmart_Comm_Handler_t* comm_handler, uint8_t destination, uint16_t seq_num, uint8_t cmd_type, uint8_t* payload, uint16_t payload_length);
+
+/**
+ * @brief Assembles a message with the compact header around the payload already at FRAME_HEADER_SIZE; parameters as assemble_message().
+ * @retval None
+ */
+static void assemble_compact_message(aSmart_Comm_Handler_t* comm_handler, uint8_t destination, uint8_t msg_type, uint16_t seq_num, uint8_t cmd_type, uint16_t payload_length, SecureLink_t* link);
+
+/**
+ * @brief Checks whether a node agreed to receive compact headers.
+ * @param comm_handler Pointer to the communication handler structure.
+ * @param address Destination address.
+ * @retval 1 if frames to the address use the compact header, 0 otherwise.
+ */
+static uint8_t is_compact_peer(aSmart_Comm_Handler_t* comm_handler, uint8_t address);
+
+/**
+ * @brief Records the capabilities agreed with a node.
+ * @param comm_handler Pointer to the communication handler structure.
+ * @param address Unicast address of the node.
+ * @param capabilities Common capability bits.
+ * @retval None
+ */
+static void set_peer_capabilities(aSmart_Comm_Handler_t* comm_handler, uint8_t address, uint8_t capabilities);
+
+/**
+ * @brief Answers a library control command.
+ * @param comm_handler Pointer to the communication handler structure.
+ * @param source Address of the sender.
+ * @param seq_num Sequence number of the command.
+ * @param cmd_type Control command type.
+ * @param payload Pointer to the payload data.
+ * @param length Length of the payload data.
+ * @retval None
+ */
+static void handle_control_command(aSmart_Comm_Handler_t* comm_handler, uint8_t source, uint16_t seq_num, uint8_t cmd_type, uint8_t* payload, uint16_t length);
+
+/**
+ * @brief Applies the response to a library control command.
+ * @param comm_handler Pointer to the communication handler structure.
+ * @param source Address of the responding node.
+ * @param cmd_type Control command type.
+ * @param payload Pointer to the payload data.
+ * @param length Length of the payload data.
+ * @retval None
+ */
+static void handle_control_response(aSmart_Comm_Handler_t* comm_handler, uint8_t source, uint8_t cmd_type, uint8_t* payload, uint16_t length);
+
+/**
+ * @brief Handles a library control notification.
+ * @param comm_handler Pointer to the communication handler structure.
+ * @param source Address of the sending node.
+ * @param notification_type Control notification type.
+ * @param payload Pointer to the payload data.
+ * @param length Length of the payload data.
+ * @retval None
+ */
+static void handle_control_notification(aSmart_Comm_Handler_t* comm_handler, uint8_t source, uint8_t notification_type, uint8_t* payload, uint16_t length);
+
+#if ASMART_COMM_TELEMETRY
+/**
+ * @brief Rebuilds a sample of a registered telemetry stream and passes it to the response callback.
+ * @param comm_handler Pointer to the communication handler structure.
+ * @param source Address of the sending node.
+ * @param destination Destination address of the frame.
+ * @param notification_type Notification type.
+ * @param payload Pointer to the payload data.
+ * @param length Length of the payload data.
+ * @retval 1 if the notification belongs to a telemetry stream, 0 otherwise.
+ */
+static uint8_t receive_telemetry(aSmart_Comm_Handler_t* comm_handler, uint8_t source, uint8_t destination, uint8_t notification_type, uint8_t* payload, uint16_t length);
+#endif
+
+/**
+ * @brief Takes the transmit buffer before a frame is assembled; with ASMART_COMM_HALF_DUPLEX
+ *        reception into the shared buffer stops and a frame waiting in it is dropped.
+ * @param comm_handler Pointer to the communication handler structure.
+ * @retval None
+ */
+static void claim_transmit_buffer(aSmart_Comm_Handler_t* comm_handler);
+
+/**
+ * @brief Gives the transmit buffer back once its frame is sent or copied.
+ * @param comm_handler Pointer to the communication handler structure.
+ * @retval None
+ */
+static void release_transmit_buffer(aSmart_Comm_Handler_t* comm_handler);
+
+/**
+ * @brief Transmits the assembled message in the transmit buffer.
+ * @param comm_handler Pointer to the communication handler structure.
+ * @retval None
+ */
+static void transmit_message(aSmart_Comm_Handler_t* comm_handler);
+
+/**
+ * @brief Transmits an encoded frame, stamping the receive credit for a credit peer and holding it back while the peer has no credit.
+ * @param comm_handler Pointer to the communication handler structure.
+ * @param frame Pointer to the frame, STX or SOH at index 0.
+ * @param frame_length Total frame length.
+ * @retval None
+ */
+static void transmit_frame(aSmart_Comm_Handler_t* comm_handler, uint8_t* frame, uint16_t frame_length);
+
+/**
+ * @brief Returns how much of the RS485 response gap is left since the last byte received.
+ * @param comm_handler Pointer to the communication handler structure.
+ * @retval Time left (µs), 0 once the gap has passed or without a gap.
+ */
+static uint32_t response_gap_left(aSmart_Comm_Handler_t* comm_handler);
+
+/**
+ * @brief Returns a free-running time in µs, for gaps shorter than a tick.
+ * @note The HAL tick plus the SysTick count within it on the MCU, the monotonic clock on the host.
+ * @retval Time (µs), wraps around.
+ */
+static uint32_t bus_time_us(void);
+
+/**
+ * @brief Writes an encoded frame to the handler's UART as it is, or holds it back while a frame is cut through the port
+ *        or the RS485 response gap runs.
+ * @param comm_handler Pointer to the communication handler structure.
+ * @param frame Pointer to the frame, STX or SOH at index 0.
+ * @param frame_length Total frame length.
+ * @retval None
+ */
+static void write_frame(aSmart_Comm_Handler_t* comm_handler, uint8_t* frame, uint16_t frame_length);
+
+/**
+ * @brief Writes an encoded frame to the handler's UART or transport; the port is the caller's.
+ * @param comm_handler Pointer to the communication handler structure.
+ * @param frame Pointer to the frame, STX or SOH at index 0.
+ * @param frame_length Total frame length.
+ * @retval None
+ */
+static void write_port(aSmart_Comm_Handler_t* comm_handler, uint8_t* frame, uint16_t frame_length);
+
+/**
+ * @brief Tells whether frames to a node are held back, so a new one has to queue behind them.
+ * @param comm_handler Pointer to the communication handler structure.
+ * @param address Address of the node.
+ * @param counted 1 for a frame that takes credit, which queues behind every held frame; 0 for
+ *                one that only queues behind frames waiting for the port.
+ * @retval 1 if it has to queue, 0 otherwise.
+ */
+static uint8_t holds_frames_for(aSmart_Comm_Handler_t* comm_handler, uint8_t address, uint8_t counted);
+
+/**
+ * @brief Holds a frame back until its node has credit and its port is free; with TX_HOLD_FRAMES taken, it is dropped.
+ * @param comm_handler Pointer to the communication handler structure.
+ * @param destination Address of the node.
+ * @param counted 1 if the frame waits for credit and is stamped when sent, 0 if it is ready for the port.
+ * @param frame Pointer to the frame, STX or SOH at index 0.
+ * @param frame_length Total frame length.
+ * @retval None
+ */
+static void hold_frame(aSmart_Comm_Handler_t* comm_handler, uint8_t destination, uint8_t counted, uint8_t* frame, uint16_t frame_length);
+
+/**
+ * @brief Sends the held frames that can go out now, each node's frames in order.
+ * @param comm_handler Pointer to the communication handler structure.
+ * @retval None
+ */
+static void service_held_frames(aSmart_Comm_Handler_t* comm_handler);
+
+#if ASMART_COMM_BRIDGE
+/**
+ * @brief Takes a port for sending if no one else has it.
+ * @param port Pointer to the handler of the port.
+ * @param owner PORT_SENDING or PORT_FORWARDING.
+ * @retval 1 if taken, 0 if the port is busy.
+ */
+static uint8_t claim_port(aSmart_Comm_Handler_t* port, uint8_t owner);
+
+/**
+ * @brief Takes the own port for sending without waiting; a frame cut through it that has not
+ *        finished BRIDGE_CUT_THROUGH_TIMEOUT_MS after the first try is cut off.
+ * @param comm_handler Pointer to the communication handler structure.
+ * @retval 1 if taken, 0 if the port is busy.
+ */
+static uint8_t take_port(aSmart_Comm_Handler_t* comm_handler);
+
+/**
+ * @brief Relays bytes of a frame being cut through, from the receive interrupt.
+ * @param comm_handler Pointer to the receiving handler.
+ * @param data Pointer to the bytes.
+ * @param length Number of bytes.
+ * @param end 1 with the last byte of the frame.
+ * @retval None
+ */
+static void relay_bytes(aSmart_Comm_Handler_t* comm_handler, const uint8_t* data, uint16_t length, uint8_t end);
+
+/**
+ * @brief Hands the queued cut-through bytes of a port to its UART, and frees the port after the last one.
+ * @note Runs from the receive interrupt of the source port and the transmit interrupt of this
+ *       one; the UART sends in the background. The host port queues the bytes at once.
+ * @param port Pointer to the handler of the port.
+ * @retval None
+ */
+static void drain_relay(aSmart_Comm_Handler_t* port);
+
+/**
+ * @brief Drops the rest of a stalled frame being cut through a port and gives the port to the caller.
+ * @param port Pointer to the handler of the port.
+ * @retval None
+ */
+static void cut_off_relay(aSmart_Comm_Handler_t* port);
+
+/**
+ * @brief Returns the line speed of a handler's port.
+ * @param comm_handler Pointer to the communication handler structure.
+ * @retval Baud rate, 0 if unknown, e.g. a transport or a host pty.
+ */
+static uint32_t port_baud_rate(aSmart_Comm_Handler_t* comm_handler);
+
+/**
+ * @brief Forwards a stored frame along its route.
+ * @param route Pointer to the route.
+ * @param frame Pointer to the frame.
+ * @param frame_length Total frame length.
+ * @retval None
+ */
+static void forward_stored_frame(BridgeRoute_t* route, uint8_t* frame, uint16_t frame_length);
+#endif
+
+#if ASMART_COMM_RX_CREDITS
+/**
+ * @brief Returns the credit state of a node.
+ * @param comm_handler Pointer to the communication handler structure.
+ * @param address Address of the node.
+ * @retval Pointer to the entry, NULL if the node has no credit flow control.
+ */
+static CreditPeer_t* find_credit_peer(aSmart_Comm_Handler_t* comm_handler, uint8_t address);
+
+/**
+ * @brief Starts credit flow control with a node, resetting its counters.
+ * @param comm_handler Pointer to the communication handler structure.
+ * @param address Unicast address of the node.
+ * @param active 1 if both nodes count from now on, 0 while waiting for the negotiation response.
+ * @retval Pointer to the entry, NULL if CREDIT_PEERS is exhausted.
+ */
+static CreditPeer_t* open_credit_peer(aSmart_Comm_Handler_t* comm_handler, uint8_t address, uint8_t active);
+
+/**
+ * @brief Ends credit flow control with a node.
+ * @param comm_handler Pointer to the communication handler structure.
+ * @param address Address of the node.
+ * @retval None
+ */
+static void close_credit_peer(aSmart_Comm_Handler_t* comm_handler, uint8_t address);
+
+/**
+ * @brief Tells whether a message occupies a receive slot on the credit account.
+ * @param msg_type Message type without channel and credit bits.
+ * @param cmd_type Command or notification type.
+ * @retval 0 for negotiation and credit updates, 1 otherwise.
+ */
+static uint8_t takes_credit(uint8_t msg_type, uint8_t cmd_type);
+
+/**
+ * @brief Tells whether a node accepts another frame now, without waiting; without credit for
+ *        CREDIT_RESYNC_MS it resynchronises the counters, after another CREDIT_RESYNC_MS it gives up.
+ * @param comm_handler Pointer to the communication handler structure.
+ * @param address Address of the node.
+ * @retval 1 if a frame may be sent, 0 if it has to be held back.
+ */
+static uint8_t has_link_credit(aSmart_Comm_Handler_t* comm_handler, uint8_t address);
+
+/**
+ * @brief Stamps the own receive credit into a frame to a credit peer and counts it if it takes credit.
+ * @param peer Pointer to the node's credit state.
+ * @param frame Pointer to the frame, STX or SOH at index 0.
+ * @param frame_length Total frame length.
+ * @retval None
+ */
+static void stamp_credit(CreditPeer_t* peer, uint8_t* frame, uint16_t frame_length);
+
+/**
+ * @brief Counts a dispatched frame and sends a credit update when the node may run short.
+ * @param comm_handler Pointer to the communication handler structure.
+ * @param peer Pointer to the sending node's credit state.
+ * @retval None
+ */
+static void consume_credit(aSmart_Comm_Handler_t* comm_handler, CreditPeer_t* peer);
+
+/**
+ * @brief Sends a credit notification, built outside the transmit buffer.
+ * @param comm_handler Pointer to the communication handler structure.
+ * @param peer Pointer to the node's credit state.
+ * @param payload Pointer to the payload, NULL for a plain update.
+ * @param length Length of the payload, 0 or 1.
+ * @retval None
+ */
+static void send_credit(aSmart_Comm_Handler_t* comm_handler, CreditPeer_t* peer, uint8_t* payload, uint16_t length);
+#endif
+
+#if ASMART_COMM_REPLAY_CACHE
+/**
+ * @brief Caches the response in the transmit buffer if it answers the last received command.
+ * @param comm_handler Pointer to the communication handler structure.
+ * @param sequence_number Sequence number the response refers to.
+ * @retval None
+ */
+static void cache_reply(aSmart_Comm_Handler_t* comm_handler, uint16_t sequence_number);
+#endif
+
+/**
+ * @brief (Re)starts UART reception into the receive buffer.
+ * @param comm_handler Pointer to the communication handler structure.
+ * @retval None
+ */
+static void start_reception(aSmart_Comm_Handler_t* comm_handler);
+
+#if defined(__CC_ARM) || defined(__GNUC__)
+/**
+ * @brief Defines the RAM taken by a handler of this build as absolute symbols (asmart_comm_ram_*),
+ *        listed in the map file and read by Tools/asmart_footprint.py.
+ * @note Never called, the symbols come from the assembler directives.
+ * @retval None
+ */
+static void export_footprint(void) __attribute__((used));
+#endif
+
+#ifdef ASMART_COMM_RAM_BUDGET
+/* A negative array size, so ARM Compiler 5 without _Static_assert stops as well */
+typedef char asmart_comm_ram_budget_exceeded[(sizeof(aSmart_Comm_Handler_t) <= ASMART_COMM_RAM_BUDGET) ? 1 : -1];
+#endif
+
+/**
+ * @brief Checks whether a destination address selects this node.
+ * @param comm_handler Pointer to the communication handler structure.
+ * @param destination Destination address of a received frame.
+ * @retval 1 if the frame is for this node, 0 otherwise.
+ */
+static uint8_t is_addressed_to_node(aSmart_Comm_Handler_t* comm_handler, uint8_t destination);
+
+/**
+ * @brief Checks whether an address is a group or the broadcast address.
+ * @param address Address to check.
+ * @retval 1 for group and broadcast addresses, 0 for unicast.
+ */
+static uint8_t is_multicast_address(uint8_t address);
+
+#if ASMART_COMM_ADDRESS_MUTE_MODE
+/**
+ * @brief Switches the UART to 9-bit address-mark mode and loads the node address for hardware matching.
+ * @param comm_handler Pointer to the communication handler structure.
+ * @retval None
+ */
+static void configure_address_mute_mode(aSmart_Comm_Handler_t* comm_handler);
+#endif
+
+#if ASMART_COMM_ADDRESS_MUTE_MODE
+/**
+ * @brief Writes one word to a UART, waiting for room in the transmit register.
+ * @param uart UART handle.
+ * @param word Data bits 0..7, address mark in bit 8 with 9-bit words.
+ * @retval None
+ */
+static void write_word(UART_HandleTypeDef* uart, uint16_t word);
+#endif
+
+/**
+ * @brief Reads the Destination of an encoded frame of either layout.
+ * @param frame Pointer to the frame.
+ * @retval Destination address.
+ */
+static uint8_t frame_destination(uint8_t* frame);
+
+#if ASMART_COMM_ADDRESS_MUTE_MODE || ASMART_COMM_RX_CREDITS || ASMART_COMM_SECURE
+/**
+ * @brief Returns the position of the Message Type byte in an encoded frame of either layout.
+ * @param frame Pointer to the frame.
+ * @retval Index of the Message Type byte.
+ */
+static uint16_t frame_type_index(uint8_t* frame);
+#endif
+
+#if ASMART_COMM_SECURE
+/**
+ * @brief Copies the header a secured frame authenticates: Length up to Command Type, credit bits cleared.
+ * @param frame Pointer to the frame, STX or SOH first.
+ * @param payload_offset Position of the payload in the frame.
+ * @param aad Receives the header, SECURE_MAX_AAD bytes.
+ * @retval Header length.
+ */
+static uint16_t frame_aad(uint8_t* frame, uint16_t payload_offset, uint8_t* aad);
+
+/**
+ * @brief Encrypts the payload of a frame whose header is written and appends the counter and tag.
+ * @param comm_handler Pointer to the communication handler structure.
+ * @param link Link of the frame's Destination.
+ * @param frame Pointer to the frame, STX or SOH first.
+ * @param payload_offset Position of the payload in the frame.
+ * @param payload_length Payload length, without the counter and tag.
+ * @retval 1 if sealed, 0 if the link's counters are used up.
+ */
+static uint8_t seal_frame(aSmart_Comm_Handler_t* comm_handler, SecureLink_t* link, uint8_t* frame, uint16_t payload_offset, uint16_t payload_length);
+#endif
+
+#if ASMART_COMM_ADDRESS_MUTE_MODE && !ASMART_COMM_STREAMING_RX
+/**
+ * @brief Packs received 9-bit words into bytes in place and strips the leading address mark.
+ * @param buffer Receive buffer holding 16-bit words.
+ * @param words Number of words received.
+ * @retval Number of frame bytes left in the buffer.
+ */
+static uint16_t unpack_9bit_frame(uint8_t* buffer, uint16_t words);
+#endif
 
 /**
  * @brief Processes a received message.
  * @param comm_handler Pointer to the communication handler structure.
+ * @param slot Receive slot holding the frame, or the received block.
+ * @retval None
+ */
+static void process_received_message(aSmart_Comm_Handler_t* comm_handler, RxFrameSlot_t* slot);
+
+/**
+ * @brief Extracts the fields of a validated frame and hands it to the mapping table and callback.
+ * @param comm_handler Pointer to the communication handler structure.
+ * @param frame Pointer to the frame, STX or SOH at index 0.
+ * @param frame_length Total frame length.
+ * @param header Header decoded by the parser.
  * @retval None
  */
-static void process_received_message(aSmart_Comm_Handler_t* comm_handler);
+static void dispatch_message(aSmart_Comm_Handler_t* comm_handler, uint8_t* frame, uint16_t frame_length, const aSmart_FrameHeader_t* header);
+
+/**
+ * @brief Parser header callback, skips frames addressed to other nodes unless a route forwards them.
+ * @param context Pointer to the communication handler structure.
+ * @param header Pointer to the frame header.
+ * @retval HEADER_ACCEPT, HEADER_SKIP or HEADER_FORWARD.
+ */
+static header_action_t filter_frame_header(void* context, const aSmart_FrameHeader_t* header);
 
 /**
  * @brief Adds a command to the mapping table for tracking.
  * @param comm_handler Pointer to the communication handler structure.
+ * @param channel Logical channel of the command.
  * @param seq_num Sequence number of the command.
  * @param cmd_type Type of the command.
  * @retval None
  */
-static void add_command_to_mapping_table(aSmart_Comm_Handler_t* comm_handler, uint16_t seq_num, uint8_t cmd_type);
+static void add_command_to_mapping_table(aSmart_Comm_Handler_t* comm_handler, uint8_t channel, uint16_t seq_num, uint8_t cmd_type);
 
 /**
- * @brief Finds a command in the mapping table using the sequence number.
+ * @brief Finds a command in the mapping table using the channel and sequence number.
  * @param comm_handler Pointer to the communication handler structure.
+ * @param channel Logical channel of the command.
  * @param seq_num Sequence number to search for.
  * @retval Pointer to the command entry if found, NULL otherwise.
  */
-static CommandEntry_t* find_command_in_mapping_table(aSmart_Comm_Handler_t* comm_handler, uint16_t seq_num);
+static CommandEntry_t* find_command_in_mapping_table(aSmart_Comm_Handler_t* comm_handler, uint8_t channel, uint16_t seq_num);
 
 /**
  * @brief Removes a command from the mapping table.
  * @param comm_handler Pointer to the communication handler structure.
+ * @param channel Logical channel of the command.
  * @param seq_num Sequence number of the command to remove.
  * @retval None
  */
-static void remove_command_from_mapping_table(aSmart_Comm_Handler_t* comm_handler, uint16_t seq_num);
+static void remove_command_from_mapping_table(aSmart_Comm_Handler_t* comm_handler, uint8_t channel, uint16_t seq_num);
 
 /**
- * @brief Checks for command timeouts and handles them.
+ * @brief Completes the request waiting for a sequence number, if any.
+ * @param comm_handler Pointer to the communication handler structure.
+ * @param seq_num Sequence number of the answered or expired command.
+ * @param status REQUEST_DONE, REQUEST_FAILED or REQUEST_TIMEOUT.
+ * @param error_code Error code for REQUEST_FAILED.
+ * @param payload Pointer to the response or error payload (NULL on timeout).
+ * @param length Length of the payload.
+ * @retval 1 if a request was completed, 0 if the response callback should handle it.
+ */
+static uint8_t complete_request(aSmart_Comm_Handler_t* comm_handler, uint16_t seq_num, uint8_t status, uint8_t error_code, uint8_t* payload, uint16_t length);
+
+/**
+ * @brief Copies the assembled command into a free retransmission slot.
  * @param comm_handler Pointer to the communication handler structure.
+ * @param channel Logical channel of the command.
+ * @param seq_num Sequence number of the command.
  * @retval None
  */
-static void check_command_timeouts(aSmart_Comm_Handler_t* comm_handler);
+static void keep_for_retransmission(aSmart_Comm_Handler_t* comm_handler, uint8_t channel, uint16_t seq_num);
+
+/**
+ * @brief Feeds the round-trip time of an answered command into the link's RTT estimator.
+ * @param comm_handler Pointer to the communication handler structure.
+ * @param entry Mapping table entry of the answered command.
+ * @retval None
+ */
+static void sample_round_trip(aSmart_Comm_Handler_t* comm_handler, CommandEntry_t* entry);
+
+/**
+ * @brief Checks for command timeouts and handles them.
+ * @param comm_handler Pointer to the communication handler structure.
+ * @retval None
+ */
+static void check_command_timeouts(aSmart_Comm_Handler_t* comm_handler);
+
+/**
+ * @brief Finds the earliest deadline of a handler: command timeouts, channel probes, credit resyncs, bulk blocks.
+ * @param comm_handler Pointer to the communication handler structure.
+ * @retval Milliseconds until it is due, 0 if work is waiting, ASMART_COMM_NO_DEADLINE if none.
+ */
+static uint32_t next_deadline(aSmart_Comm_Handler_t* comm_handler);
+
+/**
+ * @brief Returns the time left of an interval.
+ * @param since Start of the interval (ms).
+ * @param interval Length of the interval (ms).
+ * @param now Current time (ms).
+ * @retval Milliseconds left, 0 once the interval has passed.
+ */
+static uint32_t time_left(uint32_t since, uint32_t interval, uint32_t now);
+
+#if ASMART_COMM_CHANNELS > 1
+/**
+ * @brief Returns an open logical channel.
+ * @param comm_handler Pointer to the communication handler structure.
+ * @param channel Channel number.
+ * @retval Pointer to the channel, NULL for channel 0, unknown or closed channels.
+ */
+static aSmart_Channel_t* get_channel(aSmart_Comm_Handler_t* comm_handler, uint8_t channel);
+
+/**
+ * @brief Assembles a command or notification on a logical channel and queues it.
+ * @param comm_handler Pointer to the communication handler structure.
+ * @param channel Channel number.
+ * @param msg_type MSG_TYPE_COMMAND or MSG_TYPE_NOTIFICATION.
+ * @param cmd_type Command or notification type.
+ * @param payload Pointer to the payload data.
+ * @param payload_length Length of the payload data.
+ * @retval 1 if queued, 0 otherwise.
+ */
+static uint8_t queue_channel_message(aSmart_Comm_Handler_t* comm_handler, uint8_t channel, uint8_t msg_type, uint8_t cmd_type, uint8_t* payload, uint16_t payload_length);
+
+/**
+ * @brief Sends the next queued channel frame that has credit, one per call, channels in turn.
+ * @param comm_handler Pointer to the communication handler structure.
+ * @retval None
+ */
+static void service_channels(aSmart_Comm_Handler_t* comm_handler);
+
+/**
+ * @brief Passes a message of a logical channel to its callback and grants credit when due.
+ * @param comm_handler Pointer to the communication handler structure.
+ * @param channel Channel number.
+ * @param msg_type Type of the message.
+ * @param cmd_type Command or notification type.
+ * @param seq_num Channel sequence number.
+ * @param payload Pointer to the payload data.
+ * @param length Length of the payload data.
+ * @retval None
+ */
+static void deliver_channel_message(aSmart_Comm_Handler_t* comm_handler, uint8_t channel, uint8_t msg_type, uint8_t cmd_type, uint16_t seq_num, uint8_t* payload, uint16_t length);
+
+/**
+ * @brief Sends the channel's credit limit to its peer.
+ * @param comm_handler Pointer to the communication handler structure.
+ * @param channel Channel number.
+ * @param limit Highest sequence number accepted.
+ * @retval None
+ */
+static void send_channel_credit(aSmart_Comm_Handler_t* comm_handler, uint8_t channel, uint16_t limit);
+#endif
+
+#if ASMART_COMM_BULK
+/**
+ * @brief Returns the data bytes a block frame to or from a node carries.
+ * @param comm_handler Pointer to the communication handler structure.
+ * @param peer Node at the other end of the transfer.
+ * @param buffer_size Frame buffer the block has to fit.
+ * @retval Bytes left for the data after the block header and a secured link's overhead.
+ */
+static uint16_t bulk_max_data(aSmart_Comm_Handler_t* comm_handler, uint8_t peer, uint16_t buffer_size);
+
+/**
+ * @brief Sends the blocks that are due for the transfer being sent, and its finish command.
+ * @param comm_handler Pointer to the communication handler structure.
+ * @retval None
+ */
+static void service_bulk(aSmart_Comm_Handler_t* comm_handler);
+
+/**
+ * @brief Reads a block from the source into the transmit buffer and sends it.
+ * @param comm_handler Pointer to the communication handler structure.
+ * @param tx Pointer to the sender structure.
+ * @param block Block number.
+ * @retval 1 if sent, 0 if the source failed.
+ */
+static uint8_t send_bulk_block(aSmart_Comm_Handler_t* comm_handler, aSmart_BulkTx_t* tx, uint16_t block);
+
+/**
+ * @brief Ends the transfer being sent and reports its status.
+ * @param comm_handler Pointer to the communication handler structure.
+ * @param status bulk_status_t.
+ * @param notify 1 to tell the receiver with CONTROL_NOTIFICATION_BULK_ABORT.
+ * @retval None
+ */
+static void end_bulk_send(aSmart_Comm_Handler_t* comm_handler, uint8_t status, uint8_t notify);
+
+/**
+ * @brief Sends the receiver's acknowledgement to the sending node.
+ * @param comm_handler Pointer to the communication handler structure.
+ * @param rx Pointer to the receiver structure.
+ * @retval None
+ */
+static void send_bulk_ack(aSmart_Comm_Handler_t* comm_handler, aSmart_BulkRx_t* rx);
+
+/**
+ * @brief Answers an open command: starts the receiver, or refuses the transfer.
+ * @param comm_handler Pointer to the communication handler structure.
+ * @param source Address of the sending node.
+ * @param seq_num Sequence number of the command.
+ * @param payload Pointer to the payload data.
+ * @param length Length of the payload data.
+ * @retval None
+ */
+static void open_bulk_receive(aSmart_Comm_Handler_t* comm_handler, uint8_t source, uint16_t seq_num, uint8_t* payload, uint16_t length);
+#endif
+
+/* Function implementations */
+
+#if !ASMART_COMM_HOST
+void asmart_comm_init(aSmart_Comm_Handler_t* comm_handler, ResponseCallback response_callback){
+    asmart_comm_init_port(comm_handler, &COMM_UART, response_callback);
+}
+#endif
+
+void asmart_comm_init_port(aSmart_Comm_Handler_t* comm_handler, UART_HandleTypeDef* huart, ResponseCallback response_callback){
+#if !ASMART_COMM_HOST
+    /* Take the UART's entry, or the first free one */
+    for (uint8_t i = 0; i < ASMART_COMM_PORTS; i++) {
+        if (port_handlers[i] == NULL || port_handlers[i]->uart == huart) {
+            port_handlers[i] = comm_handler;
+            break;
+        }
+    }
+#endif
+    comm_handler->uart = huart;
+    comm_handler->writer = NULL;
+    comm_handler->writer_context = NULL;
+    reset_handler(comm_handler, response_callback);
+
+    /* Hardware dependent configuration */
+#if ASMART_COMM_ADDRESS_MUTE_MODE
+    configure_address_mute_mode(comm_handler);
+#endif
+    start_reception(comm_handler);
+}
+
+void asmart_comm_init_transport(aSmart_Comm_Handler_t* comm_handler, FrameWriter writer, void* context, ResponseCallback response_callback){
+    comm_handler->uart = NULL;
+    comm_handler->writer = writer;
+    comm_handler->writer_context = context;
+    reset_handler(comm_handler, response_callback);
+}
+
+static void reset_handler(aSmart_Comm_Handler_t* comm_handler, ResponseCallback response_callback) {
+    comm_handler->rx_handler.slot_in = 0;
+    comm_handler->rx_handler.slot_out = 0;
+    comm_handler->rx_handler.dropping = 0;
+    comm_handler->rx_handler.overruns = 0;
+    comm_handler->rx_handler.last_byte = 0;
+    comm_handler->rx_handler.last_byte_us = 0;
+    memset(&comm_handler->rs485, 0, sizeof(comm_handler->rs485));
+    comm_handler->rx_handler.rxd_word = 0;
+    comm_handler->sequence_number = 0;
+    comm_handler->mapping_table_count = 0;
+    comm_handler->response_callback = response_callback;
+    comm_handler->own_address = ASMART_COMM_DEFAULT_ADDRESS;
+    comm_handler->group_mask = 0;
+    comm_handler->peer_address = ASMART_COMM_DEFAULT_ADDRESS;
+    comm_handler->reply_address = ASMART_COMM_DEFAULT_ADDRESS;
+    comm_handler->reply_enabled = 1;
+    comm_handler->reply_sequence_number = 0;
+    comm_handler->reply_command_type = 0;
+    comm_handler->reply_channel = 0;
+    memset(comm_handler->compact_peers, 0, sizeof(comm_handler->compact_peers));
+    comm_handler->tx_handler.txd_start = 0;
+#if ASMART_COMM_HALF_DUPLEX
+    comm_handler->tx_handler.txd_buffer = comm_handler->rx_handler.slots[0].buffer;
+    comm_handler->rx_handler.tx_owned = 0;
+    comm_handler->rx_handler.dispatching = 0;
+#endif
+#if ASMART_COMM_REPLAY_CACHE
+    asmart_replay_init(&comm_handler->replay_cache);
+#endif
+    memset(comm_handler->mapping_table, 0, sizeof(comm_handler->mapping_table));
+    memset(comm_handler->retransmit_slots, 0, sizeof(comm_handler->retransmit_slots));
+    asmart_rtt_init(&comm_handler->rtt, COMMAND_TIMEOUT_MS);
+    comm_handler->rto_override_count = 0;
+    comm_handler->pending_requests = NULL;
+#if ASMART_COMM_TELEMETRY
+    comm_handler->telemetry_tx = NULL;
+    comm_handler->telemetry_rx = NULL;
+#endif
+#if ASMART_COMM_PUBSUB
+    asmart_pubsub_init(&comm_handler->pubsub);
+#endif
+#if ASMART_COMM_CHANNELS > 1
+    memset(comm_handler->channels, 0, sizeof(comm_handler->channels));
+    comm_handler->channel_cursor = 0;
+#endif
+#if ASMART_COMM_RX_CREDITS
+    memset(comm_handler->credit_peers, 0, sizeof(comm_handler->credit_peers));
+#endif
+    comm_handler->held_count = 0;
+#if ASMART_COMM_BRIDGE
+    asmart_bridge_init(&comm_handler->bridge);
+    comm_handler->port_owner = PORT_FREE;
+    comm_handler->relay_source = NULL;
+    comm_handler->relay_head = 0;
+    comm_handler->relay_tail = 0;
+    comm_handler->relay_sending = 0;
+    comm_handler->relay_end = 0;
+    comm_handler->relay_overflow = 0;
+    comm_handler->port_waiting = 0;
+    comm_handler->rx_handler.route = NULL;
+    comm_handler->rx_handler.deliver = 1;
+#endif
+#if ASMART_COMM_CAPTURE
+    comm_handler->capture = NULL;
+    comm_handler->capture_context = NULL;
+#endif
+#if ASMART_COMM_SECURE
+    asmart_secure_init(&comm_handler->secure);
+#endif
+#if ASMART_COMM_BULK
+    comm_handler->bulk_tx = NULL;
+    comm_handler->bulk_rx = NULL;
+    comm_handler->bulk_session = 0;
+#endif
+    asmart_parser_init(&comm_handler->rx_handler.parser, comm_handler->rx_handler.slots[0].buffer, RECEIVE_BUFFER_SIZE, filter_frame_header, comm_handler);
+}
+
+void asmart_comm_set_address(aSmart_Comm_Handler_t* comm_handler, uint8_t own_address, uint16_t group_mask){
+    comm_handler->own_address = own_address & 0x7F;
+    comm_handler->group_mask = group_mask;
+
+#if ASMART_COMM_ADDRESS_MUTE_MODE
+    /* Reload the hardware address match register, mute mode follows the group membership */
+    HAL_UART_AbortReceive(comm_handler->uart);
+    configure_address_mute_mode(comm_handler);
+    start_reception(comm_handler);
+#endif
+}
+
+uint8_t asmart_comm_set_rs485(aSmart_Comm_Handler_t* comm_handler, const aSmart_Rs485Timing_t* timing){
+    comm_handler->rs485 = *timing;
+    comm_handler->rx_handler.last_byte_us = bus_time_us();
+    if (comm_handler->uart == NULL) {
+        return 0;
+    }
+#if ASMART_COMM_HOST
+    /* The driver counts whole milliseconds, shorter times are within its own latency */
+    uint32_t sample_ns = 1000000000UL / (timing->baudrate * RS485_SAMPLES_PER_BIT);
+    return asmart_host_set_rs485(comm_handler->uart, (timing->de_assert * sample_ns) / 1000000UL, (timing->de_deassert * sample_ns) / 1000000UL) == 0;
+#else
+    USART_TypeDef* uart = comm_handler->uart->Instance;
+
+    if (!(uart->CR3 & USART_CR3_DEM)) {
+        return 0;
+    }
+#if ASMART_COMM_BRIDGE
+    /* A frame is cut through this port: disabling the UART would break it off */
+    if (comm_handler->port_owner != PORT_FREE) {
+        return 0;
+    }
+#endif
+
+    /* DEAT and DEDT are only written while the UART is disabled: stop reception around it, a frame
+       half received is lost with it and the next one is parsed from its start */
+    HAL_UART_AbortReceive(comm_handler->uart);
+#if ASMART_COMM_BRIDGE
+    if (comm_handler->rx_handler.parser.state == PARSER_STATE_FORWARD) {
+        relay_bytes(comm_handler, NULL, 0, 1);
+    }
+#endif
+    asmart_parser_reset(&comm_handler->rx_handler.parser);
+    __HAL_UART_DISABLE(comm_handler->uart);
+    MODIFY_REG(uart->CR1, USART_CR1_DEAT | USART_CR1_DEDT, ((uint32_t)timing->de_assert << USART_CR1_DEAT_Pos) | ((uint32_t)timing->de_deassert << USART_CR1_DEDT_Pos));
+    __HAL_UART_ENABLE(comm_handler->uart);
+    start_reception(comm_handler);
+    return 1;
+#endif
+}
+
+void asmart_comm_set_peer(aSmart_Comm_Handler_t* comm_handler, uint8_t peer_address){
+    comm_handler->peer_address = peer_address & 0x7F;
+}
+
+void asmart_comm_negotiate(aSmart_Comm_Handler_t* comm_handler, uint8_t destination){
+    uint8_t capabilities = ASMART_COMM_CAPABILITIES;
+
+    if (is_multicast_address(destination)) {
+        return;
+    }
+#if ASMART_COMM_RX_CREDITS
+    /* Counting starts with the offer, the node starts once it has answered */
+    if (open_credit_peer(comm_handler, destination, 0) == NULL) {
+        capabilities &= ~CAPABILITY_RX_CREDITS;
+    }
+#endif
+    asmart_comm_send_command_to(comm_handler, destination, CONTROL_COMMAND_NEGOTIATE, &capabilities, 1);
+}
+
+void asmart_comm_request(aSmart_Comm_Handler_t* comm_handler, aSmart_Request_t* request, uint8_t command_type, uint8_t* payload, uint16_t payload_length, uint8_t* response, uint16_t response_size){
+    /* Issued again while pending: the old command is no longer waited for, and the list stays acyclic */
+    if (request->status == REQUEST_PENDING) {
+        asmart_comm_cancel_request(comm_handler, request);
+    }
+
+    request->command_type = command_type;
+    request->response = response;
+    request->response_size = response_size;
+    request->response_length = 0;
+    request->error_code = 0;
+    request->next = NULL;
+
+    /* A unicast command is needed to get a response */
+    if (is_multicast_address(comm_handler->peer_address) || comm_handler->mapping_table_count >= (sizeof(comm_handler->mapping_table) / sizeof(comm_handler->mapping_table[0]))) {
+        request->status = REQUEST_FAILED;
+        if (request->on_complete) {
+            request->on_complete(request);
+        }
+        return;
+    }
+
+    /* Register with the Sequence Number of the command before sending so no completion can be missed */
+    comm_handler->sequence_number = (comm_handler->sequence_number + 1) % 65536;
+    request->sequence_number = comm_handler->sequence_number;
+    request->status = REQUEST_PENDING;
+    request->next = comm_handler->pending_requests;
+    comm_handler->pending_requests = request;
+
+    if (!send_command(comm_handler, comm_handler->peer_address, request->sequence_number, command_type, payload, payload_length)) {
+        complete_request(comm_handler, request->sequence_number, REQUEST_FAILED, 0, NULL, 0);
+    }
+}
+
+void asmart_comm_cancel_request(aSmart_Comm_Handler_t* comm_handler, aSmart_Request_t* request){
+    aSmart_Request_t** link = &comm_handler->pending_requests;
+
+    while (*link != NULL) {
+        if (*link == request) {
+            *link = request->next;
+            request->next = NULL;
+            request->status = REQUEST_IDLE;
+            return;
+        }
+        link = &(*link)->next;
+    }
+}
+
+void asmart_comm_set_command_timeout(aSmart_Comm_Handler_t* comm_handler, uint8_t command_type, uint32_t timeout_ms){
+    for (uint8_t i = 0; i < comm_handler->rto_override_count; i++) {
+        if (comm_handler->rto_overrides[i].command_type == command_type) {
+            if (timeout_ms == 0) {
+                /* Remove the override, the last entry fills the gap */
+                comm_handler->rto_overrides[i] = comm_handler->rto_overrides[--comm_handler->rto_override_count];
+            }
+            else {
+                comm_handler->rto_overrides[i].timeout_ms = timeout_ms;
+            }
+            return;
+        }
+    }
+    if (timeout_ms != 0 && comm_handler->rto_override_count < RTO_OVERRIDE_ENTRIES) {
+        comm_handler->rto_overrides[comm_handler->rto_override_count].command_type = command_type;
+        comm_handler->rto_overrides[comm_handler->rto_override_count].timeout_ms = timeout_ms;
+        comm_handler->rto_override_count++;
+    }
+}
+
+uint8_t* asmart_comm_tx_payload(aSmart_Comm_Handler_t* comm_handler){
+    claim_transmit_buffer(comm_handler);
+    return &comm_handler->tx_handler.txd_buffer[FRAME_HEADER_SIZE];
+}
+
+#if ASMART_COMM_TELEMETRY
+#if TELEMETRY_MAX_PAYLOAD > ASMART_COMM_MAX_PAYLOAD
+#error "TELEMETRY_MAX_SNAPSHOT does not fit the transmit buffer"
+#endif
+
+void asmart_comm_add_telemetry_tx(aSmart_Comm_Handler_t* comm_handler, aSmart_TelemetryTx_t* tx){
+    tx->next = comm_handler->telemetry_tx;
+    comm_handler->telemetry_tx = tx;
+}
+
+void asmart_comm_add_telemetry_rx(aSmart_Comm_Handler_t* comm_handler, aSmart_TelemetryRx_t* rx){
+    rx->next = comm_handler->telemetry_rx;
+    comm_handler->telemetry_rx = rx;
+}
+
+void asmart_comm_send_telemetry(aSmart_Comm_Handler_t* comm_handler, aSmart_TelemetryTx_t* tx, const uint8_t* snapshot){
+    uint8_t* payload = asmart_comm_tx_payload(comm_handler);
+
+    /* Several receivers cannot share one baseline */
+    if (is_multicast_address(tx->destination)) {
+        asmart_telemetry_request_keyframe(tx);
+    }
+
+    /* Encoded in place, the notification is sent without a payload copy */
+    uint16_t payload_length = asmart_telemetry_encode(tx, snapshot, payload);
+    if (payload_length != 0) {
+        asmart_comm_send_notification_to(comm_handler, tx->destination, tx->notification_type, payload, payload_length);
+    }
+}
+#endif
+
+#if ASMART_COMM_PUBSUB
+void asmart_comm_publish_topic(aSmart_Comm_Handler_t* comm_handler, uint8_t topic){
+    /* Control notifications are never filtered */
+    if (topic < CONTROL_COMMAND_FIRST) {
+        asmart_pubsub_set_filtered(&comm_handler->pubsub, topic, 1);
+    }
+}
+
+void asmart_comm_subscribe(aSmart_Comm_Handler_t* comm_handler, uint8_t publisher, uint8_t topic, uint16_t min_interval_ms, uint8_t decimation){
+    uint8_t payload[4] = {topic, (min_interval_ms >> 8) & 0xFF, min_interval_ms & 0xFF, decimation};
+
+    if (is_multicast_address(publisher)) {
+        return;
+    }
+    asmart_comm_send_command_to(comm_handler, publisher, CONTROL_COMMAND_SUBSCRIBE, payload, sizeof(payload));
+}
+
+void asmart_comm_unsubscribe(aSmart_Comm_Handler_t* comm_handler, uint8_t publisher, uint8_t topic){
+    if (is_multicast_address(publisher)) {
+        return;
+    }
+    asmart_comm_send_command_to(comm_handler, publisher, CONTROL_COMMAND_UNSUBSCRIBE, &topic, 1);
+}
+#endif
+
+void asmart_comm_receive_bytes(aSmart_Comm_Handler_t* comm_handler, const uint8_t* data, uint16_t length){
+    aSmart_RxHandler_t* rx_handler = &comm_handler->rx_handler;
+
+    /* A frame that stopped half way was damaged, the next byte belongs to another one */
+    uint32_t now = asmart_comm_now();
+    if (rx_handler->parser.state != PARSER_STATE_WAIT_STX && now - rx_handler->last_byte >= RX_IDLE_RESYNC_MS) {
+#if ASMART_COMM_BRIDGE
+        /* A frame being cut through ends short and frees its target; the receiver drops it on the CRC */
+        if (rx_handler->parser.state == PARSER_STATE_FORWARD) {
+            relay_bytes(comm_handler, NULL, 0, 1);
+        }
+#endif
+        asmart_parser_reset(&rx_handler->parser);
+    }
+    rx_handler->last_byte = now;
+    if (comm_handler->rs485.response_gap_us != 0) {
+        rx_handler->last_byte_us = bus_time_us();
+    }
+
+    for (uint16_t i = 0; i < length; i++) {
+#if ASMART_COMM_HALF_DUPLEX
+        /* The buffer holds a frame going out; on a half-duplex bus this is mostly its echo */
+        if (rx_handler->tx_owned) {
+            rx_handler->dropping = 1;
+            continue;
+        }
+#endif
+        /* Completed frames stay in their slots until asmart_comm_handler() has dispatched them;
+           a frame being cut through needs none */
+        if ((uint8_t)(rx_handler->slot_in - rx_handler->slot_out) >= RX_FRAME_SLOTS && rx_handler->parser.state != PARSER_STATE_FORWARD) {
+            if (!rx_handler->dropping) {
+                rx_handler->dropping = 1;
+                rx_handler->overruns++;
+            }
+            continue;
+        }
+        if (rx_handler->dropping) {
+            /* A slot is free again, the interrupted frame is lost */
+            rx_handler->dropping = 0;
+            asmart_parser_reset(&rx_handler->parser);
+        }
+
+        parse_result_t result = asmart_parser_feed(&rx_handler->parser, data[i]);
+
+#if ASMART_COMM_BRIDGE
+        if (result == PARSE_FORWARD_START) {
+            /* The header is in, send it on and the rest of the frame byte by byte behind it */
+            relay_bytes(comm_handler, rx_handler->parser.buffer, rx_handler->parser.index, 0);
+            continue;
+        }
+        if (result == PARSE_FORWARD || result == PARSE_FORWARDED) {
+            relay_bytes(comm_handler, &data[i], 1, result == PARSE_FORWARDED);
+            continue;
+        }
+#endif
+        if (result == PARSE_FRAME) {
+            RxFrameSlot_t* slot = &rx_handler->slots[rx_handler->slot_in % RX_FRAME_SLOTS];
+
+            slot->length = rx_handler->parser.frame_length;
+            slot->header = rx_handler->parser.header;
+#if ASMART_COMM_BRIDGE
+            slot->route = rx_handler->route;
+            slot->deliver = rx_handler->deliver;
+#endif
+#if ASMART_COMM_RX_CREDITS
+            /* Credit piggybacked by a negotiated node, applied at once so a waiting sender resumes */
+            CreditPeer_t* peer = find_credit_peer(comm_handler, slot->header.source);
+            if (peer != NULL && peer->active) {
+                peer->acknowledged = slot->header.credit;
+
+                /* A plain credit update has nothing left to dispatch, the slot is reused */
+                if (slot->header.message_type == MSG_TYPE_NOTIFICATION && slot->header.command_type == CONTROL_NOTIFICATION_CREDIT && slot->header.payload_length == 0) {
+                    continue;
+                }
+            }
+#endif
+            rx_handler->slot_in++;
+
+            /* The next frame goes into the following slot */
+            rx_handler->parser.buffer = rx_handler->slots[rx_handler->slot_in % RX_FRAME_SLOTS].buffer;
+        }
+    }
+}
+
+#if ASMART_COMM_CAPTURE
+void asmart_comm_set_capture(aSmart_Comm_Handler_t* comm_handler, CaptureHook hook, void* context){
+    comm_handler->capture_context = context;
+    comm_handler->capture = hook;
+}
+
+uint8_t asmart_comm_replay_frame(aSmart_Comm_Handler_t* comm_handler, const uint8_t* frame, uint16_t frame_length){
+    RxFrameSlot_t slot;
+
+    if (frame_length > RECEIVE_BUFFER_SIZE) {
+        return 0;
+    }
+#if ASMART_COMM_STREAMING_RX
+    /* A parser of its own: the port's parser may be in the middle of a frame, and routes are
+       not taken so nothing is relayed */
+    aSmart_Parser_t parser;
+
+    asmart_parser_init(&parser, slot.buffer, RECEIVE_BUFFER_SIZE, NULL, NULL);
+    for (uint16_t i = 0; i < frame_length; i++) {
+        if (asmart_parser_feed(&parser, frame[i]) == PARSE_FRAME) {
+            if (!is_addressed_to_node(comm_handler, parser.header.destination)) {
+                return 0;
+            }
+            slot.length = parser.frame_length;
+            slot.header = parser.header;
+#if ASMART_COMM_BRIDGE
+            slot.route = NULL;
+            slot.deliver = 1;
+#endif
+            process_received_message(comm_handler, &slot);
+            return 1;
+        }
+    }
+    return 0;
+#else
+    /* Parsed and filtered by process_received_message() like a received block */
+    memcpy(slot.buffer, frame, frame_length);
+    slot.length = frame_length;
+#if ASMART_COMM_BRIDGE
+    slot.route = NULL;
+    slot.deliver = 1;
+#endif
+    process_received_message(comm_handler, &slot);
+    return 1;
+#endif
+}
+#endif
+
+#if ASMART_COMM_SECURE
+uint8_t asmart_comm_set_link_key(aSmart_Comm_Handler_t* comm_handler, uint8_t address, const uint8_t* key, uint32_t tx_counter){
+    /* The nonce holds both addresses: a link needs two distinct unicast ones */
+    if (address == ADDRESS_UNASSIGNED || address == comm_handler->own_address || is_multicast_address(address)) {
+        return 0;
+    }
+    return asmart_secure_set_key(&comm_handler->secure, address, key, tx_counter);
+}
+
+uint32_t asmart_comm_link_counter(aSmart_Comm_Handler_t* comm_handler, uint8_t address){
+    SecureLink_t* link = asmart_secure_find(&comm_handler->secure, address);
+
+    return (link != NULL) ? link->tx_counter : 0;
+}
+
+uint32_t asmart_comm_link_rx_counter(aSmart_Comm_Handler_t* comm_handler, uint8_t address){
+    SecureLink_t* link = asmart_secure_find(&comm_handler->secure, address);
+
+    return (link != NULL) ? link->rx_highest : 0;
+}
+
+uint8_t asmart_comm_set_link_rx_counter(aSmart_Comm_Handler_t* comm_handler, uint8_t address, uint32_t rx_counter){
+    SecureLink_t* link = asmart_secure_find(&comm_handler->secure, address);
+
+    if (link == NULL) {
+        return 0;
+    }
+    asmart_secure_restore_rx(link, rx_counter);
+    return 1;
+}
+#endif
+
+#if ASMART_COMM_BULK
+void asmart_comm_bulk_receive(aSmart_Comm_Handler_t* comm_handler, aSmart_BulkRx_t* rx, BulkSink sink, BulkDone done, void* context){
+    aSmart_BulkRx_t* active = comm_handler->bulk_rx;
+
+    /* A transfer in progress ends, the sender learns it from the acknowledgement */
+    if (active != NULL && active->state == BULK_STREAMING) {
+        active->state = BULK_IDLE;
+        active->status = BULK_CANCELLED;
+        send_bulk_ack(comm_handler, active);
+        if (active->done != NULL) {
+            active->done(active->context, BULK_CANCELLED);
+        }
+    }
+    if (rx != NULL) {
+        rx->state = BULK_IDLE;
+        rx->status = BULK_REFUSED;
+        rx->peer = ADDRESS_UNASSIGNED;
+        rx->session = 0;
+        rx->sink = sink;
+        rx->done = done;
+        rx->context = context;
+    }
+    comm_handler->bulk_rx = rx;
+}
+
+uint8_t asmart_comm_bulk_send(aSmart_Comm_Handler_t* comm_handler, aSmart_BulkTx_t* tx, uint8_t destination, uint32_t size, uint32_t crc, BulkSource source, BulkDone done, void* context){
+    uint16_t block_size = asmart_bulk_block_size(bulk_max_data(comm_handler, destination, TRANSMIT_BUFFER_SIZE));
+
+    if (comm_handler->bulk_tx != NULL || is_multicast_address(destination) || size == 0 || block_size == 0 || (size - 1) / block_size >= BULK_MAX_BLOCKS) {
+        return 0;
+    }
+    comm_handler->bulk_session++;
+    asmart_bulk_tx_start(tx, destination, comm_handler->bulk_session, size, crc, block_size);
+    tx->source = source;
+    tx->done = done;
+    tx->context = context;
+    comm_handler->bulk_tx = tx;
+
+    uint8_t open[11] = {
+        tx->session,
+        (size >> 24) & 0xFF, (size >> 16) & 0xFF, (size >> 8) & 0xFF, size & 0xFF,
+        (crc >> 24) & 0xFF, (crc >> 16) & 0xFF, (crc >> 8) & 0xFF, crc & 0xFF,
+        (block_size >> 8) & 0xFF, block_size & 0xFF
+    };
+    asmart_comm_send_command_to(comm_handler, destination, CONTROL_COMMAND_BULK_OPEN, open, sizeof(open));
+    return 1;
+}
+
+void asmart_comm_bulk_cancel(aSmart_Comm_Handler_t* comm_handler){
+    if (comm_handler->bulk_tx != NULL) {
+        end_bulk_send(comm_handler, BULK_CANCELLED, 1);
+    }
+}
+#endif
+
+uint32_t asmart_comm_handler(aSmart_Comm_Handler_t* comm_handler){
+    aSmart_RxHandler_t* rx_handler = &comm_handler->rx_handler;
+
+    /* Dispatch the completed frames, oldest first */
+    while (rx_handler->slot_out != rx_handler->slot_in) {
+        RxFrameSlot_t* slot = &rx_handler->slots[rx_handler->slot_out % RX_FRAME_SLOTS];
+#if ASMART_COMM_BRIDGE
+        /* Stored frames go out unchanged, straight from the slot */
+        if (slot->route != NULL) {
+            forward_stored_frame(slot->route, slot->buffer, slot->length);
+        }
+        if (!slot->deliver) {
+            rx_handler->slot_out++;
+            continue;
+        }
+#endif
+#if ASMART_COMM_RX_CREDITS
+        CreditPeer_t* peer = find_credit_peer(comm_handler, slot->header.source);
+
+        if (peer != NULL && (!peer->active || !takes_credit(slot->header.message_type, slot->header.command_type))) {
+            peer = NULL;
+        }
+#endif
+#if ASMART_COMM_HALF_DUPLEX
+        rx_handler->dispatching = 1;
+        process_received_message(comm_handler, slot);
+        rx_handler->dispatching = 0;
+#else
+        process_received_message(comm_handler, slot);
+#endif
+        rx_handler->slot_out++;
+#if ASMART_COMM_RX_CREDITS
+        /* The slot is free, tell the sender */
+        if (peer != NULL) {
+            consume_credit(comm_handler, peer);
+        }
+#endif
+    }
+
+    /* Frames held back for credit, which may have come with the frames above, or for the port */
+    service_held_frames(comm_handler);
+
+    /* Check for command timeouts */
+    check_command_timeouts(comm_handler);
+
+#if ASMART_COMM_CHANNELS > 1
+    /* Queued channel traffic, one frame per call */
+    service_channels(comm_handler);
+#endif
+
+#if ASMART_COMM_BULK
+    /* Blocks of the transfer being sent, a burst per call */
+    service_bulk(comm_handler);
+#endif
+
+    return next_deadline(comm_handler);
+}
+
+uint8_t asmart_comm_rx_pending(aSmart_Comm_Handler_t* comm_handler){
+    return comm_handler->rx_handler.slot_in != comm_handler->rx_handler.slot_out;
+}
+
+void asmart_comm_set_clock(ClockSource clock){
+    clock_source = (clock != NULL) ? clock : HAL_GetTick;
+}
+
+uint32_t asmart_comm_now(void){
+    return clock_source();
+}
+
+uint32_t asmart_comm_now_us(void){
+    return bus_time_us();
+}
+
+void asmart_comm_send_command(aSmart_Comm_Handler_t* comm_handler, uint8_t command_type, uint8_t* payload, uint16_t payload_length){
+    asmart_comm_send_command_to(comm_handler, comm_handler->peer_address, command_type, payload, payload_length);
+}
+
+void asmart_comm_send_command_to(aSmart_Comm_Handler_t* comm_handler, uint8_t destination, uint8_t command_type, uint8_t* payload, uint16_t payload_length){
+    /* Increment and wrap sequence number */
+    comm_handler->sequence_number = (comm_handler->sequence_number + 1) % 65536;
+
+    send_command(comm_handler, destination, comm_handler->sequence_number, command_type, payload, payload_length);
+}
+
+void asmart_comm_send_notification(aSmart_Comm_Handler_t* comm_handler, uint8_t notification_type, uint8_t* payload, uint16_t payload_length){
+    asmart_comm_send_notification_to(comm_handler, comm_handler->peer_address, notification_type, payload, payload_length);
+}
+
+void asmart_comm_send_notification_to(aSmart_Comm_Handler_t* comm_handler, uint8_t destination, uint8_t notification_type, uint8_t* payload, uint16_t payload_length){
+#if ASMART_COMM_PUBSUB
+    /* Topics nobody wants right now never reach the wire */
+    if (!asmart_pubsub_should_send(&comm_handler->pubsub, is_multicast_address(destination) ? PUBSUB_ANY_SUBSCRIBER : destination, notification_type, asmart_comm_now())) {
+        release_transmit_buffer(comm_handler);
+        return;
+    }
+#endif
+
+    /* Notifications do not require sequence numbers; set to zero */
+    /* Assemble message */
+    assemble_message(comm_handler, destination, MSG_TYPE_NOTIFICATION, 0, notification_type, payload, payload_length);
+
+    /* Transmit message */
+    transmit_message(comm_handler);
+}
+
+void asmart_comm_send_response(aSmart_Comm_Handler_t* comm_handler, uint16_t sequence_number, uint8_t command_type, uint8_t* payload, uint16_t payload_length){
+    /* Answering a group or broadcast command would collide on the bus */
+    if (!comm_handler->reply_enabled) {
+        release_transmit_buffer(comm_handler);
+        return;
+    }
+
+    /* Assemble message */
+    assemble_message(comm_handler, comm_handler->reply_address, FRAME_TYPE_BYTE(MSG_TYPE_RESPONSE, comm_handler->reply_channel), sequence_number, command_type, payload, payload_length);
+
+#if ASMART_COMM_REPLAY_CACHE
+    /* Keep the encoded frame for retransmitted commands */
+    cache_reply(comm_handler, sequence_number);
+#endif
+
+    /* Transmit message */
+    transmit_message(comm_handler);
+}
+
+void asmart_comm_send_error(aSmart_Comm_Handler_t* comm_handler, uint16_t sequence_number, uint8_t error_code, uint8_t* payload, uint16_t payload_length){
+    if (!comm_handler->reply_enabled) {
+        release_transmit_buffer(comm_handler);
+        return;
+    }
+
+    /* Assemble message */
+    assemble_message(comm_handler, comm_handler->reply_address, FRAME_TYPE_BYTE(MSG_TYPE_ERROR, comm_handler->reply_channel), sequence_number, error_code, payload, payload_length);
+
+#if ASMART_COMM_REPLAY_CACHE
+    if (sequence_number != 0) {
+        cache_reply(comm_handler, sequence_number);
+    }
+#endif
+
+    /* Transmit message */
+    transmit_message(comm_handler);
+}
+
+/* Internal function implementations */
+
+static void assemble_message(aSmart_Comm_Handler_t* comm_handler, uint8_t destination, uint8_t msg_type, uint16_t seq_num, uint8_t cmd_type, uint8_t* payload, uint16_t payload_length) {
+    uint8_t* buffer = comm_handler->tx_handler.txd_buffer;
+    uint16_t index = 0;
+    SecureLink_t* link = NULL;
+
+    claim_transmit_buffer(comm_handler);
+
+    /* A payload longer than a frame holds would run past the transmit buffer */
+    if (payload_length > ASMART_COMM_MAX_PAYLOAD) {
+        comm_handler->tx_handler.txd_start = 0;
+        comm_handler->tx_handler.txd_length = 0;
+        return;
+    }
+
+#if ASMART_COMM_SECURE
+    /* Unicast frames to a node with a key are sealed; counter and tag must fit behind the payload */
+    if (!is_multicast_address(destination)) {
+        link = asmart_secure_find(&comm_handler->secure, destination);
+    }
+    if (link != NULL && payload_length > ASMART_COMM_SECURE_MAX_PAYLOAD) {
+        comm_handler->tx_handler.txd_start = 0;
+        comm_handler->tx_handler.txd_length = 0;
+        return;
+    }
+#endif
+
+#if ASMART_COMM_ADDRESS_MUTE_MODE
+    /* Muted nodes never wake for a broadcast: refused rather than lost on the line */
+    if (destination == ADDRESS_BROADCAST) {
+        comm_handler->tx_handler.txd_start = 0;
+        comm_handler->tx_handler.txd_length = 0;
+        return;
+    }
+#endif
+
+    /* Payload first, it may lie in the buffer where the header goes (a received one with ASMART_COMM_HALF_DUPLEX);
+       already in place when encoded into asmart_comm_tx_payload() */
+    if (payload != &buffer[FRAME_HEADER_SIZE]) {
+        memmove(&buffer[FRAME_HEADER_SIZE], payload, payload_length);
+    }
+
+    /* Nodes that agreed to it get the compact header */
+    if (is_compact_peer(comm_handler, destination)) {
+        assemble_compact_message(comm_handler, destination, msg_type, seq_num, cmd_type, payload_length, link);
+        return;
+    }
+
+    /* STX */
+    buffer[index++] = STX;
+
+    /* Placeholder for Length */
+    index += 2;
+
+    /* Destination and Source Address */
+    buffer[index++] = destination & 0x7F;
+    buffer[index++] = comm_handler->own_address;
+
+    /* Sequence Number (Big Endian) */
+    buffer[index++] = (seq_num >> 8) & 0xFF;
+    buffer[index++] = seq_num & 0xFF;
+
+    /* Message Type */
+    buffer[index++] = msg_type;
+
+    /* Command Type */
+    buffer[index++] = cmd_type;
+
+    /* Payload, moved into place above, then the counter and tag of a secured frame */
+    index += payload_length + ((link != NULL) ? SECURE_OVERHEAD : 0);
+
+    /* Calculate Length (excluding STX and ETX) */
+    uint16_t msg_length = index - 1;  /* Exclude STX */
+
+    /* Fill in Length (Big Endian) */
+    buffer[1] = (msg_length >> 8) & 0xFF;
+    buffer[2] = msg_length & 0xFF;
+
+#if ASMART_COMM_SECURE
+    /* Seal over the final header; a frame that cannot be sealed is not sent */
+    if (link != NULL && !seal_frame(comm_handler, link, buffer, FRAME_HEADER_SIZE, payload_length)) {
+        comm_handler->tx_handler.txd_start = 0;
+        comm_handler->tx_handler.txd_length = 0;
+        return;
+    }
+#endif
+
+    /* Calculate CRC */
+    uint16_t crc = crc16(&buffer[1], msg_length);
+
+    /* Append CRC (Big Endian) */
+    buffer[index++] = (crc >> 8) & 0xFF;
+    buffer[index++] = crc & 0xFF;
+
+    /* ETX */
+    buffer[index++] = ETX;
+
+    /* Total message length */
+    comm_handler->tx_handler.txd_start = 0;
+    comm_handler->tx_handler.txd_length = index;
+}
+
+static void assemble_compact_message(aSmart_Comm_Handler_t* comm_handler, uint8_t destination, uint8_t msg_type, uint16_t seq_num, uint8_t cmd_type, uint16_t payload_length, SecureLink_t* link) {
+    uint8_t* buffer = comm_handler->tx_handler.txd_buffer;
+
+    /* Notifications and standalone errors carry no Sequence Number, except on a channel where it counts for credit */
+    uint8_t base_type = msg_type & FRAME_TYPE_MASK;
+    uint8_t has_sequence = (base_type == MSG_TYPE_COMMAND || base_type == MSG_TYPE_RESPONSE || (base_type == MSG_TYPE_ERROR && seq_num != 0) || (msg_type & FRAME_CHANNEL_MASK));
+    uint16_t header_length = COMPACT_HEADER_MIN_SIZE + (has_sequence ? 2 : 0);
+    uint16_t msg_length = header_length + payload_length + ((link != NULL) ? SECURE_OVERHEAD : 0);
+    uint16_t length_size = (msg_length < 0x80) ? 1 : 2;
+
+    /* The header is placed so that the payload starts where it does with the standard header */
+    uint16_t start = FRAME_HEADER_SIZE - 1 - length_size - header_length;
+    uint16_t index = start;
+
+    /* SOH */
+    buffer[index++] = SOH;
+
+    /* Length as varint, low 7 bits first */
+    if (length_size == 1) {
+        buffer[index++] = msg_length;
+    }
+    else {
+        buffer[index++] = 0x80 | (msg_length & 0x7F);
+        buffer[index++] = msg_length >> 7;
+    }
+
+    /* Destination and Source Address */
+    buffer[index++] = destination & 0x7F;
+    buffer[index++] = comm_handler->own_address;
+
+    /* Message Type and flags */
+    buffer[index++] = msg_type | (has_sequence ? COMPACT_FLAG_SEQUENCE : 0);
+
+    /* Sequence Number (Big Endian), if present */
+    if (has_sequence) {
+        buffer[index++] = (seq_num >> 8) & 0xFF;
+        buffer[index++] = seq_num & 0xFF;
+    }
+
+    /* Command Type */
+    buffer[index++] = cmd_type;
+
+    /* Payload, moved into place by assemble_message(), then the counter and tag of a secured frame */
+    index += payload_length + ((link != NULL) ? SECURE_OVERHEAD : 0);
+
+#if ASMART_COMM_SECURE
+    /* Seal over the final header; a frame that cannot be sealed is not sent */
+    if (link != NULL && !seal_frame(comm_handler, link, &buffer[start], FRAME_HEADER_SIZE - start, payload_length)) {
+        comm_handler->tx_handler.txd_start = 0;
+        comm_handler->tx_handler.txd_length = 0;
+        return;
+    }
+#else
+    (void)link;
+#endif
+
+    /* CRC over Length up to the end of the Payload (Big Endian), no ETX */
+    uint16_t crc = crc16(&buffer[start + 1], index - start - 1);
+    buffer[index++] = (crc >> 8) & 0xFF;
+    buffer[index++] = crc & 0xFF;
+
+    comm_handler->tx_handler.txd_start = start;
+    comm_handler->tx_handler.txd_length = index - start;
+}
+
+static uint8_t is_compact_peer(aSmart_Comm_Handler_t* comm_handler, uint8_t address) {
+    address &= 0x7F;
+    return (comm_handler->compact_peers[address >> 3] >> (address & 0x07)) & 0x01;
+}
+
+static void set_peer_capabilities(aSmart_Comm_Handler_t* comm_handler, uint8_t address, uint8_t capabilities) {
+    /* Group and broadcast frames always use the standard header */
+    if (address == ADDRESS_UNASSIGNED || is_multicast_address(address)) {
+        return;
+    }
+    if (capabilities & CAPABILITY_COMPACT_HEADER) {
+        comm_handler->compact_peers[address >> 3] |= (1 << (address & 0x07));
+    }
+    else {
+        comm_handler->compact_peers[address >> 3] &= ~(1 << (address & 0x07));
+    }
+}
+
+static void handle_control_command(aSmart_Comm_Handler_t* comm_handler, uint8_t source, uint16_t seq_num, uint8_t cmd_type, uint8_t* payload, uint16_t length) {
+    if (cmd_type == CONTROL_COMMAND_NEGOTIATE) {
+        uint8_t common = ((length >= 1) ? payload[0] : 0) & ASMART_COMM_CAPABILITIES;
+
+#if ASMART_COMM_RX_CREDITS
+        if (find_credit_peer(comm_handler, source) == NULL && find_credit_peer(comm_handler, ADDRESS_UNASSIGNED) == NULL) {
+            common &= ~CAPABILITY_RX_CREDITS;
+        }
+#endif
+        /* Answer with the old header, the sender switches once it has the response */
+        asmart_comm_send_response(comm_handler, seq_num, cmd_type, &common, 1);
+        set_peer_capabilities(comm_handler, source, common);
+#if ASMART_COMM_RX_CREDITS
+        /* Both nodes count from the frame after the response on */
+        if (common & CAPABILITY_RX_CREDITS) {
+            open_credit_peer(comm_handler, source, 1);
+        }
+        else {
+            close_credit_peer(comm_handler, source);
+        }
+#endif
+    }
+#if ASMART_COMM_PUBSUB
+    else if (cmd_type == CONTROL_COMMAND_SUBSCRIBE && length == 4 && payload[0] < CONTROL_COMMAND_FIRST) {
+        uint8_t accepted = asmart_pubsub_subscribe(&comm_handler->pubsub, source, payload[0], (payload[1] << 8) | payload[2], payload[3]);
+        asmart_comm_send_response(comm_handler, seq_num, cmd_type, &accepted, 1);
+    }
+    else if (cmd_type == CONTROL_COMMAND_UNSUBSCRIBE && length == 1) {
+        asmart_pubsub_unsubscribe(&comm_handler->pubsub, source, payload[0]);
+        asmart_comm_send_response(comm_handler, seq_num, cmd_type, payload, 1);
+    }
+#endif
+#if ASMART_COMM_BULK
+    else if (cmd_type == CONTROL_COMMAND_BULK_OPEN) {
+        open_bulk_receive(comm_handler, source, seq_num, payload, length);
+    }
+    else if (cmd_type == CONTROL_COMMAND_BULK_FINISH && length == 1) {
+        aSmart_BulkRx_t* rx = comm_handler->bulk_rx;
+        uint8_t answer[2] = {payload[0], BULK_REFUSED};
+
+        /* A retransmitted finish gets the status of the first one */
+        if (rx != NULL && rx->peer == source && rx->session == payload[0]) {
+            uint8_t active = (rx->state != BULK_IDLE);
+
+            answer[1] = asmart_bulk_rx_finish(rx);
+            asmart_comm_send_response(comm_handler, seq_num, cmd_type, answer, sizeof(answer));
+            if (active && rx->done != NULL) {
+                rx->done(rx->context, answer[1]);
+            }
+            return;
+        }
+        asmart_comm_send_response(comm_handler, seq_num, cmd_type, answer, sizeof(answer));
+    }
+#endif
+    /* Unknown control commands are ignored, the sender times out silently */
+}
+
+static void handle_control_response(aSmart_Comm_Handler_t* comm_handler, uint8_t source, uint8_t cmd_type, uint8_t* payload, uint16_t length) {
+    /* A node without control support may answer anything, only a one-byte answer counts */
+    if (cmd_type == CONTROL_COMMAND_NEGOTIATE && length == 1) {
+        set_peer_capabilities(comm_handler, source, payload[0] & ASMART_COMM_CAPABILITIES);
+#if ASMART_COMM_RX_CREDITS
+        CreditPeer_t* peer = find_credit_peer(comm_handler, source);
+
+        if ((payload[0] & CAPABILITY_RX_CREDITS) && peer != NULL) {
+            peer->active = 1;
+        }
+        else {
+            close_credit_peer(comm_handler, source);
+        }
+#endif
+    }
+#if ASMART_COMM_BULK
+    else if ((cmd_type == CONTROL_COMMAND_BULK_OPEN || cmd_type == CONTROL_COMMAND_BULK_FINISH) && length >= 2) {
+        aSmart_BulkTx_t* tx = comm_handler->bulk_tx;
+
+        if (tx == NULL || tx->peer != source || tx->session != payload[0]) {
+            return;
+        }
+        if (cmd_type == CONTROL_COMMAND_BULK_OPEN && tx->state == BULK_OPENING) {
+            uint8_t granted = (payload[1] == BULK_OK && length == 6);
+
+            if (!granted || !asmart_bulk_tx_opened(tx, (payload[2] << 8) | payload[3], (payload[4] << 8) | payload[5], asmart_comm_now())) {
+                end_bulk_send(comm_handler, granted ? BULK_REFUSED : payload[1], 0);
+            }
+        }
+        else if (cmd_type == CONTROL_COMMAND_BULK_FINISH && tx->state == BULK_FINISHING) {
+            end_bulk_send(comm_handler, payload[1], 0);
+        }
+    }
+#endif
+}
+
+static void handle_control_notification(aSmart_Comm_Handler_t* comm_handler, uint8_t source, uint8_t notification_type, uint8_t* payload, uint16_t length) {
+#if ASMART_COMM_TELEMETRY
+    for (aSmart_TelemetryTx_t* tx = comm_handler->telemetry_tx; tx != NULL; tx = tx->next) {
+        if (length < 1 || tx->notification_type != payload[0] || tx->destination != source) {
+            continue;
+        }
+        if (notification_type == CONTROL_NOTIFICATION_TELEMETRY_ACK && length == 2) {
+            asmart_telemetry_ack(tx, payload[1]);
+        }
+        else if (notification_type == CONTROL_NOTIFICATION_KEYFRAME_REQUEST) {
+            asmart_telemetry_request_keyframe(tx);
+        }
+    }
+#endif
+#if ASMART_COMM_CHANNELS > 1
+    if ((notification_type == CONTROL_NOTIFICATION_CHANNEL_CREDIT || notification_type == CONTROL_NOTIFICATION_CHANNEL_PROBE) && length == 3) {
+        aSmart_Channel_t* channel = get_channel(comm_handler, payload[0]);
+        uint16_t value = (payload[1] << 8) | payload[2];
+        uint16_t limit;
+
+        if (channel == NULL || channel->peer != source) {
+            return;
+        }
+        if (notification_type == CONTROL_NOTIFICATION_CHANNEL_CREDIT) {
+            asmart_channel_grant(channel, value);
+        }
+        else {
+            /* Frames before the one the sender is blocked at will not come any more */
+            asmart_channel_received(channel, value - 1);
+            asmart_channel_grant_due(channel, 1, &limit);
+            send_channel_credit(comm_handler, payload[0], limit);
+        }
+    }
+#endif
+#if ASMART_COMM_RX_CREDITS
+    if (notification_type == CONTROL_NOTIFICATION_CREDIT && length == 1) {
+        CreditPeer_t* peer = find_credit_peer(comm_handler, source);
+
+        /* Everything the node sent before is dispatched or lost, count it as consumed */
+        if (peer != NULL && peer->active) {
+            peer->consumed = payload[0] & CREDIT_COUNTER_MASK;
+            send_credit(comm_handler, peer, NULL, 0);
+        }
+    }
+#endif
+#if ASMART_COMM_BULK
+    if (notification_type == CONTROL_NOTIFICATION_BULK_BLOCK && length >= BULK_BLOCK_HEADER) {
+        aSmart_BulkRx_t* rx = comm_handler->bulk_rx;
+
+        if (rx == NULL || rx->peer != source || rx->session != payload[0]) {
+            return;
+        }
+        if (((payload[1] << 8) | payload[2]) == BULK_PROBE_BLOCK) {
+            /* The sender has not heard from this node for a while */
+            if (rx->state != BULK_IDLE) {
+                send_bulk_ack(comm_handler, rx);
+            }
+        }
+        else if (rx->state == BULK_STREAMING) {
+            uint8_t due = asmart_bulk_rx_block(rx, (payload[1] << 8) | payload[2], &payload[BULK_BLOCK_HEADER], length - BULK_BLOCK_HEADER);
+
+            if (due) {
+                send_bulk_ack(comm_handler, rx);
+            }
+            if (rx->state == BULK_FAILED && rx->done != NULL) {
+                rx->done(rx->context, rx->status);
+            }
+        }
+        else if (rx->state == BULK_FAILED) {
+            /* The sender missed the failure, tell it again */
+            send_bulk_ack(comm_handler, rx);
+        }
+    }
+    else if (notification_type == CONTROL_NOTIFICATION_BULK_ACK && length == BULK_ACK_SIZE) {
+        aSmart_BulkTx_t* tx = comm_handler->bulk_tx;
+
+        if (tx == NULL || tx->state != BULK_STREAMING || tx->peer != source || tx->session != payload[0]) {
+            return;
+        }
+        if (payload[1] != BULK_OK) {
+            end_bulk_send(comm_handler, payload[1], 0);
+            return;
+        }
+        uint32_t bitmap = ((uint32_t)payload[6] << 24) | ((uint32_t)payload[7] << 16) | ((uint32_t)payload[8] << 8) | payload[9];
+        uint32_t now = asmart_comm_now();
+
+        /* Karn's algorithm: only the answer to a first probe is a round trip */
+        if (tx->probes == 1) {
+            asmart_rtt_sample(&comm_handler->rtt, now - tx->last_progress);
+        }
+        asmart_bulk_tx_ack(tx, (payload[2] << 8) | payload[3], (payload[4] << 8) | payload[5], bitmap, now, asmart_rtt_timeout(&comm_handler->rtt));
+    }
+    else if (notification_type == CONTROL_NOTIFICATION_BULK_ABORT && length == 2) {
+        aSmart_BulkRx_t* rx = comm_handler->bulk_rx;
+
+        if (rx != NULL && rx->peer == source && rx->session == payload[0] && rx->state == BULK_STREAMING) {
+            rx->state = BULK_IDLE;
+            rx->status = payload[1];
+            if (rx->done != NULL) {
+                rx->done(rx->context, payload[1]);
+            }
+        }
+    }
+#endif
+    /* Unknown control notifications are ignored */
+}
+
+#if ASMART_COMM_TELEMETRY
+static uint8_t receive_telemetry(aSmart_Comm_Handler_t* comm_handler, uint8_t source, uint8_t destination, uint8_t notification_type, uint8_t* payload, uint16_t length) {
+    aSmart_TelemetryRx_t* rx = comm_handler->telemetry_rx;
+
+    while (rx != NULL && rx->notification_type != notification_type) {
+        rx = rx->next;
+    }
+    if (rx == NULL) {
+        return 0;
+    }
+
+    telemetry_result_t result = asmart_telemetry_decode(rx, payload, length);
+
+    /* Group and broadcast streams are keyframes only; answering them would collide on the bus */
+    uint8_t answer = !is_multicast_address(destination);
+
+    if (result == TELEMETRY_REBUILT) {
+        if (comm_handler->response_callback) {
+            comm_handler->response_callback(MSG_TYPE_NOTIFICATION, notification_type, 0, rx->snapshot, rx->layout.snapshot_size);
+        }
+        if (asmart_telemetry_ack_due(rx) && answer) {
+            uint8_t ack[2] = {notification_type, rx->last_sample};
+            asmart_comm_send_notification_to(comm_handler, source, CONTROL_NOTIFICATION_TELEMETRY_ACK, ack, sizeof(ack));
+        }
+    }
+    else if (result == TELEMETRY_NEED_KEYFRAME && answer) {
+        asmart_comm_send_notification_to(comm_handler, source, CONTROL_NOTIFICATION_KEYFRAME_REQUEST, &notification_type, 1);
+    }
+    return 1;
+}
+#endif
+
+#if ASMART_COMM_CHANNELS > 1
+void asmart_comm_channel_open(aSmart_Comm_Handler_t* comm_handler, uint8_t channel, uint8_t peer, uint8_t rx_window, ChannelCallback callback){
+    uint16_t limit;
+
+    if (channel == 0 || channel >= ASMART_COMM_CHANNELS || peer == ADDRESS_UNASSIGNED || is_multicast_address(peer)) {
+        return;
+    }
+    asmart_channel_open(&comm_handler->channels[channel - 1], peer & 0x7F, rx_window, callback);
+
+    /* Let the peer start sending */
+    asmart_channel_grant_due(&comm_handler->channels[channel - 1], 1, &limit);
+    send_channel_credit(comm_handler, channel, limit);
+}
+
+void asmart_comm_channel_close(aSmart_Comm_Handler_t* comm_handler, uint8_t channel){
+    if (channel == 0 || channel >= ASMART_COMM_CHANNELS) {
+        return;
+    }
+    asmart_channel_close(&comm_handler->channels[channel - 1]);
+
+    /* Unanswered commands are dropped silently */
+    for (uint8_t i = 0; i < comm_handler->mapping_table_count; ) {
+        if (comm_handler->mapping_table[i].channel == channel) {
+            remove_command_from_mapping_table(comm_handler, channel, comm_handler->mapping_table[i].sequence_number);
+        }
+        else {
+            i++;
+        }
+    }
+}
+
+uint8_t asmart_comm_channel_send_command(aSmart_Comm_Handler_t* comm_handler, uint8_t channel, uint8_t command_type, uint8_t* payload, uint16_t payload_length){
+    return queue_channel_message(comm_handler, channel, MSG_TYPE_COMMAND, command_type, payload, payload_length);
+}
+
+uint8_t asmart_comm_channel_send_notification(aSmart_Comm_Handler_t* comm_handler, uint8_t channel, uint8_t notification_type, uint8_t* payload, uint16_t payload_length){
+    return queue_channel_message(comm_handler, channel, MSG_TYPE_NOTIFICATION, notification_type, payload, payload_length);
+}
+
+static aSmart_Channel_t* get_channel(aSmart_Comm_Handler_t* comm_handler, uint8_t channel) {
+    if (channel == 0 || channel >= ASMART_COMM_CHANNELS || !comm_handler->channels[channel - 1].open) {
+        return NULL;
+    }
+    return &comm_handler->channels[channel - 1];
+}
+
+static uint8_t queue_channel_message(aSmart_Comm_Handler_t* comm_handler, uint8_t channel, uint8_t msg_type, uint8_t cmd_type, uint8_t* payload, uint16_t payload_length) {
+    aSmart_Channel_t* logical = get_channel(comm_handler, channel);
+
+    if (logical == NULL || cmd_type >= CONTROL_COMMAND_FIRST || logical->queue_count >= CHANNEL_QUEUE_DEPTH) {
+        return 0;
+    }
+
+    if (msg_type == MSG_TYPE_COMMAND) {
+        /* Each channel gets a bounded share of the mapping table, the default channel keeps the rest */
+        uint8_t in_flight = 0;
+        for (uint8_t i = 0; i < comm_handler->mapping_table_count; i++) {
+            if (comm_handler->mapping_table[i].channel == channel) {
+                in_flight++;
+            }
+        }
+        if (in_flight >= CHANNEL_MAX_IN_FLIGHT || comm_handler->mapping_table_count >= (sizeof(comm_handler->mapping_table) / sizeof(comm_handler->mapping_table[0]))) {
+            return 0;
+        }
+    }
+
+    /* Zero stays reserved for errors that answer no command */
+    uint16_t seq_num = logical->sequence_number + 1;
+    if (seq_num == 0) {
+        seq_num = 1;
+    }
+
+    assemble_message(comm_handler, logical->peer, FRAME_TYPE_BYTE(msg_type, channel), seq_num, cmd_type, payload, payload_length);
+    uint8_t queued = comm_handler->tx_handler.txd_length != 0 && asmart_channel_enqueue(logical, seq_num, &comm_handler->tx_handler.txd_buffer[comm_handler->tx_handler.txd_start], comm_handler->tx_handler.txd_length);
+    release_transmit_buffer(comm_handler);
+    if (!queued) {
+        return 0;
+    }
+    logical->sequence_number = seq_num;
+
+    if (msg_type == MSG_TYPE_COMMAND) {
+        add_command_to_mapping_table(comm_handler, channel, seq_num, cmd_type);
+        keep_for_retransmission(comm_handler, channel, seq_num);
+
+        /* The timeout starts once the frame has left the queue */
+        CommandEntry_t* entry = find_command_in_mapping_table(comm_handler, channel, seq_num);
+        if (entry != NULL) {
+            entry->queued = 1;
+        }
+    }
+    return 1;
+}
+
+static void service_channels(aSmart_Comm_Handler_t* comm_handler) {
+    uint32_t now = asmart_comm_now();
+
+    for (uint8_t i = 0; i < ASMART_COMM_CHANNELS - 1; i++) {
+        uint8_t index = (comm_handler->channel_cursor + i) % (ASMART_COMM_CHANNELS - 1);
+        aSmart_Channel_t* logical = &comm_handler->channels[index];
+        ChannelFrame_t* frame = logical->open ? asmart_channel_head(logical) : NULL;
+
+        if (frame == NULL) {
+            continue;
+        }
+#if ASMART_COMM_RX_CREDITS
+        /* The peer has no receive slot free, leave the turn to other channels rather than wait */
+        if (!has_link_credit(comm_handler, logical->peer)) {
+            continue;
+        }
+#endif
+
+        if (!asmart_channel_has_credit(logical, frame->sequence_number)) {
+            /* Blocked: ask again now and then in case a grant was lost */
+            if (!logical->blocked) {
+                logical->blocked = 1;
+                logical->blocked_since = now;
+            }
+            else if (now - logical->blocked_since >= CHANNEL_PROBE_MS) {
+                uint8_t probe[3] = {index + 1, (frame->sequence_number >> 8) & 0xFF, frame->sequence_number & 0xFF};
+                asmart_comm_send_notification_to(comm_handler, logical->peer, CONTROL_NOTIFICATION_CHANNEL_PROBE, probe, sizeof(probe));
+                logical->blocked_since = now;
+            }
+            continue;
+        }
+
+        transmit_frame(comm_handler, frame->frame, frame->frame_length);
+
+        CommandEntry_t* entry = find_command_in_mapping_table(comm_handler, index + 1, frame->sequence_number);
+        if (entry != NULL && entry->queued) {
+            entry->queued = 0;
+            entry->timestamp = now;
+        }
+
+        asmart_channel_dequeue(logical);
+
+        /* Next call starts with the following channel */
+        comm_handler->channel_cursor = (index + 1) % (ASMART_COMM_CHANNELS - 1);
+        return;
+    }
+}
+
+static void deliver_channel_message(aSmart_Comm_Handler_t* comm_handler, uint8_t channel, uint8_t msg_type, uint8_t cmd_type, uint16_t seq_num, uint8_t* payload, uint16_t length) {
+    aSmart_Channel_t* logical = get_channel(comm_handler, channel);
+    uint8_t counted = (msg_type == MSG_TYPE_COMMAND || msg_type == MSG_TYPE_NOTIFICATION);
+    uint16_t limit;
+
+    if (logical == NULL) {
+        return;
+    }
+    if (counted) {
+        asmart_channel_received(logical, seq_num);
+    }
+
+    if (logical->callback) {
+        logical->callback(channel, msg_type, cmd_type, seq_num, payload, length);
+    }
+    else if (comm_handler->response_callback) {
+        comm_handler->response_callback(msg_type, cmd_type, seq_num, payload, length);
+    }
+
+    /* The frame has been consumed, open the window further */
+    if (counted && asmart_channel_grant_due(logical, 0, &limit)) {
+        send_channel_credit(comm_handler, channel, limit);
+    }
+}
+
+static void send_channel_credit(aSmart_Comm_Handler_t* comm_handler, uint8_t channel, uint16_t limit) {
+    uint8_t credit[3] = {channel, (limit >> 8) & 0xFF, limit & 0xFF};
+
+    asmart_comm_send_notification_to(comm_handler, comm_handler->channels[channel - 1].peer, CONTROL_NOTIFICATION_CHANNEL_CREDIT, credit, sizeof(credit));
+}
+#endif
+
+#if ASMART_COMM_BULK
+static uint16_t bulk_max_data(aSmart_Comm_Handler_t* comm_handler, uint8_t peer, uint16_t buffer_size) {
+    int32_t data = (int32_t)buffer_size - FRAME_HEADER_SIZE - FRAME_TRAILER_SIZE - BULK_BLOCK_HEADER;
+
+#if ASMART_COMM_SECURE
+    if (asmart_secure_find(&comm_handler->secure, peer) != NULL) {
+        data -= SECURE_OVERHEAD;
+    }
+#else
+    (void)comm_handler;
+    (void)peer;
+#endif
+    return (data > 0) ? (uint16_t)data : 0;
+}
+
+static void service_bulk(aSmart_Comm_Handler_t* comm_handler) {
+    aSmart_BulkTx_t* tx = comm_handler->bulk_tx;
+
+    if (tx == NULL || tx->state != BULK_STREAMING) {
+        return;
+    }
+
+    uint32_t rto = asmart_rtt_timeout(&comm_handler->rtt);
+    for (uint8_t i = 0; i < BULK_BURST; i++) {
+        int32_t block = asmart_bulk_tx_next(tx, asmart_comm_now(), rto);
+
+        if (block == BULK_NEXT_NONE) {
+            break;
+        }
+        if (block == BULK_NEXT_PROBE) {
+            uint8_t probe[BULK_BLOCK_HEADER] = {tx->session, (BULK_PROBE_BLOCK >> 8) & 0xFF, BULK_PROBE_BLOCK & 0xFF};
+            asmart_comm_send_notification_to(comm_handler, tx->peer, CONTROL_NOTIFICATION_BULK_BLOCK, probe, sizeof(probe));
+            break;
+        }
+        if (!send_bulk_block(comm_handler, tx, (uint16_t)block)) {
+            end_bulk_send(comm_handler, BULK_SOURCE_FAILED, 1);
+            return;
+        }
+    }
+
+    if (tx->probes > BULK_MAX_PROBES) {
+        end_bulk_send(comm_handler, BULK_TIMEOUT, 1);
+    }
+    else if (tx->acked == tx->block_count) {
+        /* Everything is in, the receiver checks the image */
+        uint8_t session = tx->session;
+
+        tx->state = BULK_FINISHING;
+        asmart_comm_send_command_to(comm_handler, tx->peer, CONTROL_COMMAND_BULK_FINISH, &session, 1);
+    }
+}
+
+static uint8_t send_bulk_block(aSmart_Comm_Handler_t* comm_handler, aSmart_BulkTx_t* tx, uint16_t block) {
+    uint16_t length = asmart_bulk_block_length(tx->size, tx->block_size, block);
+    uint8_t* payload = asmart_comm_tx_payload(comm_handler);
+
+    /* The source reads straight into the frame, behind the block header */
+    if (!tx->source(tx->context, (uint32_t)block * tx->block_size, &payload[BULK_BLOCK_HEADER], length)) {
+        release_transmit_buffer(comm_handler);
+        return 0;
+    }
+    payload[0] = tx->session;
+    payload[1] = (block >> 8) & 0xFF;
+    payload[2] = block & 0xFF;
+    assemble_message(comm_handler, tx->peer, MSG_TYPE_NOTIFICATION, 0, CONTROL_NOTIFICATION_BULK_BLOCK, payload, BULK_BLOCK_HEADER + length);
+    transmit_message(comm_handler);
+    return 1;
+}
+
+static void end_bulk_send(aSmart_Comm_Handler_t* comm_handler, uint8_t status, uint8_t notify) {
+    aSmart_BulkTx_t* tx = comm_handler->bulk_tx;
+
+    if (notify) {
+        uint8_t abort[2] = {tx->session, status};
+        asmart_comm_send_notification_to(comm_handler, tx->peer, CONTROL_NOTIFICATION_BULK_ABORT, abort, sizeof(abort));
+    }
+    tx->state = BULK_IDLE;
+    comm_handler->bulk_tx = NULL;
+    if (tx->done != NULL) {
+        tx->done(tx->context, status);
+    }
+}
+
+static void send_bulk_ack(aSmart_Comm_Handler_t* comm_handler, aSmart_BulkRx_t* rx) {
+    uint8_t ack[BULK_ACK_SIZE];
+    uint16_t length = asmart_bulk_rx_ack(rx, ack);
+
+    asmart_comm_send_notification_to(comm_handler, rx->peer, CONTROL_NOTIFICATION_BULK_ACK, ack, length);
+}
+
+static void open_bulk_receive(aSmart_Comm_Handler_t* comm_handler, uint8_t source, uint16_t seq_num, uint8_t* payload, uint16_t length) {
+    aSmart_BulkRx_t* rx = comm_handler->bulk_rx;
+    uint8_t answer[6] = {(length >= 1) ? payload[0] : 0, BULK_REFUSED, 0, 0, 0, 0};
+
+    /* One transfer at a time; the sending node may start over */
+    if (length != 11 || rx == NULL || (rx->state == BULK_STREAMING && rx->peer != source)) {
+        asmart_comm_send_response(comm_handler, seq_num, CONTROL_COMMAND_BULK_OPEN, answer, 2);
+        return;
+    }
+
+    /* The open was retransmitted and its response lost: the transfer is already running */
+    uint8_t running = (rx->state == BULK_STREAMING && rx->session == payload[0]);
+    if (!running) {
+        uint32_t size = ((uint32_t)payload[1] << 24) | ((uint32_t)payload[2] << 16) | ((uint32_t)payload[3] << 8) | payload[4];
+        uint32_t crc = ((uint32_t)payload[5] << 24) | ((uint32_t)payload[6] << 16) | ((uint32_t)payload[7] << 8) | payload[8];
+        uint16_t offered = (payload[9] << 8) | payload[10];
+        uint16_t max_data = bulk_max_data(comm_handler, source, RECEIVE_BUFFER_SIZE);
+        uint16_t block_size = asmart_bulk_block_size((offered < max_data) ? offered : max_data);
+
+        if (rx->state == BULK_STREAMING && rx->done != NULL) {
+            rx->done(rx->context, BULK_CANCELLED);
+        }
+        rx->state = BULK_IDLE;
+        if (block_size == 0 || asmart_bulk_rx_open(rx, source, payload[0], size, crc, block_size) == 0) {
+            asmart_comm_send_response(comm_handler, seq_num, CONTROL_COMMAND_BULK_OPEN, answer, 2);
+            return;
+        }
+    }
+
+    /* Block size and the limit of the page buffers, as an acknowledgement carries it */
+    uint8_t ack[BULK_ACK_SIZE];
+    asmart_bulk_rx_ack(rx, ack);
+    answer[1] = BULK_OK;
+    answer[2] = (rx->block_size >> 8) & 0xFF;
+    answer[3] = rx->block_size & 0xFF;
+    answer[4] = ack[4];
+    answer[5] = ack[5];
+    asmart_comm_send_response(comm_handler, seq_num, CONTROL_COMMAND_BULK_OPEN, answer, sizeof(answer));
+}
+#endif
+
+static void claim_transmit_buffer(aSmart_Comm_Handler_t* comm_handler) {
+#if ASMART_COMM_HALF_DUPLEX
+    aSmart_RxHandler_t* rx_handler = &comm_handler->rx_handler;
+
+    /* Stop the receive interrupt first, then nothing touches the buffer but this */
+    rx_handler->tx_owned = 1;
+    rx_handler->dropping = 1;  // A frame being received is cut off, the parser restarts afterwards
+
+    /* A frame waiting for dispatch is overwritten, as if it had collided on the bus; the one being
+       dispatched is being answered */
+    if (rx_handler->slot_in != rx_handler->slot_out && !rx_handler->dispatching) {
+        rx_handler->overruns++;
+        rx_handler->slot_out = rx_handler->slot_in;
+    }
+#else
+    (void)comm_handler;
+#endif
+}
+
+static void release_transmit_buffer(aSmart_Comm_Handler_t* comm_handler) {
+#if ASMART_COMM_HALF_DUPLEX
+    comm_handler->rx_handler.tx_owned = 0;
+#else
+    (void)comm_handler;
+#endif
+}
+
+static uint8_t send_command(aSmart_Comm_Handler_t* comm_handler, uint8_t destination, uint16_t seq_num, uint8_t cmd_type, uint8_t* payload, uint16_t payload_length) {
+    uint8_t unicast = !is_multicast_address(destination);
+
+    /* Add to mapping table; group and broadcast commands are never answered */
+    if (unicast) {
+        add_command_to_mapping_table(comm_handler, 0, seq_num, cmd_type);
+    }
+
+    /* Assemble message */
+    assemble_message(comm_handler, destination, MSG_TYPE_COMMAND, seq_num, cmd_type, payload, payload_length);
+
+    /* Not assembled, e.g. too long to be sealed: the command would only time out */
+    if (comm_handler->tx_handler.txd_length == 0) {
+        if (unicast) {
+            remove_command_from_mapping_table(comm_handler, 0, seq_num);
+        }
+        release_transmit_buffer(comm_handler);
+        return 0;
+    }
+
+    /* Keep a copy so a lost command or response can be recovered */
+    if (unicast) {
+        keep_for_retransmission(comm_handler, 0, seq_num);
+    }
+
+    /* Transmit message */
+    transmit_message(comm_handler);
+    return 1;
+}
+
+static void transmit_message(aSmart_Comm_Handler_t* comm_handler) {
+    transmit_frame(comm_handler, &comm_handler->tx_handler.txd_buffer[comm_handler->tx_handler.txd_start], comm_handler->tx_handler.txd_length);
+    release_transmit_buffer(comm_handler);
+}
+
+static void transmit_frame(aSmart_Comm_Handler_t* comm_handler, uint8_t* frame, uint16_t frame_length) {
+    /* Nothing was assembled, e.g. a frame that could not be sealed */
+    if (frame_length == 0) {
+        return;
+    }
+#if ASMART_COMM_RX_CREDITS
+    CreditPeer_t* peer = find_credit_peer(comm_handler, frame_destination(frame));
+
+    if (peer != NULL) {
+        uint16_t type_index = frame_type_index(frame);
+        uint16_t cmd_index = (frame[0] == SOH && (frame[type_index] & COMPACT_FLAG_SEQUENCE)) ? type_index + 3 : type_index + 1;
+
+        /* No receive slot free at the node: hold the frame back rather than wait for the credit */
+        if (peer->active && takes_credit(frame[type_index] & FRAME_TYPE_MASK, frame[cmd_index])
+                && (holds_frames_for(comm_handler, peer->address, 1) || !has_link_credit(comm_handler, peer->address))) {
+            hold_frame(comm_handler, peer->address, 1, frame, frame_length);
+            return;
+        }
+        stamp_credit(peer, frame, frame_length);
+    }
+#endif
+    write_frame(comm_handler, frame, frame_length);
+}
+
+static uint32_t response_gap_left(aSmart_Comm_Handler_t* comm_handler) {
+    uint32_t gap = comm_handler->rs485.response_gap_us;
+    uint32_t elapsed;
+
+    if (gap == 0) {
+        return 0;
+    }
+    elapsed = bus_time_us() - comm_handler->rx_handler.last_byte_us;
+    return (elapsed < gap) ? gap - elapsed : 0;
+}
+
+static uint32_t bus_time_us(void) {
+#if ASMART_COMM_HOST
+    return asmart_host_time_us();
+#else
+    uint32_t load = SysTick->LOAD + 1;
+    uint32_t tick;
+    uint32_t count;
+
+    do {
+        tick = HAL_GetTick();
+        count = SysTick->VAL;
+    } while (tick != HAL_GetTick());
+    /* A tick that expired but is not counted yet, e.g. within the receive interrupt: the counter has reloaded */
+    if ((SCB->ICSR & SCB_ICSR_PENDSTSET_Msk) && count > load / 2) {
+        tick++;
+    }
+    return tick * 1000U + ((load - 1 - count) * 1000U) / load;
+#endif
+}
+
+static void write_frame(aSmart_Comm_Handler_t* comm_handler, uint8_t* frame, uint16_t frame_length) {
+    /* On RS485 the node that sent last may still drive the bus, and a frame being cut through this
+       port goes first: hold this one back rather than wait */
+    if (holds_frames_for(comm_handler, frame_destination(frame), 0) || response_gap_left(comm_handler) != 0
+#if ASMART_COMM_BRIDGE
+        || !take_port(comm_handler)
+#endif
+    ) {
+        hold_frame(comm_handler, frame_destination(frame), 0, frame, frame_length);
+        return;
+    }
+    write_port(comm_handler, frame, frame_length);
+#if ASMART_COMM_BRIDGE
+    comm_handler->port_owner = PORT_FREE;
+#endif
+}
+
+static void write_port(aSmart_Comm_Handler_t* comm_handler, uint8_t* frame, uint16_t frame_length) {
+    if (comm_handler->writer != NULL) {
+        comm_handler->writer(comm_handler->writer_context, frame_destination(frame), frame, frame_length);
+    }
+#if ASMART_COMM_ADDRESS_MUTE_MODE
+    else {
+        /* 9-bit words: address mark first so only the addressed node leaves mute mode */
+        write_word(comm_handler->uart, 0x100 | frame_destination(frame));
+        for (uint16_t i = 0; i < frame_length; i++) {
+            write_word(comm_handler->uart, frame[i]);
+        }
+        /* Keep DE asserted until the last stop bit has left */
+        while (!__HAL_UART_GET_FLAG(comm_handler->uart, UART_FLAG_TC)) {
+        }
+    }
+#else
+    else {
+        HAL_UART_Transmit(comm_handler->uart, frame, frame_length, HAL_MAX_DELAY);
+    }
+#endif
+#if ASMART_COMM_CAPTURE
+    if (comm_handler->capture != NULL) {
+        comm_handler->capture(comm_handler->capture_context, CAPTURE_TX, frame, frame_length);
+    }
+#endif
+}
+
+#if ASMART_COMM_BRIDGE
+uint8_t asmart_comm_route_to_port(aSmart_Comm_Handler_t* comm_handler, uint8_t key, uint8_t first, uint8_t last, aSmart_Comm_Handler_t* target, uint8_t mode){
+    if (target == NULL || target == comm_handler) {
+        return 0;
+    }
+
+    /* A transport takes whole frames only, a slower line cannot keep up with the bytes relayed to it */
+    uint32_t source_baud = port_baud_rate(comm_handler);
+    uint32_t target_baud = port_baud_rate(target);
+    if (target->uart == NULL || (source_baud != 0 && target_baud != 0 && target_baud < source_baud)) {
+        mode = FORWARD_STORE;
+    }
+
+    BridgeRoute_t* route = asmart_bridge_add_route(&comm_handler->bridge, key, first, last, mode);
+    if (route == NULL) {
+        return 0;
+    }
+    route->port = target;
+    return 1;
+}
+
+uint8_t asmart_comm_route_to_sink(aSmart_Comm_Handler_t* comm_handler, uint8_t key, uint8_t first, uint8_t last, BridgeSink sink, void* context, uint8_t mode){
+    BridgeRoute_t* route = asmart_bridge_add_route(&comm_handler->bridge, key, first, last, mode);
+
+    if (route == NULL || sink == NULL) {
+        return 0;
+    }
+    route->sink = sink;
+    route->context = context;
+    return 1;
+}
+
+void asmart_comm_forward_frame(aSmart_Comm_Handler_t* comm_handler, uint8_t* frame, uint16_t frame_length){
+    write_frame(comm_handler, frame, frame_length);
+}
+
+static uint8_t claim_port(aSmart_Comm_Handler_t* port, uint8_t owner) {
+    uint8_t claimed = 0;
+
+    /* Sends run in the main loop, forwarding in receive interrupts of other ports */
+    uint32_t primask = __get_PRIMASK();
+    __disable_irq();
+    if (port->port_owner == PORT_FREE) {
+        port->port_owner = owner;
+        claimed = 1;
+    }
+    __set_PRIMASK(primask);
+    return claimed;
+}
+
+static uint8_t take_port(aSmart_Comm_Handler_t* comm_handler) {
+    if (claim_port(comm_handler, PORT_SENDING)) {
+        comm_handler->port_waiting = 0;
+        return 1;
+    }
+    if (!comm_handler->port_waiting) {
+        comm_handler->port_waiting = 1;
+        comm_handler->port_waiting_since = asmart_comm_now();
+        return 0;
+    }
+    if (asmart_comm_now() - comm_handler->port_waiting_since < BRIDGE_CUT_THROUGH_TIMEOUT_MS) {
+        return 0;
+    }
+
+    /* The frame being cut through has stalled at its source */
+    cut_off_relay(comm_handler);
+    return 1;
+}
+
+static void relay_bytes(aSmart_Comm_Handler_t* comm_handler, const uint8_t* data, uint16_t length, uint8_t end) {
+    BridgeRoute_t* route = comm_handler->rx_handler.route;
+    aSmart_Comm_Handler_t* port = route->port;
+
+    if (route->sink != NULL) {
+        route->sink(route->context, data, length, end);
+    }
+    /* Unless a send has cut the frame off after a stall */
+    else if (port->port_owner == PORT_FORWARDING && port->relay_source == comm_handler) {
+        for (uint16_t i = 0; i < length; i++) {
+            if ((uint16_t)(port->relay_head - port->relay_tail) == BRIDGE_RELAY_SIZE) {
+                port->relay_overflow = 1;
+                break;
+            }
+            port->relay_ring[port->relay_head++ & (BRIDGE_RELAY_SIZE - 1)] = data[i];
+        }
+        if (end) {
+            if (port->relay_overflow) {
+                route->truncated++;
+            }
+            port->relay_end = 1;
+        }
+        drain_relay(port);
+    }
+    if (end) {
+        route->forwarded++;
+    }
+}
+
+static void drain_relay(aSmart_Comm_Handler_t* port) {
+    uint32_t primask = __get_PRIMASK();
+    __disable_irq();
+    while (port->relay_sending == 0) {
+        uint16_t count = port->relay_head - port->relay_tail;
+        uint16_t start = port->relay_tail & (BRIDGE_RELAY_SIZE - 1);
+
+        if (count == 0) {
+            /* Last byte handed over: the port is free for the next frame */
+            if (port->relay_end) {
+                port->relay_end = 0;
+                port->relay_source = NULL;
+                port->port_owner = PORT_FREE;
+            }
+            break;
+        }
+        if (count > BRIDGE_RELAY_SIZE - start) {
+            count = BRIDGE_RELAY_SIZE - start;
+        }
+#if ASMART_COMM_HOST
+        HAL_UART_Transmit(port->uart, &port->relay_ring[start], count, HAL_MAX_DELAY);
+        port->relay_tail += count;
+#else
+        /* HAL_UART_TxCpltCallback hands over the next part */
+        port->relay_sending = count;
+        HAL_UART_Transmit_IT(port->uart, &port->relay_ring[start], count);
+#endif
+    }
+    __set_PRIMASK(primask);
+}
+
+static void cut_off_relay(aSmart_Comm_Handler_t* port) {
+    uint32_t primask = __get_PRIMASK();
+    __disable_irq();
+#if !ASMART_COMM_HOST
+    if (port->relay_sending) {
+        HAL_UART_AbortTransmit(port->uart);
+    }
+#endif
+    port->relay_tail = port->relay_head;
+    port->relay_sending = 0;
+    port->relay_end = 0;
+    port->relay_source = NULL;
+    port->port_owner = PORT_SENDING;
+    port->port_waiting = 0;
+    __set_PRIMASK(primask);
+}
+
+static uint32_t port_baud_rate(aSmart_Comm_Handler_t* comm_handler) {
+    if (comm_handler->uart == NULL) {
+        return 0;
+    }
+#if ASMART_COMM_HOST
+    return comm_handler->uart->baudrate;
+#else
+    return comm_handler->uart->Init.BaudRate;
+#endif
+}
+
+static void forward_stored_frame(BridgeRoute_t* route, uint8_t* frame, uint16_t frame_length) {
+    if (route->sink != NULL) {
+        route->sink(route->context, frame, frame_length, 1);
+    }
+    else {
+        write_frame(route->port, frame, frame_length);
+    }
+    route->forwarded++;
+}
+#endif
+
+#if ASMART_COMM_RX_CREDITS
+static CreditPeer_t* find_credit_peer(aSmart_Comm_Handler_t* comm_handler, uint8_t address) {
+    /* ADDRESS_UNASSIGNED finds a free entry */
+    if (is_multicast_address(address)) {
+        return NULL;
+    }
+    for (uint8_t i = 0; i < CREDIT_PEERS; i++) {
+        if (comm_handler->credit_peers[i].address == address) {
+            return &comm_handler->credit_peers[i];
+        }
+    }
+    return NULL;
+}
+
+static CreditPeer_t* open_credit_peer(aSmart_Comm_Handler_t* comm_handler, uint8_t address, uint8_t active) {
+    CreditPeer_t* peer = find_credit_peer(comm_handler, address);
+
+    if (address == ADDRESS_UNASSIGNED || is_multicast_address(address)) {
+        return NULL;
+    }
+    if (peer == NULL) {
+        peer = find_credit_peer(comm_handler, ADDRESS_UNASSIGNED);
+    }
+    if (peer == NULL) {
+        return NULL;
+    }
+
+    /* Deactivate first, the receive interrupt checks it before touching the counters */
+    peer->active = 0;
+    peer->address = address;
+    peer->sent = 0;
+    peer->acknowledged = 0;
+    peer->consumed = 0;
+    peer->advertised = 0;
+    peer->blocked = 0;
+    peer->resynced = 0;
+    peer->active = active;
+    return peer;
+}
+
+static void close_credit_peer(aSmart_Comm_Handler_t* comm_handler, uint8_t address) {
+    CreditPeer_t* peer = find_credit_peer(comm_handler, address);
+
+    if (peer != NULL && address != ADDRESS_UNASSIGNED) {
+        peer->active = 0;
+        peer->address = ADDRESS_UNASSIGNED;
+    }
+}
+
+static uint8_t takes_credit(uint8_t msg_type, uint8_t cmd_type) {
+    /* Negotiation resets the counters, and credit updates must get through to a waiting node */
+    if (cmd_type == CONTROL_COMMAND_NEGOTIATE && (msg_type == MSG_TYPE_COMMAND || msg_type == MSG_TYPE_RESPONSE)) {
+        return 0;
+    }
+    if (cmd_type == CONTROL_NOTIFICATION_CREDIT && msg_type == MSG_TYPE_NOTIFICATION) {
+        return 0;
+    }
+    return 1;
+}
+
+static uint8_t has_link_credit(aSmart_Comm_Handler_t* comm_handler, uint8_t address) {
+    CreditPeer_t* peer = find_credit_peer(comm_handler, address);
+    uint32_t now = asmart_comm_now();
+
+    /* Credit comes back through the receive interrupt, piggybacked or in a credit notification */
+    if (peer == NULL || !peer->active || ((peer->sent - peer->acknowledged) & CREDIT_COUNTER_MASK) < RX_CREDIT_WINDOW) {
+        if (peer != NULL) {
+            peer->blocked = 0;
+            peer->resynced = 0;
+        }
+        return 1;
+    }
+
+    if (!peer->blocked) {
+        peer->blocked = 1;
+        peer->resynced = 0;
+        peer->blocked_since = now;
+        return 0;
+    }
+    if (now - peer->blocked_since < CREDIT_RESYNC_MS) {
+        return 0;
+    }
+    if (!peer->resynced) {
+        /* Frames or credit updates may have been lost, the node takes all sent frames as consumed */
+        uint8_t sent = peer->sent;
+        send_credit(comm_handler, peer, &sent, 1);
+        peer->resynced = 1;
+        peer->blocked_since = now;
+        return 0;
+    }
 
-/* Function implementations */
+    /* Still no answer, e.g. both nodes wait for each other: send anyway */
+    peer->acknowledged = peer->sent;
+    peer->blocked = 0;
+    peer->resynced = 0;
+    return 1;
+}
 
-void asmart_comm_init(aSmart_Comm_Handler_t* comm_handler, ResponseCallback response_callback){
-		ptr_handler = comm_handler;
-    comm_handler->rx_handler.rxd_buffer_size = RECEIVE_BUFFER_SIZE;
-    comm_handler->rx_handler.rxd_index = 0;
-    comm_handler->rx_handler.message_ready = 0;
-    comm_handler->sequence_number = 0;
-    comm_handler->mapping_table_count = 0;
-    comm_handler->response_callback = response_callback;
-    memset(comm_handler->mapping_table, 0, sizeof(comm_handler->mapping_table));
+static void stamp_credit(CreditPeer_t* peer, uint8_t* frame, uint16_t frame_length) {
+    uint16_t type_index = frame_type_index(frame);
+    uint16_t cmd_index = (frame[0] == SOH && (frame[type_index] & COMPACT_FLAG_SEQUENCE)) ? type_index + 3 : type_index + 1;
+    uint16_t crc_end = frame_length - ((frame[0] == SOH) ? COMPACT_TRAILER_SIZE : FRAME_TRAILER_SIZE);
 
-    /* Hardware dependent configuration */
-    HAL_UARTEx_ReceiveToIdle_IT(&COMM_UART, comm_handler->rx_handler.rxd_buffer, comm_handler->rx_handler.rxd_buffer_size);
+    /* Piggyback the own receive credit; stored copies are stamped again on every transmission */
+    frame[type_index] = (frame[type_index] & ~FRAME_CREDIT_MASK) | (peer->consumed << FRAME_CREDIT_SHIFT);
+    uint16_t crc = crc16(&frame[1], crc_end - 1);
+    frame[crc_end] = (crc >> 8) & 0xFF;
+    frame[crc_end + 1] = crc & 0xFF;
+    peer->advertised = peer->consumed;
+
+    if (takes_credit(frame[type_index] & FRAME_TYPE_MASK, frame[cmd_index])) {
+        peer->sent = (peer->sent + 1) & CREDIT_COUNTER_MASK;
+    }
 }
 
-void asmart_comm_handler(aSmart_Comm_Handler_t* comm_handler){
-    if(comm_handler->rx_handler.message_ready){
-        /* Parse and process the message */
-        process_received_message(comm_handler);
-        comm_handler->rx_handler.message_ready = 0;
-        comm_handler->rx_handler.rxd_index = 0;
+static void consume_credit(aSmart_Comm_Handler_t* comm_handler, CreditPeer_t* peer) {
+    /* Renegotiated while the frame was dispatched, the counters start afresh */
+    if (!peer->active) {
+        return;
+    }
+    peer->consumed = (peer->consumed + 1) & CREDIT_COUNTER_MASK;
+
+    /* Nothing was sent back to carry the credit, send it before the node runs out */
+    if (((peer->consumed - peer->advertised) & CREDIT_COUNTER_MASK) >= RX_CREDIT_WINDOW - 1) {
+        send_credit(comm_handler, peer, NULL, 0);
     }
-    /* Check for command timeouts */
-    check_command_timeouts(comm_handler);
 }
 
-void asmart_comm_send_command(aSmart_Comm_Handler_t* comm_handler, uint8_t command_type, uint8_t* payload, uint16_t payload_length){
-    /* Increment and wrap sequence number */
-    comm_handler->sequence_number = (comm_handler->sequence_number + 1) % 65536;
+static void send_credit(aSmart_Comm_Handler_t* comm_handler, CreditPeer_t* peer, uint8_t* payload, uint16_t length) {
+    /* May be sent while the transmit buffer holds a frame waiting for credit */
+    uint8_t frame[FRAME_HEADER_SIZE + 1 + SECURE_OVERHEAD + FRAME_TRAILER_SIZE];
+    uint16_t sealed = 0;
+#if ASMART_COMM_SECURE
+    SecureLink_t* link = asmart_secure_find(&comm_handler->secure, peer->address);
+    sealed = (link != NULL) ? SECURE_OVERHEAD : 0;
+#endif
+    uint16_t msg_length = FRAME_MIN_LENGTH + length + sealed;
 
-    /* Add to mapping table */
-    add_command_to_mapping_table(comm_handler, comm_handler->sequence_number, command_type);
+    frame[0] = STX;
+    frame[1] = (msg_length >> 8) & 0xFF;
+    frame[2] = msg_length & 0xFF;
+    frame[3] = peer->address;
+    frame[4] = comm_handler->own_address;
+    frame[5] = 0;
+    frame[6] = 0;
+    frame[7] = MSG_TYPE_NOTIFICATION;
+    frame[8] = CONTROL_NOTIFICATION_CREDIT;
+    if (length > 0) {
+        frame[FRAME_HEADER_SIZE] = payload[0];
+    }
+#if ASMART_COMM_SECURE
+    if (link != NULL && !seal_frame(comm_handler, link, frame, FRAME_HEADER_SIZE, length)) {
+        return;
+    }
+#endif
+    frame[FRAME_HEADER_SIZE + length + sealed + 2] = ETX;
 
-    /* Assemble message */
-    assemble_message(comm_handler, MSG_TYPE_COMMAND, comm_handler->sequence_number, command_type, payload, payload_length);
+    /* Credit bits and CRC are filled in by transmit_frame() */
+    transmit_frame(comm_handler, frame, FRAME_HEADER_SIZE + length + sealed + FRAME_TRAILER_SIZE);
+}
+#endif
 
-    /* Transmit message */
-    HAL_UART_Transmit(&COMM_UART, comm_handler->tx_handler.txd_buffer, comm_handler->tx_handler.txd_length, HAL_MAX_DELAY);
+static uint8_t holds_frames_for(aSmart_Comm_Handler_t* comm_handler, uint8_t address, uint8_t counted) {
+    for (uint8_t i = 0; i < comm_handler->held_count; i++) {
+        if (comm_handler->held_frames[i].destination == address && (counted || !comm_handler->held_frames[i].counted)) {
+            return 1;
+        }
+    }
+    return 0;
 }
 
-void asmart_comm_send_notification(aSmart_Comm_Handler_t* comm_handler, uint8_t notification_type, uint8_t* payload, uint16_t payload_length){
-    /* Notifications do not require sequence numbers; set to zero */
-    /* Assemble message */
-    assemble_message(comm_handler, MSG_TYPE_NOTIFICATION, 0, notification_type, payload, payload_length);
+static void hold_frame(aSmart_Comm_Handler_t* comm_handler, uint8_t destination, uint8_t counted, uint8_t* frame, uint16_t frame_length) {
+    /* No room: the frame is lost like one dropped on the line, a command is retransmitted and a
+       response sent again from the replay cache */
+    if (comm_handler->held_count >= TX_HOLD_FRAMES || frame_length > TRANSMIT_BUFFER_SIZE) {
+        return;
+    }
 
-    /* Transmit message */
-    HAL_UART_Transmit(&COMM_UART, comm_handler->tx_handler.txd_buffer, comm_handler->tx_handler.txd_length, HAL_MAX_DELAY);
+    HeldFrame_t* held = &comm_handler->held_frames[comm_handler->held_count++];
+    held->destination = destination;
+    held->counted = counted;
+    held->frame_length = frame_length;
+    memcpy(held->frame, frame, frame_length);
 }
 
-void asmart_comm_send_response(aSmart_Comm_Handler_t* comm_handler, uint16_t sequence_number, uint8_t command_type, uint8_t* payload, uint16_t payload_length){
-    /* Assemble message */
-    assemble_message(comm_handler, MSG_TYPE_RESPONSE, sequence_number, command_type, payload, payload_length);
+static void service_held_frames(aSmart_Comm_Handler_t* comm_handler) {
+    uint8_t i = 0;
 
-    /* Transmit message */
-    HAL_UART_Transmit(&COMM_UART, comm_handler->tx_handler.txd_buffer, comm_handler->tx_handler.txd_length, HAL_MAX_DELAY);
+    while (i < comm_handler->held_count) {
+        HeldFrame_t* held = &comm_handler->held_frames[i];
+        uint8_t behind = 0;
+
+        /* A frame still held before it for the same node goes first; frames that take no credit
+           only wait for the port */
+        for (uint8_t j = 0; j < i; j++) {
+            if (comm_handler->held_frames[j].destination == held->destination && (held->counted || !comm_handler->held_frames[j].counted)) {
+                behind = 1;
+                break;
+            }
+        }
+#if ASMART_COMM_RX_CREDITS
+        /* Asked before the port is taken, a resync sends its own frame */
+        if (!behind && held->counted && !has_link_credit(comm_handler, held->destination)) {
+            behind = 1;
+        }
+#endif
+        if (behind) {
+            i++;
+            continue;
+        }
+        /* The node that sent last may still drive the bus: the deadline comes back once the gap has passed */
+        if (response_gap_left(comm_handler) != 0) {
+            return;
+        }
+#if ASMART_COMM_BRIDGE
+        /* Still cutting a frame through: nothing else can go out */
+        if (!take_port(comm_handler)) {
+            return;
+        }
+#endif
+#if ASMART_COMM_RX_CREDITS
+        CreditPeer_t* peer = find_credit_peer(comm_handler, held->destination);
+        if (held->counted && peer != NULL) {
+            stamp_credit(peer, held->frame, held->frame_length);
+        }
+#endif
+        write_port(comm_handler, held->frame, held->frame_length);
+#if ASMART_COMM_BRIDGE
+        comm_handler->port_owner = PORT_FREE;
+#endif
+
+        /* Shift entries to fill the gap */
+        comm_handler->held_count--;
+        memmove(&comm_handler->held_frames[i], &comm_handler->held_frames[i + 1], (comm_handler->held_count - i) * sizeof(HeldFrame_t));
+    }
 }
 
-void asmart_comm_send_error(aSmart_Comm_Handler_t* comm_handler, uint16_t sequence_number, uint8_t error_code, uint8_t* payload, uint16_t payload_length){
-    /* Assemble message */
-    assemble_message(comm_handler, MSG_TYPE_ERROR, sequence_number, error_code, payload, payload_length);
+#if ASMART_COMM_REPLAY_CACHE
+static void cache_reply(aSmart_Comm_Handler_t* comm_handler, uint16_t sequence_number) {
+    /* Only the key of the last received command is known; an earlier command answered late
+       stays remembered without a response, so a repeat of it is dropped */
+    if (sequence_number != comm_handler->reply_sequence_number) {
+        return;
+    }
+    asmart_replay_store(&comm_handler->replay_cache, comm_handler->reply_address, comm_handler->reply_channel, sequence_number, comm_handler->reply_command_type,
+                        &comm_handler->tx_handler.txd_buffer[comm_handler->tx_handler.txd_start], comm_handler->tx_handler.txd_length, asmart_comm_now());
+}
+#endif
 
-    /* Transmit message */
-    HAL_UART_Transmit(&COMM_UART, comm_handler->tx_handler.txd_buffer, comm_handler->tx_handler.txd_length, HAL_MAX_DELAY);
+static void start_reception(aSmart_Comm_Handler_t* comm_handler) {
+#if ASMART_COMM_HOST
+    /* The host's event loop reads the port and feeds asmart_comm_receive_bytes() */
+    asmart_host_bind(comm_handler->uart, comm_handler);
+#elif ASMART_COMM_STREAMING_RX
+    /* One word per interrupt, halfword sized so 9-bit mode fits as well */
+    HAL_UART_Receive_IT(comm_handler->uart, (uint8_t*)&comm_handler->rx_handler.rxd_word, 1);
+#elif ASMART_COMM_ADDRESS_MUTE_MODE
+    /* 9-bit words are stored as halfwords, the buffer holds half as many */
+    HAL_UARTEx_ReceiveToIdle_IT(comm_handler->uart, comm_handler->rx_handler.slots[0].buffer, RECEIVE_BUFFER_SIZE / 2);
+#else
+    HAL_UARTEx_ReceiveToIdle_IT(comm_handler->uart, comm_handler->rx_handler.slots[0].buffer, RECEIVE_BUFFER_SIZE);
+#endif
 }
 
-/* Internal function implementations */
+static header_action_t filter_frame_header(void* context, const aSmart_FrameHeader_t* header) {
+    aSmart_Comm_Handler_t* comm_handler = (aSmart_Comm_Handler_t*)context;
+    uint8_t local = is_addressed_to_node(comm_handler, header->destination);
 
-static void assemble_message(aSmart_Comm_Handler_t* comm_handler, uint8_t msg_type, uint16_t seq_num, uint8_t cmd_type, uint8_t* payload, uint16_t payload_length) {
-    uint8_t* buffer = comm_handler->tx_handler.txd_buffer;
-    uint16_t index = 0;
+#if ASMART_COMM_BRIDGE
+    aSmart_RxHandler_t* rx_handler = &comm_handler->rx_handler;
+    BridgeRoute_t* route = asmart_bridge_lookup(&comm_handler->bridge, header);
 
-    /* STX */
-    buffer[index++] = STX;
+    /* Frames to the own address are only taken away by command */
+    if (route != NULL && route->key == ROUTE_BY_DESTINATION && header->destination == comm_handler->own_address) {
+        route = NULL;
+    }
+    rx_handler->route = route;
+    rx_handler->deliver = 1;
+    if (route != NULL) {
+        /* A command route takes the frame away from this node, group and broadcast frames are kept as well */
+        if (route->key == ROUTE_BY_COMMAND || !local) {
+            rx_handler->deliver = 0;
+        }
+        if (!rx_handler->deliver && route->mode == FORWARD_CUT_THROUGH && route->sink != NULL) {
+            return HEADER_FORWARD;
+        }
+        if (!rx_handler->deliver && route->mode == FORWARD_CUT_THROUGH && route->sink == NULL && claim_port(route->port, PORT_FORWARDING)) {
+            /* The relayed bytes queue in the port's ring until its UART takes them */
+            route->port->relay_source = comm_handler;
+            route->port->relay_end = 0;
+            route->port->relay_overflow = 0;
+            return HEADER_FORWARD;
+        }
+        /* Stored, checked and forwarded from its slot, e.g. while the target port is sending */
+        return HEADER_ACCEPT;
+    }
+#endif
+    /* Frames for other nodes are skipped without storing them or computing their CRC */
+    return local ? HEADER_ACCEPT : HEADER_SKIP;
+}
 
-    /* Placeholder for Length */
-    index += 2;
+static uint8_t is_multicast_address(uint8_t address) {
+    return (address >= ADDRESS_GROUP_FIRST) ? 1 : 0;
+}
 
-    /* Sequence Number (Big Endian) */
-    buffer[index++] = (seq_num >> 8) & 0xFF;
-    buffer[index++] = seq_num & 0xFF;
+static uint8_t is_addressed_to_node(aSmart_Comm_Handler_t* comm_handler, uint8_t destination) {
+    if (destination == ADDRESS_BROADCAST) {
+        return 1;
+    }
+    if (destination >= ADDRESS_GROUP_FIRST && destination <= ADDRESS_GROUP_LAST) {
+        return (comm_handler->group_mask >> (destination - ADDRESS_GROUP_FIRST)) & 0x01;
+    }
+    return (destination != ADDRESS_UNASSIGNED && destination == comm_handler->own_address) ? 1 : 0;
+}
 
-    /* Message Type */
-    buffer[index++] = msg_type;
+#if ASMART_COMM_ADDRESS_MUTE_MODE
+static void write_word(UART_HandleTypeDef* uart, uint16_t word) {
+#if ASMART_COMM_HOST
+    uint8_t byte = (uint8_t)word;
+    HAL_UART_Transmit(uart, &byte, 1, HAL_MAX_DELAY);
+#else
+    while (!__HAL_UART_GET_FLAG(uart, UART_FLAG_TXE)) {
+    }
+    uart->Instance->TDR = word;
+#endif
+}
+#endif
 
-    /* Command Type */
-    buffer[index++] = cmd_type;
+#if ASMART_COMM_ADDRESS_MUTE_MODE
 
-    /* Payload */
-    memcpy(&buffer[index], payload, payload_length);
-    index += payload_length;
+static void configure_address_mute_mode(aSmart_Comm_Handler_t* comm_handler) {
+    /* 9 data bits without parity: bit 8 is the address mark, payload bytes stay transparent */
+    comm_handler->uart->Init.WordLength = UART_WORDLENGTH_9B;
+    comm_handler->uart->Init.Parity = UART_PARITY_NONE;
 
-    /* Calculate Length (excluding STX and ETX) */
-    uint16_t msg_length = index - 1;  /* Exclude STX */
+    /* RS485 driver enable settings in CR3 are left untouched */
+    HAL_MultiProcessor_Init(comm_handler->uart, comm_handler->own_address, UART_WAKEUPMETHOD_ADDRESSMARK);
+    HAL_MultiProcessorEx_AddressLength_Set(comm_handler->uart, UART_ADDRESS_DETECT_7B);
 
-    /* Fill in Length (Big Endian) */
-    buffer[1] = (msg_length >> 8) & 0xFF;
-    buffer[2] = msg_length & 0xFF;
+    /* The match register holds one address: a group member stays awake and filters in software */
+    if (comm_handler->group_mask != 0) {
+        HAL_MultiProcessor_DisableMuteMode(comm_handler->uart);
+        return;
+    }
+    HAL_MultiProcessor_EnableMuteMode(comm_handler->uart);
+    HAL_MultiProcessor_EnterMuteMode(comm_handler->uart);
+}
+#endif
 
-    /* Calculate CRC */
-    uint16_t crc = crc16(&buffer[1], msg_length);
+static uint8_t frame_destination(uint8_t* frame) {
+    if (frame[0] == SOH) {
+        /* Destination follows the varint Length */
+        return (frame[1] & 0x80) ? frame[3] : frame[2];
+    }
+    return frame[3];
+}
 
-    /* Append CRC (Big Endian) */
-    buffer[index++] = (crc >> 8) & 0xFF;
-    buffer[index++] = crc & 0xFF;
+#if ASMART_COMM_ADDRESS_MUTE_MODE || ASMART_COMM_RX_CREDITS || ASMART_COMM_SECURE
+static uint16_t frame_type_index(uint8_t* frame) {
+    if (frame[0] == SOH) {
+        /* Destination and Source follow the varint Length */
+        return (frame[1] & 0x80) ? 5 : 4;
+    }
+    return 7;
+}
+#endif
 
-    /* ETX */
-    buffer[index++] = ETX;
+#if ASMART_COMM_SECURE
+static uint16_t frame_aad(uint8_t* frame, uint16_t payload_offset, uint8_t* aad) {
+    uint16_t length = payload_offset - 1;
 
-    /* Total message length */
-    comm_handler->tx_handler.txd_length = index;
+    memcpy(aad, &frame[1], length);
+
+    /* Credit bits are stamped on every transmission, after sealing */
+    aad[frame_type_index(frame) - 1] &= ~FRAME_CREDIT_MASK;
+    return length;
 }
 
-static void process_received_message(aSmart_Comm_Handler_t* comm_handler) {
-		aMessage_Struct_t parsing_msg;
-	
-    parsing_msg.buffer = comm_handler->rx_handler.rxd_buffer;
-    parsing_msg.length = comm_handler->rx_handler.rxd_index;
-    parsing_msg.index = 0;
+static uint8_t seal_frame(aSmart_Comm_Handler_t* comm_handler, SecureLink_t* link, uint8_t* frame, uint16_t payload_offset, uint16_t payload_length) {
+    uint8_t aad[SECURE_MAX_AAD];
+    uint16_t aad_length = frame_aad(frame, payload_offset, aad);
 
-    /* Check STX and ETX */
-    if (parsing_msg.buffer[0] != STX || parsing_msg.buffer[parsing_msg.length - 1] != ETX) {
-        /* Invalid framing */
-        return;
-    }
+    return asmart_secure_seal(link, comm_handler->own_address, link->address, aad, aad_length, &frame[payload_offset], payload_length);
+}
+#endif
 
-    /* Extract Length */
-    parsing_msg.msg_length = (parsing_msg.buffer[1] << 8) | parsing_msg.buffer[2];
+#if ASMART_COMM_ADDRESS_MUTE_MODE && !ASMART_COMM_STREAMING_RX
+static uint16_t unpack_9bit_frame(uint8_t* buffer, uint16_t words) {
+    uint16_t* rx_words = (uint16_t*)buffer;
+    uint16_t start = 0;
+    uint16_t length = 0;
 
-    /* Verify Length */
-    if (parsing_msg.msg_length != (parsing_msg.length - 4)) {
-        /* Length mismatch */
-        return;
+    /* The matching address mark is received like data */
+    if (words > 0 && (rx_words[0] & 0x100)) {
+        start = 1;
+    }
+    /* Forward in-place copy is safe, byte i is written after word i has been read */
+    for (uint16_t i = start; i < words; i++) {
+        buffer[length++] = (uint8_t)(rx_words[i] & 0xFF);
+    }
+    return length;
+}
+#endif
+
+static void process_received_message(aSmart_Comm_Handler_t* comm_handler, RxFrameSlot_t* slot) {
+#if ASMART_COMM_CAPTURE
+    if (comm_handler->capture != NULL) {
+        comm_handler->capture(comm_handler->capture_context, CAPTURE_RX, slot->buffer, slot->length);
     }
+#endif
+#if ASMART_COMM_STREAMING_RX
+    /* Already validated byte by byte as it arrived */
+    dispatch_message(comm_handler, slot->buffer, slot->length, &slot->header);
+#else
+    /* Run the idle-terminated block through the parser; frames are rebuilt in place */
+    aSmart_Parser_t* parser = &comm_handler->rx_handler.parser;
 
-    parsing_msg.index = 3;  /* Move past STX and Length */
+    asmart_parser_reset(parser);
+    for (uint16_t i = 0; i < slot->length; i++) {
+        if (asmart_parser_feed(parser, slot->buffer[i]) == PARSE_FRAME) {
+            dispatch_message(comm_handler, slot->buffer, parser->frame_length, &parser->header);
+        }
+    }
+#endif
+}
 
-    /* Extract Sequence Number */
-    parsing_msg.seq_num = (parsing_msg.buffer[parsing_msg.index++] << 8);
-    parsing_msg.seq_num |= parsing_msg.buffer[parsing_msg.index++];
+static void dispatch_message(aSmart_Comm_Handler_t* comm_handler, uint8_t* frame, uint16_t frame_length, const aSmart_FrameHeader_t* header) {
+		aMessage_Struct_t parsing_msg;
+	
+#if ASMART_COMM_SECURE
+    /* Unicast frames from a node with a key must authenticate; the payload is decrypted in place */
+    SecureLink_t* link = is_multicast_address(header->destination) ? NULL : asmart_secure_find(&comm_handler->secure, header->source);
+    aSmart_FrameHeader_t opened;
 
-    /* Extract Message Type */
-    parsing_msg.msg_type = parsing_msg.buffer[parsing_msg.index++];
+    if (link != NULL) {
+        uint8_t aad[SECURE_MAX_AAD];
+        uint16_t aad_length = frame_aad(frame, header->payload_offset, aad);
+        secure_open_t result = asmart_secure_open(link, header->source, header->destination, aad, aad_length, &frame[header->payload_offset], header->payload_length);
 
-    /* Extract Command Type */
-    parsing_msg.cmd_type = parsing_msg.buffer[parsing_msg.index++];
+        if (result == SECURE_OPEN_FAILED) {
+            comm_handler->secure.auth_failures++;
+            return;
+        }
+        if (result == SECURE_OPEN_REPLAYED) {
+            comm_handler->secure.replays++;
+#if ASMART_COMM_REPLAY_CACHE
+            /* A retransmitted command whose response got lost is answered again, it is never run twice */
+            if (header->message_type == MSG_TYPE_COMMAND) {
+                ReplayEntry_t* cached = asmart_replay_lookup(&comm_handler->replay_cache, header->source, header->channel, header->sequence_number, header->command_type, asmart_comm_now());
+                if (cached != NULL && cached->frame_length != 0) {
+                    transmit_frame(comm_handler, cached->frame, cached->frame_length);
+                }
+            }
+#endif
+            return;
+        }
+        opened = *header;
+        opened.payload_length -= SECURE_OVERHEAD;
+        header = &opened;
+    }
+#endif
 
-    /* Extract Payload */
-    uint16_t payload_length = parsing_msg.msg_length - 6;  /* Exclude Sequence Number (2 bytes), Message Type (1 byte), Command Type (1 byte) */
-    uint8_t payload[256];
-    memcpy(payload, &parsing_msg.buffer[parsing_msg.index], payload_length);
-    payload[payload_length] = '\0';
+    parsing_msg.buffer = frame;
+    parsing_msg.length = frame_length;
 
-    /* Verify CRC */
-    parsing_msg.received_crc = (parsing_msg.buffer[parsing_msg.length - 3] << 8) |parsing_msg. buffer[parsing_msg.length - 2];
-    parsing_msg.calculated_crc = crc16(&parsing_msg.buffer[1], parsing_msg.msg_length);
+    /* Header fields were decoded by the parser, for the standard and the compact layout alike */
+    parsing_msg.destination = header->destination;
+    parsing_msg.source = header->source;
+    parsing_msg.seq_num = header->sequence_number;
+    parsing_msg.msg_type = header->message_type;
+    parsing_msg.cmd_type = header->command_type;
+    parsing_msg.channel = header->channel;
+    parsing_msg.index = header->payload_offset;
 
-    if (parsing_msg.received_crc != parsing_msg.calculated_crc) {
-        /* CRC mismatch */
-        return;
-    }
+    /* Payload is passed in place; the slot keeps its CRC, it may still be replayed or forwarded */
+    uint16_t payload_length = header->payload_length;
+    uint8_t* payload = &parsing_msg.buffer[parsing_msg.index];
 
     /* Process Message */
     if (parsing_msg.msg_type == MSG_TYPE_RESPONSE) {
         /* Find command in mapping table */
-        CommandEntry_t* entry = find_command_in_mapping_table(comm_handler, parsing_msg.seq_num);
+        CommandEntry_t* entry = find_command_in_mapping_table(comm_handler, parsing_msg.channel, parsing_msg.seq_num);
         if (entry != NULL) {
-            /* Match found, call the response callback */
-            if (comm_handler->response_callback) {
-                comm_handler->response_callback(parsing_msg.msg_type, entry->command_type, parsing_msg.seq_num, payload, payload_length);
-            }
+            uint8_t command_type = entry->command_type;
+
+            sample_round_trip(comm_handler, entry);
+
             /* Remove from mapping table */
-            remove_command_from_mapping_table(comm_handler, parsing_msg.seq_num);
+            remove_command_from_mapping_table(comm_handler, parsing_msg.channel, parsing_msg.seq_num);
+
+#if ASMART_COMM_CHANNELS > 1
+            if (parsing_msg.channel != 0) {
+                deliver_channel_message(comm_handler, parsing_msg.channel, parsing_msg.msg_type, command_type, parsing_msg.seq_num, payload, payload_length);
+                return;
+            }
+#endif
+
+            /* Answers to library control commands stay inside the library */
+            if (command_type >= CONTROL_COMMAND_FIRST) {
+                handle_control_response(comm_handler, parsing_msg.source, command_type, payload, payload_length);
+                return;
+            }
+
+            /* Match found, an awaiting request takes it, otherwise call the response callback */
+            if (!complete_request(comm_handler, parsing_msg.seq_num, REQUEST_DONE, 0, payload, payload_length)) {
+                if (comm_handler->response_callback) {
+                    comm_handler->response_callback(parsing_msg.msg_type, command_type, parsing_msg.seq_num, payload, payload_length);
+                }
+            }
         } 
 				else {
             /* Sequence number not found */
@@ -409,6 +3317,42 @@ static void process_received_message(aSmart_Comm_Handler_t* comm_handler) {
     } 	
 		
 		else if (parsing_msg.msg_type == MSG_TYPE_COMMAND) {
+        /* Responses and errors go back to the sender, unless it addressed a group or everyone */
+        comm_handler->reply_address = parsing_msg.source;
+        comm_handler->reply_enabled = !is_multicast_address(parsing_msg.destination);
+        comm_handler->reply_sequence_number = parsing_msg.seq_num;
+        comm_handler->reply_command_type = parsing_msg.cmd_type;
+        comm_handler->reply_channel = parsing_msg.channel;
+
+#if ASMART_COMM_REPLAY_CACHE
+        /* A retransmitted command gets the kept response, or nothing while its response is pending
+           or was too large to keep; the application is not called again */
+        if (comm_handler->reply_enabled) {
+            ReplayEntry_t* cached = asmart_replay_lookup(&comm_handler->replay_cache, parsing_msg.source, parsing_msg.channel, parsing_msg.seq_num, parsing_msg.cmd_type, asmart_comm_now());
+            if (cached != NULL) {
+                if (cached->frame_length != 0) {
+                    transmit_frame(comm_handler, cached->frame, cached->frame_length);
+                }
+                return;
+            }
+            asmart_replay_record(&comm_handler->replay_cache, parsing_msg.source, parsing_msg.channel, parsing_msg.seq_num, parsing_msg.cmd_type, asmart_comm_now());
+        }
+#endif
+
+#if ASMART_COMM_CHANNELS > 1
+        if (parsing_msg.channel != 0) {
+            deliver_channel_message(comm_handler, parsing_msg.channel, parsing_msg.msg_type, parsing_msg.cmd_type, parsing_msg.seq_num, payload, payload_length);
+            return;
+        }
+#endif
+
+        if (parsing_msg.cmd_type >= CONTROL_COMMAND_FIRST) {
+            if (comm_handler->reply_enabled) {
+                handle_control_command(comm_handler, parsing_msg.source, parsing_msg.seq_num, parsing_msg.cmd_type, payload, payload_length);
+            }
+            return;
+        }
+
         /* Handle incoming commands */
         if (comm_handler->response_callback) {
             comm_handler->response_callback(parsing_msg.msg_type, parsing_msg.cmd_type, parsing_msg.seq_num, payload, payload_length);
@@ -417,43 +3361,163 @@ static void process_received_message(aSmart_Comm_Handler_t* comm_handler) {
     } 
 		
 		else if (parsing_msg.msg_type == MSG_TYPE_NOTIFICATION || parsing_msg.msg_type == MSG_TYPE_ERROR) {
-        /* Handle notifications and errors */
-        if (comm_handler->response_callback) {
-            comm_handler->response_callback(parsing_msg.msg_type, parsing_msg.cmd_type, parsing_msg.seq_num, payload, payload_length);
-        }
         /* For errors, if sequence number is non-zero, it relates to a command */
         if (parsing_msg.msg_type == MSG_TYPE_ERROR && parsing_msg.seq_num != 0) {
+            /* An error answering a command is a valid round-trip sample as well */
+            CommandEntry_t* entry = find_command_in_mapping_table(comm_handler, parsing_msg.channel, parsing_msg.seq_num);
+            uint8_t control = 0;
+            if (entry != NULL) {
+                sample_round_trip(comm_handler, entry);
+                control = (entry->command_type >= CONTROL_COMMAND_FIRST);
+            }
+
             /* Remove related command from mapping table if exists */
-            remove_command_from_mapping_table(comm_handler, parsing_msg.seq_num);
+            remove_command_from_mapping_table(comm_handler, parsing_msg.channel, parsing_msg.seq_num);
+
+            /* A node that rejects a control command simply keeps the defaults */
+            if (control) {
+                return;
+            }
+
+#if ASMART_COMM_CHANNELS > 1
+            if (parsing_msg.channel != 0) {
+                deliver_channel_message(comm_handler, parsing_msg.channel, parsing_msg.msg_type, parsing_msg.cmd_type, parsing_msg.seq_num, payload, payload_length);
+                return;
+            }
+#endif
+
+            if (complete_request(comm_handler, parsing_msg.seq_num, REQUEST_FAILED, parsing_msg.cmd_type, payload, payload_length)) {
+                return;
+            }
+        }
+
+#if ASMART_COMM_CHANNELS > 1
+        if (parsing_msg.msg_type == MSG_TYPE_NOTIFICATION && parsing_msg.channel != 0) {
+            deliver_channel_message(comm_handler, parsing_msg.channel, parsing_msg.msg_type, parsing_msg.cmd_type, parsing_msg.seq_num, payload, payload_length);
+            return;
+        }
+#endif
+
+        if (parsing_msg.msg_type == MSG_TYPE_NOTIFICATION) {
+            /* Library control notifications stay inside the library */
+            if (parsing_msg.cmd_type >= CONTROL_COMMAND_FIRST) {
+                handle_control_notification(comm_handler, parsing_msg.source, parsing_msg.cmd_type, payload, payload_length);
+                return;
+            }
+#if ASMART_COMM_TELEMETRY
+            if (receive_telemetry(comm_handler, parsing_msg.source, parsing_msg.destination, parsing_msg.cmd_type, payload, payload_length)) {
+                return;
+            }
+#endif
+        }
+
+        /* Handle notifications and errors */
+        if (comm_handler->response_callback) {
+            comm_handler->response_callback(parsing_msg.msg_type, parsing_msg.cmd_type, parsing_msg.seq_num, payload, payload_length);
         }
     }
 }
 
 
 
-static void add_command_to_mapping_table(aSmart_Comm_Handler_t* comm_handler, uint16_t seq_num, uint8_t cmd_type) {
+static void add_command_to_mapping_table(aSmart_Comm_Handler_t* comm_handler, uint8_t channel, uint16_t seq_num, uint8_t cmd_type) {
     if (comm_handler->mapping_table_count < (sizeof(comm_handler->mapping_table) / sizeof(comm_handler->mapping_table[0]))) {
         CommandEntry_t* entry = &comm_handler->mapping_table[comm_handler->mapping_table_count++];
         entry->sequence_number = seq_num;
+        entry->channel = channel;
         entry->command_type = cmd_type;
-        entry->timestamp = HAL_GetTick();
+        entry->queued = 0;
+        entry->timestamp = asmart_comm_now();
+        entry->retries = 0;
+        entry->retransmit_slot = NO_RETRANSMIT_SLOT;
+        entry->fixed_timeout = 0;
+
+        /* Per-command-type override, else the link's adaptive timeout */
+        entry->timeout = asmart_rtt_timeout(&comm_handler->rtt);
+        for (uint8_t i = 0; i < comm_handler->rto_override_count; i++) {
+            if (comm_handler->rto_overrides[i].command_type == cmd_type) {
+                entry->timeout = comm_handler->rto_overrides[i].timeout_ms;
+                entry->fixed_timeout = 1;
+                break;
+            }
+        }
     } else {
         /* Handle mapping table full */
     }
 }
 
-static CommandEntry_t* find_command_in_mapping_table(aSmart_Comm_Handler_t* comm_handler, uint16_t seq_num) {
+static void keep_for_retransmission(aSmart_Comm_Handler_t* comm_handler, uint8_t channel, uint16_t seq_num) {
+    CommandEntry_t* entry = find_command_in_mapping_table(comm_handler, channel, seq_num);
+
+    if (entry == NULL || comm_handler->tx_handler.txd_length == 0 || comm_handler->tx_handler.txd_length > RETRANSMIT_FRAME_SIZE) {
+        return;
+    }
+    for (uint8_t i = 0; i < RETRANSMIT_SLOTS; i++) {
+        RetransmitSlot_t* slot = &comm_handler->retransmit_slots[i];
+        if (slot->frame_length == 0) {
+            memcpy(slot->frame, &comm_handler->tx_handler.txd_buffer[comm_handler->tx_handler.txd_start], comm_handler->tx_handler.txd_length);
+            slot->frame_length = comm_handler->tx_handler.txd_length;
+            entry->retransmit_slot = i;
+            return;
+        }
+    }
+    /* No free slot: the command times out without retransmission */
+}
+
+static uint8_t complete_request(aSmart_Comm_Handler_t* comm_handler, uint16_t seq_num, uint8_t status, uint8_t error_code, uint8_t* payload, uint16_t length) {
+    aSmart_Request_t** link = &comm_handler->pending_requests;
+
+    while (*link != NULL) {
+        aSmart_Request_t* request = *link;
+        if (request->sequence_number == seq_num) {
+            /* Unlink first, the completion may start the next request of the same flow */
+            *link = request->next;
+            request->next = NULL;
+
+            if (length > request->response_size) {
+                length = request->response_size;
+            }
+            if (payload != NULL && length > 0) {
+                memcpy(request->response, payload, length);
+            }
+            request->response_length = (payload != NULL) ? length : 0;
+            request->error_code = error_code;
+            request->status = status;
+
+            if (request->on_complete) {
+                request->on_complete(request);
+            }
+            return 1;
+        }
+        link = &request->next;
+    }
+    return 0;
+}
+
+static void sample_round_trip(aSmart_Comm_Handler_t* comm_handler, CommandEntry_t* entry) {
+    /* Karn's algorithm: the response to a retransmitted command is ambiguous */
+    if (entry->retries == 0 && !entry->fixed_timeout) {
+        asmart_rtt_sample(&comm_handler->rtt, asmart_comm_now() - entry->timestamp);
+    }
+}
+
+static CommandEntry_t* find_command_in_mapping_table(aSmart_Comm_Handler_t* comm_handler, uint8_t channel, uint16_t seq_num) {
     for (uint8_t i = 0; i < comm_handler->mapping_table_count; i++) {
-        if (comm_handler->mapping_table[i].sequence_number == seq_num) {
+        if (comm_handler->mapping_table[i].sequence_number == seq_num && comm_handler->mapping_table[i].channel == channel) {
             return &comm_handler->mapping_table[i];
         }
     }
     return NULL;
 }
 
-static void remove_command_from_mapping_table(aSmart_Comm_Handler_t* comm_handler, uint16_t seq_num) {
+static void remove_command_from_mapping_table(aSmart_Comm_Handler_t* comm_handler, uint8_t channel, uint16_t seq_num) {
     for (uint8_t i = 0; i < comm_handler->mapping_table_count; i++) {
-        if (comm_handler->mapping_table[i].sequence_number == seq_num) {
+        if (comm_handler->mapping_table[i].sequence_number == seq_num && comm_handler->mapping_table[i].channel == channel) {
+            /* Release the retransmission copy */
+            if (comm_handler->mapping_table[i].retransmit_slot != NO_RETRANSMIT_SLOT) {
+                comm_handler->retransmit_slots[comm_handler->mapping_table[i].retransmit_slot].frame_length = 0;
+            }
+
             /* Shift entries to fill the gap */
             for (uint8_t j = i; j < comm_handler->mapping_table_count - 1; j++) {
                 comm_handler->mapping_table[j] = comm_handler->mapping_table[j + 1];
@@ -465,17 +3529,65 @@ static void remove_command_from_mapping_table(aSmart_Comm_Handler_t* comm_handle
 }
 
 static void check_command_timeouts(aSmart_Comm_Handler_t* comm_handler) {
-    uint32_t current_time = HAL_GetTick();
+    uint32_t current_time = asmart_comm_now();
+    uint8_t backed_off = 0;
+
     for (uint8_t i = 0; i < comm_handler->mapping_table_count; ) {
         CommandEntry_t* entry = &comm_handler->mapping_table[i];
-        if (current_time - entry->timestamp > COMMAND_TIMEOUT_MS) {
+        if (!entry->queued && current_time - entry->timestamp > entry->timeout) {
+            if (entry->retries < COMMAND_MAX_RETRIES && entry->retransmit_slot != NO_RETRANSMIT_SLOT) {
+                /* Retransmit with the same sequence number and exponential backoff */
+                RetransmitSlot_t* slot = &comm_handler->retransmit_slots[entry->retransmit_slot];
+                transmit_frame(comm_handler, slot->frame, slot->frame_length);
+                entry->retries++;
+                entry->timestamp = current_time;
+                if (entry->fixed_timeout) {
+                    /* A timeout set for the command type may exceed RTO_MAX_MS and is not cut short */
+                    if (entry->timeout <= (0xFFFFFFFFU >> 2)) {
+                        entry->timeout <<= 1;
+                    }
+                }
+                else {
+                    entry->timeout = (entry->timeout << 1) > RTO_MAX_MS ? RTO_MAX_MS : (entry->timeout << 1);
+
+                    /* The link backs off once per expiry (RFC 6298 5.5), however many commands it hit */
+                    if (!backed_off) {
+                        asmart_rtt_backoff(&comm_handler->rtt);
+                        backed_off = 1;
+                    }
+                }
+                i++;
+                continue;
+            }
+
             /* Handle timeout */
-            if (comm_handler->response_callback) {
+            uint16_t seq_num = entry->sequence_number;
+            uint8_t cmd_type = entry->command_type;
+            uint8_t channel = entry->channel;
+
+            /* Remove the command from the mapping table */
+            remove_command_from_mapping_table(comm_handler, channel, seq_num);
+
+#if ASMART_COMM_CHANNELS > 1
+            if (channel != 0) {
+                deliver_channel_message(comm_handler, channel, MSG_TYPE_ERROR, cmd_type, seq_num, NULL, 0);
+                continue;
+            }
+#endif
+
+#if ASMART_COMM_BULK
+            /* The receiver stopped answering the open or finish command */
+            aSmart_BulkTx_t* tx = comm_handler->bulk_tx;
+            if ((cmd_type == CONTROL_COMMAND_BULK_OPEN && tx != NULL && tx->state == BULK_OPENING) || (cmd_type == CONTROL_COMMAND_BULK_FINISH && tx != NULL && tx->state == BULK_FINISHING)) {
+                end_bulk_send(comm_handler, BULK_TIMEOUT, 0);
+                continue;
+            }
+#endif
+
+            if (!complete_request(comm_handler, seq_num, REQUEST_TIMEOUT, 0, NULL, 0) && cmd_type < CONTROL_COMMAND_FIRST && comm_handler->response_callback) {
                 /* Indicate timeout by passing NULL payload */
-                comm_handler->response_callback(MSG_TYPE_ERROR, entry->command_type, entry->sequence_number, NULL, 0);
+                comm_handler->response_callback(MSG_TYPE_ERROR, cmd_type, seq_num, NULL, 0);
             }
-            /* Remove the command from the mapping table */
-            remove_command_from_mapping_table(comm_handler, entry->sequence_number);
         } 
 				else {
             i++;  /* Only increment if no removal occurred */
@@ -483,16 +3595,212 @@ static void check_command_timeouts(aSmart_Comm_Handler_t* comm_handler) {
     }
 }
 
+static uint32_t next_deadline(aSmart_Comm_Handler_t* comm_handler) {
+    uint32_t now = asmart_comm_now();
+    uint32_t next = ASMART_COMM_NO_DEADLINE;
+
+    /* Frames that arrived during the dispatch */
+    if (asmart_comm_rx_pending(comm_handler)) {
+        return 0;
+    }
+
+    /* A command times out, or is retransmitted, once more than its timeout has passed */
+    for (uint8_t i = 0; i < comm_handler->mapping_table_count; i++) {
+        CommandEntry_t* entry = &comm_handler->mapping_table[i];
+        uint32_t left = time_left(entry->timestamp, entry->timeout + 1, now);
+
+        if (!entry->queued && left < next) {
+            next = left;
+        }
+    }
+
+#if ASMART_COMM_CHANNELS > 1
+    for (uint8_t i = 0; i < ASMART_COMM_CHANNELS - 1; i++) {
+        aSmart_Channel_t* logical = &comm_handler->channels[i];
+        ChannelFrame_t* frame = logical->open ? asmart_channel_head(logical) : NULL;
+
+        if (frame == NULL) {
+            continue;
+        }
+#if ASMART_COMM_RX_CREDITS
+        /* Waiting for link credit, which arrives with a frame; see the resync below */
+        CreditPeer_t* peer = find_credit_peer(comm_handler, logical->peer);
+        if (peer != NULL && peer->blocked) {
+            continue;
+        }
+#endif
+        if (asmart_channel_has_credit(logical, frame->sequence_number) || !logical->blocked) {
+            return 0;
+        }
+        uint32_t left = time_left(logical->blocked_since, CHANNEL_PROBE_MS, now);
+        if (left < next) {
+            next = left;
+        }
+    }
+#endif
+
+    /* Held frames whose node has credit again, once their port is free and the RS485 response gap has passed */
+    uint32_t gap_left = response_gap_left(comm_handler);
+    for (uint8_t i = 0; i < comm_handler->held_count; i++) {
+        uint8_t ready = !comm_handler->held_frames[i].counted;
+#if ASMART_COMM_RX_CREDITS
+        CreditPeer_t* peer = find_credit_peer(comm_handler, comm_handler->held_frames[i].destination);
+
+        if (peer == NULL || !peer->active || ((peer->sent - peer->acknowledged) & CREDIT_COUNTER_MASK) < RX_CREDIT_WINDOW) {
+            ready = 1;
+        }
+#endif
+#if ASMART_COMM_BRIDGE
+        /* A frame cut through the port is cut off if it stalls */
+        if (ready && comm_handler->port_owner != PORT_FREE && comm_handler->port_waiting) {
+            uint32_t left = time_left(comm_handler->port_waiting_since, BRIDGE_CUT_THROUGH_TIMEOUT_MS, now);
+            if (left < next) {
+                next = left;
+            }
+            continue;
+        }
+#endif
+        if (ready && gap_left != 0) {
+            uint32_t left = (gap_left + 999) / 1000;
+            if (left < next) {
+                next = left;
+            }
+            continue;
+        }
+        if (ready) {
+            return 0;
+        }
+    }
+
+#if ASMART_COMM_RX_CREDITS
+    for (uint8_t i = 0; i < CREDIT_PEERS; i++) {
+        CreditPeer_t* peer = &comm_handler->credit_peers[i];
+
+        if (peer->address != ADDRESS_UNASSIGNED && peer->blocked) {
+            uint32_t left = time_left(peer->blocked_since, CREDIT_RESYNC_MS, now);
+            if (left < next) {
+                next = left;
+            }
+        }
+    }
+#endif
+
+#if ASMART_COMM_BULK
+    /* Blocks ready to send, or the next probe of a stalled transfer */
+    if (comm_handler->bulk_tx != NULL && comm_handler->bulk_tx->state == BULK_STREAMING) {
+        uint32_t left = asmart_bulk_tx_deadline(comm_handler->bulk_tx, now, asmart_rtt_timeout(&comm_handler->rtt));
+        if (left < next) {
+            next = left;
+        }
+    }
+#endif
+    return next;
+}
+
+static uint32_t time_left(uint32_t since, uint32_t interval, uint32_t now) {
+    uint32_t elapsed = now - since;
+
+    return (elapsed >= interval) ? 0 : interval - elapsed;
+}
+
+#if ASMART_COMM_HOST
+/* The host has no UART callbacks, see asmart_comm_host.c */
+#elif ASMART_COMM_STREAMING_RX
+/* UART receive complete callback function, one word per call */
+void HAL_UART_RxCpltCallback(UART_HandleTypeDef *huart) {
+    aSmart_Comm_Handler_t* comm_handler = find_port_handler(huart);
+
+    if (comm_handler != NULL) {
+        uint16_t word = comm_handler->rx_handler.rxd_word;
+        uint8_t byte = (uint8_t)word;
+
+        if (word & 0x100) {
+            /* Matching address mark (9-bit mute mode), a new frame follows */
+            asmart_parser_reset(&comm_handler->rx_handler.parser);
+        }
+        else {
+            asmart_comm_receive_bytes(comm_handler, &byte, 1);
+        }
+
+        /* Re-arm for the next word */
+        start_reception(comm_handler);
+    }
+}
+#else
 /* UART receive callback function */
 void HAL_UARTEx_RxEventCallback(UART_HandleTypeDef *huart, uint16_t Size) {
-    if (huart->Instance == COMM_UART.Instance) {
-        ptr_handler->rx_handler.rxd_index = Size;
-        ptr_handler->rx_handler.message_ready = 1;
+    aSmart_Comm_Handler_t* comm_handler = find_port_handler(huart);
+
+    if (comm_handler != NULL) {
+        aSmart_RxHandler_t* rx_handler = &comm_handler->rx_handler;
+
+#if ASMART_COMM_ADDRESS_MUTE_MODE
+        Size = unpack_9bit_frame(rx_handler->slots[0].buffer, Size);
+#endif
+        rx_handler->slots[0].length = Size;
+
+        /* A block arriving before the last one was processed has overwritten it */
+        if (rx_handler->slot_in == rx_handler->slot_out) {
+            rx_handler->slot_in++;
+        }
+        else {
+            rx_handler->overruns++;
+        }
 
         /* Re-initiate the reception for the next message */
-        HAL_UARTEx_ReceiveToIdle_IT(&COMM_UART, ptr_handler->rx_handler.rxd_buffer, ptr_handler->rx_handler.rxd_buffer_size);
+        start_reception(comm_handler);
     }
 }
+#endif
+
+#if !ASMART_COMM_HOST && ASMART_COMM_BRIDGE
+/* UART transmit complete callback function, a part of the relay ring has been sent */
+void HAL_UART_TxCpltCallback(UART_HandleTypeDef *huart) {
+    aSmart_Comm_Handler_t* comm_handler = find_port_handler(huart);
 
+    if (comm_handler != NULL && comm_handler->relay_sending != 0) {
+        comm_handler->relay_tail += comm_handler->relay_sending;
+        comm_handler->relay_sending = 0;
+        drain_relay(comm_handler);
+    }
+}
+#endif
 
+#if !ASMART_COMM_HOST
+static aSmart_Comm_Handler_t* find_port_handler(UART_HandleTypeDef* huart) {
+    for (uint8_t i = 0; i < ASMART_COMM_PORTS; i++) {
+        if (port_handlers[i] != NULL && port_handlers[i]->uart->Instance == huart->Instance) {
+            return port_handlers[i];
+        }
+    }
+    return NULL;
+}
+#endif
 
+#if defined(__CC_ARM)
+/* ARM Compiler 5 has no GNU inline assembly and defines __GNUC__ with --gnu; __cpp() takes the sizes */
+__asm static void export_footprint(void) {
+    EXPORT asmart_comm_ram_handler
+    EXPORT asmart_comm_ram_rx
+    EXPORT asmart_comm_ram_tx
+    EXPORT asmart_comm_ram_commands
+    EXPORT asmart_comm_ram_profile
+asmart_comm_ram_handler EQU __cpp(sizeof(aSmart_Comm_Handler_t))
+asmart_comm_ram_rx EQU __cpp(sizeof(aSmart_RxHandler_t))
+asmart_comm_ram_tx EQU __cpp(sizeof(aSmart_TxHandler_t))
+asmart_comm_ram_commands EQU __cpp(sizeof(((aSmart_Comm_Handler_t*)0)->mapping_table) + sizeof(((aSmart_Comm_Handler_t*)0)->retransmit_slots))
+asmart_comm_ram_profile EQU __cpp(ASMART_COMM_PROFILE)
+}
+#elif defined(__GNUC__)
+static void export_footprint(void) {
+    __asm__ volatile(".globl asmart_comm_ram_handler\n\t.set asmart_comm_ram_handler, %c0\n\t"
+                     ".globl asmart_comm_ram_rx\n\t.set asmart_comm_ram_rx, %c1\n\t"
+                     ".globl asmart_comm_ram_tx\n\t.set asmart_comm_ram_tx, %c2\n\t"
+                     ".globl asmart_comm_ram_commands\n\t.set asmart_comm_ram_commands, %c3\n\t"
+                     ".globl asmart_comm_ram_profile\n\t.set asmart_comm_ram_profile, %c4"
+                     :
+                     : "i"(sizeof(aSmart_Comm_Handler_t)), "i"(sizeof(aSmart_RxHandler_t)), "i"(sizeof(aSmart_TxHandler_t)),
+                       "i"(sizeof(((aSmart_Comm_Handler_t*)0)->mapping_table) + sizeof(((aSmart_Comm_Handler_t*)0)->retransmit_slots)),
+                       "i"(ASMART_COMM_PROFILE));
+}
+#endif
@@ -0,0 +1,262 @@
+#include "asmart_comm_parser.h"
+#include "asmart_comm_handler.h"
+#include "crc16.h"
+
+/***********************************************************************************************
+ *                                Streaming Frame Parser                                        *
+ ***********************************************************************************************
+ *
+ * - Bytes are fed one at a time, typically from the UART receive interrupt.
+ * - STX starts a standard frame, SOH a compact one. The Length field is checked against the
+ *   buffer size as soon as it is complete, and the CRC is updated as each byte arrives.
+ * - Once the header is in, it is decoded into `header` for either layout and the header
+ *   callback may reject the frame (e.g. wrong destination). The rest of that frame is then
+ *   only counted, neither stored nor CRC'd, up to its Length, which already had to fit the
+ *   buffer; a standard frame must still end with ETX there, else it counts as an error.
+ * - The header callback may also pass the frame through: the rest is reported byte by byte
+ *   for the caller to relay, with the CRC left to the final receiver.
+ * - The frame is validated with its last byte (ETX, or the CRC for compact frames); there
+ *   is no pass over the buffer afterwards.
+ * - Any error drops the frame and the parser hunts for the next STX or SOH.
+ *
+ ***********************************************************************************************/
+
+/**
+ * @brief Drops the current frame, restarting on the given byte if it starts a frame.
+ * @param parser Pointer to the parser structure.
+ * @param byte Byte that caused the error.
+ * @retval PARSE_ERROR
+ */
+static parse_result_t parser_error(aSmart_Parser_t* parser, uint8_t byte);
+
+/**
+ * @brief Starts a new frame.
+ * @param parser Pointer to the parser structure.
+ * @param start_byte STX or SOH.
+ * @retval None
+ */
+static void parser_start_frame(aSmart_Parser_t* parser, uint8_t start_byte);
+
+/**
+ * @brief Sets the frame boundaries once the Length field is complete.
+ * @param parser Pointer to the parser structure.
+ * @param crc_end Index one past the last CRC-covered byte.
+ * @param byte Last byte of the Length field.
+ * @retval PARSE_PENDING, or PARSE_ERROR if the frame cannot fit the buffer.
+ */
+static parse_result_t parser_set_length(aSmart_Parser_t* parser, uint32_t crc_end, uint8_t byte);
+
+/**
+ * @brief Decodes the received header into parser->header.
+ * @param parser Pointer to the parser structure.
+ * @retval None
+ */
+static void parser_decode_header(aSmart_Parser_t* parser);
+
+void asmart_parser_init(aSmart_Parser_t* parser, uint8_t* buffer, uint16_t buffer_size, HeaderCallback header_callback, void* context){
+    parser->buffer = buffer;
+    parser->buffer_size = buffer_size;
+    parser->header_callback = header_callback;
+    parser->context = context;
+    parser->frame_length = 0;
+    memset(&parser->header, 0, sizeof(parser->header));
+    asmart_parser_reset(parser);
+}
+
+void asmart_parser_reset(aSmart_Parser_t* parser){
+    parser->state = PARSER_STATE_WAIT_STX;
+    parser->index = 0;
+    parser->skip_remaining = 0;
+}
+
+parse_result_t asmart_parser_feed(aSmart_Parser_t* parser, uint8_t byte){
+    switch (parser->state) {
+        case PARSER_STATE_WAIT_STX:
+            if (byte == STX || byte == SOH) {
+                parser_start_frame(parser, byte);
+            }
+            return PARSE_PENDING;
+
+        case PARSER_STATE_LENGTH:
+            parser->buffer[parser->index++] = byte;
+            parser->crc = crc16_update(parser->crc, byte);
+
+            /* Length is complete: reject frames that cannot fit before storing them */
+            if (!parser->compact) {
+                if (parser->index == 3) {
+                    uint16_t msg_length = (parser->buffer[1] << 8) | parser->buffer[2];
+                    if (msg_length < FRAME_MIN_LENGTH) {
+                        return parser_error(parser, byte);
+                    }
+                    return parser_set_length(parser, (uint32_t)msg_length + 1, byte);
+                }
+            }
+            else if (!(byte & 0x80)) {
+                uint16_t msg_length = parser->buffer[1] & 0x7F;
+                if (parser->index == 3) {
+                    msg_length |= (uint16_t)byte << 7;
+                }
+                if (msg_length < COMPACT_HEADER_MIN_SIZE) {
+                    return parser_error(parser, byte);
+                }
+                return parser_set_length(parser, (uint32_t)parser->index + msg_length, byte);
+            }
+            else if (parser->index == 1 + COMPACT_LENGTH_MAX_BYTES) {
+                /* Varint longer than any frame that fits */
+                return parser_error(parser, byte);
+            }
+            return PARSE_PENDING;
+
+        case PARSER_STATE_HEADER:
+            parser->buffer[parser->index++] = byte;
+            parser->crc = crc16_update(parser->crc, byte);
+
+            /* Compact Type/Flags byte: the Sequence Number follows only if flagged */
+            if (parser->compact && parser->index == parser->length_end + 3 && (byte & COMPACT_FLAG_SEQUENCE)) {
+                parser->header_end += 2;
+                if (parser->header_end > parser->crc_end) {
+                    return parser_error(parser, byte);
+                }
+            }
+
+            if (parser->index == parser->header_end) {
+                header_action_t action = HEADER_ACCEPT;
+
+                parser_decode_header(parser);
+                if (parser->header_callback != NULL) {
+                    action = parser->header_callback(parser->context, &parser->header);
+                }
+                if (action != HEADER_ACCEPT) {
+                    parser->skip_remaining = parser->crc_end - parser->index + (parser->compact ? COMPACT_TRAILER_SIZE : FRAME_TRAILER_SIZE);
+                    if (action == HEADER_FORWARD) {
+                        parser->state = PARSER_STATE_FORWARD;
+                        return PARSE_FORWARD_START;
+                    }
+                    parser->state = PARSER_STATE_SKIP;
+                }
+                else {
+                    parser->state = (parser->index == parser->crc_end) ? PARSER_STATE_CRC_HI : PARSER_STATE_PAYLOAD;
+                }
+            }
+            return PARSE_PENDING;
+
+        case PARSER_STATE_PAYLOAD:
+            parser->buffer[parser->index++] = byte;
+            parser->crc = crc16_update(parser->crc, byte);
+            if (parser->index == parser->crc_end) {
+                parser->state = PARSER_STATE_CRC_HI;
+            }
+            return PARSE_PENDING;
+
+        case PARSER_STATE_CRC_HI:
+            parser->buffer[parser->index++] = byte;
+            parser->state = PARSER_STATE_CRC_LO;
+            return PARSE_PENDING;
+
+        case PARSER_STATE_CRC_LO:
+            parser->buffer[parser->index++] = byte;
+            if (((parser->buffer[parser->index - 2] << 8) | byte) != parser->crc) {
+                /* CRC mismatch */
+                return parser_error(parser, byte);
+            }
+            if (parser->compact) {
+                /* Compact frames end with the CRC */
+                parser->frame_length = parser->index;
+                asmart_parser_reset(parser);
+                return PARSE_FRAME;
+            }
+            parser->state = PARSER_STATE_ETX;
+            return PARSE_PENDING;
+
+        case PARSER_STATE_ETX:
+            if (byte != ETX) {
+                /* Invalid framing */
+                return parser_error(parser, byte);
+            }
+            parser->buffer[parser->index++] = byte;
+            parser->frame_length = parser->index;
+            asmart_parser_reset(parser);
+            return PARSE_FRAME;
+
+        case PARSER_STATE_SKIP:
+            /* At most a buffer's worth: the Length was checked against it before the skip */
+            if (--parser->skip_remaining == 0) {
+                if (!parser->compact && byte != ETX) {
+                    /* Damaged Length, the skip ended inside another frame */
+                    return parser_error(parser, byte);
+                }
+                asmart_parser_reset(parser);
+                return PARSE_SKIPPED;
+            }
+            return PARSE_PENDING;
+
+        case PARSER_STATE_FORWARD:
+            if (--parser->skip_remaining == 0) {
+                asmart_parser_reset(parser);
+                return PARSE_FORWARDED;
+            }
+            return PARSE_FORWARD;
+
+        default:
+            asmart_parser_reset(parser);
+            return PARSE_PENDING;
+    }
+}
+
+static parse_result_t parser_error(aSmart_Parser_t* parser, uint8_t byte){
+    asmart_parser_reset(parser);
+    if (byte == STX || byte == SOH) {
+        parser_start_frame(parser, byte);
+    }
+    return PARSE_ERROR;
+}
+
+static void parser_start_frame(aSmart_Parser_t* parser, uint8_t start_byte){
+    parser->buffer[0] = start_byte;
+    parser->index = 1;
+    parser->compact = (start_byte == SOH);
+    parser->crc = CRC16_INIT;
+    parser->state = PARSER_STATE_LENGTH;
+}
+
+static parse_result_t parser_set_length(aSmart_Parser_t* parser, uint32_t crc_end, uint8_t byte){
+    uint16_t trailer_size = parser->compact ? COMPACT_TRAILER_SIZE : FRAME_TRAILER_SIZE;
+
+    if (crc_end + trailer_size > parser->buffer_size) {
+        return parser_error(parser, byte);
+    }
+    parser->length_end = parser->index;
+    parser->crc_end = (uint16_t)crc_end;
+    parser->header_end = parser->compact ? parser->index + COMPACT_HEADER_MIN_SIZE : FRAME_HEADER_SIZE;
+    parser->state = PARSER_STATE_HEADER;
+    return PARSE_PENDING;
+}
+
+static void parser_decode_header(aSmart_Parser_t* parser){
+    uint8_t* buffer = parser->buffer;
+    aSmart_FrameHeader_t* header = &parser->header;
+
+    uint8_t type_byte;
+
+    if (!parser->compact) {
+        header->destination = buffer[3];
+        header->source = buffer[4];
+        header->sequence_number = (buffer[5] << 8) | buffer[6];
+        type_byte = buffer[7];
+    }
+    else {
+        uint16_t index = parser->length_end;
+        header->destination = buffer[index];
+        header->source = buffer[index + 1];
+        type_byte = buffer[index + 2];
+        header->sequence_number = (type_byte & COMPACT_FLAG_SEQUENCE) ? ((buffer[index + 3] << 8) | buffer[index + 4]) : 0;
+    }
+    header->message_type = type_byte & FRAME_TYPE_MASK;
+    header->channel = (type_byte & FRAME_CHANNEL_MASK) >> FRAME_CHANNEL_SHIFT;
+    header->credit = (type_byte & FRAME_CREDIT_MASK) >> FRAME_CREDIT_SHIFT;
+    header->flags = type_byte & ~(FRAME_TYPE_MASK | FRAME_CHANNEL_MASK | FRAME_CREDIT_MASK);
+    header->command_type = buffer[parser->header_end - 1];
+    header->compact = parser->compact;
+    header->payload_offset = parser->header_end;
+    header->payload_length = parser->crc_end - parser->header_end;
+}
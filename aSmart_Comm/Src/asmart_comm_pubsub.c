@@ -0,0 +1,128 @@
+#include "asmart_comm_pubsub.h"
+#include <string.h>
+
+/***********************************************************************************************
+ *                                Publish / Subscribe                                           *
+ ***********************************************************************************************
+ *
+ * - A topic is a notification type the publisher only sends to nodes subscribed to it.
+ * - Subscriptions are keyed by (subscriber, topic) and carry an optional rate limit
+ *   (minimum interval) and decimation (every n-th publication).
+ * - A bitset per topic tells whether anyone is subscribed, so an unwanted notification is
+ *   dropped with one bit test, before its frame is assembled.
+ * - Subscriptions are soft state: they are lost when the publisher restarts, subscribers
+ *   renew them by subscribing again.
+ *
+ ***********************************************************************************************/
+
+static uint8_t test_bit(const uint8_t* bits, uint8_t topic){
+    return (bits[topic >> 3] >> (topic & 0x07)) & 0x01;
+}
+
+static void update_subscribed(aSmart_PubSub_t* pubsub, uint8_t topic){
+    for (uint8_t i = 0; i < SUBSCRIPTION_ENTRIES; i++) {
+        if (pubsub->entries[i].subscriber != PUBSUB_ANY_SUBSCRIBER && pubsub->entries[i].topic == topic) {
+            pubsub->subscribed[topic >> 3] |= (1 << (topic & 0x07));
+            return;
+        }
+    }
+    pubsub->subscribed[topic >> 3] &= ~(1 << (topic & 0x07));
+}
+
+void asmart_pubsub_init(aSmart_PubSub_t* pubsub){
+    memset(pubsub, 0, sizeof(*pubsub));
+}
+
+void asmart_pubsub_set_filtered(aSmart_PubSub_t* pubsub, uint8_t topic, uint8_t filtered){
+    if (filtered) {
+        pubsub->filtered[topic >> 3] |= (1 << (topic & 0x07));
+    }
+    else {
+        pubsub->filtered[topic >> 3] &= ~(1 << (topic & 0x07));
+    }
+}
+
+uint8_t asmart_pubsub_subscribe(aSmart_PubSub_t* pubsub, uint8_t subscriber, uint8_t topic, uint16_t min_interval_ms, uint8_t decimation){
+    aSmart_Subscription_t* slot = NULL;
+
+    if (subscriber == PUBSUB_ANY_SUBSCRIBER) {
+        return 0;
+    }
+
+    for (uint8_t i = 0; i < SUBSCRIPTION_ENTRIES; i++) {
+        aSmart_Subscription_t* entry = &pubsub->entries[i];
+
+        /* Subscribing again updates the limits and keeps the timing */
+        if (entry->subscriber == subscriber && entry->topic == topic) {
+            entry->min_interval_ms = min_interval_ms;
+            entry->decimation = decimation;
+            return 1;
+        }
+        if (slot == NULL && entry->subscriber == PUBSUB_ANY_SUBSCRIBER) {
+            slot = entry;
+        }
+    }
+    if (slot == NULL) {
+        return 0;
+    }
+
+    memset(slot, 0, sizeof(*slot));
+    slot->subscriber = subscriber;
+    slot->topic = topic;
+    slot->min_interval_ms = min_interval_ms;
+    slot->decimation = decimation;
+    pubsub->subscribed[topic >> 3] |= (1 << (topic & 0x07));
+    return 1;
+}
+
+void asmart_pubsub_unsubscribe(aSmart_PubSub_t* pubsub, uint8_t subscriber, uint8_t topic){
+    for (uint8_t i = 0; i < SUBSCRIPTION_ENTRIES; i++) {
+        aSmart_Subscription_t* entry = &pubsub->entries[i];
+
+        if (entry->subscriber == subscriber && entry->topic == topic) {
+            entry->subscriber = PUBSUB_ANY_SUBSCRIBER;
+            update_subscribed(pubsub, topic);
+            return;
+        }
+    }
+}
+
+uint8_t asmart_pubsub_should_send(aSmart_PubSub_t* pubsub, uint8_t destination, uint8_t topic, uint32_t now){
+    uint8_t send = 0;
+
+    if (!test_bit(pubsub->filtered, topic)) {
+        return 1;
+    }
+    if (!test_bit(pubsub->subscribed, topic)) {
+        return 0;
+    }
+
+    /* A group or broadcast notification goes out once for all subscribers that are due */
+    for (uint8_t i = 0; i < SUBSCRIPTION_ENTRIES; i++) {
+        aSmart_Subscription_t* entry = &pubsub->entries[i];
+
+        if (entry->subscriber == PUBSUB_ANY_SUBSCRIBER || entry->topic != topic) {
+            continue;
+        }
+        if (destination != PUBSUB_ANY_SUBSCRIBER && entry->subscriber != destination) {
+            continue;
+        }
+
+        /* Decimation counts every publication, the rate limit holds the due one back */
+        if (entry->skipped < 0xFF) {
+            entry->skipped++;
+        }
+        if (entry->skipped < entry->decimation) {
+            continue;
+        }
+        if (entry->sent && (now - entry->last_sent) < entry->min_interval_ms) {
+            continue;
+        }
+
+        entry->skipped = 0;
+        entry->sent = 1;
+        entry->last_sent = now;
+        send = 1;
+    }
+    return send;
+}
@@ -0,0 +1,90 @@
+#include "asmart_comm_replay.h"
+#include "asmart_comm_handler.h"
+#include <string.h>
+
+/***********************************************************************************************
+ *                                Response Replay Cache                                         *
+ ***********************************************************************************************
+ *
+ * - When a response is lost the peer re-sends the command with the same sequence number.
+ * - The last REPLAY_CACHE_ENTRIES commands run are remembered, keyed by
+ *   (peer, channel, sequence number, command type), before the application sees them, and
+ *   their encoded responses are kept once sent.
+ * - A retransmitted command is answered with the kept frame. Without one (the response is
+ *   still pending, was sent later or was too large to keep) it is dropped; either way the
+ *   application callback is not invoked again, so side effects happen once.
+ * - Eviction: entries older than REPLAY_CACHE_MAX_AGE_MS, the peer's retransmission window,
+ *   are dropped, and when the cache is full the oldest entry is replaced. A peer that restarts
+ *   its sequence numbers within that time may see a command taken as a repeat.
+ *
+ ***********************************************************************************************/
+
+void asmart_replay_init(aSmart_ReplayCache_t* cache){
+    memset(cache, 0, sizeof(*cache));
+}
+
+ReplayEntry_t* asmart_replay_record(aSmart_ReplayCache_t* cache, uint8_t peer, uint8_t channel, uint16_t sequence_number, uint8_t command_type, uint32_t now){
+    ReplayEntry_t* slot = &cache->entries[0];
+
+    for (uint8_t i = 0; i < REPLAY_CACHE_ENTRIES; i++) {
+        ReplayEntry_t* entry = &cache->entries[i];
+
+        /* The same command replaces the previous one */
+        if (entry->used && entry->peer == peer && entry->channel == channel && entry->sequence_number == sequence_number && entry->command_type == command_type) {
+            slot = entry;
+            break;
+        }
+        /* Otherwise prefer a free or expired entry, then the oldest */
+        if (!entry->used || (now - entry->timestamp) > REPLAY_CACHE_MAX_AGE_MS) {
+            if (slot->used) {
+                slot = entry;
+            }
+        }
+        else if (slot->used && (now - entry->timestamp) > (now - slot->timestamp)) {
+            slot = entry;
+        }
+    }
+
+    slot->peer = peer;
+    slot->channel = channel;
+    slot->sequence_number = sequence_number;
+    slot->command_type = command_type;
+    slot->used = 1;
+    slot->timestamp = now;
+    slot->frame_length = 0;
+    return slot;
+}
+
+void asmart_replay_store(aSmart_ReplayCache_t* cache, uint8_t peer, uint8_t channel, uint16_t sequence_number, uint8_t command_type, const uint8_t* frame, uint16_t frame_length, uint32_t now){
+    ReplayEntry_t* entry = asmart_replay_lookup(cache, peer, channel, sequence_number, command_type, now);
+
+    if (entry == NULL) {
+        entry = asmart_replay_record(cache, peer, channel, sequence_number, command_type, now);
+    }
+    /* Too large to keep: a repeat of the command is dropped instead of answered */
+    if (frame_length > REPLAY_CACHE_FRAME_SIZE) {
+        entry->frame_length = 0;
+        return;
+    }
+    entry->frame_length = frame_length;
+    memcpy(entry->frame, frame, frame_length);
+}
+
+ReplayEntry_t* asmart_replay_lookup(aSmart_ReplayCache_t* cache, uint8_t peer, uint8_t channel, uint16_t sequence_number, uint8_t command_type, uint32_t now){
+    for (uint8_t i = 0; i < REPLAY_CACHE_ENTRIES; i++) {
+        ReplayEntry_t* entry = &cache->entries[i];
+
+        if (!entry->used) {
+            continue;
+        }
+        if ((now - entry->timestamp) > REPLAY_CACHE_MAX_AGE_MS) {
+            /* Age-based eviction */
+            entry->used = 0;
+            continue;
+        }
+        if (entry->peer == peer && entry->channel == channel && entry->sequence_number == sequence_number && entry->command_type == command_type) {
+            return entry;
+        }
+    }
+    return NULL;
+}
@@ -0,0 +1,59 @@
+#include "asmart_comm_rs485.h"
+#include <stddef.h>
+
+/***********************************************************************************************
+ *                                       RS485 Turnaround                                       *
+ ***********************************************************************************************
+ *
+ * - One bit is 1e9 / baud ns, one sample time a sixteenth of it.
+ * - DEAT = driver enable time in sample times, rounded up: the driver is on at the start bit.
+ * - DEDT = propagation delay in sample times, rounded up: the stop bit reaches the far end.
+ * - Gap  = half a bit + DEDT + driver disable time + propagation delay, rounded up to µs.
+ *          The receiver takes a byte in the middle of its stop bit; the sender drives the bus
+ *          until the end of the stop bit, DEDT after it, and until its driver is off.
+ *
+ ***********************************************************************************************/
+
+/**
+ * @brief Converts a time to sample times, rounded up.
+ * @param ns Time (ns).
+ * @param baudrate Line speed.
+ * @retval Sample times.
+ */
+static uint32_t to_samples(uint32_t ns, uint32_t baudrate);
+
+uint8_t asmart_rs485_timing(aSmart_Rs485Timing_t* timing, uint32_t baudrate, const aSmart_Rs485Transceiver_t* transceiver){
+    static const aSmart_Rs485Transceiver_t defaults = {RS485_DRIVER_ENABLE_NS, RS485_DRIVER_DISABLE_NS, RS485_PROPAGATION_NS};
+    uint8_t fits = 1;
+
+    if (transceiver == NULL) {
+        transceiver = &defaults;
+    }
+
+    uint32_t de_assert = to_samples(transceiver->driver_enable_ns, baudrate);
+    uint32_t de_deassert = to_samples(transceiver->propagation_ns, baudrate);
+    if (de_assert > RS485_DE_TIME_MAX || de_deassert > RS485_DE_TIME_MAX) {
+        de_assert = (de_assert > RS485_DE_TIME_MAX) ? RS485_DE_TIME_MAX : de_assert;
+        de_deassert = (de_deassert > RS485_DE_TIME_MAX) ? RS485_DE_TIME_MAX : de_deassert;
+        fits = 0;
+    }
+    timing->baudrate = baudrate;
+    timing->de_assert = (uint8_t)de_assert;
+    timing->de_deassert = (uint8_t)de_deassert;
+
+    /* The other node's driver is still on for the rest of its stop bit, its DE hold and its turn-off */
+    uint64_t gap_ns = 500000000ULL / baudrate
+                    + (uint64_t)de_deassert * 1000000000ULL / ((uint64_t)baudrate * RS485_SAMPLES_PER_BIT)
+                    + transceiver->driver_disable_ns + transceiver->propagation_ns;
+    uint64_t gap_us = (gap_ns + 999) / 1000;
+    timing->response_gap_us = (gap_us > 0xFFFF) ? 0xFFFF : (uint16_t)gap_us;
+    return fits;
+}
+
+/* Internal function implementations */
+
+static uint32_t to_samples(uint32_t ns, uint32_t baudrate){
+    uint64_t scaled = (uint64_t)ns * baudrate * RS485_SAMPLES_PER_BIT;
+
+    return (uint32_t)((scaled + 999999999ULL) / 1000000000ULL);
+}
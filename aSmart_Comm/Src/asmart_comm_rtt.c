@@ -0,0 +1,78 @@
+#include "asmart_comm_rtt.h"
+
+/***********************************************************************************************
+ *                                Retransmission Timeout Estimation                             *
+ ***********************************************************************************************
+ *
+ * - Per link, from the time a command was sent to the time its response arrived.
+ * - First sample R:   SRTT = R, RTTVAR = R / 2
+ * - Further samples:  RTTVAR = 3/4 RTTVAR + 1/4 |SRTT - R|
+ *                     SRTT   = 7/8 SRTT   + 1/8 R
+ * - RTO = SRTT + max(G, 4 * RTTVAR), clamped to [RTO_MIN_MS, RTO_MAX_MS].
+ * - Each retransmission doubles the timeout until a fresh sample is taken.
+ *
+ ***********************************************************************************************/
+
+/**
+ * @brief Clamps a timeout to the configured limits.
+ * @param rto Timeout (ms).
+ * @retval Clamped timeout (ms).
+ */
+static uint32_t clamp_rto(uint32_t rto);
+
+void asmart_rtt_init(aSmart_RttEstimator_t* rtt, uint32_t initial_rto){
+    rtt->srtt_x8 = 0;
+    rtt->rttvar_x4 = 0;
+    rtt->rto = clamp_rto(initial_rto);
+    rtt->has_sample = 0;
+    rtt->backoff = 0;
+}
+
+void asmart_rtt_sample(aSmart_RttEstimator_t* rtt, uint32_t sample_ms){
+    uint32_t variance_term;
+
+    if (sample_ms > RTO_MAX_MS) {
+        sample_ms = RTO_MAX_MS;
+    }
+
+    if (!rtt->has_sample) {
+        rtt->srtt_x8 = sample_ms << 3;
+        rtt->rttvar_x4 = sample_ms << 1;
+        rtt->has_sample = 1;
+    }
+    else {
+        uint32_t srtt = rtt->srtt_x8 >> 3;
+        uint32_t delta = (srtt > sample_ms) ? (srtt - sample_ms) : (sample_ms - srtt);
+
+        /* rttvar_x4 += |err| - rttvar_x4 / 4, srtt_x8 += R - srtt_x8 / 8 */
+        rtt->rttvar_x4 = rtt->rttvar_x4 - (rtt->rttvar_x4 >> 2) + delta;
+        rtt->srtt_x8 = rtt->srtt_x8 - (rtt->srtt_x8 >> 3) + sample_ms;
+    }
+
+    variance_term = rtt->rttvar_x4;  /* 4 * RTTVAR */
+    if (variance_term < RTO_GRANULARITY_MS) {
+        variance_term = RTO_GRANULARITY_MS;
+    }
+    rtt->rto = clamp_rto((rtt->srtt_x8 >> 3) + variance_term);
+    rtt->backoff = 0;
+}
+
+void asmart_rtt_backoff(aSmart_RttEstimator_t* rtt){
+    if ((rtt->rto << rtt->backoff) < RTO_MAX_MS) {
+        rtt->backoff++;
+    }
+}
+
+uint32_t asmart_rtt_timeout(aSmart_RttEstimator_t* rtt){
+    return clamp_rto(rtt->rto << rtt->backoff);
+}
+
+static uint32_t clamp_rto(uint32_t rto){
+    if (rto < RTO_MIN_MS) {
+        return RTO_MIN_MS;
+    }
+    if (rto > RTO_MAX_MS) {
+        return RTO_MAX_MS;
+    }
+    return rto;
+}
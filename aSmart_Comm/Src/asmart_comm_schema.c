@@ -0,0 +1,197 @@
+#include "asmart_comm_schema.h"
+#include "asmart_comm_handler.h"
+
+/* Generated by Tools/asmart_idl.py from aSmart_Comm/Schema/asmart_comm.idl, do not edit */
+
+#if ASMART_COMM_SCHEMA_MAX_PAYLOAD > ASMART_COMM_MAX_PAYLOAD
+#error "A schema message does not fit one frame, increase TRANSMIT_BUFFER_SIZE"
+#endif
+#if ASMART_COMM_SCHEMA_MAX_PAYLOAD + FRAME_HEADER_SIZE + FRAME_TRAILER_SIZE > RECEIVE_BUFFER_SIZE
+#error "A schema message does not fit the receive buffer, increase RECEIVE_BUFFER_SIZE"
+#endif
+
+uint16_t asmart_encode_begin_transaction_command(const BeginTransactionCommand_t* message, uint8_t* buffer) {
+    uint16_t index = 0;
+    buffer[index++] = (message->transaction_id >> 24) & 0xFF;
+    buffer[index++] = (message->transaction_id >> 16) & 0xFF;
+    buffer[index++] = (message->transaction_id >> 8) & 0xFF;
+    buffer[index++] = message->transaction_id & 0xFF;
+    return index;
+}
+
+uint8_t asmart_decode_begin_transaction_command(const uint8_t* payload, uint16_t length, BeginTransactionCommand_t* message) {
+    uint16_t index = 0;
+    if (length != BEGIN_TRANSACTION_COMMAND_MAX_SIZE) {
+        return 0;
+    }
+    message->transaction_id = (uint32_t)(((uint32_t)payload[index + 0] << 24) | ((uint32_t)payload[index + 1] << 16) | ((uint32_t)payload[index + 2] << 8) | payload[index + 3]);
+    index += 4;
+    return 1;
+}
+
+void asmart_send_begin_transaction_command(aSmart_Comm_Handler_t* comm_handler, const BeginTransactionCommand_t* message) {
+    uint8_t* payload = asmart_comm_tx_payload(comm_handler);
+    uint16_t length = asmart_encode_begin_transaction_command(message, payload);
+    asmart_comm_send_command(comm_handler, COMMAND_TYPE_BEGIN_TRANSACTION, payload, length);
+}
+
+void asmart_request_begin_transaction(aSmart_Comm_Handler_t* comm_handler, aSmart_Request_t* request, const BeginTransactionCommand_t* message, uint8_t* response) {
+    uint8_t* payload = asmart_comm_tx_payload(comm_handler);
+    uint16_t length = asmart_encode_begin_transaction_command(message, payload);
+    asmart_comm_request(comm_handler, request, COMMAND_TYPE_BEGIN_TRANSACTION, payload, length, response, BEGIN_TRANSACTION_RESPONSE_MAX_SIZE);
+}
+
+/* Override in the application */
+__weak void asmart_on_begin_transaction_command(uint16_t sequence_number, const BeginTransactionCommand_t* message) {
+    (void)sequence_number;
+    (void)message;
+}
+
+static uint8_t handle_begin_transaction_command(uint16_t sequence_number, const uint8_t* payload, uint16_t length) {
+    BeginTransactionCommand_t message;
+    if (!asmart_decode_begin_transaction_command(payload, length, &message)) {
+        return 0;
+    }
+    asmart_on_begin_transaction_command(sequence_number, &message);
+    return 1;
+}
+
+uint16_t asmart_encode_begin_transaction_response(const BeginTransactionResponse_t* message, uint8_t* buffer) {
+    uint16_t index = 0;
+    buffer[index++] = (message->transaction_id >> 24) & 0xFF;
+    buffer[index++] = (message->transaction_id >> 16) & 0xFF;
+    buffer[index++] = (message->transaction_id >> 8) & 0xFF;
+    buffer[index++] = message->transaction_id & 0xFF;
+    return index;
+}
+
+uint8_t asmart_decode_begin_transaction_response(const uint8_t* payload, uint16_t length, BeginTransactionResponse_t* message) {
+    uint16_t index = 0;
+    if (length != BEGIN_TRANSACTION_RESPONSE_MAX_SIZE) {
+        return 0;
+    }
+    message->transaction_id = (uint32_t)(((uint32_t)payload[index + 0] << 24) | ((uint32_t)payload[index + 1] << 16) | ((uint32_t)payload[index + 2] << 8) | payload[index + 3]);
+    index += 4;
+    return 1;
+}
+
+void asmart_send_begin_transaction_response(aSmart_Comm_Handler_t* comm_handler, uint16_t sequence_number, const BeginTransactionResponse_t* message) {
+    uint8_t* payload = asmart_comm_tx_payload(comm_handler);
+    uint16_t length = asmart_encode_begin_transaction_response(message, payload);
+    asmart_comm_send_response(comm_handler, sequence_number, COMMAND_TYPE_BEGIN_TRANSACTION, payload, length);
+}
+
+/* Override in the application */
+__weak void asmart_on_begin_transaction_response(uint16_t sequence_number, const BeginTransactionResponse_t* message) {
+    (void)sequence_number;
+    (void)message;
+}
+
+static uint8_t handle_begin_transaction_response(uint16_t sequence_number, const uint8_t* payload, uint16_t length) {
+    BeginTransactionResponse_t message;
+    if (!asmart_decode_begin_transaction_response(payload, length, &message)) {
+        return 0;
+    }
+    asmart_on_begin_transaction_response(sequence_number, &message);
+    return 1;
+}
+
+uint16_t asmart_encode_end_transaction_command(const EndTransactionCommand_t* message, uint8_t* buffer) {
+    uint16_t index = 0;
+    buffer[index++] = (message->transaction_id >> 24) & 0xFF;
+    buffer[index++] = (message->transaction_id >> 16) & 0xFF;
+    buffer[index++] = (message->transaction_id >> 8) & 0xFF;
+    buffer[index++] = message->transaction_id & 0xFF;
+    return index;
+}
+
+uint8_t asmart_decode_end_transaction_command(const uint8_t* payload, uint16_t length, EndTransactionCommand_t* message) {
+    uint16_t index = 0;
+    if (length != END_TRANSACTION_COMMAND_MAX_SIZE) {
+        return 0;
+    }
+    message->transaction_id = (uint32_t)(((uint32_t)payload[index + 0] << 24) | ((uint32_t)payload[index + 1] << 16) | ((uint32_t)payload[index + 2] << 8) | payload[index + 3]);
+    index += 4;
+    return 1;
+}
+
+void asmart_send_end_transaction_command(aSmart_Comm_Handler_t* comm_handler, const EndTransactionCommand_t* message) {
+    uint8_t* payload = asmart_comm_tx_payload(comm_handler);
+    uint16_t length = asmart_encode_end_transaction_command(message, payload);
+    asmart_comm_send_command(comm_handler, COMMAND_TYPE_END_TRANSACTION, payload, length);
+}
+
+void asmart_request_end_transaction(aSmart_Comm_Handler_t* comm_handler, aSmart_Request_t* request, const EndTransactionCommand_t* message, uint8_t* response) {
+    uint8_t* payload = asmart_comm_tx_payload(comm_handler);
+    uint16_t length = asmart_encode_end_transaction_command(message, payload);
+    asmart_comm_request(comm_handler, request, COMMAND_TYPE_END_TRANSACTION, payload, length, response, END_TRANSACTION_RESPONSE_MAX_SIZE);
+}
+
+/* Override in the application */
+__weak void asmart_on_end_transaction_command(uint16_t sequence_number, const EndTransactionCommand_t* message) {
+    (void)sequence_number;
+    (void)message;
+}
+
+static uint8_t handle_end_transaction_command(uint16_t sequence_number, const uint8_t* payload, uint16_t length) {
+    EndTransactionCommand_t message;
+    if (!asmart_decode_end_transaction_command(payload, length, &message)) {
+        return 0;
+    }
+    asmart_on_end_transaction_command(sequence_number, &message);
+    return 1;
+}
+
+uint16_t asmart_encode_end_transaction_response(const EndTransactionResponse_t* message, uint8_t* buffer) {
+    uint16_t index = 0;
+    buffer[index++] = message->status & 0xFF;
+    return index;
+}
+
+uint8_t asmart_decode_end_transaction_response(const uint8_t* payload, uint16_t length, EndTransactionResponse_t* message) {
+    uint16_t index = 0;
+    if (length != END_TRANSACTION_RESPONSE_MAX_SIZE) {
+        return 0;
+    }
+    message->status = (uint8_t)(payload[index]);
+    index += 1;
+    return 1;
+}
+
+void asmart_send_end_transaction_response(aSmart_Comm_Handler_t* comm_handler, uint16_t sequence_number, const EndTransactionResponse_t* message) {
+    uint8_t* payload = asmart_comm_tx_payload(comm_handler);
+    uint16_t length = asmart_encode_end_transaction_response(message, payload);
+    asmart_comm_send_response(comm_handler, sequence_number, COMMAND_TYPE_END_TRANSACTION, payload, length);
+}
+
+/* Override in the application */
+__weak void asmart_on_end_transaction_response(uint16_t sequence_number, const EndTransactionResponse_t* message) {
+    (void)sequence_number;
+    (void)message;
+}
+
+static uint8_t handle_end_transaction_response(uint16_t sequence_number, const uint8_t* payload, uint16_t length) {
+    EndTransactionResponse_t message;
+    if (!asmart_decode_end_transaction_response(payload, length, &message)) {
+        return 0;
+    }
+    asmart_on_end_transaction_response(sequence_number, &message);
+    return 1;
+}
+
+const aSmart_SchemaEntry_t asmart_comm_schema_table[ASMART_COMM_SCHEMA_ENTRIES] = {
+    {MSG_TYPE_COMMAND, COMMAND_TYPE_BEGIN_TRANSACTION, BEGIN_TRANSACTION_COMMAND_MIN_SIZE, BEGIN_TRANSACTION_COMMAND_MAX_SIZE, handle_begin_transaction_command},
+    {MSG_TYPE_RESPONSE, COMMAND_TYPE_BEGIN_TRANSACTION, BEGIN_TRANSACTION_RESPONSE_MIN_SIZE, BEGIN_TRANSACTION_RESPONSE_MAX_SIZE, handle_begin_transaction_response},
+    {MSG_TYPE_COMMAND, COMMAND_TYPE_END_TRANSACTION, END_TRANSACTION_COMMAND_MIN_SIZE, END_TRANSACTION_COMMAND_MAX_SIZE, handle_end_transaction_command},
+    {MSG_TYPE_RESPONSE, COMMAND_TYPE_END_TRANSACTION, END_TRANSACTION_RESPONSE_MIN_SIZE, END_TRANSACTION_RESPONSE_MAX_SIZE, handle_end_transaction_response},
+};
+
+uint8_t asmart_comm_schema_dispatch(uint8_t message_type, uint8_t command_type, uint16_t sequence_number, const uint8_t* payload, uint16_t length) {
+    for (uint8_t i = 0; i < ASMART_COMM_SCHEMA_ENTRIES; i++) {
+        const aSmart_SchemaEntry_t* entry = &asmart_comm_schema_table[i];
+        if (entry->message_type == message_type && entry->command_type == command_type) {
+            return entry->handle(sequence_number, payload, length);
+        }
+    }
+    return 0;
+}
@@ -0,0 +1,466 @@
+#include "asmart_comm_secure.h"
+#include "asmart_comm_handler.h"
+#include <string.h>
+#if ASMART_COMM_HOST
+#include "asmart_comm_aesni.h"
+#endif
+
+/***********************************************************************************************
+ *                                Secured Links                                                 *
+ ***********************************************************************************************
+ *
+ * - A link key belongs to a pair of nodes; both use it for the frames they send each other.
+ *   Frames are sealed with AES-128 in CCM mode: the payload is encrypted in place in the
+ *   transmit buffer, the header (Length up to Command Type) is authenticated along with it.
+ * - Nonce: [Source][Destination][Counter]. Every node counts the frames it sends on a link,
+ *   and the addresses keep the two directions apart, so a nonce is never used twice under a
+ *   key. The counter travels behind the ciphertext, followed by the 8-byte tag.
+ * - Replay protection: the receiver keeps the highest counter accepted and a bitmap of the
+ *   SECURE_REPLAY_WINDOW counters below it, so frames may arrive out of order (channel
+ *   queues) but each counter is accepted once. A frame is only counted once its tag matched.
+ *   asmart_secure_restore_rx() brings the highest counter back after a restart, with the
+ *   whole window below it taken as seen.
+ * - Ciphers: the AES peripheral through the CRYP HAL with DMA where the part has one
+ *   (SECURE_HARDWARE), AES-NI on a host CPU that has it, and a byte-oriented software AES
+ *   otherwise. All of them produce the same frames.
+ *
+ ***********************************************************************************************/
+
+#define CCM_FLAGS_B0 0x59  // Adata, tag of SECURE_TAG_SIZE bytes ((8 - 2) / 2 << 3), 2-byte length field (L - 1)
+#define CCM_FLAGS_COUNTER 0x01  // Counter blocks: 2-byte counter (L - 1)
+
+#if SECURE_MAX_AAD > 14
+#error "The authenticated header must fit one CCM block with its length"
+#endif
+
+#if SECURE_HARDWARE
+extern CRYP_HandleTypeDef SECURE_CRYP;
+
+/**
+ * @brief Runs CCM on the AES peripheral, data staged in a word-aligned buffer for the DMA.
+ * @param link Pointer to the link.
+ * @param nonce SECURE_NONCE_SIZE bytes.
+ * @param aad Header to authenticate.
+ * @param aad_length Header length.
+ * @param data Payload, encrypted or decrypted in place.
+ * @param length Payload length.
+ * @param tag Receives the SECURE_TAG_SIZE byte tag computed.
+ * @param encrypt 1 to encrypt, 0 to decrypt.
+ * @retval 1 on success, 0 if the peripheral failed.
+ */
+static uint8_t hardware_ccm(SecureLink_t* link, const uint8_t* nonce, const uint8_t* aad, uint16_t aad_length, uint8_t* data, uint16_t length, uint8_t* tag, uint8_t encrypt);
+#else
+/**
+ * @brief Expands an AES-128 key into its round keys.
+ * @param key SECURE_KEY_SIZE bytes.
+ * @param round_keys Receives SECURE_ROUND_KEYS bytes.
+ * @retval None
+ */
+static void aes_expand_key(const uint8_t* key, uint8_t* round_keys);
+
+/**
+ * @brief Encrypts one block with the software AES, see SecureBlockCipher.
+ * @param round_keys Expanded key.
+ * @param in Plaintext block.
+ * @param out Ciphertext block, may be in.
+ * @retval None
+ */
+static void aes_encrypt_block(const uint8_t* round_keys, const uint8_t* in, uint8_t* out);
+
+/**
+ * @brief Runs CCM with the link's block cipher.
+ * @param link Pointer to the link.
+ * @param nonce SECURE_NONCE_SIZE bytes.
+ * @param aad Header to authenticate.
+ * @param aad_length Header length.
+ * @param data Payload, encrypted or decrypted in place.
+ * @param length Payload length.
+ * @param tag Receives the SECURE_TAG_SIZE byte tag computed.
+ * @param encrypt 1 to encrypt, 0 to decrypt.
+ * @retval None
+ */
+static void software_ccm(const SecureLink_t* link, const uint8_t* nonce, const uint8_t* aad, uint16_t aad_length, uint8_t* data, uint16_t length, uint8_t* tag, uint8_t encrypt);
+#endif
+
+/**
+ * @brief Builds the nonce of a frame.
+ * @param nonce Receives SECURE_NONCE_SIZE bytes.
+ * @param source Address of the sender.
+ * @param destination Address of the receiver.
+ * @param counter Frame counter of the sender.
+ * @retval None
+ */
+static void build_nonce(uint8_t* nonce, uint8_t source, uint8_t destination, uint32_t counter);
+
+/**
+ * @brief Records the counter of an authentic frame in the replay window.
+ * @param link Pointer to the link.
+ * @param counter Received counter.
+ * @retval 1 if the counter is new, 0 if it was accepted before or lies below the window.
+ */
+static uint8_t accept_counter(SecureLink_t* link, uint32_t counter);
+
+#if !SECURE_HARDWARE
+static const uint8_t sbox[256] = {
+    0x63, 0x7c, 0x77, 0x7b, 0xf2, 0x6b, 0x6f, 0xc5, 0x30, 0x01, 0x67, 0x2b, 0xfe, 0xd7, 0xab, 0x76,
+    0xca, 0x82, 0xc9, 0x7d, 0xfa, 0x59, 0x47, 0xf0, 0xad, 0xd4, 0xa2, 0xaf, 0x9c, 0xa4, 0x72, 0xc0,
+    0xb7, 0xfd, 0x93, 0x26, 0x36, 0x3f, 0xf7, 0xcc, 0x34, 0xa5, 0xe5, 0xf1, 0x71, 0xd8, 0x31, 0x15,
+    0x04, 0xc7, 0x23, 0xc3, 0x18, 0x96, 0x05, 0x9a, 0x07, 0x12, 0x80, 0xe2, 0xeb, 0x27, 0xb2, 0x75,
+    0x09, 0x83, 0x2c, 0x1a, 0x1b, 0x6e, 0x5a, 0xa0, 0x52, 0x3b, 0xd6, 0xb3, 0x29, 0xe3, 0x2f, 0x84,
+    0x53, 0xd1, 0x00, 0xed, 0x20, 0xfc, 0xb1, 0x5b, 0x6a, 0xcb, 0xbe, 0x39, 0x4a, 0x4c, 0x58, 0xcf,
+    0xd0, 0xef, 0xaa, 0xfb, 0x43, 0x4d, 0x33, 0x85, 0x45, 0xf9, 0x02, 0x7f, 0x50, 0x3c, 0x9f, 0xa8,
+    0x51, 0xa3, 0x40, 0x8f, 0x92, 0x9d, 0x38, 0xf5, 0xbc, 0xb6, 0xda, 0x21, 0x10, 0xff, 0xf3, 0xd2,
+    0xcd, 0x0c, 0x13, 0xec, 0x5f, 0x97, 0x44, 0x17, 0xc4, 0xa7, 0x7e, 0x3d, 0x64, 0x5d, 0x19, 0x73,
+    0x60, 0x81, 0x4f, 0xdc, 0x22, 0x2a, 0x90, 0x88, 0x46, 0xee, 0xb8, 0x14, 0xde, 0x5e, 0x0b, 0xdb,
+    0xe0, 0x32, 0x3a, 0x0a, 0x49, 0x06, 0x24, 0x5c, 0xc2, 0xd3, 0xac, 0x62, 0x91, 0x95, 0xe4, 0x79,
+    0xe7, 0xc8, 0x37, 0x6d, 0x8d, 0xd5, 0x4e, 0xa9, 0x6c, 0x56, 0xf4, 0xea, 0x65, 0x7a, 0xae, 0x08,
+    0xba, 0x78, 0x25, 0x2e, 0x1c, 0xa6, 0xb4, 0xc6, 0xe8, 0xdd, 0x74, 0x1f, 0x4b, 0xbd, 0x8b, 0x8a,
+    0x70, 0x3e, 0xb5, 0x66, 0x48, 0x03, 0xf6, 0x0e, 0x61, 0x35, 0x57, 0xb9, 0x86, 0xc1, 0x1d, 0x9e,
+    0xe1, 0xf8, 0x98, 0x11, 0x69, 0xd9, 0x8e, 0x94, 0x9b, 0x1e, 0x87, 0xe9, 0xce, 0x55, 0x28, 0xdf,
+    0x8c, 0xa1, 0x89, 0x0d, 0xbf, 0xe6, 0x42, 0x68, 0x41, 0x99, 0x2d, 0x0f, 0xb0, 0x54, 0xbb, 0x16
+};
+
+/* Multiplication by x in GF(2^8) */
+#define XTIME(x) ((uint8_t)(((x) << 1) ^ (((x) >> 7) * 0x1B)))
+#endif
+
+/* Function implementations */
+
+void asmart_secure_init(aSmart_Secure_t* secure){
+    memset(secure, 0, sizeof(*secure));
+}
+
+uint8_t asmart_secure_set_key(aSmart_Secure_t* secure, uint8_t address, const uint8_t* key, uint32_t tx_counter){
+    SecureLink_t* link = asmart_secure_find(secure, address);
+
+    if (key == NULL) {
+        if (link != NULL) {
+            memset(link, 0, sizeof(*link));
+        }
+        return 1;
+    }
+    for (uint8_t i = 0; link == NULL && i < SECURE_LINKS; i++) {
+        if (secure->links[i].address == 0) {
+            link = &secure->links[i];
+        }
+    }
+    if (link == NULL || address == 0) {
+        return 0;
+    }
+
+    link->address = address;
+    link->tx_counter = (tx_counter != 0) ? tx_counter : 1;
+    link->rx_highest = 0;
+    link->rx_window = 0;
+#if SECURE_HARDWARE
+    for (uint8_t i = 0; i < SECURE_KEY_SIZE / 4; i++) {
+        link->key[i] = ((uint32_t)key[4 * i] << 24) | ((uint32_t)key[4 * i + 1] << 16) | ((uint32_t)key[4 * i + 2] << 8) | key[4 * i + 3];
+    }
+#else
+    aes_expand_key(key, link->round_keys);
+#endif
+#if ASMART_COMM_HOST
+    link->cipher = asmart_aesni_cipher();
+    if (link->cipher == NULL) {
+        link->cipher = aes_encrypt_block;
+    }
+#endif
+    return 1;
+}
+
+void asmart_secure_restore_rx(SecureLink_t* link, uint32_t rx_highest){
+    /* Which counters below it arrived is not known any more: the whole window counts as seen */
+    link->rx_highest = rx_highest;
+    link->rx_window = (rx_highest != 0) ? 0xFFFFFFFFUL : 0;
+}
+
+uint8_t asmart_secure_ccm(SecureLink_t* link, const uint8_t* nonce, const uint8_t* aad, uint16_t aad_length, uint8_t* data, uint16_t length, uint8_t* tag, uint8_t encrypt){
+    if (aad_length > SECURE_MAX_AAD) {
+        return 0;
+    }
+#if SECURE_HARDWARE
+    return hardware_ccm(link, nonce, aad, aad_length, data, length, tag, encrypt);
+#else
+    software_ccm(link, nonce, aad, aad_length, data, length, tag, encrypt);
+    return 1;
+#endif
+}
+
+SecureLink_t* asmart_secure_find(aSmart_Secure_t* secure, uint8_t address){
+    for (uint8_t i = 0; i < SECURE_LINKS; i++) {
+        if (secure->links[i].address == address && address != 0) {
+            return &secure->links[i];
+        }
+    }
+    return NULL;
+}
+
+uint8_t asmart_secure_seal(SecureLink_t* link, uint8_t source, uint8_t destination, const uint8_t* aad, uint16_t aad_length, uint8_t* payload, uint16_t length){
+    uint8_t nonce[SECURE_NONCE_SIZE];
+    uint32_t counter = link->tx_counter;
+
+    /* A counter is never used twice under a key; a new key starts them afresh */
+    if (counter == 0 || aad_length > SECURE_MAX_AAD) {
+        return 0;
+    }
+    build_nonce(nonce, source, destination, counter);
+    if (!asmart_secure_ccm(link, nonce, aad, aad_length, payload, length, &payload[length + SECURE_COUNTER_SIZE], 1)) {
+        return 0;
+    }
+    payload[length] = (counter >> 24) & 0xFF;
+    payload[length + 1] = (counter >> 16) & 0xFF;
+    payload[length + 2] = (counter >> 8) & 0xFF;
+    payload[length + 3] = counter & 0xFF;
+    link->tx_counter = counter + 1;
+    return 1;
+}
+
+secure_open_t asmart_secure_open(SecureLink_t* link, uint8_t source, uint8_t destination, const uint8_t* aad, uint16_t aad_length, uint8_t* payload, uint16_t length){
+    uint8_t nonce[SECURE_NONCE_SIZE];
+    uint8_t tag[SECURE_TAG_SIZE];
+    uint8_t difference = 0;
+
+    if (length < SECURE_OVERHEAD || aad_length > SECURE_MAX_AAD) {
+        return SECURE_OPEN_FAILED;
+    }
+    length -= SECURE_OVERHEAD;
+
+    uint8_t* trailer = &payload[length];
+    uint32_t counter = ((uint32_t)trailer[0] << 24) | ((uint32_t)trailer[1] << 16) | ((uint32_t)trailer[2] << 8) | trailer[3];
+    if (counter == 0) {
+        return SECURE_OPEN_FAILED;
+    }
+    build_nonce(nonce, source, destination, counter);
+    if (!asmart_secure_ccm(link, nonce, aad, aad_length, payload, length, tag, 0)) {
+        return SECURE_OPEN_FAILED;
+    }
+
+    /* Compared in constant time, the position of a mismatch is not revealed */
+    for (uint8_t i = 0; i < SECURE_TAG_SIZE; i++) {
+        difference |= tag[i] ^ trailer[SECURE_COUNTER_SIZE + i];
+    }
+    if (difference != 0) {
+        return SECURE_OPEN_FAILED;
+    }
+    return accept_counter(link, counter) ? SECURE_OPEN_OK : SECURE_OPEN_REPLAYED;
+}
+
+/* Internal function implementations */
+
+static void build_nonce(uint8_t* nonce, uint8_t source, uint8_t destination, uint32_t counter){
+    memset(nonce, 0, SECURE_NONCE_SIZE);
+    nonce[0] = source;
+    nonce[1] = destination;
+    nonce[2] = (counter >> 24) & 0xFF;
+    nonce[3] = (counter >> 16) & 0xFF;
+    nonce[4] = (counter >> 8) & 0xFF;
+    nonce[5] = counter & 0xFF;
+}
+
+static uint8_t accept_counter(SecureLink_t* link, uint32_t counter){
+    if (link->rx_highest == 0) {
+        link->rx_highest = counter;
+        link->rx_window = 0;
+        return 1;
+    }
+
+    /* Ahead of the window: slide it, the previous highest becomes bit shift - 1 */
+    if (counter > link->rx_highest) {
+        uint32_t shift = counter - link->rx_highest;
+
+        if (shift > SECURE_REPLAY_WINDOW) {
+            link->rx_window = 0;
+        }
+        else if (shift == SECURE_REPLAY_WINDOW) {
+            link->rx_window = 1UL << (SECURE_REPLAY_WINDOW - 1);
+        }
+        else {
+            link->rx_window = (link->rx_window << shift) | (1UL << (shift - 1));
+        }
+        link->rx_highest = counter;
+        return 1;
+    }
+
+    /* Within the window, each counter once */
+    uint32_t age = link->rx_highest - counter;
+    if (age == 0 || age > SECURE_REPLAY_WINDOW || (link->rx_window & (1UL << (age - 1)))) {
+        return 0;
+    }
+    link->rx_window |= 1UL << (age - 1);
+    return 1;
+}
+
+#if SECURE_HARDWARE
+static uint8_t hardware_ccm(SecureLink_t* link, const uint8_t* nonce, const uint8_t* aad, uint16_t aad_length, uint8_t* data, uint16_t length, uint8_t* tag, uint8_t encrypt){
+    static uint32_t work[(((RECEIVE_BUFFER_SIZE > TRANSMIT_BUFFER_SIZE) ? RECEIVE_BUFFER_SIZE : TRANSMIT_BUFFER_SIZE) + 3) / 4];
+    uint32_t header[4];
+    uint32_t b0[4];
+    uint32_t full_tag[4];
+    uint8_t block[16];
+    CRYP_ConfigTypeDef config;
+
+    if (length > sizeof(work)) {
+        return 0;
+    }
+
+    /* B0 is loaded into the IV registers, which take big-endian words; header and data pass the byte swap */
+    block[0] = CCM_FLAGS_B0;
+    memcpy(&block[1], nonce, SECURE_NONCE_SIZE);
+    block[14] = (length >> 8) & 0xFF;
+    block[15] = length & 0xFF;
+    for (uint8_t i = 0; i < 4; i++) {
+        b0[i] = ((uint32_t)block[4 * i] << 24) | ((uint32_t)block[4 * i + 1] << 16) | ((uint32_t)block[4 * i + 2] << 8) | block[4 * i + 3];
+    }
+    memset(header, 0, sizeof(header));
+    ((uint8_t*)header)[0] = (aad_length >> 8) & 0xFF;
+    ((uint8_t*)header)[1] = aad_length & 0xFF;
+    memcpy(&((uint8_t*)header)[2], aad, aad_length);
+
+    HAL_CRYP_GetConfig(&SECURE_CRYP, &config);
+    config.DataType = CRYP_DATATYPE_8B;
+    config.KeySize = CRYP_KEYSIZE_128B;
+    config.pKey = link->key;
+    config.Algorithm = CRYP_AES_CCM;
+    config.B0 = b0;
+    config.Header = header;
+    config.HeaderSize = sizeof(header) / 4;
+    config.HeaderWidthUnit = CRYP_HEADERWIDTHUNIT_WORD;
+    config.DataWidthUnit = CRYP_DATAWIDTHUNIT_BYTE;
+    config.KeyIVConfigSkip = CRYP_KEYIVCONFIG_ALWAYS;
+    if (HAL_CRYP_SetConfig(&SECURE_CRYP, &config) != HAL_OK) {
+        return 0;
+    }
+
+    /* The DMA moves the payload through the peripheral; frames are short, so wait for it here */
+    memcpy(work, data, length);
+    HAL_StatusTypeDef status = encrypt ? HAL_CRYP_Encrypt_DMA(&SECURE_CRYP, work, length, work) : HAL_CRYP_Decrypt_DMA(&SECURE_CRYP, work, length, work);
+    if (status != HAL_OK) {
+        return 0;
+    }
+    uint32_t since = asmart_comm_now();
+    while (HAL_CRYP_GetState(&SECURE_CRYP) != HAL_CRYP_STATE_READY) {
+        if (asmart_comm_now() - since > SECURE_HARDWARE_TIMEOUT_MS) {
+            return 0;
+        }
+    }
+    if (HAL_CRYPEx_AESCCM_GenerateAuthTAG(&SECURE_CRYP, full_tag, SECURE_HARDWARE_TIMEOUT_MS) != HAL_OK) {
+        return 0;
+    }
+    memcpy(data, work, length);
+    memcpy(tag, full_tag, SECURE_TAG_SIZE);
+    return 1;
+}
+#else
+static void aes_expand_key(const uint8_t* key, uint8_t* round_keys){
+    uint8_t rcon = 0x01;
+
+    memcpy(round_keys, key, SECURE_KEY_SIZE);
+    for (uint16_t i = SECURE_KEY_SIZE; i < SECURE_ROUND_KEYS; i += 4) {
+        uint8_t word[4] = { round_keys[i - 4], round_keys[i - 3], round_keys[i - 2], round_keys[i - 1] };
+
+        /* First word of a round key: RotWord, SubWord and the round constant */
+        if (i % SECURE_KEY_SIZE == 0) {
+            uint8_t first = word[0];
+
+            word[0] = sbox[word[1]] ^ rcon;
+            word[1] = sbox[word[2]];
+            word[2] = sbox[word[3]];
+            word[3] = sbox[first];
+            rcon = XTIME(rcon);
+        }
+        for (uint8_t j = 0; j < 4; j++) {
+            round_keys[i + j] = round_keys[i + j - SECURE_KEY_SIZE] ^ word[j];
+        }
+    }
+}
+
+static void aes_encrypt_block(const uint8_t* round_keys, const uint8_t* in, uint8_t* out){
+    uint8_t state[16];
+    uint8_t shifted[16];
+
+    for (uint8_t i = 0; i < 16; i++) {
+        state[i] = in[i] ^ round_keys[i];
+    }
+    for (uint8_t round = 1; round <= 10; round++) {
+        /* SubBytes and ShiftRows: row r of column c comes from column c + r */
+        for (uint8_t c = 0; c < 4; c++) {
+            for (uint8_t r = 0; r < 4; r++) {
+                shifted[4 * c + r] = sbox[state[4 * ((c + r) & 3) + r]];
+            }
+        }
+        /* MixColumns, except in the last round */
+        if (round < 10) {
+            for (uint8_t c = 0; c < 16; c += 4) {
+                uint8_t a0 = shifted[c];
+                uint8_t a1 = shifted[c + 1];
+                uint8_t a2 = shifted[c + 2];
+                uint8_t a3 = shifted[c + 3];
+                uint8_t all = a0 ^ a1 ^ a2 ^ a3;
+
+                shifted[c] = a0 ^ all ^ XTIME(a0 ^ a1);
+                shifted[c + 1] = a1 ^ all ^ XTIME(a1 ^ a2);
+                shifted[c + 2] = a2 ^ all ^ XTIME(a2 ^ a3);
+                shifted[c + 3] = a3 ^ all ^ XTIME(a3 ^ a0);
+            }
+        }
+        for (uint8_t i = 0; i < 16; i++) {
+            state[i] = shifted[i] ^ round_keys[16 * round + i];
+        }
+    }
+    memcpy(out, state, 16);
+}
+
+static void software_ccm(const SecureLink_t* link, const uint8_t* nonce, const uint8_t* aad, uint16_t aad_length, uint8_t* data, uint16_t length, uint8_t* tag, uint8_t encrypt){
+#if ASMART_COMM_HOST
+    SecureBlockCipher cipher = link->cipher;
+#else
+    SecureBlockCipher cipher = aes_encrypt_block;
+#endif
+    uint8_t mac[16];
+    uint8_t counter[16];
+    uint8_t stream[16];
+
+    /* CBC-MAC over B0 (flags, nonce, payload length) and the header block (its length, the header, zero padding) */
+    mac[0] = CCM_FLAGS_B0;
+    memcpy(&mac[1], nonce, SECURE_NONCE_SIZE);
+    mac[14] = (length >> 8) & 0xFF;
+    mac[15] = length & 0xFF;
+    cipher(link->round_keys, mac, mac);
+    mac[0] ^= (aad_length >> 8) & 0xFF;
+    mac[1] ^= aad_length & 0xFF;
+    for (uint16_t i = 0; i < aad_length; i++) {
+        mac[2 + i] ^= aad[i];
+    }
+    cipher(link->round_keys, mac, mac);
+
+    /* Payload: counter mode from block 1, the MAC runs over the plaintext */
+    counter[0] = CCM_FLAGS_COUNTER;
+    memcpy(&counter[1], nonce, SECURE_NONCE_SIZE);
+    for (uint16_t offset = 0, block = 1; offset < length; offset += 16, block++) {
+        uint16_t count = (length - offset < 16) ? length - offset : 16;
+
+        counter[14] = (block >> 8) & 0xFF;
+        counter[15] = block & 0xFF;
+        cipher(link->round_keys, counter, stream);
+        for (uint16_t i = 0; i < count; i++) {
+            if (encrypt) {
+                mac[i] ^= data[offset + i];
+                data[offset + i] ^= stream[i];
+            }
+            else {
+                data[offset + i] ^= stream[i];
+                mac[i] ^= data[offset + i];
+            }
+        }
+        cipher(link->round_keys, mac, mac);
+    }
+
+    /* Tag: the MAC encrypted with counter block 0 */
+    counter[14] = 0;
+    counter[15] = 0;
+    cipher(link->round_keys, counter, stream);
+    for (uint8_t i = 0; i < SECURE_TAG_SIZE; i++) {
+        tag[i] = mac[i] ^ stream[i];
+    }
+}
+#endif
@@ -0,0 +1,313 @@
+#include "asmart_comm_spi.h"
+
+/***********************************************************************************************
+ *                                SPI Transport                                                 *
+ ***********************************************************************************************
+ *
+ * - Sending: the handler's frames queue in the link as a stream of bytes. Every transfer takes
+ *   the next SPI_SLOT_DATA bytes of it into its slot behind the header, so short frames share a
+ *   slot and a long one spans several. The rest of the slot is padding.
+ * - Receiving: a slot with the magic and a valid length passes its bytes to the handler's
+ *   parser. Every slot carries the next sequence number; a gap means a slot was lost, and the
+ *   frame the parser had begun is dropped. The protocol's retransmission takes over from there.
+ * - Master: starts a transfer when it has bytes to send or the slave raises the data-ready
+ *   line, from the main loop or the data-ready interrupt, at least SPI_REARM_US after the last.
+ * - Slave: re-arms the next transfer from the DMA complete interrupt, filled with what it has,
+ *   and keeps the data-ready line up while that slot or its queue holds bytes. Bytes queued
+ *   after a slot was armed with nothing go in the slot after it.
+ *
+ ***********************************************************************************************/
+
+/**
+ * @brief Sends the handler's frames through the link, see FrameWriter.
+ * @param context Pointer to the link.
+ * @param destination Destination address of the frame.
+ * @param frame Pointer to the frame.
+ * @param length Frame length.
+ * @retval None
+ */
+static void write_frame(void* context, uint8_t destination, const uint8_t* frame, uint16_t length);
+
+/**
+ * @brief Fills the slot from the queue and starts the transfer; the bytes leave the queue once
+ *        it has started.
+ * @note Runs with interrupts disabled.
+ * @param link Pointer to the link structure.
+ * @retval 1 if started, 0 if the driver could not start it.
+ */
+static uint8_t start_transfer(aSmart_SpiLink_t* link);
+
+/**
+ * @brief Passes the frame bytes of a received slot to the handler's parser.
+ * @param link Pointer to the link structure.
+ * @retval None
+ */
+static void take_slot(aSmart_SpiLink_t* link);
+
+/**
+ * @brief Slave: raises the data-ready line while the armed slot or the queue holds bytes.
+ * @param link Pointer to the link structure.
+ * @retval None
+ */
+static void update_ready(aSmart_SpiLink_t* link);
+
+void asmart_spi_init(aSmart_SpiLink_t* link, aSmart_Comm_Handler_t* handler, uint8_t role, const aSmart_SpiDriver_t* driver_functions, void* driver, ResponseCallback response_callback){
+    memset(link, 0, sizeof(*link));
+    link->handler = handler;
+    link->driver_functions = driver_functions;
+    link->driver = driver;
+    link->role = role;
+    asmart_comm_init_transport(handler, write_frame, link, response_callback);
+}
+
+void asmart_spi_complete(aSmart_SpiLink_t* link, uint8_t ok){
+    link->busy = 0;
+    link->transfers++;
+    if (ok) {
+        take_slot(link);
+    }
+    else {
+        link->rx_errors++;
+    }
+
+    /* The slave must be armed again before the master clocks the next transfer */
+    if (link->role == SPI_ROLE_SLAVE) {
+        start_transfer(link);
+        update_ready(link);
+    }
+}
+
+uint32_t asmart_spi_service(aSmart_SpiLink_t* link){
+    uint32_t deadline = ASMART_COMM_NO_DEADLINE;
+
+    /* The DMA complete interrupt works on the same state */
+    uint32_t primask = __get_PRIMASK();
+    __disable_irq();
+    if (!link->busy) {
+        uint8_t due = (link->role == SPI_ROLE_SLAVE) || link->queue_count > 0 || link->driver_functions->get_ready(link->driver);
+
+        if (due && !start_transfer(link)) {
+            deadline = 0;
+        }
+        if (link->role == SPI_ROLE_SLAVE) {
+            update_ready(link);
+        }
+    }
+    __set_PRIMASK(primask);
+    return deadline;
+}
+
+uint16_t asmart_spi_tx_room(const aSmart_SpiLink_t* link){
+    return SPI_TX_QUEUE_SIZE - link->queue_count;
+}
+
+/* Internal function implementations */
+
+static void write_frame(void* context, uint8_t destination, const uint8_t* frame, uint16_t length){
+    aSmart_SpiLink_t* link = (aSmart_SpiLink_t*)context;
+    (void)destination;
+
+    uint32_t primask = __get_PRIMASK();
+    __disable_irq();
+    if (link->queue_count + length > SPI_TX_QUEUE_SIZE) {
+        link->tx_drops++;
+    }
+    else {
+        uint16_t tail = (link->queue_head + link->queue_count) % SPI_TX_QUEUE_SIZE;
+
+        for (uint16_t i = 0; i < length; i++) {
+            link->queue[(tail + i) % SPI_TX_QUEUE_SIZE] = frame[i];
+        }
+        link->queue_count += length;
+        if (link->role == SPI_ROLE_MASTER) {
+            if (!link->busy) {
+                start_transfer(link);
+            }
+        }
+        else {
+            update_ready(link);
+        }
+    }
+    __set_PRIMASK(primask);
+}
+
+static uint8_t start_transfer(aSmart_SpiLink_t* link){
+    uint16_t length = (link->queue_count > SPI_SLOT_DATA) ? SPI_SLOT_DATA : link->queue_count;
+    uint16_t first = SPI_TX_QUEUE_SIZE - link->queue_head;
+
+    link->tx_slot[0] = SPI_SLOT_MAGIC;
+    link->tx_slot[1] = link->tx_sequence;
+    link->tx_slot[2] = (uint8_t)(length >> 8);
+    link->tx_slot[3] = (uint8_t)length;
+
+    /* The bytes may wrap around the end of the ring */
+    if (first >= length) {
+        memcpy(&link->tx_slot[SPI_SLOT_HEADER], &link->queue[link->queue_head], length);
+    }
+    else {
+        memcpy(&link->tx_slot[SPI_SLOT_HEADER], &link->queue[link->queue_head], first);
+        memcpy(&link->tx_slot[SPI_SLOT_HEADER + first], link->queue, length - first);
+    }
+    memset(&link->tx_slot[SPI_SLOT_HEADER + length], SPI_PADDING, SPI_SLOT_DATA - length);
+
+    if (!link->driver_functions->transfer(link->driver, link->tx_slot, link->rx_slot)) {
+        return 0;
+    }
+    link->busy = 1;
+    link->tx_sequence++;
+    link->queue_head = (link->queue_head + length) % SPI_TX_QUEUE_SIZE;
+    link->queue_count -= length;
+    link->tx_bytes += length;
+    return 1;
+}
+
+static void take_slot(aSmart_SpiLink_t* link){
+    uint16_t length = ((uint16_t)link->rx_slot[2] << 8) | link->rx_slot[3];
+    aSmart_Parser_t* parser = &link->handler->rx_handler.parser;
+
+    if (link->rx_slot[0] != SPI_SLOT_MAGIC || length > SPI_SLOT_DATA) {
+        link->rx_errors++;
+        return;
+    }
+    if (link->rx_synced && link->rx_slot[1] != link->rx_sequence) {
+        /* A slot went missing, and with it the rest of the frame being parsed */
+        link->rx_errors++;
+        if (parser->state != PARSER_STATE_WAIT_STX && parser->state != PARSER_STATE_FORWARD) {
+            asmart_parser_reset(parser);
+        }
+    }
+    link->rx_sequence = link->rx_slot[1] + 1;
+    link->rx_synced = 1;
+    if (length > 0) {
+        asmart_comm_receive_bytes(link->handler, &link->rx_slot[SPI_SLOT_HEADER], length);
+        link->rx_bytes += length;
+    }
+}
+
+static void update_ready(aSmart_SpiLink_t* link){
+    uint8_t armed_bytes = link->busy && (link->tx_slot[2] != 0 || link->tx_slot[3] != 0);
+
+    link->driver_functions->set_ready(link->driver, link->busy && (armed_bytes || link->queue_count > 0));
+}
+
+#if !ASMART_COMM_HOST && defined(HAL_SPI_MODULE_ENABLED)
+/* Links by SPI, for the HAL callbacks */
+static aSmart_SpiLink_t* spi_links[SPI_PORTS];
+
+/**
+ * @brief Returns the link of an SPI.
+ * @param hspi SPI handle passed to a HAL callback.
+ * @retval Pointer to the link, NULL if the SPI has none.
+ */
+static aSmart_SpiLink_t* find_link(SPI_HandleTypeDef* hspi);
+
+/**
+ * @brief Ends a transfer: releases the chip select and hands the slot to the link.
+ * @param hspi SPI handle.
+ * @param ok 1 if the transfer completed, 0 on an error.
+ * @retval None
+ */
+static void end_transfer(SPI_HandleTypeDef* hspi, uint8_t ok);
+
+/* Driver functions of asmart_spi_hal_driver, see aSmart_SpiDriver_t */
+static uint8_t hal_transfer(void* driver, const uint8_t* tx, uint8_t* rx);
+static void hal_set_ready(void* driver, uint8_t level);
+static uint8_t hal_get_ready(void* driver);
+
+const aSmart_SpiDriver_t asmart_spi_hal_driver = { hal_transfer, hal_set_ready, hal_get_ready };
+
+void asmart_spi_hal_start(aSmart_SpiLink_t* link){
+    aSmart_SpiPort_t* port = (aSmart_SpiPort_t*)link->driver;
+
+    /* Take the SPI's entry, or the first free one */
+    for (uint8_t i = 0; i < SPI_PORTS; i++) {
+        if (spi_links[i] == NULL || spi_links[i]->driver == link->driver) {
+            spi_links[i] = link;
+            break;
+        }
+    }
+    if (link->role == SPI_ROLE_MASTER && port->nss_port != NULL) {
+        HAL_GPIO_WritePin(port->nss_port, port->nss_pin, GPIO_PIN_SET);
+    }
+    if (link->role == SPI_ROLE_SLAVE) {
+        HAL_GPIO_WritePin(port->ready_port, port->ready_pin, GPIO_PIN_RESET);
+    }
+    port->last_end_us = asmart_comm_now_us();
+    asmart_spi_service(link);
+}
+
+/**
+ * @brief Transfer complete callback of the SPI's DMA.
+ * @param hspi SPI handle.
+ * @retval None
+ */
+void HAL_SPI_TxRxCpltCallback(SPI_HandleTypeDef* hspi){
+    end_transfer(hspi, 1);
+}
+
+/**
+ * @brief SPI error callback, e.g. an overrun; the HAL has aborted the transfer.
+ * @param hspi SPI handle.
+ * @retval None
+ */
+void HAL_SPI_ErrorCallback(SPI_HandleTypeDef* hspi){
+    end_transfer(hspi, 0);
+}
+
+static aSmart_SpiLink_t* find_link(SPI_HandleTypeDef* hspi){
+    for (uint8_t i = 0; i < SPI_PORTS; i++) {
+        if (spi_links[i] != NULL && ((aSmart_SpiPort_t*)spi_links[i]->driver)->hspi == hspi) {
+            return spi_links[i];
+        }
+    }
+    return NULL;
+}
+
+static void end_transfer(SPI_HandleTypeDef* hspi, uint8_t ok){
+    aSmart_SpiLink_t* link = find_link(hspi);
+    aSmart_SpiPort_t* port;
+
+    if (link == NULL) {
+        return;
+    }
+    port = (aSmart_SpiPort_t*)link->driver;
+    if (link->role == SPI_ROLE_MASTER && port->nss_port != NULL) {
+        HAL_GPIO_WritePin(port->nss_port, port->nss_pin, GPIO_PIN_SET);
+    }
+    port->last_end_us = asmart_comm_now_us();
+    asmart_spi_complete(link, ok);
+}
+
+static uint8_t hal_transfer(void* driver, const uint8_t* tx, uint8_t* rx){
+    aSmart_SpiPort_t* port = (aSmart_SpiPort_t*)driver;
+    aSmart_SpiLink_t* link = find_link(port->hspi);
+    uint8_t master = (link != NULL && link->role == SPI_ROLE_MASTER);
+
+    /* Give the slave time to arm its next transfer */
+    if (master && asmart_comm_now_us() - port->last_end_us < SPI_REARM_US) {
+        return 0;
+    }
+    if (master && port->nss_port != NULL) {
+        HAL_GPIO_WritePin(port->nss_port, port->nss_pin, GPIO_PIN_RESET);
+    }
+    if (HAL_SPI_TransmitReceive_DMA(port->hspi, (uint8_t*)tx, rx, SPI_SLOT_SIZE) != HAL_OK) {
+        if (master && port->nss_port != NULL) {
+            HAL_GPIO_WritePin(port->nss_port, port->nss_pin, GPIO_PIN_SET);
+        }
+        return 0;
+    }
+    return 1;
+}
+
+static void hal_set_ready(void* driver, uint8_t level){
+    aSmart_SpiPort_t* port = (aSmart_SpiPort_t*)driver;
+
+    HAL_GPIO_WritePin(port->ready_port, port->ready_pin, level ? GPIO_PIN_SET : GPIO_PIN_RESET);
+}
+
+static uint8_t hal_get_ready(void* driver){
+    aSmart_SpiPort_t* port = (aSmart_SpiPort_t*)driver;
+
+    return HAL_GPIO_ReadPin(port->ready_port, port->ready_pin) == GPIO_PIN_SET;
+}
+#endif
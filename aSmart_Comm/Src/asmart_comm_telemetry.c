@@ -0,0 +1,211 @@
+#include "asmart_comm_telemetry.h"
+#include <string.h>
+
+/***********************************************************************************************
+ *                                Delta-Encoded Telemetry                                       *
+ ***********************************************************************************************
+ *
+ * - A telemetry stream sends the same encoded snapshot (a fixed list of fields) periodically.
+ * - Every sample is numbered; both sides keep the last TELEMETRY_HISTORY samples in a ring
+ *   indexed by sample number.
+ * - The receiver acknowledges every TELEMETRY_ACK_INTERVAL-th rebuilt sample and every
+ *   keyframe; the acknowledged sample becomes the sender's baseline.
+ * - A delta names its baseline and carries a bitmap of the fields that differ from it,
+ *   followed by their values. The receiver copies the baseline from its ring and overwrites
+ *   the changed fields, so the application always sees the full snapshot.
+ * - Keyframes (whole snapshot) are sent when there is no usable baseline, every
+ *   keyframe_interval samples and when the receiver asks for one because it lacks the baseline.
+ *
+ ***********************************************************************************************/
+
+static uint8_t init_layout(TelemetryLayout_t* layout, const uint8_t* field_sizes, uint8_t field_count){
+    uint16_t size = 0;
+
+    for (uint8_t i = 0; i < field_count; i++) {
+        size += field_sizes[i];
+    }
+    layout->field_sizes = field_sizes;
+    layout->field_count = field_count;
+    layout->snapshot_size = size;
+
+    /* An unusable layout leaves the stream disabled */
+    if (field_count == 0 || field_count > TELEMETRY_MAX_FIELDS || size == 0 || size > TELEMETRY_MAX_SNAPSHOT) {
+        layout->snapshot_size = 0;
+        return 0;
+    }
+    return 1;
+}
+
+void asmart_telemetry_tx_init(aSmart_TelemetryTx_t* tx, uint8_t notification_type, uint8_t destination, const uint8_t* field_sizes, uint8_t field_count, uint8_t keyframe_interval){
+    memset(tx, 0, sizeof(*tx));
+    tx->notification_type = notification_type;
+    tx->destination = destination;
+    tx->keyframe_interval = keyframe_interval;
+    init_layout(&tx->layout, field_sizes, field_count);
+}
+
+void asmart_telemetry_rx_init(aSmart_TelemetryRx_t* rx, uint8_t notification_type, const uint8_t* field_sizes, uint8_t field_count){
+    memset(rx, 0, sizeof(*rx));
+    rx->notification_type = notification_type;
+    init_layout(&rx->layout, field_sizes, field_count);
+}
+
+uint16_t asmart_telemetry_encode(aSmart_TelemetryTx_t* tx, const uint8_t* snapshot, uint8_t* payload){
+    const TelemetryLayout_t* layout = &tx->layout;
+    uint8_t sample = tx->sample;
+    uint16_t index = 0;
+
+    if (layout->snapshot_size == 0) {
+        return 0;
+    }
+
+    /* The receiver only holds the baseline while it is at most TELEMETRY_HISTORY samples back */
+    uint8_t keyframe = tx->force_keyframe || !tx->baseline.valid || (uint8_t)(sample - tx->baseline.sample) > TELEMETRY_HISTORY;
+    if (tx->keyframe_interval != 0 && tx->since_keyframe >= tx->keyframe_interval - 1) {
+        keyframe = 1;
+    }
+
+    if (keyframe) {
+        payload[index++] = TELEMETRY_KEYFRAME;
+        payload[index++] = sample;
+        memcpy(&payload[index], snapshot, layout->snapshot_size);
+        index += layout->snapshot_size;
+        tx->force_keyframe = 0;
+        tx->since_keyframe = 0;
+    }
+    else {
+        uint8_t bitmap_size = (layout->field_count + 7) / 8;
+        uint8_t* bitmap = &payload[3];
+        uint16_t offset = 0;
+
+        payload[index++] = TELEMETRY_DELTA;
+        payload[index++] = sample;
+        payload[index++] = tx->baseline.sample;
+        memset(bitmap, 0, bitmap_size);
+        index += bitmap_size;
+
+        /* Changed fields only, in field order */
+        for (uint8_t i = 0; i < layout->field_count; i++) {
+            uint8_t size = layout->field_sizes[i];
+            if (memcmp(&snapshot[offset], &tx->baseline.data[offset], size) != 0) {
+                bitmap[i >> 3] |= (1 << (i & 0x07));
+                memcpy(&payload[index], &snapshot[offset], size);
+                index += size;
+            }
+            offset += size;
+        }
+        tx->since_keyframe++;
+    }
+
+    /* Keep the sample until it is acknowledged or overwritten */
+    TelemetrySnapshot_t* sent = &tx->history[sample % TELEMETRY_HISTORY];
+    sent->sample = sample;
+    sent->valid = 1;
+    memcpy(sent->data, snapshot, layout->snapshot_size);
+
+    tx->sample = sample + 1;
+    return index;
+}
+
+void asmart_telemetry_ack(aSmart_TelemetryTx_t* tx, uint8_t sample){
+    TelemetrySnapshot_t* sent = &tx->history[sample % TELEMETRY_HISTORY];
+
+    /* The sample has to be one still kept, and newer than the current baseline */
+    if (!sent->valid || sent->sample != sample) {
+        return;
+    }
+    if (tx->baseline.valid && (int8_t)(sample - tx->baseline.sample) <= 0) {
+        return;
+    }
+    tx->baseline = *sent;
+}
+
+void asmart_telemetry_request_keyframe(aSmart_TelemetryTx_t* tx){
+    tx->force_keyframe = 1;
+}
+
+telemetry_result_t asmart_telemetry_decode(aSmart_TelemetryRx_t* rx, const uint8_t* payload, uint16_t length){
+    const TelemetryLayout_t* layout = &rx->layout;
+
+    if (layout->snapshot_size == 0 || length < 2) {
+        return TELEMETRY_INVALID;
+    }
+
+    uint8_t sample = payload[1];
+    TelemetrySnapshot_t* rebuilt = &rx->history[sample % TELEMETRY_HISTORY];
+
+    if (payload[0] == TELEMETRY_KEYFRAME) {
+        if (length != 2 + layout->snapshot_size) {
+            return TELEMETRY_INVALID;
+        }
+        memcpy(rebuilt->data, &payload[2], layout->snapshot_size);
+
+        /* Acknowledge right away so deltas can start */
+        rx->since_ack = TELEMETRY_ACK_INTERVAL - 1;
+        rx->keyframe_holdoff = 0;
+    }
+    else if (payload[0] == TELEMETRY_DELTA) {
+        uint8_t bitmap_size = (layout->field_count + 7) / 8;
+        const uint8_t* bitmap = &payload[3];
+
+        if (length < 3 + bitmap_size) {
+            return TELEMETRY_INVALID;
+        }
+
+        /* Validate the whole delta before touching the ring */
+        uint16_t expected = 3 + bitmap_size;
+        for (uint8_t i = 0; i < layout->field_count; i++) {
+            if (bitmap[i >> 3] & (1 << (i & 0x07))) {
+                expected += layout->field_sizes[i];
+            }
+        }
+        if (length != expected) {
+            return TELEMETRY_INVALID;
+        }
+
+        TelemetrySnapshot_t* baseline = &rx->history[payload[2] % TELEMETRY_HISTORY];
+        if (!baseline->valid || baseline->sample != payload[2]) {
+            /* Lost or too old: ask for a keyframe, then wait a few samples for it */
+            if (rx->keyframe_holdoff != 0) {
+                rx->keyframe_holdoff--;
+                return TELEMETRY_INVALID;
+            }
+            rx->keyframe_holdoff = TELEMETRY_HISTORY;
+            return TELEMETRY_NEED_KEYFRAME;
+        }
+
+        /* Baseline and sample may share a slot, the copy is skipped then */
+        if (rebuilt != baseline) {
+            memcpy(rebuilt->data, baseline->data, layout->snapshot_size);
+        }
+
+        const uint8_t* value = &payload[3 + bitmap_size];
+        uint16_t offset = 0;
+        for (uint8_t i = 0; i < layout->field_count; i++) {
+            uint8_t size = layout->field_sizes[i];
+            if (bitmap[i >> 3] & (1 << (i & 0x07))) {
+                memcpy(&rebuilt->data[offset], value, size);
+                value += size;
+            }
+            offset += size;
+        }
+    }
+    else {
+        return TELEMETRY_INVALID;
+    }
+
+    rebuilt->sample = sample;
+    rebuilt->valid = 1;
+    rx->last_sample = sample;
+    rx->snapshot = rebuilt->data;
+    rx->since_ack++;
+    return TELEMETRY_REBUILT;
+}
+
+uint8_t asmart_telemetry_ack_due(aSmart_TelemetryRx_t* rx){
+    if (rx->since_ack < TELEMETRY_ACK_INTERVAL) {
+        return 0;
+    }
+    rx->since_ack = 0;
+    return 1;
+}